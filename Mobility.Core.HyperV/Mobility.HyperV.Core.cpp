@@ -13,6 +13,44 @@
 #include <Mobility.Runtime.Core.h>
 #include <Mobility.Platform.x64.h>
 
+#include <Mile.Mobility.Utilities.MemoryAccess.h>
+
+namespace
+{
+    PHV_REFERENCE_TSC_PAGE g_ReferenceTscPage = nullptr;
+
+    /**
+     * @brief Calculates the high 64 bits of the 128-bit product of two
+     *        unsigned 64-bit integers.
+     */
+    static MO_UINT64 MoHyperVMultiplyHigh(
+        _Mo_In_ MO_UINT64 Multiplicand,
+        _Mo_In_ MO_UINT64 Multiplier)
+    {
+        MO_UINT64 MultiplicandLow = Multiplicand & MO_UINT32_MAX;
+        MO_UINT64 MultiplicandHigh = Multiplicand >> 32;
+        MO_UINT64 MultiplierLow = Multiplier & MO_UINT32_MAX;
+        MO_UINT64 MultiplierHigh = Multiplier >> 32;
+
+        MO_UINT64 LowLow = MultiplicandLow * MultiplierLow;
+        MO_UINT64 LowHigh = MultiplicandLow * MultiplierHigh;
+        MO_UINT64 HighLow = MultiplicandHigh * MultiplierLow;
+        MO_UINT64 HighHigh = MultiplicandHigh * MultiplierHigh;
+
+        MO_UINT64 Middle = (LowLow >> 32) +
+            (LowHigh & MO_UINT32_MAX) +
+            (HighLow & MO_UINT32_MAX);
+        return HighHigh + (LowHigh >> 32) + (HighLow >> 32) + (Middle >> 32);
+    }
+
+    static MO_UINT64 MOAPI MoHyperVReadReferenceClockSource(
+        _Mo_In_Opt_ MO_POINTER Context)
+    {
+        MO_UNREFERENCED_PARAMETER(Context);
+        return ::MoHyperVGetPartitionReferenceCounter();
+    }
+}
+
 MO_EXTERN_C MO_RESULT MOAPI MoHyperVCheckAvailability()
 {
     // Reference: Requirements for Implementing the Microsoft Hypervisor
@@ -84,6 +122,17 @@ MO_EXTERN_C MO_RESULT MOAPI MoHyperVCheckAvailability()
 
 MO_EXTERN_C MO_UINT64 MoHyperVGetPartitionReferenceCounter()
 {
+    if (g_ReferenceTscPage)
+    {
+        MO_UINT64 ReferenceTime = 0u;
+        if (MO_RESULT_SUCCESS_OK == ::MoHyperVReadReferenceTscPage(
+            &ReferenceTime,
+            g_ReferenceTscPage))
+        {
+            return ReferenceTime;
+        }
+    }
+
     return ::MoPlatformReadMsr(HvSyntheticMsrTimeRefCount);
 }
 
@@ -140,3 +189,113 @@ MO_EXTERN_C MO_BOOL MoHyperVSetInterruptEventFlagsPage(
     return ((0 != PhysicalAddress) == Config.SiefpEnabled) ? MO_TRUE : MO_FALSE;
 }
 
+MO_EXTERN_C MO_BOOL MoHyperVSetReferenceTscPage(
+    _Mo_In_ MO_UINT64 PhysicalAddress)
+{
+    HV_CPUID_RESULT HvCpuIdResult;
+
+    ::MoRuntimeMemoryFillByte(&HvCpuIdResult, 0, sizeof(HV_CPUID_RESULT));
+    ::MoPlatformReadCpuid(
+        reinterpret_cast<PMO_PLATFORM_X64_CPUID_RESULT>(&HvCpuIdResult),
+        HvCpuIdFunctionMsHvFeatures);
+    if (!HvCpuIdResult.MsHvFeatures.PartitionPrivileges
+        .AccessPartitionReferenceTsc)
+    {
+        return MO_FALSE;
+    }
+
+    // Stop using the old page before the hypervisor unmaps it.
+    g_ReferenceTscPage = nullptr;
+
+    // Bit 0 is the enable bit, and bits 12 to 63 are the guest physical page
+    // number of the reference TSC page. Bits 1 to 11 are reserved and must be
+    // preserved, so only replace the other bits of the current value.
+    MO_UINT64 Config = ::MoPlatformReadMsr(HvSyntheticMsrReferenceTsc);
+    Config &= 0xFFEULL;
+    if (PhysicalAddress)
+    {
+        Config |= (PhysicalAddress & ~0xFFFULL) | 1u;
+    }
+    ::MoPlatformWriteMsr(HvSyntheticMsrReferenceTsc, Config);
+
+    Config = ::MoPlatformReadMsr(HvSyntheticMsrReferenceTsc);
+    if ((0 != PhysicalAddress) != (0 != (Config & 1u)))
+    {
+        return MO_FALSE;
+    }
+
+    if (PhysicalAddress)
+    {
+        g_ReferenceTscPage = reinterpret_cast<PHV_REFERENCE_TSC_PAGE>(
+            PhysicalAddress & ~0xFFFULL);
+    }
+    return MO_TRUE;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoHyperVReadReferenceTscPage(
+    _Mo_Out_ PMO_UINT64 ReferenceTime,
+    _Mo_In_ PHV_REFERENCE_TSC_PAGE ReferenceTscPage)
+{
+    if (!ReferenceTime || !ReferenceTscPage)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    *ReferenceTime = 0u;
+
+    // Reference: Hypervisor Top Level Functional Specification
+    //            12.7.3 Partition Reference Time Enlightenment
+    //
+    // ReferenceTime = ((VirtualTsc * TscScale) >> 64) + TscOffset
+    //
+    // The hypervisor sets TscSequence to zero when the page cannot be used,
+    // and changes TscSequence after updating TscScale and TscOffset.
+
+    volatile MO_UINT32* TscSequence = &ReferenceTscPage->TscSequence;
+    volatile MO_UINT64* TscScale = &ReferenceTscPage->TscScale;
+    volatile MO_INT64* TscOffset = &ReferenceTscPage->TscOffset;
+
+    MO_UINT32 Sequence = 0u;
+    MO_UINT64 Tsc = 0u;
+    MO_UINT64 Scale = 0u;
+    MO_INT64 Offset = 0;
+    do
+    {
+        Sequence = *TscSequence;
+        if (!Sequence)
+        {
+            return MO_RESULT_ERROR_NO_INTERFACE;
+        }
+        MoMileCompilerBarrier();
+        Tsc = ::MoPlatformReadTimeStampCounter();
+        Scale = *TscScale;
+        Offset = *TscOffset;
+        MoMileCompilerBarrier();
+    } while (Sequence != *TscSequence);
+
+    *ReferenceTime = ::MoHyperVMultiplyHigh(Tsc, Scale) +
+        static_cast<MO_UINT64>(Offset);
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoHyperVInitializeReferenceClockSource(
+    _Mo_Out_ PMO_TIME_CLOCK_SOURCE Source)
+{
+    if (!Source)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    ::MoRuntimeMemoryFillByte(Source, 0, sizeof(MO_TIME_CLOCK_SOURCE));
+
+    if (!g_ReferenceTscPage)
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    Source->Name = "Hyper-V Reference TSC Page";
+    Source->Read = ::MoHyperVReadReferenceClockSource;
+    Source->Frequency = MO_HYPERV_REFERENCE_COUNTER_FREQUENCY;
+    Source->Mask = MO_UINT64_MAX;
+    Source->Rating = MO_TIME_CLOCK_SOURCE_RATING_HYPERV_REFERENCE_PAGE;
+
+    return MO_RESULT_SUCCESS_OK;
+}
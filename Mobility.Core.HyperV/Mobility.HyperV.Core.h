@@ -15,6 +15,14 @@
 
 #include <Mile.HyperV.VMBus.h>
 
+#include <Mobility.Time.Core.h>
+
+/**
+ * @brief The frequency in Hz of the Hyper-V Partition Reference Counter, which
+ *        counts in 100 nanosecond units.
+ */
+#define MO_HYPERV_REFERENCE_COUNTER_FREQUENCY 10000000
+
 /**
  * @brief Checks if the Hyper-V guest interface is available.
  * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
@@ -27,6 +35,11 @@ MO_EXTERN_C MO_RESULT MOAPI MoHyperVCheckAvailability();
 /**
  * @brief Retrieves the counter value from Hyper-V Partition Reference Counter.
  * @return The number in 100 nanosecond units.
+ * @remark If the reference TSC page is set by MoHyperVSetReferenceTscPage and
+ *         is valid, the value is calculated from the Time Stamp Counter (TSC)
+ *         without leaving the partition. Otherwise, the value is read from the
+ *         HvSyntheticMsrTimeRefCount MSR, which is intercepted by the
+ *         hypervisor.
  */
 MO_EXTERN_C MO_UINT64 MoHyperVGetPartitionReferenceCounter();
 
@@ -70,4 +83,49 @@ MO_EXTERN_C MO_BOOL MoHyperVSetInterruptMessagePage(
 MO_EXTERN_C MO_BOOL MoHyperVSetInterruptEventFlagsPage(
     _Mo_In_ MO_UINT64 PhysicalAddress);
 
+/**
+ * @brief Sets reference TSC page for the current Hyper-V partition.
+ * @param PhysicalAddress The physical address for the page, which must be
+ *                        identity mapped because the page is read through this
+ *                        address later. If this value is 0, the reference TSC
+ *                        page will be disabled.
+ * @return If the function succeeds, the return value is MO_TRUE. Otherwise, the
+ *         return value is MO_FALSE.
+ * @remarks If the partition does not have the AccessPartitionReferenceTsc
+ *          privilege, the function returns MO_FALSE.
+ */
+MO_EXTERN_C MO_BOOL MoHyperVSetReferenceTscPage(
+    _Mo_In_ MO_UINT64 PhysicalAddress);
+
+/**
+ * @brief Calculates the Hyper-V Partition Reference Counter value from the
+ *        reference TSC page.
+ * @param ReferenceTime The pointer to receive the counter value in 100
+ *                      nanosecond units.
+ * @param ReferenceTscPage The reference TSC page.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The scale and offset are read again if the hypervisor updates the
+ *          page during the calculation, which is detected by the change of the
+ *          TscSequence field.
+ *          If the TscSequence field is zero, the page is invalid and the
+ *          function returns MO_RESULT_ERROR_NO_INTERFACE. The caller should
+ *          read the HvSyntheticMsrTimeRefCount MSR instead.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoHyperVReadReferenceTscPage(
+    _Mo_Out_ PMO_UINT64 ReferenceTime,
+    _Mo_In_ PHV_REFERENCE_TSC_PAGE ReferenceTscPage);
+
+/**
+ * @brief Initializes the clock source for the Hyper-V Partition Reference
+ *        Counter backed by the reference TSC page.
+ * @param Source The clock source to be initialized.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the reference TSC page is not set by MoHyperVSetReferenceTscPage,
+ *          the function returns MO_RESULT_ERROR_NO_INTERFACE.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoHyperVInitializeReferenceClockSource(
+    _Mo_Out_ PMO_TIME_CLOCK_SOURCE Source);
+
 #endif // !MOBILITY_HYPERV_CORE
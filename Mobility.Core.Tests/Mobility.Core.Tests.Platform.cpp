@@ -0,0 +1,194 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Core.Tests.Platform.cpp
+ * PURPOSE:    Implementation for Mobility.Core Host-Side Platform Emulation
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Core.Tests.Platform.h"
+
+#include <Mobility.Platform.x64.SystemCall.h>
+
+#include <cstring>
+#include <thread>
+
+MO_TESTS_PLATFORM_STATE g_TestsPlatform;
+
+void MoTestsPlatformReset()
+{
+    std::memset(&g_TestsPlatform, 0, sizeof(g_TestsPlatform));
+    g_TestsPlatform.InterruptState =
+        0x2 | MO_TESTS_PLATFORM_RFLAGS_INTERRUPT_ENABLE;
+    g_TestsPlatform.InterProcessorInterruptResult = MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformPause()
+{
+    // The threads of the host can be preempted, so give up the time slice
+    // instead of spinning on a single processor.
+    std::this_thread::yield();
+}
+
+MO_EXTERN_C MO_UINTN MOAPI MoPlatformSaveAndDisableInterrupts()
+{
+    return g_TestsPlatform.InterruptState;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformRestoreInterrupts(
+    _Mo_In_ MO_UINTN InterruptState)
+{
+    MO_UNREFERENCED_PARAMETER(InterruptState);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformReadCpuid(
+    _Mo_Out_ PMO_PLATFORM_X64_CPUID_RESULT Result,
+    _Mo_In_ MO_UINT32 Index)
+{
+    MO_UNREFERENCED_PARAMETER(Index);
+
+    // No optional feature is reported.
+    std::memset(Result, 0, sizeof(*Result));
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformReadCpuidEx(
+    _Mo_Out_ PMO_PLATFORM_X64_CPUID_RESULT Result,
+    _Mo_In_ MO_UINT32 Index,
+    _Mo_In_ MO_UINT32 SubIndex)
+{
+    MO_UNREFERENCED_PARAMETER(SubIndex);
+
+    ::MoPlatformReadCpuid(Result, Index);
+}
+
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadMsr(
+    _Mo_In_ MO_UINT32 Index)
+{
+    MO_UNREFERENCED_PARAMETER(Index);
+
+    return 0;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteMsr(
+    _Mo_In_ MO_UINT32 Index,
+    _Mo_In_ MO_UINT64 Value)
+{
+    MO_UNREFERENCED_PARAMETER(Index);
+    MO_UNREFERENCED_PARAMETER(Value);
+}
+
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadCr0()
+{
+    return g_TestsPlatform.Cr0;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteCr0(
+    _Mo_In_ MO_UINT64 Value)
+{
+    g_TestsPlatform.Cr0 = Value;
+}
+
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadCr3()
+{
+    return g_TestsPlatform.Cr3;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteCr3(
+    _Mo_In_ MO_UINT64 Value)
+{
+    // The no-flush bit is not stored in CR3.
+    g_TestsPlatform.Cr3 = Value & ~(1ULL << 63);
+    ++g_TestsPlatform.Cr3Writes;
+}
+
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadCr4()
+{
+    return g_TestsPlatform.Cr4;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteCr4(
+    _Mo_In_ MO_UINT64 Value)
+{
+    g_TestsPlatform.Cr4 = Value;
+    ++g_TestsPlatform.Cr4Writes;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteBackInvalidateCache()
+{
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformInvalidatePage(
+    _Mo_In_ MO_UINT64 Address)
+{
+    MO_UNREFERENCED_PARAMETER(Address);
+
+    ++g_TestsPlatform.InvalidatedPages;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformInvalidateProcessContext(
+    _Mo_In_ MO_PLATFORM_X64_INVPCID_TYPE Type,
+    _Mo_In_ PMO_PLATFORM_X64_INVPCID_DESCRIPTOR Descriptor)
+{
+    MO_UNREFERENCED_PARAMETER(Descriptor);
+
+    g_TestsPlatform.LastProcessContextType = Type;
+    ++g_TestsPlatform.InvalidatedProcessContexts;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformSystemCallEntry()
+{
+    // SYSCALL is never executed, so the tests call
+    // MoPlatformSystemCallDispatch with the frame instead.
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformSetInterruptEntry(
+    _Mo_InOut_ PMO_PLATFORM_X64_IDT_GATE_DESCRIPTOR InterruptDescriptorTable,
+    _Mo_In_ MO_UINT8 Vector,
+    _Mo_In_ MO_UINT32 Tier)
+{
+    MO_UNREFERENCED_PARAMETER(InterruptDescriptorTable);
+    MO_UNREFERENCED_PARAMETER(Vector);
+    MO_UNREFERENCED_PARAMETER(Tier);
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformLocalApicEndOfInterrupt(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic)
+{
+    MO_UNREFERENCED_PARAMETER(Apic);
+
+    ++g_TestsPlatform.EndOfInterrupts;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformLocalApicSendInterProcessorInterrupt(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ MO_UINT32 DestinationId,
+    _Mo_In_ MO_UINT32 Command)
+{
+    MO_UNREFERENCED_PARAMETER(Apic);
+    MO_UNREFERENCED_PARAMETER(DestinationId);
+
+    if (MO_RESULT_SUCCESS_OK != g_TestsPlatform.InterProcessorInterruptResult)
+    {
+        return g_TestsPlatform.InterProcessorInterruptResult;
+    }
+    ++g_TestsPlatform.SentInterProcessorInterrupts;
+
+    if (g_TestsPlatform.LightweightHandlerTable)
+    {
+        MO_UINT8 Vector = static_cast<MO_UINT8>(Command & 0xFF);
+        PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER Handler =
+            g_TestsPlatform.LightweightHandlerTable[Vector];
+        for (MO_UINT32 i = 0;
+            Handler && i < g_TestsPlatform.SimulatedTargetCount;
+            ++i)
+        {
+            Handler(Vector, nullptr);
+        }
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
@@ -0,0 +1,103 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Core.Tests.Platform.h
+ * PURPOSE:    Definition for Mobility.Core Host-Side Platform Emulation
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_CORE_TESTS_PLATFORM
+#define MOBILITY_CORE_TESTS_PLATFORM
+
+#include <Mobility.Platform.x64.Apic.h>
+
+/**
+ * @brief The IF bit of RFLAGS, which is returned by the emulated
+ *        MoPlatformSaveAndDisableInterrupts if the interrupts are enabled.
+ */
+#define MO_TESTS_PLATFORM_RFLAGS_INTERRUPT_ENABLE 0x200
+
+/**
+ * @brief The emulated processor state used by the x64 platform routines, so
+ *        the portable parts of Mobility.Core run in the user mode of the host.
+ * @remarks The routines record the privileged operations instead of executing
+ *          them. The emulated inter-processor interrupts call the handler in
+ *          LightweightHandlerTable once for each simulated target processor
+ *          on the sending thread.
+ */
+typedef struct _MO_TESTS_PLATFORM_STATE
+{
+    /**
+     * @brief The value of CR0.
+     */
+    MO_UINT64 Cr0;
+    /**
+     * @brief The value of CR3.
+     */
+    MO_UINT64 Cr3;
+    /**
+     * @brief The value of CR4.
+     */
+    MO_UINT64 Cr4;
+    /**
+     * @brief The RFLAGS returned by MoPlatformSaveAndDisableInterrupts.
+     */
+    MO_UINTN InterruptState;
+    /**
+     * @brief The number of the CR3 writes.
+     */
+    MO_UINTN Cr3Writes;
+    /**
+     * @brief The number of the CR4 writes.
+     */
+    MO_UINTN Cr4Writes;
+    /**
+     * @brief The number of the pages invalidated with INVLPG.
+     */
+    MO_UINTN InvalidatedPages;
+    /**
+     * @brief The number of the INVPCID instructions.
+     */
+    MO_UINTN InvalidatedProcessContexts;
+    /**
+     * @brief The type of the last INVPCID instruction.
+     */
+    MO_PLATFORM_X64_INVPCID_TYPE LastProcessContextType;
+    /**
+     * @brief The result returned by the emulated
+     *        MoPlatformLocalApicSendInterProcessorInterrupt.
+     */
+    MO_RESULT InterProcessorInterruptResult;
+    /**
+     * @brief The number of the inter-processor interrupts sent successfully.
+     */
+    MO_UINTN SentInterProcessorInterrupts;
+    /**
+     * @brief The number of the simulated processors which receive the
+     *        inter-processor interrupts.
+     */
+    MO_UINT32 SimulatedTargetCount;
+    /**
+     * @brief The number of the End-Of-Interrupt (EOI) signals.
+     */
+    MO_UINTN EndOfInterrupts;
+    /**
+     * @brief The lightweight interrupt handler table used to deliver the
+     *        inter-processor interrupts, or nullptr if they are not delivered.
+     */
+    PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER* LightweightHandlerTable;
+} MO_TESTS_PLATFORM_STATE, *PMO_TESTS_PLATFORM_STATE;
+
+/**
+ * @brief The emulated processor state shared by all host threads.
+ */
+extern MO_TESTS_PLATFORM_STATE g_TestsPlatform;
+
+/**
+ * @brief Resets the emulated processor state, whose interrupts are enabled.
+ */
+void MoTestsPlatformReset();
+
+#endif // !MOBILITY_CORE_TESTS_PLATFORM
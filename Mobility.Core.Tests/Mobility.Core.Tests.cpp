@@ -0,0 +1,2706 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Core.Tests.cpp
+ * PURPOSE:    Implementation for Mobility.Core Host-Side Unit Tests
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include <Mile.Mobility.Portable.Types.h>
+
+#include <Mobility.Memory.RangeSet.h>
+#include <Mobility.Platform.x64.PageTable.h>
+#include <Mobility.Platform.x64.SystemCall.h>
+#include <Mobility.Platform.x64.Tlb.h>
+#include <Mobility.Scheduler.TaskPool.h>
+#include <Mobility.Service.Ring.h>
+#include <Mobility.Synchronization.RingQueue.h>
+#include <Mobility.Synchronization.SpinLock.h>
+#include <Mobility.Time.TimerWheel.h>
+
+#include "Mobility.Core.Tests.Platform.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief The base address of the simulated physical memory, which is not zero
+ *        because the page table builder rejects the null physical address.
+ */
+#define MO_TESTS_SIMULATED_MEMORY_BASE 0x100000ULL
+
+/**
+ * @brief The number of the 4 KiB pages in the simulated physical memory.
+ */
+#define MO_TESTS_SIMULATED_MEMORY_PAGES 64
+
+/**
+ * @brief The simulated physical memory for the paging structures.
+ */
+typedef struct _MO_TESTS_SIMULATED_MEMORY
+{
+    /**
+     * @brief The pages of the simulated physical memory.
+     */
+    MO_DECLSPEC_ALIGN(MO_PLATFORM_X64_PAGE_SIZE) MO_UINT8 Pages[
+        MO_TESTS_SIMULATED_MEMORY_PAGES][MO_PLATFORM_X64_PAGE_SIZE];
+    /**
+     * @brief The number of the allocated pages.
+     */
+    MO_UINTN AllocatedPages;
+    /**
+     * @brief The maximum number of the pages which can be allocated.
+     */
+    MO_UINTN PageLimit;
+} MO_TESTS_SIMULATED_MEMORY, *PMO_TESTS_SIMULATED_MEMORY;
+
+static MO_TESTS_SIMULATED_MEMORY g_SimulatedMemory;
+
+/**
+ * @brief The maximum number of the threads which contend for the same lock.
+ */
+#define MO_TESTS_CONTENTION_MAXIMUM_THREADS 4
+
+/**
+ * @brief The number of the lock acquisitions of each contending thread.
+ */
+#define MO_TESTS_CONTENTION_ITERATIONS 200000
+
+/**
+ * @brief The counter protected by the lock under contention, which is not
+ *        atomic so the lost updates reveal a broken mutual exclusion.
+ */
+static MO_UINTN volatile g_ContentionCounter = 0;
+
+/**
+ * @brief The number of the workers in the task pool tests, and all but the
+ *        first one run on their own threads.
+ */
+#define MO_TESTS_TASK_POOL_WORKERS 4
+
+/**
+ * @brief The capacity of each deque in the task pool tests, which is small so
+ *        the full deques are reached.
+ */
+#define MO_TESTS_TASK_POOL_DEQUE_CAPACITY 8
+
+/**
+ * @brief The number of the rounds in the task pool race test.
+ */
+#define MO_TESTS_TASK_POOL_ROUNDS 20000
+
+/**
+ * @brief The number of the tasks spawned in each round of the task pool race
+ *        test.
+ */
+#define MO_TESTS_TASK_POOL_TASKS_PER_ROUND 12
+
+/**
+ * @brief The number of the iterations of each level of the nested parallel
+ *        loops.
+ */
+#define MO_TESTS_TASK_POOL_PARALLEL_ITERATIONS 96
+
+/**
+ * @brief The task pool under test and its storage.
+ */
+typedef struct _MO_TESTS_TASK_POOL
+{
+    /**
+     * @brief The task pool.
+     */
+    MO_TASK_POOL Pool;
+    /**
+     * @brief The workers of the task pool.
+     */
+    MO_TASK_POOL_WORKER Workers[MO_TESTS_TASK_POOL_WORKERS];
+    /**
+     * @brief The deque slots of the workers.
+     */
+    MO_POINTER Slots[
+        MO_TESTS_TASK_POOL_WORKERS * MO_TESTS_TASK_POOL_DEQUE_CAPACITY];
+} MO_TESTS_TASK_POOL, *PMO_TESTS_TASK_POOL;
+
+static MO_TESTS_TASK_POOL g_TaskPool;
+
+/**
+ * @brief The worker of the task pool run by the current thread.
+ */
+static thread_local PMO_TASK_POOL_WORKER g_CurrentWorker = nullptr;
+
+/**
+ * @brief The number of the executions of each task in the task pool tests.
+ */
+static MO_UINT32 volatile g_TaskExecutions[
+    MO_TESTS_TASK_POOL_ROUNDS * MO_TESTS_TASK_POOL_TASKS_PER_ROUND];
+
+/**
+ * @brief The number of the visits of each iteration of the nested parallel
+ *        loops.
+ */
+static MO_UINT32 volatile g_ParallelVisits[
+    MO_TESTS_TASK_POOL_PARALLEL_ITERATIONS][
+        MO_TESTS_TASK_POOL_PARALLEL_ITERATIONS];
+
+/**
+ * @brief The capacity of the range sets in the range set tests.
+ */
+#define MO_TESTS_RANGE_SET_CAPACITY 8
+
+/**
+ * @brief The capacity of the ring queues in the single-threaded ring queue
+ *        tests, which is small so the wrap-around is reached quickly.
+ */
+#define MO_TESTS_RING_QUEUE_CAPACITY 8
+
+/**
+ * @brief The capacity of the ring queue shared by the producers in the
+ *        multiple-producer ring queue test.
+ */
+#define MO_TESTS_RING_QUEUE_SHARED_CAPACITY 64
+
+/**
+ * @brief The number of the producers in the multiple-producer ring queue test.
+ */
+#define MO_TESTS_RING_QUEUE_PRODUCERS 4
+
+/**
+ * @brief The number of the elements enqueued by each producer in the
+ *        multiple-producer ring queue test.
+ */
+#define MO_TESTS_RING_QUEUE_ELEMENTS_PER_PRODUCER 100000
+
+/**
+ * @brief The maximum number of the elements enqueued by one call in the
+ *        multiple-producer ring queue test.
+ */
+#define MO_TESTS_RING_QUEUE_MAXIMUM_BATCH 5
+
+/**
+ * @brief The number of the simulated processors which receive the TLB
+ *        shootdowns.
+ */
+#define MO_TESTS_TLB_SHOOTDOWN_TARGETS 2
+
+/**
+ * @brief The number of the submission and completion entries of the service
+ *        rings in the service ring tests.
+ */
+#define MO_TESTS_SERVICE_RING_ENTRIES 8
+
+/**
+ * @brief The number of the requests submitted in the service ring wakeup
+ *        test.
+ */
+#define MO_TESTS_SERVICE_RING_REQUESTS 100000
+
+/**
+ * @brief The operation handled by the service ring handler in the service
+ *        ring tests.
+ */
+#define MO_TESTS_SERVICE_RING_OPERATION_ADD 1
+
+/**
+ * @brief The size of the shared region in the service ring tests.
+ */
+#define MO_TESTS_SERVICE_RING_REGION_SIZE ( \
+    sizeof(MO_SERVICE_RING_HEADER) + \
+    MO_TESTS_SERVICE_RING_ENTRIES * sizeof(MO_SERVICE_RING_SUBMISSION) + \
+    MO_TESTS_SERVICE_RING_ENTRIES * sizeof(MO_SERVICE_RING_COMPLETION))
+
+/**
+ * @brief The shared region of the service rings in the service ring tests.
+ */
+static MO_SYNCHRONIZATION_CACHE_LINE_ALIGNED MO_UINT8 g_ServiceRingRegion[
+    MO_TESTS_SERVICE_RING_REGION_SIZE + MO_SYNCHRONIZATION_CACHE_LINE_SIZE];
+
+/**
+ * @brief The view of the kernel used by the wakeup system call handler in the
+ *        service ring tests.
+ */
+static PMO_SERVICE_RING g_ServiceRingKernel = nullptr;
+
+/**
+ * @brief The shift of the tick length in the timer wheel tests, so the
+ *        deadlines inside a tick are rounded up.
+ */
+#define MO_TESTS_TIMER_WHEEL_TICK_SHIFT 3
+
+/**
+ * @brief The number of the timers in the timer wheel tests.
+ */
+#define MO_TESTS_TIMER_WHEEL_TIMERS 128
+
+/**
+ * @brief The number of the random operations in the randomized timer wheel
+ *        test.
+ */
+#define MO_TESTS_TIMER_WHEEL_OPERATIONS 200000
+
+/**
+ * @brief The actions of the timer routines in the timer wheel tests.
+ */
+typedef enum _MO_TESTS_TIMER_ACTION
+{
+    MoTestsTimerActionNone,
+    MoTestsTimerActionInsertSelf,
+    MoTestsTimerActionInsertOther,
+    MoTestsTimerActionCancelOther,
+    MoTestsTimerActionMaximum
+} MO_TESTS_TIMER_ACTION, *PMO_TESTS_TIMER_ACTION;
+
+/**
+ * @brief The timer in the timer wheel tests and its expected state.
+ */
+typedef struct _MO_TESTS_TIMER
+{
+    /**
+     * @brief The timer.
+     */
+    MO_TIMER Timer;
+    /**
+     * @brief The expected tick when the timer expires.
+     */
+    MO_UINT64 ExpireTick;
+    /**
+     * @brief The serial number of the advance during which the timer was
+     *        inserted, or of the last advance before it was inserted.
+     */
+    MO_UINT64 InsertedAdvance;
+    /**
+     * @brief The action of the routine when the timer expires.
+     */
+    MO_TESTS_TIMER_ACTION Action;
+    /**
+     * @brief Whether the timer is expected to be pending.
+     */
+    MO_BOOL Pending;
+} MO_TESTS_TIMER, *PMO_TESTS_TIMER;
+
+/**
+ * @brief The timer wheel under test and the expected state of its timers.
+ */
+typedef struct _MO_TESTS_TIMER_WHEEL
+{
+    /**
+     * @brief The timer wheel.
+     */
+    MO_TIMER_WHEEL Wheel;
+    /**
+     * @brief The timers.
+     */
+    MO_TESTS_TIMER Timers[MO_TESTS_TIMER_WHEEL_TIMERS];
+    /**
+     * @brief The current time in nanoseconds.
+     */
+    MO_UINT64 CurrentNanoseconds;
+    /**
+     * @brief The serial number of the current or the last advance.
+     */
+    MO_UINT64 Advances;
+    /**
+     * @brief The expected number of the pending timers.
+     */
+    MO_UINT64 PendingCount;
+    /**
+     * @brief The number of the routines called during the current advance.
+     */
+    MO_UINT32 Calls;
+    /**
+     * @brief Whether the routines should perform their actions.
+     */
+    MO_BOOL ActionsEnabled;
+    /**
+     * @brief The number of the routines called for the timers which are not
+     *        expected to expire yet.
+     */
+    MO_UINTN EarlyExpirations;
+    /**
+     * @brief The number of the timers which have not expired more than one
+     *        tick after their deadlines.
+     */
+    MO_UINTN LateExpirations;
+} MO_TESTS_TIMER_WHEEL, *PMO_TESTS_TIMER_WHEEL;
+
+static MO_TESTS_TIMER_WHEEL g_TimerWheel;
+
+/**
+ * @brief The random number generator of the timer wheel tests, which has the
+ *        fixed seed so the failures are reproducible.
+ */
+static std::mt19937_64 g_TimerWheelRandom;
+
+static MO_UINTN g_FailedChecks = 0;
+
+#define MO_TESTS_CHECK(Condition) \
+    MoTestsCheck((Condition) ? MO_TRUE : MO_FALSE, #Condition, __LINE__)
+
+static void MoTestsCheck(
+    _Mo_In_ MO_BOOL Passed,
+    _Mo_In_ const char* Expression,
+    _Mo_In_ int Line)
+{
+    if (!Passed)
+    {
+        ++g_FailedChecks;
+        std::printf("[FAILED] Line %d: %s\n", Line, Expression);
+    }
+}
+
+static MO_RESULT MOAPI MoTestsAllocatePage(
+    _Mo_Out_ PMO_UINT64 PhysicalAddress,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    PMO_TESTS_SIMULATED_MEMORY Memory =
+        reinterpret_cast<PMO_TESTS_SIMULATED_MEMORY>(Context);
+    if (Memory->AllocatedPages >= Memory->PageLimit)
+    {
+        return MO_RESULT_ERROR_OUT_OF_MEMORY;
+    }
+
+    *PhysicalAddress = MO_TESTS_SIMULATED_MEMORY_BASE +
+        (Memory->AllocatedPages++ * MO_PLATFORM_X64_PAGE_SIZE);
+    return MO_RESULT_SUCCESS_OK;
+}
+
+static MO_POINTER MOAPI MoTestsTranslateAddress(
+    _Mo_In_ MO_UINT64 PhysicalAddress,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    PMO_TESTS_SIMULATED_MEMORY Memory =
+        reinterpret_cast<PMO_TESTS_SIMULATED_MEMORY>(Context);
+    if (PhysicalAddress < MO_TESTS_SIMULATED_MEMORY_BASE)
+    {
+        return nullptr;
+    }
+    MO_UINT64 Index = (PhysicalAddress - MO_TESTS_SIMULATED_MEMORY_BASE) /
+        MO_PLATFORM_X64_PAGE_SIZE;
+    if (Index >= Memory->AllocatedPages)
+    {
+        return nullptr;
+    }
+    return Memory->Pages[Index];
+}
+
+static MO_RESULT MoTestsInitializeBuilder(
+    _Mo_Out_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder,
+    _Mo_In_ MO_BOOL Allow1GiBPages,
+    _Mo_In_ MO_UINTN PageLimit)
+{
+    g_SimulatedMemory.AllocatedPages = 0;
+    g_SimulatedMemory.PageLimit = PageLimit;
+    return ::MoPlatformPageTableInitialize(
+        Builder,
+        MoTestsAllocatePage,
+        MoTestsTranslateAddress,
+        &g_SimulatedMemory,
+        Allow1GiBPages);
+}
+
+/**
+ * @brief Checks the translation of the virtual address.
+ */
+static void MoTestsCheckTranslation(
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder,
+    _Mo_In_ MO_UINT64 VirtualAddress,
+    _Mo_In_ MO_UINT64 ExpectedPhysicalAddress,
+    _Mo_In_ MO_UINT64 ExpectedPageSize,
+    _Mo_In_ MO_UINT32 ExpectedAttributes,
+    _Mo_In_ MO_UINT8 ExpectedCacheType)
+{
+    MO_UINT64 PhysicalAddress = 0;
+    MO_UINT64 PageSize = 0;
+    MO_UINT32 Attributes = 0;
+    MO_UINT8 CacheType = 0;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoPlatformPageTableQuery(
+        &PhysicalAddress,
+        &PageSize,
+        &Attributes,
+        &CacheType,
+        Builder,
+        VirtualAddress));
+    MO_TESTS_CHECK(ExpectedPhysicalAddress == PhysicalAddress);
+    MO_TESTS_CHECK(ExpectedPageSize == PageSize);
+    MO_TESTS_CHECK(ExpectedAttributes == Attributes);
+    MO_TESTS_CHECK(ExpectedCacheType == CacheType);
+}
+
+static void MoTestsMapWith1GiBPages()
+{
+    MO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoTestsInitializeBuilder(
+        &Builder,
+        MO_TRUE,
+        MO_TESTS_SIMULATED_MEMORY_PAGES));
+
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoPlatformPageTableIdentityMapRange(
+        &Builder,
+        0,
+        2 * MO_PLATFORM_X64_PAGE_SIZE_1G,
+        MO_PLATFORM_X64_PAGE_ATTRIBUTE_WRITABLE,
+        MO_PLATFORM_X64_PAGE_CACHE_WRITE_BACK));
+
+    // Only the PML4 and one PDPT are needed.
+    MO_TESTS_CHECK(2 == Builder.AllocatedTables);
+    MO_TESTS_CHECK(2 == Builder.Mapped1GiBPages);
+    MO_TESTS_CHECK(0 == Builder.Mapped2MiBPages);
+    MO_TESTS_CHECK(0 == Builder.Mapped4KiBPages);
+
+    ::MoTestsCheckTranslation(
+        &Builder,
+        MO_PLATFORM_X64_PAGE_SIZE_1G + 0x1234,
+        MO_PLATFORM_X64_PAGE_SIZE_1G + 0x1234,
+        MO_PLATFORM_X64_PAGE_SIZE_1G,
+        MO_PLATFORM_X64_PAGE_ATTRIBUTE_WRITABLE,
+        MO_PLATFORM_X64_PAGE_CACHE_WRITE_BACK);
+}
+
+static void MoTestsMapWith2MiBPages()
+{
+    MO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoTestsInitializeBuilder(
+        &Builder,
+        MO_FALSE,
+        MO_TESTS_SIMULATED_MEMORY_PAGES));
+
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoPlatformPageTableIdentityMapRange(
+        &Builder,
+        0,
+        MO_PLATFORM_X64_PAGE_SIZE_1G,
+        MO_PLATFORM_X64_PAGE_ATTRIBUTE_WRITABLE,
+        MO_PLATFORM_X64_PAGE_CACHE_WRITE_BACK));
+
+    MO_TESTS_CHECK(3 == Builder.AllocatedTables);
+    MO_TESTS_CHECK(0 == Builder.Mapped1GiBPages);
+    MO_TESTS_CHECK(512 == Builder.Mapped2MiBPages);
+    MO_TESTS_CHECK(0 == Builder.Mapped4KiBPages);
+}
+
+static void MoTestsMapUnalignedEdges()
+{
+    MO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoTestsInitializeBuilder(
+        &Builder,
+        MO_TRUE,
+        MO_TESTS_SIMULATED_MEMORY_PAGES));
+
+    // One 4 KiB page at the head, two 2 MiB pages, and two 4 KiB pages at the
+    // tail.
+    const MO_UINT64 VirtualAddress = 0xFFFF8000001FF000ULL;
+    const MO_UINT64 PhysicalAddress = 0x401FF000ULL;
+    const MO_UINT64 Length =
+        MO_PLATFORM_X64_PAGE_SIZE_4K +
+        2 * MO_PLATFORM_X64_PAGE_SIZE_2M +
+        2 * MO_PLATFORM_X64_PAGE_SIZE_4K;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoPlatformPageTableMapRange(
+        &Builder,
+        VirtualAddress,
+        PhysicalAddress,
+        Length,
+        MO_PLATFORM_X64_PAGE_ATTRIBUTE_NO_EXECUTE,
+        MO_PLATFORM_X64_PAGE_CACHE_WRITE_COMBINING));
+
+    MO_TESTS_CHECK(0 == Builder.Mapped1GiBPages);
+    MO_TESTS_CHECK(2 == Builder.Mapped2MiBPages);
+    MO_TESTS_CHECK(3 == Builder.Mapped4KiBPages);
+
+    for (MO_UINT64 Offset = 0;
+        Offset < Length;
+        Offset += MO_PLATFORM_X64_PAGE_SIZE_4K)
+    {
+        MO_UINT64 ExpectedPageSize = MO_PLATFORM_X64_PAGE_SIZE_2M;
+        if (Offset < MO_PLATFORM_X64_PAGE_SIZE_4K ||
+            Offset >= Length - 2 * MO_PLATFORM_X64_PAGE_SIZE_4K)
+        {
+            ExpectedPageSize = MO_PLATFORM_X64_PAGE_SIZE_4K;
+        }
+        ::MoTestsCheckTranslation(
+            &Builder,
+            VirtualAddress + Offset,
+            PhysicalAddress + Offset,
+            ExpectedPageSize,
+            MO_PLATFORM_X64_PAGE_ATTRIBUTE_NO_EXECUTE,
+            MO_PLATFORM_X64_PAGE_CACHE_WRITE_COMBINING);
+    }
+
+    MO_UINT64 Unmapped = 0;
+    MO_TESTS_CHECK(MO_RESULT_ERROR_NO_INTERFACE == ::MoPlatformPageTableQuery(
+        &Unmapped,
+        nullptr,
+        nullptr,
+        nullptr,
+        &Builder,
+        VirtualAddress + Length));
+}
+
+static void MoTestsSplitLargePage()
+{
+    MO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoTestsInitializeBuilder(
+        &Builder,
+        MO_TRUE,
+        MO_TESTS_SIMULATED_MEMORY_PAGES));
+
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoPlatformPageTableIdentityMapRange(
+        &Builder,
+        0,
+        MO_PLATFORM_X64_PAGE_SIZE_1G,
+        MO_PLATFORM_X64_PAGE_ATTRIBUTE_WRITABLE,
+        MO_PLATFORM_X64_PAGE_CACHE_WRITE_BACK));
+
+    // Remapping a 4 KiB page splits the 1 GiB page and then the 2 MiB page,
+    // and the other pages keep the original attributes.
+    const MO_UINT64 Address = 0x00A00000ULL + 0x5000ULL;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoPlatformPageTableIdentityMapRange(
+        &Builder,
+        Address,
+        MO_PLATFORM_X64_PAGE_SIZE_4K,
+        0,
+        MO_PLATFORM_X64_PAGE_CACHE_UNCACHEABLE));
+
+    MO_TESTS_CHECK(4 == Builder.AllocatedTables);
+    ::MoTestsCheckTranslation(
+        &Builder,
+        Address,
+        Address,
+        MO_PLATFORM_X64_PAGE_SIZE_4K,
+        0,
+        MO_PLATFORM_X64_PAGE_CACHE_UNCACHEABLE);
+    ::MoTestsCheckTranslation(
+        &Builder,
+        Address + MO_PLATFORM_X64_PAGE_SIZE_4K,
+        Address + MO_PLATFORM_X64_PAGE_SIZE_4K,
+        MO_PLATFORM_X64_PAGE_SIZE_4K,
+        MO_PLATFORM_X64_PAGE_ATTRIBUTE_WRITABLE,
+        MO_PLATFORM_X64_PAGE_CACHE_WRITE_BACK);
+    ::MoTestsCheckTranslation(
+        &Builder,
+        0x00800000ULL,
+        0x00800000ULL,
+        MO_PLATFORM_X64_PAGE_SIZE_2M,
+        MO_PLATFORM_X64_PAGE_ATTRIBUTE_WRITABLE,
+        MO_PLATFORM_X64_PAGE_CACHE_WRITE_BACK);
+}
+
+static void MoTestsRejectInvalidRanges()
+{
+    MO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoTestsInitializeBuilder(
+        &Builder,
+        MO_TRUE,
+        MO_TESTS_SIMULATED_MEMORY_PAGES));
+
+    MO_TESTS_CHECK(MO_RESULT_ERROR_INVALID_PARAMETER ==
+        ::MoPlatformPageTableIdentityMapRange(
+            &Builder,
+            0x1800,
+            MO_PLATFORM_X64_PAGE_SIZE_4K,
+            0,
+            MO_PLATFORM_X64_PAGE_CACHE_WRITE_BACK));
+    MO_TESTS_CHECK(MO_RESULT_ERROR_OUT_OF_BOUNDS ==
+        ::MoPlatformPageTableMapRange(
+            &Builder,
+            0x00007FFFFFFFF000ULL,
+            0,
+            2 * MO_PLATFORM_X64_PAGE_SIZE_4K,
+            0,
+            MO_PLATFORM_X64_PAGE_CACHE_WRITE_BACK));
+    MO_TESTS_CHECK(MO_RESULT_ERROR_INVALID_PARAMETER ==
+        ::MoPlatformPageTableIdentityMapRange(
+            &Builder,
+            0,
+            MO_PLATFORM_X64_PAGE_SIZE_4K,
+            0,
+            MO_PLATFORM_X64_PAGE_CACHE_MAXIMUM + 1));
+
+    // Only the PML4 is allocated.
+    MO_TESTS_CHECK(1 == Builder.AllocatedTables);
+}
+
+static void MoTestsReportOutOfMemory()
+{
+    MO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoTestsInitializeBuilder(
+        &Builder,
+        MO_FALSE,
+        2));
+
+    // The page table for the 4 KiB page cannot be allocated.
+    MO_TESTS_CHECK(MO_RESULT_ERROR_OUT_OF_MEMORY ==
+        ::MoPlatformPageTableIdentityMapRange(
+            &Builder,
+            0x1000,
+            MO_PLATFORM_X64_PAGE_SIZE_4K,
+            0,
+            MO_PLATFORM_X64_PAGE_CACHE_WRITE_BACK));
+}
+
+/**
+ * @brief Checks whether the range set contains exactly the expected ranges in
+ *        the same order.
+ */
+template<MO_UINTN ExpectedCount>
+static MO_BOOL MoTestsMatchRanges(
+    _Mo_In_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ const MO_MEMORY_RANGE (&Expected)[ExpectedCount])
+{
+    if (ExpectedCount != Set->Count)
+    {
+        return MO_FALSE;
+    }
+    for (MO_UINTN i = 0; i < ExpectedCount; ++i)
+    {
+        if (Expected[i].Base != Set->Ranges[i].Base ||
+            Expected[i].Length != Set->Ranges[i].Length)
+        {
+            return MO_FALSE;
+        }
+    }
+    return MO_TRUE;
+}
+
+static void MoTestsMergeAdjacentRanges()
+{
+    MO_MEMORY_RANGE Buffer[MO_TESTS_RANGE_SET_CAPACITY];
+    MO_MEMORY_RANGE_SET Set;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInitialize(
+        &Set,
+        Buffer,
+        MO_TESTS_RANGE_SET_CAPACITY));
+
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInsert(
+        &Set,
+        0x5000,
+        0x1000));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInsert(
+        &Set,
+        0x1000,
+        0x1000));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInsert(
+        &Set,
+        0x3000,
+        0x1000));
+    const MO_MEMORY_RANGE Sorted[] =
+    {
+        { 0x1000, 0x1000 }, { 0x3000, 0x1000 }, { 0x5000, 0x1000 },
+    };
+    MO_TESTS_CHECK(::MoTestsMatchRanges(&Set, Sorted));
+
+    // The adjacent ranges on both sides are coalesced, and the empty range is
+    // ignored.
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInsert(
+        &Set,
+        0x2000,
+        0x1000));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInsert(
+        &Set,
+        0x9000,
+        0));
+    const MO_MEMORY_RANGE Adjacent[] =
+    {
+        { 0x1000, 0x3000 }, { 0x5000, 0x1000 },
+    };
+    MO_TESTS_CHECK(::MoTestsMatchRanges(&Set, Adjacent));
+
+    // An overlapping range which covers the gap and more is merged with all
+    // ranges it touches.
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInsert(
+        &Set,
+        0x800,
+        0x5000));
+    const MO_MEMORY_RANGE Overlapped[] =
+    {
+        { 0x800, 0x5800 },
+    };
+    MO_TESTS_CHECK(::MoTestsMatchRanges(&Set, Overlapped));
+
+    MO_MEMORY_RANGE Range = {};
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetQuery(
+        &Range,
+        &Set,
+        0x5FFF));
+    MO_TESTS_CHECK(0x800 == Range.Base && 0x5800 == Range.Length);
+    MO_TESTS_CHECK(MO_RESULT_ERROR_NO_INTERFACE == ::MoMemoryRangeSetQuery(
+        nullptr,
+        &Set,
+        0x6000));
+    MO_TESTS_CHECK(MO_RESULT_ERROR_NO_INTERFACE == ::MoMemoryRangeSetQuery(
+        nullptr,
+        &Set,
+        MO_UINT64_MAX));
+
+    // The range which wraps around the end of the address space is rejected.
+    MO_TESTS_CHECK(MO_RESULT_ERROR_OUT_OF_BOUNDS == ::MoMemoryRangeSetInsert(
+        &Set,
+        MO_UINT64_MAX - 0xFFF,
+        0x2000));
+    MO_TESTS_CHECK(::MoTestsMatchRanges(&Set, Overlapped));
+}
+
+static void MoTestsSplitRanges()
+{
+    MO_MEMORY_RANGE Buffer[MO_TESTS_RANGE_SET_CAPACITY];
+    MO_MEMORY_RANGE_SET Set;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInitialize(
+        &Set,
+        Buffer,
+        MO_TESTS_RANGE_SET_CAPACITY));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInsert(
+        &Set,
+        0x1000,
+        0x8000));
+
+    // Removing from the middle splits the range.
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetRemove(
+        &Set,
+        0x3000,
+        0x1000));
+    const MO_MEMORY_RANGE Split[] =
+    {
+        { 0x1000, 0x2000 }, { 0x4000, 0x5000 },
+    };
+    MO_TESTS_CHECK(::MoTestsMatchRanges(&Set, Split));
+
+    // The adjacent ranges are not touched.
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetRemove(
+        &Set,
+        0x9000,
+        0x1000));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetRemove(
+        &Set,
+        0x3000,
+        0x1000));
+    MO_TESTS_CHECK(::MoTestsMatchRanges(&Set, Split));
+
+    // Removing across the gap trims the tail of the first range and the head
+    // of the second range.
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetRemove(
+        &Set,
+        0x2000,
+        0x3000));
+    const MO_MEMORY_RANGE Trimmed[] =
+    {
+        { 0x1000, 0x1000 }, { 0x5000, 0x4000 },
+    };
+    MO_TESTS_CHECK(::MoTestsMatchRanges(&Set, Trimmed));
+
+    // Removing a range which covers whole ranges drops them.
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetRemove(
+        &Set,
+        0x0,
+        0x8000));
+    const MO_MEMORY_RANGE Dropped[] =
+    {
+        { 0x8000, 0x1000 },
+    };
+    MO_TESTS_CHECK(::MoTestsMatchRanges(&Set, Dropped));
+
+    MO_TESTS_CHECK(MO_RESULT_ERROR_OUT_OF_BOUNDS == ::MoMemoryRangeSetRemove(
+        &Set,
+        MO_UINT64_MAX,
+        2));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetClear(&Set));
+    MO_TESTS_CHECK(0 == Set.Count);
+}
+
+static void MoTestsCombineRangeSets()
+{
+    MO_MEMORY_RANGE Buffer[MO_TESTS_RANGE_SET_CAPACITY];
+    MO_MEMORY_RANGE OtherBuffer[MO_TESTS_RANGE_SET_CAPACITY];
+    MO_MEMORY_RANGE_SET Set;
+    MO_MEMORY_RANGE_SET Other;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInitialize(
+        &Other,
+        OtherBuffer,
+        MO_TESTS_RANGE_SET_CAPACITY));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInsert(
+        &Other,
+        0x2000,
+        0x2000));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInsert(
+        &Other,
+        0x8000,
+        0x1000));
+
+    // Each operation starts from [0x1000, 0x3000) and [0x6000, 0x8000), so
+    // the first ranges overlap and the second ones are adjacent.
+    const MO_MEMORY_RANGE Initial[] =
+    {
+        { 0x1000, 0x2000 }, { 0x6000, 0x2000 },
+    };
+    auto Reset = [&]()
+    {
+        MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInitialize(
+            &Set,
+            Buffer,
+            MO_TESTS_RANGE_SET_CAPACITY));
+        for (const MO_MEMORY_RANGE& Range : Initial)
+        {
+            MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInsert(
+                &Set,
+                Range.Base,
+                Range.Length));
+        }
+    };
+
+    Reset();
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetUnion(
+        &Set,
+        &Other));
+    const MO_MEMORY_RANGE Union[] =
+    {
+        { 0x1000, 0x3000 }, { 0x6000, 0x3000 },
+    };
+    MO_TESTS_CHECK(::MoTestsMatchRanges(&Set, Union));
+
+    Reset();
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetSubtract(
+        &Set,
+        &Other));
+    const MO_MEMORY_RANGE Difference[] =
+    {
+        { 0x1000, 0x1000 }, { 0x6000, 0x2000 },
+    };
+    MO_TESTS_CHECK(::MoTestsMatchRanges(&Set, Difference));
+
+    Reset();
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetIntersect(
+        &Set,
+        &Other));
+    const MO_MEMORY_RANGE Intersection[] =
+    {
+        { 0x2000, 0x1000 },
+    };
+    MO_TESTS_CHECK(::MoTestsMatchRanges(&Set, Intersection));
+
+    // The other range set is never modified.
+    const MO_MEMORY_RANGE Unchanged[] =
+    {
+        { 0x2000, 0x2000 }, { 0x8000, 0x1000 },
+    };
+    MO_TESTS_CHECK(::MoTestsMatchRanges(&Other, Unchanged));
+}
+
+static void MoTestsFillRangeSet()
+{
+    MO_MEMORY_RANGE Buffer[2];
+    MO_MEMORY_RANGE_SET Set;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInitialize(
+        &Set,
+        Buffer,
+        2));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInsert(
+        &Set,
+        0x1000,
+        0x3000));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInsert(
+        &Set,
+        0x8000,
+        0x1000));
+    const MO_MEMORY_RANGE Full[] =
+    {
+        { 0x1000, 0x3000 }, { 0x8000, 0x1000 },
+    };
+
+    // A new slot is needed, so the full buffer is reported and the range set
+    // is not modified.
+    MO_TESTS_CHECK(MO_RESULT_ERROR_OUT_OF_MEMORY == ::MoMemoryRangeSetInsert(
+        &Set,
+        0x6000,
+        0x1000));
+    MO_TESTS_CHECK(MO_RESULT_ERROR_OUT_OF_MEMORY == ::MoMemoryRangeSetRemove(
+        &Set,
+        0x2000,
+        0x1000));
+    MO_TESTS_CHECK(::MoTestsMatchRanges(&Set, Full));
+
+    MO_MEMORY_RANGE OtherBuffer[2];
+    MO_MEMORY_RANGE_SET Other;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInitialize(
+        &Other,
+        OtherBuffer,
+        2));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInsert(
+        &Other,
+        0x2000,
+        0x1000));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInsert(
+        &Other,
+        0x6000,
+        0x1000));
+    MO_TESTS_CHECK(MO_RESULT_ERROR_OUT_OF_MEMORY == ::MoMemoryRangeSetUnion(
+        &Set,
+        &Other));
+    MO_TESTS_CHECK(MO_RESULT_ERROR_OUT_OF_MEMORY == ::MoMemoryRangeSetSubtract(
+        &Set,
+        &Other));
+    MO_TESTS_CHECK(::MoTestsMatchRanges(&Set, Full));
+
+    // The adjacent range and the trimming removal need no new slot.
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetInsert(
+        &Set,
+        0x4000,
+        0x1000));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMemoryRangeSetRemove(
+        &Set,
+        0x8800,
+        0x800));
+    const MO_MEMORY_RANGE Extended[] =
+    {
+        { 0x1000, 0x4000 }, { 0x8000, 0x800 },
+    };
+    MO_TESTS_CHECK(::MoTestsMatchRanges(&Set, Extended));
+}
+
+static void MoTestsCacheSpscRingQueueIndexes()
+{
+    MO_UINT32 Buffer[MO_TESTS_RING_QUEUE_CAPACITY];
+    MO_SPSC_RING_QUEUE Queue;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoSpscRingQueueInitialize(
+        &Queue,
+        Buffer,
+        MO_TESTS_RING_QUEUE_CAPACITY,
+        sizeof(MO_UINT32)));
+
+    const MO_UINT32 Input[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    MO_UINT32 Output[MO_TESTS_RING_QUEUE_CAPACITY] = {};
+
+    // The producer does not read the head while the cached one says there is
+    // enough space.
+    MO_TESTS_CHECK(3 == ::MoSpscRingQueueEnqueue(&Queue, Input, 3));
+    MO_TESTS_CHECK(0 == Queue.CachedHead);
+
+    // The consumer reads the tail only when the cached one is not enough.
+    MO_TESTS_CHECK(2 == ::MoSpscRingQueueDequeue(&Queue, Output, 2));
+    MO_TESTS_CHECK(3 == Queue.CachedTail);
+    MO_TESTS_CHECK(1 == Output[0] && 2 == Output[1]);
+    MO_TESTS_CHECK(1 == ::MoSpscRingQueueEnqueue(&Queue, &Input[3], 1));
+    MO_TESTS_CHECK(1 == ::MoSpscRingQueueDequeue(&Queue, Output, 1));
+    MO_TESTS_CHECK(3 == Queue.CachedTail);
+    MO_TESTS_CHECK(3 == Output[0]);
+
+    // The cached head only allows 4 more elements, so the fifth one reloads
+    // the head.
+    MO_TESTS_CHECK(4 == ::MoSpscRingQueueEnqueue(&Queue, &Input[4], 4));
+    MO_TESTS_CHECK(0 == Queue.CachedHead);
+    MO_TESTS_CHECK(1 == ::MoSpscRingQueueEnqueue(&Queue, Input, 1));
+    MO_TESTS_CHECK(3 == Queue.CachedHead);
+
+    // The dequeued elements wrap around the end of the buffer.
+    MO_TESTS_CHECK(6 == ::MoSpscRingQueueDequeue(
+        &Queue,
+        Output,
+        MO_TESTS_RING_QUEUE_CAPACITY));
+    const MO_UINT32 Expected[] = { 4, 5, 6, 7, 8, 1 };
+    MO_UINTN Mismatches = 0;
+    for (MO_UINTN i = 0; i < sizeof(Expected) / sizeof(*Expected); ++i)
+    {
+        if (Expected[i] != Output[i])
+        {
+            ++Mismatches;
+        }
+    }
+    MO_TESTS_CHECK(0 == Mismatches);
+    MO_TESTS_CHECK(0 == ::MoSpscRingQueueDequeue(&Queue, Output, 1));
+}
+
+/**
+ * @brief Enqueues more elements than the capacity to the empty ring queue,
+ *        whose positions are about to wrap around the 32-bit range, and checks
+ *        that only the capacity is accepted and returned in order.
+ */
+template<typename EnqueueType, typename DequeueType>
+static void MoTestsOverfillRingQueue(
+    _Mo_In_ EnqueueType Enqueue,
+    _Mo_In_ DequeueType Dequeue)
+{
+    MO_UINT32 Input[MO_TESTS_RING_QUEUE_CAPACITY * 2];
+    for (MO_UINT32 i = 0; i < MO_TESTS_RING_QUEUE_CAPACITY * 2; ++i)
+    {
+        Input[i] = i + 1;
+    }
+    MO_UINT32 Output[MO_TESTS_RING_QUEUE_CAPACITY * 2] = {};
+
+    for (MO_UINTN Round = 0; Round < 3; ++Round)
+    {
+        MO_TESTS_CHECK(MO_TESTS_RING_QUEUE_CAPACITY == Enqueue(
+            Input,
+            MO_TESTS_RING_QUEUE_CAPACITY * 2));
+        MO_TESTS_CHECK(0 == Enqueue(Input, 1));
+        MO_TESTS_CHECK(MO_TESTS_RING_QUEUE_CAPACITY == Dequeue(
+            Output,
+            MO_TESTS_RING_QUEUE_CAPACITY * 2));
+        MO_UINTN Mismatches = 0;
+        for (MO_UINT32 i = 0; i < MO_TESTS_RING_QUEUE_CAPACITY; ++i)
+        {
+            if (i + 1 != Output[i])
+            {
+                ++Mismatches;
+            }
+        }
+        MO_TESTS_CHECK(0 == Mismatches);
+        MO_TESTS_CHECK(0 == Dequeue(Output, 1));
+
+        // Move the positions by a partial batch, so the next round starts
+        // in the middle of the buffer.
+        MO_TESTS_CHECK(3 == Enqueue(Input, 3));
+        MO_TESTS_CHECK(3 == Dequeue(Output, 3));
+    }
+}
+
+static void MoTestsWrapRingQueues()
+{
+    // Start the positions right before the 32-bit wrap-around.
+    const MO_UINT32 Start = 0xFFFFFFFCU;
+
+    MO_UINT32 SpscBuffer[MO_TESTS_RING_QUEUE_CAPACITY];
+    MO_SPSC_RING_QUEUE SpscQueue;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoSpscRingQueueInitialize(
+        &SpscQueue,
+        SpscBuffer,
+        MO_TESTS_RING_QUEUE_CAPACITY,
+        sizeof(MO_UINT32)));
+    SpscQueue.Tail = Start;
+    SpscQueue.CachedHead = Start;
+    SpscQueue.Head = Start;
+    SpscQueue.CachedTail = Start;
+    ::MoTestsOverfillRingQueue(
+        [&](const MO_UINT32* Elements, MO_UINT32 Count)
+        {
+            return ::MoSpscRingQueueEnqueue(&SpscQueue, Elements, Count);
+        },
+        [&](MO_UINT32* Elements, MO_UINT32 Count)
+        {
+            return ::MoSpscRingQueueDequeue(&SpscQueue, Elements, Count);
+        });
+
+    MO_DECLSPEC_ALIGN(8) MO_UINT8 MpscBuffer[MO_MPSC_RING_QUEUE_BUFFER_SIZE(
+        MO_TESTS_RING_QUEUE_CAPACITY,
+        sizeof(MO_UINT32))];
+    MO_MPSC_RING_QUEUE MpscQueue;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMpscRingQueueInitialize(
+        &MpscQueue,
+        MpscBuffer,
+        MO_TESTS_RING_QUEUE_CAPACITY,
+        sizeof(MO_UINT32)));
+    // The slot at position P is free if its sequence number is P.
+    for (MO_UINT32 Offset = 0; Offset < MO_TESTS_RING_QUEUE_CAPACITY; ++Offset)
+    {
+        MpscQueue.Sequences[(Start + Offset) & MpscQueue.Mask] =
+            Start + Offset;
+    }
+    MpscQueue.EnqueuePosition = Start;
+    MpscQueue.DequeuePosition = Start;
+    ::MoTestsOverfillRingQueue(
+        [&](const MO_UINT32* Elements, MO_UINT32 Count)
+        {
+            return ::MoMpscRingQueueEnqueue(&MpscQueue, Elements, Count);
+        },
+        [&](MO_UINT32* Elements, MO_UINT32 Count)
+        {
+            return ::MoMpscRingQueueDequeue(&MpscQueue, Elements, Count);
+        });
+}
+
+static void MoTestsBatchMpscRingQueue()
+{
+    static MO_DECLSPEC_ALIGN(8) MO_UINT8 Buffer[
+        MO_MPSC_RING_QUEUE_BUFFER_SIZE(
+            MO_TESTS_RING_QUEUE_SHARED_CAPACITY,
+            sizeof(MO_UINT32))];
+    static MO_MPSC_RING_QUEUE Queue;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoMpscRingQueueInitialize(
+        &Queue,
+        Buffer,
+        MO_TESTS_RING_QUEUE_SHARED_CAPACITY,
+        sizeof(MO_UINT32)));
+
+    // Each element is the producer index in the high byte and the sequence
+    // number of the producer in the other bytes, and each producer enqueues
+    // the batches of different sizes.
+    std::vector<std::thread> Producers;
+    for (MO_UINT32 Producer = 0;
+        Producer < MO_TESTS_RING_QUEUE_PRODUCERS;
+        ++Producer)
+    {
+        Producers.emplace_back([Producer]()
+        {
+            MO_UINT32 Batch[MO_TESTS_RING_QUEUE_MAXIMUM_BATCH];
+            MO_UINT32 Next = 0;
+            while (Next < MO_TESTS_RING_QUEUE_ELEMENTS_PER_PRODUCER)
+            {
+                MO_UINT32 Count = 1 + ((Next + Producer) %
+                    MO_TESTS_RING_QUEUE_MAXIMUM_BATCH);
+                if (Count > MO_TESTS_RING_QUEUE_ELEMENTS_PER_PRODUCER - Next)
+                {
+                    Count = MO_TESTS_RING_QUEUE_ELEMENTS_PER_PRODUCER - Next;
+                }
+                for (MO_UINT32 i = 0; i < Count; ++i)
+                {
+                    Batch[i] = (Producer << 24) | (Next + i);
+                }
+
+                // Only a prefix of the batch is claimed if the queue is
+                // nearly full.
+                MO_UINT32 Enqueued = ::MoMpscRingQueueEnqueue(
+                    &Queue,
+                    Batch,
+                    Count);
+                if (!Enqueued)
+                {
+                    std::this_thread::yield();
+                }
+                Next += Enqueued;
+            }
+        });
+    }
+
+    MO_UINT32 Expected[MO_TESTS_RING_QUEUE_PRODUCERS] = {};
+    MO_UINTN Received = 0;
+    MO_UINTN Mismatches = 0;
+    const MO_UINTN Total =
+        MO_TESTS_RING_QUEUE_PRODUCERS *
+        MO_TESTS_RING_QUEUE_ELEMENTS_PER_PRODUCER;
+    while (Received < Total)
+    {
+        MO_UINT32 Output[MO_TESTS_RING_QUEUE_SHARED_CAPACITY];
+        MO_UINT32 Count = ::MoMpscRingQueueDequeue(
+            &Queue,
+            Output,
+            MO_TESTS_RING_QUEUE_SHARED_CAPACITY);
+        if (!Count)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        for (MO_UINT32 i = 0; i < Count; ++i)
+        {
+            MO_UINT32 Producer = Output[i] >> 24;
+            if (Producer >= MO_TESTS_RING_QUEUE_PRODUCERS ||
+                (Output[i] & 0xFFFFFF) != Expected[Producer])
+            {
+                ++Mismatches;
+                continue;
+            }
+            ++Expected[Producer];
+        }
+        Received += Count;
+    }
+
+    for (std::thread& Thread : Producers)
+    {
+        Thread.join();
+    }
+
+    MO_TESTS_CHECK(0 == Mismatches);
+    for (MO_UINT32 Producer = 0;
+        Producer < MO_TESTS_RING_QUEUE_PRODUCERS;
+        ++Producer)
+    {
+        MO_TESTS_CHECK(MO_TESTS_RING_QUEUE_ELEMENTS_PER_PRODUCER ==
+            Expected[Producer]);
+    }
+    MO_UINT32 Output = 0;
+    MO_TESTS_CHECK(0 == ::MoMpscRingQueueDequeue(&Queue, &Output, 1));
+}
+
+static MO_UINT64 MOAPI MoTestsServiceRingAdd(
+    _Mo_In_ PMO_SERVICE_RING_SUBMISSION Submission,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    // The handler always gets the private copy of the request.
+    PMO_UINT8 Address = reinterpret_cast<PMO_UINT8>(Submission);
+    if (Address >= g_ServiceRingRegion &&
+        Address < g_ServiceRingRegion + sizeof(g_ServiceRingRegion))
+    {
+        return 0;
+    }
+
+    ++*static_cast<PMO_UINT32>(Context);
+    return Submission->Arguments[0] + Submission->Arguments[1];
+}
+
+/**
+ * @brief The handler table of the service operations in the service ring
+ *        tests, where the operation 0 has no handler.
+ */
+static PMO_SERVICE_RING_HANDLER g_ServiceRingHandlers[] =
+{
+    nullptr,
+    ::MoTestsServiceRingAdd,
+};
+
+/**
+ * @brief The number of the requests handled in the service ring tests.
+ */
+static MO_UINT32 g_ServiceRingHandled = 0;
+
+static MO_UINT64 MOAPI MoTestsServiceRingWakeUp(
+    _Mo_InOut_ PMO_PLATFORM_X64_SYSTEM_CALL_FRAME Frame)
+{
+    MO_UNREFERENCED_PARAMETER(Frame);
+
+    ::MoServiceRingLeaveIdle(g_ServiceRingKernel);
+    return ::MoServiceRingProcess(
+        g_ServiceRingKernel,
+        g_ServiceRingHandlers,
+        sizeof(g_ServiceRingHandlers) / sizeof(*g_ServiceRingHandlers),
+        &g_ServiceRingHandled,
+        MO_TESTS_SERVICE_RING_ENTRIES);
+}
+
+static void MoTestsSubmitServiceRequest(
+    _Mo_InOut_ PMO_SERVICE_RING Ring,
+    _Mo_In_ MO_UINT32 Operation,
+    _Mo_In_ MO_UINT64 UserData)
+{
+    PMO_SERVICE_RING_SUBMISSION Submission =
+        ::MoServiceRingGetSubmission(Ring);
+    MO_TESTS_CHECK(nullptr != Submission);
+    if (Submission)
+    {
+        Submission->UserData = UserData;
+        Submission->Operation = Operation;
+        Submission->Flags = 0;
+        Submission->Arguments[0] = UserData;
+        Submission->Arguments[1] = 1;
+    }
+}
+
+static void MoTestsValidateServiceRing()
+{
+    MO_UINTN RegionSize = 0;
+    MO_TESTS_CHECK(MO_RESULT_ERROR_INVALID_PARAMETER ==
+        ::MoServiceRingQueryRegionSize(nullptr, 8, 8));
+    MO_TESTS_CHECK(MO_RESULT_ERROR_INVALID_PARAMETER ==
+        ::MoServiceRingQueryRegionSize(&RegionSize, 0, 8));
+    MO_TESTS_CHECK(MO_RESULT_ERROR_INVALID_PARAMETER ==
+        ::MoServiceRingQueryRegionSize(&RegionSize, 8, 6));
+    MO_TESTS_CHECK(MO_RESULT_ERROR_OUT_OF_BOUNDS ==
+        ::MoServiceRingQueryRegionSize(&RegionSize, 0x80000000, 8));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoServiceRingQueryRegionSize(
+        &RegionSize,
+        MO_TESTS_SERVICE_RING_ENTRIES,
+        MO_TESTS_SERVICE_RING_ENTRIES));
+    MO_TESTS_CHECK(MO_TESTS_SERVICE_RING_REGION_SIZE == RegionSize);
+
+    MO_SERVICE_RING Kernel;
+    MO_TESTS_CHECK(MO_RESULT_ERROR_INVALID_PARAMETER == ::MoServiceRingCreate(
+        &Kernel,
+        g_ServiceRingRegion + 8,
+        RegionSize,
+        MO_TESTS_SERVICE_RING_ENTRIES,
+        MO_TESTS_SERVICE_RING_ENTRIES));
+    MO_TESTS_CHECK(MO_RESULT_ERROR_OUT_OF_BOUNDS == ::MoServiceRingCreate(
+        &Kernel,
+        g_ServiceRingRegion,
+        RegionSize - 1,
+        MO_TESTS_SERVICE_RING_ENTRIES,
+        MO_TESTS_SERVICE_RING_ENTRIES));
+    MO_TESTS_CHECK(MO_RESULT_ERROR_INVALID_PARAMETER == ::MoServiceRingCreate(
+        &Kernel,
+        g_ServiceRingRegion,
+        RegionSize,
+        3,
+        MO_TESTS_SERVICE_RING_ENTRIES));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoServiceRingCreate(
+        &Kernel,
+        g_ServiceRingRegion,
+        RegionSize,
+        MO_TESTS_SERVICE_RING_ENTRIES,
+        MO_TESTS_SERVICE_RING_ENTRIES));
+
+    MO_SERVICE_RING Session;
+    MO_TESTS_CHECK(MO_RESULT_ERROR_INVALID_PARAMETER == ::MoServiceRingAttach(
+        &Session,
+        g_ServiceRingRegion,
+        sizeof(MO_SERVICE_RING_HEADER) - 1));
+    MO_TESTS_CHECK(MO_RESULT_ERROR_INVALID_PARAMETER == ::MoServiceRingAttach(
+        &Session,
+        g_ServiceRingRegion,
+        RegionSize - 1));
+
+    // The session validates the layout instead of trusting the header.
+    PMO_SERVICE_RING_HEADER Header = Kernel.Header;
+    Header->Signature = 0;
+    MO_TESTS_CHECK(MO_RESULT_ERROR_INVALID_PARAMETER == ::MoServiceRingAttach(
+        &Session,
+        g_ServiceRingRegion,
+        RegionSize));
+    Header->Signature = MO_SERVICE_RING_SIGNATURE;
+    Header->SubmissionEntryCount = MO_TESTS_SERVICE_RING_ENTRIES + 1;
+    MO_TESTS_CHECK(MO_RESULT_ERROR_INVALID_PARAMETER == ::MoServiceRingAttach(
+        &Session,
+        g_ServiceRingRegion,
+        RegionSize));
+    Header->SubmissionEntryCount = MO_TESTS_SERVICE_RING_ENTRIES * 2;
+    MO_TESTS_CHECK(MO_RESULT_ERROR_INVALID_PARAMETER == ::MoServiceRingAttach(
+        &Session,
+        g_ServiceRingRegion,
+        RegionSize));
+    Header->SubmissionEntryCount = MO_TESTS_SERVICE_RING_ENTRIES;
+    Header->CompletionOffset += sizeof(MO_SERVICE_RING_COMPLETION);
+    MO_TESTS_CHECK(MO_RESULT_ERROR_INVALID_PARAMETER == ::MoServiceRingAttach(
+        &Session,
+        g_ServiceRingRegion,
+        RegionSize));
+    Header->CompletionOffset -= sizeof(MO_SERVICE_RING_COMPLETION);
+    Header->SubmissionOffset = 0;
+    MO_TESTS_CHECK(MO_RESULT_ERROR_INVALID_PARAMETER == ::MoServiceRingAttach(
+        &Session,
+        g_ServiceRingRegion,
+        RegionSize));
+    Header->SubmissionOffset = sizeof(MO_SERVICE_RING_HEADER);
+
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoServiceRingAttach(
+        &Session,
+        g_ServiceRingRegion,
+        RegionSize));
+    MO_TESTS_CHECK(Kernel.Submissions == Session.Submissions);
+    MO_TESTS_CHECK(Kernel.Completions == Session.Completions);
+    MO_TESTS_CHECK(MO_TESTS_SERVICE_RING_ENTRIES - 1 == Session.SubmissionMask);
+}
+
+static void MoTestsClampServiceRing()
+{
+    MO_SERVICE_RING Kernel;
+    MO_SERVICE_RING Session;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoServiceRingCreate(
+        &Kernel,
+        g_ServiceRingRegion,
+        MO_TESTS_SERVICE_RING_REGION_SIZE,
+        MO_TESTS_SERVICE_RING_ENTRIES,
+        MO_TESTS_SERVICE_RING_ENTRIES / 2));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoServiceRingAttach(
+        &Session,
+        g_ServiceRingRegion,
+        MO_TESTS_SERVICE_RING_REGION_SIZE));
+    const MO_UINT32 HandlerCount =
+        sizeof(g_ServiceRingHandlers) / sizeof(*g_ServiceRingHandlers);
+    MO_UINT32 Handled = 0;
+
+    // The submission queue is full.
+    for (MO_UINT32 i = 0; i < MO_TESTS_SERVICE_RING_ENTRIES; ++i)
+    {
+        ::MoTestsSubmitServiceRequest(
+            &Session,
+            MO_TESTS_SERVICE_RING_OPERATION_ADD,
+            i);
+    }
+    MO_TESTS_CHECK(nullptr == ::MoServiceRingGetSubmission(&Session));
+    MO_TESTS_CHECK(MO_FALSE == ::MoServiceRingSubmit(&Session));
+
+    // The processing stops at the maximum count, and at the full completion
+    // queue.
+    MO_TESTS_CHECK(1 == ::MoServiceRingProcess(
+        &Kernel,
+        g_ServiceRingHandlers,
+        HandlerCount,
+        &Handled,
+        1));
+    MO_TESTS_CHECK(MO_TESTS_SERVICE_RING_ENTRIES / 2 - 1 ==
+        ::MoServiceRingProcess(
+            &Kernel,
+            g_ServiceRingHandlers,
+            HandlerCount,
+            &Handled,
+            MO_TESTS_SERVICE_RING_ENTRIES));
+    MO_TESTS_CHECK(0 == ::MoServiceRingProcess(
+        &Kernel,
+        g_ServiceRingHandlers,
+        HandlerCount,
+        &Handled,
+        MO_TESTS_SERVICE_RING_ENTRIES));
+    MO_TESTS_CHECK(MO_TESTS_SERVICE_RING_ENTRIES / 2 == Handled);
+
+    MO_SERVICE_RING_COMPLETION Completions[MO_TESTS_SERVICE_RING_ENTRIES];
+    MO_TESTS_CHECK(MO_TESTS_SERVICE_RING_ENTRIES / 2 ==
+        ::MoServiceRingReapCompletions(
+            &Session,
+            Completions,
+            MO_TESTS_SERVICE_RING_ENTRIES));
+    MO_TESTS_CHECK(0 == Completions[0].UserData);
+    MO_TESTS_CHECK(1 == Completions[0].Result);
+    MO_TESTS_CHECK(3 == Completions[3].UserData);
+    MO_TESTS_CHECK(4 == Completions[3].Result);
+
+    // The hostile submission tails are ignored, so nothing is handled twice
+    // or read past the queue.
+    PMO_SERVICE_RING_HEADER Header = Kernel.Header;
+    MO_UINT32 SubmissionHead = Header->SubmissionHead;
+    MO_UINT32 SubmissionTail = Header->SubmissionTail;
+    const MO_UINT32 HostileTails[] =
+    {
+        SubmissionHead + MO_TESTS_SERVICE_RING_ENTRIES + 1,
+        SubmissionHead - 1,
+        SubmissionHead + 0x80000000U,
+    };
+    for (MO_UINT32 Tail : HostileTails)
+    {
+        Header->SubmissionTail = Tail;
+        MO_TESTS_CHECK(0 == ::MoServiceRingProcess(
+            &Kernel,
+            g_ServiceRingHandlers,
+            HandlerCount,
+            &Handled,
+            MO_TESTS_SERVICE_RING_ENTRIES));
+        MO_TESTS_CHECK(SubmissionHead == Header->SubmissionHead);
+    }
+    Header->SubmissionTail = SubmissionTail;
+
+    // The hostile completion heads leave no free completion entry.
+    MO_UINT32 CompletionHead = Header->CompletionHead;
+    Header->CompletionHead = Header->CompletionTail + 1;
+    MO_TESTS_CHECK(0 == ::MoServiceRingProcess(
+        &Kernel,
+        g_ServiceRingHandlers,
+        HandlerCount,
+        &Handled,
+        MO_TESTS_SERVICE_RING_ENTRIES));
+    Header->CompletionHead =
+        Header->CompletionTail - MO_TESTS_SERVICE_RING_ENTRIES;
+    MO_TESTS_CHECK(0 == ::MoServiceRingProcess(
+        &Kernel,
+        g_ServiceRingHandlers,
+        HandlerCount,
+        &Handled,
+        MO_TESTS_SERVICE_RING_ENTRIES));
+    Header->CompletionHead = CompletionHead;
+    MO_TESTS_CHECK(MO_TESTS_SERVICE_RING_ENTRIES / 2 == Handled);
+
+    // The remaining requests are handled after the completions are reaped,
+    // and the unknown operations complete with the error.
+    Session.Submissions[(SubmissionHead + 1) & Session.SubmissionMask]
+        .Operation = 0;
+    Session.Submissions[(SubmissionHead + 2) & Session.SubmissionMask]
+        .Operation = HandlerCount;
+    MO_TESTS_CHECK(MO_TESTS_SERVICE_RING_ENTRIES / 2 ==
+        ::MoServiceRingProcess(
+            &Kernel,
+            g_ServiceRingHandlers,
+            HandlerCount,
+            &Handled,
+            MO_TESTS_SERVICE_RING_ENTRIES));
+    MO_TESTS_CHECK(MO_TESTS_SERVICE_RING_ENTRIES / 2 + 2 == Handled);
+    MO_TESTS_CHECK(MO_TESTS_SERVICE_RING_ENTRIES / 2 ==
+        ::MoServiceRingReapCompletions(
+            &Session,
+            Completions,
+            MO_TESTS_SERVICE_RING_ENTRIES));
+    MO_TESTS_CHECK(5 == Completions[0].Result);
+    MO_TESTS_CHECK(MO_SERVICE_RING_INVALID_OPERATION == Completions[1].Result);
+    MO_TESTS_CHECK(MO_SERVICE_RING_INVALID_OPERATION == Completions[2].Result);
+    MO_TESTS_CHECK(8 == Completions[3].Result);
+    MO_TESTS_CHECK(nullptr != ::MoServiceRingGetSubmission(&Session));
+}
+
+static void MoTestsWakeUpServiceRing()
+{
+    static MO_SERVICE_RING Kernel;
+    static MO_SERVICE_RING Session;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoServiceRingCreate(
+        &Kernel,
+        g_ServiceRingRegion,
+        MO_TESTS_SERVICE_RING_REGION_SIZE,
+        MO_TESTS_SERVICE_RING_ENTRIES,
+        MO_TESTS_SERVICE_RING_ENTRIES));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoServiceRingAttach(
+        &Session,
+        g_ServiceRingRegion,
+        MO_TESTS_SERVICE_RING_REGION_SIZE));
+
+    // The wakeup is a system call dispatched through the table.
+    static PMO_PLATFORM_X64_SYSTEM_CALL_HANDLER SystemCallHandlers[
+        MO_SERVICE_RING_SYSTEM_CALL_WAKEUP + 1] = {};
+    SystemCallHandlers[MO_SERVICE_RING_SYSTEM_CALL_WAKEUP] =
+        ::MoTestsServiceRingWakeUp;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoPlatformSystemCallInitialize(
+        SystemCallHandlers,
+        MO_SERVICE_RING_SYSTEM_CALL_WAKEUP + 1));
+    g_ServiceRingKernel = &Kernel;
+    g_ServiceRingHandled = 0;
+
+    MO_PLATFORM_X64_SYSTEM_CALL_FRAME Frame = {};
+    Frame.Number = MO_SERVICE_RING_SYSTEM_CALL_WAKEUP;
+
+    // The idle kernel asks for the wakeup, which handles the requests.
+    MO_TESTS_CHECK(MO_TRUE == ::MoServiceRingEnterIdle(&Kernel));
+    ::MoTestsSubmitServiceRequest(
+        &Session,
+        MO_TESTS_SERVICE_RING_OPERATION_ADD,
+        41);
+    MO_TESTS_CHECK(MO_TRUE == ::MoServiceRingSubmit(&Session));
+    MO_TESTS_CHECK(1 == ::MoPlatformSystemCallDispatch(&Frame));
+    MO_TESTS_CHECK(1 == g_ServiceRingHandled);
+    MO_TESTS_CHECK(0 == Kernel.Header->Flags);
+    MO_SERVICE_RING_COMPLETION Completion;
+    MO_TESTS_CHECK(1 == ::MoServiceRingReapCompletions(
+        &Session,
+        &Completion,
+        1));
+    MO_TESTS_CHECK(41 == Completion.UserData && 42 == Completion.Result);
+
+    // The polling kernel needs no wakeup, and refuses to become idle while
+    // the requests are pending.
+    ::MoTestsSubmitServiceRequest(
+        &Session,
+        MO_TESTS_SERVICE_RING_OPERATION_ADD,
+        1);
+    MO_TESTS_CHECK(MO_FALSE == ::MoServiceRingSubmit(&Session));
+    MO_TESTS_CHECK(MO_FALSE == ::MoServiceRingEnterIdle(&Kernel));
+    MO_TESTS_CHECK(0 == Kernel.Header->Flags);
+    MO_TESTS_CHECK(1 == ::MoServiceRingProcess(
+        &Kernel,
+        g_ServiceRingHandlers,
+        sizeof(g_ServiceRingHandlers) / sizeof(*g_ServiceRingHandlers),
+        &g_ServiceRingHandled,
+        MO_TESTS_SERVICE_RING_ENTRIES));
+    MO_TESTS_CHECK(1 == ::MoServiceRingReapCompletions(
+        &Session,
+        &Completion,
+        1));
+
+    // The kernel thread sleeps whenever it becomes idle, and only the wakeups
+    // of the session let it continue, so a lost wakeup stops the progress.
+    static MO_UINT32 volatile Wakeups = 0;
+    static MO_UINT32 volatile Stopped = 0;
+    g_ServiceRingHandled = 0;
+    std::thread KernelThread([]()
+    {
+        MO_UINT32 SeenWakeups = 0;
+        while (!::MoAtomicLoad32(&Stopped, MO_ATOMIC_ORDER_ACQUIRE))
+        {
+            if (::MoServiceRingProcess(
+                &Kernel,
+                g_ServiceRingHandlers,
+                sizeof(g_ServiceRingHandlers) / sizeof(*g_ServiceRingHandlers),
+                &g_ServiceRingHandled,
+                MO_TESTS_SERVICE_RING_ENTRIES))
+            {
+                continue;
+            }
+            if (!::MoServiceRingEnterIdle(&Kernel))
+            {
+                continue;
+            }
+            while (SeenWakeups == ::MoAtomicLoad32(
+                &Wakeups,
+                MO_ATOMIC_ORDER_ACQUIRE) &&
+                !::MoAtomicLoad32(&Stopped, MO_ATOMIC_ORDER_ACQUIRE))
+            {
+                std::this_thread::yield();
+            }
+            SeenWakeups = ::MoAtomicLoad32(&Wakeups, MO_ATOMIC_ORDER_ACQUIRE);
+            ::MoServiceRingLeaveIdle(&Kernel);
+        }
+    });
+
+    std::chrono::steady_clock::time_point Deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    MO_UINT32 Submitted = 0;
+    MO_UINT32 Reaped = 0;
+    MO_UINTN Mismatches = 0;
+    while (Reaped < MO_TESTS_SERVICE_RING_REQUESTS &&
+        std::chrono::steady_clock::now() < Deadline)
+    {
+        MO_UINT32 Batch = 0;
+        while (Submitted < MO_TESTS_SERVICE_RING_REQUESTS &&
+            Batch < 1 + Submitted % 3)
+        {
+            PMO_SERVICE_RING_SUBMISSION Submission =
+                ::MoServiceRingGetSubmission(&Session);
+            if (!Submission)
+            {
+                break;
+            }
+            Submission->UserData = Submitted;
+            Submission->Operation = MO_TESTS_SERVICE_RING_OPERATION_ADD;
+            Submission->Flags = 0;
+            Submission->Arguments[0] = Submitted;
+            Submission->Arguments[1] = 1;
+            ++Submitted;
+            ++Batch;
+        }
+        if (Batch && ::MoServiceRingSubmit(&Session))
+        {
+            ::MoAtomicFetchAdd32(&Wakeups, 1, MO_ATOMIC_ORDER_RELEASE);
+        }
+
+        MO_SERVICE_RING_COMPLETION Completions[MO_TESTS_SERVICE_RING_ENTRIES];
+        MO_UINT32 Count = ::MoServiceRingReapCompletions(
+            &Session,
+            Completions,
+            MO_TESTS_SERVICE_RING_ENTRIES);
+        for (MO_UINT32 i = 0; i < Count; ++i)
+        {
+            if (Reaped + i != Completions[i].UserData ||
+                Reaped + i + 1 != Completions[i].Result)
+            {
+                ++Mismatches;
+            }
+        }
+        Reaped += Count;
+        if (!Count)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    ::MoAtomicStore32(&Stopped, 1, MO_ATOMIC_ORDER_RELEASE);
+    KernelThread.join();
+
+    MO_TESTS_CHECK(MO_TESTS_SERVICE_RING_REQUESTS == Reaped);
+    MO_TESTS_CHECK(MO_TESTS_SERVICE_RING_REQUESTS == g_ServiceRingHandled);
+    MO_TESTS_CHECK(0 == Mismatches);
+    g_ServiceRingKernel = nullptr;
+}
+
+static void MoTestsCoalesceTlbRanges()
+{
+    const MO_UINT64 PageSize = MO_PLATFORM_X64_PAGE_SIZE;
+
+    MO_PLATFORM_X64_TLB_BATCH Batch;
+    ::MoPlatformTlbBatchInitialize(&Batch, 0);
+    MO_TESTS_CHECK(MO_PLATFORM_X64_TLB_DEFAULT_FLUSH_THRESHOLD ==
+        Batch.FlushThreshold);
+
+    ::MoPlatformTlbBatchAddRange(&Batch, 0x1000, 0, MO_FALSE);
+    MO_TESTS_CHECK(0 == Batch.RangeCount);
+
+    // The unaligned ranges are widened to the pages they touch.
+    ::MoPlatformTlbBatchAddRange(&Batch, 0x1000, PageSize, MO_FALSE);
+    ::MoPlatformTlbBatchAddRange(&Batch, 0x1800, PageSize, MO_FALSE);
+    MO_TESTS_CHECK(1 == Batch.RangeCount);
+    MO_TESTS_CHECK(0x1000 == Batch.Ranges[0].Start);
+    MO_TESTS_CHECK(0x3000 == Batch.Ranges[0].End);
+    MO_TESTS_CHECK(2 == Batch.PageCount);
+
+    // The adjacent range is merged.
+    ::MoPlatformTlbBatchAddRange(&Batch, 0x3000, PageSize, MO_FALSE);
+    MO_TESTS_CHECK(1 == Batch.RangeCount);
+    MO_TESTS_CHECK(0x4000 == Batch.Ranges[0].End);
+    MO_TESTS_CHECK(3 == Batch.PageCount);
+
+    // The range which bridges two ranges merges both of them.
+    ::MoPlatformTlbBatchAddRange(&Batch, 0x10000, 1, MO_FALSE);
+    MO_TESTS_CHECK(2 == Batch.RangeCount);
+    MO_TESTS_CHECK(4 == Batch.PageCount);
+    ::MoPlatformTlbBatchAddRange(&Batch, 0x3800, 0xD000, MO_TRUE);
+    MO_TESTS_CHECK(1 == Batch.RangeCount);
+    MO_TESTS_CHECK(0x1000 == Batch.Ranges[0].Start);
+    MO_TESTS_CHECK(0x11000 == Batch.Ranges[0].End);
+    MO_TESTS_CHECK(16 == Batch.PageCount);
+    MO_TESTS_CHECK(Batch.Global);
+    MO_TESTS_CHECK(!Batch.FlushAll);
+
+    // The batch falls back to the full flush above the threshold only.
+    ::MoPlatformTlbBatchAddRange(
+        &Batch,
+        0x100000,
+        (MO_PLATFORM_X64_TLB_DEFAULT_FLUSH_THRESHOLD - 16) * PageSize,
+        MO_FALSE);
+    MO_TESTS_CHECK(MO_PLATFORM_X64_TLB_DEFAULT_FLUSH_THRESHOLD ==
+        Batch.PageCount);
+    MO_TESTS_CHECK(!Batch.FlushAll);
+    ::MoPlatformTlbBatchAddRange(&Batch, 0x200000, PageSize, MO_FALSE);
+    MO_TESTS_CHECK(Batch.FlushAll);
+
+    // The range which wraps around the address space is flushed fully.
+    ::MoPlatformTlbBatchInitialize(&Batch, 0);
+    ::MoPlatformTlbBatchAddRange(
+        &Batch,
+        0xFFFFFFFFFFFFF000ULL,
+        2 * PageSize,
+        MO_FALSE);
+    MO_TESTS_CHECK(Batch.FlushAll);
+
+    // The disjoint ranges fill the batch, and the one after them falls back
+    // to the full flush, but the ranges which merge still fit.
+    ::MoPlatformTlbBatchInitialize(&Batch, 0xFFFFFFFF);
+    for (MO_UINT64 i = 0; i < MO_PLATFORM_X64_TLB_BATCH_MAXIMUM_RANGES; ++i)
+    {
+        ::MoPlatformTlbBatchAddRange(
+            &Batch,
+            i * 2 * PageSize,
+            PageSize,
+            MO_FALSE);
+    }
+    MO_TESTS_CHECK(MO_PLATFORM_X64_TLB_BATCH_MAXIMUM_RANGES ==
+        Batch.RangeCount);
+    ::MoPlatformTlbBatchAddRange(&Batch, PageSize, PageSize, MO_FALSE);
+    MO_TESTS_CHECK(MO_PLATFORM_X64_TLB_BATCH_MAXIMUM_RANGES - 1 ==
+        Batch.RangeCount);
+    MO_TESTS_CHECK(MO_PLATFORM_X64_TLB_BATCH_MAXIMUM_RANGES + 1 ==
+        Batch.PageCount);
+    MO_TESTS_CHECK(!Batch.FlushAll);
+    ::MoPlatformTlbBatchAddRange(
+        &Batch,
+        MO_PLATFORM_X64_TLB_BATCH_MAXIMUM_RANGES * 2 * PageSize,
+        PageSize,
+        MO_FALSE);
+    MO_TESTS_CHECK(!Batch.FlushAll);
+    ::MoPlatformTlbBatchAddRange(&Batch, 0x10000000, PageSize, MO_FALSE);
+    MO_TESTS_CHECK(Batch.FlushAll);
+}
+
+static void MoTestsFlushTlbBatch()
+{
+    ::MoTestsPlatformReset();
+    g_TestsPlatform.Cr4 = MO_PLATFORM_X64_CR4_PAGE_GLOBAL_ENABLE;
+
+    MO_PLATFORM_X64_TLB_BATCH Batch;
+    ::MoPlatformTlbBatchInitialize(&Batch, 0);
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK ==
+        ::MoPlatformTlbBatchFlush(&Batch, nullptr));
+    MO_TESTS_CHECK(0 == g_TestsPlatform.InvalidatedPages);
+
+    ::MoPlatformTlbBatchAddRange(&Batch, 0x1000, 0x3000, MO_FALSE);
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK ==
+        ::MoPlatformTlbBatchFlush(&Batch, nullptr));
+    MO_TESTS_CHECK(3 == g_TestsPlatform.InvalidatedPages);
+    MO_TESTS_CHECK(0 == Batch.RangeCount && 0 == Batch.PageCount);
+
+    // The full flush reloads CR3, or toggles CR4.PGE for the global pages.
+    ::MoPlatformTlbBatchAddRange(&Batch, 0, 0x100000, MO_FALSE);
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK ==
+        ::MoPlatformTlbBatchFlush(&Batch, nullptr));
+    MO_TESTS_CHECK(1 == g_TestsPlatform.Cr3Writes);
+    MO_TESTS_CHECK(0 == g_TestsPlatform.Cr4Writes);
+    MO_TESTS_CHECK(!Batch.FlushAll);
+    ::MoPlatformTlbBatchAddRange(&Batch, 0, 0x100000, MO_TRUE);
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK ==
+        ::MoPlatformTlbBatchFlush(&Batch, nullptr));
+    MO_TESTS_CHECK(1 == g_TestsPlatform.Cr3Writes);
+    MO_TESTS_CHECK(2 == g_TestsPlatform.Cr4Writes);
+    MO_TESTS_CHECK(MO_PLATFORM_X64_CR4_PAGE_GLOBAL_ENABLE ==
+        g_TestsPlatform.Cr4);
+
+    static MO_PLATFORM_X64_LOCAL_APIC Apic;
+    static MO_PLATFORM_X64_IDT_GATE_DESCRIPTOR InterruptDescriptorTable[256];
+    static PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER HandlerTable[256];
+    MO_PLATFORM_X64_TLB_SHOOTDOWN Shootdown;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoPlatformTlbShootdownInitialize(
+        &Shootdown,
+        &Apic,
+        0,
+        MO_TESTS_TLB_SHOOTDOWN_TARGETS));
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK ==
+        ::MoPlatformTlbShootdownInstallHandler(
+            &Shootdown,
+            InterruptDescriptorTable,
+            HandlerTable));
+    g_TestsPlatform.LightweightHandlerTable = HandlerTable;
+    g_TestsPlatform.SimulatedTargetCount = MO_TESTS_TLB_SHOOTDOWN_TARGETS;
+
+    // All targets apply the whole batch on a single interrupt.
+    g_TestsPlatform.InvalidatedPages = 0;
+    ::MoPlatformTlbBatchAddRange(&Batch, 0x1000, 0x2000, MO_FALSE);
+    ::MoPlatformTlbBatchAddRange(&Batch, 0x8000, 0x1000, MO_FALSE);
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK ==
+        ::MoPlatformTlbBatchFlush(&Batch, &Shootdown));
+    MO_TESTS_CHECK(1 == g_TestsPlatform.SentInterProcessorInterrupts);
+    MO_TESTS_CHECK(1 == Shootdown.Shootdowns);
+    MO_TESTS_CHECK(3 * (1 + MO_TESTS_TLB_SHOOTDOWN_TARGETS) ==
+        g_TestsPlatform.InvalidatedPages);
+    MO_TESTS_CHECK(MO_TESTS_TLB_SHOOTDOWN_TARGETS ==
+        g_TestsPlatform.EndOfInterrupts);
+    MO_TESTS_CHECK(0 == Shootdown.PendingCount);
+    MO_TESTS_CHECK(nullptr == Shootdown.Batch);
+    MO_TESTS_CHECK(0 == Batch.RangeCount);
+
+    // The shootdown with the interrupts disabled fails before sending the
+    // interrupt or waiting for the targets, and keeps the batch.
+    g_TestsPlatform.InvalidatedPages = 0;
+    g_TestsPlatform.InterruptState &=
+        ~static_cast<MO_UINTN>(MO_TESTS_PLATFORM_RFLAGS_INTERRUPT_ENABLE);
+    ::MoPlatformTlbBatchAddRange(&Batch, 0x1000, 0x1000, MO_FALSE);
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK !=
+        ::MoPlatformTlbBatchFlush(&Batch, &Shootdown));
+    MO_TESTS_CHECK(1 == g_TestsPlatform.SentInterProcessorInterrupts);
+    MO_TESTS_CHECK(0 == g_TestsPlatform.InvalidatedPages);
+    MO_TESTS_CHECK(1 == Batch.RangeCount);
+
+    // The local flush does not wait for anything.
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK ==
+        ::MoPlatformTlbBatchFlush(&Batch, nullptr));
+    MO_TESTS_CHECK(1 == g_TestsPlatform.InvalidatedPages);
+    g_TestsPlatform.InterruptState |= MO_TESTS_PLATFORM_RFLAGS_INTERRUPT_ENABLE;
+
+    // The batch is kept if the interrupt is not sent.
+    g_TestsPlatform.InterProcessorInterruptResult =
+        MO_RESULT_ERROR_NOT_IMPLEMENTED;
+    ::MoPlatformTlbBatchAddRange(&Batch, 0x1000, 0x1000, MO_FALSE);
+    MO_TESTS_CHECK(MO_RESULT_ERROR_NOT_IMPLEMENTED ==
+        ::MoPlatformTlbBatchFlush(&Batch, &Shootdown));
+    MO_TESTS_CHECK(1 == Batch.RangeCount);
+    MO_TESTS_CHECK(nullptr == Shootdown.Batch);
+
+    ::MoTestsPlatformReset();
+}
+
+static MO_VOID MOAPI MoTestsTimerRoutine(
+    _Mo_In_ PMO_TIMER Timer,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+static void MoTestsResetTimerWheel(
+    _Mo_In_ MO_UINT64 CurrentNanoseconds)
+{
+    g_TimerWheel = MO_TESTS_TIMER_WHEEL();
+    g_TimerWheel.CurrentNanoseconds = CurrentNanoseconds;
+    g_TimerWheel.ActionsEnabled = MO_TRUE;
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoTimerWheelInitialize(
+        &g_TimerWheel.Wheel,
+        MO_TESTS_TIMER_WHEEL_TICK_SHIFT,
+        CurrentNanoseconds));
+    for (MO_UINTN i = 0; i < MO_TESTS_TIMER_WHEEL_TIMERS; ++i)
+    {
+        ::MoTimerInitialize(
+            &g_TimerWheel.Timers[i].Timer,
+            ::MoTestsTimerRoutine,
+            reinterpret_cast<MO_POINTER>(i));
+    }
+}
+
+static void MoTestsInsertTimer(
+    _Mo_In_ MO_UINTN Index,
+    _Mo_In_ MO_UINT64 DeadlineNanoseconds,
+    _Mo_In_ MO_TESTS_TIMER_ACTION Action)
+{
+    PMO_TESTS_TIMER Timer = &g_TimerWheel.Timers[Index];
+    if (!Timer->Pending)
+    {
+        ++g_TimerWheel.PendingCount;
+    }
+    Timer->Pending = MO_TRUE;
+    Timer->ExpireTick =
+        (DeadlineNanoseconds >> MO_TESTS_TIMER_WHEEL_TICK_SHIFT) +
+        ((DeadlineNanoseconds &
+            ((1ULL << MO_TESTS_TIMER_WHEEL_TICK_SHIFT) - 1)) ? 1 : 0);
+    // The passed deadline expires at the next tick which has not been
+    // processed, which is one tick late if the time has not moved.
+    if (Timer->ExpireTick < g_TimerWheel.Wheel.CurrentTick)
+    {
+        Timer->ExpireTick = g_TimerWheel.Wheel.CurrentTick;
+    }
+    Timer->InsertedAdvance = g_TimerWheel.Advances;
+    Timer->Action = Action;
+    ::MoTimerWheelInsert(
+        &g_TimerWheel.Wheel,
+        &Timer->Timer,
+        DeadlineNanoseconds);
+}
+
+static void MoTestsCancelTimer(
+    _Mo_In_ MO_UINTN Index)
+{
+    PMO_TESTS_TIMER Timer = &g_TimerWheel.Timers[Index];
+    MO_BOOL Cancelled = ::MoTimerWheelCancel(
+        &g_TimerWheel.Wheel,
+        &Timer->Timer);
+    MO_TESTS_CHECK(Cancelled == Timer->Pending);
+    if (Timer->Pending)
+    {
+        --g_TimerWheel.PendingCount;
+    }
+    Timer->Pending = MO_FALSE;
+}
+
+/**
+ * @brief Picks a random deadline, which can be in the past, near the cascade
+ *        boundaries of each level, or beyond the range of the timer wheel.
+ */
+static MO_UINT64 MoTestsPickTimerDeadline()
+{
+    MO_UINT64 Now = g_TimerWheel.CurrentNanoseconds;
+    MO_UINT64 Ticks = 0;
+    switch (g_TimerWheelRandom() % 8)
+    {
+    case 0:
+    {
+        MO_UINT64 Past = g_TimerWheelRandom() % 4096;
+        return Past < Now ? Now - Past : 0;
+    }
+    case 1:
+    {
+        MO_UINT32 Level = 1 + g_TimerWheelRandom() %
+            MO_TIMER_WHEEL_LEVEL_COUNT;
+        Ticks = (1ULL << (MO_TIMER_WHEEL_SLOT_BITS * Level)) - 1 +
+            g_TimerWheelRandom() % 3;
+        break;
+    }
+    case 2:
+        Ticks = g_TimerWheelRandom() % MO_TIMER_WHEEL_RANGE_TICKS;
+        break;
+    case 3:
+        Ticks = MO_TIMER_WHEEL_RANGE_TICKS +
+            g_TimerWheelRandom() % (2 * MO_TIMER_WHEEL_RANGE_TICKS);
+        break;
+    default:
+        Ticks = g_TimerWheelRandom() % 256;
+        break;
+    }
+
+    return Now + (Ticks << MO_TESTS_TIMER_WHEEL_TICK_SHIFT) +
+        g_TimerWheelRandom() % (1ULL << MO_TESTS_TIMER_WHEEL_TICK_SHIFT);
+}
+
+static MO_VOID MOAPI MoTestsTimerRoutine(
+    _Mo_In_ PMO_TIMER Timer,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    MO_UINTN Index = reinterpret_cast<MO_UINTN>(Context);
+    PMO_TESTS_TIMER Current = &g_TimerWheel.Timers[Index];
+    MO_UINT64 TargetTick =
+        g_TimerWheel.CurrentNanoseconds >> MO_TESTS_TIMER_WHEEL_TICK_SHIFT;
+
+    // The timers inserted during this advance expire in the next one at the
+    // earliest.
+    ++g_TimerWheel.Calls;
+    if (!Current->Pending ||
+        ::MoTimerIsPending(Timer) ||
+        Current->ExpireTick > TargetTick ||
+        Current->InsertedAdvance == g_TimerWheel.Advances)
+    {
+        ++g_TimerWheel.EarlyExpirations;
+    }
+    Current->Pending = MO_FALSE;
+    --g_TimerWheel.PendingCount;
+
+    if (!g_TimerWheel.ActionsEnabled)
+    {
+        return;
+    }
+
+    MO_UINTN Other = g_TimerWheelRandom() % MO_TESTS_TIMER_WHEEL_TIMERS;
+    switch (Current->Action)
+    {
+    case MoTestsTimerActionInsertSelf:
+        ::MoTestsInsertTimer(
+            Index,
+            ::MoTestsPickTimerDeadline(),
+            static_cast<MO_TESTS_TIMER_ACTION>(
+                g_TimerWheelRandom() % MoTestsTimerActionMaximum));
+        break;
+    case MoTestsTimerActionInsertOther:
+        ::MoTestsInsertTimer(
+            Other,
+            ::MoTestsPickTimerDeadline(),
+            MoTestsTimerActionNone);
+        break;
+    case MoTestsTimerActionCancelOther:
+        // The other timer can be an expired timer whose routine has not been
+        // called yet.
+        ::MoTestsCancelTimer(Other);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Advances the timer wheel to the time, and checks that no pending
+ *        timer is more than one tick late.
+ */
+static void MoTestsAdvanceTimerWheel(
+    _Mo_In_ MO_UINT64 CurrentNanoseconds)
+{
+    ++g_TimerWheel.Advances;
+    g_TimerWheel.CurrentNanoseconds = CurrentNanoseconds;
+    g_TimerWheel.Calls = 0;
+    MO_UINT32 Expired = ::MoTimerWheelAdvance(
+        &g_TimerWheel.Wheel,
+        CurrentNanoseconds);
+    MO_TESTS_CHECK(g_TimerWheel.Calls <= Expired);
+    MO_TESTS_CHECK(g_TimerWheel.PendingCount ==
+        g_TimerWheel.Wheel.PendingCount);
+
+    MO_UINT64 TargetTick =
+        CurrentNanoseconds >> MO_TESTS_TIMER_WHEEL_TICK_SHIFT;
+    for (MO_UINTN i = 0; i < MO_TESTS_TIMER_WHEEL_TIMERS; ++i)
+    {
+        PMO_TESTS_TIMER Timer = &g_TimerWheel.Timers[i];
+        if (Timer->Pending &&
+            Timer->InsertedAdvance != g_TimerWheel.Advances &&
+            Timer->ExpireTick < TargetTick)
+        {
+            ++g_TimerWheel.LateExpirations;
+        }
+    }
+}
+
+/**
+ * @brief Queries the next deadline of the timer wheel, and checks that it is
+ *        not later than the earliest pending timer.
+ */
+static MO_UINT64 MoTestsQueryTimerWheelDeadline()
+{
+    MO_UINT64 Deadline = ::MoTimerWheelQueryNextDeadline(&g_TimerWheel.Wheel);
+
+    MO_UINT64 EarliestTick = MO_TIMER_WHEEL_NO_DEADLINE;
+    for (MO_UINTN i = 0; i < MO_TESTS_TIMER_WHEEL_TIMERS; ++i)
+    {
+        PMO_TESTS_TIMER Timer = &g_TimerWheel.Timers[i];
+        if (Timer->Pending && Timer->ExpireTick < EarliestTick)
+        {
+            EarliestTick = Timer->ExpireTick;
+        }
+    }
+
+    if (MO_TIMER_WHEEL_NO_DEADLINE == EarliestTick)
+    {
+        MO_TESTS_CHECK(MO_TIMER_WHEEL_NO_DEADLINE == Deadline);
+        return Deadline;
+    }
+
+    MO_TESTS_CHECK(Deadline >=
+        (g_TimerWheel.Wheel.CurrentTick << MO_TESTS_TIMER_WHEEL_TICK_SHIFT));
+    MO_TESTS_CHECK(Deadline <=
+        (EarliestTick << MO_TESTS_TIMER_WHEEL_TICK_SHIFT));
+    return Deadline;
+}
+
+/**
+ * @brief Advances the timer wheel from one next deadline to another until no
+ *        timer is pending, and checks that nothing expires before each of
+ *        them.
+ */
+static void MoTestsDrainTimerWheel(
+    _Mo_In_ MO_UINTN MaximumSteps)
+{
+    MO_UINTN Steps = 0;
+    while (g_TimerWheel.PendingCount && Steps < MaximumSteps)
+    {
+        MO_UINT64 Deadline = ::MoTestsQueryTimerWheelDeadline();
+        if (MO_TIMER_WHEEL_NO_DEADLINE == Deadline)
+        {
+            break;
+        }
+        if (Deadline > g_TimerWheel.CurrentNanoseconds)
+        {
+            ::MoTestsAdvanceTimerWheel(Deadline - 1);
+            MO_TESTS_CHECK(0 == g_TimerWheel.Calls);
+        }
+        ::MoTestsAdvanceTimerWheel(Deadline);
+        ++Steps;
+    }
+    MO_TESTS_CHECK(0 == g_TimerWheel.PendingCount);
+    MO_TESTS_CHECK(MO_TIMER_WHEEL_NO_DEADLINE ==
+        ::MoTimerWheelQueryNextDeadline(&g_TimerWheel.Wheel));
+}
+
+static void MoTestsCascadeTimerWheel()
+{
+    // Start from an unaligned tick, so the cascades happen before the
+    // timers reach their levels' boundaries.
+    ::MoTestsResetTimerWheel(12345ULL << MO_TESTS_TIMER_WHEEL_TICK_SHIFT);
+
+    MO_UINTN Index = 0;
+    for (MO_UINT32 Level = 1; Level <= MO_TIMER_WHEEL_LEVEL_COUNT; ++Level)
+    {
+        MO_UINT64 Boundary = 1ULL << (MO_TIMER_WHEEL_SLOT_BITS * Level);
+        for (MO_UINT64 Ticks = Boundary - 1; Ticks <= Boundary + 1; ++Ticks)
+        {
+            ::MoTestsInsertTimer(
+                Index++,
+                g_TimerWheel.CurrentNanoseconds +
+                    (Ticks << MO_TESTS_TIMER_WHEEL_TICK_SHIFT),
+                MoTestsTimerActionNone);
+        }
+    }
+    ::MoTestsInsertTimer(
+        Index++,
+        g_TimerWheel.CurrentNanoseconds +
+            ((3 * MO_TIMER_WHEEL_RANGE_TICKS + 5) <<
+                MO_TESTS_TIMER_WHEEL_TICK_SHIFT),
+        MoTestsTimerActionNone);
+
+    // Each timer is moved at most once per level and once more per range.
+    ::MoTestsDrainTimerWheel(Index * (MO_TIMER_WHEEL_LEVEL_COUNT + 3) + 1);
+    MO_TESTS_CHECK(0 == g_TimerWheel.EarlyExpirations);
+    MO_TESTS_CHECK(0 == g_TimerWheel.LateExpirations);
+}
+
+static void MoTestsRandomizeTimerWheel()
+{
+    g_TimerWheelRandom.seed(0x4D6F62696C697479ULL);
+    ::MoTestsResetTimerWheel(
+        (g_TimerWheelRandom() % MO_TIMER_WHEEL_RANGE_TICKS) <<
+            MO_TESTS_TIMER_WHEEL_TICK_SHIFT);
+
+    for (MO_UINTN Operation = 0;
+        Operation < MO_TESTS_TIMER_WHEEL_OPERATIONS;
+        ++Operation)
+    {
+        MO_UINTN Index = g_TimerWheelRandom() % MO_TESTS_TIMER_WHEEL_TIMERS;
+        MO_UINT64 Now = g_TimerWheel.CurrentNanoseconds;
+        switch (g_TimerWheelRandom() % 16)
+        {
+        case 0:
+        case 1:
+        case 2:
+        case 3:
+        case 4:
+        case 5:
+            ::MoTestsInsertTimer(
+                Index,
+                ::MoTestsPickTimerDeadline(),
+                static_cast<MO_TESTS_TIMER_ACTION>(
+                    g_TimerWheelRandom() % MoTestsTimerActionMaximum));
+            break;
+        case 6:
+        case 7:
+            ::MoTestsCancelTimer(Index);
+            break;
+        case 8:
+        case 9:
+        case 10:
+        case 11:
+            ::MoTestsAdvanceTimerWheel(Now + g_TimerWheelRandom() %
+                (256ULL << MO_TESTS_TIMER_WHEEL_TICK_SHIFT));
+            break;
+        case 12:
+            ::MoTestsAdvanceTimerWheel(Now + g_TimerWheelRandom() %
+                (MO_TIMER_WHEEL_RANGE_TICKS <<
+                    MO_TESTS_TIMER_WHEEL_TICK_SHIFT));
+            break;
+        default:
+        {
+            // Nothing expires before the next deadline.
+            MO_UINT64 Deadline = ::MoTestsQueryTimerWheelDeadline();
+            if (MO_TIMER_WHEEL_NO_DEADLINE != Deadline && Deadline > Now)
+            {
+                ::MoTestsAdvanceTimerWheel(Deadline - 1);
+                MO_TESTS_CHECK(0 == g_TimerWheel.Calls);
+                ::MoTestsAdvanceTimerWheel(Deadline);
+            }
+            break;
+        }
+        }
+    }
+
+    g_TimerWheel.ActionsEnabled = MO_FALSE;
+    ::MoTestsDrainTimerWheel(
+        MO_TESTS_TIMER_WHEEL_TIMERS * (MO_TIMER_WHEEL_LEVEL_COUNT + 3) + 1);
+    MO_TESTS_CHECK(0 == g_TimerWheel.EarlyExpirations);
+    MO_TESTS_CHECK(0 == g_TimerWheel.LateExpirations);
+    for (MO_UINT32 Level = 0; Level < MO_TIMER_WHEEL_LEVEL_COUNT; ++Level)
+    {
+        MO_TESTS_CHECK(0 == g_TimerWheel.Wheel.OccupiedSlots[Level]);
+    }
+}
+
+/**
+ * @brief Runs the worker on the contending threads at the same time, and
+ *        reports the average time of each lock acquisition.
+ * @return The number of the contending threads, or 0 if the benchmark is
+ *         skipped.
+ * @remarks The spin locks are not designed for the preempted lock holders and
+ *          waiters, so the threads are no more than the processors, and the
+ *          benchmark is skipped on a single processor.
+ */
+template<typename WorkerType>
+static MO_UINTN MoTestsRunContention(
+    _Mo_In_ const char* Name,
+    _Mo_In_ WorkerType Worker)
+{
+    g_ContentionCounter = 0;
+
+    MO_UINTN ThreadCount = std::thread::hardware_concurrency();
+    if (ThreadCount > MO_TESTS_CONTENTION_MAXIMUM_THREADS)
+    {
+        ThreadCount = MO_TESTS_CONTENTION_MAXIMUM_THREADS;
+    }
+    if (ThreadCount < 2)
+    {
+        std::printf("%s: skipped on a single processor.\n", Name);
+        return 0;
+    }
+
+    std::chrono::steady_clock::time_point Start =
+        std::chrono::steady_clock::now();
+    std::vector<std::thread> Threads;
+    for (MO_UINTN i = 0; i < ThreadCount; ++i)
+    {
+        Threads.emplace_back(Worker);
+    }
+    for (std::thread& Thread : Threads)
+    {
+        Thread.join();
+    }
+    std::chrono::nanoseconds Elapsed =
+        std::chrono::steady_clock::now() - Start;
+
+    std::printf(
+        "%s: %.1f ns per acquisition with %zu threads.\n",
+        Name,
+        static_cast<double>(Elapsed.count()) / (
+            ThreadCount * MO_TESTS_CONTENTION_ITERATIONS),
+        ThreadCount);
+    return ThreadCount;
+}
+
+static void MoTestsContendSpinLock()
+{
+    MO_SPIN_LOCK Lock;
+    ::MoSpinLockInitialize(&Lock);
+    MO_UINTN ThreadCount = ::MoTestsRunContention("Spin lock", [&Lock]()
+    {
+        for (MO_UINTN i = 0; i < MO_TESTS_CONTENTION_ITERATIONS; ++i)
+        {
+            ::MoSpinLockAcquire(&Lock);
+            g_ContentionCounter = g_ContentionCounter + 1;
+            ::MoSpinLockRelease(&Lock);
+        }
+    });
+    MO_TESTS_CHECK(
+        ThreadCount * MO_TESTS_CONTENTION_ITERATIONS == g_ContentionCounter);
+}
+
+static void MoTestsContendTicketLock()
+{
+    MO_TICKET_LOCK Lock;
+    ::MoTicketLockInitialize(&Lock);
+    MO_UINTN ThreadCount = ::MoTestsRunContention("Ticket lock", [&Lock]()
+    {
+        for (MO_UINTN i = 0; i < MO_TESTS_CONTENTION_ITERATIONS; ++i)
+        {
+            ::MoTicketLockAcquire(&Lock);
+            g_ContentionCounter = g_ContentionCounter + 1;
+            ::MoTicketLockRelease(&Lock);
+        }
+    });
+    MO_TESTS_CHECK(
+        ThreadCount * MO_TESTS_CONTENTION_ITERATIONS == g_ContentionCounter);
+}
+
+static void MoTestsContendMcsLock()
+{
+    MO_MCS_LOCK Lock;
+    ::MoMcsLockInitialize(&Lock);
+    MO_UINTN ThreadCount = ::MoTestsRunContention("MCS lock", [&Lock]()
+    {
+        MO_MCS_LOCK_NODE Node;
+        for (MO_UINTN i = 0; i < MO_TESTS_CONTENTION_ITERATIONS; ++i)
+        {
+            ::MoMcsLockAcquire(&Lock, &Node);
+            g_ContentionCounter = g_ContentionCounter + 1;
+            ::MoMcsLockRelease(&Lock, &Node);
+        }
+    });
+    MO_TESTS_CHECK(
+        ThreadCount * MO_TESTS_CONTENTION_ITERATIONS == g_ContentionCounter);
+}
+
+static void MoTestsContendReadWriteLock()
+{
+    MO_READ_WRITE_LOCK Lock;
+    ::MoReadWriteLockInitialize(&Lock);
+    MO_UINTN ThreadCount = ::MoTestsRunContention("Reader-writer lock", [&Lock]()
+    {
+        for (MO_UINTN i = 0; i < MO_TESTS_CONTENTION_ITERATIONS; ++i)
+        {
+            // One of every four acquisitions is exclusive.
+            if (!(i % 4))
+            {
+                ::MoReadWriteLockAcquireExclusive(&Lock);
+                g_ContentionCounter = g_ContentionCounter + 1;
+                ::MoReadWriteLockReleaseExclusive(&Lock);
+            }
+            else
+            {
+                ::MoReadWriteLockAcquireShared(&Lock);
+                MO_UINTN Counter = g_ContentionCounter;
+                MO_TESTS_CHECK(Counter == g_ContentionCounter);
+                ::MoReadWriteLockReleaseShared(&Lock);
+            }
+        }
+    });
+    MO_TESTS_CHECK(
+        ThreadCount * (MO_TESTS_CONTENTION_ITERATIONS / 4) ==
+        g_ContentionCounter);
+}
+
+static MO_VOID MOAPI MoTestsTaskPoolIdle(
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    MO_UNREFERENCED_PARAMETER(Context);
+
+    std::this_thread::yield();
+}
+
+/**
+ * @brief Initializes the task pool under test, and starts the threads of all
+ *        workers but the first one, which is run by the calling thread.
+ */
+static void MoTestsStartTaskPool(
+    _Mo_Out_ std::vector<std::thread>& Threads)
+{
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoTaskPoolInitialize(
+        &g_TaskPool.Pool,
+        g_TaskPool.Workers,
+        MO_TESTS_TASK_POOL_WORKERS,
+        g_TaskPool.Slots,
+        MO_TESTS_TASK_POOL_DEQUE_CAPACITY,
+        MoTestsTaskPoolIdle,
+        nullptr));
+
+    g_CurrentWorker = ::MoTaskPoolGetWorker(&g_TaskPool.Pool, 0);
+    for (MO_UINT32 i = 1; i < MO_TESTS_TASK_POOL_WORKERS; ++i)
+    {
+        Threads.emplace_back([i]()
+        {
+            g_CurrentWorker = ::MoTaskPoolGetWorker(&g_TaskPool.Pool, i);
+            ::MoTaskPoolWorkerRun(g_CurrentWorker);
+        });
+    }
+}
+
+static void MoTestsStopTaskPool(
+    _Mo_InOut_ std::vector<std::thread>& Threads)
+{
+    ::MoTaskPoolShutdown(&g_TaskPool.Pool);
+    for (std::thread& Thread : Threads)
+    {
+        Thread.join();
+    }
+    Threads.clear();
+    g_CurrentWorker = nullptr;
+}
+
+/**
+ * @brief The context of the tasks which count their executions.
+ */
+typedef struct _MO_TESTS_COUNTED_TASK
+{
+    /**
+     * @brief The task.
+     */
+    MO_TASK Task;
+    /**
+     * @brief The number of the executions of the task.
+     */
+    MO_UINT32 volatile* Executions;
+    /**
+     * @brief The counter decremented after the task is executed.
+     */
+    MO_UINT32 volatile* Remaining;
+    /**
+     * @brief The counter incremented after the task is executed, or nullptr.
+     */
+    MO_UINT32 volatile* Completed;
+} MO_TESTS_COUNTED_TASK, *PMO_TESTS_COUNTED_TASK;
+
+static MO_VOID MOAPI MoTestsCountedTaskRoutine(
+    _Mo_In_ PMO_TASK_POOL_WORKER Worker,
+    _Mo_In_ PMO_TASK Task)
+{
+    MO_UNREFERENCED_PARAMETER(Worker);
+
+    PMO_TESTS_COUNTED_TASK Context =
+        reinterpret_cast<PMO_TESTS_COUNTED_TASK>(Task->Context);
+    ::MoAtomicFetchAdd32(Context->Executions, 1, MO_ATOMIC_ORDER_RELAXED);
+    if (Context->Completed)
+    {
+        ::MoAtomicFetchAdd32(Context->Completed, 1, MO_ATOMIC_ORDER_RELEASE);
+    }
+    ::MoAtomicFetchAdd32(
+        Context->Remaining,
+        static_cast<MO_UINT32>(-1),
+        MO_ATOMIC_ORDER_RELEASE);
+}
+
+static void MoTestsRaceTaskPoolDeques()
+{
+    std::vector<std::thread> Threads;
+    ::MoTestsStartTaskPool(Threads);
+
+    // Each round spawns more tasks than the deque holds, so the owner executes
+    // some of them in place, and then pops the rest while the thieves steal
+    // them, which races for the last task of the deque.
+    std::vector<MO_TESTS_COUNTED_TASK> Tasks(
+        MO_TESTS_TASK_POOL_ROUNDS * MO_TESTS_TASK_POOL_TASKS_PER_ROUND);
+    for (MO_UINTN Round = 0; Round < MO_TESTS_TASK_POOL_ROUNDS; ++Round)
+    {
+        MO_UINT32 volatile Remaining = MO_TESTS_TASK_POOL_TASKS_PER_ROUND;
+        for (MO_UINTN i = 0; i < MO_TESTS_TASK_POOL_TASKS_PER_ROUND; ++i)
+        {
+            MO_UINTN Index = Round * MO_TESTS_TASK_POOL_TASKS_PER_ROUND + i;
+            PMO_TESTS_COUNTED_TASK Task = &Tasks[Index];
+            Task->Executions = &g_TaskExecutions[Index];
+            Task->Remaining = &Remaining;
+            Task->Completed = nullptr;
+            ::MoTaskInitialize(
+                &Task->Task,
+                MoTestsCountedTaskRoutine,
+                Task,
+                nullptr);
+            ::MoTaskPoolSpawn(g_CurrentWorker, &Task->Task);
+        }
+        ::MoTaskPoolWorkUntilZero(g_CurrentWorker, &Remaining);
+    }
+
+    ::MoTestsStopTaskPool(Threads);
+
+    // Every task is executed exactly once, neither lost nor duplicated by the
+    // races between the owner and the thieves.
+    MO_UINTN Mismatches = 0;
+    for (MO_UINTN i = 0; i < Tasks.size(); ++i)
+    {
+        if (1 != g_TaskExecutions[i])
+        {
+            ++Mismatches;
+        }
+    }
+    MO_TESTS_CHECK(0 == Mismatches);
+}
+
+/**
+ * @brief The context of the continuation, which records the predecessors
+ *        completed when it starts.
+ */
+typedef struct _MO_TESTS_CONTINUATION
+{
+    /**
+     * @brief The continuation task.
+     */
+    MO_TASK Task;
+    /**
+     * @brief The number of the predecessors which have completed.
+     */
+    MO_UINT32 volatile Completed;
+    /**
+     * @brief The number of the predecessors completed when the continuation
+     *        starts.
+     */
+    MO_UINT32 CompletedAtStart;
+    /**
+     * @brief The number of the executions of the continuation.
+     */
+    MO_UINT32 volatile Executions;
+    /**
+     * @brief The counter decremented after the continuation is executed.
+     */
+    MO_UINT32 volatile Remaining;
+} MO_TESTS_CONTINUATION, *PMO_TESTS_CONTINUATION;
+
+static MO_VOID MOAPI MoTestsContinuationRoutine(
+    _Mo_In_ PMO_TASK_POOL_WORKER Worker,
+    _Mo_In_ PMO_TASK Task)
+{
+    MO_UNREFERENCED_PARAMETER(Worker);
+
+    PMO_TESTS_CONTINUATION Context =
+        reinterpret_cast<PMO_TESTS_CONTINUATION>(Task->Context);
+    Context->CompletedAtStart = ::MoAtomicLoad32(
+        &Context->Completed,
+        MO_ATOMIC_ORDER_ACQUIRE);
+    ::MoAtomicFetchAdd32(&Context->Executions, 1, MO_ATOMIC_ORDER_RELAXED);
+    ::MoAtomicFetchAdd32(
+        &Context->Remaining,
+        static_cast<MO_UINT32>(-1),
+        MO_ATOMIC_ORDER_RELEASE);
+}
+
+static void MoTestsSpawnTaskPoolContinuations()
+{
+    const MO_UINTN PredecessorCount = 4 * MO_TESTS_TASK_POOL_DEQUE_CAPACITY;
+    const MO_UINTN Repetitions = 1000;
+
+    std::vector<std::thread> Threads;
+    ::MoTestsStartTaskPool(Threads);
+
+    MO_UINTN Mismatches = 0;
+    for (MO_UINTN Repetition = 0; Repetition < Repetitions; ++Repetition)
+    {
+        MO_TESTS_CONTINUATION Continuation;
+        Continuation.Completed = 0;
+        Continuation.CompletedAtStart = 0;
+        Continuation.Executions = 0;
+        Continuation.Remaining = 1;
+        ::MoTaskInitialize(
+            &Continuation.Task,
+            MoTestsContinuationRoutine,
+            &Continuation,
+            nullptr);
+
+        // All predecessors are initialized before any of them is spawned, so
+        // the pending count cannot reach zero early.
+        std::vector<MO_TESTS_COUNTED_TASK> Tasks(PredecessorCount);
+        std::vector<MO_UINT32> Executions(PredecessorCount);
+        MO_UINT32 volatile Remaining = static_cast<MO_UINT32>(
+            PredecessorCount);
+        for (MO_UINTN i = 0; i < PredecessorCount; ++i)
+        {
+            Tasks[i].Executions = &Executions[i];
+            Tasks[i].Remaining = &Remaining;
+            Tasks[i].Completed = &Continuation.Completed;
+            ::MoTaskInitialize(
+                &Tasks[i].Task,
+                MoTestsCountedTaskRoutine,
+                &Tasks[i],
+                &Continuation.Task);
+        }
+        if (PredecessorCount != Continuation.Task.PendingCount)
+        {
+            ++Mismatches;
+        }
+        for (MO_UINTN i = 0; i < PredecessorCount; ++i)
+        {
+            ::MoTaskPoolSpawn(g_CurrentWorker, &Tasks[i].Task);
+        }
+
+        // The continuation is spawned by the worker which completes the last
+        // predecessor, which may be a thief.
+        ::MoTaskPoolWorkUntilZero(g_CurrentWorker, &Continuation.Remaining);
+        ::MoTaskPoolWorkUntilZero(g_CurrentWorker, &Remaining);
+
+        if (1 != Continuation.Executions ||
+            PredecessorCount != Continuation.CompletedAtStart ||
+            0 != Continuation.Task.PendingCount)
+        {
+            ++Mismatches;
+        }
+    }
+
+    ::MoTestsStopTaskPool(Threads);
+
+    MO_TESTS_CHECK(0 == Mismatches);
+}
+
+static MO_VOID MOAPI MoTestsInnerParallelRoutine(
+    _Mo_In_ MO_UINTN Begin,
+    _Mo_In_ MO_UINTN End,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    MO_UINTN Row = reinterpret_cast<MO_UINTN>(Context);
+    for (MO_UINTN Column = Begin; Column < End; ++Column)
+    {
+        ::MoAtomicFetchAdd32(
+            &g_ParallelVisits[Row][Column],
+            1,
+            MO_ATOMIC_ORDER_RELAXED);
+    }
+}
+
+static MO_VOID MOAPI MoTestsOuterParallelRoutine(
+    _Mo_In_ MO_UINTN Begin,
+    _Mo_In_ MO_UINTN End,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    MO_UNREFERENCED_PARAMETER(Context);
+
+    // The nested loops are run by the worker which executes the outer chunk,
+    // which is the owner or a thief.
+    for (MO_UINTN Row = Begin; Row < End; ++Row)
+    {
+        MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoTaskPoolParallelFor(
+            g_CurrentWorker,
+            0,
+            MO_TESTS_TASK_POOL_PARALLEL_ITERATIONS,
+            1,
+            MoTestsInnerParallelRoutine,
+            reinterpret_cast<MO_POINTER>(Row)));
+    }
+}
+
+static void MoTestsNestTaskPoolParallelFor()
+{
+    std::vector<std::thread> Threads;
+    ::MoTestsStartTaskPool(Threads);
+
+    // Both levels are split into more chunks than the deques hold, so the
+    // full deques execute the chunks in place, and the waiting workers run
+    // the chunks of the other levels.
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoTaskPoolParallelFor(
+        g_CurrentWorker,
+        0,
+        MO_TESTS_TASK_POOL_PARALLEL_ITERATIONS,
+        1,
+        MoTestsOuterParallelRoutine,
+        nullptr));
+
+    // The empty range and the invalid parameters return before spawning.
+    MO_TESTS_CHECK(MO_RESULT_SUCCESS_OK == ::MoTaskPoolParallelFor(
+        g_CurrentWorker,
+        8,
+        8,
+        1,
+        MoTestsOuterParallelRoutine,
+        nullptr));
+    MO_TESTS_CHECK(MO_RESULT_ERROR_INVALID_PARAMETER ==
+        ::MoTaskPoolParallelFor(
+            g_CurrentWorker,
+            0,
+            8,
+            0,
+            MoTestsOuterParallelRoutine,
+            nullptr));
+
+    ::MoTestsStopTaskPool(Threads);
+
+    MO_UINTN Mismatches = 0;
+    for (MO_UINTN Row = 0;
+        Row < MO_TESTS_TASK_POOL_PARALLEL_ITERATIONS;
+        ++Row)
+    {
+        for (MO_UINTN Column = 0;
+            Column < MO_TESTS_TASK_POOL_PARALLEL_ITERATIONS;
+            ++Column)
+        {
+            if (1 != g_ParallelVisits[Row][Column])
+            {
+                ++Mismatches;
+            }
+        }
+    }
+    MO_TESTS_CHECK(0 == Mismatches);
+}
+
+int main()
+{
+    std::printf("Mobility.Core Host-Side Unit Tests\n");
+
+    ::MoTestsPlatformReset();
+
+    ::MoTestsMapWith1GiBPages();
+    ::MoTestsMapWith2MiBPages();
+    ::MoTestsMapUnalignedEdges();
+    ::MoTestsSplitLargePage();
+    ::MoTestsRejectInvalidRanges();
+    ::MoTestsReportOutOfMemory();
+    ::MoTestsMergeAdjacentRanges();
+    ::MoTestsSplitRanges();
+    ::MoTestsCombineRangeSets();
+    ::MoTestsFillRangeSet();
+    ::MoTestsCacheSpscRingQueueIndexes();
+    ::MoTestsWrapRingQueues();
+    ::MoTestsBatchMpscRingQueue();
+    ::MoTestsValidateServiceRing();
+    ::MoTestsClampServiceRing();
+    ::MoTestsWakeUpServiceRing();
+    ::MoTestsCoalesceTlbRanges();
+    ::MoTestsFlushTlbBatch();
+    ::MoTestsCascadeTimerWheel();
+    ::MoTestsRandomizeTimerWheel();
+    ::MoTestsContendSpinLock();
+    ::MoTestsContendTicketLock();
+    ::MoTestsContendMcsLock();
+    ::MoTestsContendReadWriteLock();
+    ::MoTestsRaceTaskPoolDeques();
+    ::MoTestsSpawnTaskPoolContinuations();
+    ::MoTestsNestTaskPoolParallelFor();
+
+    if (g_FailedChecks)
+    {
+        std::printf("%zu check(s) failed.\n", g_FailedChecks);
+        return 1;
+    }
+
+    std::printf("All checks passed.\n");
+    return 0;
+}
@@ -12,9 +12,12 @@
 
 #include <Mobility.Runtime.Core.h>
 #include <Mobility.Platform.Interface.h>
+#include <Mobility.Memory.RangeSet.h>
 
 #include <Guid/Acpi.h>
 #include <IndustryStandard/Acpi20.h>
+#include <IndustryStandard/Acpi40.h>
+#include <IndustryStandard/HighPrecisionEventTimerTable.h>
 
 MO_EXTERN_C MO_BOOL MoUefiAcpiStructureValidate(
     _Mo_In_ MO_POINTER Structure,
@@ -179,281 +182,1306 @@ MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiQueryDescriptionTable(
     return MO_RESULT_SUCCESS_OK;
 }
 
-MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiQueryMemoryRanges(
-    _Mo_Out_ PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM* MemoryRanges,
-    _Mo_Out_ PMO_UINTN MemoryRangesCount,
-    _Mo_In_ MO_UINT64 SystemResourceAffinityTable)
+static_assert(
+    0 == (MO_UEFI_ACPI_TABLE_INDEX_BUCKETS &
+        (MO_UEFI_ACPI_TABLE_INDEX_BUCKETS - 1)),
+    "The bucket count must be a power of two.");
+static_assert(
+    MO_UEFI_ACPI_TABLE_INDEX_BUCKETS > MO_UEFI_ACPI_TABLE_INDEX_MAXIMUM_TABLES,
+    "The bucket count must be larger than the maximum table count.");
+
+namespace
 {
-    if (!MemoryRanges ||
-        !MemoryRangesCount ||
-        !SystemResourceAffinityTable)
+    static MO_UINTN MoUefiAcpiTableIndexHash(
+        _Mo_In_ MO_UINT32 Signature)
+    {
+        // The signatures are 4 ASCII characters, so use the multiplicative
+        // hashing for mixing the bits of all characters into the bucket index.
+        MO_UINT32 Hash = Signature * 0x9E3779B1u;
+        return (Hash >> 16) & (MO_UEFI_ACPI_TABLE_INDEX_BUCKETS - 1);
+    }
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiTableIndexInitialize(
+    _Mo_Out_ PMO_UEFI_ACPI_TABLE_INDEX Index,
+    _Mo_In_ MO_UINT64 ExtendedSystemDescriptionTable)
+{
+    if (!Index || !ExtendedSystemDescriptionTable)
     {
         return MO_RESULT_ERROR_INVALID_PARAMETER;
     }
-    *MemoryRanges = nullptr;
-    *MemoryRangesCount = 0u;
+
+    if (MO_RESULT_SUCCESS_OK != ::MoRuntimeMemoryFillByte(
+        Index,
+        0,
+        sizeof(MO_UEFI_ACPI_TABLE_INDEX)))
+    {
+        // This function should not fail here.
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
 
     if (!::MoUefiAcpiDescriptionTableValidate(
-        reinterpret_cast<MO_POINTER>(SystemResourceAffinityTable),
-        EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_SIGNATURE,
-        EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_REVISION))
+        reinterpret_cast<MO_POINTER>(ExtendedSystemDescriptionTable),
+        EFI_ACPI_2_0_EXTENDED_SYSTEM_DESCRIPTION_TABLE_SIGNATURE,
+        EFI_ACPI_2_0_EXTENDED_SYSTEM_DESCRIPTION_TABLE_REVISION))
     {
         return MO_RESULT_ERROR_INVALID_POINTER;
     }
+    Index->ExtendedSystemDescriptionTable = ExtendedSystemDescriptionTable;
+    EFI_ACPI_DESCRIPTION_HEADER* TableHeader =
+        reinterpret_cast<EFI_ACPI_DESCRIPTION_HEADER*>(
+            ExtendedSystemDescriptionTable);
 
-    using TableHeaderType = EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_HEADER;
-    TableHeaderType* TableHeader = reinterpret_cast<TableHeaderType*>(
-        SystemResourceAffinityTable);
-    MO_UINTN TableEntriesStart = reinterpret_cast<MO_UINTN>(&TableHeader[1]);
+    bool IndexFull = false;
+    PMO_UINT64 TableArray = reinterpret_cast<PMO_UINT64>(&TableHeader[1]);
+    MO_UINTN TableCount = TableHeader->Length;
+    TableCount -= sizeof(EFI_ACPI_DESCRIPTION_HEADER);
+    TableCount /= sizeof(MO_UINT64);
+    for (MO_UINTN i = 0; i < TableCount; ++i)
+    {
+        EFI_ACPI_DESCRIPTION_HEADER* Candidate =
+            reinterpret_cast<EFI_ACPI_DESCRIPTION_HEADER*>(TableArray[i]);
+        if (!Candidate ||
+            Candidate->Length < sizeof(EFI_ACPI_DESCRIPTION_HEADER) ||
+            !::MoUefiAcpiStructureValidate(Candidate, Candidate->Length))
+        {
+            ++Index->SkippedTableCount;
+            continue;
+        }
+        if (Index->TableCount >= MO_UEFI_ACPI_TABLE_INDEX_MAXIMUM_TABLES)
+        {
+            IndexFull = true;
+            ++Index->SkippedTableCount;
+            continue;
+        }
+
+        MO_UINT16 Current = Index->TableCount++;
+        PMO_UEFI_ACPI_TABLE_INDEX_ENTRY Entry = &Index->Tables[Current];
+        Entry->TableAddress = TableArray[i];
+        Entry->Signature = Candidate->Signature;
+        Entry->Revision = Candidate->Revision;
+        Entry->NextInstance = 0;
 
-    MO_UINT16 Count = 0;
+        MO_UINTN Bucket = ::MoUefiAcpiTableIndexHash(Candidate->Signature);
+        for (;;)
+        {
+            MO_UINT16 First = Index->Buckets[Bucket];
+            if (!First)
+            {
+                Index->Buckets[Bucket] = static_cast<MO_UINT16>(Current + 1);
+                break;
+            }
+            if (Candidate->Signature == Index->Tables[First - 1].Signature)
+            {
+                // Append to the instance chain for keeping the XSDT order.
+                PMO_UEFI_ACPI_TABLE_INDEX_ENTRY Last = &Index->Tables[First - 1];
+                while (Last->NextInstance)
+                {
+                    Last = &Index->Tables[Last->NextInstance - 1];
+                }
+                Last->NextInstance = static_cast<MO_UINT16>(Current + 1);
+                break;
+            }
+            Bucket = (Bucket + 1) & (MO_UEFI_ACPI_TABLE_INDEX_BUCKETS - 1);
+        }
+    }
+
+    return IndexFull ? MO_RESULT_SUCCESS_FALSE : MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiTableIndexQuery(
+    _Mo_Out_ PMO_UINT64 TableAddress,
+    _Mo_In_ PMO_UEFI_ACPI_TABLE_INDEX Index,
+    _Mo_In_ MO_UINT32 ExpectedSignature,
+    _Mo_In_ MO_UINT8 MinimumRevision,
+    _Mo_In_ MO_UINTN Instance)
+{
+    if (!TableAddress || !Index)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    *TableAddress = 0u;
+
+    MO_UINTN Bucket = ::MoUefiAcpiTableIndexHash(ExpectedSignature);
+    for (MO_UINTN Probe = 0; Probe < MO_UEFI_ACPI_TABLE_INDEX_BUCKETS; ++Probe)
     {
-        MO_UINTN CurrentItem = TableEntriesStart;
-        MO_UINT32 ProcessedSize = sizeof(TableHeaderType);
-        while (ProcessedSize < TableHeader->Header.Length)
+        MO_UINT16 Current = Index->Buckets[Bucket];
+        if (!Current)
         {
-            using CandidateType = EFI_ACPI_3_0_MEMORY_AFFINITY_STRUCTURE;
-            CandidateType* Candidate =
-                reinterpret_cast<CandidateType*>(CurrentItem);
-            if (EFI_ACPI_3_0_MEMORY_AFFINITY == Candidate->Type)
+            // Reach the end of the probe sequence.
+            break;
+        }
+        if (ExpectedSignature == Index->Tables[Current - 1].Signature)
+        {
+            while (Current)
             {
-                ++Count;
+                PMO_UEFI_ACPI_TABLE_INDEX_ENTRY Entry =
+                    &Index->Tables[Current - 1];
+                if (Entry->Revision >= MinimumRevision)
+                {
+                    if (!Instance)
+                    {
+                        *TableAddress = Entry->TableAddress;
+                        return MO_RESULT_SUCCESS_OK;
+                    }
+                    --Instance;
+                }
+                Current = Entry->NextInstance;
             }
-            ProcessedSize += Candidate->Length;
-            CurrentItem += Candidate->Length;
+            break;
         }
+        Bucket = (Bucket + 1) & (MO_UEFI_ACPI_TABLE_INDEX_BUCKETS - 1);
     }
-    if (!Count)
+
+    return MO_RESULT_ERROR_NO_INTERFACE;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiSubStructureIteratorInitialize(
+    _Mo_Out_ PMO_UEFI_ACPI_SUB_STRUCTURE_ITERATOR Iterator,
+    _Mo_In_ MO_UINT64 DescriptionTable,
+    _Mo_In_ MO_UINTN HeaderSize,
+    _Mo_In_ MO_UINT16 TypeFilter)
+{
+    if (!Iterator || !DescriptionTable)
     {
-        // No Memory Affinity Structure found.
-        return MO_RESULT_ERROR_NO_INTERFACE;
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
     }
-    MO_UINTN Size = sizeof(MO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM) * Count;
+    Iterator->Current = 0u;
+    Iterator->End = 0u;
+    Iterator->TypeFilter = TypeFilter;
 
-    PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM Ranges = nullptr;
-    if (MO_RESULT_SUCCESS_OK != ::MoPlatformHeapAllocate(
-        reinterpret_cast<PMO_POINTER>(&Ranges),
-        Size))
+    EFI_ACPI_DESCRIPTION_HEADER* TableHeader =
+        reinterpret_cast<EFI_ACPI_DESCRIPTION_HEADER*>(DescriptionTable);
+    if (HeaderSize < sizeof(EFI_ACPI_DESCRIPTION_HEADER) ||
+        HeaderSize > TableHeader->Length)
     {
-        return MO_RESULT_ERROR_OUT_OF_MEMORY;
+        return MO_RESULT_ERROR_OUT_OF_BOUNDS;
+    }
+
+    MO_UINTN TableStart = static_cast<MO_UINTN>(DescriptionTable);
+    Iterator->Current = TableStart + HeaderSize;
+    Iterator->End = TableStart + TableHeader->Length;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiSubStructureIteratorNext(
+    _Mo_Out_ PMO_UEFI_ACPI_SUB_STRUCTURE_HEADER* SubStructure,
+    _Mo_InOut_ PMO_UEFI_ACPI_SUB_STRUCTURE_ITERATOR Iterator)
+{
+    if (!SubStructure || !Iterator)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
     }
+    *SubStructure = nullptr;
 
+    while (Iterator->Current < Iterator->End)
     {
-        MO_UINTN CurrentIndex = 0;
-        MO_UINTN CurrentItem = TableEntriesStart;
-        MO_UINT32 ProcessedSize = sizeof(TableHeaderType);
-        while (ProcessedSize < TableHeader->Header.Length)
+        MO_UINTN RemainingSize = Iterator->End - Iterator->Current;
+        PMO_UEFI_ACPI_SUB_STRUCTURE_HEADER Candidate =
+            reinterpret_cast<PMO_UEFI_ACPI_SUB_STRUCTURE_HEADER>(
+                Iterator->Current);
+        if (RemainingSize < sizeof(MO_UEFI_ACPI_SUB_STRUCTURE_HEADER) ||
+            Candidate->Length < sizeof(MO_UEFI_ACPI_SUB_STRUCTURE_HEADER) ||
+            Candidate->Length > RemainingSize)
         {
+            // Terminate the iteration because the following sub-structures
+            // cannot be located reliably.
+            Iterator->Current = Iterator->End;
+            return MO_RESULT_ERROR_OUT_OF_BOUNDS;
+        }
+        Iterator->Current += Candidate->Length;
+
+        if (MO_UEFI_ACPI_SUB_STRUCTURE_TYPE_ANY == Iterator->TypeFilter ||
+            Candidate->Type == Iterator->TypeFilter)
+        {
+            *SubStructure = Candidate;
+            return MO_RESULT_SUCCESS_OK;
+        }
+    }
+
+    return MO_RESULT_ERROR_NO_INTERFACE;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiEnumerateSubStructures(
+    _Mo_In_ MO_UINT64 DescriptionTable,
+    _Mo_In_ MO_UINTN HeaderSize,
+    _Mo_In_ MO_UINT16 TypeFilter,
+    _Mo_In_ PMO_UEFI_ACPI_SUB_STRUCTURE_CALLBACK Callback,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    if (!DescriptionTable || !Callback)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MO_UEFI_ACPI_SUB_STRUCTURE_ITERATOR Iterator;
+    MO_RESULT Result = ::MoUefiAcpiSubStructureIteratorInitialize(
+        &Iterator,
+        DescriptionTable,
+        HeaderSize,
+        TypeFilter);
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+
+    for (;;)
+    {
+        PMO_UEFI_ACPI_SUB_STRUCTURE_HEADER SubStructure = nullptr;
+        Result = ::MoUefiAcpiSubStructureIteratorNext(&SubStructure, &Iterator);
+        if (MO_RESULT_ERROR_NO_INTERFACE == Result)
+        {
+            // Reach the end of the ACPI description table.
+            break;
+        }
+        if (MO_RESULT_SUCCESS_OK != Result)
+        {
+            return Result;
+        }
+
+        Result = Callback(SubStructure, Context);
+        if (MO_RESULT_SUCCESS_OK != Result)
+        {
+            return Result;
+        }
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+static_assert(
+    sizeof(MO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM) == sizeof(MO_MEMORY_RANGE) &&
+    OFFSET_OF(MO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM, AddressBase) ==
+        OFFSET_OF(MO_MEMORY_RANGE, Base) &&
+    OFFSET_OF(MO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM, Length) ==
+        OFFSET_OF(MO_MEMORY_RANGE, Length),
+    "The simple memory range item must have the same layout as the range.");
+
+namespace
+{
+    static MO_RESULT MoUefiAcpiCollectMemoryRangesInternal(
+        _Mo_Out_Opt_ PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM Buffer,
+        _Mo_Out_Opt_ PMO_UINTN RequiredCount,
+        _Mo_Out_ PMO_UINTN ResultCount,
+        _Mo_In_ MO_UINTN BufferCount,
+        _Mo_In_ MO_UINT64 SystemResourceAffinityTable,
+        _Mo_In_ MO_BOOL Merge)
+    {
+        if (!ResultCount || !SystemResourceAffinityTable)
+        {
+            return MO_RESULT_ERROR_INVALID_PARAMETER;
+        }
+        *ResultCount = 0u;
+        if (RequiredCount)
+        {
+            *RequiredCount = 0u;
+        }
+        if (!Buffer)
+        {
+            BufferCount = 0u;
+        }
+
+        if (!::MoUefiAcpiDescriptionTableValidate(
+            reinterpret_cast<MO_POINTER>(SystemResourceAffinityTable),
+            EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_SIGNATURE,
+            EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_REVISION))
+        {
+            return MO_RESULT_ERROR_INVALID_POINTER;
+        }
+
+        MO_UEFI_ACPI_SUB_STRUCTURE_ITERATOR Iterator;
+        if (MO_RESULT_SUCCESS_OK != ::MoUefiAcpiSubStructureIteratorInitialize(
+            &Iterator,
+            SystemResourceAffinityTable,
+            sizeof(EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_HEADER),
+            EFI_ACPI_3_0_MEMORY_AFFINITY))
+        {
+            return MO_RESULT_ERROR_INVALID_POINTER;
+        }
+
+        // The merged ranges are maintained by the range set on the same
+        // buffer, which has the same layout as the simple memory range items.
+        MO_MEMORY_RANGE_SET MergedRanges = {};
+        if (Merge && BufferCount)
+        {
+            if (MO_RESULT_SUCCESS_OK != ::MoMemoryRangeSetInitialize(
+                &MergedRanges,
+                reinterpret_cast<PMO_MEMORY_RANGE>(Buffer),
+                BufferCount))
+            {
+                // This function should not fail here.
+                return MO_RESULT_ERROR_UNEXPECTED;
+            }
+        }
+
+        MO_UINTN StructureCount = 0u;
+        MO_UINTN Count = 0u;
+        MO_BOOL Insufficient = MO_FALSE;
+        for (;;)
+        {
+            PMO_UEFI_ACPI_SUB_STRUCTURE_HEADER SubStructure = nullptr;
+            MO_RESULT Result = ::MoUefiAcpiSubStructureIteratorNext(
+                &SubStructure,
+                &Iterator);
+            if (MO_RESULT_ERROR_NO_INTERFACE == Result)
+            {
+                // Reach the end of the System Resource Affinity Table (SRAT).
+                break;
+            }
             using CandidateType = EFI_ACPI_3_0_MEMORY_AFFINITY_STRUCTURE;
+            if (MO_RESULT_SUCCESS_OK != Result ||
+                SubStructure->Length < sizeof(CandidateType))
+            {
+                return MO_RESULT_ERROR_INVALID_POINTER;
+            }
             CandidateType* Candidate =
-                reinterpret_cast<CandidateType*>(CurrentItem);
-            if (EFI_ACPI_3_0_MEMORY_AFFINITY == Candidate->Type)
+                reinterpret_cast<CandidateType*>(SubStructure);
+            ++StructureCount;
+            if (Insufficient)
             {
-                MO_UINT64 AddressBase = Candidate->AddressBaseHigh;
-                AddressBase <<= 32;
-                AddressBase |= Candidate->AddressBaseLow;
-                MO_UINT64 Length = Candidate->LengthHigh;
-                Length <<= 32;
-                Length |= Candidate->LengthLow;
-                Ranges[CurrentIndex].AddressBase = AddressBase;
-                Ranges[CurrentIndex].Length = Length;
-                ++CurrentIndex;
+                // Only count the remaining structures for the required count.
+                continue;
             }
-            ProcessedSize += Candidate->Length;
-            CurrentItem += Candidate->Length;
+
+            MO_UINT64 AddressBase = Candidate->AddressBaseHigh;
+            AddressBase <<= 32;
+            AddressBase |= Candidate->AddressBaseLow;
+            MO_UINT64 Length = Candidate->LengthHigh;
+            Length <<= 32;
+            Length |= Candidate->LengthLow;
+
+            if (Merge)
+            {
+                if (!BufferCount)
+                {
+                    Insufficient = MO_TRUE;
+                    continue;
+                }
+                Result = ::MoMemoryRangeSetInsert(
+                    &MergedRanges,
+                    AddressBase,
+                    Length);
+                if (MO_RESULT_ERROR_OUT_OF_MEMORY == Result)
+                {
+                    Insufficient = MO_TRUE;
+                }
+                else if (MO_RESULT_SUCCESS_OK != Result)
+                {
+                    return MO_RESULT_ERROR_INVALID_POINTER;
+                }
+                continue;
+            }
+
+            if (Count >= BufferCount)
+            {
+                Insufficient = MO_TRUE;
+                continue;
+            }
+
+            // Find the insertion point from the tail, which is the fast path
+            // because the firmware usually describes the memory in order. The
+            // equal address bases are kept in the original order.
+            MO_UINTN Position = Count;
+            while (Position && Buffer[Position - 1].AddressBase > AddressBase)
+            {
+                --Position;
+            }
+            if (MO_RESULT_SUCCESS_OK != ::MoRuntimeMemoryMove(
+                &Buffer[Position + 1],
+                &Buffer[Position],
+                sizeof(MO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM) *
+                    (Count - Position)))
+            {
+                return MO_RESULT_ERROR_UNEXPECTED;
+            }
+            Buffer[Position].AddressBase = AddressBase;
+            Buffer[Position].Length = Length;
+            ++Count;
+        }
+        if (Merge)
+        {
+            Count = MergedRanges.Count;
+        }
+
+        if (!StructureCount)
+        {
+            // No Memory Affinity Structure found.
+            return MO_RESULT_ERROR_NO_INTERFACE;
         }
+        if (RequiredCount)
+        {
+            *RequiredCount = StructureCount;
+        }
+        if (Insufficient)
+        {
+            return MO_RESULT_ERROR_OUT_OF_MEMORY;
+        }
+
+        *ResultCount = Count;
+
+        return MO_RESULT_SUCCESS_OK;
     }
 
-    if (MO_RESULT_SUCCESS_OK != ::MoRuntimeElementSort(
-        Ranges,
-        Count,
-        sizeof(MO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM),
-        [](
-            _Mo_In_ MO_POINTER Left,
-            _Mo_In_ MO_POINTER Right,
-            _Mo_In_ MO_POINTER Context) -> MO_INTN MOAPI
+    typedef MO_RESULT(MOAPI* PMO_UEFI_ACPI_COLLECT_MEMORY_RANGES_ROUTINE)(
+        _Mo_Out_Opt_ PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM Buffer,
+        _Mo_Out_Opt_ PMO_UINTN RequiredCount,
+        _Mo_Out_ PMO_UINTN ResultCount,
+        _Mo_In_ MO_UINTN BufferCount,
+        _Mo_In_ MO_UINT64 SystemResourceAffinityTable);
+
+    static MO_RESULT MoUefiAcpiAllocateMemoryRanges(
+        _Mo_Out_ PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM* Ranges,
+        _Mo_Out_ PMO_UINTN RangesCount,
+        _Mo_In_ MO_UINT64 SystemResourceAffinityTable,
+        _Mo_In_ PMO_UEFI_ACPI_COLLECT_MEMORY_RANGES_ROUTINE CollectRoutine)
     {
-        MO_UNREFERENCED_PARAMETER(Context);
-        PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM LeftItem =
-            reinterpret_cast<PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM>(Left);
-        PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM RightItem =
-            reinterpret_cast<PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM>(Right);
-        if (LeftItem->AddressBase < RightItem->AddressBase)
+        if (!Ranges || !RangesCount || !SystemResourceAffinityTable)
         {
-            return -1;
+            return MO_RESULT_ERROR_INVALID_PARAMETER;
         }
-        else if (LeftItem->AddressBase > RightItem->AddressBase)
+        *Ranges = nullptr;
+        *RangesCount = 0u;
+
+        MO_UINTN RequiredCount = 0u;
+        MO_UINTN Count = 0u;
+        MO_RESULT Result = ::MoUefiAcpiCollectMemoryRanges(
+            nullptr,
+            &RequiredCount,
+            &Count,
+            0u,
+            SystemResourceAffinityTable);
+        if (MO_RESULT_ERROR_OUT_OF_MEMORY != Result)
+        {
+            return Result;
+        }
+
+        PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM Buffer = nullptr;
+        if (MO_RESULT_SUCCESS_OK != ::MoPlatformHeapAllocate(
+            reinterpret_cast<PMO_POINTER>(&Buffer),
+            sizeof(MO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM) * RequiredCount))
+        {
+            return MO_RESULT_ERROR_OUT_OF_MEMORY;
+        }
+
+        Result = CollectRoutine(
+            Buffer,
+            nullptr,
+            &Count,
+            RequiredCount,
+            SystemResourceAffinityTable);
+        if (MO_RESULT_SUCCESS_OK != Result)
         {
-            return 1;
+            // Cleanup on error.
+            ::MoPlatformHeapFree(Buffer);
+            return Result;
         }
-        return 0;
-    },
-        nullptr))
+
+        *Ranges = Buffer;
+        *RangesCount = Count;
+
+        return MO_RESULT_SUCCESS_OK;
+    }
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiCollectMemoryRanges(
+    _Mo_Out_Opt_ PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM Buffer,
+    _Mo_Out_Opt_ PMO_UINTN RequiredCount,
+    _Mo_Out_ PMO_UINTN ResultCount,
+    _Mo_In_ MO_UINTN BufferCount,
+    _Mo_In_ MO_UINT64 SystemResourceAffinityTable)
+{
+    return ::MoUefiAcpiCollectMemoryRangesInternal(
+        Buffer,
+        RequiredCount,
+        ResultCount,
+        BufferCount,
+        SystemResourceAffinityTable,
+        MO_FALSE);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiCollectMergedMemoryRanges(
+    _Mo_Out_Opt_ PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM Buffer,
+    _Mo_Out_Opt_ PMO_UINTN RequiredCount,
+    _Mo_Out_ PMO_UINTN ResultCount,
+    _Mo_In_ MO_UINTN BufferCount,
+    _Mo_In_ MO_UINT64 SystemResourceAffinityTable)
+{
+    return ::MoUefiAcpiCollectMemoryRangesInternal(
+        Buffer,
+        RequiredCount,
+        ResultCount,
+        BufferCount,
+        SystemResourceAffinityTable,
+        MO_TRUE);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiCollectMemoryHoles(
+    _Mo_Out_Opt_ PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM Buffer,
+    _Mo_Out_Opt_ PMO_UINTN RequiredCount,
+    _Mo_Out_ PMO_UINTN ResultCount,
+    _Mo_In_ MO_UINTN BufferCount,
+    _Mo_In_ MO_UINT64 SystemResourceAffinityTable)
+{
+    MO_RESULT Result = ::MoUefiAcpiCollectMemoryRangesInternal(
+        Buffer,
+        RequiredCount,
+        ResultCount,
+        BufferCount,
+        SystemResourceAffinityTable,
+        MO_TRUE);
+    if (MO_RESULT_SUCCESS_OK != Result)
     {
-        // Cleanup on error.
-        ::MoPlatformHeapFree(Ranges);
-        return MO_RESULT_ERROR_UNEXPECTED;
+        return Result;
+    }
+    MO_UINTN MergedCount = *ResultCount;
+    *ResultCount = 0u;
+
+    if (MergedCount < 2)
+    {
+        // No memory holes found.
+        return MO_RESULT_ERROR_NO_INTERFACE;
     }
 
-    *MemoryRanges = Ranges;
-    *MemoryRangesCount = Count;
+    // Convert the merged ranges to the holes in place, the hole i only depends
+    // on the merged range i and i + 1 which are not overwritten yet.
+    MO_UINTN HoleCount = MergedCount - 1;
+    for (MO_UINTN i = 0; i < HoleCount; ++i)
+    {
+        MO_UINT64 PreviousRangeEnd = Buffer[i].AddressBase + Buffer[i].Length;
+        MO_UINT64 CurrentRangeStart = Buffer[i + 1].AddressBase;
+        Buffer[i].AddressBase = PreviousRangeEnd;
+        Buffer[i].Length = CurrentRangeStart - PreviousRangeEnd;
+    }
+
+    *ResultCount = HoleCount;
 
     return MO_RESULT_SUCCESS_OK;
 }
 
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiQueryMemoryRanges(
+    _Mo_Out_ PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM* MemoryRanges,
+    _Mo_Out_ PMO_UINTN MemoryRangesCount,
+    _Mo_In_ MO_UINT64 SystemResourceAffinityTable)
+{
+    return ::MoUefiAcpiAllocateMemoryRanges(
+        MemoryRanges,
+        MemoryRangesCount,
+        SystemResourceAffinityTable,
+        ::MoUefiAcpiCollectMemoryRanges);
+}
+
 MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiQueryMergedMemoryRanges(
     _Mo_Out_ PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM* MergedMemoryRanges,
     _Mo_Out_ PMO_UINTN MergedMemoryRangesCount,
     _Mo_In_ MO_UINT64 SystemResourceAffinityTable)
 {
-    if (!MergedMemoryRanges ||
-        !MergedMemoryRangesCount ||
-        !SystemResourceAffinityTable)
+    return ::MoUefiAcpiAllocateMemoryRanges(
+        MergedMemoryRanges,
+        MergedMemoryRangesCount,
+        SystemResourceAffinityTable,
+        ::MoUefiAcpiCollectMergedMemoryRanges);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiQueryMemoryHoles(
+    _Mo_Out_ PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM* MemoryHoleRanges,
+    _Mo_Out_ PMO_UINTN MemoryHoleRangesCount,
+    _Mo_In_ MO_UINT64 SystemResourceAffinityTable)
+{
+    return ::MoUefiAcpiAllocateMemoryRanges(
+        MemoryHoleRanges,
+        MemoryHoleRangesCount,
+        SystemResourceAffinityTable,
+        ::MoUefiAcpiCollectMemoryHoles);
+}
+
+namespace
+{
+    static MO_BOOL MoUefiAcpiPatchIsValidFieldSize(
+        _Mo_In_ MO_UINT8 Size)
+    {
+        return (1u == Size || 2u == Size || 4u == Size || 8u == Size);
+    }
+
+    static MO_UINT64 MoUefiAcpiPatchReadField(
+        _Mo_In_ PMO_UINT8 Structure,
+        _Mo_In_ MO_UINTN Offset,
+        _Mo_In_ MO_UINTN Size)
+    {
+        // The ACPI structures are packed, so read the field byte by byte for
+        // avoiding the unaligned access.
+        MO_UINT64 Value = 0u;
+        for (MO_UINTN i = Size; i; --i)
+        {
+            Value <<= 8;
+            Value |= Structure[Offset + i - 1];
+        }
+        return Value;
+    }
+
+    static MO_VOID MoUefiAcpiPatchWriteField(
+        _Mo_In_ PMO_UINT8 Structure,
+        _Mo_In_ MO_UINTN Offset,
+        _Mo_In_ MO_UINTN Size,
+        _Mo_In_ MO_UINT64 Value)
+    {
+        for (MO_UINTN i = 0; i < Size; ++i)
+        {
+            Structure[Offset + i] = static_cast<MO_UINT8>(Value);
+            Value >>= 8;
+        }
+    }
+
+    static MO_BOOL MoUefiAcpiPatchValidateRule(
+        _Mo_In_ PMO_UEFI_ACPI_PATCH_RULE Rule)
+    {
+        if (Rule->Predicate > MO_UEFI_ACPI_PATCH_PREDICATE_GREATER_OR_EQUAL)
+        {
+            return MO_FALSE;
+        }
+        if (MO_UEFI_ACPI_PATCH_PREDICATE_ALWAYS != Rule->Predicate &&
+            !::MoUefiAcpiPatchIsValidFieldSize(Rule->ConditionSize))
+        {
+            return MO_FALSE;
+        }
+        if (Rule->Operation > MO_UEFI_ACPI_PATCH_OPERATION_COPY)
+        {
+            return MO_FALSE;
+        }
+        if (!::MoUefiAcpiPatchIsValidFieldSize(Rule->FieldSize))
+        {
+            return MO_FALSE;
+        }
+        return MO_TRUE;
+    }
+
+    static MO_BOOL MoUefiAcpiPatchRuleFits(
+        _Mo_In_ PMO_UEFI_ACPI_PATCH_RULE Rule,
+        _Mo_In_ MO_UINTN StructureSize)
+    {
+        if (static_cast<MO_UINTN>(Rule->FieldOffset) + Rule->FieldSize >
+            StructureSize)
+        {
+            return MO_FALSE;
+        }
+        if (MO_UEFI_ACPI_PATCH_PREDICATE_ALWAYS != Rule->Predicate &&
+            static_cast<MO_UINTN>(Rule->ConditionOffset) + Rule->ConditionSize >
+                StructureSize)
+        {
+            return MO_FALSE;
+        }
+        if (MO_UEFI_ACPI_PATCH_OPERATION_COPY == Rule->Operation &&
+            (Rule->Value > StructureSize ||
+                StructureSize - Rule->Value < Rule->FieldSize))
+        {
+            return MO_FALSE;
+        }
+        return MO_TRUE;
+    }
+
+    static MO_BOOL MoUefiAcpiPatchApplyRule(
+        _Mo_InOut_ PMO_BOOL Modified,
+        _Mo_In_ PMO_UINT8 Structure,
+        _Mo_In_ MO_UINTN StructureSize,
+        _Mo_In_ PMO_UEFI_ACPI_PATCH_RULE Rule)
+    {
+        if (!::MoUefiAcpiPatchRuleFits(Rule, StructureSize))
+        {
+            return MO_FALSE;
+        }
+
+        if (MO_UEFI_ACPI_PATCH_PREDICATE_ALWAYS != Rule->Predicate)
+        {
+            MO_UINT64 Condition = ::MoUefiAcpiPatchReadField(
+                Structure,
+                Rule->ConditionOffset,
+                Rule->ConditionSize);
+            if (MO_UEFI_ACPI_PATCH_PREDICATE_EQUAL == Rule->Predicate &&
+                Condition != Rule->ConditionValue)
+            {
+                return MO_FALSE;
+            }
+            if (MO_UEFI_ACPI_PATCH_PREDICATE_GREATER_OR_EQUAL == Rule->Predicate &&
+                Condition < Rule->ConditionValue)
+            {
+                return MO_FALSE;
+            }
+        }
+
+        MO_UINT64 Current = ::MoUefiAcpiPatchReadField(
+            Structure,
+            Rule->FieldOffset,
+            Rule->FieldSize);
+        if ((Rule->Flags & MO_UEFI_ACPI_PATCH_FLAG_ONLY_IF_ZERO) && Current)
+        {
+            return MO_FALSE;
+        }
+
+        MO_UINT64 Value = 0u;
+        if (MO_UEFI_ACPI_PATCH_OPERATION_SET == Rule->Operation)
+        {
+            Value = Rule->Value;
+        }
+        else if (MO_UEFI_ACPI_PATCH_OPERATION_OR == Rule->Operation)
+        {
+            Value = Current | Rule->Value;
+        }
+        else
+        {
+            Value = ::MoUefiAcpiPatchReadField(
+                Structure,
+                static_cast<MO_UINTN>(Rule->Value),
+                Rule->FieldSize);
+        }
+        if (Rule->FieldSize < sizeof(MO_UINT64))
+        {
+            Value &= (1ULL << (Rule->FieldSize * 8u)) - 1u;
+        }
+
+        if (Value != Current)
+        {
+            ::MoUefiAcpiPatchWriteField(
+                Structure,
+                Rule->FieldOffset,
+                Rule->FieldSize,
+                Value);
+            *Modified = MO_TRUE;
+        }
+
+        return MO_TRUE;
+    }
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiPatchDescriptionTable(
+    _Mo_Out_Opt_ PMO_UINT64 AppliedRules,
+    _Mo_In_ MO_UINT64 DescriptionTable,
+    _Mo_In_ PMO_UEFI_ACPI_PATCH_RULE Rules,
+    _Mo_In_ MO_UINTN RuleCount)
+{
+    if (!DescriptionTable ||
+        !Rules ||
+        !RuleCount ||
+        RuleCount > MO_UEFI_ACPI_PATCH_MAXIMUM_RULES)
     {
         return MO_RESULT_ERROR_INVALID_PARAMETER;
     }
-    *MergedMemoryRanges = nullptr;
-    *MergedMemoryRangesCount = 0u;
+    if (AppliedRules)
+    {
+        *AppliedRules = 0u;
+    }
 
-    PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM MemoryRanges = nullptr;
-    MO_UINTN MemoryRangesCount = 0u;
-    MO_RESULT Result = ::MoUefiAcpiQueryMemoryRanges(
-        &MemoryRanges,
-        &MemoryRangesCount,
-        SystemResourceAffinityTable);
-    if (MO_RESULT_SUCCESS_OK != Result)
+    EFI_ACPI_DESCRIPTION_HEADER* TableHeader =
+        reinterpret_cast<EFI_ACPI_DESCRIPTION_HEADER*>(DescriptionTable);
+    PMO_UINT8 Table = reinterpret_cast<PMO_UINT8>(DescriptionTable);
+
+    // Validate all matched rules before modifying anything, so a malformed
+    // rule cannot leave the table half-patched.
+    MO_UINT64 MatchedRules = 0u;
+    MO_BOOL HasSubStructureRules = MO_FALSE;
+    MO_UINT16 HeaderSize = 0u;
+    for (MO_UINTN i = 0; i < RuleCount; ++i)
     {
-        return Result;
+        PMO_UEFI_ACPI_PATCH_RULE Rule = &Rules[i];
+        if (Rule->Signature != TableHeader->Signature ||
+            Rule->MinimumRevision > TableHeader->Revision)
+        {
+            continue;
+        }
+        if (!::MoUefiAcpiPatchValidateRule(Rule))
+        {
+            return MO_RESULT_ERROR_INVALID_PARAMETER;
+        }
+        if (MO_UEFI_ACPI_PATCH_SCOPE_TABLE == Rule->Scope)
+        {
+            if (!::MoUefiAcpiPatchRuleFits(Rule, TableHeader->Length))
+            {
+                return MO_RESULT_ERROR_INVALID_PARAMETER;
+            }
+        }
+        else
+        {
+            if (HasSubStructureRules && HeaderSize != Rule->HeaderSize)
+            {
+                // The sub-structures of a table have only one start offset.
+                return MO_RESULT_ERROR_INVALID_PARAMETER;
+            }
+            HasSubStructureRules = MO_TRUE;
+            HeaderSize = Rule->HeaderSize;
+        }
+        MatchedRules |= 1ULL << i;
+    }
+    if (!MatchedRules)
+    {
+        return MO_RESULT_SUCCESS_OK;
+    }
+
+    MO_UEFI_ACPI_SUB_STRUCTURE_ITERATOR Iterator;
+    if (HasSubStructureRules)
+    {
+        if (MO_RESULT_SUCCESS_OK != ::MoUefiAcpiSubStructureIteratorInitialize(
+            &Iterator,
+            DescriptionTable,
+            HeaderSize,
+            MO_UEFI_ACPI_SUB_STRUCTURE_TYPE_ANY))
+        {
+            return MO_RESULT_ERROR_INVALID_PARAMETER;
+        }
     }
 
-    // Merge adjacent or overlapping ranges.
-    MO_UINTN Count = 0;
+    MO_UINT64 Applied = 0u;
+    MO_BOOL Modified = MO_FALSE;
+
+    for (MO_UINTN i = 0; i < RuleCount; ++i)
     {
-        for (MO_UINTN i = 0; i < MemoryRangesCount; ++i)
+        if (!(MatchedRules & (1ULL << i)) ||
+            MO_UEFI_ACPI_PATCH_SCOPE_TABLE != Rules[i].Scope)
         {
-            if (!Count)
+            continue;
+        }
+        if (::MoUefiAcpiPatchApplyRule(
+            &Modified,
+            Table,
+            TableHeader->Length,
+            &Rules[i]))
+        {
+            Applied |= 1ULL << i;
+        }
+    }
+
+    MO_RESULT Result = MO_RESULT_SUCCESS_OK;
+    if (HasSubStructureRules)
+    {
+        for (;;)
+        {
+            PMO_UEFI_ACPI_SUB_STRUCTURE_HEADER SubStructure = nullptr;
+            Result = ::MoUefiAcpiSubStructureIteratorNext(
+                &SubStructure,
+                &Iterator);
+            if (MO_RESULT_SUCCESS_OK != Result)
             {
-                MemoryRanges[Count] = MemoryRanges[i];
-                ++Count;
+                if (MO_RESULT_ERROR_NO_INTERFACE == Result)
+                {
+                    // Reach the end of the ACPI description table.
+                    Result = MO_RESULT_SUCCESS_OK;
+                }
+                break;
             }
-            else
+
+            for (MO_UINTN i = 0; i < RuleCount; ++i)
             {
-                PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM LastMergedRange =
-                    &MemoryRanges[Count - 1];
-                MO_UINT64 LastMergedRangeEnd =
-                    LastMergedRange->AddressBase + LastMergedRange->Length;
-                MO_UINT64 CurrentRangeStart = MemoryRanges[i].AddressBase;
-                if (CurrentRangeStart <= LastMergedRangeEnd)
+                if (!(MatchedRules & (1ULL << i)) ||
+                    SubStructure->Type != Rules[i].Scope)
                 {
-                    // Overlapping or adjacent ranges, merge them.
-                    MO_UINT64 CurrentRangeEnd =
-                        MemoryRanges[i].AddressBase + MemoryRanges[i].Length;
-                    if (CurrentRangeEnd > LastMergedRangeEnd)
-                    {
-                        LastMergedRange->Length =
-                            CurrentRangeEnd - LastMergedRange->AddressBase;
-                    }
+                    continue;
                 }
-                else
+                if (::MoUefiAcpiPatchApplyRule(
+                    &Modified,
+                    reinterpret_cast<PMO_UINT8>(SubStructure),
+                    SubStructure->Length,
+                    &Rules[i]))
                 {
-                    // Non-overlapping range, add it to the merged list.
-                    MemoryRanges[Count] = MemoryRanges[i];
-                    ++Count;
+                    Applied |= 1ULL << i;
                 }
             }
         }
     }
-    if (!Count)
+
+    if (Modified)
     {
-        // Should not happen.
-        ::MoPlatformHeapFree(MemoryRanges);
-        return MO_RESULT_ERROR_UNEXPECTED;
+        // Only one checksum pass is needed for all applied rules. It is also
+        // needed when the sub-structures walk is terminated by a malformed
+        // sub-structure, because the previous rules are already applied.
+        TableHeader->Checksum = 0;
+        ::MoRuntimeCalculateChecksumByte(
+            &TableHeader->Checksum,
+            TableHeader,
+            TableHeader->Length);
     }
-    MO_UINTN Size = sizeof(MO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM) * Count;
 
-    PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM MergedRanges = nullptr;
-    if (MO_RESULT_SUCCESS_OK != ::MoPlatformHeapAllocate(
-        reinterpret_cast<PMO_POINTER>(&MergedRanges),
-        Size))
+    if (AppliedRules)
     {
-        ::MoPlatformHeapFree(MemoryRanges);
-        return MO_RESULT_ERROR_OUT_OF_MEMORY;
+        *AppliedRules = Applied;
     }
 
-    if (MO_RESULT_SUCCESS_OK != ::MoRuntimeMemoryMove(
-        MergedRanges,
-        MemoryRanges,
-        Size))
+    return Result;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiTableIndexApplyPatches(
+    _Mo_Out_Opt_ PMO_UINT64 AppliedRules,
+    _Mo_In_ PMO_UEFI_ACPI_TABLE_INDEX Index,
+    _Mo_In_ PMO_UEFI_ACPI_PATCH_RULE Rules,
+    _Mo_In_ MO_UINTN RuleCount)
+{
+    if (!Index ||
+        !Rules ||
+        !RuleCount ||
+        RuleCount > MO_UEFI_ACPI_PATCH_MAXIMUM_RULES)
     {
-        ::MoPlatformHeapFree(MemoryRanges);
-        ::MoPlatformHeapFree(MergedRanges);
-        return MO_RESULT_ERROR_UNEXPECTED;
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (AppliedRules)
+    {
+        *AppliedRules = 0u;
     }
 
-    ::MoPlatformHeapFree(MemoryRanges);
+    MO_UINT64 Applied = 0u;
+    for (MO_UINTN i = 0; i < Index->TableCount; ++i)
+    {
+        PMO_UEFI_ACPI_TABLE_INDEX_ENTRY Entry = &Index->Tables[i];
+
+        MO_BOOL Matched = MO_FALSE;
+        for (MO_UINTN j = 0; j < RuleCount; ++j)
+        {
+            if (Rules[j].Signature == Entry->Signature)
+            {
+                Matched = MO_TRUE;
+                break;
+            }
+        }
+        if (!Matched)
+        {
+            continue;
+        }
 
-    *MergedMemoryRanges = MergedRanges;
-    *MergedMemoryRangesCount = Count;
+        MO_UINT64 TableAppliedRules = 0u;
+        MO_RESULT Result = ::MoUefiAcpiPatchDescriptionTable(
+            &TableAppliedRules,
+            Entry->TableAddress,
+            Rules,
+            RuleCount);
+        Applied |= TableAppliedRules;
+        if (MO_RESULT_SUCCESS_OK != Result)
+        {
+            if (AppliedRules)
+            {
+                *AppliedRules = Applied;
+            }
+            return Result;
+        }
+    }
+
+    if (AppliedRules)
+    {
+        *AppliedRules = Applied;
+    }
 
     return MO_RESULT_SUCCESS_OK;
 }
 
-MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiQueryMemoryHoles(
-    _Mo_Out_ PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM* MemoryHoleRanges,
-    _Mo_Out_ PMO_UINTN MemoryHoleRangesCount,
-    _Mo_In_ MO_UINT64 SystemResourceAffinityTable)
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiQueryPowerManagementTimer(
+    _Mo_Out_ PMO_UINT16 Port,
+    _Mo_Out_Opt_ PMO_BOOL Extended,
+    _Mo_In_ PMO_UEFI_ACPI_TABLE_INDEX Index)
 {
-    if (!MemoryHoleRanges ||
-        !MemoryHoleRangesCount ||
-        !SystemResourceAffinityTable)
+    if (!Port || !Index)
     {
         return MO_RESULT_ERROR_INVALID_PARAMETER;
     }
-    *MemoryHoleRanges = nullptr;
-    *MemoryHoleRangesCount = 0u;
+    *Port = 0u;
+    if (Extended)
+    {
+        *Extended = MO_FALSE;
+    }
 
-    PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM MergedMemoryRanges = nullptr;
-    MO_UINTN MergedMemoryRangesCount = 0u;
-    MO_RESULT Result = ::MoUefiAcpiQueryMergedMemoryRanges(
-        &MergedMemoryRanges,
-        &MergedMemoryRangesCount,
-        SystemResourceAffinityTable);
-    if (MO_RESULT_SUCCESS_OK != Result)
+    MO_UINT64 TableAddress = 0u;
+    if (MO_RESULT_SUCCESS_OK != ::MoUefiAcpiTableIndexQuery(
+        &TableAddress,
+        Index,
+        EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE_SIGNATURE,
+        0,
+        0))
     {
-        return Result;
+        return MO_RESULT_ERROR_NO_INTERFACE;
     }
+    EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE* Table =
+        reinterpret_cast<EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE*>(
+            TableAddress);
 
-    if (MergedMemoryRangesCount < 2)
+    // The PmTmrBlk, PmTmrLen and Flags fields are available since ACPI 1.0,
+    // and the XPmTmrBlk field is available since ACPI 2.0.
+    MO_UINTN LegacyLength =
+        OFFSET_OF(EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE, Flags) +
+        sizeof(Table->Flags);
+    MO_UINTN ExtendedLength =
+        OFFSET_OF(EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE, XPmTmrBlk) +
+        sizeof(Table->XPmTmrBlk);
+    if (Table->Header.Length < LegacyLength || Table->PmTmrLen < 4)
     {
-        // No memory holes found.
-        ::MoPlatformHeapFree(MergedMemoryRanges);
         return MO_RESULT_ERROR_NO_INTERFACE;
     }
 
-    MO_UINTN HoleCount = MergedMemoryRangesCount - 1;
-    MO_UINTN Size = sizeof(MO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM) * HoleCount;
-    PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM Holes = nullptr;
-    if (MO_RESULT_SUCCESS_OK != ::MoPlatformHeapAllocate(
-        reinterpret_cast<PMO_POINTER>(&Holes),
-        Size))
+    MO_UINT64 Address = Table->PmTmrBlk;
+    if (Table->Header.Length >= ExtendedLength &&
+        EFI_ACPI_2_0_SYSTEM_IO == Table->XPmTmrBlk.AddressSpaceId &&
+        Table->XPmTmrBlk.Address)
     {
-        ::MoPlatformHeapFree(MergedMemoryRanges);
-        return MO_RESULT_ERROR_OUT_OF_MEMORY;
+        Address = Table->XPmTmrBlk.Address;
+    }
+    if (!Address || Address > 0xFFFF)
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
     }
 
-    for (MO_UINTN i = 0; i < HoleCount; ++i)
+    *Port = static_cast<MO_UINT16>(Address);
+    if (Extended)
     {
-        MO_UINT64 PreviousRangeEnd =
-            MergedMemoryRanges[i].AddressBase + MergedMemoryRanges[i].Length;
-        MO_UINT64 CurrentRangeStart = MergedMemoryRanges[i + 1].AddressBase;
-        Holes[i].AddressBase = PreviousRangeEnd;
-        Holes[i].Length = CurrentRangeStart - PreviousRangeEnd;
+        *Extended = (Table->Flags & EFI_ACPI_2_0_TMR_VAL_EXT)
+            ? MO_TRUE
+            : MO_FALSE;
+    }
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiQueryHighPrecisionEventTimer(
+    _Mo_Out_ PMO_UINT64 BaseAddress,
+    _Mo_In_ PMO_UEFI_ACPI_TABLE_INDEX Index)
+{
+    if (!BaseAddress || !Index)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    *BaseAddress = 0u;
+
+    MO_UINT64 TableAddress = 0u;
+    if (MO_RESULT_SUCCESS_OK != ::MoUefiAcpiTableIndexQuery(
+        &TableAddress,
+        Index,
+        EFI_ACPI_2_0_HIGH_PRECISION_EVENT_TIMER_TABLE_SIGNATURE,
+        EFI_ACPI_HIGH_PRECISION_EVENT_TIMER_TABLE_REVISION,
+        0))
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+    EFI_ACPI_HIGH_PRECISION_EVENT_TIMER_TABLE_HEADER* Table =
+        reinterpret_cast<EFI_ACPI_HIGH_PRECISION_EVENT_TIMER_TABLE_HEADER*>(
+            TableAddress);
+    if (Table->Header.Length <
+        sizeof(EFI_ACPI_HIGH_PRECISION_EVENT_TIMER_TABLE_HEADER))
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    if (EFI_ACPI_2_0_SYSTEM_MEMORY !=
+        Table->BaseAddressLower32Bit.AddressSpaceId ||
+        !Table->BaseAddressLower32Bit.Address)
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    *BaseAddress = Table->BaseAddressLower32Bit.Address;
+    return MO_RESULT_SUCCESS_OK;
+}
+
+namespace
+{
+    /**
+     * @brief Queries the APIC ID and the ACPI processor UID from the
+     *        Processor Local APIC or the Processor Local x2APIC Structure.
+     * @return MO_RESULT_SUCCESS_OK for the enabled processors,
+     *         MO_RESULT_ERROR_NO_INTERFACE for the other structures, or
+     *         MO_RESULT_ERROR_INVALID_POINTER for the truncated structures.
+     */
+    static MO_RESULT MoUefiAcpiQueryProcessorStructure(
+        _Mo_Out_ PMO_UINT32 ApicId,
+        _Mo_Out_ PMO_UINT32 ProcessorUid,
+        _Mo_In_ PMO_UEFI_ACPI_SUB_STRUCTURE_HEADER SubStructure)
+    {
+        if (EFI_ACPI_4_0_PROCESSOR_LOCAL_APIC == SubStructure->Type)
+        {
+            using CandidateType = EFI_ACPI_2_0_PROCESSOR_LOCAL_APIC_STRUCTURE;
+            if (SubStructure->Length < sizeof(CandidateType))
+            {
+                return MO_RESULT_ERROR_INVALID_POINTER;
+            }
+            CandidateType* Candidate =
+                reinterpret_cast<CandidateType*>(SubStructure);
+            if (!(Candidate->Flags & EFI_ACPI_4_0_LOCAL_APIC_ENABLED) ||
+                0xFF == Candidate->ApicId)
+            {
+                return MO_RESULT_ERROR_NO_INTERFACE;
+            }
+            *ApicId = Candidate->ApicId;
+            *ProcessorUid = Candidate->AcpiProcessorId;
+            return MO_RESULT_SUCCESS_OK;
+        }
+        if (EFI_ACPI_4_0_PROCESSOR_LOCAL_X2APIC == SubStructure->Type)
+        {
+            using CandidateType = EFI_ACPI_4_0_PROCESSOR_LOCAL_X2APIC_STRUCTURE;
+            if (SubStructure->Length < sizeof(CandidateType))
+            {
+                return MO_RESULT_ERROR_INVALID_POINTER;
+            }
+            CandidateType* Candidate =
+                reinterpret_cast<CandidateType*>(SubStructure);
+            if (!(Candidate->Flags & EFI_ACPI_4_0_LOCAL_APIC_ENABLED) ||
+                MO_UINT32_MAX == Candidate->X2ApicId)
+            {
+                return MO_RESULT_ERROR_NO_INTERFACE;
+            }
+            *ApicId = Candidate->X2ApicId;
+            *ProcessorUid = Candidate->AcpiProcessorUid;
+            return MO_RESULT_SUCCESS_OK;
+        }
+        return MO_RESULT_ERROR_NO_INTERFACE;
     }
 
-    ::MoPlatformHeapFree(MergedMemoryRanges);
+    /**
+     * @brief Checks whether the processor is already described by an enabled
+     *        structure before the specified structure in the MADT.
+     * @remarks The firmware may describe the processors with the APIC IDs less
+     *          than 255 in both structure types, and the check does not depend
+     *          on the caller-provided buffer, so the required count is also
+     *          exact.
+     */
+    static MO_BOOL MoUefiAcpiIsProcessorDescribed(
+        _Mo_In_ MO_UINT64 TableAddress,
+        _Mo_In_ PMO_UEFI_ACPI_SUB_STRUCTURE_HEADER Current,
+        _Mo_In_ MO_UINT32 ApicId)
+    {
+        MO_UEFI_ACPI_SUB_STRUCTURE_ITERATOR Iterator;
+        if (MO_RESULT_SUCCESS_OK != ::MoUefiAcpiSubStructureIteratorInitialize(
+            &Iterator,
+            TableAddress,
+            sizeof(EFI_ACPI_2_0_MULTIPLE_APIC_DESCRIPTION_TABLE_HEADER),
+            MO_UEFI_ACPI_SUB_STRUCTURE_TYPE_ANY))
+        {
+            return MO_FALSE;
+        }
+
+        for (;;)
+        {
+            PMO_UEFI_ACPI_SUB_STRUCTURE_HEADER SubStructure = nullptr;
+            if (MO_RESULT_SUCCESS_OK != ::MoUefiAcpiSubStructureIteratorNext(
+                &SubStructure,
+                &Iterator) ||
+                SubStructure == Current)
+            {
+                return MO_FALSE;
+            }
+
+            MO_UINT32 CandidateApicId = 0u;
+            MO_UINT32 CandidateProcessorUid = 0u;
+            if (MO_RESULT_SUCCESS_OK == ::MoUefiAcpiQueryProcessorStructure(
+                &CandidateApicId,
+                &CandidateProcessorUid,
+                SubStructure) &&
+                ApicId == CandidateApicId)
+            {
+                return MO_TRUE;
+            }
+        }
+    }
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiCollectProcessors(
+    _Mo_Out_Opt_ PMO_UEFI_ACPI_PROCESSOR_ITEM Buffer,
+    _Mo_Out_Opt_ PMO_UINTN RequiredCount,
+    _Mo_Out_ PMO_UINTN ResultCount,
+    _Mo_In_ MO_UINTN BufferCount,
+    _Mo_In_ PMO_UEFI_ACPI_TABLE_INDEX Index)
+{
+    if (!ResultCount || !Index)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    *ResultCount = 0u;
+    if (RequiredCount)
+    {
+        *RequiredCount = 0u;
+    }
+    if (!Buffer)
+    {
+        BufferCount = 0u;
+    }
+
+    MO_UINT64 TableAddress = 0u;
+    if (MO_RESULT_SUCCESS_OK != ::MoUefiAcpiTableIndexQuery(
+        &TableAddress,
+        Index,
+        EFI_ACPI_2_0_MULTIPLE_SAPIC_DESCRIPTION_TABLE_SIGNATURE,
+        0,
+        0))
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    MO_UEFI_ACPI_SUB_STRUCTURE_ITERATOR Iterator;
+    if (MO_RESULT_SUCCESS_OK != ::MoUefiAcpiSubStructureIteratorInitialize(
+        &Iterator,
+        TableAddress,
+        sizeof(EFI_ACPI_2_0_MULTIPLE_APIC_DESCRIPTION_TABLE_HEADER),
+        MO_UEFI_ACPI_SUB_STRUCTURE_TYPE_ANY))
+    {
+        return MO_RESULT_ERROR_INVALID_POINTER;
+    }
+
+    MO_UINTN ProcessorCount = 0u;
+    MO_UINTN Count = 0u;
+    MO_BOOL Insufficient = MO_FALSE;
+    for (;;)
+    {
+        PMO_UEFI_ACPI_SUB_STRUCTURE_HEADER SubStructure = nullptr;
+        MO_RESULT Result = ::MoUefiAcpiSubStructureIteratorNext(
+            &SubStructure,
+            &Iterator);
+        if (MO_RESULT_ERROR_NO_INTERFACE == Result)
+        {
+            // Reach the end of the Multiple APIC Description Table (MADT).
+            break;
+        }
+        if (MO_RESULT_SUCCESS_OK != Result)
+        {
+            return MO_RESULT_ERROR_INVALID_POINTER;
+        }
+
+        MO_UINT32 ApicId = 0u;
+        MO_UINT32 ProcessorUid = 0u;
+        Result = ::MoUefiAcpiQueryProcessorStructure(
+            &ApicId,
+            &ProcessorUid,
+            SubStructure);
+        if (MO_RESULT_ERROR_NO_INTERFACE == Result)
+        {
+            continue;
+        }
+        if (MO_RESULT_SUCCESS_OK != Result)
+        {
+            return Result;
+        }
+        if (::MoUefiAcpiIsProcessorDescribed(
+            TableAddress,
+            SubStructure,
+            ApicId))
+        {
+            continue;
+        }
+        ++ProcessorCount;
+        if (Count >= BufferCount)
+        {
+            // Only count the remaining processors for the required count.
+            Insufficient = MO_TRUE;
+            continue;
+        }
+        Buffer[Count].ApicId = ApicId;
+        Buffer[Count].ProcessorUid = ProcessorUid;
+        ++Count;
+    }
+
+    if (RequiredCount)
+    {
+        *RequiredCount = ProcessorCount;
+    }
+    if (!ProcessorCount)
+    {
+        // No enabled processors found.
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+    if (Insufficient)
+    {
+        return MO_RESULT_ERROR_OUT_OF_MEMORY;
+    }
 
-    *MemoryHoleRanges = Holes;
-    *MemoryHoleRangesCount = HoleCount;
+    *ResultCount = Count;
 
     return MO_RESULT_SUCCESS_OK;
 }
@@ -79,6 +79,9 @@ MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiQueryExtendedSystemDescriptionTable(
  *          returns MO_RESULT_ERROR_NO_INTERFACE.
  *          If the Extended System Description Table (XSDT) is invalid, the
  *          function returns MO_RESULT_ERROR_INVALID_POINTER.
+ *          This function walks and validates the XSDT on every call, so use
+ *          MoUefiAcpiTableIndexInitialize and MoUefiAcpiTableIndexQuery for
+ *          querying multiple tables.
  */
 MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiQueryDescriptionTable(
     _Mo_Out_ PMO_UINT64 TableAddress,
@@ -86,6 +89,264 @@ MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiQueryDescriptionTable(
     _Mo_In_ MO_UINT8 MinimumRevision,
     _Mo_In_ MO_UINT64 ExtendedSystemDescriptionTable);
 
+/**
+ * @brief The maximum number of the ACPI description tables which can be
+ *        recorded in an ACPI table index.
+ */
+#define MO_UEFI_ACPI_TABLE_INDEX_MAXIMUM_TABLES 64
+
+/**
+ * @brief The number of the hash buckets in an ACPI table index, which must be
+ *        a power of two and larger than the maximum number of the tables.
+ */
+#define MO_UEFI_ACPI_TABLE_INDEX_BUCKETS 128
+
+/**
+ * @brief The ACPI description table record in an ACPI table index.
+ */
+typedef struct _MO_UEFI_ACPI_TABLE_INDEX_ENTRY
+{
+    /**
+     * @brief The physical address of the ACPI description table.
+     */
+    MO_UINT64 TableAddress;
+    /**
+     * @brief The signature of the ACPI description table.
+     */
+    MO_UINT32 Signature;
+    /**
+     * @brief The revision of the ACPI description table.
+     */
+    MO_UINT8 Revision;
+    MO_UINT8 Reserved;
+    /**
+     * @brief The index plus one of the next record with the same signature in
+     *        the XSDT order, or zero if this is the last instance.
+     */
+    MO_UINT16 NextInstance;
+} MO_UEFI_ACPI_TABLE_INDEX_ENTRY, *PMO_UEFI_ACPI_TABLE_INDEX_ENTRY;
+
+/**
+ * @brief The ACPI table index which is built from the Extended System
+ *        Description Table (XSDT) once, and maps the signatures to the
+ *        validated ACPI description tables.
+ * @remark The buckets use the open addressing with linear probing, and each
+ *         occupied bucket refers to the first instance of a signature. The
+ *         other instances with the same signature, e.g. SSDTs, are chained in
+ *         the XSDT order.
+ */
+typedef struct _MO_UEFI_ACPI_TABLE_INDEX
+{
+    /**
+     * @brief The physical address of the Extended System Description Table
+     *        (XSDT) used for building the index.
+     */
+    MO_UINT64 ExtendedSystemDescriptionTable;
+    /**
+     * @brief The number of the recorded ACPI description tables.
+     */
+    MO_UINT16 TableCount;
+    /**
+     * @brief The number of the ACPI description tables skipped because they
+     *        failed the validation or the index is full.
+     */
+    MO_UINT16 SkippedTableCount;
+    MO_UINT32 Reserved;
+    /**
+     * @brief The hash buckets which contain the index plus one of the first
+     *        instance record, or zero if the bucket is empty.
+     */
+    MO_UINT16 Buckets[MO_UEFI_ACPI_TABLE_INDEX_BUCKETS];
+    /**
+     * @brief The recorded ACPI description tables in the XSDT order.
+     */
+    MO_UEFI_ACPI_TABLE_INDEX_ENTRY Tables[
+        MO_UEFI_ACPI_TABLE_INDEX_MAXIMUM_TABLES];
+} MO_UEFI_ACPI_TABLE_INDEX, *PMO_UEFI_ACPI_TABLE_INDEX;
+
+/**
+ * @brief Builds the ACPI table index from the Extended System Description Table
+ *        (XSDT), and each ACPI description table is validated exactly once.
+ * @param Index The ACPI table index to be built. If this parameter is nullptr,
+ *              the function returns MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param ExtendedSystemDescriptionTable The physical address of the Extended
+ *                                       System Description Table (XSDT). If
+ *                                       this parameter is zero, the function
+ *                                       returns
+ *                                       MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the Extended System Description Table (XSDT) is invalid, the
+ *          function returns MO_RESULT_ERROR_INVALID_POINTER.
+ *          If the XSDT contains more tables than the index can record, the
+ *          remaining tables are skipped and the function returns
+ *          MO_RESULT_SUCCESS_FALSE.
+ *          The index records the addresses only, so the tables patched in place
+ *          after building the index are still served by the index.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiTableIndexInitialize(
+    _Mo_Out_ PMO_UEFI_ACPI_TABLE_INDEX Index,
+    _Mo_In_ MO_UINT64 ExtendedSystemDescriptionTable);
+
+/**
+ * @brief Acquires the physical address of an ACPI description table from the
+ *        ACPI table index.
+ * @param TableAddress The pointer to receive the physical address of the ACPI
+ *                     description table. If this parameter is nullptr, the
+ *                     function returns MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param Index The ACPI table index. If this parameter is nullptr, the function
+ *              returns MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param ExpectedSignature The expected signature of the ACPI description
+ *                          table.
+ * @param MinimumRevision The minimum revision of the ACPI description table.
+ * @param Instance The zero-based instance number among the ACPI description
+ *                 tables which have the expected signature and meet the minimum
+ *                 revision, in the XSDT order.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the specified ACPI description table is not found, the function
+ *          returns MO_RESULT_ERROR_NO_INTERFACE.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiTableIndexQuery(
+    _Mo_Out_ PMO_UINT64 TableAddress,
+    _Mo_In_ PMO_UEFI_ACPI_TABLE_INDEX Index,
+    _Mo_In_ MO_UINT32 ExpectedSignature,
+    _Mo_In_ MO_UINT8 MinimumRevision,
+    _Mo_In_ MO_UINTN Instance);
+
+/**
+ * @brief The type filter value which matches all types of the ACPI
+ *        sub-structures.
+ */
+#define MO_UEFI_ACPI_SUB_STRUCTURE_TYPE_ANY 0xFFFF
+
+/**
+ * @brief The common header of the ACPI sub-structures which follow the fixed
+ *        part of the ACPI description tables, like the Interrupt Controller
+ *        Structures in the MADT and the Static Resource Allocation Structures
+ *        in the SRAT.
+ */
+typedef struct _MO_UEFI_ACPI_SUB_STRUCTURE_HEADER
+{
+    /**
+     * @brief The type of the ACPI sub-structure.
+     */
+    MO_UINT8 Type;
+    /**
+     * @brief The length in bytes of the ACPI sub-structure.
+     */
+    MO_UINT8 Length;
+} MO_UEFI_ACPI_SUB_STRUCTURE_HEADER, *PMO_UEFI_ACPI_SUB_STRUCTURE_HEADER;
+
+/**
+ * @brief The allocation-free streaming iterator of the ACPI sub-structures.
+ */
+typedef struct _MO_UEFI_ACPI_SUB_STRUCTURE_ITERATOR
+{
+    /**
+     * @brief The address of the next ACPI sub-structure to be visited.
+     */
+    MO_UINTN Current;
+    /**
+     * @brief The address of the end of the ACPI description table.
+     */
+    MO_UINTN End;
+    /**
+     * @brief The type of the ACPI sub-structures to be visited, or
+     *        MO_UEFI_ACPI_SUB_STRUCTURE_TYPE_ANY for all types.
+     */
+    MO_UINT16 TypeFilter;
+} MO_UEFI_ACPI_SUB_STRUCTURE_ITERATOR, *PMO_UEFI_ACPI_SUB_STRUCTURE_ITERATOR;
+
+/**
+ * @brief Initializes the iterator of the ACPI sub-structures in an ACPI
+ *        description table.
+ * @param Iterator The iterator to be initialized. If this parameter is nullptr,
+ *                 the function returns MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param DescriptionTable The physical address of the ACPI description table.
+ *                         If this parameter is zero, the function returns
+ *                         MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param HeaderSize The size in bytes of the fixed part of the ACPI description
+ *                   table before the first ACPI sub-structure, like the size of
+ *                   EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_HEADER.
+ * @param TypeFilter The type of the ACPI sub-structures to be visited, or
+ *                   MO_UEFI_ACPI_SUB_STRUCTURE_TYPE_ANY for all types.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The ACPI description table is not validated by this function, so
+ *          the caller should validate it before iterating.
+ *          If the header size is smaller than the ACPI description header or
+ *          larger than the length of the ACPI description table, the function
+ *          returns MO_RESULT_ERROR_OUT_OF_BOUNDS.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiSubStructureIteratorInitialize(
+    _Mo_Out_ PMO_UEFI_ACPI_SUB_STRUCTURE_ITERATOR Iterator,
+    _Mo_In_ MO_UINT64 DescriptionTable,
+    _Mo_In_ MO_UINTN HeaderSize,
+    _Mo_In_ MO_UINT16 TypeFilter);
+
+/**
+ * @brief Moves the iterator to the next ACPI sub-structure which matches the
+ *        type filter.
+ * @param SubStructure The pointer to receive the address of the next ACPI
+ *                     sub-structure. If this parameter is nullptr, the function
+ *                     returns MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param Iterator The iterator of the ACPI sub-structures. If this parameter is
+ *                 nullptr, the function returns
+ *                 MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If there are no more ACPI sub-structures, the function returns
+ *          MO_RESULT_ERROR_NO_INTERFACE.
+ *          If an ACPI sub-structure has an invalid length or crosses the end
+ *          of the ACPI description table, the function returns
+ *          MO_RESULT_ERROR_OUT_OF_BOUNDS and the iteration is terminated.
+ *          The returned ACPI sub-structure is guaranteed to have at least the
+ *          size of MO_UEFI_ACPI_SUB_STRUCTURE_HEADER, and the caller should
+ *          check the length before accessing the type-specific fields.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiSubStructureIteratorNext(
+    _Mo_Out_ PMO_UEFI_ACPI_SUB_STRUCTURE_HEADER* SubStructure,
+    _Mo_InOut_ PMO_UEFI_ACPI_SUB_STRUCTURE_ITERATOR Iterator);
+
+/**
+ * @brief The callback routine invoked for each visited ACPI sub-structure.
+ * @param SubStructure The address of the visited ACPI sub-structure.
+ * @param Context The user-defined context passed to the enumerate function.
+ * @return If the callback returns MO_RESULT_SUCCESS_OK, the enumeration will
+ *         continue. Otherwise, the enumeration will be stopped and the result
+ *         will be returned by the enumerate function.
+ */
+typedef MO_RESULT(MOAPI* PMO_UEFI_ACPI_SUB_STRUCTURE_CALLBACK)(
+    _Mo_In_ PMO_UEFI_ACPI_SUB_STRUCTURE_HEADER SubStructure,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief Enumerates the ACPI sub-structures which match the type filter in an
+ *        ACPI description table.
+ * @param DescriptionTable The physical address of the ACPI description table.
+ *                         If this parameter is zero, the function returns
+ *                         MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param HeaderSize The size in bytes of the fixed part of the ACPI description
+ *                   table before the first ACPI sub-structure.
+ * @param TypeFilter The type of the ACPI sub-structures to be visited, or
+ *                   MO_UEFI_ACPI_SUB_STRUCTURE_TYPE_ANY for all types.
+ * @param Callback The callback routine invoked for each visited ACPI
+ *                 sub-structure. If this parameter is nullptr, the function
+ *                 returns MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param Context The user-defined context passed to the callback routine.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the enumeration is stopped by the callback routine, the function
+ *          returns the result of the callback routine.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiEnumerateSubStructures(
+    _Mo_In_ MO_UINT64 DescriptionTable,
+    _Mo_In_ MO_UINTN HeaderSize,
+    _Mo_In_ MO_UINT16 TypeFilter,
+    _Mo_In_ PMO_UEFI_ACPI_SUB_STRUCTURE_CALLBACK Callback,
+    _Mo_In_Opt_ MO_POINTER Context);
+
 /**
  * @brief The simple memory range item structure for ACPI memory queries.
  */
@@ -184,4 +445,377 @@ MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiQueryMemoryHoles(
     _Mo_Out_ PMO_UINTN MemoryHoleRangesCount,
     _Mo_In_ MO_UINT64 SystemResourceAffinityTable);
 
+/**
+ * @brief Collects the sorted original memory ranges definitions from the System
+ *        Resource Affinity Table (SRAT) into the caller-provided buffer.
+ * @param Buffer The buffer to receive the memory ranges. This parameter can be
+ *               nullptr if only the required buffer count is queried.
+ * @param RequiredCount The pointer to receive the required buffer count in
+ *                      items. This parameter can be nullptr if the required
+ *                      buffer count is not needed.
+ * @param ResultCount The pointer to receive the count of memory ranges stored
+ *                    into the buffer. If this parameter is nullptr, the
+ *                    function returns MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param BufferCount The size of the buffer in items. If the size is
+ *                    insufficient, the function returns
+ *                    MO_RESULT_ERROR_OUT_OF_MEMORY.
+ * @param SystemResourceAffinityTable The physical address of the System
+ *                                    Resource Affinity Table (SRAT). If this
+ *                                    parameter is zero, the function returns
+ *                                    MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The System Resource Affinity Table (SRAT) is walked only once, and
+ *          no memory is allocated from the heap, so this function can be used
+ *          before the heap is available.
+ *          The required buffer count is the count of Memory Affinity
+ *          Structures, which is also sufficient for the merged memory ranges
+ *          and the memory holes.
+ *          If no memory ranges are found, the function returns
+ *          MO_RESULT_ERROR_NO_INTERFACE.
+ *          If the System Resource Affinity Table (SRAT) is invalid, the
+ *          function returns MO_RESULT_ERROR_INVALID_POINTER.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiCollectMemoryRanges(
+    _Mo_Out_Opt_ PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM Buffer,
+    _Mo_Out_Opt_ PMO_UINTN RequiredCount,
+    _Mo_Out_ PMO_UINTN ResultCount,
+    _Mo_In_ MO_UINTN BufferCount,
+    _Mo_In_ MO_UINT64 SystemResourceAffinityTable);
+
+/**
+ * @brief Collects the sorted merged memory ranges definitions from the System
+ *        Resource Affinity Table (SRAT) into the caller-provided buffer.
+ * @param Buffer The buffer to receive the merged memory ranges. This parameter
+ *               can be nullptr if only the required buffer count is queried.
+ * @param RequiredCount The pointer to receive the required buffer count in
+ *                      items. This parameter can be nullptr if the required
+ *                      buffer count is not needed.
+ * @param ResultCount The pointer to receive the count of merged memory ranges
+ *                    stored into the buffer. If this parameter is nullptr, the
+ *                    function returns MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param BufferCount The size of the buffer in items. If the size is
+ *                    insufficient, the function returns
+ *                    MO_RESULT_ERROR_OUT_OF_MEMORY.
+ * @param SystemResourceAffinityTable The physical address of the System
+ *                                    Resource Affinity Table (SRAT). If this
+ *                                    parameter is zero, the function returns
+ *                                    MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The memory ranges are merged while they are streamed from the
+ *          System Resource Affinity Table (SRAT), so the buffer only needs to
+ *          hold the merged memory ranges in most cases. The required buffer
+ *          count is the count of Memory Affinity Structures, which is always
+ *          sufficient.
+ *          If no memory ranges are found, the function returns
+ *          MO_RESULT_ERROR_NO_INTERFACE.
+ *          If the System Resource Affinity Table (SRAT) is invalid, the
+ *          function returns MO_RESULT_ERROR_INVALID_POINTER.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiCollectMergedMemoryRanges(
+    _Mo_Out_Opt_ PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM Buffer,
+    _Mo_Out_Opt_ PMO_UINTN RequiredCount,
+    _Mo_Out_ PMO_UINTN ResultCount,
+    _Mo_In_ MO_UINTN BufferCount,
+    _Mo_In_ MO_UINT64 SystemResourceAffinityTable);
+
+/**
+ * @brief Collects the sorted merged memory holes definitions from the System
+ *        Resource Affinity Table (SRAT) into the caller-provided buffer.
+ * @param Buffer The buffer to receive the memory holes. This parameter can be
+ *               nullptr if only the required buffer count is queried.
+ * @param RequiredCount The pointer to receive the required buffer count in
+ *                      items. This parameter can be nullptr if the required
+ *                      buffer count is not needed.
+ * @param ResultCount The pointer to receive the count of memory holes stored
+ *                    into the buffer. If this parameter is nullptr, the
+ *                    function returns MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param BufferCount The size of the buffer in items. If the size is
+ *                    insufficient, the function returns
+ *                    MO_RESULT_ERROR_OUT_OF_MEMORY.
+ * @param SystemResourceAffinityTable The physical address of the System
+ *                                    Resource Affinity Table (SRAT). If this
+ *                                    parameter is zero, the function returns
+ *                                    MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The buffer is also used as the scratch space of the merged memory
+ *          ranges, so it needs to hold one more item than the memory holes.
+ *          The required buffer count is the count of Memory Affinity
+ *          Structures, which is always sufficient.
+ *          If no memory holes are found, the function returns
+ *          MO_RESULT_ERROR_NO_INTERFACE.
+ *          If the System Resource Affinity Table (SRAT) is invalid, the
+ *          function returns MO_RESULT_ERROR_INVALID_POINTER.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiCollectMemoryHoles(
+    _Mo_Out_Opt_ PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM Buffer,
+    _Mo_Out_Opt_ PMO_UINTN RequiredCount,
+    _Mo_Out_ PMO_UINTN ResultCount,
+    _Mo_In_ MO_UINTN BufferCount,
+    _Mo_In_ MO_UINT64 SystemResourceAffinityTable);
+
+/**
+ * @brief The maximum number of the ACPI patch rules which can be applied in one
+ *        call, which is limited by the bits of the applied rules mask.
+ */
+#define MO_UEFI_ACPI_PATCH_MAXIMUM_RULES 64
+
+/**
+ * @brief The scope value which makes the ACPI patch rule apply to the fixed
+ *        part of the ACPI description table instead of its sub-structures.
+ */
+#define MO_UEFI_ACPI_PATCH_SCOPE_TABLE 0xFFFF
+
+/*
+ * The predicates of the ACPI patch rules, which are evaluated on the condition
+ * field of the patched structure.
+ */
+
+#define MO_UEFI_ACPI_PATCH_PREDICATE_ALWAYS 0
+#define MO_UEFI_ACPI_PATCH_PREDICATE_EQUAL 1
+#define MO_UEFI_ACPI_PATCH_PREDICATE_GREATER_OR_EQUAL 2
+
+/*
+ * The operations of the ACPI patch rules, which are applied on the target
+ * field of the patched structure.
+ */
+
+#define MO_UEFI_ACPI_PATCH_OPERATION_SET 0
+#define MO_UEFI_ACPI_PATCH_OPERATION_OR 1
+#define MO_UEFI_ACPI_PATCH_OPERATION_COPY 2
+
+/**
+ * @brief The ACPI patch rule is only applied when the target field is zero.
+ */
+#define MO_UEFI_ACPI_PATCH_FLAG_ONLY_IF_ZERO 0x1
+
+/**
+ * @brief The declarative ACPI patch rule.
+ * @remarks All fields are accessed as little-endian unsigned integers of 1, 2,
+ *          4 or 8 bytes, and the offsets are relative to the start of the
+ *          patched structure, which is the ACPI description table for the
+ *          table scope or the ACPI sub-structure for the sub-structure scope.
+ */
+typedef struct _MO_UEFI_ACPI_PATCH_RULE
+{
+    /**
+     * @brief The name of the ACPI patch rule, which is only used for reporting.
+     */
+    MO_CONSTANT_STRING Name;
+    /**
+     * @brief The signature of the ACPI description table to be patched.
+     */
+    MO_UINT32 Signature;
+    /**
+     * @brief MO_UEFI_ACPI_PATCH_SCOPE_TABLE for patching the fixed part of the
+     *        ACPI description table, or the type of the ACPI sub-structures to
+     *        be patched.
+     */
+    MO_UINT16 Scope;
+    /**
+     * @brief The size in bytes of the fixed part of the ACPI description table
+     *        before the first ACPI sub-structure, which is only used for the
+     *        sub-structure scope.
+     */
+    MO_UINT16 HeaderSize;
+    /**
+     * @brief The MO_UEFI_ACPI_PATCH_PREDICATE_* predicate.
+     */
+    MO_UINT8 Predicate;
+    /**
+     * @brief The size in bytes of the condition field.
+     */
+    MO_UINT8 ConditionSize;
+    /**
+     * @brief The offset in bytes of the condition field.
+     */
+    MO_UINT16 ConditionOffset;
+    /**
+     * @brief The MO_UEFI_ACPI_PATCH_OPERATION_* operation.
+     */
+    MO_UINT8 Operation;
+    /**
+     * @brief The size in bytes of the target field.
+     */
+    MO_UINT8 FieldSize;
+    /**
+     * @brief The offset in bytes of the target field.
+     */
+    MO_UINT16 FieldOffset;
+    /**
+     * @brief The minimum revision of the ACPI description table to be patched.
+     */
+    MO_UINT8 MinimumRevision;
+    /**
+     * @brief The MO_UEFI_ACPI_PATCH_FLAG_* flags.
+     */
+    MO_UINT8 Flags;
+    MO_UINT8 Reserved[6];
+    /**
+     * @brief The value compared with the condition field.
+     */
+    MO_UINT64 ConditionValue;
+    /**
+     * @brief The new value for MO_UEFI_ACPI_PATCH_OPERATION_SET, the bit mask
+     *        for MO_UEFI_ACPI_PATCH_OPERATION_OR, or the offset in bytes of the
+     *        source field for MO_UEFI_ACPI_PATCH_OPERATION_COPY. The source
+     *        field has the same size as the target field, so the wider source
+     *        field is truncated.
+     */
+    MO_UINT64 Value;
+} MO_UEFI_ACPI_PATCH_RULE, *PMO_UEFI_ACPI_PATCH_RULE;
+
+/**
+ * @brief Applies the ACPI patch rules to an ACPI description table, and updates
+ *        the checksum once after all rules are applied.
+ * @param AppliedRules The pointer to receive the mask of the applied rules,
+ *                     which bit N is set if Rules[N] is applied to at least one
+ *                     structure. This parameter can be nullptr if the mask is
+ *                     not needed.
+ * @param DescriptionTable The physical address of the ACPI description table.
+ *                         If this parameter is zero, the function returns
+ *                         MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param Rules The array of the ACPI patch rules. The rules whose signature is
+ *              different from the ACPI description table are ignored. If this
+ *              parameter is nullptr, the function returns
+ *              MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param RuleCount The count of the ACPI patch rules, which must not be zero and
+ *                  must not exceed MO_UEFI_ACPI_PATCH_MAXIMUM_RULES.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The ACPI description table is not validated by this function, so
+ *          the caller should validate it before patching, like querying it
+ *          from the ACPI description table index.
+ *          The rules are validated before the ACPI description table is
+ *          modified. If a rule is malformed or a table scope field crosses the
+ *          end of the ACPI description table, the function returns
+ *          MO_RESULT_ERROR_INVALID_PARAMETER. The ACPI sub-structures which are
+ *          too short for a rule are skipped.
+ *          The table scope rules are applied in order before the sub-structure
+ *          scope rules, and the ACPI sub-structures are walked only once.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiPatchDescriptionTable(
+    _Mo_Out_Opt_ PMO_UINT64 AppliedRules,
+    _Mo_In_ MO_UINT64 DescriptionTable,
+    _Mo_In_ PMO_UEFI_ACPI_PATCH_RULE Rules,
+    _Mo_In_ MO_UINTN RuleCount);
+
+/**
+ * @brief Applies the ACPI patch rules to all ACPI description tables in the
+ *        ACPI description table index.
+ * @param AppliedRules The pointer to receive the mask of the applied rules,
+ *                     which bit N is set if Rules[N] is applied to at least one
+ *                     structure. This parameter can be nullptr if the mask is
+ *                     not needed.
+ * @param Index The ACPI description table index. If this parameter is nullptr,
+ *              the function returns MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param Rules The array of the ACPI patch rules. If this parameter is nullptr,
+ *              the function returns MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param RuleCount The count of the ACPI patch rules, which must not be zero and
+ *                  must not exceed MO_UEFI_ACPI_PATCH_MAXIMUM_RULES.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The rules are applied to every indexed instance of the matched
+ *          signature, and the ACPI description tables without any matched
+ *          rule are not touched.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiTableIndexApplyPatches(
+    _Mo_Out_Opt_ PMO_UINT64 AppliedRules,
+    _Mo_In_ PMO_UEFI_ACPI_TABLE_INDEX Index,
+    _Mo_In_ PMO_UEFI_ACPI_PATCH_RULE Rules,
+    _Mo_In_ MO_UINTN RuleCount);
+
+/**
+ * @brief Acquires the I/O port of the ACPI Power Management Timer from the Fixed
+ *        ACPI Description Table (FADT).
+ * @param Port The pointer to receive the I/O port of the ACPI Power Management
+ *             Timer. If this parameter is nullptr, the function returns
+ *             MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param Extended The pointer to receive whether the counter is 32 bits wide
+ *                 (TMR_VAL_EXT) instead of 24 bits wide. This parameter can be
+ *                 nullptr if the width is not needed.
+ * @param Index The ACPI description table index. If this parameter is nullptr,
+ *              the function returns MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The XPmTmrBlk field is preferred, and the PmTmrBlk field is used if
+ *          the XPmTmrBlk field is not in the system I/O space or empty.
+ *          If the FADT is not found or the ACPI Power Management Timer is not
+ *          supported, the function returns MO_RESULT_ERROR_NO_INTERFACE.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiQueryPowerManagementTimer(
+    _Mo_Out_ PMO_UINT16 Port,
+    _Mo_Out_Opt_ PMO_BOOL Extended,
+    _Mo_In_ PMO_UEFI_ACPI_TABLE_INDEX Index);
+
+/**
+ * @brief Acquires the base address of the High Precision Event Timer (HPET)
+ *        registers from the HPET description table.
+ * @param BaseAddress The pointer to receive the physical base address of the
+ *                    HPET registers. If this parameter is nullptr, the function
+ *                    returns MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param Index The ACPI description table index. If this parameter is nullptr,
+ *              the function returns MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the HPET description table is not found or the HPET registers are
+ *          not in the system memory space, the function returns
+ *          MO_RESULT_ERROR_NO_INTERFACE.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiQueryHighPrecisionEventTimer(
+    _Mo_Out_ PMO_UINT64 BaseAddress,
+    _Mo_In_ PMO_UEFI_ACPI_TABLE_INDEX Index);
+
+/**
+ * @brief The processor item structure for ACPI processor queries.
+ */
+typedef struct _MO_UEFI_ACPI_PROCESSOR_ITEM
+{
+    /**
+     * @brief The local APIC ID or the x2APIC ID of the processor.
+     */
+    MO_UINT32 ApicId;
+    /**
+     * @brief The ACPI processor UID of the processor, which is the ACPI
+     *        processor ID for the Processor Local APIC Structures.
+     */
+    MO_UINT32 ProcessorUid;
+} MO_UEFI_ACPI_PROCESSOR_ITEM, *PMO_UEFI_ACPI_PROCESSOR_ITEM;
+
+/**
+ * @brief Collects the enabled processors from the Processor Local APIC and the
+ *        Processor Local x2APIC Structures in the Multiple APIC Description
+ *        Table (MADT) into the caller-provided buffer.
+ * @param Buffer The buffer to receive the processors. This parameter can be
+ *               nullptr if only the required buffer count is queried.
+ * @param RequiredCount The pointer to receive the required buffer count in
+ *                      items. This parameter can be nullptr if the required
+ *                      buffer count is not needed.
+ * @param ResultCount The pointer to receive the count of processors stored into
+ *                    the buffer. If this parameter is nullptr, the function
+ *                    returns MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param BufferCount The size of the buffer in items. If the size is
+ *                    insufficient, the function returns
+ *                    MO_RESULT_ERROR_OUT_OF_MEMORY.
+ * @param Index The ACPI description table index. If this parameter is nullptr,
+ *              the function returns MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The processors are stored in the MADT order, and the firmware lists
+ *          the bootstrap processor first by convention. The processors which
+ *          are described by both structure types or more than once are
+ *          stored only once, and the required buffer count is the count of
+ *          the distinct APIC IDs.
+ *          If the MADT is not found or no enabled processors are found, the
+ *          function returns MO_RESULT_ERROR_NO_INTERFACE.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoUefiAcpiCollectProcessors(
+    _Mo_Out_Opt_ PMO_UEFI_ACPI_PROCESSOR_ITEM Buffer,
+    _Mo_Out_Opt_ PMO_UINTN RequiredCount,
+    _Mo_Out_ PMO_UINTN ResultCount,
+    _Mo_In_ MO_UINTN BufferCount,
+    _Mo_In_ PMO_UEFI_ACPI_TABLE_INDEX Index);
+
 #endif // !MOBILITY_UEFI_ACPI
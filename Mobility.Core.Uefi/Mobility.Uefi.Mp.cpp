@@ -0,0 +1,189 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Uefi.Mp.cpp
+ * PURPOSE:    Implementation for Mobility UEFI multiprocessor work dispatch
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Uefi.Mp.h"
+
+#include <Protocol/MpService.h>
+
+#ifdef _MSC_VER
+extern "C" __int64 _InterlockedIncrement64(
+    __int64 volatile* Addend);
+#pragma intrinsic(_InterlockedIncrement64)
+#endif // _MSC_VER
+
+namespace
+{
+    typedef struct _MO_UEFI_MP_WORK_QUEUE
+    {
+        PMO_UEFI_MP_WORK_ROUTINE Routine;
+        MO_POINTER Context;
+        MO_UINTN ItemCount;
+        MO_UINTN ChunkSize;
+        MO_UINTN ChunkCount;
+        volatile MO_INT64 NextChunk;
+        volatile MO_INT64 CompletedChunks;
+        volatile MO_INT64 Participants;
+    } MO_UEFI_MP_WORK_QUEUE, *PMO_UEFI_MP_WORK_QUEUE;
+
+    static MO_INT64 MoUefiMpInterlockedIncrement(
+        _Mo_InOut_ volatile MO_INT64* Addend)
+    {
+#ifdef _MSC_VER
+        return ::_InterlockedIncrement64(
+            reinterpret_cast<__int64 volatile*>(Addend));
+#else
+        return __atomic_add_fetch(Addend, 1, __ATOMIC_SEQ_CST);
+#endif // _MSC_VER
+    }
+
+    static MO_VOID MoUefiMpDrainWorkQueue(
+        _Mo_In_ PMO_UEFI_MP_WORK_QUEUE Queue)
+    {
+        MO_BOOL Participated = MO_FALSE;
+
+        for (;;)
+        {
+            // The queue index is claimed first, so each chunk is processed by
+            // exactly one processor even if many processors race here.
+            MO_UINTN Chunk = static_cast<MO_UINTN>(
+                ::MoUefiMpInterlockedIncrement(&Queue->NextChunk) - 1);
+            if (Chunk >= Queue->ChunkCount)
+            {
+                break;
+            }
+
+            MO_UINTN Begin = Chunk * Queue->ChunkSize;
+            MO_UINTN End = Queue->ItemCount - Begin > Queue->ChunkSize
+                ? Begin + Queue->ChunkSize
+                : Queue->ItemCount;
+            Queue->Routine(Begin, End, Queue->Context);
+
+            ::MoUefiMpInterlockedIncrement(&Queue->CompletedChunks);
+            Participated = MO_TRUE;
+        }
+
+        if (Participated)
+        {
+            ::MoUefiMpInterlockedIncrement(&Queue->Participants);
+        }
+    }
+
+    static VOID EFIAPI MoUefiMpApProcedure(
+        _Mo_In_ VOID* Buffer)
+    {
+        ::MoUefiMpDrainWorkQueue(
+            reinterpret_cast<PMO_UEFI_MP_WORK_QUEUE>(Buffer));
+    }
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoUefiMpDispatchWork(
+    _Mo_Out_Opt_ PMO_UINTN ProcessorCount,
+    _Mo_In_ EFI_BOOT_SERVICES* BootServices,
+    _Mo_In_ MO_UINTN ItemCount,
+    _Mo_In_ MO_UINTN ChunkSize,
+    _Mo_In_ PMO_UEFI_MP_WORK_ROUTINE Routine,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    if (ProcessorCount)
+    {
+        *ProcessorCount = 0;
+    }
+
+    if (!BootServices || !ChunkSize || !Routine)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    if (!ItemCount)
+    {
+        return MO_RESULT_SUCCESS_OK;
+    }
+
+    MO_UEFI_MP_WORK_QUEUE Queue;
+    Queue.Routine = Routine;
+    Queue.Context = Context;
+    Queue.ItemCount = ItemCount;
+    Queue.ChunkSize = ChunkSize;
+    Queue.ChunkCount = ItemCount / ChunkSize + (ItemCount % ChunkSize ? 1 : 0);
+    Queue.NextChunk = 0;
+    Queue.CompletedChunks = 0;
+    Queue.Participants = 0;
+
+    EFI_EVENT CompletionEvent = nullptr;
+    if (Queue.ChunkCount > 1)
+    {
+        EFI_MP_SERVICES_PROTOCOL* MpServices = nullptr;
+        EFI_STATUS Status = BootServices->LocateProtocol(
+            &gEfiMpServiceProtocolGuid,
+            nullptr,
+            reinterpret_cast<void**>(&MpServices));
+        if (EFI_SUCCESS == Status)
+        {
+            Status = BootServices->CreateEvent(
+                0,
+                TPL_CALLBACK,
+                nullptr,
+                nullptr,
+                &CompletionEvent);
+        }
+        if (EFI_SUCCESS == Status)
+        {
+            // The non-blocking mode lets the bootstrap processor drain the
+            // same queue instead of idling until the application processors
+            // finish. EFI_NOT_STARTED means there is no enabled application
+            // processor, which falls back to the bootstrap processor.
+            Status = MpServices->StartupAllAPs(
+                MpServices,
+                ::MoUefiMpApProcedure,
+                FALSE,
+                CompletionEvent,
+                0,
+                &Queue,
+                nullptr);
+            if (EFI_SUCCESS != Status)
+            {
+                BootServices->CloseEvent(CompletionEvent);
+                CompletionEvent = nullptr;
+            }
+        }
+    }
+
+    ::MoUefiMpDrainWorkQueue(&Queue);
+
+    if (CompletionEvent)
+    {
+        // The queue lives on this stack, so all application processors must
+        // leave the procedure before returning, not only finish the chunks.
+        // WaitForEvent fails above TPL_APPLICATION, so poll the event
+        // instead of returning while they may still access the queue.
+        UINTN EventIndex = 0;
+        EFI_STATUS Status = BootServices->WaitForEvent(
+            1,
+            &CompletionEvent,
+            &EventIndex);
+        while (EFI_SUCCESS != Status)
+        {
+            Status = BootServices->CheckEvent(CompletionEvent);
+        }
+        BootServices->CloseEvent(CompletionEvent);
+    }
+
+    if (static_cast<MO_UINTN>(Queue.CompletedChunks) != Queue.ChunkCount)
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    if (ProcessorCount)
+    {
+        *ProcessorCount = static_cast<MO_UINTN>(Queue.Participants);
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
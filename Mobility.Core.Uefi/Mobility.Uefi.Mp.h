@@ -0,0 +1,65 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Uefi.Mp.h
+ * PURPOSE:    Definition for Mobility UEFI multiprocessor work dispatch
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_UEFI_MP
+#define MOBILITY_UEFI_MP
+
+#include "Mobility.Uefi.Core.h"
+
+/**
+ * @brief The routine which processes a range of the work items.
+ * @param Begin The index of the first work item in the range.
+ * @param End The index after the last work item in the range.
+ * @param Context The user-defined context passed to the dispatch function.
+ * @remark The routine may run on the bootstrap processor and the application
+ *         processors at the same time, so it must be safe for concurrent calls
+ *         on different ranges, and it must not call the UEFI boot services.
+ */
+typedef MO_VOID(MOAPI* PMO_UEFI_MP_WORK_ROUTINE)(
+    _Mo_In_ MO_UINTN Begin,
+    _Mo_In_ MO_UINTN End,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief Splits the work items into the chunks and processes them on all
+ *        enabled processors through the EFI MP Services Protocol, and returns
+ *        after all chunks are processed.
+ * @param ProcessorCount The pointer to receive the number of the processors
+ *                       which processed at least one chunk. This parameter can
+ *                       be nullptr if the number is not needed.
+ * @param BootServices The pointer to the UEFI Boot Services table. If this
+ *                     parameter is nullptr, the function returns
+ *                     MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param ItemCount The number of the work items.
+ * @param ChunkSize The number of the work items in each chunk, which must not
+ *                  be zero. The last chunk may be smaller.
+ * @param Routine The routine which processes each chunk. If this parameter is
+ *                nullptr, the function returns
+ *                MO_RESULT_ERROR_INVALID_PARAMETER.
+ * @param Context The user-defined context passed to the routine.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The chunks are taken from a shared queue by the bootstrap processor
+ *          and the application processors, so the faster processors process
+ *          more chunks. The bootstrap processor always participates, and it
+ *          processes all chunks if the EFI MP Services Protocol is not
+ *          available or there is no enabled application processor.
+ *          This function must be called on the bootstrap processor at
+ *          TPL_APPLICATION before exiting the boot services.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoUefiMpDispatchWork(
+    _Mo_Out_Opt_ PMO_UINTN ProcessorCount,
+    _Mo_In_ EFI_BOOT_SERVICES* BootServices,
+    _Mo_In_ MO_UINTN ItemCount,
+    _Mo_In_ MO_UINTN ChunkSize,
+    _Mo_In_ PMO_UEFI_MP_WORK_ROUTINE Routine,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+#endif // !MOBILITY_UEFI_MP
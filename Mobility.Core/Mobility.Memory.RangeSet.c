@@ -0,0 +1,566 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Memory.RangeSet.c
+ * PURPOSE:    Implementation for Mobility Memory Range Set
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Memory.RangeSet.h"
+
+#include "Mobility.Runtime.Core.h"
+
+MO_FORCEINLINE MO_UINT64 MoMemoryRangeSetGetEnd(
+    _Mo_In_ PMO_MEMORY_RANGE Range)
+{
+    return Range->Base + Range->Length;
+}
+
+/**
+ * @brief Finds the index of the first range whose end is not below the
+ *        specified address by the binary search.
+ */
+MO_FORCEINLINE MO_UINTN MoMemoryRangeSetLowerBound(
+    _Mo_In_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ MO_UINT64 Address)
+{
+    MO_UINTN Low = 0u;
+    MO_UINTN High = Set->Count;
+    while (Low < High)
+    {
+        MO_UINTN Middle = Low + ((High - Low) >> 1);
+        if (MoMemoryRangeSetGetEnd(&Set->Ranges[Middle]) < Address)
+        {
+            Low = Middle + 1;
+        }
+        else
+        {
+            High = Middle;
+        }
+    }
+    return Low;
+}
+
+/**
+ * @brief Moves the ranges starting from the source index to the destination
+ *        index, which opens or closes the slots in the buffer.
+ */
+MO_FORCEINLINE MO_RESULT MoMemoryRangeSetMoveTail(
+    _Mo_In_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ MO_UINTN Destination,
+    _Mo_In_ MO_UINTN Source)
+{
+    if (MO_RESULT_SUCCESS_OK != MoRuntimeMemoryMove(
+        &Set->Ranges[Destination],
+        &Set->Ranges[Source],
+        sizeof(MO_MEMORY_RANGE) * (Set->Count - Source)))
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoMemoryRangeSetInitialize(
+    _Mo_Out_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ PMO_MEMORY_RANGE Buffer,
+    _Mo_In_ MO_UINTN Capacity)
+{
+    if (!Set || !Buffer || !Capacity)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    Set->Ranges = Buffer;
+    Set->Count = 0u;
+    Set->Capacity = Capacity;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoMemoryRangeSetClear(
+    _Mo_InOut_ PMO_MEMORY_RANGE_SET Set)
+{
+    if (!Set)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    Set->Count = 0u;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoMemoryRangeSetInsert(
+    _Mo_InOut_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ MO_UINT64 Base,
+    _Mo_In_ MO_UINT64 Length)
+{
+    if (!Set || !Set->Ranges)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (!Length)
+    {
+        return MO_RESULT_SUCCESS_OK;
+    }
+    MO_UINT64 End = Base + Length;
+    if (End < Base)
+    {
+        return MO_RESULT_ERROR_OUT_OF_BOUNDS;
+    }
+
+    // The first range which overlaps or is adjacent to the new range.
+    MO_UINTN First = MoMemoryRangeSetLowerBound(Set, Base);
+    // The range after the last range which overlaps or is adjacent to the new
+    // range. These ranges will be merged and removed, so the linear walk does
+    // not change the complexity.
+    MO_UINTN Last = First;
+    while (Last < Set->Count && Set->Ranges[Last].Base <= End)
+    {
+        ++Last;
+    }
+
+    if (First == Last)
+    {
+        if (Set->Count >= Set->Capacity)
+        {
+            return MO_RESULT_ERROR_OUT_OF_MEMORY;
+        }
+        if (MO_RESULT_SUCCESS_OK != MoMemoryRangeSetMoveTail(
+            Set,
+            First + 1,
+            First))
+        {
+            return MO_RESULT_ERROR_UNEXPECTED;
+        }
+        Set->Ranges[First].Base = Base;
+        Set->Ranges[First].Length = Length;
+        ++Set->Count;
+        return MO_RESULT_SUCCESS_OK;
+    }
+
+    if (Set->Ranges[First].Base < Base)
+    {
+        Base = Set->Ranges[First].Base;
+    }
+    MO_UINT64 LastEnd = MoMemoryRangeSetGetEnd(&Set->Ranges[Last - 1]);
+    if (LastEnd > End)
+    {
+        End = LastEnd;
+    }
+    Set->Ranges[First].Base = Base;
+    Set->Ranges[First].Length = End - Base;
+
+    if (Last > First + 1)
+    {
+        if (MO_RESULT_SUCCESS_OK != MoMemoryRangeSetMoveTail(
+            Set,
+            First + 1,
+            Last))
+        {
+            return MO_RESULT_ERROR_UNEXPECTED;
+        }
+        Set->Count -= Last - (First + 1);
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoMemoryRangeSetRemove(
+    _Mo_InOut_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ MO_UINT64 Base,
+    _Mo_In_ MO_UINT64 Length)
+{
+    if (!Set || !Set->Ranges)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (!Length)
+    {
+        return MO_RESULT_SUCCESS_OK;
+    }
+    MO_UINT64 End = Base + Length;
+    if (End < Base)
+    {
+        return MO_RESULT_ERROR_OUT_OF_BOUNDS;
+    }
+
+    // The first range which overlaps with the removed range. The adjacent
+    // range is not affected, and Base + 1 cannot overflow because End is
+    // larger than Base.
+    MO_UINTN First = MoMemoryRangeSetLowerBound(Set, Base + 1);
+    if (First >= Set->Count || Set->Ranges[First].Base >= End)
+    {
+        // Nothing to remove.
+        return MO_RESULT_SUCCESS_OK;
+    }
+
+    PMO_MEMORY_RANGE Range = &Set->Ranges[First];
+    MO_UINT64 RangeEnd = MoMemoryRangeSetGetEnd(Range);
+    if (Range->Base < Base && RangeEnd > End)
+    {
+        // The removed range is strictly inside the range, so split it.
+        if (Set->Count >= Set->Capacity)
+        {
+            return MO_RESULT_ERROR_OUT_OF_MEMORY;
+        }
+        if (MO_RESULT_SUCCESS_OK != MoMemoryRangeSetMoveTail(
+            Set,
+            First + 1,
+            First))
+        {
+            return MO_RESULT_ERROR_UNEXPECTED;
+        }
+        ++Set->Count;
+        Set->Ranges[First].Length = Base - Set->Ranges[First].Base;
+        Set->Ranges[First + 1].Base = End;
+        Set->Ranges[First + 1].Length = RangeEnd - End;
+        return MO_RESULT_SUCCESS_OK;
+    }
+
+    if (Range->Base < Base)
+    {
+        // Trim the tail of the first range and keep it.
+        Range->Length = Base - Range->Base;
+        ++First;
+    }
+
+    // Skip the ranges which are fully covered by the removed range. These
+    // ranges will be removed, so the linear walk does not change the
+    // complexity.
+    MO_UINTN Last = First;
+    while (Last < Set->Count &&
+        MoMemoryRangeSetGetEnd(&Set->Ranges[Last]) <= End)
+    {
+        ++Last;
+    }
+
+    if (Last < Set->Count && Set->Ranges[Last].Base < End)
+    {
+        // Trim the head of the last range.
+        Range = &Set->Ranges[Last];
+        RangeEnd = MoMemoryRangeSetGetEnd(Range);
+        Range->Base = End;
+        Range->Length = RangeEnd - End;
+    }
+
+    if (Last > First)
+    {
+        if (MO_RESULT_SUCCESS_OK != MoMemoryRangeSetMoveTail(
+            Set,
+            First,
+            Last))
+        {
+            return MO_RESULT_ERROR_UNEXPECTED;
+        }
+        Set->Count -= Last - First;
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoMemoryRangeSetQuery(
+    _Mo_Out_Opt_ PMO_MEMORY_RANGE Range,
+    _Mo_In_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ MO_UINT64 Address)
+{
+    if (!Set || !Set->Ranges)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (Address == MO_UINT64_MAX)
+    {
+        // No range can contain the last address because the range end is
+        // exclusive.
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    MO_UINTN Index = MoMemoryRangeSetLowerBound(Set, Address + 1);
+    if (Index >= Set->Count || Set->Ranges[Index].Base > Address)
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    if (Range)
+    {
+        *Range = Set->Ranges[Index];
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+/**
+ * @brief Checks whether the range overlaps or is adjacent to any range of the
+ *        range set, which means adding it does not need a new slot.
+ */
+MO_FORCEINLINE MO_BOOL MoMemoryRangeSetIsTouching(
+    _Mo_In_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ PMO_MEMORY_RANGE Range)
+{
+    MO_UINTN Index = MoMemoryRangeSetLowerBound(Set, Range->Base);
+    return (Index < Set->Count &&
+        Set->Ranges[Index].Base <= MoMemoryRangeSetGetEnd(Range))
+        ? MO_TRUE
+        : MO_FALSE;
+}
+
+/**
+ * @brief Checks whether the range is strictly inside a range of the range set,
+ *        which means removing it needs a new slot.
+ */
+MO_FORCEINLINE MO_BOOL MoMemoryRangeSetIsSplitting(
+    _Mo_In_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ PMO_MEMORY_RANGE Range)
+{
+    MO_UINTN Index = MoMemoryRangeSetLowerBound(Set, Range->Base + 1);
+    return (Index < Set->Count &&
+        Set->Ranges[Index].Base < Range->Base &&
+        MoMemoryRangeSetGetEnd(&Set->Ranges[Index]) >
+        MoMemoryRangeSetGetEnd(Range))
+        ? MO_TRUE
+        : MO_FALSE;
+}
+
+/**
+ * @brief Gets the specified range of another range set, or the specified gap
+ *        between its ranges if the gaps are requested. The gap with index N is
+ *        the gap before the range with index N, and the last gap is after the
+ *        last range.
+ */
+MO_FORCEINLINE MO_VOID MoMemoryRangeSetGetItem(
+    _Mo_Out_ PMO_MEMORY_RANGE Item,
+    _Mo_In_ PMO_MEMORY_RANGE_SET Other,
+    _Mo_In_ MO_UINTN Index,
+    _Mo_In_ MO_BOOL Gap)
+{
+    if (!Gap)
+    {
+        *Item = Other->Ranges[Index];
+        return;
+    }
+
+    Item->Base = Index ? MoMemoryRangeSetGetEnd(&Other->Ranges[Index - 1]) : 0u;
+    MO_UINT64 End = (Index < Other->Count)
+        ? Other->Ranges[Index].Base
+        : MO_UINT64_MAX;
+    Item->Length = End - Item->Base;
+}
+
+/**
+ * @brief Counts the ranges of the union of two range sets without modifying
+ *        them, by merging the sorted ranges of both sets.
+ */
+MO_FORCEINLINE MO_UINTN MoMemoryRangeSetCountUnion(
+    _Mo_In_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ PMO_MEMORY_RANGE_SET Other)
+{
+    MO_UINTN Count = 0u;
+    MO_UINT64 CurrentEnd = 0u;
+    MO_UINTN i = 0u;
+    MO_UINTN j = 0u;
+    while (i < Set->Count || j < Other->Count)
+    {
+        PMO_MEMORY_RANGE Next = nullptr;
+        if (j >= Other->Count ||
+            (i < Set->Count && Set->Ranges[i].Base < Other->Ranges[j].Base))
+        {
+            Next = &Set->Ranges[i++];
+        }
+        else
+        {
+            Next = &Other->Ranges[j++];
+        }
+
+        MO_UINT64 NextEnd = MoMemoryRangeSetGetEnd(Next);
+        if (Count && Next->Base <= CurrentEnd)
+        {
+            if (NextEnd > CurrentEnd)
+            {
+                CurrentEnd = NextEnd;
+            }
+            continue;
+        }
+        ++Count;
+        CurrentEnd = NextEnd;
+    }
+    return Count;
+}
+
+/**
+ * @brief Counts the ranges left after removing the ranges or the gaps of
+ *        another range set without modifying them. The parts left in a range
+ *        are never adjacent to each other because the removed ranges are not
+ *        empty.
+ */
+MO_FORCEINLINE MO_UINTN MoMemoryRangeSetCountRemoval(
+    _Mo_In_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ PMO_MEMORY_RANGE_SET Other,
+    _Mo_In_ MO_BOOL Gaps)
+{
+    MO_UINTN Count = 0u;
+    MO_UINTN ItemCount = Gaps ? Other->Count + 1 : Other->Count;
+    MO_UINTN j = 0u;
+    for (MO_UINTN i = 0; i < Set->Count; ++i)
+    {
+        MO_UINT64 Current = Set->Ranges[i].Base;
+        MO_UINT64 End = MoMemoryRangeSetGetEnd(&Set->Ranges[i]);
+        for (; j < ItemCount; ++j)
+        {
+            MO_MEMORY_RANGE Item;
+            MoMemoryRangeSetGetItem(&Item, Other, j, Gaps);
+            MO_UINT64 ItemEnd = MoMemoryRangeSetGetEnd(&Item);
+            if (!Item.Length || ItemEnd <= Current)
+            {
+                continue;
+            }
+            if (Item.Base >= End)
+            {
+                break;
+            }
+            if (Item.Base > Current)
+            {
+                ++Count;
+            }
+            Current = ItemEnd;
+            if (Current >= End)
+            {
+                // The item may also cover the next ranges.
+                break;
+            }
+        }
+        if (Current < End)
+        {
+            ++Count;
+        }
+    }
+    return Count;
+}
+
+/**
+ * @brief Removes the ranges or the gaps of another range set in two passes.
+ *        The first pass skips the items which split a range, so the number of
+ *        the ranges never increases. The second pass removes the rest, and
+ *        each of them adds exactly one range. So the number of the ranges
+ *        never exceeds the larger one of the count before and after the
+ *        removal.
+ */
+MO_FORCEINLINE MO_RESULT MoMemoryRangeSetRemoveItems(
+    _Mo_InOut_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ PMO_MEMORY_RANGE_SET Other,
+    _Mo_In_ MO_BOOL Gaps)
+{
+    if (MoMemoryRangeSetCountRemoval(Set, Other, Gaps) > Set->Capacity)
+    {
+        return MO_RESULT_ERROR_OUT_OF_MEMORY;
+    }
+
+    MO_UINTN ItemCount = Gaps ? Other->Count + 1 : Other->Count;
+    for (MO_UINTN Pass = 0; Pass < 2; ++Pass)
+    {
+        for (MO_UINTN i = 0; i < ItemCount; ++i)
+        {
+            MO_MEMORY_RANGE Item;
+            MoMemoryRangeSetGetItem(&Item, Other, i, Gaps);
+            if (!Pass && MoMemoryRangeSetIsSplitting(Set, &Item))
+            {
+                continue;
+            }
+
+            MO_RESULT Result = MoMemoryRangeSetRemove(
+                Set,
+                Item.Base,
+                Item.Length);
+            if (MO_RESULT_SUCCESS_OK != Result)
+            {
+                return Result;
+            }
+        }
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoMemoryRangeSetUnion(
+    _Mo_InOut_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ PMO_MEMORY_RANGE_SET Other)
+{
+    if (!Set || !Other)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (Set == Other)
+    {
+        return MO_RESULT_SUCCESS_OK;
+    }
+
+    if (MoMemoryRangeSetCountUnion(Set, Other) > Set->Capacity)
+    {
+        return MO_RESULT_ERROR_OUT_OF_MEMORY;
+    }
+
+    // The first pass only adds the ranges which touch the existing ranges, so
+    // the number of the ranges never increases. The second pass adds the rest,
+    // and each of them needs exactly one new slot because the ranges of the
+    // other range set are not adjacent to each other.
+    for (MO_UINTN Pass = 0; Pass < 2; ++Pass)
+    {
+        for (MO_UINTN i = 0; i < Other->Count; ++i)
+        {
+            if (!Pass && !MoMemoryRangeSetIsTouching(Set, &Other->Ranges[i]))
+            {
+                continue;
+            }
+
+            MO_RESULT Result = MoMemoryRangeSetInsert(
+                Set,
+                Other->Ranges[i].Base,
+                Other->Ranges[i].Length);
+            if (MO_RESULT_SUCCESS_OK != Result)
+            {
+                return Result;
+            }
+        }
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoMemoryRangeSetSubtract(
+    _Mo_InOut_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ PMO_MEMORY_RANGE_SET Other)
+{
+    if (!Set || !Other)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (Set == Other)
+    {
+        return MoMemoryRangeSetClear(Set);
+    }
+
+    return MoMemoryRangeSetRemoveItems(Set, Other, MO_FALSE);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoMemoryRangeSetIntersect(
+    _Mo_InOut_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ PMO_MEMORY_RANGE_SET Other)
+{
+    if (!Set || !Other)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (Set == Other)
+    {
+        return MO_RESULT_SUCCESS_OK;
+    }
+    if (!Other->Count)
+    {
+        return MoMemoryRangeSetClear(Set);
+    }
+
+    // Remove the gaps of the other range set, including the gaps before the
+    // first range and after the last range.
+    return MoMemoryRangeSetRemoveItems(Set, Other, MO_TRUE);
+}
@@ -0,0 +1,174 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Memory.RangeSet.h
+ * PURPOSE:    Definition for Mobility Memory Range Set
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_MEMORY_RANGESET
+#define MOBILITY_MEMORY_RANGESET
+
+#include <Mile.Mobility.Portable.Types.h>
+
+/**
+ * @brief The half-open address range [Base, Base + Length).
+ */
+typedef struct _MO_MEMORY_RANGE
+{
+    /**
+     * @brief The base address of the range.
+     */
+    MO_UINT64 Base;
+    /**
+     * @brief The length in bytes of the range.
+     */
+    MO_UINT64 Length;
+} MO_MEMORY_RANGE, *PMO_MEMORY_RANGE;
+
+/**
+ * @brief The set of the address ranges, which are kept sorted by the base
+ *        address and coalesced, so no two ranges overlap or are adjacent.
+ * @remarks The ranges are stored in the caller-provided buffer, so the range
+ *          set can be used before any heap is available. The ranges can be
+ *          read directly from the Ranges and Count fields, but they should
+ *          only be modified by the range set functions.
+ */
+typedef struct _MO_MEMORY_RANGE_SET
+{
+    /**
+     * @brief The caller-provided buffer of the ranges.
+     */
+    PMO_MEMORY_RANGE Ranges;
+    /**
+     * @brief The number of the ranges in the set.
+     */
+    MO_UINTN Count;
+    /**
+     * @brief The number of the ranges which can be stored in the buffer.
+     */
+    MO_UINTN Capacity;
+} MO_MEMORY_RANGE_SET, *PMO_MEMORY_RANGE_SET;
+
+/**
+ * @brief Initializes an empty range set on the caller-provided buffer.
+ * @param Set The range set to be initialized.
+ * @param Buffer The buffer to store the ranges, which must remain valid for
+ *               the lifetime of the range set.
+ * @param Capacity The number of the ranges which can be stored in the buffer.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoMemoryRangeSetInitialize(
+    _Mo_Out_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ PMO_MEMORY_RANGE Buffer,
+    _Mo_In_ MO_UINTN Capacity);
+
+/**
+ * @brief Removes all ranges from the range set.
+ * @param Set The range set.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoMemoryRangeSetClear(
+    _Mo_InOut_ PMO_MEMORY_RANGE_SET Set);
+
+/**
+ * @brief Adds the range to the range set, and coalesces it with the
+ *        overlapping and adjacent ranges.
+ * @param Set The range set.
+ * @param Base The base address of the range.
+ * @param Length The length in bytes of the range. Adding an empty range does
+ *               nothing.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the range wraps around the end of the address space, the function
+ *          returns MO_RESULT_ERROR_OUT_OF_BOUNDS. If the range needs a new slot
+ *          and the buffer is full, the function returns
+ *          MO_RESULT_ERROR_OUT_OF_MEMORY and the range set is not modified.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoMemoryRangeSetInsert(
+    _Mo_InOut_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ MO_UINT64 Base,
+    _Mo_In_ MO_UINT64 Length);
+
+/**
+ * @brief Removes the range from the range set, and trims or splits the
+ *        overlapping ranges.
+ * @param Set The range set.
+ * @param Base The base address of the range.
+ * @param Length The length in bytes of the range. Removing an empty range does
+ *               nothing.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the range wraps around the end of the address space, the function
+ *          returns MO_RESULT_ERROR_OUT_OF_BOUNDS. If a range needs to be split
+ *          and the buffer is full, the function returns
+ *          MO_RESULT_ERROR_OUT_OF_MEMORY and the range set is not modified.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoMemoryRangeSetRemove(
+    _Mo_InOut_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ MO_UINT64 Base,
+    _Mo_In_ MO_UINT64 Length);
+
+/**
+ * @brief Queries the range which contains the specified address.
+ * @param Range The pointer to receive the range which contains the address.
+ *              This parameter can be nullptr if only the membership is needed.
+ * @param Set The range set.
+ * @param Address The address to be queried.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If no range contains the address, the function returns
+ *          MO_RESULT_ERROR_NO_INTERFACE.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoMemoryRangeSetQuery(
+    _Mo_Out_Opt_ PMO_MEMORY_RANGE Range,
+    _Mo_In_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ MO_UINT64 Address);
+
+/**
+ * @brief Adds all ranges of another range set to the range set.
+ * @param Set The range set to be updated.
+ * @param Other The range set to be added.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the result does not fit in the buffer, the function returns
+ *          MO_RESULT_ERROR_OUT_OF_MEMORY and the range set is not modified.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoMemoryRangeSetUnion(
+    _Mo_InOut_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ PMO_MEMORY_RANGE_SET Other);
+
+/**
+ * @brief Removes all ranges of another range set from the range set.
+ * @param Set The range set to be updated.
+ * @param Other The range set to be removed.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the result does not fit in the buffer, the function returns
+ *          MO_RESULT_ERROR_OUT_OF_MEMORY and the range set is not modified.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoMemoryRangeSetSubtract(
+    _Mo_InOut_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ PMO_MEMORY_RANGE_SET Other);
+
+/**
+ * @brief Keeps only the parts of the range set which are also covered by
+ *        another range set.
+ * @param Set The range set to be updated.
+ * @param Other The range set to be intersected with.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The intersection is done by removing the gaps of the other range
+ *          set. If the result does not fit in the buffer, the function
+ *          returns MO_RESULT_ERROR_OUT_OF_MEMORY and the range set is not
+ *          modified.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoMemoryRangeSetIntersect(
+    _Mo_InOut_ PMO_MEMORY_RANGE_SET Set,
+    _Mo_In_ PMO_MEMORY_RANGE_SET Other);
+
+#endif // !MOBILITY_MEMORY_RANGESET
@@ -0,0 +1,77 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.ARM64.c
+ * PURPOSE:    Implementation for Mobility Runtime ARM64 Specific Parts
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Platform.Interface.h"
+
+#ifdef _MSC_VER
+
+#ifndef MOBILITY_PLATFORM_ARM64_PRIVATE
+#define MOBILITY_PLATFORM_ARM64_PRIVATE
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+void __yield();
+
+__int64 _ReadStatusReg(int);
+void _WriteStatusReg(int, __int64);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // !MOBILITY_PLATFORM_ARM64_PRIVATE
+
+#endif // _MSC_VER
+
+/**
+ * @brief The encoding of the Interrupt Mask Bits (DAIF) system register for
+ *        _ReadStatusReg and _WriteStatusReg, which is ARM64_SYSREG(3, 3, 4, 2,
+ *        1).
+ */
+#define MO_PLATFORM_ARM64_SYSREG_DAIF 0x5A11
+
+/**
+ * @brief The IRQ mask bit (DAIF.I) of the Interrupt Mask Bits (DAIF) system
+ *        register.
+ *
+ * @remark Arm Architecture Reference Manual for A-profile architecture
+ *         C5.2.2 DAIF, Interrupt Mask Bits
+ */
+#define MO_PLATFORM_ARM64_DAIF_IRQ_MASK 0x80
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformPause()
+{
+    __yield();
+}
+
+MO_EXTERN_C MO_UINTN MOAPI MoPlatformSaveAndDisableInterrupts()
+{
+    MO_UINTN InterruptState =
+        (MO_UINTN)(_ReadStatusReg(MO_PLATFORM_ARM64_SYSREG_DAIF));
+    _WriteStatusReg(
+        MO_PLATFORM_ARM64_SYSREG_DAIF,
+        (__int64)(InterruptState | MO_PLATFORM_ARM64_DAIF_IRQ_MASK));
+    return InterruptState;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformRestoreInterrupts(
+    _Mo_In_ MO_UINTN InterruptState)
+{
+    if (!(InterruptState & MO_PLATFORM_ARM64_DAIF_IRQ_MASK))
+    {
+        MO_UINTN CurrentState =
+            (MO_UINTN)(_ReadStatusReg(MO_PLATFORM_ARM64_SYSREG_DAIF));
+        _WriteStatusReg(
+            MO_PLATFORM_ARM64_SYSREG_DAIF,
+            (__int64)(CurrentState & ~MO_PLATFORM_ARM64_DAIF_IRQ_MASK));
+    }
+}
@@ -47,4 +47,28 @@ MO_EXTERN_C MO_RESULT MOAPI MoPlatformHeapReallocate(
     _Mo_In_Opt_ MO_POINTER Block,
     _Mo_In_ MO_UINTN NewSize);
 
+/**
+ * @brief Hints the current processor that it is in a spin-wait loop.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformPause();
+
+/**
+ * @brief Disables interrupts on the current processor and returns the previous
+ *        interrupt state.
+ * @return The platform-specific interrupt state before disabling interrupts,
+ *         which should be passed to MoPlatformRestoreInterrupts.
+ */
+MO_EXTERN_C MO_UINTN MOAPI MoPlatformSaveAndDisableInterrupts();
+
+/**
+ * @brief Restores the interrupt state of the current processor.
+ * @param InterruptState The interrupt state returned by
+ *                       MoPlatformSaveAndDisableInterrupts.
+ * @remarks Interrupts are only enabled again if they were enabled before the
+ *          paired MoPlatformSaveAndDisableInterrupts call, so the pairs can be
+ *          nested.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformRestoreInterrupts(
+    _Mo_In_ MO_UINTN InterruptState);
+
 #endif // !MOBILITY_PLATFORM_INTERFACE
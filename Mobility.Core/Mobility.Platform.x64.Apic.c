@@ -0,0 +1,536 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.Apic.c
+ * PURPOSE:    Implementation for Mobility x64 Local APIC
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Platform.x64.Apic.h"
+
+#include "Mobility.Platform.x64.Smp.h"
+#include "Mobility.Runtime.Core.h"
+
+#include <Mile.Mobility.Utilities.MemoryAccess.h>
+
+/**
+ * @brief The maximum number of the reads for waiting the previous
+ *        inter-processor interrupt to be accepted in the xAPIC mode.
+ */
+#define MO_PLATFORM_X64_APIC_MAXIMUM_DELIVERY_SPINS 0x100000
+
+MO_FORCEINLINE volatile MO_UINT32* MoPlatformLocalApicGetRegisterAddress(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ MO_UINT32 Offset)
+{
+    return (volatile MO_UINT32*)(MO_UINTN)(Apic->BaseAddress + Offset);
+}
+
+/**
+ * @brief Converts the nanoseconds to the cycles of the specified frequency,
+ *        which saturates at MO_UINT64_MAX.
+ */
+MO_FORCEINLINE MO_UINT64 MoPlatformLocalApicConvertNanosecondsToCycles(
+    _Mo_In_ MO_UINT64 Frequency,
+    _Mo_In_ MO_UINT64 Nanoseconds)
+{
+    MO_UINT64 Seconds = Nanoseconds / MO_TIME_NANOSECONDS_PER_SECOND;
+    MO_UINT64 Remainder = Nanoseconds % MO_TIME_NANOSECONDS_PER_SECOND;
+    if (Seconds > (MO_UINT64_MAX - Frequency) / Frequency)
+    {
+        return MO_UINT64_MAX;
+    }
+    return Seconds * Frequency +
+        (Remainder * Frequency) / MO_TIME_NANOSECONDS_PER_SECOND;
+}
+
+static MO_UINT64 MOAPI MoPlatformLocalApicReadTimerCounter(
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    // The current count counts down, so invert it for the clock source which
+    // is expected to count up.
+    return ~(MO_UINT64)(MoPlatformLocalApicReadRegister(
+        (PMO_PLATFORM_X64_LOCAL_APIC)(Context),
+        MO_PLATFORM_X64_APIC_TIMER_CURRENT_COUNT)) & MO_UINT32_MAX;
+}
+
+static MO_VOID MOAPI MoPlatformLocalApicTimerHandler(
+    _Mo_In_ MO_PLATFORM_X64_INTERRUPT_TYPE InterruptType,
+    _Mo_In_ PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_CONTEXT InterruptContext)
+{
+    MO_UNREFERENCED_PARAMETER(InterruptType);
+    MO_UNREFERENCED_PARAMETER(InterruptContext);
+
+    PMO_PLATFORM_X64_LOCAL_APIC Apic =
+        MoPlatformGetCurrentProcessorBlock()->LocalApic;
+    if (Apic)
+    {
+        ++Apic->TimerInterrupts;
+        if (Apic->TimerRoutine)
+        {
+            Apic->TimerRoutine(Apic->TimerContext);
+        }
+        MoPlatformLocalApicEndOfInterrupt(Apic);
+    }
+}
+
+static MO_VOID MOAPI MoPlatformLocalApicSpuriousHandler(
+    _Mo_In_ MO_PLATFORM_X64_INTERRUPT_TYPE InterruptType,
+    _Mo_In_ PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_CONTEXT InterruptContext)
+{
+    MO_UNREFERENCED_PARAMETER(InterruptType);
+    MO_UNREFERENCED_PARAMETER(InterruptContext);
+
+    // The spurious interrupt is not recorded in the in-service register, so it
+    // must not be acknowledged with the end of interrupt.
+    PMO_PLATFORM_X64_LOCAL_APIC Apic =
+        MoPlatformGetCurrentProcessorBlock()->LocalApic;
+    if (Apic)
+    {
+        ++Apic->SpuriousInterrupts;
+    }
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformLocalApicQueryFeatures(
+    _Mo_Out_Opt_ PMO_BOOL X2ApicSupported,
+    _Mo_Out_Opt_ PMO_BOOL TscDeadlineSupported)
+{
+    if (X2ApicSupported)
+    {
+        *X2ApicSupported = MO_FALSE;
+    }
+    if (TscDeadlineSupported)
+    {
+        *TscDeadlineSupported = MO_FALSE;
+    }
+
+    MO_PLATFORM_X64_CPUID_RESULT CpuidResult;
+
+    // CPUID.01H:EDX.APIC[bit 9], CPUID.01H:ECX.x2APIC[bit 21] and
+    // CPUID.01H:ECX.TSC-Deadline[bit 24]
+    MoPlatformReadCpuid(&CpuidResult, 1);
+    if (!(CpuidResult.Edx & (1u << 9)))
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+    if (X2ApicSupported)
+    {
+        *X2ApicSupported = (CpuidResult.Ecx & (1u << 21)) ? MO_TRUE : MO_FALSE;
+    }
+    if (TscDeadlineSupported)
+    {
+        *TscDeadlineSupported =
+            (CpuidResult.Ecx & (1u << 24)) ? MO_TRUE : MO_FALSE;
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformLocalApicInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ MO_UINT32 Mode,
+    _Mo_In_ MO_UINT8 TimerVector,
+    _Mo_In_ MO_UINT8 SpuriousVector,
+    _Mo_In_ MO_UINT64 TscFrequency)
+{
+    if (!Apic ||
+        Mode > MO_PLATFORM_X64_APIC_MODE_X2APIC ||
+        TimerVector < MO_PLATFORM_X64_INTERRUPT_FIRST_EXTERNAL_VECTOR ||
+        SpuriousVector < MO_PLATFORM_X64_INTERRUPT_FIRST_EXTERNAL_VECTOR ||
+        TimerVector == SpuriousVector)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (MO_RESULT_SUCCESS_OK != MoRuntimeMemoryFillByte(
+        Apic,
+        0,
+        sizeof(MO_PLATFORM_X64_LOCAL_APIC)))
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    MO_BOOL X2ApicSupported = MO_FALSE;
+    MO_BOOL TscDeadlineSupported = MO_FALSE;
+    MO_RESULT Result = MoPlatformLocalApicQueryFeatures(
+        &X2ApicSupported,
+        &TscDeadlineSupported);
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+    if (MO_PLATFORM_X64_APIC_MODE_X2APIC == Mode && !X2ApicSupported)
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    // The x2APIC mode can only be entered from the enabled xAPIC mode, and
+    // leaving it needs disabling the local APIC, so the xAPIC mode is rejected
+    // if the firmware has entered the x2APIC mode.
+    MO_UINT64 ApicBase = MoPlatformReadMsr(MO_PLATFORM_X64_MSR_APIC_BASE);
+    if (MO_PLATFORM_X64_APIC_MODE_XAPIC == Mode &&
+        (ApicBase & MO_PLATFORM_X64_APIC_BASE_X2APIC_ENABLE))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (!(ApicBase & MO_PLATFORM_X64_APIC_BASE_GLOBAL_ENABLE))
+    {
+        ApicBase |= MO_PLATFORM_X64_APIC_BASE_GLOBAL_ENABLE;
+        MoPlatformWriteMsr(MO_PLATFORM_X64_MSR_APIC_BASE, ApicBase);
+    }
+    if (MO_PLATFORM_X64_APIC_MODE_X2APIC == Mode &&
+        !(ApicBase & MO_PLATFORM_X64_APIC_BASE_X2APIC_ENABLE))
+    {
+        ApicBase |= MO_PLATFORM_X64_APIC_BASE_X2APIC_ENABLE;
+        MoPlatformWriteMsr(MO_PLATFORM_X64_MSR_APIC_BASE, ApicBase);
+    }
+    Apic->Mode = Mode;
+    if (MO_PLATFORM_X64_APIC_MODE_XAPIC == Mode)
+    {
+        Apic->BaseAddress = ApicBase & MO_PLATFORM_X64_APIC_BASE_ADDRESS_MASK;
+    }
+
+    Apic->TimerVector = TimerVector;
+    Apic->SpuriousVector = SpuriousVector;
+    if (TscDeadlineSupported && TscFrequency)
+    {
+        Apic->TimerMode = MO_PLATFORM_X64_APIC_TIMER_TSC_DEADLINE;
+        Apic->TimerFrequency = TscFrequency;
+    }
+    else
+    {
+        Apic->TimerMode = MO_PLATFORM_X64_APIC_TIMER_ONE_SHOT;
+    }
+
+    // Accept all interrupt priorities, and keep the timer masked until the
+    // interrupt handlers are installed.
+    MoPlatformLocalApicWriteRegister(
+        Apic,
+        MO_PLATFORM_X64_APIC_TASK_PRIORITY,
+        0u);
+    MoPlatformLocalApicWriteRegister(
+        Apic,
+        MO_PLATFORM_X64_APIC_SPURIOUS_INTERRUPT_VECTOR,
+        MO_PLATFORM_X64_APIC_SOFTWARE_ENABLE | SpuriousVector);
+    MoPlatformLocalApicCancelTimer(Apic);
+    if (MO_PLATFORM_X64_APIC_TIMER_ONE_SHOT == Apic->TimerMode)
+    {
+        MoPlatformLocalApicWriteRegister(
+            Apic,
+            MO_PLATFORM_X64_APIC_TIMER_DIVIDE_CONFIGURATION,
+            MO_PLATFORM_X64_APIC_TIMER_DIVIDE_BY_1);
+    }
+    MoPlatformLocalApicWriteRegister(
+        Apic,
+        MO_PLATFORM_X64_APIC_LVT_TIMER,
+        MO_PLATFORM_X64_APIC_LVT_MASKED | TimerVector | (
+            (MO_PLATFORM_X64_APIC_TIMER_TSC_DEADLINE == Apic->TimerMode)
+            ? MO_PLATFORM_X64_APIC_TIMER_MODE_TSC_DEADLINE
+            : MO_PLATFORM_X64_APIC_TIMER_MODE_ONE_SHOT));
+    if (MO_PLATFORM_X64_APIC_TIMER_TSC_DEADLINE == Apic->TimerMode &&
+        MO_PLATFORM_X64_APIC_MODE_X2APIC != Apic->Mode)
+    {
+        // WRMSR is not ordered with the memory-mapped write to the LVT timer
+        // register in xAPIC mode, so the IA32_TSC_DEADLINE writes may be
+        // ignored before the TSC-deadline mode is enabled.
+        //
+        // Intel(R) 64 and IA-32 Architectures Software Developer's Manual
+        // (December 2023)
+        //   Volume 3 (3A, 3B, 3C, & 3D): System Programming Guide
+        //     11.5.4.1 TSC-Deadline Mode
+        MoPlatformMemoryFence();
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_UINT32 MOAPI MoPlatformLocalApicReadRegister(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ MO_UINT32 Offset)
+{
+    if (MO_PLATFORM_X64_APIC_MODE_X2APIC == Apic->Mode)
+    {
+        return (MO_UINT32)(MoPlatformReadMsr(
+            MO_PLATFORM_X64_MSR_X2APIC_BASE + (Offset >> 4)));
+    }
+
+    MoMileCompilerBarrier();
+    MO_UINT32 Result = *MoPlatformLocalApicGetRegisterAddress(Apic, Offset);
+    MoMileCompilerBarrier();
+    return Result;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformLocalApicWriteRegister(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ MO_UINT32 Offset,
+    _Mo_In_ MO_UINT32 Value)
+{
+    if (MO_PLATFORM_X64_APIC_MODE_X2APIC == Apic->Mode)
+    {
+        MoPlatformWriteMsr(
+            MO_PLATFORM_X64_MSR_X2APIC_BASE + (Offset >> 4),
+            Value);
+        return;
+    }
+
+    MoMileCompilerBarrier();
+    *MoPlatformLocalApicGetRegisterAddress(Apic, Offset) = Value;
+    MoMileCompilerBarrier();
+}
+
+MO_EXTERN_C MO_UINT32 MOAPI MoPlatformLocalApicGetId(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic)
+{
+    MO_UINT32 Id = MoPlatformLocalApicReadRegister(
+        Apic,
+        MO_PLATFORM_X64_APIC_ID);
+    return (MO_PLATFORM_X64_APIC_MODE_X2APIC == Apic->Mode) ? Id : Id >> 24;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformLocalApicEndOfInterrupt(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic)
+{
+    MoPlatformLocalApicWriteRegister(
+        Apic,
+        MO_PLATFORM_X64_APIC_END_OF_INTERRUPT,
+        0u);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformLocalApicSendInterProcessorInterrupt(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ MO_UINT32 DestinationId,
+    _Mo_In_ MO_UINT32 Command)
+{
+    if (!Apic)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    // The x2APIC mode writes the whole 64-bit command with one MSR write, and
+    // there is no delivery status to wait for.
+    if (MO_PLATFORM_X64_APIC_MODE_X2APIC == Apic->Mode)
+    {
+        MoPlatformWriteMsr(
+            MO_PLATFORM_X64_MSR_X2APIC_BASE + (
+                MO_PLATFORM_X64_APIC_INTERRUPT_COMMAND_LOW >> 4),
+            ((MO_UINT64)(DestinationId) << 32) | Command);
+        return MO_RESULT_SUCCESS_OK;
+    }
+
+    if (DestinationId > 0xFF)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MO_UINTN Spins = 0u;
+    while (MoPlatformLocalApicReadRegister(
+        Apic,
+        MO_PLATFORM_X64_APIC_INTERRUPT_COMMAND_LOW) &
+        MO_PLATFORM_X64_APIC_DELIVERY_STATUS_PENDING)
+    {
+        if (++Spins > MO_PLATFORM_X64_APIC_MAXIMUM_DELIVERY_SPINS)
+        {
+            return MO_RESULT_ERROR_UNEXPECTED;
+        }
+        MoPlatformPause();
+    }
+
+    // Writing the lower half sends the interrupt, so write the destination in
+    // the upper half first.
+    MoPlatformLocalApicWriteRegister(
+        Apic,
+        MO_PLATFORM_X64_APIC_INTERRUPT_COMMAND_HIGH,
+        DestinationId << 24);
+    MoPlatformLocalApicWriteRegister(
+        Apic,
+        MO_PLATFORM_X64_APIC_INTERRUPT_COMMAND_LOW,
+        Command);
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformLocalApicCalibrateTimer(
+    _Mo_InOut_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ PMO_TIME_CLOCK_SOURCE Reference,
+    _Mo_In_ MO_UINT64 Nanoseconds)
+{
+    if (!Apic || !Reference)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (MO_PLATFORM_X64_APIC_TIMER_TSC_DEADLINE == Apic->TimerMode)
+    {
+        return MO_RESULT_SUCCESS_OK;
+    }
+
+    MO_TIME_CLOCK_SOURCE Target;
+    if (MO_RESULT_SUCCESS_OK != MoRuntimeMemoryFillByte(
+        &Target,
+        0,
+        sizeof(MO_TIME_CLOCK_SOURCE)))
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+    Target.Read = MoPlatformLocalApicReadTimerCounter;
+    Target.Context = Apic;
+    Target.Mask = MO_UINT32_MAX;
+
+    // Let the masked timer count down from the maximum, so it does not expire
+    // during the measurement.
+    MoPlatformLocalApicWriteRegister(
+        Apic,
+        MO_PLATFORM_X64_APIC_TIMER_INITIAL_COUNT,
+        MO_UINT32_MAX);
+    MO_RESULT Result = MoTimeCalibrateFrequency(
+        &Apic->TimerFrequency,
+        &Target,
+        Reference,
+        Nanoseconds);
+    MoPlatformLocalApicWriteRegister(
+        Apic,
+        MO_PLATFORM_X64_APIC_TIMER_INITIAL_COUNT,
+        0u);
+
+    return Result;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformLocalApicArmTimer(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ MO_UINT64 Nanoseconds)
+{
+    if (!Apic)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (!Apic->TimerFrequency)
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    // Zero disarms the timer in both modes, so the shortest interval is one
+    // cycle.
+    MO_UINT64 Cycles = MoPlatformLocalApicConvertNanosecondsToCycles(
+        Apic->TimerFrequency,
+        Nanoseconds);
+    if (!Cycles)
+    {
+        Cycles = 1u;
+    }
+
+    if (MO_PLATFORM_X64_APIC_TIMER_TSC_DEADLINE == Apic->TimerMode)
+    {
+        MO_UINT64 Now = MoPlatformReadTimeStampCounter();
+        MO_UINT64 Deadline = (Cycles > MO_UINT64_MAX - Now)
+            ? MO_UINT64_MAX
+            : Now + Cycles;
+        MoPlatformWriteMsr(MO_PLATFORM_X64_MSR_TSC_DEADLINE, Deadline);
+    }
+    else
+    {
+        MoPlatformLocalApicWriteRegister(
+            Apic,
+            MO_PLATFORM_X64_APIC_TIMER_INITIAL_COUNT,
+            (Cycles > MO_UINT32_MAX) ? MO_UINT32_MAX : (MO_UINT32)(Cycles));
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformLocalApicCancelTimer(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic)
+{
+    if (MO_PLATFORM_X64_APIC_TIMER_TSC_DEADLINE == Apic->TimerMode)
+    {
+        MoPlatformWriteMsr(MO_PLATFORM_X64_MSR_TSC_DEADLINE, 0u);
+    }
+    else
+    {
+        MoPlatformLocalApicWriteRegister(
+            Apic,
+            MO_PLATFORM_X64_APIC_TIMER_INITIAL_COUNT,
+            0u);
+    }
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformLocalApicInstallHandlers(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_InOut_ PMO_PLATFORM_X64_IDT_GATE_DESCRIPTOR InterruptDescriptorTable,
+    _Mo_InOut_ PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER*
+        LightweightHandlerTable,
+    _Mo_In_ PMO_PLATFORM_X64_APIC_TIMER_ROUTINE TimerRoutine,
+    _Mo_In_Opt_ MO_POINTER TimerContext)
+{
+    if (!Apic ||
+        !InterruptDescriptorTable ||
+        !LightweightHandlerTable ||
+        !TimerRoutine)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    PMO_PLATFORM_X64_PROCESSOR_BLOCK Block =
+        MoPlatformGetCurrentProcessorBlock();
+    if (Block->LocalApic)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    Apic->TimerRoutine = TimerRoutine;
+    Apic->TimerContext = TimerContext;
+    Block->LocalApic = Apic;
+    MoMileCompilerBarrier();
+    LightweightHandlerTable[Apic->TimerVector] =
+        MoPlatformLocalApicTimerHandler;
+    LightweightHandlerTable[Apic->SpuriousVector] =
+        MoPlatformLocalApicSpuriousHandler;
+    MoPlatformSetInterruptEntry(
+        InterruptDescriptorTable,
+        Apic->TimerVector,
+        MO_PLATFORM_X64_INTERRUPT_ENTRY_LIGHTWEIGHT);
+    MoPlatformSetInterruptEntry(
+        InterruptDescriptorTable,
+        Apic->SpuriousVector,
+        MO_PLATFORM_X64_INTERRUPT_ENTRY_LIGHTWEIGHT);
+
+    // Unmask the timer with the mode selected by the initialization.
+    MO_UINT32 Timer = MoPlatformLocalApicReadRegister(
+        Apic,
+        MO_PLATFORM_X64_APIC_LVT_TIMER);
+    MoPlatformLocalApicWriteRegister(
+        Apic,
+        MO_PLATFORM_X64_APIC_LVT_TIMER,
+        Timer & ~MO_PLATFORM_X64_APIC_LVT_MASKED);
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformLocalApicUninstallHandlers(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic)
+{
+    if (!Apic)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    PMO_PLATFORM_X64_PROCESSOR_BLOCK Block =
+        MoPlatformGetCurrentProcessorBlock();
+    if (Block->LocalApic != Apic)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MO_UINT32 Timer = MoPlatformLocalApicReadRegister(
+        Apic,
+        MO_PLATFORM_X64_APIC_LVT_TIMER);
+    MoPlatformLocalApicWriteRegister(
+        Apic,
+        MO_PLATFORM_X64_APIC_LVT_TIMER,
+        Timer | MO_PLATFORM_X64_APIC_LVT_MASKED);
+    MoPlatformLocalApicCancelTimer(Apic);
+
+    MoMileCompilerBarrier();
+    Block->LocalApic = nullptr;
+
+    return MO_RESULT_SUCCESS_OK;
+}
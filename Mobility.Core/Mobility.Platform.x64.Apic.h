@@ -0,0 +1,343 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.Apic.h
+ * PURPOSE:    Definition for Mobility x64 Local APIC
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_PLATFORM_X64_APIC
+#define MOBILITY_PLATFORM_X64_APIC
+
+#include "Mobility.Platform.x64.h"
+#include "Mobility.Time.Core.h"
+
+/*
+ * The Model-Specific Registers (MSRs) used by the local APIC.
+ *
+ * @remark Intel(R) 64 and IA-32 Architectures Software Developer's Manual
+ *         (December 2023)
+ *           Volume 3 (3A, 3B, 3C, & 3D): System Programming Guide
+ *             11.4.4 Local APIC Status and Location
+ *             11.5.4.1 TSC-Deadline Mode
+ *             11.12.1 Detecting and Enabling x2APIC Mode
+ */
+
+#define MO_PLATFORM_X64_MSR_APIC_BASE 0x1B
+#define MO_PLATFORM_X64_MSR_TSC_DEADLINE 0x6E0
+#define MO_PLATFORM_X64_MSR_X2APIC_BASE 0x800
+
+#define MO_PLATFORM_X64_APIC_BASE_BOOTSTRAP_PROCESSOR 0x100ULL
+#define MO_PLATFORM_X64_APIC_BASE_X2APIC_ENABLE 0x400ULL
+#define MO_PLATFORM_X64_APIC_BASE_GLOBAL_ENABLE 0x800ULL
+#define MO_PLATFORM_X64_APIC_BASE_ADDRESS_MASK 0x000FFFFFFFFFF000ULL
+
+/*
+ * The offsets of the local APIC registers in the xAPIC mode. The x2APIC mode
+ * uses the MSR at MO_PLATFORM_X64_MSR_X2APIC_BASE + (Offset >> 4) instead.
+ *
+ * @remark Intel(R) 64 and IA-32 Architectures Software Developer's Manual
+ *         (December 2023)
+ *           Volume 3 (3A, 3B, 3C, & 3D): System Programming Guide
+ *             Table 11-1. Local APIC Register Address Map
+ */
+
+#define MO_PLATFORM_X64_APIC_ID 0x020
+#define MO_PLATFORM_X64_APIC_VERSION 0x030
+#define MO_PLATFORM_X64_APIC_TASK_PRIORITY 0x080
+#define MO_PLATFORM_X64_APIC_END_OF_INTERRUPT 0x0B0
+#define MO_PLATFORM_X64_APIC_SPURIOUS_INTERRUPT_VECTOR 0x0F0
+#define MO_PLATFORM_X64_APIC_ERROR_STATUS 0x280
+#define MO_PLATFORM_X64_APIC_INTERRUPT_COMMAND_LOW 0x300
+#define MO_PLATFORM_X64_APIC_INTERRUPT_COMMAND_HIGH 0x310
+#define MO_PLATFORM_X64_APIC_LVT_TIMER 0x320
+#define MO_PLATFORM_X64_APIC_LVT_LINT0 0x350
+#define MO_PLATFORM_X64_APIC_LVT_LINT1 0x360
+#define MO_PLATFORM_X64_APIC_LVT_ERROR 0x370
+#define MO_PLATFORM_X64_APIC_TIMER_INITIAL_COUNT 0x380
+#define MO_PLATFORM_X64_APIC_TIMER_CURRENT_COUNT 0x390
+#define MO_PLATFORM_X64_APIC_TIMER_DIVIDE_CONFIGURATION 0x3E0
+
+/*
+ * The bits of the local APIC registers.
+ */
+
+#define MO_PLATFORM_X64_APIC_SOFTWARE_ENABLE 0x100
+#define MO_PLATFORM_X64_APIC_LVT_MASKED 0x10000
+#define MO_PLATFORM_X64_APIC_TIMER_MODE_ONE_SHOT 0x00000
+#define MO_PLATFORM_X64_APIC_TIMER_MODE_PERIODIC 0x20000
+#define MO_PLATFORM_X64_APIC_TIMER_MODE_TSC_DEADLINE 0x40000
+#define MO_PLATFORM_X64_APIC_TIMER_DIVIDE_BY_1 0xB
+#define MO_PLATFORM_X64_APIC_DELIVERY_STATUS_PENDING 0x1000
+
+/*
+ * The default vectors of the local APIC interrupts. The spurious vector must
+ * have the lower 4 bits set on the P6 family and Pentium processors.
+ */
+
+#define MO_PLATFORM_X64_APIC_DEFAULT_TIMER_VECTOR 0xEF
+#define MO_PLATFORM_X64_APIC_DEFAULT_SPURIOUS_VECTOR 0xFF
+
+/*
+ * The modes of the local APIC and its timer.
+ */
+
+#define MO_PLATFORM_X64_APIC_MODE_XAPIC 0
+#define MO_PLATFORM_X64_APIC_MODE_X2APIC 1
+
+#define MO_PLATFORM_X64_APIC_TIMER_ONE_SHOT 0
+#define MO_PLATFORM_X64_APIC_TIMER_TSC_DEADLINE 1
+
+/**
+ * @brief The prototype for the routine called on the local APIC timer
+ *        interrupt.
+ * @param Context The user-defined context of the timer.
+ * @remark The routine runs in the lightweight interrupt entry tier with the
+ *         interrupts disabled, so it must not use the FPU or SIMD instructions.
+ *         It may arm the timer again for the next event.
+ */
+typedef MO_VOID(MOAPI* PMO_PLATFORM_X64_APIC_TIMER_ROUTINE)(
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief The local APIC of the current processor.
+ */
+typedef struct _MO_PLATFORM_X64_LOCAL_APIC
+{
+    /**
+     * @brief The base address of the xAPIC registers, which is zero in the
+     *        x2APIC mode.
+     */
+    MO_UINT64 BaseAddress;
+    /**
+     * @brief The MO_PLATFORM_X64_APIC_MODE_* mode of the local APIC.
+     */
+    MO_UINT32 Mode;
+    /**
+     * @brief The MO_PLATFORM_X64_APIC_TIMER_* mode of the local APIC timer.
+     */
+    MO_UINT32 TimerMode;
+    /**
+     * @brief The vector of the local APIC timer interrupt.
+     */
+    MO_UINT8 TimerVector;
+    /**
+     * @brief The vector of the spurious interrupt.
+     */
+    MO_UINT8 SpuriousVector;
+    MO_UINT8 Reserved[6];
+    /**
+     * @brief The frequency in Hz of the timer counter, which is the frequency
+     *        of the Time Stamp Counter (TSC) in the TSC-deadline mode.
+     */
+    MO_UINT64 TimerFrequency;
+    /**
+     * @brief The routine called on the timer interrupt.
+     */
+    PMO_PLATFORM_X64_APIC_TIMER_ROUTINE TimerRoutine;
+    /**
+     * @brief The user-defined context passed to the timer routine.
+     */
+    MO_POINTER TimerContext;
+    /**
+     * @brief The number of the timer interrupts handled.
+     */
+    MO_UINT64 TimerInterrupts;
+    /**
+     * @brief The number of the spurious interrupts handled.
+     */
+    MO_UINT64 SpuriousInterrupts;
+} MO_PLATFORM_X64_LOCAL_APIC, *PMO_PLATFORM_X64_LOCAL_APIC;
+
+/**
+ * @brief Queries the local APIC features of the current processor without
+ *        changing its state.
+ * @param X2ApicSupported The pointer to receive whether the x2APIC mode is
+ *                        supported.
+ * @param TscDeadlineSupported The pointer to receive whether the TSC-deadline
+ *                             timer mode is supported.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the local APIC is not reported by CPUID.01H:EDX.APIC[bit 9], the
+ *          function returns MO_RESULT_ERROR_NO_INTERFACE.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformLocalApicQueryFeatures(
+    _Mo_Out_Opt_ PMO_BOOL X2ApicSupported,
+    _Mo_Out_Opt_ PMO_BOOL TscDeadlineSupported);
+
+/**
+ * @brief Initializes the local APIC of the current processor in the specified
+ *        mode, enables the local APIC with the specified spurious vector and
+ *        masks the timer.
+ * @param Apic The local APIC to be initialized.
+ * @param Mode The MO_PLATFORM_X64_APIC_MODE_* mode of the local APIC. The
+ *             x2APIC mode is entered if it is not entered yet.
+ * @param TimerVector The vector of the timer interrupt.
+ * @param SpuriousVector The vector of the spurious interrupt.
+ * @param TscFrequency The frequency in Hz of the invariant Time Stamp Counter
+ *                     (TSC). If it is zero or the TSC-deadline mode is not
+ *                     supported, the one-shot mode is used, and the timer must
+ *                     be calibrated with MoPlatformLocalApicCalibrateTimer.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The local APIC is owned by the firmware before exiting the boot
+ *          services, so this function should only be called after that, or
+ *          with the mode used by the firmware if the caller restores the
+ *          firmware configuration. The function returns
+ *          MO_RESULT_ERROR_NO_INTERFACE if the x2APIC mode is requested but
+ *          not supported, and MO_RESULT_ERROR_INVALID_PARAMETER if the xAPIC
+ *          mode is requested but the x2APIC mode is already entered.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformLocalApicInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ MO_UINT32 Mode,
+    _Mo_In_ MO_UINT8 TimerVector,
+    _Mo_In_ MO_UINT8 SpuriousVector,
+    _Mo_In_ MO_UINT64 TscFrequency);
+
+/**
+ * @brief Reads the specified local APIC register.
+ * @param Apic The local APIC.
+ * @param Offset The MO_PLATFORM_X64_APIC_* offset of the register.
+ * @return The value of the register.
+ */
+MO_EXTERN_C MO_UINT32 MOAPI MoPlatformLocalApicReadRegister(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ MO_UINT32 Offset);
+
+/**
+ * @brief Writes a value to the specified local APIC register.
+ * @param Apic The local APIC.
+ * @param Offset The MO_PLATFORM_X64_APIC_* offset of the register.
+ * @param Value The value to write to the register.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformLocalApicWriteRegister(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ MO_UINT32 Offset,
+    _Mo_In_ MO_UINT32 Value);
+
+/**
+ * @brief Acquires the local APIC ID of the current processor.
+ * @param Apic The local APIC.
+ * @return The 8-bit xAPIC ID or the 32-bit x2APIC ID.
+ */
+MO_EXTERN_C MO_UINT32 MOAPI MoPlatformLocalApicGetId(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic);
+
+/**
+ * @brief Signals the end of the interrupt being serviced.
+ * @param Apic The local APIC.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformLocalApicEndOfInterrupt(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic);
+
+/**
+ * @brief Sends an inter-processor interrupt (IPI).
+ * @param Apic The local APIC.
+ * @param DestinationId The local APIC ID of the destination processor, which is
+ *                      ignored if the command specifies a destination
+ *                      shorthand.
+ * @param Command The lower 32 bits of the Interrupt Command Register (ICR),
+ *                which specify the vector, the delivery mode, the level and
+ *                the destination shorthand.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks In the xAPIC mode, the function waits for the previous IPI to be
+ *          accepted before sending the new one, and returns
+ *          MO_RESULT_ERROR_INVALID_PARAMETER if the destination does not fit in
+ *          8 bits.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformLocalApicSendInterProcessorInterrupt(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ MO_UINT32 DestinationId,
+    _Mo_In_ MO_UINT32 Command);
+
+/**
+ * @brief Measures the frequency of the one-shot timer counter against a
+ *        reference clock source.
+ * @param Apic The local APIC in the one-shot timer mode.
+ * @param Reference The initialized reference clock source.
+ * @param Nanoseconds The duration in nanoseconds of each measurement, which
+ *                    should be short enough for the 32-bit counter not to
+ *                    expire, e.g. 10 milliseconds.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks In the TSC-deadline mode, the function does nothing and returns
+ *          MO_RESULT_SUCCESS_OK.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformLocalApicCalibrateTimer(
+    _Mo_InOut_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ PMO_TIME_CLOCK_SOURCE Reference,
+    _Mo_In_ MO_UINT64 Nanoseconds);
+
+/**
+ * @brief Arms the timer to raise one interrupt after the specified interval,
+ *        which replaces the previous armed interval.
+ * @param Apic The local APIC.
+ * @param Nanoseconds The interval in nanoseconds.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks There is no periodic tick, and the idle loop should disable the
+ *          interrupts, arm the timer for the next pending event, and call
+ *          MoPlatformEnableInterruptsAndHalt if there is still no work.
+ *          The interval is clamped to the 32-bit counter in the one-shot mode,
+ *          so the routine should arm the timer again if the event is not due.
+ *          If the timer frequency is unknown, the function returns
+ *          MO_RESULT_ERROR_NO_INTERFACE.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformLocalApicArmTimer(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ MO_UINT64 Nanoseconds);
+
+/**
+ * @brief Cancels the armed timer interval.
+ * @param Apic The local APIC.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformLocalApicCancelTimer(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic);
+
+/**
+ * @brief Installs the timer and the spurious interrupt handlers in the
+ *        lightweight interrupt entry tier, and unmasks the timer of the current
+ *        processor.
+ * @param Apic The local APIC of the current processor, which is recorded in
+ *             its processor block for the interrupt handlers.
+ * @param InterruptDescriptorTable The Interrupt Descriptor Table (IDT) whose
+ *                                 gates of both vectors are updated.
+ * @param LightweightHandlerTable The lightweight interrupt handler table which
+ *                                is also used as
+ *                                MoPlatformLightweightInterruptHandlerTable.
+ * @param TimerRoutine The routine called on the timer interrupt.
+ * @param TimerContext The user-defined context passed to the timer routine.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The GS base of the current processor must point to its processor
+ *          block. The function is called once on each processor, and only one
+ *          local APIC can be installed on each processor. The handlers are
+ *          shared by all processors, so the same vectors must be used.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformLocalApicInstallHandlers(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_InOut_ PMO_PLATFORM_X64_IDT_GATE_DESCRIPTOR InterruptDescriptorTable,
+    _Mo_InOut_ PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER*
+        LightweightHandlerTable,
+    _Mo_In_ PMO_PLATFORM_X64_APIC_TIMER_ROUTINE TimerRoutine,
+    _Mo_In_Opt_ MO_POINTER TimerContext);
+
+/**
+ * @brief Masks and cancels the timer of the current processor, and removes
+ *        the local APIC from its processor block.
+ * @param Apic The local APIC installed by MoPlatformLocalApicInstallHandlers on
+ *             the current processor.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The handlers are kept in the handler table because other processors
+ *          may still use them, so the caller restores the IDT gates of both
+ *          vectors if they are returned to another owner.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformLocalApicUninstallHandlers(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic);
+
+#endif // !MOBILITY_PLATFORM_X64_APIC
@@ -8,6 +8,21 @@
 ; MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
 ;
 
+;
+; Define MO_PLATFORM_X64_INTERRUPT_STATISTICS as 1 to make the interrupt entry
+; points record the interrupt statistics, which must match the definition in
+; Mobility.Platform.x64.InterruptStatistics.h.
+;
+IFNDEF MO_PLATFORM_X64_INTERRUPT_STATISTICS
+MO_PLATFORM_X64_INTERRUPT_STATISTICS EQU 0
+ENDIF
+
+IF MO_PLATFORM_X64_INTERRUPT_STATISTICS
+EXTERN MoPlatformInterruptStatisticsRecord:PROC
+ENDIF
+
+EXTERN MoPlatformSystemCallDispatch:PROC
+
 .CODE
 
 ; -----------------------------------------------------------------------------
@@ -26,6 +41,43 @@ MoPlatformEnableInterrupts PROC
     ret
 MoPlatformEnableInterrupts ENDP
 
+; -----------------------------------------------------------------------------
+; MO_EXTERN_C MO_UINTN MOAPI MoPlatformSaveAndDisableInterrupts();
+; -----------------------------------------------------------------------------
+MoPlatformSaveAndDisableInterrupts PROC
+    pushfq
+    pop rax
+    cli
+    ret
+MoPlatformSaveAndDisableInterrupts ENDP
+
+; -----------------------------------------------------------------------------
+; MO_EXTERN_C MO_VOID MOAPI MoPlatformRestoreInterrupts(
+;     _Mo_In_ MO_UINTN InterruptState);
+; -----------------------------------------------------------------------------
+MoPlatformRestoreInterrupts PROC
+    ; RCX = InterruptState
+
+    ; Only enable interrupts if the interrupt flag (IF, bit 9) was set, so the
+    ; nested save and restore pairs keep interrupts disabled.
+    test rcx, 200h
+    jz SkipEnableInterrupts
+    sti
+SkipEnableInterrupts:
+    ret
+MoPlatformRestoreInterrupts ENDP
+
+; -----------------------------------------------------------------------------
+; MO_EXTERN_C MO_VOID MOAPI MoPlatformEnableInterruptsAndHalt();
+; -----------------------------------------------------------------------------
+MoPlatformEnableInterruptsAndHalt PROC
+    ; The interrupts are not recognized until the instruction after STI is
+    ; executed, so no interrupt can be lost between STI and HLT.
+    sti
+    hlt
+    ret
+MoPlatformEnableInterruptsAndHalt ENDP
+
 ; -----------------------------------------------------------------------------
 ; MO_EXTERN_C MO_VOID MOAPI MoPlatformLoadGlobalDescriptorTable(
 ;     _Mo_In_ PMO_PLATFORM_X64_PSEUDO_DESCRIPTOR Descriptor);
@@ -113,6 +165,278 @@ HaltLoop:
     jmp HaltLoop
 MoPlatformSwitchToNewStack ENDP
 
+; -----------------------------------------------------------------------------
+; MO_EXTERN_C MO_VOID MOAPI MoPlatformFiberSwitchContext(
+;     _Mo_Out_ PMO_UINT64 CurrentStackPointer,
+;     _Mo_In_ MO_UINT64 NextStackPointer);
+; -----------------------------------------------------------------------------
+; Only the callee-saved registers of the Microsoft x64 calling convention are
+; saved, because the switch is always a function call. The layout must match
+; MO_PLATFORM_X64_FIBER_SAVED_CONTEXT in Mobility.Platform.x64.Fiber.c.
+MoPlatformFiberSwitchContext PROC
+    ; RCX = CurrentStackPointer
+    ; RDX = NextStackPointer
+
+    push rbp
+    push rbx
+    push rdi
+    push rsi
+    push r12
+    push r13
+    push r14
+    push r15
+
+    ; The stack is 16-byte aligned after reserving the space, which is needed
+    ; by MOVAPS.
+    sub rsp, 0A8h
+    movaps xmmword ptr [rsp + 00h], xmm6
+    movaps xmmword ptr [rsp + 10h], xmm7
+    movaps xmmword ptr [rsp + 20h], xmm8
+    movaps xmmword ptr [rsp + 30h], xmm9
+    movaps xmmword ptr [rsp + 40h], xmm10
+    movaps xmmword ptr [rsp + 50h], xmm11
+    movaps xmmword ptr [rsp + 60h], xmm12
+    movaps xmmword ptr [rsp + 70h], xmm13
+    movaps xmmword ptr [rsp + 80h], xmm14
+    movaps xmmword ptr [rsp + 90h], xmm15
+    stmxcsr dword ptr [rsp + 0A0h]
+    fnstcw word ptr [rsp + 0A4h]
+
+    ; Switch the stack.
+    mov [rcx], rsp
+    mov rsp, rdx
+
+    fldcw word ptr [rsp + 0A4h]
+    ldmxcsr dword ptr [rsp + 0A0h]
+    movaps xmm6, xmmword ptr [rsp + 00h]
+    movaps xmm7, xmmword ptr [rsp + 10h]
+    movaps xmm8, xmmword ptr [rsp + 20h]
+    movaps xmm9, xmmword ptr [rsp + 30h]
+    movaps xmm10, xmmword ptr [rsp + 40h]
+    movaps xmm11, xmmword ptr [rsp + 50h]
+    movaps xmm12, xmmword ptr [rsp + 60h]
+    movaps xmm13, xmmword ptr [rsp + 70h]
+    movaps xmm14, xmmword ptr [rsp + 80h]
+    movaps xmm15, xmmword ptr [rsp + 90h]
+    add rsp, 0A8h
+
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rsi
+    pop rdi
+    pop rbx
+    pop rbp
+    ret
+MoPlatformFiberSwitchContext ENDP
+
+; -----------------------------------------------------------------------------
+; MO_EXTERN_C MO_VOID MOAPI MoPlatformFiberStartThunk();
+; -----------------------------------------------------------------------------
+; The first saved return address of a new fiber, which is reached with the
+; registers restored from the initial context built by MoPlatformFiberCreate.
+MoPlatformFiberStartThunk PROC
+    ; RBX = Fiber
+    ; R12 = Entry routine of the fiber
+
+    ; Reserve space for register parameters (rcx, rdx, r8 & r9) on the stack,
+    ; in case the callee wishes to spill them.
+    mov rcx, rbx
+    sub rsp, 20h
+    call r12
+
+    ; The entry routine never returns because it switches back to the caller
+    ; of the fiber.
+    cli
+FiberHaltLoop:
+    hlt
+    jmp FiberHaltLoop
+MoPlatformFiberStartThunk ENDP
+
+; -----------------------------------------------------------------------------
+; MO_EXTERN_C MO_VOID MOAPI MoPlatformSystemCallEntry();
+; -----------------------------------------------------------------------------
+; The entry point of SYSCALL, which saves the registers as the
+; MO_PLATFORM_X64_SYSTEM_CALL_FRAME structure on the kernel stack of the
+; processor block, calls MoPlatformSystemCallDispatch and returns with SYSRET.
+;
+; The offsets in the MO_PLATFORM_X64_PROCESSOR_BLOCK structure:
+;   10h: KernelStackTop
+;   20h: SystemCallUserStackPointer
+MoPlatformSystemCallEntry PROC
+    ; RAX = System call number
+    ; RDI, RSI, RDX, R10, R8, R9 = Arguments
+    ; RCX = Return address
+    ; R11 = Saved RFLAGS
+    ; The interrupts are disabled by MO_PLATFORM_X64_SYSTEM_CALL_FLAGS_MASK.
+
+    swapgs
+    mov qword ptr gs:[20h], rsp
+    mov rsp, qword ptr gs:[10h]
+
+    ; MO_UINT8 Xmm0[16], ..., Xmm5[16];
+    ; MO_UINT32 MxCsr, Reserved0;
+    ; MO_UINT64 Cr0;
+    ; The kernel stack top is 16-byte aligned, so the XMM registers are 16-byte
+    ; aligned.
+
+    sub rsp, 6 * 16 + 16
+
+    ; MO_UINT64 Rsp, RFlags, Rip;
+    push qword ptr gs:[20h]
+    push r11
+    push rcx
+
+    ; MO_UINT64 Arguments[6];
+    push r9
+    push r8
+    push r10
+    push rdx
+    push rsi
+    push rdi
+
+    ; MO_UINT64 Number;
+    push rax
+
+    ; Clear CR0.TS, so saving the XMM registers or using them in the handler
+    ; does not raise #NM when the lazy FPU state switching is pending. The
+    ; saved CR0 is restored on the way out, and the registers saved here always
+    ; belong to the current owner of the state.
+    mov rax, cr0
+    mov qword ptr [rsp + 10 * 8 + 6 * 16 + 8], rax
+    test rax, 8 ; CR0.TS
+    jz SystemCallTaskSwitchedCleared
+    clts
+SystemCallTaskSwitchedCleared:
+
+    movaps xmmword ptr [rsp + 10 * 8 + 0 * 16], xmm0
+    movaps xmmword ptr [rsp + 10 * 8 + 1 * 16], xmm1
+    movaps xmmword ptr [rsp + 10 * 8 + 2 * 16], xmm2
+    movaps xmmword ptr [rsp + 10 * 8 + 3 * 16], xmm3
+    movaps xmmword ptr [rsp + 10 * 8 + 4 * 16], xmm4
+    movaps xmmword ptr [rsp + 10 * 8 + 5 * 16], xmm5
+    stmxcsr dword ptr [rsp + 10 * 8 + 6 * 16]
+
+    ; 10 registers are pushed after the 16-byte aligned XMM area, so only the
+    ; space for register parameters is needed.
+    sti
+    cld
+    mov rcx, rsp
+    sub rsp, 20h
+    call MoPlatformSystemCallDispatch
+    add rsp, 20h
+    cli
+
+    ; RAX = Result
+    ldmxcsr dword ptr [rsp + 10 * 8 + 6 * 16]
+    movaps xmm0, xmmword ptr [rsp + 10 * 8 + 0 * 16]
+    movaps xmm1, xmmword ptr [rsp + 10 * 8 + 1 * 16]
+    movaps xmm2, xmmword ptr [rsp + 10 * 8 + 2 * 16]
+    movaps xmm3, xmmword ptr [rsp + 10 * 8 + 3 * 16]
+    movaps xmm4, xmmword ptr [rsp + 10 * 8 + 4 * 16]
+    movaps xmm5, xmmword ptr [rsp + 10 * 8 + 5 * 16]
+
+    ; Set CR0.TS again if it was set when SYSCALL was executed.
+    mov rcx, qword ptr [rsp + 10 * 8 + 6 * 16 + 8]
+    test rcx, 8 ; CR0.TS
+    jz SystemCallTaskSwitchedRestored
+    mov cr0, rcx
+SystemCallTaskSwitchedRestored:
+
+    add rsp, 8
+    pop rdi
+    pop rsi
+    pop rdx
+    pop r10
+    pop r8
+    pop r9
+
+    ; SYSRET raises #GP in the kernel mode with the user stack if RCX is not
+    ; canonical (CVE-2012-0217), and SYSCALL at the end of the lower half
+    ; returns to a non-canonical address. So return with IRETQ if the return
+    ; address is not in the lower half, which faults on the kernel stack.
+    mov rcx, qword ptr [rsp]
+    shr rcx, 47
+    jnz SystemCallReturnWithIretq
+
+    pop rcx
+    pop r11
+    pop rsp
+
+    swapgs
+    sysretq
+
+SystemCallReturnWithIretq:
+    ; Rewrite Rip, RFlags and Rsp as the IRETQ frame, whose SS and CS are
+    ; MO_PLATFORM_X64_SEGMENT_USER_DATA and MO_PLATFORM_X64_SEGMENT_USER_CODE
+    ; with RPL 3. The XMM area is no longer used.
+    mov rcx, qword ptr [rsp + 16]
+    mov r11, qword ptr [rsp + 8]
+    mov qword ptr [rsp + 32], 1Bh
+    mov qword ptr [rsp + 24], rcx
+    mov qword ptr [rsp + 16], r11
+    mov qword ptr [rsp + 8], 23h
+    mov rcx, qword ptr [rsp]
+    jmp MoPlatformUserModeReturn
+MoPlatformSystemCallEntry ENDP
+
+; -----------------------------------------------------------------------------
+; MO_EXTERN_C MO_VOID MOAPI MoPlatformEnterUserMode(
+;     _In_ MO_UINT64 Rip,
+;     _In_ MO_UINT64 Rsp,
+;     _In_ MO_UINT64 RFlags);
+; -----------------------------------------------------------------------------
+MoPlatformEnterUserMode PROC
+    cli
+
+    ; Clear IOPL and NT, and set IF and the reserved bit 1.
+    and r8d, 0FFFF8FFFh
+    or r8d, 202h
+
+    ; The IRETQ frame, whose SS and CS are MO_PLATFORM_X64_SEGMENT_USER_DATA
+    ; and MO_PLATFORM_X64_SEGMENT_USER_CODE with RPL 3.
+    push 1Bh
+    push rdx
+    push r8
+    push 23h
+    push rcx
+
+    ; Do not leak the kernel values to the user mode.
+    xor eax, eax
+    xor ebx, ebx
+    xor ecx, ecx
+    xor edx, edx
+    xor esi, esi
+    xor edi, edi
+    xor ebp, ebp
+    xor r8d, r8d
+    xor r9d, r9d
+    xor r10d, r10d
+    xor r11d, r11d
+    xor r12d, r12d
+    xor r13d, r13d
+    xor r14d, r14d
+    xor r15d, r15d
+
+    jmp MoPlatformUserModeReturn
+MoPlatformEnterUserMode ENDP
+
+; -----------------------------------------------------------------------------
+; MoPlatformUserModeReturn
+; -----------------------------------------------------------------------------
+; Swaps to the user GS base and returns to the user mode with the IRETQ frame
+; on the stack. If IRETQ faults, such as for a non-canonical return address,
+; the fault arrives in the kernel mode with the user GS base, so the common
+; interrupt entry also swaps the GS base for the faults at
+; MoPlatformUserModeReturnIretq. The handler of such a fault must not return
+; to the same IRETQ unchanged, or it faults again.
+MoPlatformUserModeReturn PROC
+    swapgs
+MoPlatformUserModeReturnIretq::
+    iretq
+MoPlatformUserModeReturn ENDP
+
 .DATA
 
 ALIGN 8
@@ -186,6 +510,18 @@ MoPlatformInterruptCommonEntry PROC PUBLIC FRAME
     push rsi
     push rdi
 
+    ; Swap to the GS base of the processor block if the interrupt arrives in
+    ; the user mode, or at the IRETQ which returns to the user mode after
+    ; swapping to the user GS base.
+    test byte ptr [rbp + 32], 3 ; CS.RPL
+    jnz CommonEntrySwapGs
+    lea rax, MoPlatformUserModeReturnIretq
+    cmp rax, qword ptr [rbp + 24]
+    jne CommonEntryGsSwapped
+CommonEntrySwapGs:
+    swapgs
+CommonEntryGsSwapped:
+
     ; MO_UINT64 Gs, Fs, Es, Ds, Cs, Ss;
     ;insure high 16 bits of each is zero
 
@@ -268,6 +604,11 @@ MoPlatformInterruptCommonEntry PROC PUBLIC FRAME
 
     ; MO_PLATFORM_X64_FXSAVE_AREA FxSaveState;
 
+    ; Clear CR0.TS, so FXSAVE does not raise #NM when the lazy FPU state
+    ; switching is pending. The saved CR0 is restored on the way out, and the
+    ; registers saved here always belong to the current owner of the state.
+    clts
+
     sub rsp, 512
     mov rcx, rsp
     fxsave [rcx]
@@ -278,6 +619,15 @@ MoPlatformInterruptCommonEntry PROC PUBLIC FRAME
     ; MO_UINT32 ExceptionData;
     push qword ptr [rbp + 16]
 
+IF MO_PLATFORM_X64_INTERRUPT_STATISTICS
+    ; Keep the Time Stamp Counter before calling the handler in R12, which is
+    ; preserved by the handler and restored from the saved context later.
+    rdtsc
+    shl rdx, 32
+    or rax, rdx
+    mov r12, rax
+ENDIF
+
     ; Call into exception handler
     movzx rcx, byte ptr [rbp + 8]
     mov rax, qword ptr [MoPlatformInterruptHandlerTable]
@@ -301,6 +651,15 @@ SkipCallInterruptHandler:
     ; BUGBUG: This should not be necessary, but it's currently true that
     ; interrupt handlers enable interrupts
     cli
+
+IF MO_PLATFORM_X64_INTERRUPT_STATISTICS
+    movzx rcx, byte ptr [rbp + 8]
+    mov rdx, r12
+    sub rsp, 4 * 8 + 8
+    call MoPlatformInterruptStatisticsRecord
+    add rsp, 4 * 8 + 8
+ENDIF
+
     ; MO_UINT64 ExceptionData;
     add rsp, 8
 
@@ -352,6 +711,17 @@ SkipCallInterruptHandler:
     pop qword ptr [rbp + 32] ; cs for iretq
     pop qword ptr [rbp + 56] ; ss for iretq
 
+    ; Swap back to the user GS base under the same conditions as the entry,
+    ; which are checked against the returned context.
+    test byte ptr [rbp + 32], 3 ; CS.RPL
+    jnz CommonExitSwapGs
+    lea rax, MoPlatformUserModeReturnIretq
+    cmp rax, qword ptr [rbp + 24]
+    jne CommonExitGsSwapped
+CommonExitSwapGs:
+    swapgs
+CommonExitGsSwapped:
+
     ; MO_UINT64 Rdi, Rsi, Rbp, Rsp, Rbx, Rdx, Rcx, Rax;
     ; MO_UINT64 R8, R9, R10, R11, R12, R13, R14, R15;
 
@@ -439,4 +809,302 @@ ALIGN 8
 Vector = Vector + 1
 ENDM
 
+.DATA
+
+ALIGN 8
+; -----------------------------------------------------------------------------
+; MO_EXTERN_C PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER*
+;     MoPlatformLightweightInterruptHandlerTable;
+; -----------------------------------------------------------------------------
+; The length of the pointed interrupt handler table must be 256 entries.
+PUBLIC MoPlatformLightweightInterruptHandlerTable
+MoPlatformLightweightInterruptHandlerTable QWORD 0
+
+.CODE
+
+; -----------------------------------------------------------------------------
+; MoPlatformInterruptLightweightEntry
+; -----------------------------------------------------------------------------
+; The lightweight interrupt routine for the hardware interrupts and the
+; inter-processor interrupts. Only the volatile registers of the x64 calling
+; convention are saved, which are the volatile general-purpose registers,
+; XMM0-XMM5 and MXCSR, because the non-volatile registers are preserved by the
+; handler itself. The handler must not use the x87 or MMX registers, and must
+; not modify the interrupted context other than the saved volatile registers.
+MoPlatformInterruptLightweightEntry PROC PUBLIC FRAME
+    .PUSHFRAME CODE
+    .ALLOCSTACK 8
+
+    ; All interrupt handlers are invoked through interrupt gates, so IF flag
+    ; automatically cleared at the entry point
+
+    push rbp
+    .PUSHREG rbp
+    mov rbp, rsp
+    .SETFRAME rbp, 0
+    .ENDPROLOG
+
+    ; Stack:
+    ; +---------------------+ <-- 16-byte aligned ensured by processor
+    ; +    Old SS           +
+    ; +---------------------+
+    ; +    Old RSP          +
+    ; +---------------------+
+    ; +    RFlags           +
+    ; +---------------------+
+    ; +    CS               +
+    ; +---------------------+
+    ; +    RIP              +
+    ; +---------------------+
+    ; +    Error Code       +
+    ; +---------------------+
+    ; +    Vector Number    +
+    ; +---------------------+
+    ; +    RBP              +
+    ; +---------------------+ <-- RBP, 16-byte aligned
+
+    ; Swap to the GS base of the processor block if the interrupt arrives in
+    ; the user mode. The lightweight tier is not used for the exceptions, so
+    ; it never handles a fault at MoPlatformUserModeReturnIretq.
+    test byte ptr [rbp + 32], 3 ; CS.RPL
+    jz LightweightEntryGsSwapped
+    swapgs
+LightweightEntryGsSwapped:
+
+    ; MO_UINT64 R11, R10, R9, R8, Rdx, Rcx, Rax;
+
+    push rax
+    push rcx
+    push rdx
+    push r8
+    push r9
+    push r10
+    push r11
+
+    ; MO_UINT8 Xmm0[16], ..., Xmm5[16];
+    ; MO_UINT32 MxCsr, Reserved0;
+    ; MO_UINT64 Cr0, Reserved1;
+    ; 7 registers are pushed above, so the 8 bytes of Reserved1 make the XMM
+    ; registers 16-byte aligned.
+
+    sub rsp, 6 * 16 + 3 * 8
+
+    ; Clear CR0.TS, so saving the XMM registers or using them in the handler
+    ; does not raise #NM when the lazy FPU state switching is pending. The
+    ; saved CR0 is restored on the way out, and the registers saved here always
+    ; belong to the current owner of the state.
+    mov rax, cr0
+    mov qword ptr [rsp + 6 * 16 + 8], rax
+    test rax, 8 ; CR0.TS
+    jz LightweightTaskSwitchedCleared
+    clts
+LightweightTaskSwitchedCleared:
+
+    movaps xmmword ptr [rsp + 0 * 16], xmm0
+    movaps xmmword ptr [rsp + 1 * 16], xmm1
+    movaps xmmword ptr [rsp + 2 * 16], xmm2
+    movaps xmmword ptr [rsp + 3 * 16], xmm3
+    movaps xmmword ptr [rsp + 4 * 16], xmm4
+    movaps xmmword ptr [rsp + 5 * 16], xmm5
+    stmxcsr dword ptr [rsp + 6 * 16]
+
+    ; Calling convention requires that Direction flag is clear
+    cld
+
+    ; Per X64 calling convention, allocate maximum parameter stack space, and
+    ; RSP is already 16-byte aligned.
+
+    sub rsp, 4 * 8
+
+IF MO_PLATFORM_X64_INTERRUPT_STATISTICS
+    ; Keep the Time Stamp Counter before calling the handler in Reserved1,
+    ; which is not used by the handler.
+    rdtsc
+    shl rdx, 32
+    or rax, rdx
+    mov qword ptr [rsp + 4 * 8 + 6 * 16 + 16], rax
+ENDIF
+
+    ; Call into interrupt handler
+    movzx rcx, byte ptr [rbp + 8]
+    mov rax, qword ptr [MoPlatformLightweightInterruptHandlerTable]
+    test rax, rax ; NULL?
+    jz SkipCallLightweightInterruptHandler
+    mov rax, [rax + rcx * 8]
+    test rax, rax ; NULL?
+    jz SkipCallLightweightInterruptHandler
+
+    ; Prepare parameter and call
+    lea rdx, [rsp + 4 * 8]
+    call rax
+
+SkipCallLightweightInterruptHandler:
+IF MO_PLATFORM_X64_INTERRUPT_STATISTICS
+    movzx rcx, byte ptr [rbp + 8]
+    mov rdx, qword ptr [rsp + 4 * 8 + 6 * 16 + 16]
+    call MoPlatformInterruptStatisticsRecord
+ENDIF
+
+    add rsp, 4 * 8
+
+    ldmxcsr dword ptr [rsp + 6 * 16]
+    movaps xmm0, xmmword ptr [rsp + 0 * 16]
+    movaps xmm1, xmmword ptr [rsp + 1 * 16]
+    movaps xmm2, xmmword ptr [rsp + 2 * 16]
+    movaps xmm3, xmmword ptr [rsp + 3 * 16]
+    movaps xmm4, xmmword ptr [rsp + 4 * 16]
+    movaps xmm5, xmmword ptr [rsp + 5 * 16]
+
+    ; Set CR0.TS again if it was set when the interrupt arrived.
+    mov rax, qword ptr [rsp + 6 * 16 + 8]
+    test rax, 8 ; CR0.TS
+    jz LightweightTaskSwitchedRestored
+    mov cr0, rax
+LightweightTaskSwitchedRestored:
+
+    add rsp, 6 * 16 + 3 * 8
+
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rdx
+    pop rcx
+    pop rax
+
+    test byte ptr [rbp + 32], 3 ; CS.RPL
+    jz LightweightExitGsSwapped
+    swapgs
+LightweightExitGsSwapped:
+
+    mov rsp, rbp
+    mov rbp, qword ptr[rbp]
+    add rsp, 24
+    iretq
+
+MoPlatformInterruptLightweightEntry ENDP
+
+; -----------------------------------------------------------------------------
+; MO_EXTERN_C MO_UINT64 MoPlatformInterruptDescriptorTableLightweightHandlers[256];
+; -----------------------------------------------------------------------------
+; These are the lightweight interrupt vector entry points, which have the same
+; layout as MoPlatformInterruptDescriptorTableHandlers but jump into
+; MoPlatformInterruptLightweightEntry.
+; N.B. Each entry must be no more than 8 bytes and must be 8-byte aligned.
+ALIGN 8
+PUBLIC MoPlatformInterruptDescriptorTableLightweightHandlers
+MoPlatformInterruptDescriptorTableLightweightHandlers LABEL BYTE
+Vector = 0
+REPEAT 256
+ALIGN 8
+
+    ; The same exceptions as MoPlatformInterruptDescriptorTableHandlers have
+    ; error codes associated with them, so the frame layout is always the same.
+    DummyCodeNeeded = 1
+    IF Vector EQ 8
+        DummyCodeNeeded = 0
+    ELSEIF Vector EQ 10
+        DummyCodeNeeded = 0
+    ELSEIF Vector EQ 11
+        DummyCodeNeeded = 0
+    ELSEIF Vector EQ 12
+        DummyCodeNeeded = 0
+    ELSEIF Vector EQ 13
+        DummyCodeNeeded = 0
+    ELSEIF Vector EQ 14
+        DummyCodeNeeded = 0
+    ELSEIF Vector EQ 17
+        DummyCodeNeeded = 0
+    ELSEIF Vector EQ 21
+        DummyCodeNeeded = 0
+    ENDIF
+
+    IF DummyCodeNeeded
+        ; Push a dummy error code. Use rax to get a 1-byte instruction to fit.
+        push rax
+    ENDIF
+
+    ; Must use LOW(Vector) to ensure only use 2-byte instruction to push vector
+    ; number.
+    push LOW(Vector)
+    jmp MoPlatformInterruptLightweightEntry
+
+Vector = Vector + 1
+ENDM
+
+.CONST
+
+; -----------------------------------------------------------------------------
+; MO_EXTERN_C MO_UINT8 MoPlatformSmpTrampolineCode[
+;     MO_PLATFORM_X64_SMP_TRAMPOLINE_CODE_SIZE];
+; -----------------------------------------------------------------------------
+; This is the application processor startup code, which is copied to the start
+; of a 4 KiB page below 1 MiB, and the startup IPI makes the processor execute
+; it in real mode with CS = page >> 4 and IP = 0.
+;
+; The MO_PLATFORM_X64_SMP_TRAMPOLINE_DATA structure at offset 100h of the same
+; page is filled by the bootstrap processor, and the code switches to the
+; protected mode with the temporary GDT, enables the long mode with the
+; temporary page tables which identity map the trampoline page, then switches
+; to the CR0, CR3 and CR4 of the bootstrap processor and calls the entry point
+; with the argument on the provided stack.
+;
+; N.B. The instructions are emitted as bytes because they are executed in the
+; real, protected and long modes, which cannot be expressed in one MASM code
+; segment. The offsets in the comments are relative to the start of the page.
+PUBLIC MoPlatformSmpTrampolineCode
+MoPlatformSmpTrampolineCode LABEL BYTE
+
+    ; 16-bit real mode, CS = DS = page >> 4.
+    DB 0FAh                                  ; 0000: cli
+    DB 0FCh                                  ; 0001: cld
+    DB 8Ch, 0C8h                             ; 0002: mov ax, cs
+    DB 8Eh, 0D8h                             ; 0004: mov ds, ax
+    DB 66h, 31h, 0DBh                        ; 0006: xor ebx, ebx
+    DB 89h, 0C3h                             ; 0009: mov bx, ax
+    DB 66h, 0C1h, 0E3h, 04h                  ; 000B: shl ebx, 4
+    DB 66h, 0Fh, 01h, 16h, 06h, 01h          ; 000F: lgdt [GdtLimit]
+    DB 0Fh, 20h, 0C0h                        ; 0015: mov eax, cr0
+    DB 0Ch, 01h                              ; 0018: or al, 1
+    DB 0Fh, 22h, 0C0h                        ; 001A: mov cr0, eax
+    DB 66h, 0FFh, 2Eh, 0Ch, 01h              ; 001D: jmp far [ProtectedModeEntry]
+
+    ; 32-bit protected mode, EBX = page.
+    DB 66h, 0B8h, 10h, 00h                   ; 0022: mov ax, 10h
+    DB 8Eh, 0D8h                             ; 0026: mov ds, ax
+    DB 8Eh, 0C0h                             ; 0028: mov es, ax
+    DB 8Eh, 0D0h                             ; 002A: mov ss, ax
+    DB 0Fh, 20h, 0E0h                        ; 002C: mov eax, cr4
+    DB 83h, 0C8h, 20h                        ; 002F: or eax, 20h (PAE)
+    DB 0Fh, 22h, 0E0h                        ; 0032: mov cr4, eax
+    DB 8Bh, 83h, 20h, 01h, 00h, 00h          ; 0035: mov eax, [ebx + TemporaryCr3]
+    DB 0Fh, 22h, 0D8h                        ; 003B: mov cr3, eax
+    DB 0B9h, 80h, 00h, 00h, 0C0h             ; 003E: mov ecx, 0C0000080h (EFER)
+    DB 8Bh, 83h, 24h, 01h, 00h, 00h          ; 0043: mov eax, [ebx + Efer]
+    DB 31h, 0D2h                             ; 0049: xor edx, edx
+    DB 0Fh, 30h                              ; 004B: wrmsr
+    DB 0Fh, 20h, 0C0h                        ; 004D: mov eax, cr0
+    DB 0Dh, 01h, 00h, 00h, 80h               ; 0050: or eax, 80000001h (PG | PE)
+    DB 0Fh, 22h, 0C0h                        ; 0055: mov cr0, eax
+    DB 0FFh, 0ABh, 14h, 01h, 00h, 00h        ; 0058: jmp far [ebx + LongModeEntry]
+
+    ; 64-bit long mode, RBX = page.
+    DB 89h, 0DBh                             ; 005E: mov ebx, ebx
+    DB 48h, 8Bh, 83h, 38h, 01h, 00h, 00h     ; 0060: mov rax, [rbx + Cr4]
+    DB 0Fh, 22h, 0E0h                        ; 0067: mov cr4, rax
+    DB 48h, 8Bh, 83h, 30h, 01h, 00h, 00h     ; 006A: mov rax, [rbx + Cr3]
+    DB 0Fh, 22h, 0D8h                        ; 0071: mov cr3, rax
+    DB 48h, 8Bh, 83h, 28h, 01h, 00h, 00h     ; 0074: mov rax, [rbx + Cr0]
+    DB 0Fh, 22h, 0C0h                        ; 007B: mov cr0, rax
+    DB 48h, 8Bh, 0A3h, 40h, 01h, 00h, 00h    ; 007E: mov rsp, [rbx + StackTop]
+    DB 48h, 8Bh, 8Bh, 50h, 01h, 00h, 00h     ; 0085: mov rcx, [rbx + Argument]
+    DB 48h, 8Bh, 83h, 48h, 01h, 00h, 00h     ; 008C: mov rax, [rbx + EntryPoint]
+    DB 48h, 83h, 0ECh, 20h                   ; 0093: sub rsp, 20h
+    DB 0FFh, 0D0h                            ; 0097: call rax
+
+    ; The entry point should not return.
+    DB 0FAh                                  ; 0099: cli
+    DB 0F4h                                  ; 009A: hlt
+    DB 0EBh, 0FCh                            ; 009B: jmp 0099h
+
 END
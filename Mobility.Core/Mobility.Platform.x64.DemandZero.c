@@ -0,0 +1,295 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.DemandZero.c
+ * PURPOSE:    Implementation for Mobility x64 Demand-Zero Memory
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Platform.x64.DemandZero.h"
+
+#include "Mobility.Runtime.Core.h"
+
+#include <Mile.Mobility.Utilities.MemoryAccess.h>
+
+static PMO_PLATFORM_X64_DEMAND_ZERO_MANAGER MoPlatformDemandZeroActiveManager =
+    nullptr;
+
+MO_FORCEINLINE PMO_PLATFORM_X64_DEMAND_ZERO_REGION MoPlatformDemandZeroFindRegion(
+    _Mo_In_ PMO_PLATFORM_X64_DEMAND_ZERO_MANAGER Manager,
+    _Mo_In_ MO_UINT64 VirtualAddress)
+{
+    for (MO_UINTN i = 0; i < Manager->RegionCount; ++i)
+    {
+        PMO_PLATFORM_X64_DEMAND_ZERO_REGION Region = &Manager->Regions[i];
+        if (VirtualAddress >= Region->VirtualAddress &&
+            VirtualAddress - Region->VirtualAddress < Region->Length)
+        {
+            return Region;
+        }
+    }
+
+    return nullptr;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformDemandZeroInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_DEMAND_ZERO_MANAGER Manager,
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER PageTableBuilder,
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_ALLOCATE_ROUTINE AllocateFrame,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    if (!Manager || !PageTableBuilder || !AllocateFrame)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    if (MO_RESULT_SUCCESS_OK != MoRuntimeMemoryFillByte(
+        Manager,
+        0u,
+        sizeof(MO_PLATFORM_X64_DEMAND_ZERO_MANAGER)))
+    {
+        // This function should not fail here.
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    Manager->PageTableBuilder = PageTableBuilder;
+    Manager->AllocateFrame = AllocateFrame;
+    Manager->Context = Context;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformDemandZeroReserveRange(
+    _Mo_In_ PMO_PLATFORM_X64_DEMAND_ZERO_MANAGER Manager,
+    _Mo_In_ MO_UINT64 VirtualAddress,
+    _Mo_In_ MO_UINT64 Length,
+    _Mo_In_ MO_UINT32 Attributes,
+    _Mo_In_ MO_UINT8 CacheType)
+{
+    if (!Manager ||
+        !Length ||
+        CacheType > MO_PLATFORM_X64_PAGE_CACHE_MAXIMUM)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    if ((VirtualAddress | Length) & (MO_PLATFORM_X64_PAGE_SIZE_4K - 1))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MO_UINT64 LastVirtualAddress = VirtualAddress + (Length - 1);
+    if (LastVirtualAddress < VirtualAddress)
+    {
+        return MO_RESULT_ERROR_OUT_OF_BOUNDS;
+    }
+
+    for (MO_UINTN i = 0; i < Manager->RegionCount; ++i)
+    {
+        PMO_PLATFORM_X64_DEMAND_ZERO_REGION Region = &Manager->Regions[i];
+        MO_UINT64 RegionLastAddress =
+            Region->VirtualAddress + (Region->Length - 1);
+        if (VirtualAddress <= RegionLastAddress &&
+            Region->VirtualAddress <= LastVirtualAddress)
+        {
+            return MO_RESULT_ERROR_INVALID_PARAMETER;
+        }
+    }
+
+    if (Manager->RegionCount >= MO_PLATFORM_X64_DEMAND_ZERO_MAXIMUM_REGIONS)
+    {
+        return MO_RESULT_ERROR_OUT_OF_MEMORY;
+    }
+
+    PMO_PLATFORM_X64_DEMAND_ZERO_REGION Region =
+        &Manager->Regions[Manager->RegionCount];
+    Region->VirtualAddress = VirtualAddress;
+    Region->Length = Length;
+    Region->Attributes = Attributes;
+    Region->CacheType = CacheType;
+    Region->CommittedPages = 0u;
+
+    // Publish the region after it is filled, because the page-fault handler may
+    // look up the regions at any time.
+    MoMileCompilerBarrier();
+    ++Manager->RegionCount;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformDemandZeroResolveFault(
+    _Mo_In_ PMO_PLATFORM_X64_DEMAND_ZERO_MANAGER Manager,
+    _Mo_In_ MO_UINT64 FaultAddress,
+    _Mo_In_ MO_UINT64 ErrorCode)
+{
+    if (!Manager || !Manager->PageTableBuilder || !Manager->AllocateFrame)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    // Only the not-present pages can be backed, and the protection violations
+    // and the reserved bit violations are passed to the next handler.
+    if (ErrorCode & (
+        MO_PLATFORM_X64_PAGE_FAULT_ERROR_PRESENT |
+        MO_PLATFORM_X64_PAGE_FAULT_ERROR_RESERVED_BIT))
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    PMO_PLATFORM_X64_DEMAND_ZERO_REGION Region =
+        MoPlatformDemandZeroFindRegion(Manager, FaultAddress);
+    if (!Region)
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    MO_UINT64 PageAddress = FaultAddress & ~(MO_PLATFORM_X64_PAGE_SIZE_4K - 1);
+
+    MO_UINT64 FrameAddress = 0u;
+    if (MO_RESULT_SUCCESS_OK == MoPlatformPageTableQuery(
+        &FrameAddress,
+        nullptr,
+        nullptr,
+        nullptr,
+        Manager->PageTableBuilder,
+        PageAddress))
+    {
+        // The page is already backed, and only the stale translation needs to
+        // be dropped.
+        MoPlatformInvalidatePage(PageAddress);
+        return MO_RESULT_SUCCESS_OK;
+    }
+
+    if (MO_RESULT_SUCCESS_OK != Manager->AllocateFrame(
+        &FrameAddress,
+        Manager->Context))
+    {
+        return MO_RESULT_ERROR_OUT_OF_MEMORY;
+    }
+    if (FrameAddress & (MO_PLATFORM_X64_PAGE_SIZE_4K - 1))
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    MO_POINTER Frame = nullptr;
+    if (Manager->PageTableBuilder->TranslateAddress)
+    {
+        Frame = Manager->PageTableBuilder->TranslateAddress(
+            FrameAddress,
+            Manager->PageTableBuilder->Context);
+    }
+    else
+    {
+        Frame = (MO_POINTER)((MO_UINTN)(FrameAddress));
+    }
+    if (MO_RESULT_SUCCESS_OK != MoRuntimeMemoryFillByte(
+        Frame,
+        0u,
+        MO_PLATFORM_X64_PAGE_SIZE_4K))
+    {
+        return MO_RESULT_ERROR_INVALID_POINTER;
+    }
+
+    MO_RESULT Result = MoPlatformPageTableMapRange(
+        Manager->PageTableBuilder,
+        PageAddress,
+        FrameAddress,
+        MO_PLATFORM_X64_PAGE_SIZE_4K,
+        Region->Attributes,
+        Region->CacheType);
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+
+    // The processor may cache the not-present translation, so drop it before
+    // the faulting instruction is restarted.
+    MoPlatformInvalidatePage(PageAddress);
+
+    ++Region->CommittedPages;
+    ++Manager->ResolvedFaults;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+static MO_VOID MOAPI MoPlatformDemandZeroPageFaultHandler(
+    _Mo_In_ MO_PLATFORM_X64_INTERRUPT_TYPE InterruptType,
+    _Mo_In_ PMO_PLATFORM_X64_INTERRUPT_CONTEXT InterruptContext)
+{
+    PMO_PLATFORM_X64_DEMAND_ZERO_MANAGER Manager =
+        MoPlatformDemandZeroActiveManager;
+    if (Manager)
+    {
+        if (MO_RESULT_SUCCESS_OK == MoPlatformDemandZeroResolveFault(
+            Manager,
+            InterruptContext->Cr2,
+            InterruptContext->ExceptionData))
+        {
+            return;
+        }
+
+        if (Manager->PreviousHandler)
+        {
+            Manager->PreviousHandler(InterruptType, InterruptContext);
+            return;
+        }
+    }
+
+    // Returning from the handler will restart the faulting instruction and
+    // raise the same page fault again, so halt the processor instead.
+    for (;;)
+    {
+        MoPlatformHalt();
+    }
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformDemandZeroInstallHandler(
+    _Mo_In_ PMO_PLATFORM_X64_DEMAND_ZERO_MANAGER Manager,
+    _Mo_InOut_ PMO_PLATFORM_X64_INTERRUPT_HANDLER* InterruptHandlerTable)
+{
+    if (!Manager || !InterruptHandlerTable)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    if (MoPlatformDemandZeroActiveManager)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    PMO_PLATFORM_X64_INTERRUPT_HANDLER* Entry =
+        &InterruptHandlerTable[MO_PLATFORM_X64_INTERRUPT_PAGE_FAULT];
+    Manager->PreviousHandler = *Entry;
+    MoPlatformDemandZeroActiveManager = Manager;
+    MoMileCompilerBarrier();
+    *Entry = MoPlatformDemandZeroPageFaultHandler;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformDemandZeroUninstallHandler(
+    _Mo_In_ PMO_PLATFORM_X64_DEMAND_ZERO_MANAGER Manager,
+    _Mo_InOut_ PMO_PLATFORM_X64_INTERRUPT_HANDLER* InterruptHandlerTable)
+{
+    if (!Manager || !InterruptHandlerTable)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    PMO_PLATFORM_X64_INTERRUPT_HANDLER* Entry =
+        &InterruptHandlerTable[MO_PLATFORM_X64_INTERRUPT_PAGE_FAULT];
+    if (MoPlatformDemandZeroActiveManager != Manager ||
+        *Entry != MoPlatformDemandZeroPageFaultHandler)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    *Entry = Manager->PreviousHandler;
+    MoMileCompilerBarrier();
+    MoPlatformDemandZeroActiveManager = nullptr;
+    Manager->PreviousHandler = nullptr;
+
+    return MO_RESULT_SUCCESS_OK;
+}
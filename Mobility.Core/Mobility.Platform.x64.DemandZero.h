@@ -0,0 +1,197 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.DemandZero.h
+ * PURPOSE:    Definition for Mobility x64 Demand-Zero Memory
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_PLATFORM_X64_DEMANDZERO
+#define MOBILITY_PLATFORM_X64_DEMANDZERO
+
+#include "Mobility.Platform.x64.PageTable.h"
+
+/**
+ * @brief The maximum number of the demand-zero regions which can be reserved
+ *        in a demand-zero manager.
+ */
+#define MO_PLATFORM_X64_DEMAND_ZERO_MAXIMUM_REGIONS 16
+
+/*
+ * The bits of the error code pushed by the page-fault exception.
+ *
+ * @remark Intel(R) 64 and IA-32 Architectures Software Developer's Manual
+ *         (December 2023)
+ *           Volume 3 (3A, 3B, 3C, & 3D): System Programming Guide
+ *             5.7 Page-Fault Exceptions
+ */
+
+#define MO_PLATFORM_X64_PAGE_FAULT_ERROR_PRESENT 0x1
+#define MO_PLATFORM_X64_PAGE_FAULT_ERROR_WRITE 0x2
+#define MO_PLATFORM_X64_PAGE_FAULT_ERROR_USER 0x4
+#define MO_PLATFORM_X64_PAGE_FAULT_ERROR_RESERVED_BIT 0x8
+#define MO_PLATFORM_X64_PAGE_FAULT_ERROR_INSTRUCTION_FETCH 0x10
+
+/**
+ * @brief The virtual range which is backed by zeroed frames on first touch.
+ */
+typedef struct _MO_PLATFORM_X64_DEMAND_ZERO_REGION
+{
+    /**
+     * @brief The base virtual address of the region.
+     */
+    MO_UINT64 VirtualAddress;
+    /**
+     * @brief The length in bytes of the region.
+     */
+    MO_UINT64 Length;
+    /**
+     * @brief The MO_PLATFORM_X64_PAGE_ATTRIBUTE_* flags for the pages.
+     */
+    MO_UINT32 Attributes;
+    /**
+     * @brief The MO_PLATFORM_X64_PAGE_CACHE_* cacheability type for the pages.
+     */
+    MO_UINT8 CacheType;
+    MO_UINT8 Reserved[3];
+    /**
+     * @brief The number of the pages which are backed by frames.
+     */
+    MO_UINT64 CommittedPages;
+} MO_PLATFORM_X64_DEMAND_ZERO_REGION, *PMO_PLATFORM_X64_DEMAND_ZERO_REGION;
+
+/**
+ * @brief The demand-zero manager which reserves the virtual ranges and backs
+ *        them with zeroed frames when the page faults are raised.
+ */
+typedef struct _MO_PLATFORM_X64_DEMAND_ZERO_MANAGER
+{
+    /**
+     * @brief The page table builder of the page table used by the processor.
+     */
+    PMO_PLATFORM_X64_PAGE_TABLE_BUILDER PageTableBuilder;
+    /**
+     * @brief The routine for allocating the 4 KiB frames which back the
+     *        reserved regions.
+     */
+    PMO_PLATFORM_X64_PAGE_TABLE_ALLOCATE_ROUTINE AllocateFrame;
+    /**
+     * @brief The user-defined context passed to the allocate routine.
+     */
+    MO_POINTER Context;
+    /**
+     * @brief The page-fault handler which was installed before the demand-zero
+     *        handler, which receives the page faults not resolved by the
+     *        demand-zero manager.
+     */
+    PMO_PLATFORM_X64_INTERRUPT_HANDLER PreviousHandler;
+    /**
+     * @brief The number of the page faults resolved by the demand-zero manager.
+     */
+    MO_UINT64 ResolvedFaults;
+    /**
+     * @brief The number of the reserved regions.
+     */
+    MO_UINTN RegionCount;
+    /**
+     * @brief The reserved regions.
+     */
+    MO_PLATFORM_X64_DEMAND_ZERO_REGION Regions[
+        MO_PLATFORM_X64_DEMAND_ZERO_MAXIMUM_REGIONS];
+} MO_PLATFORM_X64_DEMAND_ZERO_MANAGER, *PMO_PLATFORM_X64_DEMAND_ZERO_MANAGER;
+
+/**
+ * @brief Initializes the demand-zero manager.
+ * @param Manager The demand-zero manager to be initialized.
+ * @param PageTableBuilder The page table builder of the page table used by the
+ *                         processor.
+ * @param AllocateFrame The routine for allocating the 4 KiB frames which back
+ *                      the reserved regions.
+ * @param Context The user-defined context passed to the allocate routine.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformDemandZeroInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_DEMAND_ZERO_MANAGER Manager,
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER PageTableBuilder,
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_ALLOCATE_ROUTINE AllocateFrame,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief Reserves the virtual range which is backed by zeroed frames on first
+ *        touch. No frames and no paging structures are allocated here.
+ * @param Manager The demand-zero manager.
+ * @param VirtualAddress The base virtual address which must be 4 KiB aligned
+ *                       and canonical.
+ * @param Length The length in bytes which must be a multiple of 4 KiB.
+ * @param Attributes The MO_PLATFORM_X64_PAGE_ATTRIBUTE_* flags.
+ * @param CacheType The MO_PLATFORM_X64_PAGE_CACHE_* cacheability type.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The range must not be mapped in the page table, and must not overlap
+ *          with the other reserved regions.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformDemandZeroReserveRange(
+    _Mo_In_ PMO_PLATFORM_X64_DEMAND_ZERO_MANAGER Manager,
+    _Mo_In_ MO_UINT64 VirtualAddress,
+    _Mo_In_ MO_UINT64 Length,
+    _Mo_In_ MO_UINT32 Attributes,
+    _Mo_In_ MO_UINT8 CacheType);
+
+/**
+ * @brief Resolves the page fault by backing the faulting page with a zeroed
+ *        frame if the page is in the reserved regions.
+ * @param Manager The demand-zero manager.
+ * @param FaultAddress The faulting virtual address, which is read from CR2.
+ * @param ErrorCode The error code pushed by the page-fault exception.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the page fault is not caused by a not-present page in the
+ *          reserved regions, the function returns MO_RESULT_ERROR_NO_INTERFACE.
+ *          The translation of the faulting page is invalidated on the current
+ *          processor only.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformDemandZeroResolveFault(
+    _Mo_In_ PMO_PLATFORM_X64_DEMAND_ZERO_MANAGER Manager,
+    _Mo_In_ MO_UINT64 FaultAddress,
+    _Mo_In_ MO_UINT64 ErrorCode);
+
+/**
+ * @brief Installs the demand-zero page-fault handler to the specified interrupt
+ *        handler table, and the page faults not resolved will be passed to the
+ *        previously installed handler.
+ * @param Manager The demand-zero manager used by the page-fault handler.
+ * @param InterruptHandlerTable The interrupt handler table which is also used
+ *                              as MoPlatformInterruptHandlerTable.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks Only one demand-zero manager can be installed at the same time. If
+ *          there is no previously installed handler, the processor will be
+ *          halted when a page fault cannot be resolved, so the caller should
+ *          install a handler which passes the page faults to the previous
+ *          owner of the vector first.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformDemandZeroInstallHandler(
+    _Mo_In_ PMO_PLATFORM_X64_DEMAND_ZERO_MANAGER Manager,
+    _Mo_InOut_ PMO_PLATFORM_X64_INTERRUPT_HANDLER* InterruptHandlerTable);
+
+/**
+ * @brief Uninstalls the demand-zero page-fault handler from the specified
+ *        interrupt handler table, and restores the previously installed
+ *        handler.
+ * @param Manager The demand-zero manager installed by
+ *                MoPlatformDemandZeroInstallHandler.
+ * @param InterruptHandlerTable The interrupt handler table passed to
+ *                              MoPlatformDemandZeroInstallHandler.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The committed pages stay mapped, but the page faults in the
+ *          reserved regions are no longer resolved after that.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformDemandZeroUninstallHandler(
+    _Mo_In_ PMO_PLATFORM_X64_DEMAND_ZERO_MANAGER Manager,
+    _Mo_InOut_ PMO_PLATFORM_X64_INTERRUPT_HANDLER* InterruptHandlerTable);
+
+#endif // !MOBILITY_PLATFORM_X64_DEMANDZERO
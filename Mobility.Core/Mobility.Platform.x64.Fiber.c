@@ -0,0 +1,345 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.Fiber.c
+ * PURPOSE:    Implementation for Mobility x64 Fibers
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Platform.x64.Fiber.h"
+
+#include "Mobility.Platform.x64.DemandZero.h"
+#include "Mobility.Runtime.Core.h"
+
+/**
+ * @brief The initial value of the x87 FPU control word of a new fiber.
+ */
+#define MO_PLATFORM_X64_FIBER_INITIAL_CONTROL_WORD 0x037F
+
+/**
+ * @brief The initial value of MXCSR of a new fiber.
+ */
+#define MO_PLATFORM_X64_FIBER_INITIAL_MXCSR 0x1F80
+
+/**
+ * @brief The first instructions of a new fiber, which call the routine in R12
+ *        with the fiber in RBX as the parameter.
+ * @remarks Implemented in the assembly parts, and never called directly.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformFiberStartThunk();
+
+/**
+ * @brief The layout of the context saved on the fiber stack, which must match
+ *        MoPlatformFiberSwitchContext in the assembly parts.
+ */
+typedef struct _MO_PLATFORM_X64_FIBER_SAVED_CONTEXT
+{
+    MO_UINT64 Xmm[10][2];
+    MO_UINT32 Mxcsr;
+    MO_UINT16 FpuControlWord;
+    MO_UINT16 Reserved;
+    MO_UINT64 R15;
+    MO_UINT64 R14;
+    MO_UINT64 R13;
+    MO_UINT64 R12;
+    MO_UINT64 Rsi;
+    MO_UINT64 Rdi;
+    MO_UINT64 Rbx;
+    MO_UINT64 Rbp;
+    MO_UINT64 Rip;
+} MO_PLATFORM_X64_FIBER_SAVED_CONTEXT, *PMO_PLATFORM_X64_FIBER_SAVED_CONTEXT;
+
+MO_C_STATIC_ASSERT(
+    sizeof(MO_PLATFORM_X64_FIBER_SAVED_CONTEXT) ==
+    MO_PLATFORM_X64_FIBER_CONTEXT_SIZE + sizeof(MO_UINT64));
+
+/**
+ * @brief The size in bytes reserved on the top of an overflowed stack for the
+ *        return address and the home space of MoPlatformFiberOverflowEntry.
+ */
+#define MO_PLATFORM_X64_FIBER_OVERFLOW_FRAME_SIZE 0x28
+
+static MO_VOID MOAPI MoPlatformFiberExit(
+    _Mo_In_ PMO_PLATFORM_X64_FIBER Fiber,
+    _Mo_In_ MO_UINT32 State)
+{
+    // The exited fiber is never switched to again, so its saved stack pointer
+    // is only written here.
+    PMO_PLATFORM_X64_FIBER Caller = Fiber->Caller;
+    Fiber->State = State;
+    Caller->State = MO_PLATFORM_X64_FIBER_STATE_RUNNING;
+    MoPlatformFiberSwitchContext(&Fiber->StackPointer, Caller->StackPointer);
+
+    // The caller never switches back, so this point is never reached.
+    for (;;)
+    {
+        MoPlatformHalt();
+    }
+}
+
+static MO_VOID MOAPI MoPlatformFiberEntry(
+    _Mo_In_ PMO_PLATFORM_X64_FIBER Fiber)
+{
+    Fiber->StartRoutine(Fiber, Fiber->Context);
+
+    MoPlatformFiberExit(Fiber, MO_PLATFORM_X64_FIBER_STATE_FINISHED);
+}
+
+/**
+ * @brief Resumed by the page-fault handler on the top of the overflowed stack
+ *        instead of the faulting instruction.
+ */
+static MO_VOID MOAPI MoPlatformFiberOverflowEntry(
+    _Mo_In_ PMO_PLATFORM_X64_FIBER Fiber)
+{
+    MoPlatformFiberExit(Fiber, MO_PLATFORM_X64_FIBER_STATE_OVERFLOWED);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFiberInitializeCurrent(
+    _Mo_Out_ PMO_PLATFORM_X64_FIBER Fiber)
+{
+    if (!Fiber)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MoRuntimeMemoryFillByte(Fiber, 0, sizeof(MO_PLATFORM_X64_FIBER));
+    Fiber->State = MO_PLATFORM_X64_FIBER_STATE_RUNNING;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFiberCreate(
+    _Mo_Out_ PMO_PLATFORM_X64_FIBER Fiber,
+    _Mo_In_ MO_UINT64 StackBase,
+    _Mo_In_ MO_UINT64 StackSize,
+    _Mo_In_ PMO_PLATFORM_X64_FIBER_START_ROUTINE StartRoutine,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    if (!Fiber || !StackBase || !StartRoutine)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if ((StackBase | StackSize) & 0xF ||
+        StackSize < MO_PLATFORM_X64_FIBER_MINIMUM_STACK_SIZE ||
+        StackBase + StackSize < StackBase)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MoRuntimeMemoryFillByte(Fiber, 0, sizeof(MO_PLATFORM_X64_FIBER));
+    Fiber->StackBase = StackBase;
+    Fiber->StackSize = StackSize;
+    Fiber->StartRoutine = StartRoutine;
+    Fiber->Context = Context;
+    Fiber->State = MO_PLATFORM_X64_FIBER_STATE_READY;
+
+    PMO_UINT64 Canaries = (PMO_UINT64)(MO_UINTN)StackBase;
+    for (MO_UINTN Index = 0;
+        Index < MO_PLATFORM_X64_FIBER_STACK_CANARY_COUNT;
+        ++Index)
+    {
+        Canaries[Index] = MO_PLATFORM_X64_FIBER_STACK_CANARY;
+    }
+
+    // The saved stack pointer must be 16-byte aligned for the MOVAPS in the
+    // switch, which also keeps the stack aligned at the start thunk.
+    MO_UINT64 StackPointer = StackBase + StackSize -
+        sizeof(MO_PLATFORM_X64_FIBER_SAVED_CONTEXT) - 0x10;
+    PMO_PLATFORM_X64_FIBER_SAVED_CONTEXT SavedContext =
+        (PMO_PLATFORM_X64_FIBER_SAVED_CONTEXT)(MO_UINTN)StackPointer;
+    MoRuntimeMemoryFillByte(
+        SavedContext,
+        0,
+        sizeof(MO_PLATFORM_X64_FIBER_SAVED_CONTEXT));
+    SavedContext->Mxcsr = MO_PLATFORM_X64_FIBER_INITIAL_MXCSR;
+    SavedContext->FpuControlWord = MO_PLATFORM_X64_FIBER_INITIAL_CONTROL_WORD;
+    SavedContext->R12 = (MO_UINT64)(MO_UINTN)MoPlatformFiberEntry;
+    SavedContext->Rbx = (MO_UINT64)(MO_UINTN)Fiber;
+    SavedContext->Rip = (MO_UINT64)(MO_UINTN)MoPlatformFiberStartThunk;
+    Fiber->StackPointer = StackPointer;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFiberMapStack(
+    _Mo_Out_ PMO_UINT64 StackBase,
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder,
+    _Mo_In_ MO_UINT64 GuardPageAddress,
+    _Mo_In_ MO_UINT64 PhysicalAddress,
+    _Mo_In_ MO_UINT64 StackSize)
+{
+    if (!StackBase || !Builder)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if ((GuardPageAddress | PhysicalAddress | StackSize) &
+        (MO_PLATFORM_X64_FIBER_GUARD_PAGE_SIZE - 1) ||
+        StackSize < MO_PLATFORM_X64_FIBER_MINIMUM_STACK_SIZE ||
+        GuardPageAddress + MO_PLATFORM_X64_FIBER_GUARD_PAGE_SIZE + StackSize <
+            GuardPageAddress)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MO_UINT64 GuardPhysicalAddress = 0u;
+    if (MO_RESULT_ERROR_NO_INTERFACE != MoPlatformPageTableQuery(
+        &GuardPhysicalAddress,
+        nullptr,
+        nullptr,
+        nullptr,
+        Builder,
+        GuardPageAddress))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MO_UINT64 Base = GuardPageAddress + MO_PLATFORM_X64_FIBER_GUARD_PAGE_SIZE;
+    MO_RESULT Result = MoPlatformPageTableMapRange(
+        Builder,
+        Base,
+        PhysicalAddress,
+        StackSize,
+        MO_PLATFORM_X64_PAGE_ATTRIBUTE_WRITABLE,
+        MO_PLATFORM_X64_PAGE_CACHE_WRITE_BACK);
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+
+    *StackBase = Base;
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFiberHandleGuardPageFault(
+    _Mo_InOut_ PMO_PLATFORM_X64_FIBER Fiber,
+    _Mo_InOut_ PMO_PLATFORM_X64_INTERRUPT_CONTEXT InterruptContext)
+{
+    if (!Fiber || !InterruptContext)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (MO_PLATFORM_X64_FIBER_STATE_RUNNING != Fiber->State ||
+        !Fiber->Caller ||
+        Fiber->StackBase < MO_PLATFORM_X64_FIBER_GUARD_PAGE_SIZE)
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    // Only the not-present faults on the guard page are the stack overflow.
+    MO_UINT64 FaultAddress = InterruptContext->Cr2;
+    if ((InterruptContext->ExceptionData &
+        MO_PLATFORM_X64_PAGE_FAULT_ERROR_PRESENT) ||
+        FaultAddress <
+            Fiber->StackBase - MO_PLATFORM_X64_FIBER_GUARD_PAGE_SIZE ||
+        FaultAddress >= Fiber->StackBase)
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    // The frames on the overflowed stack are abandoned, so resume on its top
+    // with the stack pointer aligned as after a call instruction.
+    InterruptContext->Rip = (MO_UINT64)(MO_UINTN)MoPlatformFiberOverflowEntry;
+    InterruptContext->Rcx = (MO_UINT64)(MO_UINTN)Fiber;
+    InterruptContext->Rsp = Fiber->StackBase + Fiber->StackSize -
+        MO_PLATFORM_X64_FIBER_OVERFLOW_FRAME_SIZE;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_BOOL MOAPI MoPlatformFiberCheckStack(
+    _Mo_In_ PMO_PLATFORM_X64_FIBER Fiber)
+{
+    if (!Fiber->StackBase)
+    {
+        return MO_TRUE;
+    }
+
+    PMO_UINT64 Canaries = (PMO_UINT64)(MO_UINTN)Fiber->StackBase;
+    for (MO_UINTN Index = 0;
+        Index < MO_PLATFORM_X64_FIBER_STACK_CANARY_COUNT;
+        ++Index)
+    {
+        if (MO_PLATFORM_X64_FIBER_STACK_CANARY != Canaries[Index])
+        {
+            return MO_FALSE;
+        }
+    }
+
+    // The saved stack pointer is also checked, because a deep frame may skip
+    // over the canary values.
+    if (MO_PLATFORM_X64_FIBER_STATE_RUNNING != Fiber->State &&
+        (Fiber->StackPointer < Fiber->StackBase ||
+        Fiber->StackPointer >= Fiber->StackBase + Fiber->StackSize))
+    {
+        return MO_FALSE;
+    }
+
+    return MO_TRUE;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFiberSwitch(
+    _Mo_InOut_ PMO_PLATFORM_X64_FIBER Current,
+    _Mo_InOut_ PMO_PLATFORM_X64_FIBER Next)
+{
+    if (!Current || !Next || Current == Next)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (MO_PLATFORM_X64_FIBER_STATE_RUNNING != Current->State ||
+        MO_PLATFORM_X64_FIBER_STATE_READY != Next->State)
+    {
+        return MO_RESULT_ERROR_INVALID_HANDLE;
+    }
+    if (!MoPlatformFiberCheckStack(Current) ||
+        !MoPlatformFiberCheckStack(Next))
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    Current->State = MO_PLATFORM_X64_FIBER_STATE_READY;
+    Next->State = MO_PLATFORM_X64_FIBER_STATE_RUNNING;
+    Next->Caller = Current;
+    MoPlatformFiberSwitchContext(&Current->StackPointer, Next->StackPointer);
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFiberYield(
+    _Mo_InOut_ PMO_PLATFORM_X64_FIBER Current)
+{
+    if (!Current || !Current->Caller)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    return MoPlatformFiberSwitch(Current, Current->Caller);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFiberJoin(
+    _Mo_InOut_ PMO_PLATFORM_X64_FIBER Current,
+    _Mo_InOut_ PMO_PLATFORM_X64_FIBER Target)
+{
+    if (!Current || !Target)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    while (MO_PLATFORM_X64_FIBER_STATE_FINISHED != Target->State)
+    {
+        if (MO_PLATFORM_X64_FIBER_STATE_OVERFLOWED == Target->State)
+        {
+            return MO_RESULT_ERROR_UNEXPECTED;
+        }
+
+        MO_RESULT Result = MoPlatformFiberSwitch(Current, Target);
+        if (MO_RESULT_SUCCESS_OK != Result)
+        {
+            return Result;
+        }
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
@@ -0,0 +1,251 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.Fiber.h
+ * PURPOSE:    Definition for Mobility x64 Fibers
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_PLATFORM_X64_FIBER
+#define MOBILITY_PLATFORM_X64_FIBER
+
+#include "Mobility.Platform.x64.h"
+#include "Mobility.Platform.x64.PageTable.h"
+
+/**
+ * @brief The minimum size in bytes of a fiber stack.
+ */
+#define MO_PLATFORM_X64_FIBER_MINIMUM_STACK_SIZE 0x1000
+
+/**
+ * @brief The value filled into the lowest bytes of a fiber stack, which is
+ *        checked on each switch for detecting the stack overflow.
+ */
+#define MO_PLATFORM_X64_FIBER_STACK_CANARY 0x2172656269466F4DULL
+
+/**
+ * @brief The number of the canary values at the lowest bytes of a fiber stack.
+ */
+#define MO_PLATFORM_X64_FIBER_STACK_CANARY_COUNT 8
+
+/**
+ * @brief The size in bytes of the context saved on the fiber stack by
+ *        MoPlatformFiberSwitchContext, which includes XMM6 to XMM15, MXCSR,
+ *        the x87 FPU control word and 8 general-purpose registers.
+ */
+#define MO_PLATFORM_X64_FIBER_CONTEXT_SIZE 0xE8
+
+/**
+ * @brief The size in bytes of the unmapped guard page below a fiber stack
+ *        mapped by MoPlatformFiberMapStack.
+ */
+#define MO_PLATFORM_X64_FIBER_GUARD_PAGE_SIZE MO_PLATFORM_X64_PAGE_SIZE_4K
+
+typedef enum _MO_PLATFORM_X64_FIBER_STATE
+{
+    MO_PLATFORM_X64_FIBER_STATE_READY = 0,
+    MO_PLATFORM_X64_FIBER_STATE_RUNNING = 1,
+    MO_PLATFORM_X64_FIBER_STATE_FINISHED = 2,
+    MO_PLATFORM_X64_FIBER_STATE_OVERFLOWED = 3,
+} MO_PLATFORM_X64_FIBER_STATE, *PMO_PLATFORM_X64_FIBER_STATE;
+
+typedef struct _MO_PLATFORM_X64_FIBER
+    MO_PLATFORM_X64_FIBER, *PMO_PLATFORM_X64_FIBER;
+
+/**
+ * @brief The start routine of a fiber.
+ * @param Fiber The fiber being started.
+ * @param Context The user-defined context passed to MoPlatformFiberCreate.
+ * @remarks The fiber finishes and switches back to its caller when the start
+ *          routine returns.
+ */
+typedef MO_VOID(MOAPI* PMO_PLATFORM_X64_FIBER_START_ROUTINE)(
+    _Mo_In_ PMO_PLATFORM_X64_FIBER Fiber,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief The fiber, which is a stackful coroutine switched cooperatively.
+ */
+struct _MO_PLATFORM_X64_FIBER
+{
+    /**
+     * @brief The saved stack pointer when the fiber is not running.
+     */
+    MO_UINT64 StackPointer;
+    /**
+     * @brief The lowest address of the stack, or zero if the fiber is
+     *        converted from the current execution context.
+     */
+    MO_UINT64 StackBase;
+    /**
+     * @brief The size in bytes of the stack, or zero if the fiber is converted
+     *        from the current execution context.
+     */
+    MO_UINT64 StackSize;
+    /**
+     * @brief The start routine of the fiber.
+     */
+    PMO_PLATFORM_X64_FIBER_START_ROUTINE StartRoutine;
+    /**
+     * @brief The user-defined context passed to the start routine.
+     */
+    MO_POINTER Context;
+    /**
+     * @brief The fiber which switched to this fiber last, which is resumed by
+     *        yield and by the end of the start routine.
+     */
+    PMO_PLATFORM_X64_FIBER Caller;
+    /**
+     * @brief The state of the fiber (MO_PLATFORM_X64_FIBER_STATE).
+     */
+    MO_UINT32 State;
+    /**
+     * @brief Reserved bits. Set to 0.
+     */
+    MO_UINT32 Reserved;
+};
+
+/**
+ * @brief Switches the stack between the fibers after saving the callee-saved
+ *        registers of the Microsoft x64 calling convention.
+ * @param CurrentStackPointer The pointer to receive the stack pointer of the
+ *                            current fiber.
+ * @param NextStackPointer The saved stack pointer of the next fiber.
+ * @remarks Implemented in the assembly parts. Use MoPlatformFiberSwitch
+ *          instead, which also checks the fibers and updates their states.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformFiberSwitchContext(
+    _Mo_Out_ PMO_UINT64 CurrentStackPointer,
+    _Mo_In_ MO_UINT64 NextStackPointer);
+
+/**
+ * @brief Converts the current execution context to a fiber, which is needed
+ *        before switching to other fibers.
+ * @param Fiber The fiber to initialize.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFiberInitializeCurrent(
+    _Mo_Out_ PMO_PLATFORM_X64_FIBER Fiber);
+
+/**
+ * @brief Creates a fiber on the specified stack.
+ * @param Fiber The fiber to create.
+ * @param StackBase The lowest address of the stack, which must be 16-byte
+ *                  aligned and is usually allocated from the page allocator.
+ * @param StackSize The size in bytes of the stack, which must be a multiple of
+ *                  16 and not less than MO_PLATFORM_X64_FIBER_MINIMUM_STACK_SIZE.
+ * @param StartRoutine The start routine of the fiber.
+ * @param Context The user-defined context passed to the start routine.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The fiber does not run until it is switched to. The lowest bytes of
+ *          the stack are filled with the canary values for detecting the stack
+ *          overflow, and MoPlatformFiberMapStack can also leave the page below
+ *          the stack unmapped as the guard page.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFiberCreate(
+    _Mo_Out_ PMO_PLATFORM_X64_FIBER Fiber,
+    _Mo_In_ MO_UINT64 StackBase,
+    _Mo_In_ MO_UINT64 StackSize,
+    _Mo_In_ PMO_PLATFORM_X64_FIBER_START_ROUTINE StartRoutine,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief Maps a fiber stack with the page table builder, and leaves the page
+ *        below the stack unmapped as the guard page.
+ * @param StackBase Receives the lowest virtual address of the stack, which is
+ *                  passed to MoPlatformFiberCreate.
+ * @param Builder The page table builder of the current page tables.
+ * @param GuardPageAddress The virtual address of the guard page, which must be
+ *                         4 KiB aligned and canonical, and the stack is mapped
+ *                         right above it.
+ * @param PhysicalAddress The base physical address of the stack, which must be
+ *                        4 KiB aligned.
+ * @param StackSize The size in bytes of the stack, which must be a multiple of
+ *                  4 KiB and not less than
+ *                  MO_PLATFORM_X64_FIBER_MINIMUM_STACK_SIZE.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the guard page is already mapped, the function returns
+ *          MO_RESULT_ERROR_INVALID_PARAMETER, because the overflow would not be
+ *          caught. The stack is mapped as writable and write-back cacheable.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFiberMapStack(
+    _Mo_Out_ PMO_UINT64 StackBase,
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder,
+    _Mo_In_ MO_UINT64 GuardPageAddress,
+    _Mo_In_ MO_UINT64 PhysicalAddress,
+    _Mo_In_ MO_UINT64 StackSize);
+
+/**
+ * @brief Reports the page fault on the guard page of the running fiber as the
+ *        stack overflow, which is called from the page-fault handler.
+ * @param Fiber The running fiber whose stack is mapped by
+ *              MoPlatformFiberMapStack.
+ * @param InterruptContext The context of the page fault.
+ * @return If the page fault is on the guard page of the fiber, it returns
+ *         MO_RESULT_SUCCESS_OK. Otherwise, it returns
+ *         MO_RESULT_ERROR_NO_INTERFACE and the fault should be passed to the
+ *         next handler.
+ * @remarks The context is changed to resume on the top of the overflowed stack,
+ *          which marks the fiber as MO_PLATFORM_X64_FIBER_STATE_OVERFLOWED and
+ *          switches back to its caller, so MoPlatformFiberJoin returns
+ *          MO_RESULT_ERROR_UNEXPECTED. The page fault can only be delivered
+ *          on the exhausted stack if the page-fault gate uses an interrupt
+ *          stack table (IST) entry.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFiberHandleGuardPageFault(
+    _Mo_InOut_ PMO_PLATFORM_X64_FIBER Fiber,
+    _Mo_InOut_ PMO_PLATFORM_X64_INTERRUPT_CONTEXT InterruptContext);
+
+/**
+ * @brief Checks whether the canary values of the fiber stack are intact.
+ * @param Fiber The fiber to check.
+ * @return MO_TRUE if the canary values are intact or the fiber has no owned
+ *         stack, MO_FALSE if the stack has overflowed.
+ */
+MO_EXTERN_C MO_BOOL MOAPI MoPlatformFiberCheckStack(
+    _Mo_In_ PMO_PLATFORM_X64_FIBER Fiber);
+
+/**
+ * @brief Switches from the current fiber to the specified fiber.
+ * @param Current The current fiber, which must be running.
+ * @param Next The fiber to switch to, which must be ready.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK after the
+ *         current fiber is switched back. Otherwise, it returns an MO_RESULT
+ *         error code without switching.
+ * @remarks The function returns MO_RESULT_ERROR_UNEXPECTED if the stack of
+ *          either fiber has overflowed.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFiberSwitch(
+    _Mo_InOut_ PMO_PLATFORM_X64_FIBER Current,
+    _Mo_InOut_ PMO_PLATFORM_X64_FIBER Next);
+
+/**
+ * @brief Switches from the current fiber back to its caller.
+ * @param Current The current fiber, which must be running.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK after the
+ *         current fiber is switched back. Otherwise, it returns an MO_RESULT
+ *         error code without switching.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFiberYield(
+    _Mo_InOut_ PMO_PLATFORM_X64_FIBER Current);
+
+/**
+ * @brief Runs the specified fiber until it finishes.
+ * @param Current The current fiber, which must be running.
+ * @param Target The fiber to wait for.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The target fiber is switched to again each time it yields. If the
+ *          stack of the target fiber has overflowed, the function returns
+ *          MO_RESULT_ERROR_UNEXPECTED.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFiberJoin(
+    _Mo_InOut_ PMO_PLATFORM_X64_FIBER Current,
+    _Mo_InOut_ PMO_PLATFORM_X64_FIBER Target);
+
+#endif // !MOBILITY_PLATFORM_X64_FIBER
@@ -0,0 +1,359 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.Fpu.c
+ * PURPOSE:    Implementation for Mobility x64 Lazy FPU and SIMD State Switching
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Platform.x64.Fpu.h"
+
+#include "Mobility.Runtime.Core.h"
+
+#include <Mile.Mobility.Utilities.MemoryAccess.h>
+
+/**
+ * @brief The initial value of the x87 FPU control word, which masks all x87
+ *        floating-point exceptions and selects the extended precision.
+ */
+#define MO_PLATFORM_X64_FPU_INITIAL_CONTROL_WORD 0x037F
+
+/**
+ * @brief The initial value of MXCSR, which masks all SIMD floating-point
+ *        exceptions.
+ */
+#define MO_PLATFORM_X64_FPU_INITIAL_MXCSR 0x1F80
+
+static PMO_PLATFORM_X64_FPU_MANAGER MoPlatformFpuActiveManager = nullptr;
+
+MO_FORCEINLINE MO_BOOL MoPlatformFpuCheckContext(
+    _Mo_In_ PMO_PLATFORM_X64_FPU_MANAGER Manager,
+    _Mo_In_ PMO_PLATFORM_X64_FPU_CONTEXT Context)
+{
+    if (!Context || !Context->StateArea)
+    {
+        return MO_FALSE;
+    }
+
+    if ((MO_UINTN)(Context->StateArea) &
+        (MO_PLATFORM_X64_FPU_STATE_ALIGNMENT - 1))
+    {
+        return MO_FALSE;
+    }
+
+    return Context->StateAreaSize >= Manager->StateSize;
+}
+
+MO_FORCEINLINE MO_VOID MoPlatformFpuSaveState(
+    _Mo_In_ PMO_PLATFORM_X64_FPU_MANAGER Manager,
+    _Mo_In_ PMO_PLATFORM_X64_FPU_CONTEXT Context)
+{
+    switch (Manager->SaveMethod)
+    {
+    case MO_PLATFORM_X64_FPU_SAVE_METHOD_XSAVEOPT:
+        MoPlatformSaveExtendedStateOptimized(
+            Context->StateArea,
+            Manager->EnabledFeatures);
+        break;
+    case MO_PLATFORM_X64_FPU_SAVE_METHOD_XSAVE:
+        MoPlatformSaveExtendedState(
+            Context->StateArea,
+            Manager->EnabledFeatures);
+        break;
+    default:
+        MoPlatformSaveLegacyFloatingPointState(Context->StateArea);
+        break;
+    }
+}
+
+MO_FORCEINLINE MO_VOID MoPlatformFpuRestoreState(
+    _Mo_In_ PMO_PLATFORM_X64_FPU_MANAGER Manager,
+    _Mo_In_ PMO_PLATFORM_X64_FPU_CONTEXT Context)
+{
+    if (MO_PLATFORM_X64_FPU_SAVE_METHOD_FXSAVE == Manager->SaveMethod)
+    {
+        MoPlatformRestoreLegacyFloatingPointState(Context->StateArea);
+    }
+    else
+    {
+        MoPlatformRestoreExtendedState(
+            Context->StateArea,
+            Manager->EnabledFeatures);
+    }
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFpuInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_FPU_MANAGER Manager,
+    _Mo_In_ PMO_PLATFORM_X64_FPU_CONTEXT InitialContext)
+{
+    if (!Manager || !InitialContext)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (MO_RESULT_SUCCESS_OK != MoRuntimeMemoryFillByte(
+        Manager,
+        0,
+        sizeof(MO_PLATFORM_X64_FPU_MANAGER)))
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    MO_PLATFORM_X64_CPUID_RESULT CpuidResult;
+
+    MoPlatformReadCpuid(&CpuidResult, 0);
+    MO_UINT32 MaximumLeaf = CpuidResult.Eax;
+
+    // CPUID.01H:EDX.FXSR[bit 24] is always set on x64 processors, and
+    // CPUID.01H:ECX.XSAVE[bit 26] reports the XSAVE feature set.
+    MoPlatformReadCpuid(&CpuidResult, 1);
+    MO_BOOL XsaveSupported =
+        MaximumLeaf >= 0xD && (CpuidResult.Ecx & (1u << 26));
+
+    // CR0.MP makes WAIT/FWAIT also honor CR0.TS, and CR0.EM must be clear for
+    // the FPU and SIMD instructions to execute at all.
+    MO_UINT64 Cr0 = MoPlatformReadCr0();
+    Cr0 |= MO_PLATFORM_X64_CR0_MONITOR_COPROCESSOR;
+    Cr0 &= ~(MO_PLATFORM_X64_CR0_EMULATION | MO_PLATFORM_X64_CR0_TASK_SWITCHED);
+    MoPlatformWriteCr0(Cr0);
+
+    MO_UINT64 Cr4 = MoPlatformReadCr4();
+    Cr4 |= MO_PLATFORM_X64_CR4_OSFXSR | MO_PLATFORM_X64_CR4_OSXMMEXCPT;
+    if (XsaveSupported)
+    {
+        Cr4 |= MO_PLATFORM_X64_CR4_OSXSAVE;
+    }
+    MoPlatformWriteCr4(Cr4);
+
+    if (XsaveSupported)
+    {
+        // CPUID.(EAX=0DH,ECX=0):EDX:EAX reports the supported state components.
+        MoPlatformReadCpuidEx(&CpuidResult, 0xD, 0);
+        MO_UINT64 SupportedFeatures =
+            ((MO_UINT64)(CpuidResult.Edx) << 32) | CpuidResult.Eax;
+
+        MO_UINT64 EnabledFeatures =
+            MO_PLATFORM_X64_XSTATE_X87 | MO_PLATFORM_X64_XSTATE_SSE;
+        if (SupportedFeatures & MO_PLATFORM_X64_XSTATE_AVX)
+        {
+            EnabledFeatures |= MO_PLATFORM_X64_XSTATE_AVX;
+
+            // The AVX-512 state components can only be enabled together.
+            if (MO_PLATFORM_X64_XSTATE_AVX512 ==
+                (SupportedFeatures & MO_PLATFORM_X64_XSTATE_AVX512))
+            {
+                EnabledFeatures |= MO_PLATFORM_X64_XSTATE_AVX512;
+            }
+        }
+        MoPlatformWriteExtendedControlRegister(
+            MO_PLATFORM_X64_XCR_XFEATURE_ENABLED_MASK,
+            EnabledFeatures);
+        Manager->EnabledFeatures = EnabledFeatures;
+
+        // CPUID.(EAX=0DH,ECX=0):EBX reports the size of the XSAVE area for the
+        // state components currently enabled in XCR0.
+        MoPlatformReadCpuidEx(&CpuidResult, 0xD, 0);
+        Manager->StateSize = CpuidResult.Ebx;
+
+        // CPUID.(EAX=0DH,ECX=1):EAX[bit 0] reports the XSAVEOPT instruction.
+        MoPlatformReadCpuidEx(&CpuidResult, 0xD, 1);
+        Manager->SaveMethod = (CpuidResult.Eax & 0x1)
+            ? MO_PLATFORM_X64_FPU_SAVE_METHOD_XSAVEOPT
+            : MO_PLATFORM_X64_FPU_SAVE_METHOD_XSAVE;
+    }
+    else
+    {
+        Manager->EnabledFeatures =
+            MO_PLATFORM_X64_XSTATE_X87 | MO_PLATFORM_X64_XSTATE_SSE;
+        Manager->StateSize = MO_PLATFORM_X64_FPU_LEGACY_STATE_SIZE;
+        Manager->SaveMethod = MO_PLATFORM_X64_FPU_SAVE_METHOD_FXSAVE;
+    }
+
+    if (!MoPlatformFpuCheckContext(Manager, InitialContext))
+    {
+        return MO_RESULT_ERROR_OUT_OF_BOUNDS;
+    }
+
+    // The registers hold the state of the initial context, which is saved to
+    // its state area when another context uses the FPU for the first time.
+    Manager->Current = InitialContext;
+    Manager->Owner = InitialContext;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFpuInitializeContext(
+    _Mo_In_ PMO_PLATFORM_X64_FPU_MANAGER Manager,
+    _Mo_Out_ PMO_PLATFORM_X64_FPU_CONTEXT Context,
+    _Mo_In_ MO_POINTER StateArea,
+    _Mo_In_ MO_UINT32 StateAreaSize)
+{
+    if (!Manager || !Manager->StateSize || !Context)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    Context->StateArea = StateArea;
+    Context->StateAreaSize = StateAreaSize;
+    Context->Reserved = 0u;
+    if (!MoPlatformFpuCheckContext(Manager, Context))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    // The zeroed XSAVE header marks all extended state components as in their
+    // initial configuration, so only the legacy region needs the values which
+    // are different from zero.
+    if (MO_RESULT_SUCCESS_OK != MoRuntimeMemoryFillByte(
+        StateArea,
+        0,
+        Manager->StateSize))
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+    PMO_PLATFORM_X64_FXSAVE_AREA LegacyState =
+        (PMO_PLATFORM_X64_FXSAVE_AREA)(StateArea);
+    LegacyState->Fcw = MO_PLATFORM_X64_FPU_INITIAL_CONTROL_WORD;
+    LegacyState->MxCsr = MO_PLATFORM_X64_FPU_INITIAL_MXCSR;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFpuSwitchContext(
+    _Mo_In_ PMO_PLATFORM_X64_FPU_MANAGER Manager,
+    _Mo_In_ PMO_PLATFORM_X64_FPU_CONTEXT Context)
+{
+    if (!Manager || !Context)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    Manager->Current = Context;
+
+    MO_UINT64 Cr0 = MoPlatformReadCr0();
+    MO_UINT64 NewCr0 = (Manager->Owner == Context)
+        ? Cr0 & ~MO_PLATFORM_X64_CR0_TASK_SWITCHED
+        : Cr0 | MO_PLATFORM_X64_CR0_TASK_SWITCHED;
+    if (NewCr0 != Cr0)
+    {
+        MoPlatformWriteCr0(NewCr0);
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFpuResolveDeviceNotAvailable(
+    _Mo_In_ PMO_PLATFORM_X64_FPU_MANAGER Manager)
+{
+    if (!Manager || !Manager->Current)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MO_UINT64 Cr0 = MoPlatformReadCr0();
+    if (Cr0 & MO_PLATFORM_X64_CR0_EMULATION)
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+    MoPlatformWriteCr0(Cr0 & ~MO_PLATFORM_X64_CR0_TASK_SWITCHED);
+
+    if (Manager->Owner != Manager->Current)
+    {
+        if (Manager->Owner)
+        {
+            MoPlatformFpuSaveState(Manager, Manager->Owner);
+        }
+        MoPlatformFpuRestoreState(Manager, Manager->Current);
+        Manager->Owner = Manager->Current;
+        ++Manager->StateSwitches;
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+static MO_VOID MOAPI MoPlatformFpuDeviceNotAvailableHandler(
+    _Mo_In_ MO_PLATFORM_X64_INTERRUPT_TYPE InterruptType,
+    _Mo_In_ PMO_PLATFORM_X64_INTERRUPT_CONTEXT InterruptContext)
+{
+    PMO_PLATFORM_X64_FPU_MANAGER Manager = MoPlatformFpuActiveManager;
+    if (Manager)
+    {
+        // The registers still hold the state of the owner here, because the
+        // interrupt entry only saves them into the interrupt context, so this
+        // path must not use the FPU or SIMD instructions before the switch.
+        if (MO_RESULT_SUCCESS_OK == MoPlatformFpuResolveDeviceNotAvailable(
+            Manager))
+        {
+            // The interrupt exit restores CR0 and the legacy region from the
+            // interrupt context, so update both of them to keep the state which
+            // has just been restored.
+            InterruptContext->Cr0 &= ~MO_PLATFORM_X64_CR0_TASK_SWITCHED;
+            MoPlatformSaveLegacyFloatingPointState(
+                &InterruptContext->FxSaveState);
+            return;
+        }
+
+        if (Manager->PreviousHandler)
+        {
+            Manager->PreviousHandler(InterruptType, InterruptContext);
+            return;
+        }
+    }
+
+    // Returning from the handler will restart the faulting instruction and
+    // raise the same exception again, so halt the processor instead.
+    for (;;)
+    {
+        MoPlatformHalt();
+    }
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFpuInstallHandler(
+    _Mo_In_ PMO_PLATFORM_X64_FPU_MANAGER Manager,
+    _Mo_InOut_ PMO_PLATFORM_X64_INTERRUPT_HANDLER* InterruptHandlerTable)
+{
+    if (!Manager || !InterruptHandlerTable)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    if (MoPlatformFpuActiveManager)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    PMO_PLATFORM_X64_INTERRUPT_HANDLER* Entry =
+        &InterruptHandlerTable[MO_PLATFORM_X64_INTERRUPT_DEVICE_NOT_AVAILABLE];
+    Manager->PreviousHandler = *Entry;
+    MoPlatformFpuActiveManager = Manager;
+    MoMileCompilerBarrier();
+    *Entry = MoPlatformFpuDeviceNotAvailableHandler;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFpuUninstallHandler(
+    _Mo_In_ PMO_PLATFORM_X64_FPU_MANAGER Manager,
+    _Mo_InOut_ PMO_PLATFORM_X64_INTERRUPT_HANDLER* InterruptHandlerTable)
+{
+    if (!Manager || !InterruptHandlerTable)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    PMO_PLATFORM_X64_INTERRUPT_HANDLER* Entry =
+        &InterruptHandlerTable[MO_PLATFORM_X64_INTERRUPT_DEVICE_NOT_AVAILABLE];
+    if (MoPlatformFpuActiveManager != Manager ||
+        *Entry != MoPlatformFpuDeviceNotAvailableHandler)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    *Entry = Manager->PreviousHandler;
+    MoMileCompilerBarrier();
+    MoPlatformFpuActiveManager = nullptr;
+    Manager->PreviousHandler = nullptr;
+
+    return MO_RESULT_SUCCESS_OK;
+}
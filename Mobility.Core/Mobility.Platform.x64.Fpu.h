@@ -0,0 +1,241 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.Fpu.h
+ * PURPOSE:    Definition for Mobility x64 Lazy FPU and SIMD State Switching
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_PLATFORM_X64_FPU
+#define MOBILITY_PLATFORM_X64_FPU
+
+#include "Mobility.Platform.x64.h"
+
+/*
+ * The bits of the control registers used by the FPU and SIMD state management.
+ *
+ * @remark Intel(R) 64 and IA-32 Architectures Software Developer's Manual
+ *         (December 2023)
+ *           Volume 3 (3A, 3B, 3C, & 3D): System Programming Guide
+ *             2.5 Control Registers
+ */
+
+#define MO_PLATFORM_X64_CR0_MONITOR_COPROCESSOR 0x2ULL
+#define MO_PLATFORM_X64_CR0_EMULATION 0x4ULL
+#define MO_PLATFORM_X64_CR0_TASK_SWITCHED 0x8ULL
+#define MO_PLATFORM_X64_CR4_OSFXSR 0x200ULL
+#define MO_PLATFORM_X64_CR4_OSXMMEXCPT 0x400ULL
+#define MO_PLATFORM_X64_CR4_OSXSAVE 0x40000ULL
+
+/*
+ * The state components of the XSAVE feature set in XCR0.
+ *
+ * @remark Intel(R) 64 and IA-32 Architectures Software Developer's Manual
+ *         (December 2023)
+ *           Volume 1: Basic Architecture
+ *             13.1 XSAVE-Supported Features and State-Component Bitmaps
+ */
+
+#define MO_PLATFORM_X64_XSTATE_X87 0x1ULL
+#define MO_PLATFORM_X64_XSTATE_SSE 0x2ULL
+#define MO_PLATFORM_X64_XSTATE_AVX 0x4ULL
+#define MO_PLATFORM_X64_XSTATE_OPMASK 0x20ULL
+#define MO_PLATFORM_X64_XSTATE_ZMM_HI256 0x40ULL
+#define MO_PLATFORM_X64_XSTATE_HI16_ZMM 0x80ULL
+#define MO_PLATFORM_X64_XSTATE_AVX512 ( \
+    MO_PLATFORM_X64_XSTATE_OPMASK | \
+    MO_PLATFORM_X64_XSTATE_ZMM_HI256 | \
+    MO_PLATFORM_X64_XSTATE_HI16_ZMM)
+
+/**
+ * @brief The index of XCR0, the XSAVE feature enabled mask.
+ */
+#define MO_PLATFORM_X64_XCR_XFEATURE_ENABLED_MASK 0
+
+/**
+ * @brief The required alignment in bytes of the state save area.
+ */
+#define MO_PLATFORM_X64_FPU_STATE_ALIGNMENT 64
+
+/**
+ * @brief The size in bytes of the FXSAVE area, which is also the legacy region
+ *        at the beginning of the XSAVE area.
+ */
+#define MO_PLATFORM_X64_FPU_LEGACY_STATE_SIZE 512
+
+/*
+ * The instructions used for saving the FPU and SIMD state.
+ */
+
+#define MO_PLATFORM_X64_FPU_SAVE_METHOD_FXSAVE 0
+#define MO_PLATFORM_X64_FPU_SAVE_METHOD_XSAVE 1
+#define MO_PLATFORM_X64_FPU_SAVE_METHOD_XSAVEOPT 2
+
+/**
+ * @brief The FPU and SIMD state of an execution context, e.g. a thread.
+ */
+typedef struct _MO_PLATFORM_X64_FPU_CONTEXT
+{
+    /**
+     * @brief The state save area, which is MO_PLATFORM_X64_FPU_STATE_ALIGNMENT
+     *        aligned and holds at least StateSize bytes of the FPU manager.
+     */
+    MO_POINTER StateArea;
+    /**
+     * @brief The size in bytes of the state save area.
+     */
+    MO_UINT32 StateAreaSize;
+    MO_UINT32 Reserved;
+} MO_PLATFORM_X64_FPU_CONTEXT, *PMO_PLATFORM_X64_FPU_CONTEXT;
+
+/**
+ * @brief The FPU manager which switches the FPU and SIMD state lazily, so the
+ *        state is saved and restored only when another context actually uses
+ *        the FPU or SIMD instructions.
+ * @remark The registers belong to the owner context. After switching to
+ *         another context, CR0.TS is set, and the first FPU or SIMD instruction
+ *         raises the device-not-available exception (#NM), whose handler saves
+ *         the state of the owner and restores the state of the current context.
+ */
+typedef struct _MO_PLATFORM_X64_FPU_MANAGER
+{
+    /**
+     * @brief The state components enabled in XCR0, or the x87 and SSE
+     *        components if the XSAVE feature set is not supported.
+     */
+    MO_UINT64 EnabledFeatures;
+    /**
+     * @brief The size in bytes of the state save area required for the enabled
+     *        state components.
+     */
+    MO_UINT32 StateSize;
+    /**
+     * @brief The MO_PLATFORM_X64_FPU_SAVE_METHOD_* instruction used for saving
+     *        the state.
+     */
+    MO_UINT32 SaveMethod;
+    /**
+     * @brief The context which is running on the processor.
+     */
+    PMO_PLATFORM_X64_FPU_CONTEXT Current;
+    /**
+     * @brief The context whose state is held in the registers.
+     */
+    PMO_PLATFORM_X64_FPU_CONTEXT Owner;
+    /**
+     * @brief The device-not-available handler which was installed before the
+     *        FPU handler, which receives the exceptions not resolved by the FPU
+     *        manager.
+     */
+    PMO_PLATFORM_X64_INTERRUPT_HANDLER PreviousHandler;
+    /**
+     * @brief The number of the state switches performed by the FPU manager.
+     */
+    MO_UINT64 StateSwitches;
+} MO_PLATFORM_X64_FPU_MANAGER, *PMO_PLATFORM_X64_FPU_MANAGER;
+
+/**
+ * @brief Initializes the FPU manager, enables the XSAVE feature set and all
+ *        supported state components up to AVX-512 on the current processor, and
+ *        makes the specified context the owner of the current state.
+ * @param Manager The FPU manager to be initialized.
+ * @param InitialContext The context which is running on the processor, whose
+ *                       state area must be large enough for the StateSize
+ *                       member after the initialization.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The state save area size is enumerated by CPUID leaf 0DH after XCR0
+ *          is written. If the XSAVE feature set is not supported, the 512-byte
+ *          FXSAVE area is used instead.
+ *          If the state area of the initial context is too small, the function
+ *          returns MO_RESULT_ERROR_OUT_OF_BOUNDS, and the StateSize member is
+ *          still valid for allocating a larger one.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFpuInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_FPU_MANAGER Manager,
+    _Mo_In_ PMO_PLATFORM_X64_FPU_CONTEXT InitialContext);
+
+/**
+ * @brief Initializes the context with the specified state save area, which is
+ *        filled with the initial FPU and SIMD state.
+ * @param Manager The FPU manager.
+ * @param Context The context to be initialized.
+ * @param StateArea The state save area, which must be
+ *                  MO_PLATFORM_X64_FPU_STATE_ALIGNMENT aligned.
+ * @param StateAreaSize The size in bytes of the state save area, which must be
+ *                      at least the StateSize member of the FPU manager.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFpuInitializeContext(
+    _Mo_In_ PMO_PLATFORM_X64_FPU_MANAGER Manager,
+    _Mo_Out_ PMO_PLATFORM_X64_FPU_CONTEXT Context,
+    _Mo_In_ MO_POINTER StateArea,
+    _Mo_In_ MO_UINT32 StateAreaSize);
+
+/**
+ * @brief Switches the current context of the FPU manager without touching the
+ *        FPU and SIMD state, which is deferred to the first use of the FPU or
+ *        SIMD instructions in the new context.
+ * @param Manager The FPU manager.
+ * @param Context The context which will run on the processor.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks CR0.TS is set if the new context is not the owner of the state, and
+ *          is cleared otherwise, so switching back to the owner costs nothing.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFpuSwitchContext(
+    _Mo_In_ PMO_PLATFORM_X64_FPU_MANAGER Manager,
+    _Mo_In_ PMO_PLATFORM_X64_FPU_CONTEXT Context);
+
+/**
+ * @brief Saves the state of the owner context and restores the state of the
+ *        current context, which makes the current context the owner.
+ * @param Manager The FPU manager.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks CR0.TS is cleared by this function. If CR0.EM is set, the exception
+ *          is not caused by the lazy state switching, and the function returns
+ *          MO_RESULT_ERROR_NO_INTERFACE.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFpuResolveDeviceNotAvailable(
+    _Mo_In_ PMO_PLATFORM_X64_FPU_MANAGER Manager);
+
+/**
+ * @brief Installs the device-not-available (#NM) handler to the specified
+ *        interrupt handler table, and the exceptions not resolved will be
+ *        passed to the previously installed handler.
+ * @param Manager The FPU manager used by the device-not-available handler.
+ * @param InterruptHandlerTable The interrupt handler table which is also used
+ *                              as MoPlatformInterruptHandlerTable.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks Only one FPU manager can be installed at the same time. The vector
+ *          must use the MO_PLATFORM_X64_INTERRUPT_ENTRY_FULL entry tier, and
+ *          the handlers of the MO_PLATFORM_X64_INTERRUPT_ENTRY_LIGHTWEIGHT
+ *          entry tier must not use the x87 FPU or MMX instructions.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFpuInstallHandler(
+    _Mo_In_ PMO_PLATFORM_X64_FPU_MANAGER Manager,
+    _Mo_InOut_ PMO_PLATFORM_X64_INTERRUPT_HANDLER* InterruptHandlerTable);
+
+/**
+ * @brief Uninstalls the device-not-available (#NM) handler from the specified
+ *        interrupt handler table, and restores the previously installed
+ *        handler.
+ * @param Manager The FPU manager installed by MoPlatformFpuInstallHandler.
+ * @param InterruptHandlerTable The interrupt handler table passed to
+ *                              MoPlatformFpuInstallHandler.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The caller should make the initial context the owner and clear
+ *          CR0.TS before uninstalling, because the device-not-available
+ *          exceptions are no longer resolved after that.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformFpuUninstallHandler(
+    _Mo_In_ PMO_PLATFORM_X64_FPU_MANAGER Manager,
+    _Mo_InOut_ PMO_PLATFORM_X64_INTERRUPT_HANDLER* InterruptHandlerTable);
+
+#endif // !MOBILITY_PLATFORM_X64_FPU
@@ -0,0 +1,244 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.InterruptStatistics.c
+ * PURPOSE:    Implementation for Mobility x64 Interrupt Statistics
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Platform.x64.InterruptStatistics.h"
+
+#include "Mobility.Platform.x64.Smp.h"
+#include "Mobility.Runtime.Core.h"
+#include "Mobility.Synchronization.Atomic.h"
+
+#if MO_PLATFORM_X64_INTERRUPT_STATISTICS
+
+/**
+ * @brief The PMO_PLATFORM_X64_PROCESSOR_INTERRUPT_STATISTICS array, or nullptr
+ *        if the statistics are not initialized.
+ */
+static MO_POINTER volatile MoPlatformInterruptStatisticsProcessors = nullptr;
+
+static MO_UINT32 volatile MoPlatformInterruptStatisticsProcessorCount = 0;
+
+/**
+ * @brief Loads the published array, and the number of its entries, which is
+ *        published before the array.
+ */
+MO_FORCEINLINE PMO_PLATFORM_X64_PROCESSOR_INTERRUPT_STATISTICS
+MoPlatformInterruptStatisticsGetProcessors(
+    _Mo_Out_ PMO_UINT32 ProcessorCount)
+{
+    PMO_PLATFORM_X64_PROCESSOR_INTERRUPT_STATISTICS Processors =
+        (PMO_PLATFORM_X64_PROCESSOR_INTERRUPT_STATISTICS)MoAtomicLoadPointer(
+            &MoPlatformInterruptStatisticsProcessors,
+            MO_ATOMIC_ORDER_ACQUIRE);
+    *ProcessorCount = MoAtomicLoad32(
+        &MoPlatformInterruptStatisticsProcessorCount,
+        MO_ATOMIC_ORDER_RELAXED);
+    return Processors;
+}
+
+MO_FORCEINLINE MO_UINT32 MoPlatformInterruptStatisticsGetBucket(
+    _Mo_In_ MO_UINT64 Cycles)
+{
+    // The floor of the base-2 logarithm by binary search, which does not need
+    // any intrinsic.
+    MO_UINT32 Bucket = 0;
+    for (MO_UINT32 Shift = 32; Shift; Shift >>= 1)
+    {
+        if (Cycles >> Shift)
+        {
+            Cycles >>= Shift;
+            Bucket += Shift;
+        }
+    }
+    if (Bucket >= MO_PLATFORM_X64_INTERRUPT_STATISTICS_BUCKET_COUNT)
+    {
+        Bucket = MO_PLATFORM_X64_INTERRUPT_STATISTICS_BUCKET_COUNT - 1;
+    }
+    return Bucket;
+}
+
+#endif // MO_PLATFORM_X64_INTERRUPT_STATISTICS
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformInterruptStatisticsInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_PROCESSOR_INTERRUPT_STATISTICS Processors,
+    _Mo_In_ MO_UINT32 ProcessorCount)
+{
+#if MO_PLATFORM_X64_INTERRUPT_STATISTICS
+    if (!Processors || !ProcessorCount)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MoRuntimeMemoryFillByte(
+        Processors,
+        0,
+        ProcessorCount * sizeof(MO_PLATFORM_X64_PROCESSOR_INTERRUPT_STATISTICS));
+
+    // Publish the count before the array, so the entry points never see the
+    // array with a stale count.
+    MO_UINTN PreviousState = MoPlatformSaveAndDisableInterrupts();
+    MoAtomicStorePointer(
+        &MoPlatformInterruptStatisticsProcessors,
+        nullptr,
+        MO_ATOMIC_ORDER_RELEASE);
+    MoAtomicStore32(
+        &MoPlatformInterruptStatisticsProcessorCount,
+        ProcessorCount,
+        MO_ATOMIC_ORDER_RELEASE);
+    MoAtomicStorePointer(
+        &MoPlatformInterruptStatisticsProcessors,
+        Processors,
+        MO_ATOMIC_ORDER_RELEASE);
+    MoPlatformRestoreInterrupts(PreviousState);
+
+    return MO_RESULT_SUCCESS_OK;
+#else
+    MO_UNREFERENCED_PARAMETER(Processors);
+    MO_UNREFERENCED_PARAMETER(ProcessorCount);
+    return MO_RESULT_ERROR_NOT_IMPLEMENTED;
+#endif // MO_PLATFORM_X64_INTERRUPT_STATISTICS
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformInterruptStatisticsRecord(
+    _Mo_In_ MO_PLATFORM_X64_INTERRUPT_TYPE InterruptType,
+    _Mo_In_ MO_UINT64 StartTimeStamp)
+{
+#if MO_PLATFORM_X64_INTERRUPT_STATISTICS
+    MO_UINT64 EndTimeStamp = MoPlatformReadTimeStampCounter();
+
+    MO_UINT32 ProcessorCount = 0;
+    PMO_PLATFORM_X64_PROCESSOR_INTERRUPT_STATISTICS Processors =
+        MoPlatformInterruptStatisticsGetProcessors(&ProcessorCount);
+    if (!Processors)
+    {
+        return;
+    }
+
+    // The processor block is not loaded if there is only one processor, such
+    // as running before exiting the boot services.
+    MO_UINT32 ProcessorIndex = 0;
+    if (ProcessorCount > 1)
+    {
+        ProcessorIndex =
+            MoPlatformGetCurrentProcessorBlock()->ProcessorIndex;
+        if (ProcessorIndex >= ProcessorCount)
+        {
+            return;
+        }
+    }
+
+    // Only the current processor writes its statistics with the interrupts
+    // disabled, so no atomic operation is needed.
+    PMO_PLATFORM_X64_INTERRUPT_VECTOR_STATISTICS Statistics =
+        &Processors[ProcessorIndex].Vectors[(MO_UINT8)InterruptType];
+    MO_UINT64 Cycles = EndTimeStamp - StartTimeStamp;
+    ++Statistics->Count;
+    Statistics->TotalCycles += Cycles;
+    if (Cycles > Statistics->MaximumCycles)
+    {
+        Statistics->MaximumCycles = Cycles;
+    }
+    ++Statistics->Histogram[MoPlatformInterruptStatisticsGetBucket(Cycles)];
+#else
+    MO_UNREFERENCED_PARAMETER(InterruptType);
+    MO_UNREFERENCED_PARAMETER(StartTimeStamp);
+#endif // MO_PLATFORM_X64_INTERRUPT_STATISTICS
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformInterruptStatisticsQuery(
+    _Mo_Out_ PMO_PLATFORM_X64_INTERRUPT_VECTOR_STATISTICS Statistics,
+    _Mo_In_ MO_PLATFORM_X64_INTERRUPT_TYPE InterruptType,
+    _Mo_In_ MO_UINT32 ProcessorIndex)
+{
+#if MO_PLATFORM_X64_INTERRUPT_STATISTICS
+    if (!Statistics ||
+        InterruptType < 0 ||
+        InterruptType >= MO_PLATFORM_X64_INTERRUPT_STATISTICS_VECTOR_COUNT)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MO_UINT32 ProcessorCount = 0;
+    PMO_PLATFORM_X64_PROCESSOR_INTERRUPT_STATISTICS Processors =
+        MoPlatformInterruptStatisticsGetProcessors(&ProcessorCount);
+    if (!Processors)
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    MO_UINT32 First = 0;
+    MO_UINT32 Last = ProcessorCount;
+    if (MO_PLATFORM_X64_INTERRUPT_STATISTICS_ALL_PROCESSORS != ProcessorIndex)
+    {
+        if (ProcessorIndex >= Last)
+        {
+            return MO_RESULT_ERROR_OUT_OF_BOUNDS;
+        }
+        First = ProcessorIndex;
+        Last = ProcessorIndex + 1;
+    }
+
+    MoRuntimeMemoryFillByte(
+        Statistics,
+        0,
+        sizeof(MO_PLATFORM_X64_INTERRUPT_VECTOR_STATISTICS));
+    for (MO_UINT32 Index = First; Index < Last; ++Index)
+    {
+        PMO_PLATFORM_X64_INTERRUPT_VECTOR_STATISTICS Current =
+            &Processors[Index].Vectors[InterruptType];
+        Statistics->Count += Current->Count;
+        Statistics->TotalCycles += Current->TotalCycles;
+        if (Current->MaximumCycles > Statistics->MaximumCycles)
+        {
+            Statistics->MaximumCycles = Current->MaximumCycles;
+        }
+        for (MO_UINT32 Bucket = 0;
+            Bucket < MO_PLATFORM_X64_INTERRUPT_STATISTICS_BUCKET_COUNT;
+            ++Bucket)
+        {
+            Statistics->Histogram[Bucket] += Current->Histogram[Bucket];
+        }
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+#else
+    MO_UNREFERENCED_PARAMETER(Statistics);
+    MO_UNREFERENCED_PARAMETER(InterruptType);
+    MO_UNREFERENCED_PARAMETER(ProcessorIndex);
+    return MO_RESULT_ERROR_NOT_IMPLEMENTED;
+#endif // MO_PLATFORM_X64_INTERRUPT_STATISTICS
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformInterruptStatisticsReset()
+{
+#if MO_PLATFORM_X64_INTERRUPT_STATISTICS
+    MO_UINT32 ProcessorCount = 0;
+    PMO_PLATFORM_X64_PROCESSOR_INTERRUPT_STATISTICS Processors =
+        MoPlatformInterruptStatisticsGetProcessors(&ProcessorCount);
+    if (!Processors)
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    // The statistics of the other processors can be updated meanwhile, so a
+    // few invocations can survive the reset, which is acceptable for the
+    // diagnostics.
+    MO_UINTN PreviousState = MoPlatformSaveAndDisableInterrupts();
+    MoRuntimeMemoryFillByte(
+        Processors,
+        0,
+        ProcessorCount *
+        sizeof(MO_PLATFORM_X64_PROCESSOR_INTERRUPT_STATISTICS));
+    MoPlatformRestoreInterrupts(PreviousState);
+
+    return MO_RESULT_SUCCESS_OK;
+#else
+    return MO_RESULT_ERROR_NOT_IMPLEMENTED;
+#endif // MO_PLATFORM_X64_INTERRUPT_STATISTICS
+}
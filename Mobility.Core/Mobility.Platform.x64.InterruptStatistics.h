@@ -0,0 +1,139 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.InterruptStatistics.h
+ * PURPOSE:    Definition for Mobility x64 Interrupt Statistics
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_PLATFORM_X64_INTERRUPTSTATISTICS
+#define MOBILITY_PLATFORM_X64_INTERRUPTSTATISTICS
+
+#include "Mobility.Platform.x64.h"
+
+/**
+ * @brief Defined as 1 to make the interrupt entry points record the interrupt
+ *        statistics. It must be defined for both the C sources and the
+ *        assembly source, and the entry points do nothing extra if it is 0.
+ */
+#ifndef MO_PLATFORM_X64_INTERRUPT_STATISTICS
+#define MO_PLATFORM_X64_INTERRUPT_STATISTICS 0
+#endif // !MO_PLATFORM_X64_INTERRUPT_STATISTICS
+
+/**
+ * @brief The number of the interrupt vectors.
+ */
+#define MO_PLATFORM_X64_INTERRUPT_STATISTICS_VECTOR_COUNT 256
+
+/**
+ * @brief The number of the buckets of the handler duration histogram. The
+ *        bucket N counts the durations in [2^N, 2^(N+1)) cycles, except that
+ *        the bucket 0 also counts the zero duration and the last bucket also
+ *        counts all longer durations.
+ */
+#define MO_PLATFORM_X64_INTERRUPT_STATISTICS_BUCKET_COUNT 32
+
+/**
+ * @brief The processor index used for querying the sum of all processors.
+ */
+#define MO_PLATFORM_X64_INTERRUPT_STATISTICS_ALL_PROCESSORS 0xFFFFFFFF
+
+/**
+ * @brief The statistics of an interrupt vector.
+ */
+typedef struct _MO_PLATFORM_X64_INTERRUPT_VECTOR_STATISTICS
+{
+    /**
+     * @brief The number of the times the entry point is invoked for the vector.
+     */
+    MO_UINT64 Count;
+    /**
+     * @brief The total duration in the Time Stamp Counter (TSC) cycles.
+     */
+    MO_UINT64 TotalCycles;
+    /**
+     * @brief The maximum duration in the Time Stamp Counter (TSC) cycles.
+     */
+    MO_UINT64 MaximumCycles;
+    /**
+     * @brief The handler duration histogram, whose buckets are described in
+     *        MO_PLATFORM_X64_INTERRUPT_STATISTICS_BUCKET_COUNT.
+     */
+    MO_UINT32 Histogram[MO_PLATFORM_X64_INTERRUPT_STATISTICS_BUCKET_COUNT];
+} MO_PLATFORM_X64_INTERRUPT_VECTOR_STATISTICS,
+*PMO_PLATFORM_X64_INTERRUPT_VECTOR_STATISTICS;
+
+/**
+ * @brief The interrupt statistics of a processor.
+ */
+typedef struct _MO_PLATFORM_X64_PROCESSOR_INTERRUPT_STATISTICS
+{
+    /**
+     * @brief The statistics of each interrupt vector.
+     */
+    MO_PLATFORM_X64_INTERRUPT_VECTOR_STATISTICS Vectors[
+        MO_PLATFORM_X64_INTERRUPT_STATISTICS_VECTOR_COUNT];
+} MO_PLATFORM_X64_PROCESSOR_INTERRUPT_STATISTICS,
+*PMO_PLATFORM_X64_PROCESSOR_INTERRUPT_STATISTICS;
+
+/**
+ * @brief Initializes the interrupt statistics and starts recording.
+ * @param Processors The interrupt statistics array, which must have
+ *                   ProcessorCount entries and stay valid while recording.
+ * @param ProcessorCount The number of the processors.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. If the
+ *         interrupt statistics are not enabled at compile time, it returns
+ *         MO_RESULT_ERROR_NOT_IMPLEMENTED. Otherwise, it returns an MO_RESULT
+ *         error code.
+ * @remarks The processor block of each processor must be loaded before the
+ *          interrupts are delivered to it if ProcessorCount is greater than 1.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformInterruptStatisticsInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_PROCESSOR_INTERRUPT_STATISTICS Processors,
+    _Mo_In_ MO_UINT32 ProcessorCount);
+
+/**
+ * @brief Records an invocation of the interrupt handler. It is called by the
+ *        interrupt entry points with the interrupts disabled.
+ * @param InterruptType The interrupt vector.
+ * @param StartTimeStamp The Time Stamp Counter (TSC) value read before calling
+ *                       the interrupt handler.
+ * @remarks The duration includes the nested interrupts if the handler enables
+ *          the interrupts. The function must not use the x87 or MMX
+ *          registers, because it is also called by the lightweight entry.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformInterruptStatisticsRecord(
+    _Mo_In_ MO_PLATFORM_X64_INTERRUPT_TYPE InterruptType,
+    _Mo_In_ MO_UINT64 StartTimeStamp);
+
+/**
+ * @brief Queries the statistics of an interrupt vector.
+ * @param Statistics The statistics of the vector.
+ * @param InterruptType The interrupt vector.
+ * @param ProcessorIndex The index of the processor, or
+ *                       MO_PLATFORM_X64_INTERRUPT_STATISTICS_ALL_PROCESSORS for
+ *                       the sum of all processors.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. If the
+ *         interrupt statistics are not enabled at compile time, it returns
+ *         MO_RESULT_ERROR_NOT_IMPLEMENTED. Otherwise, it returns an MO_RESULT
+ *         error code.
+ * @remarks The statistics are not read atomically, so the result can be
+ *          slightly inconsistent if the interrupts are delivered meanwhile.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformInterruptStatisticsQuery(
+    _Mo_Out_ PMO_PLATFORM_X64_INTERRUPT_VECTOR_STATISTICS Statistics,
+    _Mo_In_ MO_PLATFORM_X64_INTERRUPT_TYPE InterruptType,
+    _Mo_In_ MO_UINT32 ProcessorIndex);
+
+/**
+ * @brief Resets the statistics of all interrupt vectors of all processors.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. If the
+ *         interrupt statistics are not enabled at compile time, it returns
+ *         MO_RESULT_ERROR_NOT_IMPLEMENTED. Otherwise, it returns an MO_RESULT
+ *         error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformInterruptStatisticsReset();
+
+#endif // !MOBILITY_PLATFORM_X64_INTERRUPTSTATISTICS
@@ -0,0 +1,593 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.PageTable.c
+ * PURPOSE:    Implementation for Mobility x64 Page Table Builder
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Platform.x64.PageTable.h"
+
+#include "Mobility.Platform.x64.Pcid.h"
+#include "Mobility.Runtime.Core.h"
+
+MO_FORCEINLINE PMO_PLATFORM_X64_PAGE_TABLE_ENTRY MoPlatformPageTableGetTable(
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder,
+    _Mo_In_ MO_UINT64 PhysicalAddress)
+{
+    if (Builder->TranslateAddress)
+    {
+        return (PMO_PLATFORM_X64_PAGE_TABLE_ENTRY)(Builder->TranslateAddress(
+            PhysicalAddress,
+            Builder->Context));
+    }
+
+    return (PMO_PLATFORM_X64_PAGE_TABLE_ENTRY)((MO_UINTN)(PhysicalAddress));
+}
+
+MO_FORCEINLINE MO_RESULT MoPlatformPageTableAllocateTable(
+    _Mo_Out_ PMO_UINT64 PhysicalAddress,
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder)
+{
+    MO_UINT64 CandidateAddress = 0u;
+    if (MO_RESULT_SUCCESS_OK != Builder->AllocatePage(
+        &CandidateAddress,
+        Builder->Context))
+    {
+        return MO_RESULT_ERROR_OUT_OF_MEMORY;
+    }
+    if (!CandidateAddress ||
+        (CandidateAddress & (MO_PLATFORM_X64_PAGE_SIZE_4K - 1)))
+    {
+        // Paging structures must be 4 KiB aligned.
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    PMO_PLATFORM_X64_PAGE_TABLE_ENTRY Table = MoPlatformPageTableGetTable(
+        Builder,
+        CandidateAddress);
+    if (!Table)
+    {
+        return MO_RESULT_ERROR_INVALID_POINTER;
+    }
+
+    if (MO_RESULT_SUCCESS_OK != MoRuntimeMemoryFillByte(
+        Table,
+        0u,
+        MO_PLATFORM_X64_PAGE_SIZE_4K))
+    {
+        // This function should not fail here.
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    ++Builder->AllocatedTables;
+    *PhysicalAddress = CandidateAddress;
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_FORCEINLINE MO_PLATFORM_X64_PAGE_TABLE_ENTRY MoPlatformPageTableMakeLeafEntry(
+    _Mo_In_ MO_UINT64 PhysicalAddress,
+    _Mo_In_ MO_UINT64 PageSize,
+    _Mo_In_ MO_UINT32 Attributes,
+    _Mo_In_ MO_UINT8 CacheType)
+{
+    MO_PLATFORM_X64_PAGE_TABLE_ENTRY Entry;
+    Entry.RawData = 0u;
+
+    Entry.P = 1;
+    Entry.RW = (Attributes & MO_PLATFORM_X64_PAGE_ATTRIBUTE_WRITABLE) ? 1 : 0;
+    Entry.US = (Attributes & MO_PLATFORM_X64_PAGE_ATTRIBUTE_USER) ? 1 : 0;
+    Entry.PWT = (CacheType >> 0) & 1;
+    Entry.PCD = (CacheType >> 1) & 1;
+    Entry.G = (Attributes & MO_PLATFORM_X64_PAGE_ATTRIBUTE_GLOBAL) ? 1 : 0;
+    Entry.XD = (Attributes & MO_PLATFORM_X64_PAGE_ATTRIBUTE_NO_EXECUTE) ? 1 : 0;
+
+    if (MO_PLATFORM_X64_PAGE_SIZE_1G == PageSize)
+    {
+        Entry.PS_1G = 1;
+        Entry.PAT_1G = (CacheType >> 2) & 1;
+        Entry.PageFrameNumber_1G = PhysicalAddress >> 30;
+    }
+    else if (MO_PLATFORM_X64_PAGE_SIZE_2M == PageSize)
+    {
+        Entry.PS_2M = 1;
+        Entry.PAT_2M = (CacheType >> 2) & 1;
+        Entry.PageFrameNumber_2M = PhysicalAddress >> 21;
+    }
+    else
+    {
+        Entry.PAT_4K = (CacheType >> 2) & 1;
+        Entry.PageFrameNumber_4K = PhysicalAddress >> 12;
+    }
+
+    return Entry;
+}
+
+MO_FORCEINLINE MO_VOID MoPlatformPageTableDecodeLeafEntry(
+    _Mo_Out_ PMO_UINT64 PhysicalAddress,
+    _Mo_Out_ PMO_UINT32 Attributes,
+    _Mo_Out_ PMO_UINT8 CacheType,
+    _Mo_In_ MO_PLATFORM_X64_PAGE_TABLE_ENTRY Entry,
+    _Mo_In_ MO_UINT64 PageSize)
+{
+    MO_UINT8 PatBit = 0;
+    if (MO_PLATFORM_X64_PAGE_SIZE_1G == PageSize)
+    {
+        *PhysicalAddress = ((MO_UINT64)Entry.PageFrameNumber_1G) << 30;
+        PatBit = (MO_UINT8)Entry.PAT_1G;
+    }
+    else if (MO_PLATFORM_X64_PAGE_SIZE_2M == PageSize)
+    {
+        *PhysicalAddress = ((MO_UINT64)Entry.PageFrameNumber_2M) << 21;
+        PatBit = (MO_UINT8)Entry.PAT_2M;
+    }
+    else
+    {
+        *PhysicalAddress = ((MO_UINT64)Entry.PageFrameNumber_4K) << 12;
+        PatBit = (MO_UINT8)Entry.PAT_4K;
+    }
+
+    *Attributes = 0;
+    if (Entry.RW)
+    {
+        *Attributes |= MO_PLATFORM_X64_PAGE_ATTRIBUTE_WRITABLE;
+    }
+    if (Entry.US)
+    {
+        *Attributes |= MO_PLATFORM_X64_PAGE_ATTRIBUTE_USER;
+    }
+    if (Entry.XD)
+    {
+        *Attributes |= MO_PLATFORM_X64_PAGE_ATTRIBUTE_NO_EXECUTE;
+    }
+    if (Entry.G)
+    {
+        *Attributes |= MO_PLATFORM_X64_PAGE_ATTRIBUTE_GLOBAL;
+    }
+
+    *CacheType = (MO_UINT8)((PatBit << 2) | (Entry.PCD << 1) | Entry.PWT);
+}
+
+MO_FORCEINLINE MO_PLATFORM_X64_PAGE_TABLE_ENTRY MoPlatformPageTableMakeTableEntry(
+    _Mo_In_ MO_UINT64 PhysicalAddress)
+{
+    // The access rights of the referencing entries are kept permissive, and
+    // the leaf entries decide the effective access rights.
+    MO_PLATFORM_X64_PAGE_DIRECTORY_ENTRY Entry;
+    Entry.RawData = 0u;
+    Entry.P = 1;
+    Entry.RW = 1;
+    Entry.US = 1;
+    Entry.PageTableAddress = PhysicalAddress >> 12;
+
+    MO_PLATFORM_X64_PAGE_TABLE_ENTRY Result;
+    Result.RawData = Entry.RawData;
+    return Result;
+}
+
+MO_FORCEINLINE MO_RESULT MoPlatformPageTableGetNextTable(
+    _Mo_Out_ PMO_PLATFORM_X64_PAGE_TABLE_ENTRY* NextTable,
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder,
+    _Mo_InOut_ PMO_PLATFORM_X64_PAGE_TABLE_ENTRY Entry,
+    _Mo_In_ MO_UINT64 EntryPageSize)
+{
+    MO_RESULT Result = MO_RESULT_SUCCESS_OK;
+
+    if (!Entry->P)
+    {
+        MO_UINT64 TableAddress = 0u;
+        Result = MoPlatformPageTableAllocateTable(&TableAddress, Builder);
+        if (MO_RESULT_SUCCESS_OK != Result)
+        {
+            return Result;
+        }
+
+        Entry->RawData = MoPlatformPageTableMakeTableEntry(
+            TableAddress).RawData;
+    }
+    else if (EntryPageSize && Entry->PS_2M)
+    {
+        // Split the large page into the next level paging structure with the
+        // same attributes before replacing the entry, so the range mapped by
+        // the original large page keeps valid all the time.
+
+        MO_UINT64 LargePageAddress = 0u;
+        MO_UINT32 Attributes = 0u;
+        MO_UINT8 CacheType = 0u;
+        MoPlatformPageTableDecodeLeafEntry(
+            &LargePageAddress,
+            &Attributes,
+            &CacheType,
+            *Entry,
+            EntryPageSize);
+
+        MO_UINT64 TableAddress = 0u;
+        Result = MoPlatformPageTableAllocateTable(&TableAddress, Builder);
+        if (MO_RESULT_SUCCESS_OK != Result)
+        {
+            return Result;
+        }
+        PMO_PLATFORM_X64_PAGE_TABLE_ENTRY Table = MoPlatformPageTableGetTable(
+            Builder,
+            TableAddress);
+
+        MO_UINT64 ChildPageSize =
+            EntryPageSize / MO_PLATFORM_X64_PAGE_TABLE_ENTRY_COUNT;
+        for (MO_UINTN i = 0; i < MO_PLATFORM_X64_PAGE_TABLE_ENTRY_COUNT; ++i)
+        {
+            Table[i] = MoPlatformPageTableMakeLeafEntry(
+                LargePageAddress + (i * ChildPageSize),
+                ChildPageSize,
+                Attributes,
+                CacheType);
+        }
+
+        Entry->RawData = MoPlatformPageTableMakeTableEntry(
+            TableAddress).RawData;
+    }
+
+    MO_PLATFORM_X64_PAGE_DIRECTORY_ENTRY DirectoryEntry;
+    DirectoryEntry.RawData = Entry->RawData;
+    *NextTable = MoPlatformPageTableGetTable(
+        Builder,
+        ((MO_UINT64)DirectoryEntry.PageTableAddress) << 12);
+    if (!*NextTable)
+    {
+        return MO_RESULT_ERROR_INVALID_POINTER;
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_FORCEINLINE MO_BOOL MoPlatformPageTableIsCanonicalAddress(
+    _Mo_In_ MO_UINT64 VirtualAddress)
+{
+    // Bits 63:47 must be all zeros or all ones for 4-level paging.
+    MO_UINT64 UpperBits = VirtualAddress >> 47;
+    return (0u == UpperBits || 0x1FFFFu == UpperBits) ? MO_TRUE : MO_FALSE;
+}
+
+MO_FORCEINLINE MO_BOOL MoPlatformPageTableCanMapLargePage(
+    _Mo_In_ MO_UINT64 VirtualAddress,
+    _Mo_In_ MO_UINT64 PhysicalAddress,
+    _Mo_In_ MO_UINT64 RemainingLength,
+    _Mo_In_ MO_UINT64 PageSize)
+{
+    if (RemainingLength < PageSize)
+    {
+        return MO_FALSE;
+    }
+    if ((VirtualAddress | PhysicalAddress) & (PageSize - 1))
+    {
+        return MO_FALSE;
+    }
+    return MO_TRUE;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformPageTableInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder,
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_ALLOCATE_ROUTINE AllocatePage,
+    _Mo_In_Opt_ PMO_PLATFORM_X64_PAGE_TABLE_TRANSLATE_ROUTINE TranslateAddress,
+    _Mo_In_Opt_ MO_POINTER Context,
+    _Mo_In_ MO_BOOL Allow1GiBPages)
+{
+    if (!Builder || !AllocatePage)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    if (MO_RESULT_SUCCESS_OK != MoRuntimeMemoryFillByte(
+        Builder,
+        0u,
+        sizeof(MO_PLATFORM_X64_PAGE_TABLE_BUILDER)))
+    {
+        // This function should not fail here.
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    Builder->AllocatePage = AllocatePage;
+    Builder->TranslateAddress = TranslateAddress;
+    Builder->Context = Context;
+    Builder->Allow1GiBPages = Allow1GiBPages;
+
+    return MoPlatformPageTableAllocateTable(
+        &Builder->PageMapLevel4Address,
+        Builder);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformPageTableMapRange(
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder,
+    _Mo_In_ MO_UINT64 VirtualAddress,
+    _Mo_In_ MO_UINT64 PhysicalAddress,
+    _Mo_In_ MO_UINT64 Length,
+    _Mo_In_ MO_UINT32 Attributes,
+    _Mo_In_ MO_UINT8 CacheType)
+{
+    if (!Builder ||
+        !Builder->AllocatePage ||
+        !Builder->PageMapLevel4Address ||
+        CacheType > MO_PLATFORM_X64_PAGE_CACHE_MAXIMUM)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    if ((VirtualAddress | PhysicalAddress | Length)
+        & (MO_PLATFORM_X64_PAGE_SIZE_4K - 1))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    if (!Length)
+    {
+        // For zero length, do nothing and return success.
+        return MO_RESULT_SUCCESS_OK;
+    }
+
+    {
+        MO_UINT64 LastVirtualAddress = VirtualAddress + (Length - 1);
+        MO_UINT64 LastPhysicalAddress = PhysicalAddress + (Length - 1);
+        if (LastVirtualAddress < VirtualAddress ||
+            LastPhysicalAddress < PhysicalAddress)
+        {
+            // The range wraps around.
+            return MO_RESULT_ERROR_OUT_OF_BOUNDS;
+        }
+        if (!MoPlatformPageTableIsCanonicalAddress(VirtualAddress) ||
+            !MoPlatformPageTableIsCanonicalAddress(LastVirtualAddress) ||
+            (VirtualAddress >> 47) != (LastVirtualAddress >> 47))
+        {
+            // The range must not cross the non-canonical hole.
+            return MO_RESULT_ERROR_OUT_OF_BOUNDS;
+        }
+        if (LastPhysicalAddress >> 52)
+        {
+            // The maximum physical address width is 52 bits.
+            return MO_RESULT_ERROR_OUT_OF_BOUNDS;
+        }
+    }
+
+    PMO_PLATFORM_X64_PAGE_TABLE_ENTRY PageMapLevel4 =
+        MoPlatformPageTableGetTable(Builder, Builder->PageMapLevel4Address);
+    if (!PageMapLevel4)
+    {
+        return MO_RESULT_ERROR_INVALID_POINTER;
+    }
+
+    MO_RESULT Result = MO_RESULT_SUCCESS_OK;
+    MO_UINT64 CurrentVirtualAddress = VirtualAddress;
+    MO_UINT64 CurrentPhysicalAddress = PhysicalAddress;
+    MO_UINT64 RemainingLength = Length;
+    while (RemainingLength)
+    {
+        MO_UINT64 MappedSize = MO_PLATFORM_X64_PAGE_SIZE_4K;
+
+        PMO_PLATFORM_X64_PAGE_TABLE_ENTRY PageDirectoryPointerTable = nullptr;
+        Result = MoPlatformPageTableGetNextTable(
+            &PageDirectoryPointerTable,
+            Builder,
+            &PageMapLevel4[(CurrentVirtualAddress >> 39) & 0x1FF],
+            0u);
+        if (MO_RESULT_SUCCESS_OK != Result)
+        {
+            return Result;
+        }
+
+        PMO_PLATFORM_X64_PAGE_TABLE_ENTRY PageDirectoryPointerEntry =
+            &PageDirectoryPointerTable[(CurrentVirtualAddress >> 30) & 0x1FF];
+        if (Builder->Allow1GiBPages &&
+            (!PageDirectoryPointerEntry->P || PageDirectoryPointerEntry->PS_1G) &&
+            MoPlatformPageTableCanMapLargePage(
+                CurrentVirtualAddress,
+                CurrentPhysicalAddress,
+                RemainingLength,
+                MO_PLATFORM_X64_PAGE_SIZE_1G))
+        {
+            MappedSize = MO_PLATFORM_X64_PAGE_SIZE_1G;
+            PageDirectoryPointerEntry->RawData =
+                MoPlatformPageTableMakeLeafEntry(
+                    CurrentPhysicalAddress,
+                    MappedSize,
+                    Attributes,
+                    CacheType).RawData;
+            ++Builder->Mapped1GiBPages;
+        }
+        else
+        {
+            PMO_PLATFORM_X64_PAGE_TABLE_ENTRY PageDirectory = nullptr;
+            Result = MoPlatformPageTableGetNextTable(
+                &PageDirectory,
+                Builder,
+                PageDirectoryPointerEntry,
+                MO_PLATFORM_X64_PAGE_SIZE_1G);
+            if (MO_RESULT_SUCCESS_OK != Result)
+            {
+                return Result;
+            }
+
+            PMO_PLATFORM_X64_PAGE_TABLE_ENTRY PageDirectoryEntry =
+                &PageDirectory[(CurrentVirtualAddress >> 21) & 0x1FF];
+            if ((!PageDirectoryEntry->P || PageDirectoryEntry->PS_2M) &&
+                MoPlatformPageTableCanMapLargePage(
+                    CurrentVirtualAddress,
+                    CurrentPhysicalAddress,
+                    RemainingLength,
+                    MO_PLATFORM_X64_PAGE_SIZE_2M))
+            {
+                MappedSize = MO_PLATFORM_X64_PAGE_SIZE_2M;
+                PageDirectoryEntry->RawData =
+                    MoPlatformPageTableMakeLeafEntry(
+                        CurrentPhysicalAddress,
+                        MappedSize,
+                        Attributes,
+                        CacheType).RawData;
+                ++Builder->Mapped2MiBPages;
+            }
+            else
+            {
+                PMO_PLATFORM_X64_PAGE_TABLE_ENTRY PageTable = nullptr;
+                Result = MoPlatformPageTableGetNextTable(
+                    &PageTable,
+                    Builder,
+                    PageDirectoryEntry,
+                    MO_PLATFORM_X64_PAGE_SIZE_2M);
+                if (MO_RESULT_SUCCESS_OK != Result)
+                {
+                    return Result;
+                }
+
+                PageTable[(CurrentVirtualAddress >> 12) & 0x1FF].RawData =
+                    MoPlatformPageTableMakeLeafEntry(
+                        CurrentPhysicalAddress,
+                        MappedSize,
+                        Attributes,
+                        CacheType).RawData;
+                ++Builder->Mapped4KiBPages;
+            }
+        }
+
+        CurrentVirtualAddress += MappedSize;
+        CurrentPhysicalAddress += MappedSize;
+        RemainingLength -= MappedSize;
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformPageTableIdentityMapRange(
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder,
+    _Mo_In_ MO_UINT64 PhysicalAddress,
+    _Mo_In_ MO_UINT64 Length,
+    _Mo_In_ MO_UINT32 Attributes,
+    _Mo_In_ MO_UINT8 CacheType)
+{
+    return MoPlatformPageTableMapRange(
+        Builder,
+        PhysicalAddress,
+        PhysicalAddress,
+        Length,
+        Attributes,
+        CacheType);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformPageTableQuery(
+    _Mo_Out_ PMO_UINT64 PhysicalAddress,
+    _Mo_Out_Opt_ PMO_UINT64 PageSize,
+    _Mo_Out_Opt_ PMO_UINT32 Attributes,
+    _Mo_Out_Opt_ PMO_UINT8 CacheType,
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder,
+    _Mo_In_ MO_UINT64 VirtualAddress)
+{
+    if (!PhysicalAddress || !Builder || !Builder->PageMapLevel4Address)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    *PhysicalAddress = 0u;
+
+    if (!MoPlatformPageTableIsCanonicalAddress(VirtualAddress))
+    {
+        return MO_RESULT_ERROR_OUT_OF_BOUNDS;
+    }
+
+    PMO_PLATFORM_X64_PAGE_TABLE_ENTRY Table = MoPlatformPageTableGetTable(
+        Builder,
+        Builder->PageMapLevel4Address);
+
+    // Walk from the Page-Map Level-4 table (shift 39) down to the page table
+    // (shift 12), and stop at the first leaf entry.
+    for (MO_UINT32 Shift = 39; Table; Shift -= 9)
+    {
+        PMO_PLATFORM_X64_PAGE_TABLE_ENTRY Entry =
+            &Table[(VirtualAddress >> Shift) & 0x1FF];
+        if (!Entry->P)
+        {
+            return MO_RESULT_ERROR_NO_INTERFACE;
+        }
+
+        MO_UINT64 EntryPageSize = 1ULL << Shift;
+        if (12 == Shift || (39 != Shift && Entry->PS_2M))
+        {
+            MO_UINT64 PageAddress = 0u;
+            MO_UINT32 PageAttributes = 0u;
+            MO_UINT8 PageCacheType = 0u;
+            MoPlatformPageTableDecodeLeafEntry(
+                &PageAddress,
+                &PageAttributes,
+                &PageCacheType,
+                *Entry,
+                EntryPageSize);
+
+            *PhysicalAddress =
+                PageAddress + (VirtualAddress & (EntryPageSize - 1));
+            if (PageSize)
+            {
+                *PageSize = EntryPageSize;
+            }
+            if (Attributes)
+            {
+                *Attributes = PageAttributes;
+            }
+            if (CacheType)
+            {
+                *CacheType = PageCacheType;
+            }
+            return MO_RESULT_SUCCESS_OK;
+        }
+
+        MO_PLATFORM_X64_PAGE_DIRECTORY_ENTRY DirectoryEntry;
+        DirectoryEntry.RawData = Entry->RawData;
+        Table = MoPlatformPageTableGetTable(
+            Builder,
+            ((MO_UINT64)DirectoryEntry.PageTableAddress) << 12);
+    }
+
+    return MO_RESULT_ERROR_INVALID_POINTER;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformPageTableInitializeAttributeTable()
+{
+    // CPUID.01H:EDX.PAT[bit 16]
+    MO_PLATFORM_X64_CPUID_RESULT CpuidResult;
+    MoPlatformReadCpuid(&CpuidResult, 0x00000001);
+    if (!(CpuidResult.Edx & (1u << 16)))
+    {
+        return MO_RESULT_ERROR_NOT_IMPLEMENTED;
+    }
+
+    if (MO_PLATFORM_X64_PAT_VALUE ==
+        MoPlatformReadMsr(MO_PLATFORM_X64_MSR_IA32_PAT))
+    {
+        return MO_RESULT_SUCCESS_OK;
+    }
+
+    // Enter the no-fill cache mode, and drop the cache lines and the
+    // translations which may be created with the previous memory types.
+    // Clearing CR4.PGE also flushes the global translations, which survive
+    // the CR3 reload.
+    MO_UINT64 Cr0 = MoPlatformReadCr0();
+    MO_UINT64 Cr4 = MoPlatformReadCr4();
+    MoPlatformWriteCr0(
+        (Cr0 | MO_PLATFORM_X64_CR0_CACHE_DISABLE) &
+        ~MO_PLATFORM_X64_CR0_NOT_WRITE_THROUGH);
+    MoPlatformWriteBackInvalidateCache();
+    if (Cr4 & MO_PLATFORM_X64_CR4_PAGE_GLOBAL_ENABLE)
+    {
+        MoPlatformWriteCr4(Cr4 & ~MO_PLATFORM_X64_CR4_PAGE_GLOBAL_ENABLE);
+    }
+    MoPlatformWriteCr3(MoPlatformReadCr3());
+
+    MoPlatformWriteMsr(MO_PLATFORM_X64_MSR_IA32_PAT, MO_PLATFORM_X64_PAT_VALUE);
+
+    // Flush again, because the speculative accesses may fill the TLBs while
+    // the IA32_PAT is changed, and then leave the no-fill cache mode.
+    MoPlatformWriteBackInvalidateCache();
+    MoPlatformWriteCr3(MoPlatformReadCr3());
+    MoPlatformWriteCr0(Cr0);
+    if (Cr4 & MO_PLATFORM_X64_CR4_PAGE_GLOBAL_ENABLE)
+    {
+        MoPlatformWriteCr4(Cr4);
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
@@ -0,0 +1,309 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.PageTable.h
+ * PURPOSE:    Definition for Mobility x64 Page Table Builder
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_PLATFORM_X64_PAGETABLE
+#define MOBILITY_PLATFORM_X64_PAGETABLE
+
+#include "Mobility.Platform.x64.h"
+
+/**
+ * @brief The size in bytes of the smallest page.
+ */
+#define MO_PLATFORM_X64_PAGE_SIZE 0x1000
+
+/*
+ * The sizes of the pages which can be mapped by the x64 4-level paging.
+ */
+#define MO_PLATFORM_X64_PAGE_SIZE_4K 0x1000ULL
+#define MO_PLATFORM_X64_PAGE_SIZE_2M 0x200000ULL
+#define MO_PLATFORM_X64_PAGE_SIZE_1G 0x40000000ULL
+
+/*
+ * The number of entries in each paging structure.
+ */
+#define MO_PLATFORM_X64_PAGE_TABLE_ENTRY_COUNT 512
+
+/*
+ * The attributes for the pages mapped by the page table builder.
+ */
+
+/**
+ * @brief The pages are writable.
+ */
+#define MO_PLATFORM_X64_PAGE_ATTRIBUTE_WRITABLE 0x1
+/**
+ * @brief The pages are accessible from user mode.
+ */
+#define MO_PLATFORM_X64_PAGE_ATTRIBUTE_USER 0x2
+/**
+ * @brief The pages are not executable, requires IA32_EFER.NXE = 1.
+ */
+#define MO_PLATFORM_X64_PAGE_ATTRIBUTE_NO_EXECUTE 0x4
+/**
+ * @brief The translations are global, requires CR4.PGE = 1.
+ */
+#define MO_PLATFORM_X64_PAGE_ATTRIBUTE_GLOBAL 0x8
+
+/*
+ * The cacheability types for the pages mapped by the page table builder. The
+ * value is the 3-bit Page Attribute Table (PAT) index composed by the PAT, PCD
+ * and PWT bits of the paging-structure entry. The first 4 names follow the
+ * power-on default layout of IA32_PAT, and the write-combining type is only
+ * available after MoPlatformPageTableInitializeAttributeTable is called.
+ *
+ * @remark Intel(R) 64 and IA-32 Architectures Software Developer's Manual
+ *         (December 2023)
+ *           Volume 3 (3A, 3B, 3C, & 3D): System Programming Guide
+ *             13.12.3 Selecting a Memory Type from the PAT
+ */
+
+#define MO_PLATFORM_X64_PAGE_CACHE_WRITE_BACK 0
+#define MO_PLATFORM_X64_PAGE_CACHE_WRITE_THROUGH 1
+#define MO_PLATFORM_X64_PAGE_CACHE_UNCACHED_MINUS 2
+#define MO_PLATFORM_X64_PAGE_CACHE_UNCACHEABLE 3
+#define MO_PLATFORM_X64_PAGE_CACHE_WRITE_COMBINING 4
+
+#define MO_PLATFORM_X64_PAGE_CACHE_MAXIMUM 7
+
+/*
+ * The bits of CR0 used when the IA32_PAT is changed.
+ *
+ * @remark Intel(R) 64 and IA-32 Architectures Software Developer's Manual
+ *         (December 2023)
+ *           Volume 3 (3A, 3B, 3C, & 3D): System Programming Guide
+ *             2.5 Control Registers
+ */
+
+#define MO_PLATFORM_X64_CR0_NOT_WRITE_THROUGH 0x20000000ULL
+#define MO_PLATFORM_X64_CR0_CACHE_DISABLE 0x40000000ULL
+
+/**
+ * @brief The index of the IA32_PAT Model-Specific Register (MSR).
+ */
+#define MO_PLATFORM_X64_MSR_IA32_PAT 0x277
+
+/*
+ * The memory types which can be encoded in the IA32_PAT entries.
+ *
+ * @remark Intel(R) 64 and IA-32 Architectures Software Developer's Manual
+ *         (December 2023)
+ *           Volume 3 (3A, 3B, 3C, & 3D): System Programming Guide
+ *             13.12.2 IA32_PAT MSR
+ */
+
+#define MO_PLATFORM_X64_MEMORY_TYPE_UNCACHEABLE 0x00
+#define MO_PLATFORM_X64_MEMORY_TYPE_WRITE_COMBINING 0x01
+#define MO_PLATFORM_X64_MEMORY_TYPE_WRITE_THROUGH 0x04
+#define MO_PLATFORM_X64_MEMORY_TYPE_WRITE_PROTECTED 0x05
+#define MO_PLATFORM_X64_MEMORY_TYPE_WRITE_BACK 0x06
+#define MO_PLATFORM_X64_MEMORY_TYPE_UNCACHED_MINUS 0x07
+
+#define MO_PLATFORM_X64_PAT_ENTRY(Index, MemoryType) \
+    (((MO_UINT64)(MemoryType)) << ((Index) * 8))
+
+/**
+ * @brief The IA32_PAT value used by Mobility, which keeps PA0 to PA3 as the
+ *        power-on default and uses PA4 for write-combining. PA5 to PA7 mirror
+ *        PA1 to PA3, so the entries with the PAT bit set but not using the
+ *        write-combining index still get the power-on default memory types.
+ */
+#define MO_PLATFORM_X64_PAT_VALUE ( \
+    MO_PLATFORM_X64_PAT_ENTRY(0, MO_PLATFORM_X64_MEMORY_TYPE_WRITE_BACK) | \
+    MO_PLATFORM_X64_PAT_ENTRY(1, MO_PLATFORM_X64_MEMORY_TYPE_WRITE_THROUGH) | \
+    MO_PLATFORM_X64_PAT_ENTRY(2, MO_PLATFORM_X64_MEMORY_TYPE_UNCACHED_MINUS) | \
+    MO_PLATFORM_X64_PAT_ENTRY(3, MO_PLATFORM_X64_MEMORY_TYPE_UNCACHEABLE) | \
+    MO_PLATFORM_X64_PAT_ENTRY(4, MO_PLATFORM_X64_MEMORY_TYPE_WRITE_COMBINING) | \
+    MO_PLATFORM_X64_PAT_ENTRY(5, MO_PLATFORM_X64_MEMORY_TYPE_WRITE_THROUGH) | \
+    MO_PLATFORM_X64_PAT_ENTRY(6, MO_PLATFORM_X64_MEMORY_TYPE_UNCACHED_MINUS) | \
+    MO_PLATFORM_X64_PAT_ENTRY(7, MO_PLATFORM_X64_MEMORY_TYPE_UNCACHEABLE))
+
+/**
+ * @brief The prototype for allocating a 4 KiB page for paging structures.
+ * @param PhysicalAddress Receives the physical address of the allocated page
+ *                        which must be 4 KiB aligned.
+ * @param Context The user-defined context of the page table builder.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+typedef MO_RESULT(MOAPI* PMO_PLATFORM_X64_PAGE_TABLE_ALLOCATE_ROUTINE)(
+    _Mo_Out_ PMO_UINT64 PhysicalAddress,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief The prototype for translating the physical address of paging
+ *        structures to the address which can be accessed by the builder.
+ * @param PhysicalAddress The physical address of the paging structure.
+ * @param Context The user-defined context of the page table builder.
+ * @return The accessible address of the paging structure, or nullptr if the
+ *         physical address cannot be accessed.
+ */
+typedef MO_POINTER(MOAPI* PMO_PLATFORM_X64_PAGE_TABLE_TRANSLATE_ROUTINE)(
+    _Mo_In_ MO_UINT64 PhysicalAddress,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief The x64 4-level page table builder which maps the ranges with 1 GiB
+ *        and 2 MiB pages where the alignment allows, and only falls back to
+ *        4 KiB pages at the edges.
+ * @remark All paging structures are accessed through the allocate and
+ *         translate routines, so the builder can also operate on a simulated
+ *         physical memory for testing on the host.
+ */
+typedef struct _MO_PLATFORM_X64_PAGE_TABLE_BUILDER
+{
+    /**
+     * @brief The physical address of the Page-Map Level-4 table, which can be
+     *        loaded to CR3.
+     */
+    MO_UINT64 PageMapLevel4Address;
+    /**
+     * @brief The routine for allocating pages for paging structures.
+     */
+    PMO_PLATFORM_X64_PAGE_TABLE_ALLOCATE_ROUTINE AllocatePage;
+    /**
+     * @brief The routine for translating the physical address of paging
+     *        structures. If this member is nullptr, the physical addresses are
+     *        considered identity mapped.
+     */
+    PMO_PLATFORM_X64_PAGE_TABLE_TRANSLATE_ROUTINE TranslateAddress;
+    /**
+     * @brief The user-defined context passed to the routines.
+     */
+    MO_POINTER Context;
+    /**
+     * @brief Whether the 1 GiB pages are allowed, which requires the
+     *        CPUID.80000001H:EDX.Page1GB[bit 26] reported by the processor.
+     */
+    MO_BOOL Allow1GiBPages;
+    /**
+     * @brief The number of the allocated paging structures.
+     */
+    MO_UINT32 AllocatedTables;
+    /**
+     * @brief The number of the 1 GiB page mappings written.
+     */
+    MO_UINT64 Mapped1GiBPages;
+    /**
+     * @brief The number of the 2 MiB page mappings written.
+     */
+    MO_UINT64 Mapped2MiBPages;
+    /**
+     * @brief The number of the 4 KiB page mappings written.
+     */
+    MO_UINT64 Mapped4KiBPages;
+} MO_PLATFORM_X64_PAGE_TABLE_BUILDER, *PMO_PLATFORM_X64_PAGE_TABLE_BUILDER;
+
+/**
+ * @brief Initializes the page table builder and allocates an empty Page-Map
+ *        Level-4 table.
+ * @param Builder The page table builder to be initialized.
+ * @param AllocatePage The routine for allocating pages for paging structures.
+ * @param TranslateAddress The optional routine for translating the physical
+ *                         address of paging structures. If this parameter is
+ *                         nullptr, the physical addresses are considered
+ *                         identity mapped.
+ * @param Context The user-defined context passed to the routines.
+ * @param Allow1GiBPages Whether the 1 GiB pages are allowed.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformPageTableInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder,
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_ALLOCATE_ROUTINE AllocatePage,
+    _Mo_In_Opt_ PMO_PLATFORM_X64_PAGE_TABLE_TRANSLATE_ROUTINE TranslateAddress,
+    _Mo_In_Opt_ MO_POINTER Context,
+    _Mo_In_ MO_BOOL Allow1GiBPages);
+
+/**
+ * @brief Maps the physical range to the virtual range with the largest pages
+ *        the alignment allows. The existing mappings in the range are replaced,
+ *        and the large pages which partially overlap the range are split.
+ * @param Builder The page table builder.
+ * @param VirtualAddress The base virtual address which must be 4 KiB aligned
+ *                       and canonical.
+ * @param PhysicalAddress The base physical address which must be 4 KiB
+ *                        aligned.
+ * @param Length The length in bytes which must be a multiple of 4 KiB.
+ * @param Attributes The MO_PLATFORM_X64_PAGE_ATTRIBUTE_* flags.
+ * @param CacheType The MO_PLATFORM_X64_PAGE_CACHE_* cacheability type.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the allocate routine fails, the function returns
+ *          MO_RESULT_ERROR_OUT_OF_MEMORY and the range may be partially mapped.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformPageTableMapRange(
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder,
+    _Mo_In_ MO_UINT64 VirtualAddress,
+    _Mo_In_ MO_UINT64 PhysicalAddress,
+    _Mo_In_ MO_UINT64 Length,
+    _Mo_In_ MO_UINT32 Attributes,
+    _Mo_In_ MO_UINT8 CacheType);
+
+/**
+ * @brief Maps the physical range to the same virtual range.
+ * @param Builder The page table builder.
+ * @param PhysicalAddress The base physical address which must be 4 KiB
+ *                        aligned.
+ * @param Length The length in bytes which must be a multiple of 4 KiB.
+ * @param Attributes The MO_PLATFORM_X64_PAGE_ATTRIBUTE_* flags.
+ * @param CacheType The MO_PLATFORM_X64_PAGE_CACHE_* cacheability type.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformPageTableIdentityMapRange(
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder,
+    _Mo_In_ MO_UINT64 PhysicalAddress,
+    _Mo_In_ MO_UINT64 Length,
+    _Mo_In_ MO_UINT32 Attributes,
+    _Mo_In_ MO_UINT8 CacheType);
+
+/**
+ * @brief Queries the mapping of the specified virtual address.
+ * @param PhysicalAddress Receives the physical address which the virtual
+ *                        address is mapped to.
+ * @param PageSize Receives the size of the page which maps the virtual
+ *                 address. This parameter is optional.
+ * @param Attributes Receives the MO_PLATFORM_X64_PAGE_ATTRIBUTE_* flags of the
+ *                   page. This parameter is optional.
+ * @param CacheType Receives the MO_PLATFORM_X64_PAGE_CACHE_* cacheability type
+ *                  of the page. This parameter is optional.
+ * @param Builder The page table builder.
+ * @param VirtualAddress The virtual address to be queried.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the virtual address is not mapped, the function returns
+ *          MO_RESULT_ERROR_NO_INTERFACE.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformPageTableQuery(
+    _Mo_Out_ PMO_UINT64 PhysicalAddress,
+    _Mo_Out_Opt_ PMO_UINT64 PageSize,
+    _Mo_Out_Opt_ PMO_UINT32 Attributes,
+    _Mo_Out_Opt_ PMO_UINT8 CacheType,
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder,
+    _Mo_In_ MO_UINT64 VirtualAddress);
+
+/**
+ * @brief Programs the IA32_PAT with MO_PLATFORM_X64_PAT_VALUE for the current
+ *        processor, which makes MO_PLATFORM_X64_PAGE_CACHE_WRITE_COMBINING
+ *        available.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The IA32_PAT is updated in the no-fill cache mode with the caches
+ *          and the TLBs, including the global translations, flushed before and
+ *          after it, which is the sequence in 12.11.8 MTRR Considerations in
+ *          Multiple-Processor Systems of the Intel SDM. The caller should
+ *          disable the interrupts, and should call this function on every
+ *          processor because the IA32_PAT is a per-processor register. If the
+ *          processor does not support PAT, the function returns
+ *          MO_RESULT_ERROR_NOT_IMPLEMENTED.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformPageTableInitializeAttributeTable();
+
+#endif // !MOBILITY_PLATFORM_X64_PAGETABLE
@@ -0,0 +1,240 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.Pcid.c
+ * PURPOSE:    Implementation for Mobility x64 PCID-Tagged Address Spaces
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Platform.x64.Pcid.h"
+
+#include "Mobility.Platform.x64.PageTable.h"
+#include "Mobility.Runtime.Core.h"
+#include "Mobility.Synchronization.Atomic.h"
+
+/**
+ * @brief The number of the bits of the PCID in the context of an address
+ *        space.
+ */
+#define MO_PLATFORM_X64_PCID_BITS 12
+
+MO_FORCEINLINE MO_UINT64 MoPlatformPcidGetGeneration(
+    _Mo_In_ MO_UINT64 Context)
+{
+    return Context >> MO_PLATFORM_X64_PCID_BITS;
+}
+
+MO_FORCEINLINE MO_UINT64 MoPlatformPcidGetPcid(
+    _Mo_In_ MO_UINT64 Context)
+{
+    return Context & MO_PLATFORM_X64_CR3_PCID_MASK;
+}
+
+static MO_VOID MoPlatformPcidStartGeneration(
+    _Mo_InOut_ PMO_PLATFORM_X64_PCID_ALLOCATOR Allocator)
+{
+    MoRuntimeMemoryFillByte(
+        Allocator->UsedPcids,
+        0,
+        sizeof(Allocator->UsedPcids));
+    Allocator->UsedPcids[0] = 1;
+    Allocator->NextPcid = 1;
+    MoAtomicStore64(
+        &Allocator->Generation,
+        Allocator->Generation + 1,
+        MO_ATOMIC_ORDER_RELEASE);
+}
+
+static MO_UINT64 MoPlatformPcidAllocate(
+    _Mo_InOut_ PMO_PLATFORM_X64_PCID_ALLOCATOR Allocator)
+{
+    for (MO_UINT32 Pass = 0; Pass < 2; ++Pass)
+    {
+        for (MO_UINT32 Count = 0; Count < MO_PLATFORM_X64_PCID_COUNT; ++Count)
+        {
+            MO_UINT32 Pcid =
+                (Allocator->NextPcid + Count) & (MO_PLATFORM_X64_PCID_COUNT - 1);
+            MO_UINT64 Bit = 1ULL << (Pcid & 63);
+            if (Allocator->UsedPcids[Pcid / 64] & Bit)
+            {
+                continue;
+            }
+            Allocator->UsedPcids[Pcid / 64] |= Bit;
+            Allocator->NextPcid = Pcid + 1;
+            return (Allocator->Generation << MO_PLATFORM_X64_PCID_BITS) | Pcid;
+        }
+
+        // All PCIDs are used, so recycle them in the next generation.
+        MoPlatformPcidStartGeneration(Allocator);
+    }
+
+    // The new generation always has free PCIDs.
+    return 0;
+}
+
+static MO_VOID MoPlatformPcidFlushAllContexts(
+    _Mo_In_ PMO_PLATFORM_X64_PCID_PROCESSOR Processor)
+{
+    if (Processor->InvpcidSupported)
+    {
+        MO_PLATFORM_X64_INVPCID_DESCRIPTOR Descriptor = { 0 };
+        MoPlatformInvalidateProcessContext(
+            MO_PLATFORM_X64_INVPCID_ALL_CONTEXTS,
+            &Descriptor);
+        return;
+    }
+
+    // Changing CR4.PGE invalidates the TLB entries of all PCIDs, including
+    // the global translations.
+    MO_UINT64 Cr4 = MoPlatformReadCr4();
+    MoPlatformWriteCr4(Cr4 ^ MO_PLATFORM_X64_CR4_PAGE_GLOBAL_ENABLE);
+    MoPlatformWriteCr4(Cr4);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformPcidInitializeAllocator(
+    _Mo_Out_ PMO_PLATFORM_X64_PCID_ALLOCATOR Allocator)
+{
+    MoSpinLockInitialize(&Allocator->Lock);
+    Allocator->Generation = 0;
+    MoPlatformPcidStartGeneration(Allocator);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformPcidEnable(
+    _Mo_Out_ PMO_PLATFORM_X64_PCID_PROCESSOR Processor)
+{
+    if (!Processor)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MO_PLATFORM_X64_CPUID_RESULT CpuidResult;
+    MoPlatformReadCpuid(&CpuidResult, 0);
+    MO_UINT32 MaximumLeaf = CpuidResult.Eax;
+    MoPlatformReadCpuid(&CpuidResult, 1);
+    if (!(CpuidResult.Ecx & (1u << 17)))
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+    MO_BOOL InvpcidSupported = MO_FALSE;
+    if (MaximumLeaf >= 7)
+    {
+        MoPlatformReadCpuidEx(&CpuidResult, 7, 0);
+        InvpcidSupported = (CpuidResult.Ebx & (1u << 10)) ? MO_TRUE : MO_FALSE;
+    }
+
+    // Setting CR4.PCIDE causes #GP if CR3 bits 0-11 are not zero.
+    if (MoPlatformReadCr3() & MO_PLATFORM_X64_CR3_PCID_MASK)
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    Processor->Generation = 0;
+    Processor->CurrentAddressSpace = nullptr;
+    Processor->InvpcidSupported = InvpcidSupported;
+    MoRuntimeMemoryFillByte(Processor->Reserved, 0, sizeof(Processor->Reserved));
+
+    MoPlatformWriteCr4(MoPlatformReadCr4() | MO_PLATFORM_X64_CR4_PCID_ENABLE);
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformPcidInitializeAddressSpace(
+    _Mo_Out_ PMO_PLATFORM_X64_ADDRESS_SPACE AddressSpace,
+    _Mo_In_ MO_UINT64 PageMapLevel4Address)
+{
+    if (!AddressSpace ||
+        !PageMapLevel4Address ||
+        (PageMapLevel4Address & (MO_PLATFORM_X64_PAGE_SIZE - 1)))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    AddressSpace->PageMapLevel4Address = PageMapLevel4Address;
+    AddressSpace->Context = 0;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformPcidSwitchAddressSpace(
+    _Mo_InOut_ PMO_PLATFORM_X64_PCID_ALLOCATOR Allocator,
+    _Mo_InOut_ PMO_PLATFORM_X64_PCID_PROCESSOR Processor,
+    _Mo_InOut_ PMO_PLATFORM_X64_ADDRESS_SPACE AddressSpace)
+{
+    MO_UINT64 Context = MoAtomicLoad64(
+        &AddressSpace->Context,
+        MO_ATOMIC_ORDER_ACQUIRE);
+    if (MoPlatformPcidGetGeneration(Context) != MoAtomicLoad64(
+        &Allocator->Generation,
+        MO_ATOMIC_ORDER_ACQUIRE))
+    {
+        MoSpinLockAcquire(&Allocator->Lock);
+        Context = AddressSpace->Context;
+        if (MoPlatformPcidGetGeneration(Context) != Allocator->Generation)
+        {
+            Context = MoPlatformPcidAllocate(Allocator);
+            MoAtomicStore64(
+                &AddressSpace->Context,
+                Context,
+                MO_ATOMIC_ORDER_RELEASE);
+        }
+        MoSpinLockRelease(&Allocator->Lock);
+    }
+
+    // The PCIDs of a newer generation may still have the TLB entries of their
+    // previous owners on this processor.
+    MO_UINT64 Generation = MoPlatformPcidGetGeneration(Context);
+    if (Processor->Generation != Generation)
+    {
+        MoPlatformPcidFlushAllContexts(Processor);
+        Processor->Generation = Generation;
+    }
+
+    MoPlatformWriteCr3(
+        AddressSpace->PageMapLevel4Address |
+        MoPlatformPcidGetPcid(Context) |
+        MO_PLATFORM_X64_CR3_NO_FLUSH);
+    Processor->CurrentAddressSpace = AddressSpace;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformPcidRetireAddressSpace(
+    _Mo_InOut_ PMO_PLATFORM_X64_ADDRESS_SPACE AddressSpace)
+{
+    // The PCID stays used until the next generation, because the other
+    // processors may still have its TLB entries.
+    MoAtomicStore64(&AddressSpace->Context, 0, MO_ATOMIC_ORDER_RELEASE);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformPcidInvalidatePage(
+    _Mo_In_ PMO_PLATFORM_X64_PCID_PROCESSOR Processor,
+    _Mo_InOut_ PMO_PLATFORM_X64_ADDRESS_SPACE AddressSpace,
+    _Mo_In_ MO_UINT64 Address)
+{
+    MO_UINT64 Context = MoAtomicLoad64(
+        &AddressSpace->Context,
+        MO_ATOMIC_ORDER_ACQUIRE);
+    if (!Context)
+    {
+        // No TLB entry is tagged with the new PCID of the address space yet.
+        return;
+    }
+
+    if (Processor->InvpcidSupported)
+    {
+        MO_PLATFORM_X64_INVPCID_DESCRIPTOR Descriptor;
+        Descriptor.Pcid = MoPlatformPcidGetPcid(Context);
+        Descriptor.Address = Address;
+        MoPlatformInvalidateProcessContext(
+            MO_PLATFORM_X64_INVPCID_INDIVIDUAL_ADDRESS,
+            &Descriptor);
+    }
+    else if (Processor->CurrentAddressSpace == AddressSpace)
+    {
+        MoPlatformInvalidatePage(Address);
+    }
+    else
+    {
+        MoPlatformPcidRetireAddressSpace(AddressSpace);
+    }
+}
@@ -0,0 +1,185 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.Pcid.h
+ * PURPOSE:    Definition for Mobility x64 PCID-Tagged Address Spaces
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_PLATFORM_X64_PCID
+#define MOBILITY_PLATFORM_X64_PCID
+
+#include "Mobility.Platform.x64.h"
+#include "Mobility.Synchronization.SpinLock.h"
+
+/*
+ * The bits of the control registers used by the process-context identifiers.
+ *
+ * @remark Intel(R) 64 and IA-32 Architectures Software Developer's Manual
+ *         (December 2023)
+ *           Volume 3 (3A, 3B, 3C, & 3D): System Programming Guide
+ *             2.5 Control Registers
+ *             4.10.1 Process-Context Identifiers (PCIDs)
+ *             4.10.4.1 Operations that Invalidate TLBs and Paging-Structure
+ *                      Caches
+ */
+
+#define MO_PLATFORM_X64_CR4_PAGE_GLOBAL_ENABLE 0x80ULL
+#define MO_PLATFORM_X64_CR4_PCID_ENABLE 0x20000ULL
+#define MO_PLATFORM_X64_CR3_PCID_MASK 0xFFFULL
+#define MO_PLATFORM_X64_CR3_NO_FLUSH 0x8000000000000000ULL
+
+/**
+ * @brief The number of the PCIDs, and PCID 0 is reserved for the address space
+ *        which is active when the PCIDs are enabled.
+ */
+#define MO_PLATFORM_X64_PCID_COUNT 4096
+
+/**
+ * @brief The allocator of the PCIDs shared by all processors.
+ * @remarks The PCIDs are recycled by the generations. When all PCIDs of the
+ *          current generation are used, the next generation starts with all
+ *          PCIDs free, each address space gets a new PCID on its next switch,
+ *          and each processor flushes the TLB entries of all PCIDs once
+ *          before using the PCIDs of the new generation.
+ */
+typedef struct _MO_PLATFORM_X64_PCID_ALLOCATOR
+{
+    /**
+     * @brief Serializes the allocations and the generation changes.
+     */
+    MO_SPIN_LOCK Lock;
+    /**
+     * @brief The hint of the next PCID to allocate.
+     */
+    MO_UINT32 NextPcid;
+    /**
+     * @brief The current generation, which is incremented when all PCIDs are
+     *        used.
+     */
+    MO_UINT64 volatile Generation;
+    /**
+     * @brief The bit N is set if the PCID N is used in the current generation.
+     */
+    MO_UINT64 UsedPcids[MO_PLATFORM_X64_PCID_COUNT / 64];
+} MO_PLATFORM_X64_PCID_ALLOCATOR, *PMO_PLATFORM_X64_PCID_ALLOCATOR;
+
+/**
+ * @brief The address space tagged with a PCID.
+ */
+typedef struct _MO_PLATFORM_X64_ADDRESS_SPACE
+{
+    /**
+     * @brief The physical address of the PML4 table, which must be 4 KiB
+     *        aligned.
+     */
+    MO_UINT64 PageMapLevel4Address;
+    /**
+     * @brief The generation in bits 12-63 and the PCID in bits 0-11, or 0 if no
+     *        PCID is assigned.
+     */
+    MO_UINT64 volatile Context;
+} MO_PLATFORM_X64_ADDRESS_SPACE, *PMO_PLATFORM_X64_ADDRESS_SPACE;
+
+/**
+ * @brief The PCID state of a processor.
+ */
+typedef struct _MO_PLATFORM_X64_PCID_PROCESSOR
+{
+    /**
+     * @brief The generation whose PCIDs have no stale TLB entries on the
+     *        processor.
+     */
+    MO_UINT64 Generation;
+    /**
+     * @brief The address space which is current on the processor, or nullptr if
+     *        it is the one active when the PCIDs are enabled.
+     */
+    PMO_PLATFORM_X64_ADDRESS_SPACE CurrentAddressSpace;
+    /**
+     * @brief Set if the processor supports INVPCID.
+     */
+    MO_BOOL InvpcidSupported;
+    /**
+     * @brief Reserved bits. Set to 0.
+     */
+    MO_UINT8 Reserved[7];
+} MO_PLATFORM_X64_PCID_PROCESSOR, *PMO_PLATFORM_X64_PCID_PROCESSOR;
+
+/**
+ * @brief Initializes the PCID allocator.
+ * @param Allocator The PCID allocator to initialize.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformPcidInitializeAllocator(
+    _Mo_Out_ PMO_PLATFORM_X64_PCID_ALLOCATOR Allocator);
+
+/**
+ * @brief Enables the PCIDs on the current processor with CR4.PCIDE.
+ * @param Processor The PCID state of the current processor to initialize.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. If the
+ *         processor does not support the PCIDs, it returns
+ *         MO_RESULT_ERROR_NO_INTERFACE. Otherwise, it returns an MO_RESULT
+ *         error code.
+ * @remarks It must be called on each processor, and CR3 bits 0-11 must be zero
+ *          when it is called, so the current address space uses PCID 0.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformPcidEnable(
+    _Mo_Out_ PMO_PLATFORM_X64_PCID_PROCESSOR Processor);
+
+/**
+ * @brief Initializes the address space, which has no PCID until it is
+ *        switched to.
+ * @param AddressSpace The address space to initialize.
+ * @param PageMapLevel4Address The physical address of the PML4 table, which
+ *                             must be 4 KiB aligned.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformPcidInitializeAddressSpace(
+    _Mo_Out_ PMO_PLATFORM_X64_ADDRESS_SPACE AddressSpace,
+    _Mo_In_ MO_UINT64 PageMapLevel4Address);
+
+/**
+ * @brief Switches the current processor to the address space, and keeps the
+ *        TLB entries tagged with the PCID of the address space.
+ * @param Allocator The PCID allocator.
+ * @param Processor The PCID state of the current processor.
+ * @param AddressSpace The address space to switch to.
+ * @remarks The interrupts should be disabled, so the processor is not switched
+ *          meanwhile. The allocator is only locked if the address space needs
+ *          a new PCID.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformPcidSwitchAddressSpace(
+    _Mo_InOut_ PMO_PLATFORM_X64_PCID_ALLOCATOR Allocator,
+    _Mo_InOut_ PMO_PLATFORM_X64_PCID_PROCESSOR Processor,
+    _Mo_InOut_ PMO_PLATFORM_X64_ADDRESS_SPACE AddressSpace);
+
+/**
+ * @brief Drops the PCID of the address space, so it gets a new PCID without
+ *        any TLB entry on all processors on its next switch.
+ * @param AddressSpace The address space.
+ * @remarks It can be used after changing the mappings which may be cached by
+ *          the other processors, or before freeing the address space. The
+ *          processors which are running the address space keep using the
+ *          dropped PCID until their next switch.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformPcidRetireAddressSpace(
+    _Mo_InOut_ PMO_PLATFORM_X64_ADDRESS_SPACE AddressSpace);
+
+/**
+ * @brief Invalidates the TLB entries for the page in the address space on the
+ *        current processor.
+ * @param Processor The PCID state of the current processor.
+ * @param AddressSpace The address space.
+ * @param Address The linear address in the page to invalidate.
+ * @remarks INVPCID is used if it is supported. Otherwise, INVLPG is used if
+ *          the address space is current, and the PCID is retired if not.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformPcidInvalidatePage(
+    _Mo_In_ PMO_PLATFORM_X64_PCID_PROCESSOR Processor,
+    _Mo_InOut_ PMO_PLATFORM_X64_ADDRESS_SPACE AddressSpace,
+    _Mo_In_ MO_UINT64 Address);
+
+#endif // !MOBILITY_PLATFORM_X64_PCID
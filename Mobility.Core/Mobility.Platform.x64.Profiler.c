@@ -0,0 +1,544 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.Profiler.c
+ * PURPOSE:    Implementation for Mobility x64 Sampling Profiler
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Platform.x64.Profiler.h"
+
+#include "Mobility.Platform.x64.Smp.h"
+#include "Mobility.Runtime.Core.h"
+#include "Mobility.Time.Core.h"
+
+#include <Mile.Mobility.Utilities.MemoryAccess.h>
+
+/**
+ * @brief The number of the samples drained from a processor at once.
+ */
+#define MO_PLATFORM_X64_PROFILER_COLLECT_BATCH 16
+
+static PMO_PLATFORM_X64_PROFILER MoPlatformProfilerActiveProfiler = nullptr;
+
+// The handler is kept after the profiler is stopped, because the interrupts
+// which have read the wrapped handler still need to call it.
+static PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER
+MoPlatformProfilerPreviousHandler = nullptr;
+
+MO_FORCEINLINE MO_BOOL MoPlatformProfilerIsPowerOfTwo(
+    _Mo_In_ MO_UINT32 Value)
+{
+    return Value && !(Value & (Value - 1));
+}
+
+MO_FORCEINLINE MO_UINT32 MoPlatformProfilerHash(
+    _Mo_In_ MO_UINT64 Value)
+{
+    return (MO_UINT32)((Value * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+static MO_VOID MoPlatformProfilerRecordSample(
+    _Mo_In_ PMO_PLATFORM_X64_PROFILER Profiler,
+    _Mo_In_ PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_CONTEXT InterruptContext)
+{
+    // The processor block is not loaded if there is only one processor, such
+    // as running before exiting the boot services.
+    MO_UINT32 ProcessorIndex = 0;
+    if (Profiler->ProcessorCount > 1)
+    {
+        ProcessorIndex =
+            MoPlatformGetCurrentProcessorBlock()->ProcessorIndex;
+        if (ProcessorIndex >= Profiler->ProcessorCount)
+        {
+            return;
+        }
+    }
+    PMO_PLATFORM_X64_PROFILER_PROCESSOR Processor =
+        &Profiler->Processors[ProcessorIndex];
+
+    MO_UINT64 TimeStamp = MoPlatformReadTimeStampCounter();
+    if (TimeStamp - Processor->LastSampleTimeStamp <
+        Profiler->SamplePeriodCycles)
+    {
+        return;
+    }
+    Processor->LastSampleTimeStamp = TimeStamp;
+
+    // The unused frames are not cleared, because they are never read.
+    MO_PLATFORM_X64_PROFILER_SAMPLE Sample;
+    Sample.Rip = InterruptContext->Rip;
+    Sample.ProcessorIndex = ProcessorIndex;
+    Sample.FrameCount = 0;
+
+    // Only walk the frames of the kernel mode, and only between the
+    // interrupted stack pointer and the top of the stack, so a register which
+    // is not used as the frame pointer cannot lead to an unmapped address.
+    MO_UINT64 StackTop = 0;
+    if (Profiler->MaximumFrames &&
+        !(InterruptContext->Cs & 3) &&
+        Profiler->StackTopRoutine(
+            &StackTop,
+            InterruptContext->Rsp,
+            Profiler->StackTopContext) &&
+        StackTop >= InterruptContext->Rsp + 16)
+    {
+        MO_UINT64 Lowest = InterruptContext->Rsp;
+        MO_UINT64 Highest = StackTop - 16;
+        MO_UINT64 Frame = InterruptContext->Rbp;
+        while (Sample.FrameCount < Profiler->MaximumFrames)
+        {
+            if (Frame < Lowest || Frame > Highest || (Frame & 7))
+            {
+                break;
+            }
+
+            PMO_UINT64 FrameRecord = (PMO_UINT64)(MO_UINTN)Frame;
+            MO_UINT64 ReturnAddress = FrameRecord[1];
+            if (!ReturnAddress)
+            {
+                break;
+            }
+            Sample.Frames[Sample.FrameCount++] = ReturnAddress;
+
+            // The frames of the callers are always at the higher addresses.
+            Lowest = Frame + 16;
+            Frame = FrameRecord[0];
+        }
+    }
+
+    if (!MoSpscRingQueueEnqueue(&Processor->Queue, &Sample, 1))
+    {
+        ++Processor->DroppedSamples;
+    }
+}
+
+static MO_VOID MOAPI MoPlatformProfilerInterruptHandler(
+    _Mo_In_ MO_PLATFORM_X64_INTERRUPT_TYPE InterruptType,
+    _Mo_In_ PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_CONTEXT InterruptContext)
+{
+    PMO_PLATFORM_X64_PROFILER Profiler = MoPlatformProfilerActiveProfiler;
+    if (Profiler)
+    {
+        MoPlatformProfilerRecordSample(Profiler, InterruptContext);
+    }
+
+    PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER PreviousHandler =
+        MoPlatformProfilerPreviousHandler;
+    if (PreviousHandler)
+    {
+        PreviousHandler(InterruptType, InterruptContext);
+    }
+}
+
+static MO_VOID MoPlatformProfilerAggregateSample(
+    _Mo_InOut_ PMO_PLATFORM_X64_PROFILER_REPORT Report,
+    _Mo_In_ PMO_PLATFORM_X64_PROFILER_SAMPLE Sample)
+{
+    ++Report->TotalSamples;
+
+    MO_UINT32 Mask = Report->FlatCapacity - 1;
+    MO_UINT32 Index = MoPlatformProfilerHash(Sample->Rip) & Mask;
+    MO_UINT32 Probe = 0;
+    for (; Probe < Report->FlatCapacity; ++Probe)
+    {
+        PMO_PLATFORM_X64_PROFILER_FLAT_ITEM Item =
+            &Report->FlatItems[(Index + Probe) & Mask];
+        if (!Item->Count)
+        {
+            Item->Rip = Sample->Rip;
+            Item->Count = 1;
+            break;
+        }
+        if (Item->Rip == Sample->Rip)
+        {
+            ++Item->Count;
+            break;
+        }
+    }
+    if (Probe == Report->FlatCapacity)
+    {
+        ++Report->OverflowSamples;
+    }
+
+    if (!Report->StackCapacity)
+    {
+        return;
+    }
+
+    MO_UINT64 Hash = Sample->Rip;
+    for (MO_UINT32 Frame = 0; Frame < Sample->FrameCount; ++Frame)
+    {
+        Hash = (Hash ^ Sample->Frames[Frame]) * 0x100000001B3ULL;
+    }
+
+    Mask = Report->StackCapacity - 1;
+    Index = MoPlatformProfilerHash(Hash) & Mask;
+    for (Probe = 0; Probe < Report->StackCapacity; ++Probe)
+    {
+        PMO_PLATFORM_X64_PROFILER_STACK_ITEM Item =
+            &Report->StackItems[(Index + Probe) & Mask];
+        if (!Item->Count)
+        {
+            Item->Sample.Rip = Sample->Rip;
+            Item->Sample.ProcessorIndex = Sample->ProcessorIndex;
+            Item->Sample.FrameCount = Sample->FrameCount;
+            for (MO_UINT32 Frame = 0; Frame < Sample->FrameCount; ++Frame)
+            {
+                Item->Sample.Frames[Frame] = Sample->Frames[Frame];
+            }
+            Item->Count = 1;
+            return;
+        }
+
+        if (Item->Sample.Rip != Sample->Rip ||
+            Item->Sample.FrameCount != Sample->FrameCount)
+        {
+            continue;
+        }
+        MO_UINT32 Frame = 0;
+        while (Frame < Sample->FrameCount &&
+            Item->Sample.Frames[Frame] == Sample->Frames[Frame])
+        {
+            ++Frame;
+        }
+        if (Frame == Sample->FrameCount)
+        {
+            ++Item->Count;
+            return;
+        }
+    }
+    ++Report->OverflowSamples;
+}
+
+static MO_VOID MoPlatformProfilerWriteNumber(
+    _Mo_In_ MO_UINT64 Value,
+    _Mo_In_ MO_BOOL Hexadecimal,
+    _Mo_In_ PMO_PLATFORM_X64_PROFILER_WRITE_ROUTINE WriteRoutine,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    // 21 characters: 20 decimal digits + '\0'
+    MO_CHAR NumberBuffer[21];
+
+    MO_RESULT Result = Hexadecimal
+        ? MoRuntimeConvertUnsignedIntegerToHexString(
+            NumberBuffer,
+            nullptr,
+            sizeof(NumberBuffer),
+            (MO_UINTN)Value,
+            sizeof(Value) * 8,
+            MO_TRUE,
+            MO_TRUE)
+        : MoRuntimeConvertUnsignedIntegerToDecimalString(
+            NumberBuffer,
+            nullptr,
+            sizeof(NumberBuffer),
+            (MO_UINTN)Value);
+    WriteRoutine(
+        (MO_RESULT_SUCCESS_OK == Result)
+        ? NumberBuffer
+        : "<Conversion Error>",
+        Context);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformProfilerInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_PROFILER Profiler,
+    _Mo_Out_ PMO_PLATFORM_X64_PROFILER_PROCESSOR Processors,
+    _Mo_In_ MO_UINT32 ProcessorCount,
+    _Mo_Out_ PMO_PLATFORM_X64_PROFILER_SAMPLE SampleBuffer,
+    _Mo_In_ MO_UINT32 SampleCapacity,
+    _Mo_In_ MO_UINT32 SampleFrequency,
+    _Mo_In_ MO_UINT64 TimeStampCounterFrequency,
+    _Mo_In_ MO_UINT32 MaximumFrames,
+    _Mo_In_Opt_ PMO_PLATFORM_X64_PROFILER_STACK_TOP_ROUTINE StackTopRoutine,
+    _Mo_In_Opt_ MO_POINTER StackTopContext)
+{
+    if (!Profiler ||
+        !Processors ||
+        !ProcessorCount ||
+        !SampleBuffer ||
+        !SampleFrequency ||
+        !TimeStampCounterFrequency ||
+        MaximumFrames > MO_PLATFORM_X64_PROFILER_MAXIMUM_FRAMES ||
+        (MaximumFrames && !StackTopRoutine))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MoRuntimeMemoryFillByte(Profiler, 0, sizeof(MO_PLATFORM_X64_PROFILER));
+    MoRuntimeMemoryFillByte(
+        Processors,
+        0,
+        ProcessorCount * sizeof(MO_PLATFORM_X64_PROFILER_PROCESSOR));
+    for (MO_UINT32 Index = 0; Index < ProcessorCount; ++Index)
+    {
+        MO_RESULT Result = MoSpscRingQueueInitialize(
+            &Processors[Index].Queue,
+            &SampleBuffer[(MO_UINTN)Index * SampleCapacity],
+            SampleCapacity,
+            sizeof(MO_PLATFORM_X64_PROFILER_SAMPLE));
+        if (MO_RESULT_SUCCESS_OK != Result)
+        {
+            return Result;
+        }
+    }
+
+    Profiler->Processors = Processors;
+    Profiler->ProcessorCount = ProcessorCount;
+    Profiler->MaximumFrames = MaximumFrames;
+    Profiler->StackTopRoutine = StackTopRoutine;
+    Profiler->StackTopContext = StackTopContext;
+    Profiler->SamplePeriodCycles = TimeStampCounterFrequency / SampleFrequency;
+    Profiler->SamplePeriodNanoseconds =
+        MO_TIME_NANOSECONDS_PER_SECOND / SampleFrequency;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformProfilerStart(
+    _Mo_InOut_ PMO_PLATFORM_X64_PROFILER Profiler,
+    _Mo_InOut_ PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER*
+        LightweightHandlerTable,
+    _Mo_In_ MO_UINT8 Vector)
+{
+    if (!Profiler || !LightweightHandlerTable)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (MoPlatformProfilerActiveProfiler ||
+        MoPlatformProfilerInterruptHandler == LightweightHandlerTable[Vector])
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    Profiler->Vector = Vector;
+    Profiler->PreviousHandler = LightweightHandlerTable[Vector];
+    MoPlatformProfilerPreviousHandler = Profiler->PreviousHandler;
+    MoPlatformProfilerActiveProfiler = Profiler;
+    MoMileCompilerBarrier();
+    LightweightHandlerTable[Vector] = MoPlatformProfilerInterruptHandler;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformProfilerStop(
+    _Mo_InOut_ PMO_PLATFORM_X64_PROFILER Profiler,
+    _Mo_InOut_ PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER*
+        LightweightHandlerTable)
+{
+    if (!Profiler ||
+        !LightweightHandlerTable ||
+        MoPlatformProfilerActiveProfiler != Profiler)
+    {
+        return;
+    }
+
+    LightweightHandlerTable[Profiler->Vector] = Profiler->PreviousHandler;
+    MoMileCompilerBarrier();
+    MoPlatformProfilerActiveProfiler = nullptr;
+}
+
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformProfilerClampTimerInterval(
+    _Mo_In_Opt_ PMO_PLATFORM_X64_PROFILER Profiler,
+    _Mo_In_ MO_UINT64 Nanoseconds)
+{
+    if (!Profiler || MoPlatformProfilerActiveProfiler != Profiler)
+    {
+        return Nanoseconds;
+    }
+
+    return (Nanoseconds < Profiler->SamplePeriodNanoseconds)
+        ? Nanoseconds
+        : Profiler->SamplePeriodNanoseconds;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformProfilerInitializeReport(
+    _Mo_Out_ PMO_PLATFORM_X64_PROFILER_REPORT Report,
+    _Mo_Out_ PMO_PLATFORM_X64_PROFILER_FLAT_ITEM FlatItems,
+    _Mo_In_ MO_UINT32 FlatCapacity,
+    _Mo_Out_Opt_ PMO_PLATFORM_X64_PROFILER_STACK_ITEM StackItems,
+    _Mo_In_ MO_UINT32 StackCapacity)
+{
+    if (!Report ||
+        !FlatItems ||
+        !MoPlatformProfilerIsPowerOfTwo(FlatCapacity))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (StackCapacity &&
+        (!StackItems || !MoPlatformProfilerIsPowerOfTwo(StackCapacity)))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MoRuntimeMemoryFillByte(
+        Report,
+        0,
+        sizeof(MO_PLATFORM_X64_PROFILER_REPORT));
+    MoRuntimeMemoryFillByte(
+        FlatItems,
+        0,
+        FlatCapacity * sizeof(MO_PLATFORM_X64_PROFILER_FLAT_ITEM));
+    if (StackCapacity)
+    {
+        MoRuntimeMemoryFillByte(
+            StackItems,
+            0,
+            StackCapacity * sizeof(MO_PLATFORM_X64_PROFILER_STACK_ITEM));
+    }
+
+    Report->FlatItems = FlatItems;
+    Report->FlatCapacity = FlatCapacity;
+    Report->StackItems = StackCapacity ? StackItems : nullptr;
+    Report->StackCapacity = StackCapacity;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformProfilerCollect(
+    _Mo_InOut_ PMO_PLATFORM_X64_PROFILER Profiler,
+    _Mo_InOut_ PMO_PLATFORM_X64_PROFILER_REPORT Report)
+{
+    MO_PLATFORM_X64_PROFILER_SAMPLE Samples[
+        MO_PLATFORM_X64_PROFILER_COLLECT_BATCH];
+
+    MO_UINT64 Collected = 0;
+    for (MO_UINT32 Index = 0; Index < Profiler->ProcessorCount; ++Index)
+    {
+        for (;;)
+        {
+            MO_UINT32 Count = MoSpscRingQueueDequeue(
+                &Profiler->Processors[Index].Queue,
+                Samples,
+                MO_PLATFORM_X64_PROFILER_COLLECT_BATCH);
+            if (!Count)
+            {
+                break;
+            }
+            for (MO_UINT32 Sample = 0; Sample < Count; ++Sample)
+            {
+                MoPlatformProfilerAggregateSample(Report, &Samples[Sample]);
+            }
+            Collected += Count;
+        }
+    }
+
+    return Collected;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformProfilerWriteFlatProfile(
+    _Mo_In_ PMO_PLATFORM_X64_PROFILER_REPORT Report,
+    _Mo_In_ MO_UINT32 MaximumLines,
+    _Mo_In_ PMO_PLATFORM_X64_PROFILER_WRITE_ROUTINE WriteRoutine,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    WriteRoutine("Samples: ", Context);
+    MoPlatformProfilerWriteNumber(
+        Report->TotalSamples,
+        MO_FALSE,
+        WriteRoutine,
+        Context);
+    WriteRoutine(", not aggregated: ", Context);
+    MoPlatformProfilerWriteNumber(
+        Report->OverflowSamples,
+        MO_FALSE,
+        WriteRoutine,
+        Context);
+    WriteRoutine("\r\n", Context);
+
+    // Select the items in the descending order of the count without sorting
+    // the table, and the items with the same count are in the ascending order
+    // of the address.
+    PMO_PLATFORM_X64_PROFILER_FLAT_ITEM Previous = nullptr;
+    for (MO_UINT32 Line = 0; Line < MaximumLines; ++Line)
+    {
+        PMO_PLATFORM_X64_PROFILER_FLAT_ITEM Best = nullptr;
+        for (MO_UINT32 Index = 0; Index < Report->FlatCapacity; ++Index)
+        {
+            PMO_PLATFORM_X64_PROFILER_FLAT_ITEM Item =
+                &Report->FlatItems[Index];
+            if (!Item->Count)
+            {
+                continue;
+            }
+            if (Previous &&
+                (Item->Count > Previous->Count ||
+                (Item->Count == Previous->Count &&
+                Item->Rip <= Previous->Rip)))
+            {
+                continue;
+            }
+            if (!Best ||
+                Item->Count > Best->Count ||
+                (Item->Count == Best->Count && Item->Rip < Best->Rip))
+            {
+                Best = Item;
+            }
+        }
+        if (!Best)
+        {
+            break;
+        }
+
+        MoPlatformProfilerWriteNumber(
+            Best->Count,
+            MO_FALSE,
+            WriteRoutine,
+            Context);
+        WriteRoutine(" ", Context);
+        MoPlatformProfilerWriteNumber(
+            Best->Count * 100 / Report->TotalSamples,
+            MO_FALSE,
+            WriteRoutine,
+            Context);
+        WriteRoutine("% ", Context);
+        MoPlatformProfilerWriteNumber(
+            Best->Rip,
+            MO_TRUE,
+            WriteRoutine,
+            Context);
+        WriteRoutine("\r\n", Context);
+
+        Previous = Best;
+    }
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformProfilerWriteFoldedStacks(
+    _Mo_In_ PMO_PLATFORM_X64_PROFILER_REPORT Report,
+    _Mo_In_ PMO_PLATFORM_X64_PROFILER_WRITE_ROUTINE WriteRoutine,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    for (MO_UINT32 Index = 0; Index < Report->StackCapacity; ++Index)
+    {
+        PMO_PLATFORM_X64_PROFILER_STACK_ITEM Item =
+            &Report->StackItems[Index];
+        if (!Item->Count)
+        {
+            continue;
+        }
+
+        for (MO_UINT32 Frame = Item->Sample.FrameCount; Frame > 0; --Frame)
+        {
+            MoPlatformProfilerWriteNumber(
+                Item->Sample.Frames[Frame - 1],
+                MO_TRUE,
+                WriteRoutine,
+                Context);
+            WriteRoutine(";", Context);
+        }
+        MoPlatformProfilerWriteNumber(
+            Item->Sample.Rip,
+            MO_TRUE,
+            WriteRoutine,
+            Context);
+        WriteRoutine(" ", Context);
+        MoPlatformProfilerWriteNumber(
+            Item->Count,
+            MO_FALSE,
+            WriteRoutine,
+            Context);
+        WriteRoutine("\r\n", Context);
+    }
+}
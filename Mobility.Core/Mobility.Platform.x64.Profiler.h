@@ -0,0 +1,387 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.Profiler.h
+ * PURPOSE:    Definition for Mobility x64 Sampling Profiler
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_PLATFORM_X64_PROFILER
+#define MOBILITY_PLATFORM_X64_PROFILER
+
+#include "Mobility.Platform.x64.h"
+#include "Mobility.Synchronization.RingQueue.h"
+
+/**
+ * @brief The maximum number of the return addresses recorded in each sample.
+ */
+#define MO_PLATFORM_X64_PROFILER_MAXIMUM_FRAMES 14
+
+/**
+ * @brief Set to 1 if the image is built with the frame pointers, such as with
+ *        the /Oy- option of MSVC, so the frames can be walked by default.
+ */
+#ifndef MO_PLATFORM_X64_PROFILER_FRAME_POINTERS
+#define MO_PLATFORM_X64_PROFILER_FRAME_POINTERS 0
+#endif // !MO_PLATFORM_X64_PROFILER_FRAME_POINTERS
+
+/**
+ * @brief The default number of the return addresses walked for each sample,
+ *        which is zero if the image is not built with the frame pointers.
+ */
+#if MO_PLATFORM_X64_PROFILER_FRAME_POINTERS
+#define MO_PLATFORM_X64_PROFILER_DEFAULT_FRAMES \
+    MO_PLATFORM_X64_PROFILER_MAXIMUM_FRAMES
+#else
+#define MO_PLATFORM_X64_PROFILER_DEFAULT_FRAMES 0
+#endif // MO_PLATFORM_X64_PROFILER_FRAME_POINTERS
+
+/**
+ * @brief The sample taken by the profiler on an interrupt.
+ */
+typedef struct _MO_PLATFORM_X64_PROFILER_SAMPLE
+{
+    /**
+     * @brief The interrupted instruction pointer.
+     */
+    MO_UINT64 Rip;
+    /**
+     * @brief The index of the processor which takes the sample.
+     */
+    MO_UINT32 ProcessorIndex;
+    /**
+     * @brief The number of the valid items in Frames.
+     */
+    MO_UINT32 FrameCount;
+    /**
+     * @brief The return addresses from the innermost caller to the outermost
+     *        one.
+     */
+    MO_UINT64 Frames[MO_PLATFORM_X64_PROFILER_MAXIMUM_FRAMES];
+} MO_PLATFORM_X64_PROFILER_SAMPLE, *PMO_PLATFORM_X64_PROFILER_SAMPLE;
+
+MO_C_STATIC_ASSERT(sizeof(MO_PLATFORM_X64_PROFILER_SAMPLE) == 128);
+
+/**
+ * @brief The sample buffer of a processor, which is only written by the
+ *        interrupt handler on that processor.
+ */
+typedef struct _MO_PLATFORM_X64_PROFILER_PROCESSOR
+{
+    /**
+     * @brief The queue of the samples, which is produced by the sampling
+     *        interrupt and consumed by the drain.
+     */
+    MO_SPSC_RING_QUEUE Queue;
+    /**
+     * @brief The Time Stamp Counter (TSC) value of the last sample.
+     */
+    MO_UINT64 LastSampleTimeStamp;
+    /**
+     * @brief The number of the samples dropped because the queue is full.
+     */
+    MO_UINT64 DroppedSamples;
+    /**
+     * @brief Pads the per-processor state to its own cache line.
+     */
+    MO_UINT8 Reserved[MO_SYNCHRONIZATION_CACHE_LINE_SIZE - 16];
+} MO_PLATFORM_X64_PROFILER_PROCESSOR, *PMO_PLATFORM_X64_PROFILER_PROCESSOR;
+
+/**
+ * @brief The routine which queries the top of the stack containing the
+ *        interrupted stack pointer, which bounds the frame walk.
+ * @param StackTop The pointer to receive the address above the highest byte of
+ *                 the stack.
+ * @param StackPointer The interrupted stack pointer.
+ * @param Context The user-defined context of the routine.
+ * @return MO_TRUE if the stack is known and mapped from the stack pointer to
+ *         the top, MO_FALSE if the frames should not be walked.
+ * @remarks The routine is called in the sampling interrupt. It usually returns
+ *          the KernelStackTop of the current processor block, or the StackBase
+ *          plus the StackSize of the running fiber.
+ */
+typedef MO_BOOL(MOAPI* PMO_PLATFORM_X64_PROFILER_STACK_TOP_ROUTINE)(
+    _Mo_Out_ PMO_UINT64 StackTop,
+    _Mo_In_ MO_UINT64 StackPointer,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief The sampling profiler.
+ */
+typedef struct _MO_PLATFORM_X64_PROFILER
+{
+    /**
+     * @brief The per-processor states of the profiler.
+     */
+    PMO_PLATFORM_X64_PROFILER_PROCESSOR Processors;
+    /**
+     * @brief The number of the per-processor states.
+     */
+    MO_UINT32 ProcessorCount;
+    /**
+     * @brief The number of the return addresses walked for each sample, which
+     *        is zero if only the interrupted instruction pointer is recorded.
+     */
+    MO_UINT32 MaximumFrames;
+    /**
+     * @brief The minimum Time Stamp Counter (TSC) cycles between two samples on
+     *        the same processor.
+     */
+    MO_UINT64 SamplePeriodCycles;
+    /**
+     * @brief The minimum nanoseconds between two samples on the same processor,
+     *        which clamps the timer interval.
+     */
+    MO_UINT64 SamplePeriodNanoseconds;
+    /**
+     * @brief The routine which bounds the frame walk with the top of the
+     *        interrupted stack.
+     */
+    PMO_PLATFORM_X64_PROFILER_STACK_TOP_ROUTINE StackTopRoutine;
+    /**
+     * @brief The user-defined context passed to the stack top routine.
+     */
+    MO_POINTER StackTopContext;
+    /**
+     * @brief The handler which was installed on the vector before the profiler.
+     */
+    PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER PreviousHandler;
+    /**
+     * @brief The interrupt vector of the sampling interrupt.
+     */
+    MO_UINT8 Vector;
+    /**
+     * @brief Reserved bits. Set to 0.
+     */
+    MO_UINT8 Reserved[7];
+} MO_PLATFORM_X64_PROFILER, *PMO_PLATFORM_X64_PROFILER;
+
+/**
+ * @brief The item of the flat profile, which counts the samples of each
+ *        interrupted instruction pointer.
+ */
+typedef struct _MO_PLATFORM_X64_PROFILER_FLAT_ITEM
+{
+    /**
+     * @brief The sampled instruction pointer.
+     */
+    MO_UINT64 Rip;
+    /**
+     * @brief The number of the samples with the instruction pointer.
+     */
+    MO_UINT64 Count;
+} MO_PLATFORM_X64_PROFILER_FLAT_ITEM, *PMO_PLATFORM_X64_PROFILER_FLAT_ITEM;
+
+/**
+ * @brief The item of the folded-stack profile, which counts the samples of
+ *        each distinct call stack.
+ */
+typedef struct _MO_PLATFORM_X64_PROFILER_STACK_ITEM
+{
+    /**
+     * @brief The sample which represents the call stack.
+     */
+    MO_PLATFORM_X64_PROFILER_SAMPLE Sample;
+    /**
+     * @brief The number of the samples with the same call stack.
+     */
+    MO_UINT64 Count;
+} MO_PLATFORM_X64_PROFILER_STACK_ITEM, *PMO_PLATFORM_X64_PROFILER_STACK_ITEM;
+
+/**
+ * @brief The aggregated samples, whose tables are owned by the caller.
+ */
+typedef struct _MO_PLATFORM_X64_PROFILER_REPORT
+{
+    /**
+     * @brief The hash table of the samples aggregated by the instruction
+     *        pointer.
+     */
+    PMO_PLATFORM_X64_PROFILER_FLAT_ITEM FlatItems;
+    /**
+     * @brief The hash table of the samples aggregated by the call stack.
+     */
+    PMO_PLATFORM_X64_PROFILER_STACK_ITEM StackItems;
+    /**
+     * @brief The capacity of the flat table, which must be a power of two.
+     */
+    MO_UINT32 FlatCapacity;
+    /**
+     * @brief The capacity of the stack table, which must be a power of two, or
+     *        zero if the stack table is not used.
+     */
+    MO_UINT32 StackCapacity;
+    /**
+     * @brief The number of the drained samples.
+     */
+    MO_UINT64 TotalSamples;
+    /**
+     * @brief The number of the samples which are not aggregated because the
+     *        tables are full.
+     */
+    MO_UINT64 OverflowSamples;
+} MO_PLATFORM_X64_PROFILER_REPORT, *PMO_PLATFORM_X64_PROFILER_REPORT;
+
+/**
+ * @brief The routine which writes the text of the profile.
+ * @param String The null-terminated ASCII string to write.
+ * @param Context The user-defined context of the routine.
+ * @remark The routine can write to the console, or stream the text to the
+ *         serial port for the tools running on the host.
+ */
+typedef MO_VOID(MOAPI* PMO_PLATFORM_X64_PROFILER_WRITE_ROUTINE)(
+    _Mo_In_ MO_CONSTANT_STRING String,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief Initializes the sampling profiler.
+ * @param Profiler The profiler to initialize.
+ * @param Processors The array of the per-processor sample buffers, which must
+ *                   have ProcessorCount items.
+ * @param ProcessorCount The number of the processors, indexed by the
+ *                       ProcessorIndex of their processor blocks.
+ * @param SampleBuffer The buffer of the samples for all processors, which must
+ *                     have ProcessorCount * SampleCapacity samples.
+ * @param SampleCapacity The number of the samples buffered by each processor,
+ *                       which must be a power of two.
+ * @param SampleFrequency The maximum number of the samples per second on each
+ *                        processor.
+ * @param TimeStampCounterFrequency The frequency in Hz of the Time Stamp
+ *                                  Counter (TSC).
+ * @param MaximumFrames The number of the return addresses walked with the
+ *                      frame pointers for each sample, which must not be
+ *                      greater than MO_PLATFORM_X64_PROFILER_MAXIMUM_FRAMES.
+ * @param StackTopRoutine The routine which queries the top of the interrupted
+ *                        stack, which is required if MaximumFrames is not
+ *                        zero.
+ * @param StackTopContext The user-defined context passed to the stack top
+ *                        routine.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The frames are only walked for the code built with the frame
+ *          pointers, so use MO_PLATFORM_X64_PROFILER_DEFAULT_FRAMES unless the
+ *          caller knows how the image is built. The frames are only read
+ *          between the interrupted stack pointer and the top of the stack.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformProfilerInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_PROFILER Profiler,
+    _Mo_Out_ PMO_PLATFORM_X64_PROFILER_PROCESSOR Processors,
+    _Mo_In_ MO_UINT32 ProcessorCount,
+    _Mo_Out_ PMO_PLATFORM_X64_PROFILER_SAMPLE SampleBuffer,
+    _Mo_In_ MO_UINT32 SampleCapacity,
+    _Mo_In_ MO_UINT32 SampleFrequency,
+    _Mo_In_ MO_UINT64 TimeStampCounterFrequency,
+    _Mo_In_ MO_UINT32 MaximumFrames,
+    _Mo_In_Opt_ PMO_PLATFORM_X64_PROFILER_STACK_TOP_ROUTINE StackTopRoutine,
+    _Mo_In_Opt_ MO_POINTER StackTopContext);
+
+/**
+ * @brief Starts sampling on the interrupts of the specified vector, which is
+ *        usually the local APIC timer vector.
+ * @param Profiler The initialized profiler.
+ * @param LightweightHandlerTable The lightweight interrupt handler table whose
+ *                                handler of the vector is wrapped.
+ * @param Vector The interrupt vector which uses the lightweight interrupt
+ *               entry tier.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The original handler of the vector is still called after each
+ *          sample. Only one profiler can be started at the same time.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformProfilerStart(
+    _Mo_InOut_ PMO_PLATFORM_X64_PROFILER Profiler,
+    _Mo_InOut_ PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER*
+        LightweightHandlerTable,
+    _Mo_In_ MO_UINT8 Vector);
+
+/**
+ * @brief Stops sampling, and restores the original handler of the vector.
+ * @param Profiler The started profiler.
+ * @param LightweightHandlerTable The lightweight interrupt handler table passed
+ *                                to MoPlatformProfilerStart.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformProfilerStop(
+    _Mo_InOut_ PMO_PLATFORM_X64_PROFILER Profiler,
+    _Mo_InOut_ PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER*
+        LightweightHandlerTable);
+
+/**
+ * @brief Clamps the interval of the next one-shot timer interrupt, so the
+ *        timer fires at least at the sample frequency while profiling.
+ * @param Profiler The profiler, or nullptr if no profiler is started.
+ * @param Nanoseconds The interval requested by the owner of the timer.
+ * @return The interval which should be used for arming the timer.
+ * @remarks Without the periodic tick, the timer only fires for the pending
+ *          events, so the owner of the timer should call this function before
+ *          MoPlatformLocalApicArmTimer.
+ */
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformProfilerClampTimerInterval(
+    _Mo_In_Opt_ PMO_PLATFORM_X64_PROFILER Profiler,
+    _Mo_In_ MO_UINT64 Nanoseconds);
+
+/**
+ * @brief Initializes the report for aggregating the samples.
+ * @param Report The report to initialize.
+ * @param FlatItems The table of the flat profile items.
+ * @param FlatCapacity The number of the items in the flat profile table, which
+ *                     must be a power of two.
+ * @param StackItems The table of the folded-stack profile items, which can be
+ *                   nullptr if the folded-stack profile is not needed.
+ * @param StackCapacity The number of the items in the folded-stack profile
+ *                      table, which must be a power of two, or zero if the
+ *                      table is not provided.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformProfilerInitializeReport(
+    _Mo_Out_ PMO_PLATFORM_X64_PROFILER_REPORT Report,
+    _Mo_Out_ PMO_PLATFORM_X64_PROFILER_FLAT_ITEM FlatItems,
+    _Mo_In_ MO_UINT32 FlatCapacity,
+    _Mo_Out_Opt_ PMO_PLATFORM_X64_PROFILER_STACK_ITEM StackItems,
+    _Mo_In_ MO_UINT32 StackCapacity);
+
+/**
+ * @brief Drains the sample buffers of all processors into the report.
+ * @param Profiler The profiler.
+ * @param Report The initialized report.
+ * @return The number of the drained samples.
+ * @remarks The function can be called on any processor while sampling, but
+ *          only by one caller at the same time.
+ */
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformProfilerCollect(
+    _Mo_InOut_ PMO_PLATFORM_X64_PROFILER Profiler,
+    _Mo_InOut_ PMO_PLATFORM_X64_PROFILER_REPORT Report);
+
+/**
+ * @brief Writes the flat profile, one line with the sample count, the
+ *        percentage and the instruction pointer for each of the hottest
+ *        instruction pointers.
+ * @param Report The report.
+ * @param MaximumLines The maximum number of the instruction pointers written.
+ * @param WriteRoutine The routine which writes the text.
+ * @param Context The user-defined context passed to the write routine.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformProfilerWriteFlatProfile(
+    _Mo_In_ PMO_PLATFORM_X64_PROFILER_REPORT Report,
+    _Mo_In_ MO_UINT32 MaximumLines,
+    _Mo_In_ PMO_PLATFORM_X64_PROFILER_WRITE_ROUTINE WriteRoutine,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief Writes the folded-stack profile, one line with the semicolon
+ *        separated frames from the outermost one to the interrupted
+ *        instruction pointer followed by the sample count for each distinct
+ *        call stack.
+ * @param Report The report.
+ * @param WriteRoutine The routine which writes the text.
+ * @param Context The user-defined context passed to the write routine.
+ * @remarks The format is accepted by the common flame graph tools.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformProfilerWriteFoldedStacks(
+    _Mo_In_ PMO_PLATFORM_X64_PROFILER_REPORT Report,
+    _Mo_In_ PMO_PLATFORM_X64_PROFILER_WRITE_ROUTINE WriteRoutine,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+#endif // !MOBILITY_PLATFORM_X64_PROFILER
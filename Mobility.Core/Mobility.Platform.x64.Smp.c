@@ -0,0 +1,325 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.Smp.c
+ * PURPOSE:    Implementation for Mobility x64 Multiprocessor Startup
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Platform.x64.Smp.h"
+
+#include "Mobility.Platform.x64.Fpu.h"
+#include "Mobility.Platform.x64.PageTable.h"
+#include "Mobility.Runtime.Core.h"
+
+#include <Mile.Mobility.Utilities.MemoryAccess.h>
+
+/*
+ * The raw values of the flat segment descriptors, which have zero base and the
+ * 4 GiB limit. The base and limit are ignored for the code segments and most
+ * data segment accesses in the 64-bit mode.
+ */
+
+#define MO_PLATFORM_X64_SMP_CODE32_DESCRIPTOR 0x00CF9A000000FFFFULL
+#define MO_PLATFORM_X64_SMP_KERNEL_CODE_DESCRIPTOR 0x00AF9A000000FFFFULL
+#define MO_PLATFORM_X64_SMP_KERNEL_DATA_DESCRIPTOR 0x00CF92000000FFFFULL
+#define MO_PLATFORM_X64_SMP_USER_DATA_DESCRIPTOR 0x00CFF2000000FFFFULL
+#define MO_PLATFORM_X64_SMP_USER_CODE_DESCRIPTOR 0x00AFFA000000FFFFULL
+
+/**
+ * @brief The present and writable bits of the temporary paging-structure
+ *        entries.
+ */
+#define MO_PLATFORM_X64_SMP_TABLE_ENTRY_FLAGS 0x3ULL
+
+/**
+ * @brief The present, writable and page size bits of the temporary 2 MiB page
+ *        directory entry.
+ */
+#define MO_PLATFORM_X64_SMP_LARGE_PAGE_ENTRY_FLAGS 0x83ULL
+
+MO_FORCEINLINE PMO_PLATFORM_X64_SMP_TRAMPOLINE_DATA
+MoPlatformSmpGetTrampolineData(
+    _Mo_In_ MO_UINT64 TrampolineBase)
+{
+    return (PMO_PLATFORM_X64_SMP_TRAMPOLINE_DATA)(MO_UINTN)(
+        TrampolineBase + MO_PLATFORM_X64_SMP_TRAMPOLINE_DATA_OFFSET);
+}
+
+/**
+ * @brief Waits until the application processor has started or the specified
+ *        time has elapsed.
+ * @return MO_TRUE if the application processor has started.
+ */
+MO_FORCEINLINE MO_BOOL MoPlatformSmpWaitForStarted(
+    _Mo_In_ PMO_PLATFORM_X64_PROCESSOR_BLOCK Block,
+    _Mo_In_ MO_UINT64 Nanoseconds)
+{
+    // Nothing else may update the monotonic time while the processors are
+    // being started, so keep it accumulated while waiting.
+    MoTimeUpdate();
+    MO_UINT64 Deadline = MoTimeGetMonotonicNanoseconds() + Nanoseconds;
+    while (!Block->Started)
+    {
+        MoTimeUpdate();
+        if (MoTimeGetMonotonicNanoseconds() >= Deadline)
+        {
+            return Block->Started ? MO_TRUE : MO_FALSE;
+        }
+        MoPlatformPause();
+    }
+    return MO_TRUE;
+}
+
+static MO_VOID MOAPI MoPlatformSmpApplicationProcessorEntry(
+    _Mo_In_ PMO_PLATFORM_X64_PROCESSOR_BLOCK Block)
+{
+    MoPlatformProcessorBlockLoad(Block);
+
+    MoMileCompilerBarrier();
+    Block->Started = 1u;
+    MoMileCompilerBarrier();
+
+    if (Block->StartRoutine)
+    {
+        Block->StartRoutine(Block);
+    }
+
+    for (;;)
+    {
+        MoPlatformDisableInterrupts();
+        MoPlatformHalt();
+    }
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformProcessorBlockInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_PROCESSOR_BLOCK Block,
+    _Mo_In_ MO_UINT32 ProcessorIndex,
+    _Mo_In_ MO_UINT32 ApicId,
+    _Mo_In_ MO_UINT64 KernelStackTop,
+    _Mo_In_ MO_UINT64 InterruptStackTop)
+{
+    if (!Block ||
+        !KernelStackTop || (KernelStackTop & 0xF) ||
+        !InterruptStackTop || (InterruptStackTop & 0xF))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (MO_RESULT_SUCCESS_OK != MoRuntimeMemoryFillByte(
+        Block,
+        0,
+        sizeof(MO_PLATFORM_X64_PROCESSOR_BLOCK)))
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    Block->Self = Block;
+    Block->ProcessorIndex = ProcessorIndex;
+    Block->ApicId = ApicId;
+    Block->KernelStackTop = KernelStackTop;
+    Block->InterruptStackTop = InterruptStackTop;
+    MoPlatformStoreInterruptDescriptorTable(&Block->InterruptDescriptorTable);
+
+    PMO_PLATFORM_X64_GDT_DESCRIPTORS Gdt = &Block->GlobalDescriptorTable;
+    Gdt->KernelCode.RawData = MO_PLATFORM_X64_SMP_KERNEL_CODE_DESCRIPTOR;
+    Gdt->KernelData.RawData = MO_PLATFORM_X64_SMP_KERNEL_DATA_DESCRIPTOR;
+    Gdt->UserData.RawData = MO_PLATFORM_X64_SMP_USER_DATA_DESCRIPTOR;
+    Gdt->UserCode.RawData = MO_PLATFORM_X64_SMP_USER_CODE_DESCRIPTOR;
+    MoPlatformSetSystemSegmentDescriptorBase(
+        &Gdt->Tss,
+        (MO_UINT64)(MO_UINTN)(&Block->TaskStateSegment));
+    MoPlatformSetSystemSegmentDescriptorLimit(
+        &Gdt->Tss,
+        sizeof(MO_PLATFORM_X64_TASK_STATE_SEGMENT) - 1);
+    Gdt->Tss.Type = MO_PLATFORM_X64_SYSTEM_SEGMENT_TYPE_TSS_AVAILABLE;
+    Gdt->Tss.P = 1;
+
+    // No I/O permission bit map, because the offset is beyond the TSS limit.
+    PMO_PLATFORM_X64_TASK_STATE_SEGMENT Tss = &Block->TaskStateSegment;
+    Tss->RSP[0] = KernelStackTop;
+    Tss->IST[0] = InterruptStackTop;
+    Tss->IoMapBaseAddress = sizeof(MO_PLATFORM_X64_TASK_STATE_SEGMENT);
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformProcessorBlockLoad(
+    _Mo_In_ PMO_PLATFORM_X64_PROCESSOR_BLOCK Block)
+{
+    MO_PLATFORM_X64_PSEUDO_DESCRIPTOR Descriptor;
+    Descriptor.Limit = (MO_UINT16)(sizeof(MO_PLATFORM_X64_GDT_DESCRIPTORS) - 1);
+    Descriptor.Base = (MO_UINT64)(MO_UINTN)(&Block->GlobalDescriptorTable);
+    MoPlatformLoadGlobalDescriptorTable(&Descriptor);
+    MoPlatformSetCodeSegmentSelector(MO_PLATFORM_X64_SEGMENT_KERNEL_CODE);
+    MoPlatformSetDataSegmentSelectors(MO_PLATFORM_X64_SEGMENT_KERNEL_DATA);
+    MoPlatformLoadTaskRegister(MO_PLATFORM_X64_SEGMENT_TSS);
+
+    MoPlatformWriteMsr(
+        MO_PLATFORM_X64_MSR_GS_BASE,
+        (MO_UINT64)(MO_UINTN)(Block));
+    MoPlatformWriteMsr(MO_PLATFORM_X64_MSR_KERNEL_GS_BASE, 0u);
+
+    MoPlatformLoadInterruptDescriptorTable(&Block->InterruptDescriptorTable);
+}
+
+MO_EXTERN_C PMO_PLATFORM_X64_PROCESSOR_BLOCK MOAPI
+MoPlatformGetCurrentProcessorBlock()
+{
+    return (PMO_PLATFORM_X64_PROCESSOR_BLOCK)(MO_UINTN)(
+        MoPlatformReadGsQword(0));
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformSmpPrepareTrampoline(
+    _Mo_In_ MO_UINT64 TrampolineBase)
+{
+    if (!TrampolineBase ||
+        (TrampolineBase & (MO_PLATFORM_X64_PAGE_SIZE - 1)) ||
+        TrampolineBase > MO_PLATFORM_X64_SMP_TRAMPOLINE_MAXIMUM_ADDRESS -
+            MO_PLATFORM_X64_SMP_TRAMPOLINE_PAGES * MO_PLATFORM_X64_PAGE_SIZE)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MO_UINT64 Cr4 = MoPlatformReadCr4();
+    if (Cr4 & MO_PLATFORM_X64_CR4_LA57)
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    if (MO_RESULT_SUCCESS_OK != MoRuntimeMemoryFillByte(
+        (MO_POINTER)(MO_UINTN)(TrampolineBase),
+        0,
+        MO_PLATFORM_X64_SMP_TRAMPOLINE_PAGES * MO_PLATFORM_X64_PAGE_SIZE))
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+    if (MO_RESULT_SUCCESS_OK != MoRuntimeMemoryMove(
+        (MO_POINTER)(MO_UINTN)(TrampolineBase),
+        MoPlatformSmpTrampolineCode,
+        MO_PLATFORM_X64_SMP_TRAMPOLINE_CODE_SIZE))
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    // The temporary page tables only identity map the first 2 MiB, which is
+    // enough for executing the trampoline until CR3 of the bootstrap processor
+    // is loaded.
+    MO_UINT64 PageMapLevel4 = TrampolineBase + MO_PLATFORM_X64_PAGE_SIZE;
+    MO_UINT64 PageDirectoryPointer = PageMapLevel4 + MO_PLATFORM_X64_PAGE_SIZE;
+    MO_UINT64 PageDirectory = PageDirectoryPointer + MO_PLATFORM_X64_PAGE_SIZE;
+    *(PMO_UINT64)(MO_UINTN)(PageMapLevel4) =
+        PageDirectoryPointer | MO_PLATFORM_X64_SMP_TABLE_ENTRY_FLAGS;
+    *(PMO_UINT64)(MO_UINTN)(PageDirectoryPointer) =
+        PageDirectory | MO_PLATFORM_X64_SMP_TABLE_ENTRY_FLAGS;
+    *(PMO_UINT64)(MO_UINTN)(PageDirectory) =
+        MO_PLATFORM_X64_SMP_LARGE_PAGE_ENTRY_FLAGS;
+
+    PMO_PLATFORM_X64_SMP_TRAMPOLINE_DATA Data =
+        MoPlatformSmpGetTrampolineData(TrampolineBase);
+    Data->Gdt[1] = MO_PLATFORM_X64_SMP_CODE32_DESCRIPTOR;
+    Data->Gdt[2] = MO_PLATFORM_X64_SMP_KERNEL_DATA_DESCRIPTOR;
+    Data->Gdt[3] = MO_PLATFORM_X64_SMP_KERNEL_CODE_DESCRIPTOR;
+    Data->GdtLimit = (MO_UINT16)(sizeof(Data->Gdt) - 1);
+    Data->GdtBase = (MO_UINT32)(MO_UINTN)(&Data->Gdt[0]);
+    Data->ProtectedModeEntry = (MO_UINT32)(
+        TrampolineBase + MO_PLATFORM_X64_SMP_TRAMPOLINE_PROTECTED_MODE_ENTRY);
+    Data->ProtectedModeSelector =
+        MO_PLATFORM_X64_SMP_TRAMPOLINE_CODE32_SELECTOR;
+    Data->LongModeEntry = (MO_UINT32)(
+        TrampolineBase + MO_PLATFORM_X64_SMP_TRAMPOLINE_LONG_MODE_ENTRY);
+    Data->LongModeSelector = MO_PLATFORM_X64_SMP_TRAMPOLINE_CODE64_SELECTOR;
+    Data->TemporaryCr3 = (MO_UINT32)(PageMapLevel4);
+
+    // IA32_EFER.LMA is set by the processor when the paging is enabled, and
+    // IA32_EFER.NXE must be inherited before loading the page tables of the
+    // bootstrap processor which may use the execute-disable bit.
+    Data->Efer = (MO_UINT32)(
+        MoPlatformReadMsr(MO_PLATFORM_X64_MSR_EFER) &
+        ~MO_PLATFORM_X64_EFER_LONG_MODE_ACTIVE);
+
+    // CR0.TS belongs to the lazy FPU state switching of the bootstrap
+    // processor, so the application processors start without it.
+    Data->Cr0 = MoPlatformReadCr0() & ~MO_PLATFORM_X64_CR0_TASK_SWITCHED;
+    Data->Cr3 = MoPlatformReadCr3();
+    Data->Cr4 = Cr4;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformSmpStartProcessor(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ MO_UINT64 TrampolineBase,
+    _Mo_InOut_ PMO_PLATFORM_X64_PROCESSOR_BLOCK Block,
+    _Mo_In_ PMO_PLATFORM_X64_PROCESSOR_START_ROUTINE StartRoutine,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    if (!Apic ||
+        !TrampolineBase ||
+        (TrampolineBase & (MO_PLATFORM_X64_PAGE_SIZE - 1)) ||
+        TrampolineBase >= MO_PLATFORM_X64_SMP_TRAMPOLINE_MAXIMUM_ADDRESS ||
+        !Block ||
+        Block->Self != Block ||
+        !StartRoutine)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (!MoTimeGetCurrentClockSource())
+    {
+        // The delays of the startup sequence are measured by the monotonic
+        // clock.
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    Block->StartRoutine = StartRoutine;
+    Block->Context = Context;
+    Block->Started = 0u;
+
+    PMO_PLATFORM_X64_SMP_TRAMPOLINE_DATA Data =
+        MoPlatformSmpGetTrampolineData(TrampolineBase);
+    Data->StackTop = Block->KernelStackTop;
+    Data->EntryPoint =
+        (MO_UINT64)(MO_UINTN)(MoPlatformSmpApplicationProcessorEntry);
+    Data->Argument = (MO_UINT64)(MO_UINTN)(Block);
+    MoMileCompilerBarrier();
+
+    MO_RESULT Result = MoPlatformLocalApicSendInterProcessorInterrupt(
+        Apic,
+        Block->ApicId,
+        MO_PLATFORM_X64_APIC_COMMAND_INIT);
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+    MoPlatformSmpWaitForStarted(Block, MO_PLATFORM_X64_SMP_INIT_DELAY);
+
+    MO_UINT32 StartupCommand = MO_PLATFORM_X64_APIC_COMMAND_STARTUP | (
+        (MO_UINT32)(TrampolineBase >> 12));
+    for (MO_UINTN i = 0; i < 2; ++i)
+    {
+        Result = MoPlatformLocalApicSendInterProcessorInterrupt(
+            Apic,
+            Block->ApicId,
+            StartupCommand);
+        if (MO_RESULT_SUCCESS_OK != Result)
+        {
+            return Result;
+        }
+        if (MoPlatformSmpWaitForStarted(
+            Block,
+            MO_PLATFORM_X64_SMP_STARTUP_DELAY))
+        {
+            return MO_RESULT_SUCCESS_OK;
+        }
+    }
+
+    if (!MoPlatformSmpWaitForStarted(
+        Block,
+        MO_PLATFORM_X64_SMP_STARTUP_TIMEOUT))
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
@@ -0,0 +1,352 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.Smp.h
+ * PURPOSE:    Definition for Mobility x64 Multiprocessor Startup
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_PLATFORM_X64_SMP
+#define MOBILITY_PLATFORM_X64_SMP
+
+#include "Mobility.Platform.x64.h"
+#include "Mobility.Platform.x64.Apic.h"
+
+/*
+ * The Model-Specific Registers (MSRs) and the control register bits used by
+ * the multiprocessor startup.
+ *
+ * @remark Intel(R) 64 and IA-32 Architectures Software Developer's Manual
+ *         (December 2023)
+ *           Volume 3 (3A, 3B, 3C, & 3D): System Programming Guide
+ *             2.2.1 Extended Feature Enable Register
+ *             2.5 Control Registers
+ *             3.4.4 Segment Loading Instructions in IA-32e Mode
+ */
+
+#define MO_PLATFORM_X64_MSR_EFER 0xC0000080
+#define MO_PLATFORM_X64_MSR_GS_BASE 0xC0000101
+#define MO_PLATFORM_X64_MSR_KERNEL_GS_BASE 0xC0000102
+#define MO_PLATFORM_X64_EFER_LONG_MODE_ACTIVE 0x400ULL
+#define MO_PLATFORM_X64_CR4_LA57 0x1000ULL
+
+/*
+ * The interrupt commands of the INIT-SIPI-SIPI sequence.
+ *
+ * @remark Intel(R) 64 and IA-32 Architectures Software Developer's Manual
+ *         (December 2023)
+ *           Volume 3 (3A, 3B, 3C, & 3D): System Programming Guide
+ *             9.4.4.1 Typical BSP Initialization Sequence
+ *             11.6.1 Interrupt Command Register (ICR)
+ */
+
+#define MO_PLATFORM_X64_APIC_COMMAND_INIT 0x00004500
+#define MO_PLATFORM_X64_APIC_COMMAND_STARTUP 0x00004600
+
+/*
+ * The delays in nanoseconds of the INIT-SIPI-SIPI sequence, and the time for
+ * waiting the application processor to report that it has started.
+ */
+
+#define MO_PLATFORM_X64_SMP_INIT_DELAY 10000000ULL
+#define MO_PLATFORM_X64_SMP_STARTUP_DELAY 200000ULL
+#define MO_PLATFORM_X64_SMP_STARTUP_TIMEOUT 100000000ULL
+
+/**
+ * @brief The number of the 4 KiB pages used by the trampoline, which are the
+ *        code and data page followed by the temporary PML4, PDPT and PD pages.
+ */
+#define MO_PLATFORM_X64_SMP_TRAMPOLINE_PAGES 4
+
+/**
+ * @brief The trampoline must be below this address, because the startup IPI
+ *        can only start the application processors in the first 1 MiB.
+ */
+#define MO_PLATFORM_X64_SMP_TRAMPOLINE_MAXIMUM_ADDRESS 0x100000ULL
+
+/**
+ * @brief The size in bytes of MoPlatformSmpTrampolineCode.
+ */
+#define MO_PLATFORM_X64_SMP_TRAMPOLINE_CODE_SIZE 0x9D
+
+/**
+ * @brief The offset in bytes of MO_PLATFORM_X64_SMP_TRAMPOLINE_DATA in the
+ *        trampoline page, which is hard-coded in MoPlatformSmpTrampolineCode.
+ */
+#define MO_PLATFORM_X64_SMP_TRAMPOLINE_DATA_OFFSET 0x100
+
+/*
+ * The offsets in bytes of the entry points in MoPlatformSmpTrampolineCode.
+ */
+
+#define MO_PLATFORM_X64_SMP_TRAMPOLINE_PROTECTED_MODE_ENTRY 0x22
+#define MO_PLATFORM_X64_SMP_TRAMPOLINE_LONG_MODE_ENTRY 0x5E
+
+/*
+ * The selectors of the temporary GDT in the trampoline data.
+ */
+
+#define MO_PLATFORM_X64_SMP_TRAMPOLINE_CODE32_SELECTOR 0x08
+#define MO_PLATFORM_X64_SMP_TRAMPOLINE_DATA_SELECTOR 0x10
+#define MO_PLATFORM_X64_SMP_TRAMPOLINE_CODE64_SELECTOR 0x18
+
+/**
+ * @brief The data shared between the bootstrap processor and the trampoline
+ *        code, which is at MO_PLATFORM_X64_SMP_TRAMPOLINE_DATA_OFFSET of the
+ *        trampoline page.
+ * @remark The layout is hard-coded in MoPlatformSmpTrampolineCode.
+ */
+typedef struct _MO_PLATFORM_X64_SMP_TRAMPOLINE_DATA
+{
+    MO_UINT16 Reserved0[3];
+    /**
+     * @brief The limit of the temporary GDT, which is followed by GdtBase so
+     *        the two fields form the 32-bit pseudo-descriptor.
+     */
+    MO_UINT16 GdtLimit;
+    /**
+     * @brief The physical address of the temporary GDT.
+     */
+    MO_UINT32 GdtBase;
+    /**
+     * @brief The physical address of the 32-bit protected mode code, which is
+     *        followed by ProtectedModeSelector as the far pointer.
+     */
+    MO_UINT32 ProtectedModeEntry;
+    MO_UINT16 ProtectedModeSelector;
+    MO_UINT16 Reserved1;
+    /**
+     * @brief The physical address of the 64-bit long mode code, which is
+     *        followed by LongModeSelector as the far pointer.
+     */
+    MO_UINT32 LongModeEntry;
+    MO_UINT16 LongModeSelector;
+    MO_UINT16 Reserved2[3];
+    /**
+     * @brief The physical address of the temporary PML4, which identity maps
+     *        the first 2 MiB.
+     */
+    MO_UINT32 TemporaryCr3;
+    /**
+     * @brief The lower 32 bits of IA32_EFER of the bootstrap processor, which
+     *        has IA32_EFER.LME set and IA32_EFER.LMA cleared.
+     */
+    MO_UINT32 Efer;
+    /**
+     * @brief The CR0 of the bootstrap processor.
+     */
+    MO_UINT64 Cr0;
+    /**
+     * @brief The CR3 of the bootstrap processor, which must identity map the
+     *        trampoline page.
+     */
+    MO_UINT64 Cr3;
+    /**
+     * @brief The CR4 of the bootstrap processor.
+     */
+    MO_UINT64 Cr4;
+    /**
+     * @brief The initial stack pointer of the entry point.
+     */
+    MO_UINT64 StackTop;
+    /**
+     * @brief The entry point called in the long mode.
+     */
+    MO_UINT64 EntryPoint;
+    /**
+     * @brief The argument passed to the entry point.
+     */
+    MO_UINT64 Argument;
+    /**
+     * @brief The temporary GDT, which contains the null descriptor, the 32-bit
+     *        code descriptor, the data descriptor and the 64-bit code
+     *        descriptor.
+     */
+    MO_UINT64 Gdt[4];
+} MO_PLATFORM_X64_SMP_TRAMPOLINE_DATA, *PMO_PLATFORM_X64_SMP_TRAMPOLINE_DATA;
+
+MO_C_STATIC_ASSERT(sizeof(MO_PLATFORM_X64_SMP_TRAMPOLINE_DATA) == 0x78);
+
+/**
+ * @brief The application processor startup code, which is copied to the
+ *        trampoline page by MoPlatformSmpPrepareTrampoline.
+ */
+MO_EXTERN_C MO_UINT8 MoPlatformSmpTrampolineCode[
+    MO_PLATFORM_X64_SMP_TRAMPOLINE_CODE_SIZE];
+
+typedef struct _MO_PLATFORM_X64_PROCESSOR_BLOCK
+    MO_PLATFORM_X64_PROCESSOR_BLOCK, *PMO_PLATFORM_X64_PROCESSOR_BLOCK;
+
+/**
+ * @brief The routine called on the application processor after its processor
+ *        block is loaded.
+ * @param Block The processor block of the current processor.
+ * @remark The interrupts are disabled when the routine is called, and the
+ *         processor halts forever if the routine returns.
+ */
+typedef MO_VOID(MOAPI* PMO_PLATFORM_X64_PROCESSOR_START_ROUTINE)(
+    _Mo_In_ PMO_PLATFORM_X64_PROCESSOR_BLOCK Block);
+
+/**
+ * @brief The per-processor block, which is pointed by the GS base of its
+ *        processor and contains the GDT and the TSS of its processor.
+ * @remark The IDT is shared by all processors, and the IDT gates which use
+ *         IST1 run on the interrupt stack of the current processor.
+ */
+struct _MO_PLATFORM_X64_PROCESSOR_BLOCK
+{
+    /**
+     * @brief The address of this block, which is read from GS:[0] by
+     *        MoPlatformGetCurrentProcessorBlock.
+     */
+    PMO_PLATFORM_X64_PROCESSOR_BLOCK Self;
+    /**
+     * @brief The zero-based index of the processor, and the bootstrap processor
+     *        is zero by convention.
+     */
+    MO_UINT32 ProcessorIndex;
+    /**
+     * @brief The local APIC ID or the x2APIC ID of the processor.
+     */
+    MO_UINT32 ApicId;
+    /**
+     * @brief The top of the kernel stack, which is also RSP0 of the TSS.
+     */
+    MO_UINT64 KernelStackTop;
+    /**
+     * @brief The top of the interrupt stack, which is IST1 of the TSS.
+     */
+    MO_UINT64 InterruptStackTop;
+    /**
+     * @brief The user stack pointer saved by MoPlatformSystemCallEntry before
+     *        switching to the kernel stack. The assembly parts access this
+     *        member and KernelStackTop with their offsets.
+     */
+    MO_UINT64 SystemCallUserStackPointer;
+    /**
+     * @brief The routine called on the application processor.
+     */
+    PMO_PLATFORM_X64_PROCESSOR_START_ROUTINE StartRoutine;
+    /**
+     * @brief The user-defined context of the start routine.
+     */
+    MO_POINTER Context;
+    /**
+     * @brief The local APIC of the processor, which is set by
+     *        MoPlatformLocalApicInstallHandlers and used by its interrupt
+     *        handlers.
+     */
+    PMO_PLATFORM_X64_LOCAL_APIC LocalApic;
+    /**
+     * @brief Set to non-zero by the application processor after its processor
+     *        block is loaded.
+     */
+    volatile MO_UINT32 Started;
+    MO_UINT32 Reserved0;
+    MO_UINT16 Reserved1[3];
+    /**
+     * @brief The pseudo-descriptor of the shared IDT.
+     */
+    MO_PLATFORM_X64_PSEUDO_DESCRIPTOR InterruptDescriptorTable;
+    /**
+     * @brief The GDT of the processor.
+     */
+    MO_PLATFORM_X64_GDT_DESCRIPTORS GlobalDescriptorTable;
+    /**
+     * @brief The TSS of the processor.
+     */
+    MO_PLATFORM_X64_TASK_STATE_SEGMENT TaskStateSegment;
+};
+
+/**
+ * @brief Initializes the processor block with its GDT and TSS, and records the
+ *        IDT of the current processor as the shared IDT.
+ * @param Block The processor block to be initialized.
+ * @param ProcessorIndex The zero-based index of the processor.
+ * @param ApicId The local APIC ID or the x2APIC ID of the processor.
+ * @param KernelStackTop The top of the kernel stack, which must be 16-byte
+ *                       aligned.
+ * @param InterruptStackTop The top of the interrupt stack, which must be
+ *                          16-byte aligned.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformProcessorBlockInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_PROCESSOR_BLOCK Block,
+    _Mo_In_ MO_UINT32 ProcessorIndex,
+    _Mo_In_ MO_UINT32 ApicId,
+    _Mo_In_ MO_UINT64 KernelStackTop,
+    _Mo_In_ MO_UINT64 InterruptStackTop);
+
+/**
+ * @brief Loads the GDT, the TSS and the shared IDT of the processor block on
+ *        the current processor, and points the GS base to the processor block.
+ * @param Block The processor block of the current processor.
+ * @remarks The interrupts must be disabled, and the IDT gates must use the
+ *          MO_PLATFORM_X64_SEGMENT_KERNEL_CODE selector. The GS base is written
+ *          after the segment selectors are loaded, because loading GS in the
+ *          64-bit mode also loads the base from the descriptor.
+ *          Each processor block can only be loaded once, because the TSS
+ *          descriptor is marked busy by loading the task register.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformProcessorBlockLoad(
+    _Mo_In_ PMO_PLATFORM_X64_PROCESSOR_BLOCK Block);
+
+/**
+ * @brief Acquires the processor block of the current processor.
+ * @return The processor block of the current processor, which is only valid
+ *         after MoPlatformProcessorBlockLoad is called on it.
+ */
+MO_EXTERN_C PMO_PLATFORM_X64_PROCESSOR_BLOCK MOAPI
+MoPlatformGetCurrentProcessorBlock();
+
+/**
+ * @brief Prepares the trampoline for starting the application processors,
+ *        which copies the trampoline code, builds the temporary GDT and page
+ *        tables, and records the control registers of the current processor.
+ * @param TrampolineBase The physical address of the
+ *                       MO_PLATFORM_X64_SMP_TRAMPOLINE_PAGES pages for the
+ *                       trampoline, which must be 4 KiB aligned, below
+ *                       MO_PLATFORM_X64_SMP_TRAMPOLINE_MAXIMUM_ADDRESS and
+ *                       identity mapped by the current page tables.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The 5-level paging is not supported by the trampoline, so if
+ *          CR4.LA57 is set, the function returns MO_RESULT_ERROR_NO_INTERFACE.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformSmpPrepareTrampoline(
+    _Mo_In_ MO_UINT64 TrampolineBase);
+
+/**
+ * @brief Starts an application processor with the INIT-SIPI-SIPI sequence,
+ *        which loads the processor block on the application processor and
+ *        calls the start routine.
+ * @param Apic The local APIC of the bootstrap processor.
+ * @param TrampolineBase The physical address of the trampoline prepared by
+ *                       MoPlatformSmpPrepareTrampoline.
+ * @param Block The initialized processor block of the application processor,
+ *              whose kernel stack is used for calling the start routine.
+ * @param StartRoutine The routine called on the application processor.
+ * @param Context The user-defined context of the start routine.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The delays of the sequence are measured by
+ *          MoTimeGetMonotonicNanoseconds, so if no clock source is registered,
+ *          the function returns MO_RESULT_ERROR_NO_INTERFACE.
+ *          The second startup IPI is only sent if the application processor
+ *          has not started after the first one. If the application processor
+ *          does not start within MO_PLATFORM_X64_SMP_STARTUP_TIMEOUT, the
+ *          function returns MO_RESULT_ERROR_NO_INTERFACE.
+ *          The application processors share the trampoline, so they must be
+ *          started one by one.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformSmpStartProcessor(
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ MO_UINT64 TrampolineBase,
+    _Mo_InOut_ PMO_PLATFORM_X64_PROCESSOR_BLOCK Block,
+    _Mo_In_ PMO_PLATFORM_X64_PROCESSOR_START_ROUTINE StartRoutine,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+#endif // !MOBILITY_PLATFORM_X64_SMP
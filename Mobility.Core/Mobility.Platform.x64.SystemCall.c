@@ -0,0 +1,94 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.SystemCall.c
+ * PURPOSE:    Implementation for Mobility x64 Fast System Call Entry
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Platform.x64.SystemCall.h"
+
+#include "Mobility.Platform.x64.Smp.h"
+
+MO_C_STATIC_ASSERT(
+    MO_PLATFORM_X64_SEGMENT_KERNEL_DATA ==
+    MO_PLATFORM_X64_SEGMENT_KERNEL_CODE + 8);
+MO_C_STATIC_ASSERT(
+    MO_PLATFORM_X64_SEGMENT_USER_DATA ==
+    MO_PLATFORM_X64_SEGMENT_KERNEL_DATA + 8);
+MO_C_STATIC_ASSERT(
+    MO_PLATFORM_X64_SEGMENT_USER_CODE ==
+    MO_PLATFORM_X64_SEGMENT_KERNEL_DATA + 16);
+
+static PMO_PLATFORM_X64_SYSTEM_CALL_HANDLER* MoPlatformSystemCallHandlers =
+    nullptr;
+
+static MO_UINT32 MoPlatformSystemCallHandlerCount = 0;
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformSystemCallInitialize(
+    _Mo_In_ PMO_PLATFORM_X64_SYSTEM_CALL_HANDLER* Handlers,
+    _Mo_In_ MO_UINT32 HandlerCount)
+{
+    if (!Handlers || !HandlerCount)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MoPlatformSystemCallHandlers = Handlers;
+    MoPlatformSystemCallHandlerCount = HandlerCount;
+
+    // SYSCALL loads CS from STAR[47:32] and SS from the next selector, and the
+    // 64-bit SYSRET loads SS and CS from the two selectors after STAR[63:48],
+    // with RPL forced to 3.
+    MO_UINT64 Star = 0;
+    Star |= ((MO_UINT64)MO_PLATFORM_X64_SEGMENT_KERNEL_CODE) << 32;
+    Star |= ((MO_UINT64)(MO_PLATFORM_X64_SEGMENT_KERNEL_DATA | 3)) << 48;
+
+    MO_UINTN PreviousState = MoPlatformSaveAndDisableInterrupts();
+    MoPlatformWriteMsr(MO_PLATFORM_X64_MSR_STAR, Star);
+    MoPlatformWriteMsr(
+        MO_PLATFORM_X64_MSR_LSTAR,
+        (MO_UINT64)(MO_UINTN)(&MoPlatformSystemCallEntry));
+    MoPlatformWriteMsr(
+        MO_PLATFORM_X64_MSR_FMASK,
+        MO_PLATFORM_X64_SYSTEM_CALL_FLAGS_MASK);
+    MoPlatformWriteMsr(
+        MO_PLATFORM_X64_MSR_EFER,
+        MoPlatformReadMsr(MO_PLATFORM_X64_MSR_EFER) |
+        MO_PLATFORM_X64_EFER_SYSTEM_CALL_ENABLE);
+    MoPlatformRestoreInterrupts(PreviousState);
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformSystemCallDispatch(
+    _Mo_InOut_ PMO_PLATFORM_X64_SYSTEM_CALL_FRAME Frame)
+{
+    MO_UINT64 Number = Frame->Number;
+    if (Number >= MoPlatformSystemCallHandlerCount)
+    {
+        return MO_PLATFORM_X64_SYSTEM_CALL_INVALID_NUMBER;
+    }
+    PMO_PLATFORM_X64_SYSTEM_CALL_HANDLER Handler =
+        MoPlatformSystemCallHandlers[Number];
+    if (!Handler)
+    {
+        return MO_PLATFORM_X64_SYSTEM_CALL_INVALID_NUMBER;
+    }
+
+    // Keep the return context away from the handler, so the handler cannot
+    // change where the caller resumes. The entry still checks the return
+    // address, because SYSCALL at the end of the lower half returns to a
+    // non-canonical address.
+    MO_UINT64 Rip = Frame->Rip;
+    MO_UINT64 RFlags = Frame->RFlags;
+    MO_UINT64 Rsp = Frame->Rsp;
+    MO_UINT64 Result = Handler(Frame);
+    Frame->Rip = Rip;
+    Frame->RFlags = RFlags;
+    Frame->Rsp = Rsp;
+
+    return Result;
+}
@@ -0,0 +1,193 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.SystemCall.h
+ * PURPOSE:    Definition for Mobility x64 Fast System Call Entry
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_PLATFORM_X64_SYSTEMCALL
+#define MOBILITY_PLATFORM_X64_SYSTEMCALL
+
+#include "Mobility.Platform.x64.h"
+
+/*
+ * The model-specific registers and flags of SYSCALL and SYSRET.
+ *
+ * @remark Intel(R) 64 and IA-32 Architectures Software Developer's Manual
+ *         (December 2023)
+ *           Volume 3 (3A, 3B, 3C, & 3D): System Programming Guide
+ *             5.8.8 Fast System Calls in 64-Bit Mode
+ */
+
+#define MO_PLATFORM_X64_MSR_STAR 0xC0000081
+#define MO_PLATFORM_X64_MSR_LSTAR 0xC0000082
+#define MO_PLATFORM_X64_MSR_FMASK 0xC0000084
+#define MO_PLATFORM_X64_EFER_SYSTEM_CALL_ENABLE 0x1ULL
+
+/**
+ * @brief The RFLAGS bits cleared by SYSCALL, which are TF, IF, DF, IOPL, NT
+ *        and AC, so the entry starts with the interrupts disabled.
+ */
+#define MO_PLATFORM_X64_SYSTEM_CALL_FLAGS_MASK 0x47700ULL
+
+/**
+ * @brief The number of the arguments passed in the registers.
+ */
+#define MO_PLATFORM_X64_SYSTEM_CALL_ARGUMENT_COUNT 6
+
+/**
+ * @brief The result of the system call whose number has no handler.
+ */
+#define MO_PLATFORM_X64_SYSTEM_CALL_INVALID_NUMBER 0xFFFFFFFFFFFFFFFFULL
+
+/**
+ * @brief The registers saved on the kernel stack by MoPlatformSystemCallEntry,
+ *        which must match the assembly parts.
+ * @remarks The caller puts the system call number in RAX and the arguments in
+ *          RDI, RSI, RDX, R10, R8 and R9, because SYSCALL overwrites RCX and
+ *          R11 with RIP and RFLAGS. The result is returned in RAX, and the
+ *          other registers except RCX and R11 are preserved. The caller
+ *          returns with IRETQ instead of SYSRET if the return address is not
+ *          in the lower half, such as after SYSCALL at the end of it.
+ */
+typedef struct _MO_PLATFORM_X64_SYSTEM_CALL_FRAME
+{
+    /**
+     * @brief The system call number passed in RAX.
+     */
+    MO_UINT64 Number;
+    /**
+     * @brief The arguments passed in RDI, RSI, RDX, R10, R8 and R9.
+     */
+    MO_UINT64 Arguments[MO_PLATFORM_X64_SYSTEM_CALL_ARGUMENT_COUNT];
+    /**
+     * @brief The return address saved in RCX by SYSCALL. The return context is
+     *        restored after the handler returns, so the handler cannot change
+     *        where the caller resumes.
+     */
+    MO_UINT64 Rip;
+    /**
+     * @brief The RFLAGS of the caller saved in R11 by SYSCALL.
+     */
+    MO_UINT64 RFlags;
+    /**
+     * @brief The stack pointer of the caller.
+     */
+    MO_UINT64 Rsp;
+    /**
+     * @brief XMM0 of the caller. XMM0-XMM5 and MXCSR are restored before
+     *        returning, so the handler can use SSE.
+     */
+    MO_UINT8 Xmm0[16];
+    /**
+     * @brief XMM1 of the caller.
+     */
+    MO_UINT8 Xmm1[16];
+    /**
+     * @brief XMM2 of the caller.
+     */
+    MO_UINT8 Xmm2[16];
+    /**
+     * @brief XMM3 of the caller.
+     */
+    MO_UINT8 Xmm3[16];
+    /**
+     * @brief XMM4 of the caller.
+     */
+    MO_UINT8 Xmm4[16];
+    /**
+     * @brief XMM5 of the caller.
+     */
+    MO_UINT8 Xmm5[16];
+    /**
+     * @brief MXCSR of the caller.
+     */
+    MO_UINT32 MxCsr;
+    /**
+     * @brief Reserved bits. Set to 0.
+     */
+    MO_UINT32 Reserved0;
+    /**
+     * @brief CR0 of the caller, whose TS bit is cleared during the system call.
+     */
+    MO_UINT64 Cr0;
+} MO_PLATFORM_X64_SYSTEM_CALL_FRAME, *PMO_PLATFORM_X64_SYSTEM_CALL_FRAME;
+
+MO_C_STATIC_ASSERT(sizeof(MO_PLATFORM_X64_SYSTEM_CALL_FRAME) == 0xC0);
+
+/**
+ * @brief The system service called by MoPlatformSystemCallDispatch.
+ * @param Frame The registers of the caller. The arguments can be modified,
+ *              and are returned to the caller in their registers.
+ * @return The result returned to the caller in RAX.
+ * @remarks The interrupts are enabled when the handler is called. The handler
+ *          can use XMM0-XMM5 and MXCSR, which are saved in the frame and used
+ *          by the compiler for the floating-point code and the memory
+ *          operations. The handler must not use the x87 or MMX registers or
+ *          XMM6-XMM15, because they are not saved for the caller.
+ */
+typedef MO_UINT64(MOAPI* PMO_PLATFORM_X64_SYSTEM_CALL_HANDLER)(
+    _Mo_InOut_ PMO_PLATFORM_X64_SYSTEM_CALL_FRAME Frame);
+
+/**
+ * @brief Enables SYSCALL and SYSRET on the current processor, and sets the
+ *        dispatch table shared by all processors.
+ * @param Handlers The dispatch table indexed by the system call number, which
+ *                 must stay valid while SYSCALL is enabled. The entries can be
+ *                 nullptr for the unused numbers.
+ * @param HandlerCount The number of the entries of the dispatch table.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks It must be called on each processor after
+ *          MoPlatformProcessorBlockLoad, because the entry switches to the
+ *          kernel stack of the processor block. The GDT must be the one in
+ *          the processor block, so SYSRET returns with
+ *          MO_PLATFORM_X64_SEGMENT_USER_CODE and
+ *          MO_PLATFORM_X64_SEGMENT_USER_DATA.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformSystemCallInitialize(
+    _Mo_In_ PMO_PLATFORM_X64_SYSTEM_CALL_HANDLER* Handlers,
+    _Mo_In_ MO_UINT32 HandlerCount);
+
+/**
+ * @brief Calls the handler of the system call. It is called by
+ *        MoPlatformSystemCallEntry on the kernel stack.
+ * @param Frame The registers of the caller.
+ * @return The result returned to the caller in RAX.
+ */
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformSystemCallDispatch(
+    _Mo_InOut_ PMO_PLATFORM_X64_SYSTEM_CALL_FRAME Frame);
+
+/**
+ * @brief The entry point of SYSCALL, which is written to LSTAR.
+ * @remarks Implemented in the assembly parts, and never called directly.
+ *          SYSCALL must only be executed in the user mode, because the entry
+ *          always swaps the GS base to the processor block. The NMI and
+ *          machine-check handlers should use IST, because they can arrive
+ *          before the entry switches to the kernel stack, and they cannot
+ *          rely on the GS base, because they can also arrive before SWAPGS.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformSystemCallEntry();
+
+/**
+ * @brief Enters the user mode on the current processor with IRETQ.
+ * @param Rip The address to start in the user mode.
+ * @param Rsp The stack pointer in the user mode.
+ * @param RFlags The RFLAGS in the user mode. IOPL and NT are cleared, and IF
+ *               is set.
+ * @remarks Implemented in the assembly parts, and never returns. It must be
+ *          called with the interrupts disabled and the GS base of the
+ *          processor block, because it swaps to the user GS base before
+ *          IRETQ. The general-purpose registers are zeroed, and the code and
+ *          stack segments are MO_PLATFORM_X64_SEGMENT_USER_CODE and
+ *          MO_PLATFORM_X64_SEGMENT_USER_DATA with RPL 3.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformEnterUserMode(
+    _Mo_In_ MO_UINT64 Rip,
+    _Mo_In_ MO_UINT64 Rsp,
+    _Mo_In_ MO_UINT64 RFlags);
+
+#endif // !MOBILITY_PLATFORM_X64_SYSTEMCALL
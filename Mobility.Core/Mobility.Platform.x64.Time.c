@@ -0,0 +1,211 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.Time.c
+ * PURPOSE:    Implementation for Mobility x64 Clock Sources
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Platform.x64.Time.h"
+
+#include "Mobility.Runtime.Core.h"
+
+static MO_UINT64 MOAPI MoPlatformReadTimeStampCounterClockSource(
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    MO_UNREFERENCED_PARAMETER(Context);
+    return MoPlatformReadTimeStampCounter();
+}
+
+static MO_UINT64 MOAPI MoPlatformReadPowerManagementTimerClockSource(
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    return MoPlatformReadIoPort32((MO_UINT16)(MO_UINTN)(Context));
+}
+
+static MO_UINT64 MOAPI MoPlatformReadHighPrecisionEventTimerClockSource(
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    volatile MO_UINT64* Registers = (volatile MO_UINT64*)(Context);
+    return Registers[MO_PLATFORM_X64_HPET_MAIN_COUNTER_REGISTER / 8];
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformCheckInvariantTimeStampCounter()
+{
+    MO_PLATFORM_X64_CPUID_RESULT CpuidResult;
+
+    MoPlatformReadCpuid(&CpuidResult, 0x80000000);
+    if (CpuidResult.Eax < 0x80000007)
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    MoPlatformReadCpuid(&CpuidResult, 0x80000007);
+    if (!(CpuidResult.Edx & (1u << 8)))
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformQueryTimeStampCounterFrequency(
+    _Mo_Out_ PMO_UINT64 Frequency)
+{
+    if (!Frequency)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    *Frequency = 0u;
+
+    MO_PLATFORM_X64_CPUID_RESULT CpuidResult;
+
+    MoPlatformReadCpuid(&CpuidResult, 0);
+    if (CpuidResult.Eax < 0x15)
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    // EAX is the denominator and EBX is the numerator of the TSC / crystal
+    // clock ratio, and ECX is the crystal clock frequency in Hz, which is
+    // zero if not enumerated.
+    MoPlatformReadCpuid(&CpuidResult, 0x15);
+    if (!CpuidResult.Eax || !CpuidResult.Ebx || !CpuidResult.Ecx)
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    *Frequency = (MO_UINT64)CpuidResult.Ecx * CpuidResult.Ebx / CpuidResult.Eax;
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformInitializeTimeStampCounterClockSource(
+    _Mo_Out_ PMO_TIME_CLOCK_SOURCE Source,
+    _Mo_In_ MO_UINT64 Frequency)
+{
+    if (!Source)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (MO_RESULT_SUCCESS_OK != MoRuntimeMemoryFillByte(
+        Source,
+        0,
+        sizeof(MO_TIME_CLOCK_SOURCE)))
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    if (MO_RESULT_SUCCESS_OK != MoPlatformCheckInvariantTimeStampCounter())
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    Source->Name = "TSC";
+    Source->Read = MoPlatformReadTimeStampCounterClockSource;
+    Source->Frequency = Frequency;
+    Source->Mask = MO_UINT64_MAX;
+    Source->Rating = MO_TIME_CLOCK_SOURCE_RATING_TIME_STAMP_COUNTER;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformInitializePowerManagementTimerClockSource(
+    _Mo_Out_ PMO_TIME_CLOCK_SOURCE Source,
+    _Mo_In_ MO_UINT16 Port,
+    _Mo_In_ MO_BOOL Extended)
+{
+    if (!Source || !Port)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (MO_RESULT_SUCCESS_OK != MoRuntimeMemoryFillByte(
+        Source,
+        0,
+        sizeof(MO_TIME_CLOCK_SOURCE)))
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    Source->Name = "ACPI PM Timer";
+    Source->Read = MoPlatformReadPowerManagementTimerClockSource;
+    Source->Context = (MO_POINTER)(MO_UINTN)(Port);
+    Source->Frequency = MO_PLATFORM_X64_POWER_MANAGEMENT_TIMER_FREQUENCY;
+    Source->Mask = Extended ? 0xFFFFFFFFULL : 0xFFFFFFULL;
+    Source->Rating = MO_TIME_CLOCK_SOURCE_RATING_POWER_MANAGEMENT_TIMER;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformInitializeHighPrecisionEventTimerClockSource(
+    _Mo_Out_ PMO_TIME_CLOCK_SOURCE Source,
+    _Mo_Out_Opt_ PMO_UINT64 Configuration,
+    _Mo_In_ MO_UINT64 BaseAddress)
+{
+    if (!Source || !BaseAddress)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (MO_RESULT_SUCCESS_OK != MoRuntimeMemoryFillByte(
+        Source,
+        0,
+        sizeof(MO_TIME_CLOCK_SOURCE)))
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    volatile MO_UINT64* Registers =
+        (volatile MO_UINT64*)(MO_UINTN)(BaseAddress);
+
+    // The upper 32 bits are the period of the main counter in femtoseconds.
+    MO_UINT64 Capabilities =
+        Registers[MO_PLATFORM_X64_HPET_GENERAL_CAPABILITIES_REGISTER / 8];
+    MO_UINT64 Period = Capabilities >> 32;
+    if (!Period || Period > MO_PLATFORM_X64_HPET_MAXIMUM_PERIOD)
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    MO_UINT64 OriginalConfiguration =
+        Registers[MO_PLATFORM_X64_HPET_GENERAL_CONFIGURATION_REGISTER / 8];
+    if (Configuration)
+    {
+        *Configuration = OriginalConfiguration;
+    }
+    if (!(OriginalConfiguration & MO_PLATFORM_X64_HPET_CONFIGURATION_ENABLE))
+    {
+        Registers[MO_PLATFORM_X64_HPET_GENERAL_CONFIGURATION_REGISTER / 8] =
+            OriginalConfiguration | MO_PLATFORM_X64_HPET_CONFIGURATION_ENABLE;
+    }
+
+    Source->Name = "HPET";
+    Source->Read = MoPlatformReadHighPrecisionEventTimerClockSource;
+    Source->Context = (MO_POINTER)(MO_UINTN)(BaseAddress);
+    Source->Frequency = (1000000000000000ULL + (Period >> 1)) / Period;
+    Source->Mask =
+        (Capabilities & MO_PLATFORM_X64_HPET_CAPABILITY_COUNTER_SIZE)
+        ? MO_UINT64_MAX
+        : 0xFFFFFFFFULL;
+    Source->Rating = MO_TIME_CLOCK_SOURCE_RATING_HIGH_PRECISION_EVENT_TIMER;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformDeinitializeHighPrecisionEventTimerClockSource(
+    _Mo_In_ PMO_TIME_CLOCK_SOURCE Source,
+    _Mo_In_ MO_UINT64 Configuration)
+{
+    if (!Source ||
+        !Source->Context ||
+        (Configuration & MO_PLATFORM_X64_HPET_CONFIGURATION_ENABLE))
+    {
+        return;
+    }
+
+    // Only clear the enable bit set by the initialization, and keep the other
+    // bits as they are now.
+    volatile MO_UINT64* Registers = (volatile MO_UINT64*)(Source->Context);
+    Registers[MO_PLATFORM_X64_HPET_GENERAL_CONFIGURATION_REGISTER / 8] &=
+        ~MO_PLATFORM_X64_HPET_CONFIGURATION_ENABLE;
+}
@@ -0,0 +1,147 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.Time.h
+ * PURPOSE:    Definition for Mobility x64 Clock Sources
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_PLATFORM_X64_TIME
+#define MOBILITY_PLATFORM_X64_TIME
+
+#include "Mobility.Platform.x64.h"
+#include "Mobility.Time.Core.h"
+
+/**
+ * @brief The frequency in Hz of the ACPI Power Management Timer.
+ * @remark For more information, see ACPI Specification 6.5, 4.8.3.3 Power
+ *         Management Timer (PM_TMR).
+ */
+#define MO_PLATFORM_X64_POWER_MANAGEMENT_TIMER_FREQUENCY 3579545
+
+/*
+ * The registers of the High Precision Event Timer (HPET).
+ *
+ * @remark IA-PC HPET (High Precision Event Timers) Specification 1.0a
+ *           2.3 Register Definition and Address Ranges
+ */
+
+/**
+ * @brief The offset of the General Capabilities and ID Register.
+ */
+#define MO_PLATFORM_X64_HPET_GENERAL_CAPABILITIES_REGISTER 0x000
+/**
+ * @brief The offset of the General Configuration Register.
+ */
+#define MO_PLATFORM_X64_HPET_GENERAL_CONFIGURATION_REGISTER 0x010
+/**
+ * @brief The offset of the Main Counter Value Register.
+ */
+#define MO_PLATFORM_X64_HPET_MAIN_COUNTER_REGISTER 0x0F0
+/**
+ * @brief The main counter is 64 bits wide (COUNT_SIZE_CAP).
+ */
+#define MO_PLATFORM_X64_HPET_CAPABILITY_COUNTER_SIZE 0x2000ULL
+/**
+ * @brief The main counter runs and the timer interrupts are allowed
+ *        (ENABLE_CNF).
+ */
+#define MO_PLATFORM_X64_HPET_CONFIGURATION_ENABLE 0x1ULL
+/**
+ * @brief The maximum period in femtoseconds of the main counter
+ *        (COUNTER_CLK_PERIOD), which is 100 nanoseconds.
+ */
+#define MO_PLATFORM_X64_HPET_MAXIMUM_PERIOD 100000000ULL
+
+/**
+ * @brief Checks whether the Time Stamp Counter (TSC) of the current processor
+ *        runs at a constant rate in all ACPI P-, C- and T-states.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the invariant TSC is not reported by
+ *          CPUID.80000007H:EDX.InvariantTSC[bit 8], the function returns
+ *          MO_RESULT_ERROR_NO_INTERFACE.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformCheckInvariantTimeStampCounter();
+
+/**
+ * @brief Queries the nominal frequency of the Time Stamp Counter (TSC) reported
+ *        by the processor.
+ * @param Frequency The pointer to receive the frequency in Hz.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If CPUID leaf 15H is not available or does not enumerate the crystal
+ *          clock frequency, the function returns MO_RESULT_ERROR_NO_INTERFACE,
+ *          and the frequency should be calibrated instead.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformQueryTimeStampCounterFrequency(
+    _Mo_Out_ PMO_UINT64 Frequency);
+
+/**
+ * @brief Initializes the clock source for the invariant Time Stamp Counter
+ *        (TSC).
+ * @param Source The clock source to be initialized.
+ * @param Frequency The frequency in Hz of the Time Stamp Counter (TSC). If this
+ *                  parameter is zero, the Frequency member should be filled by
+ *                  the calibration before registering the clock source.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the Time Stamp Counter (TSC) is not invariant, the function
+ *          returns MO_RESULT_ERROR_NO_INTERFACE.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformInitializeTimeStampCounterClockSource(
+    _Mo_Out_ PMO_TIME_CLOCK_SOURCE Source,
+    _Mo_In_ MO_UINT64 Frequency);
+
+/**
+ * @brief Initializes the clock source for the ACPI Power Management Timer.
+ * @param Source The clock source to be initialized.
+ * @param Port The I/O port of the ACPI Power Management Timer.
+ * @param Extended Whether the counter is 32 bits wide (TMR_VAL_EXT) instead of
+ *                 24 bits wide.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformInitializePowerManagementTimerClockSource(
+    _Mo_Out_ PMO_TIME_CLOCK_SOURCE Source,
+    _Mo_In_ MO_UINT16 Port,
+    _Mo_In_ MO_BOOL Extended);
+
+/**
+ * @brief Initializes the clock source for the main counter of the High
+ *        Precision Event Timer (HPET), and starts the main counter if it is
+ *        halted.
+ * @param Source The clock source to be initialized.
+ * @param Configuration The general configuration of the HPET before the main
+ *                      counter is started, which is passed to
+ *                      MoPlatformDeinitializeHighPrecisionEventTimerClockSource.
+ *                      It can be nullptr if the configuration is not restored.
+ * @param BaseAddress The base address of the HPET registers, which must be
+ *                    mapped as uncacheable.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks If the period reported by the HPET is invalid, the function returns
+ *          MO_RESULT_ERROR_NO_INTERFACE.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformInitializeHighPrecisionEventTimerClockSource(
+    _Mo_Out_ PMO_TIME_CLOCK_SOURCE Source,
+    _Mo_Out_Opt_ PMO_UINT64 Configuration,
+    _Mo_In_ MO_UINT64 BaseAddress);
+
+/**
+ * @brief Halts the main counter of the High Precision Event Timer (HPET) again
+ *        if it was halted before the clock source was initialized, so the
+ *        firmware gets the HPET back as it was.
+ * @param Source The clock source initialized by
+ *               MoPlatformInitializeHighPrecisionEventTimerClockSource, which
+ *               must not be read afterwards.
+ * @param Configuration The general configuration returned by
+ *                      MoPlatformInitializeHighPrecisionEventTimerClockSource.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformDeinitializeHighPrecisionEventTimerClockSource(
+    _Mo_In_ PMO_TIME_CLOCK_SOURCE Source,
+    _Mo_In_ MO_UINT64 Configuration);
+
+#endif // !MOBILITY_PLATFORM_X64_TIME
@@ -0,0 +1,392 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.Tlb.c
+ * PURPOSE:    Implementation for Mobility x64 Batched TLB Invalidation
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Platform.x64.Tlb.h"
+
+#include "Mobility.Platform.x64.PageTable.h"
+#include "Mobility.Runtime.Core.h"
+#include "Mobility.Synchronization.Atomic.h"
+
+static PMO_PLATFORM_X64_TLB_SHOOTDOWN MoPlatformTlbActiveShootdown = nullptr;
+
+static MO_VOID MoPlatformTlbFlushAll(
+    _Mo_In_ MO_BOOL Global)
+{
+    if (Global)
+    {
+        // Changing CR4.PGE invalidates all TLB entries, including the global
+        // translations.
+        MO_UINT64 Cr4 = MoPlatformReadCr4();
+        if (Cr4 & MO_PLATFORM_X64_CR4_PAGE_GLOBAL_ENABLE)
+        {
+            MoPlatformWriteCr4(Cr4 & ~MO_PLATFORM_X64_CR4_PAGE_GLOBAL_ENABLE);
+            MoPlatformWriteCr4(Cr4);
+            return;
+        }
+    }
+
+    // Writing CR3 without the no-flush bit invalidates the non-global TLB
+    // entries of the current PCID.
+    MoPlatformWriteCr3(MoPlatformReadCr3());
+}
+
+static MO_VOID MoPlatformTlbFlushAddressSpace(
+    _Mo_In_ PMO_PLATFORM_X64_TLB_BATCH Batch)
+{
+    PMO_PLATFORM_X64_ADDRESS_SPACE AddressSpace = Batch->AddressSpace;
+    MO_UINT64 Context = MoAtomicLoad64(
+        &AddressSpace->Context,
+        MO_ATOMIC_ORDER_ACQUIRE);
+    if (!Context)
+    {
+        // No TLB entry is tagged with the new PCID of the address space yet.
+        return;
+    }
+
+    if (!Batch->InvpcidSupported)
+    {
+        MoPlatformPcidRetireAddressSpace(AddressSpace);
+        return;
+    }
+
+    MO_PLATFORM_X64_INVPCID_DESCRIPTOR Descriptor;
+    Descriptor.Pcid = Context & MO_PLATFORM_X64_CR3_PCID_MASK;
+    Descriptor.Address = 0;
+    if (Batch->FlushAll)
+    {
+        MoPlatformInvalidateProcessContext(
+            MO_PLATFORM_X64_INVPCID_SINGLE_CONTEXT,
+            &Descriptor);
+        return;
+    }
+
+    for (MO_UINT32 Index = 0; Index < Batch->RangeCount; ++Index)
+    {
+        PMO_PLATFORM_X64_TLB_RANGE Range = &Batch->Ranges[Index];
+        for (Descriptor.Address = Range->Start;
+            Descriptor.Address < Range->End;
+            Descriptor.Address += MO_PLATFORM_X64_PAGE_SIZE)
+        {
+            MoPlatformInvalidateProcessContext(
+                MO_PLATFORM_X64_INVPCID_INDIVIDUAL_ADDRESS,
+                &Descriptor);
+        }
+    }
+}
+
+static MO_VOID MoPlatformTlbBatchReset(
+    _Mo_InOut_ PMO_PLATFORM_X64_TLB_BATCH Batch)
+{
+    Batch->RangeCount = 0;
+    Batch->PageCount = 0;
+    Batch->FlushAll = MO_FALSE;
+    Batch->Global = MO_FALSE;
+}
+
+static MO_VOID MOAPI MoPlatformTlbShootdownHandler(
+    _Mo_In_ MO_PLATFORM_X64_INTERRUPT_TYPE InterruptType,
+    _Mo_In_ PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_CONTEXT InterruptContext)
+{
+    MO_UNREFERENCED_PARAMETER(InterruptType);
+    MO_UNREFERENCED_PARAMETER(InterruptContext);
+
+    PMO_PLATFORM_X64_TLB_SHOOTDOWN Shootdown = MoPlatformTlbActiveShootdown;
+    if (!Shootdown)
+    {
+        return;
+    }
+
+    PMO_PLATFORM_X64_TLB_BATCH Batch =
+        (PMO_PLATFORM_X64_TLB_BATCH)MoAtomicLoadPointer(
+            &Shootdown->Batch,
+            MO_ATOMIC_ORDER_ACQUIRE);
+    if (Batch)
+    {
+        MoPlatformTlbBatchFlushLocal(Batch);
+
+        // The initiator may reuse the batch as soon as the count drops to
+        // zero, so the batch must not be accessed after the decrement.
+        MoAtomicFetchAdd32(
+            &Shootdown->PendingCount,
+            (MO_UINT32)(-1),
+            MO_ATOMIC_ORDER_RELEASE);
+    }
+    MoPlatformLocalApicEndOfInterrupt(Shootdown->Apic);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformTlbBatchInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_TLB_BATCH Batch,
+    _Mo_In_ MO_UINT32 FlushThreshold)
+{
+    Batch->FlushThreshold = FlushThreshold
+        ? FlushThreshold
+        : MO_PLATFORM_X64_TLB_DEFAULT_FLUSH_THRESHOLD;
+    MoPlatformTlbBatchReset(Batch);
+    Batch->InvpcidSupported = MO_FALSE;
+    MoRuntimeMemoryFillByte(Batch->Reserved, 0, sizeof(Batch->Reserved));
+    Batch->AddressSpace = nullptr;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformTlbBatchSetAddressSpace(
+    _Mo_InOut_ PMO_PLATFORM_X64_TLB_BATCH Batch,
+    _Mo_In_ PMO_PLATFORM_X64_PCID_PROCESSOR Processor,
+    _Mo_In_Opt_ PMO_PLATFORM_X64_ADDRESS_SPACE AddressSpace)
+{
+    Batch->InvpcidSupported = Processor->InvpcidSupported;
+    Batch->AddressSpace = AddressSpace;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformTlbBatchAddRange(
+    _Mo_InOut_ PMO_PLATFORM_X64_TLB_BATCH Batch,
+    _Mo_In_ MO_UINT64 Address,
+    _Mo_In_ MO_UINT64 Size,
+    _Mo_In_ MO_BOOL Global)
+{
+    if (!Size)
+    {
+        return;
+    }
+    if (Global)
+    {
+        Batch->Global = MO_TRUE;
+    }
+    if (Batch->FlushAll)
+    {
+        return;
+    }
+
+    MO_UINT64 Start = Address & ~(MO_PLATFORM_X64_PAGE_SIZE - 1);
+    MO_UINT64 Last = Address + (Size - 1);
+    MO_UINT64 End =
+        (Last & ~(MO_PLATFORM_X64_PAGE_SIZE - 1)) + MO_PLATFORM_X64_PAGE_SIZE;
+    if (Last < Address || End < Start)
+    {
+        // The range wraps around the address space.
+        Batch->FlushAll = MO_TRUE;
+        return;
+    }
+
+    // The ranges in the batch are disjoint and not adjacent to each other, so
+    // a single pass merges all ranges which overlap or adjoin the new range.
+    MO_UINT32 Index = 0;
+    while (Index < Batch->RangeCount)
+    {
+        PMO_PLATFORM_X64_TLB_RANGE Range = &Batch->Ranges[Index];
+        if (Range->Start > End || Range->End < Start)
+        {
+            ++Index;
+            continue;
+        }
+        if (Range->Start < Start)
+        {
+            Start = Range->Start;
+        }
+        if (Range->End > End)
+        {
+            End = Range->End;
+        }
+        Batch->PageCount -=
+            (Range->End - Range->Start) / MO_PLATFORM_X64_PAGE_SIZE;
+        *Range = Batch->Ranges[--Batch->RangeCount];
+    }
+
+    if (Batch->RangeCount >= MO_PLATFORM_X64_TLB_BATCH_MAXIMUM_RANGES)
+    {
+        Batch->FlushAll = MO_TRUE;
+        return;
+    }
+    Batch->Ranges[Batch->RangeCount].Start = Start;
+    Batch->Ranges[Batch->RangeCount].End = End;
+    ++Batch->RangeCount;
+    Batch->PageCount += (End - Start) / MO_PLATFORM_X64_PAGE_SIZE;
+    if (Batch->PageCount > Batch->FlushThreshold)
+    {
+        Batch->FlushAll = MO_TRUE;
+    }
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformTlbBatchFlushLocal(
+    _Mo_In_ PMO_PLATFORM_X64_TLB_BATCH Batch)
+{
+    if (Batch->AddressSpace &&
+        Batch->AddressSpace->PageMapLevel4Address !=
+        (MoPlatformReadCr3() & ~MO_PLATFORM_X64_CR3_PCID_MASK))
+    {
+        // INVLPG and the CR3 reload only apply to the current PCID.
+        MoPlatformTlbFlushAddressSpace(Batch);
+        if (!Batch->Global)
+        {
+            return;
+        }
+
+        // The global translations are not tagged with the PCIDs, so they are
+        // still invalidated below.
+    }
+
+    if (Batch->FlushAll)
+    {
+        MoPlatformTlbFlushAll(Batch->Global);
+        return;
+    }
+
+    // INVLPG also invalidates the global translations of the page.
+    for (MO_UINT32 Index = 0; Index < Batch->RangeCount; ++Index)
+    {
+        PMO_PLATFORM_X64_TLB_RANGE Range = &Batch->Ranges[Index];
+        for (MO_UINT64 Address = Range->Start;
+            Address < Range->End;
+            Address += MO_PLATFORM_X64_PAGE_SIZE)
+        {
+            MoPlatformInvalidatePage(Address);
+        }
+    }
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformTlbBatchFlush(
+    _Mo_InOut_ PMO_PLATFORM_X64_TLB_BATCH Batch,
+    _Mo_In_Opt_ PMO_PLATFORM_X64_TLB_SHOOTDOWN Shootdown)
+{
+    if (!Batch->RangeCount && !Batch->FlushAll)
+    {
+        return MO_RESULT_SUCCESS_OK;
+    }
+
+    if (Shootdown)
+    {
+        // Two processors flushing with the interrupts disabled would wait for
+        // each other's shootdown interrupts forever.
+        MO_UINTN InterruptState = MoPlatformSaveAndDisableInterrupts();
+        MoPlatformRestoreInterrupts(InterruptState);
+        if (!(InterruptState & MO_PLATFORM_X64_RFLAGS_INTERRUPT_ENABLE))
+        {
+            return MO_RESULT_ERROR_UNEXPECTED;
+        }
+    }
+
+    MoPlatformTlbBatchFlushLocal(Batch);
+
+    MO_RESULT Result = MO_RESULT_SUCCESS_OK;
+
+    if (Shootdown)
+    {
+        MoSpinLockAcquire(&Shootdown->Lock);
+        if (Shootdown->TargetCount)
+        {
+            MoAtomicStore32(
+                &Shootdown->PendingCount,
+                Shootdown->TargetCount,
+                MO_ATOMIC_ORDER_RELAXED);
+            MoAtomicStorePointer(
+                &Shootdown->Batch,
+                Batch,
+                MO_ATOMIC_ORDER_RELEASE);
+
+            // All targets apply the whole batch on a single interrupt.
+            Result = MoPlatformLocalApicSendInterProcessorInterrupt(
+                Shootdown->Apic,
+                0,
+                MO_PLATFORM_X64_APIC_COMMAND_FIXED_ALL_EXCLUDING_SELF |
+                Shootdown->Vector);
+            if (MO_RESULT_SUCCESS_OK == Result)
+            {
+                ++Shootdown->Shootdowns;
+                while (MoAtomicLoad32(
+                    &Shootdown->PendingCount,
+                    MO_ATOMIC_ORDER_ACQUIRE))
+                {
+                    MoPlatformPause();
+                }
+            }
+
+            MoAtomicStorePointer(
+                &Shootdown->Batch,
+                nullptr,
+                MO_ATOMIC_ORDER_RELAXED);
+        }
+        MoSpinLockRelease(&Shootdown->Lock);
+    }
+
+    if (MO_RESULT_SUCCESS_OK == Result)
+    {
+        MoPlatformTlbBatchReset(Batch);
+    }
+
+    return Result;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformTlbShootdownInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_TLB_SHOOTDOWN Shootdown,
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ MO_UINT8 Vector,
+    _Mo_In_ MO_UINT32 TargetCount)
+{
+    if (!Shootdown || !Apic)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (!Vector)
+    {
+        Vector = MO_PLATFORM_X64_TLB_DEFAULT_SHOOTDOWN_VECTOR;
+    }
+    if (Vector < 0x20)
+    {
+        // The vectors 0-31 are reserved for the exceptions.
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MoSpinLockInitialize(&Shootdown->Lock);
+    Shootdown->Vector = Vector;
+    Shootdown->Reserved[0] = 0;
+    Shootdown->Reserved[1] = 0;
+    Shootdown->Reserved[2] = 0;
+    Shootdown->TargetCount = TargetCount;
+    Shootdown->PendingCount = 0;
+    Shootdown->Apic = Apic;
+    Shootdown->Batch = nullptr;
+    Shootdown->Shootdowns = 0;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformTlbShootdownSetTargetCount(
+    _Mo_InOut_ PMO_PLATFORM_X64_TLB_SHOOTDOWN Shootdown,
+    _Mo_In_ MO_UINT32 TargetCount)
+{
+    MoSpinLockAcquire(&Shootdown->Lock);
+    Shootdown->TargetCount = TargetCount;
+    MoSpinLockRelease(&Shootdown->Lock);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformTlbShootdownInstallHandler(
+    _Mo_In_ PMO_PLATFORM_X64_TLB_SHOOTDOWN Shootdown,
+    _Mo_InOut_ PMO_PLATFORM_X64_IDT_GATE_DESCRIPTOR InterruptDescriptorTable,
+    _Mo_InOut_ PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER*
+        LightweightHandlerTable)
+{
+    if (!Shootdown || !InterruptDescriptorTable || !LightweightHandlerTable)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    if (MoPlatformTlbActiveShootdown)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MoPlatformTlbActiveShootdown = Shootdown;
+    MoMileCompilerBarrier();
+    LightweightHandlerTable[Shootdown->Vector] = MoPlatformTlbShootdownHandler;
+    MoPlatformSetInterruptEntry(
+        InterruptDescriptorTable,
+        Shootdown->Vector,
+        MO_PLATFORM_X64_INTERRUPT_ENTRY_LIGHTWEIGHT);
+
+    return MO_RESULT_SUCCESS_OK;
+}
@@ -0,0 +1,290 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Platform.x64.Tlb.h
+ * PURPOSE:    Definition for Mobility x64 Batched TLB Invalidation
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_PLATFORM_X64_TLB
+#define MOBILITY_PLATFORM_X64_TLB
+
+#include "Mobility.Platform.x64.Apic.h"
+#include "Mobility.Platform.x64.Pcid.h"
+#include "Mobility.Synchronization.SpinLock.h"
+
+/**
+ * @brief The maximum number of the coalesced ranges in a TLB batch. The batch
+ *        falls back to the full flush if more disjoint ranges are added.
+ */
+#define MO_PLATFORM_X64_TLB_BATCH_MAXIMUM_RANGES 16
+
+/**
+ * @brief The default maximum number of the pages which are invalidated one by
+ *        one. The batch falls back to the full flush above it, because the
+ *        refill after the full flush is cheaper than the INVLPG instructions.
+ */
+#define MO_PLATFORM_X64_TLB_DEFAULT_FLUSH_THRESHOLD 33
+
+/**
+ * @brief The default vector of the TLB shootdown interrupt.
+ */
+#define MO_PLATFORM_X64_TLB_DEFAULT_SHOOTDOWN_VECTOR 0xEE
+
+/**
+ * @brief The lower 32 bits of the Interrupt Command Register (ICR) of the TLB
+ *        shootdown interrupt without the vector, which is the fixed delivery
+ *        mode to all processors excluding self.
+ *
+ * @remark Intel(R) 64 and IA-32 Architectures Software Developer's Manual
+ *         (December 2023)
+ *           Volume 3 (3A, 3B, 3C, & 3D): System Programming Guide
+ *             11.6.1 Interrupt Command Register (ICR)
+ */
+#define MO_PLATFORM_X64_APIC_COMMAND_FIXED_ALL_EXCLUDING_SELF 0x000C4000
+
+/**
+ * @brief The interrupt enable flag (IF) of RFLAGS, which is set in the
+ *        interrupt state returned by MoPlatformSaveAndDisableInterrupts if the
+ *        interrupts were enabled.
+ */
+#define MO_PLATFORM_X64_RFLAGS_INTERRUPT_ENABLE 0x200ULL
+
+/**
+ * @brief The page-aligned virtual range in a TLB batch.
+ */
+typedef struct _MO_PLATFORM_X64_TLB_RANGE
+{
+    /**
+     * @brief The inclusive start of the range.
+     */
+    MO_UINT64 Start;
+    /**
+     * @brief The exclusive end of the range.
+     */
+    MO_UINT64 End;
+} MO_PLATFORM_X64_TLB_RANGE, *PMO_PLATFORM_X64_TLB_RANGE;
+
+/**
+ * @brief The virtual ranges whose translations are changed during an
+ *        operation, which are invalidated at once when the operation ends.
+ * @remarks The overlapping and adjacent ranges are coalesced, so unmapping a
+ *          large region page by page still needs only one range. The ranges
+ *          belong to the address space of the batch, which is invalidated by
+ *          its PCID on the processors which are not running it.
+ */
+typedef struct _MO_PLATFORM_X64_TLB_BATCH
+{
+    /**
+     * @brief The disjoint and non-adjacent ranges of the batch.
+     */
+    MO_PLATFORM_X64_TLB_RANGE Ranges[MO_PLATFORM_X64_TLB_BATCH_MAXIMUM_RANGES];
+    /**
+     * @brief The number of the used entries of Ranges.
+     */
+    MO_UINT32 RangeCount;
+    /**
+     * @brief The maximum number of the pages which are invalidated one by one.
+     */
+    MO_UINT32 FlushThreshold;
+    /**
+     * @brief The number of the pages in all ranges.
+     */
+    MO_UINT64 PageCount;
+    /**
+     * @brief Set if all TLB entries of the address space are flushed instead.
+     */
+    MO_BOOL FlushAll;
+    /**
+     * @brief Set if the global translations are changed.
+     */
+    MO_BOOL Global;
+    /**
+     * @brief Set if INVPCID is used for the address space of the batch.
+     */
+    MO_BOOL InvpcidSupported;
+    /**
+     * @brief Reserved bits. Set to 0.
+     */
+    MO_UINT8 Reserved[5];
+    /**
+     * @brief The address space whose translations are changed, or nullptr for
+     *        the address space which is current on each processor.
+     */
+    PMO_PLATFORM_X64_ADDRESS_SPACE AddressSpace;
+} MO_PLATFORM_X64_TLB_BATCH, *PMO_PLATFORM_X64_TLB_BATCH;
+
+/**
+ * @brief The state of the TLB shootdowns shared by all processors.
+ * @remarks Only one batch is published at the same time, and it is sent to
+ *          all other processors with a single inter-processor interrupt.
+ */
+typedef struct _MO_PLATFORM_X64_TLB_SHOOTDOWN
+{
+    /**
+     * @brief Serializes the initiators.
+     */
+    MO_SPIN_LOCK Lock;
+    /**
+     * @brief The vector of the shootdown interrupt.
+     */
+    MO_UINT8 Vector;
+    /**
+     * @brief Reserved bits. Set to 0.
+     */
+    MO_UINT8 Reserved[3];
+    /**
+     * @brief The number of the other processors which receive the interrupt.
+     */
+    MO_UINT32 TargetCount;
+    /**
+     * @brief The number of the targets which have not applied the batch yet.
+     */
+    MO_UINT32 volatile PendingCount;
+    /**
+     * @brief The local APIC used to send the shootdown interrupt.
+     */
+    PMO_PLATFORM_X64_LOCAL_APIC Apic;
+    /**
+     * @brief The PMO_PLATFORM_X64_TLB_BATCH being shot down, or nullptr if no
+     *        shootdown is in progress.
+     */
+    MO_POINTER volatile Batch;
+    /**
+     * @brief The number of the sent shootdown interrupts.
+     */
+    MO_UINT64 Shootdowns;
+} MO_PLATFORM_X64_TLB_SHOOTDOWN, *PMO_PLATFORM_X64_TLB_SHOOTDOWN;
+
+/**
+ * @brief Initializes the empty TLB batch for the address space which is
+ *        current on each processor.
+ * @param Batch The TLB batch to initialize.
+ * @param FlushThreshold The maximum number of the pages which are invalidated
+ *                       one by one, or 0 for
+ *                       MO_PLATFORM_X64_TLB_DEFAULT_FLUSH_THRESHOLD.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformTlbBatchInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_TLB_BATCH Batch,
+    _Mo_In_ MO_UINT32 FlushThreshold);
+
+/**
+ * @brief Sets the address space whose translations are changed by the ranges
+ *        added to the TLB batch.
+ * @param Batch The empty TLB batch.
+ * @param Processor The PCID state of the current processor, which tells
+ *                  whether INVPCID is supported.
+ * @param AddressSpace The address space, or nullptr for the address space
+ *                     which is current on each processor.
+ * @remarks The processors running the address space invalidate the ranges
+ *          with INVLPG. The others invalidate them with INVPCID if it is
+ *          supported, or retire the PCID of the address space if not.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformTlbBatchSetAddressSpace(
+    _Mo_InOut_ PMO_PLATFORM_X64_TLB_BATCH Batch,
+    _Mo_In_ PMO_PLATFORM_X64_PCID_PROCESSOR Processor,
+    _Mo_In_Opt_ PMO_PLATFORM_X64_ADDRESS_SPACE AddressSpace);
+
+/**
+ * @brief Adds the virtual range whose translations are changed to the TLB
+ *        batch.
+ * @param Batch The TLB batch.
+ * @param Address The start of the range, which is rounded down to the page.
+ * @param Size The size in bytes of the range, which is rounded up to the
+ *             pages.
+ * @param Global Whether the translations of the range are global.
+ * @remarks The batch falls back to the full flush if it has more pages than
+ *          the threshold or more disjoint ranges than
+ *          MO_PLATFORM_X64_TLB_BATCH_MAXIMUM_RANGES.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformTlbBatchAddRange(
+    _Mo_InOut_ PMO_PLATFORM_X64_TLB_BATCH Batch,
+    _Mo_In_ MO_UINT64 Address,
+    _Mo_In_ MO_UINT64 Size,
+    _Mo_In_ MO_BOOL Global);
+
+/**
+ * @brief Invalidates the TLB entries of the batch on the current processor,
+ *        and leaves the batch unchanged.
+ * @param Batch The TLB batch.
+ * @remarks The full flush reloads CR3, which flushes the current PCID only, or
+ *          toggles CR4.PGE if the global translations are changed. If the
+ *          address space of the batch is not current, the full flush uses the
+ *          single-context INVPCID instead.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformTlbBatchFlushLocal(
+    _Mo_In_ PMO_PLATFORM_X64_TLB_BATCH Batch);
+
+/**
+ * @brief Invalidates the TLB entries of the batch on the current processor
+ *        and all other processors, and empties the batch.
+ * @param Batch The TLB batch.
+ * @param Shootdown The TLB shootdown state, or nullptr if the translations
+ *                  are not used by the other processors.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code, and the batch is kept, because
+ *         the other processors may still have the stale TLB entries.
+ * @remarks The interrupts must be enabled if the shootdown state is
+ *          specified, so the processors waiting for the lock of the
+ *          shootdown state can still apply the shootdown of its owner.
+ *          Otherwise, it returns MO_RESULT_ERROR_UNEXPECTED without
+ *          invalidating anything instead of waiting forever. The address space
+ *          of the batch is kept when the batch is emptied.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformTlbBatchFlush(
+    _Mo_InOut_ PMO_PLATFORM_X64_TLB_BATCH Batch,
+    _Mo_In_Opt_ PMO_PLATFORM_X64_TLB_SHOOTDOWN Shootdown);
+
+/**
+ * @brief Initializes the TLB shootdown state.
+ * @param Shootdown The TLB shootdown state to initialize.
+ * @param Apic The local APIC used to send the shootdown interrupt.
+ * @param Vector The vector of the shootdown interrupt, or 0 for
+ *               MO_PLATFORM_X64_TLB_DEFAULT_SHOOTDOWN_VECTOR.
+ * @param TargetCount The number of the other processors which receive the
+ *                    shootdown interrupt.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformTlbShootdownInitialize(
+    _Mo_Out_ PMO_PLATFORM_X64_TLB_SHOOTDOWN Shootdown,
+    _Mo_In_ PMO_PLATFORM_X64_LOCAL_APIC Apic,
+    _Mo_In_ MO_UINT8 Vector,
+    _Mo_In_ MO_UINT32 TargetCount);
+
+/**
+ * @brief Updates the number of the other processors which receive the
+ *        shootdown interrupt, such as after starting a processor.
+ * @param Shootdown The TLB shootdown state.
+ * @param TargetCount The number of the other processors which receive the
+ *                    shootdown interrupt.
+ * @remarks The interrupts must be enabled, because it waits for the current
+ *          shootdown to complete.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformTlbShootdownSetTargetCount(
+    _Mo_InOut_ PMO_PLATFORM_X64_TLB_SHOOTDOWN Shootdown,
+    _Mo_In_ MO_UINT32 TargetCount);
+
+/**
+ * @brief Installs the shootdown interrupt handler in the lightweight interrupt
+ *        entry tier.
+ * @param Shootdown The TLB shootdown state used by the interrupt handler.
+ * @param InterruptDescriptorTable The Interrupt Descriptor Table (IDT) whose
+ *                                 gate of the shootdown vector is updated.
+ * @param LightweightHandlerTable The lightweight interrupt handler table which
+ *                                is also used as
+ *                                MoPlatformLightweightInterruptHandlerTable.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks Only one TLB shootdown state can be installed at the same time. The
+ *          IDT and the handler table are shared by all processors.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformTlbShootdownInstallHandler(
+    _Mo_In_ PMO_PLATFORM_X64_TLB_SHOOTDOWN Shootdown,
+    _Mo_InOut_ PMO_PLATFORM_X64_IDT_GATE_DESCRIPTOR InterruptDescriptorTable,
+    _Mo_InOut_ PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER*
+        LightweightHandlerTable);
+
+#endif // !MOBILITY_PLATFORM_X64_TLB
@@ -28,14 +28,43 @@ void __halt();
 void __cdecl __debugbreak();
 
 void __cpuid(int[4], int);
+void __cpuidex(int[4], int, int);
+
+unsigned __int64 __rdtsc();
 
 unsigned __int64 __readmsr(unsigned long);
 void __writemsr(unsigned long, unsigned __int64);
 
+unsigned __int64 __readcr0();
+void __writecr0(unsigned __int64);
+
 unsigned __int64 __readcr3();
 void __writecr3(unsigned __int64);
 
+unsigned __int64 __readcr4();
+void __writecr4(unsigned __int64);
+
+unsigned __int64 _xgetbv(unsigned int);
+void _xsetbv(unsigned int, unsigned __int64);
+
+void _fxsave64(void*);
+void _fxrstor64(void const*);
+
+void _xsave64(void*, unsigned __int64);
+void _xsaveopt64(void*, unsigned __int64);
+void _xrstor64(void const*, unsigned __int64);
+
+void __invlpg(void*);
+void _invpcid(unsigned int, void*);
+
+void __wbinvd();
+
+void _mm_mfence();
+
 void __lidt(void*);
+void __sidt(void*);
+
+unsigned __int64 __readgsqword(unsigned long);
 
 unsigned char __inbyte(unsigned short);
 unsigned short __inword(unsigned short);
@@ -73,6 +102,19 @@ MO_EXTERN_C MO_VOID MOAPI MoPlatformReadCpuid(
     __cpuid((int*)Result, (int)Index);
 }
 
+MO_EXTERN_C MO_VOID MOAPI MoPlatformReadCpuidEx(
+    _Mo_Out_ PMO_PLATFORM_X64_CPUID_RESULT Result,
+    _Mo_In_ MO_UINT32 Index,
+    _Mo_In_ MO_UINT32 SubIndex)
+{
+    __cpuidex((int*)Result, (int)Index, (int)SubIndex);
+}
+
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadTimeStampCounter()
+{
+    return __rdtsc();
+}
+
 MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadMsr(
     _Mo_In_ MO_UINT32 Index)
 {
@@ -86,6 +128,17 @@ MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteMsr(
     __writemsr(Index, Value);
 }
 
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadCr0()
+{
+    return __readcr0();
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteCr0(
+    _Mo_In_ MO_UINT64 Value)
+{
+    __writecr0(Value);
+}
+
 MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadCr3()
 {
     return __readcr3();
@@ -97,12 +150,104 @@ MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteCr3(
     __writecr3(Value);
 }
 
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadCr4()
+{
+    return __readcr4();
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteCr4(
+    _Mo_In_ MO_UINT64 Value)
+{
+    __writecr4(Value);
+}
+
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadExtendedControlRegister(
+    _Mo_In_ MO_UINT32 Index)
+{
+    return _xgetbv(Index);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteExtendedControlRegister(
+    _Mo_In_ MO_UINT32 Index,
+    _Mo_In_ MO_UINT64 Value)
+{
+    _xsetbv(Index, Value);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformSaveLegacyFloatingPointState(
+    _Mo_Out_ MO_POINTER SaveArea)
+{
+    _fxsave64(SaveArea);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformRestoreLegacyFloatingPointState(
+    _Mo_In_ MO_POINTER SaveArea)
+{
+    _fxrstor64(SaveArea);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformSaveExtendedState(
+    _Mo_Out_ MO_POINTER SaveArea,
+    _Mo_In_ MO_UINT64 Mask)
+{
+    _xsave64(SaveArea, Mask);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformSaveExtendedStateOptimized(
+    _Mo_Out_ MO_POINTER SaveArea,
+    _Mo_In_ MO_UINT64 Mask)
+{
+    _xsaveopt64(SaveArea, Mask);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformRestoreExtendedState(
+    _Mo_In_ MO_POINTER SaveArea,
+    _Mo_In_ MO_UINT64 Mask)
+{
+    _xrstor64(SaveArea, Mask);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformInvalidatePage(
+    _Mo_In_ MO_UINT64 Address)
+{
+    __invlpg((void*)(MO_UINTN)(Address));
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformInvalidateProcessContext(
+    _Mo_In_ MO_PLATFORM_X64_INVPCID_TYPE Type,
+    _Mo_In_ PMO_PLATFORM_X64_INVPCID_DESCRIPTOR Descriptor)
+{
+    _invpcid((unsigned int)Type, Descriptor);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteBackInvalidateCache()
+{
+    __wbinvd();
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformMemoryFence()
+{
+    _mm_mfence();
+}
+
 MO_EXTERN_C MO_VOID MOAPI MoPlatformLoadInterruptDescriptorTable(
     _Mo_In_ PMO_PLATFORM_X64_PSEUDO_DESCRIPTOR Descriptor)
 {
     __lidt(Descriptor);
 }
 
+MO_EXTERN_C MO_VOID MOAPI MoPlatformStoreInterruptDescriptorTable(
+    _Mo_Out_ PMO_PLATFORM_X64_PSEUDO_DESCRIPTOR Descriptor)
+{
+    __sidt(Descriptor);
+}
+
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadGsQword(
+    _Mo_In_ MO_UINT32 Offset)
+{
+    return __readgsqword(Offset);
+}
+
 MO_EXTERN_C MO_UINT8 MOAPI MoPlatformReadIoPort8(
     _Mo_In_ MO_UINT16 Port)
 {
@@ -217,3 +362,38 @@ MO_EXTERN_C MO_VOID MOAPI MoPlatformSetIdtGateDescriptorOffset(
         Descriptor->OffsetHigh = ((MO_UINT32)(Offset >> 32)) & 0xFFFFFFFF;
     }
 }
+
+MO_EXTERN_C MO_UINT32 MOAPI MoPlatformGetDefaultInterruptEntryTier(
+    _Mo_In_ MO_UINT8 Vector)
+{
+    return (Vector < MO_PLATFORM_X64_INTERRUPT_FIRST_EXTERNAL_VECTOR)
+        ? MO_PLATFORM_X64_INTERRUPT_ENTRY_FULL
+        : MO_PLATFORM_X64_INTERRUPT_ENTRY_LIGHTWEIGHT;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformSetInterruptEntry(
+    _Mo_InOut_ PMO_PLATFORM_X64_IDT_GATE_DESCRIPTOR InterruptDescriptorTable,
+    _Mo_In_ MO_UINT8 Vector,
+    _Mo_In_ MO_UINT32 Tier)
+{
+    if (!InterruptDescriptorTable)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    PMO_UINT64 Handlers = MoPlatformInterruptDescriptorTableHandlers;
+    if (MO_PLATFORM_X64_INTERRUPT_ENTRY_LIGHTWEIGHT == Tier)
+    {
+        Handlers = MoPlatformInterruptDescriptorTableLightweightHandlers;
+    }
+    else if (MO_PLATFORM_X64_INTERRUPT_ENTRY_FULL != Tier)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MoPlatformSetIdtGateDescriptorOffset(
+        &InterruptDescriptorTable[Vector],
+        (MO_UINT64)(MO_UINTN)(&Handlers[Vector]));
+
+    return MO_RESULT_SUCCESS_OK;
+}
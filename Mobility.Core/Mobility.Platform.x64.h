@@ -13,6 +13,8 @@
 
 #include <Mile.Mobility.Portable.Types.h>
 
+#include "Mobility.Platform.Interface.h"
+
 #ifdef _MSC_VER
 #if (_MSC_VER >= 1200)
 #pragma warning(push)
@@ -244,6 +246,36 @@ typedef struct _MO_PLATFORM_X64_TASK_STATE_SEGMENT
 } MO_PLATFORM_X64_TASK_STATE_SEGMENT, *PMO_PLATFORM_X64_TASK_STATE_SEGMENT;
 #pragma pack(pop, MO_PLATFORM_X64_TASK_STATE_SEGMENT_PRAGMA_PACK)
 
+/**
+ * @brief The segment types for the GDT entries.
+ * @remarks The user data segment is placed before the user code segment,
+ *          because SYSRET loads SS and CS from the selector in STAR[63:48]
+ *          plus 8 and 16, and SYSCALL loads CS and SS from the selector in
+ *          STAR[47:32] plus 0 and 8.
+ */
+typedef enum _MO_PLATFORM_X64_SEGMENT_TYPE
+{
+    MO_PLATFORM_X64_SEGMENT_NULL = 0x00,
+    MO_PLATFORM_X64_SEGMENT_KERNEL_CODE = 0x08,
+    MO_PLATFORM_X64_SEGMENT_KERNEL_DATA = 0x10,
+    MO_PLATFORM_X64_SEGMENT_USER_DATA = 0x18,
+    MO_PLATFORM_X64_SEGMENT_USER_CODE = 0x20,
+    MO_PLATFORM_X64_SEGMENT_TSS = 0x28,
+} MO_PLATFORM_X64_SEGMENT_TYPE, *PMO_PLATFORM_X64_SEGMENT_TYPE;
+
+/**
+ * @brief The GDT descriptors for x64 architecture.
+ */
+typedef struct _MO_PLATFORM_X64_GDT_DESCRIPTORS
+{
+    MO_PLATFORM_X64_SEGMENT_DESCRIPTOR Null;
+    MO_PLATFORM_X64_SEGMENT_DESCRIPTOR KernelCode;
+    MO_PLATFORM_X64_SEGMENT_DESCRIPTOR KernelData;
+    MO_PLATFORM_X64_SEGMENT_DESCRIPTOR UserData;
+    MO_PLATFORM_X64_SEGMENT_DESCRIPTOR UserCode;
+    MO_PLATFORM_X64_SYSTEM_SEGMENT_DESCRIPTOR Tss;
+} MO_PLATFORM_X64_GDT_DESCRIPTORS, *PMO_PLATFORM_X64_GDT_DESCRIPTORS;
+
 /*
  * @remark Intel(R) 64 and IA-32 Architectures Software Developer's Manual
  *         (December 2023)
@@ -755,12 +787,6 @@ MO_C_STATIC_ASSERT(sizeof(MO_PLATFORM_X64_FXSAVE_AREA) == 512);
 #endif
 #endif
 
-/**
- * @brief Inserts a PAUSE instruction to improve the performance of spin-wait
- *        loops.
- */
-MO_EXTERN_C MO_VOID MOAPI MoPlatformPause();
-
 /**
  * @brief Halts the current processor until the next external interrupt arrives.
  */
@@ -792,6 +818,25 @@ MO_EXTERN_C MO_VOID MOAPI MoPlatformReadCpuid(
     _Mo_Out_ PMO_PLATFORM_X64_CPUID_RESULT Result,
     _Mo_In_ MO_UINT32 Index);
 
+/**
+ * @brief Queries the processor information with the specified leaf and
+ *        sub-leaf of the CPUID instruction.
+ * @param Result The pointer to receive the CPUID result.
+ * @param Index The leaf of the CPUID instruction, passed in EAX.
+ * @param SubIndex The sub-leaf of the CPUID instruction, passed in ECX.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformReadCpuidEx(
+    _Mo_Out_ PMO_PLATFORM_X64_CPUID_RESULT Result,
+    _Mo_In_ MO_UINT32 Index,
+    _Mo_In_ MO_UINT32 SubIndex);
+
+/**
+ * @brief Reads the value of the Time Stamp Counter (TSC) of the current
+ *        processor.
+ * @return The value of the Time Stamp Counter (TSC).
+ */
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadTimeStampCounter();
+
 /**
  * @brief Reads the value of the specified Model-Specific Register (MSR).
  * @param Index The index of the MSR to read.
@@ -809,6 +854,19 @@ MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteMsr(
     _Mo_In_ MO_UINT32 Index,
     _Mo_In_ MO_UINT64 Value);
 
+/**
+ * @brief Reads the value of the CR0 register.
+ * @return The value of the CR0 register.
+ */
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadCr0();
+
+/**
+ * @brief Writes a value to the CR0 register.
+ * @param Value The value to write to the CR0 register.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteCr0(
+    _Mo_In_ MO_UINT64 Value);
+
 /**
  * @brief Reads the value of the CR3 register.
  * @return The value of the CR3 register.
@@ -822,6 +880,144 @@ MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadCr3();
 MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteCr3(
     _Mo_In_ MO_UINT64 Value);
 
+/**
+ * @brief Reads the value of the CR4 register.
+ * @return The value of the CR4 register.
+ */
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadCr4();
+
+/**
+ * @brief Writes a value to the CR4 register.
+ * @param Value The value to write to the CR4 register.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteCr4(
+    _Mo_In_ MO_UINT64 Value);
+
+/**
+ * @brief Reads the value of the specified Extended Control Register (XCR).
+ * @param Index The index of the XCR to read.
+ * @return The value of the specified XCR.
+ * @remark CR4.OSXSAVE must be set before calling this function.
+ */
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadExtendedControlRegister(
+    _Mo_In_ MO_UINT32 Index);
+
+/**
+ * @brief Writes a value to the specified Extended Control Register (XCR).
+ * @param Index The index of the XCR to write.
+ * @param Value The value to write to the XCR.
+ * @remark CR4.OSXSAVE must be set before calling this function.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteExtendedControlRegister(
+    _Mo_In_ MO_UINT32 Index,
+    _Mo_In_ MO_UINT64 Value);
+
+/**
+ * @brief Saves the x87 FPU, MMX and SSE state to the 512-byte save area with
+ *        the FXSAVE instruction.
+ * @param SaveArea The save area, which must be 16-byte aligned.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformSaveLegacyFloatingPointState(
+    _Mo_Out_ MO_POINTER SaveArea);
+
+/**
+ * @brief Restores the x87 FPU, MMX and SSE state from the 512-byte save area
+ *        with the FXRSTOR instruction.
+ * @param SaveArea The save area, which must be 16-byte aligned.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformRestoreLegacyFloatingPointState(
+    _Mo_In_ MO_POINTER SaveArea);
+
+/**
+ * @brief Saves the processor state components specified by the mask and XCR0
+ *        to the XSAVE area with the XSAVE instruction.
+ * @param SaveArea The XSAVE area, which must be 64-byte aligned.
+ * @param Mask The requested-feature bitmap.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformSaveExtendedState(
+    _Mo_Out_ MO_POINTER SaveArea,
+    _Mo_In_ MO_UINT64 Mask);
+
+/**
+ * @brief Saves the processor state components specified by the mask and XCR0
+ *        to the XSAVE area with the XSAVEOPT instruction, which may skip the
+ *        components not modified since they were restored from the same area.
+ * @param SaveArea The XSAVE area, which must be 64-byte aligned.
+ * @param Mask The requested-feature bitmap.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformSaveExtendedStateOptimized(
+    _Mo_Out_ MO_POINTER SaveArea,
+    _Mo_In_ MO_UINT64 Mask);
+
+/**
+ * @brief Restores the processor state components specified by the mask and
+ *        XCR0 from the XSAVE area with the XRSTOR instruction.
+ * @param SaveArea The XSAVE area, which must be 64-byte aligned.
+ * @param Mask The requested-feature bitmap.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformRestoreExtendedState(
+    _Mo_In_ MO_POINTER SaveArea,
+    _Mo_In_ MO_UINT64 Mask);
+
+/**
+ * @brief Invalidates the TLB entries for the page containing the specified
+ *        linear address on the current processor.
+ * @param Address The linear address in the page to invalidate.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformInvalidatePage(
+    _Mo_In_ MO_UINT64 Address);
+
+/**
+ * @brief The INVPCID descriptor.
+ */
+typedef struct _MO_PLATFORM_X64_INVPCID_DESCRIPTOR
+{
+    /**
+     * @brief The PCID in bits 0-11, and bits 12-63 are reserved.
+     */
+    MO_UINT64 Pcid;
+    /**
+     * @brief The linear address, only used by the individual-address
+     *        invalidation.
+     */
+    MO_UINT64 Address;
+} MO_PLATFORM_X64_INVPCID_DESCRIPTOR, *PMO_PLATFORM_X64_INVPCID_DESCRIPTOR;
+
+/**
+ * @brief The types of the INVPCID instruction.
+ */
+typedef enum _MO_PLATFORM_X64_INVPCID_TYPE
+{
+    MO_PLATFORM_X64_INVPCID_INDIVIDUAL_ADDRESS = 0,
+    MO_PLATFORM_X64_INVPCID_SINGLE_CONTEXT = 1,
+    MO_PLATFORM_X64_INVPCID_ALL_CONTEXTS_INCLUDING_GLOBAL = 2,
+    MO_PLATFORM_X64_INVPCID_ALL_CONTEXTS = 3,
+} MO_PLATFORM_X64_INVPCID_TYPE, *PMO_PLATFORM_X64_INVPCID_TYPE;
+
+/**
+ * @brief Invalidates the TLB entries and the paging-structure caches on the
+ *        current processor with the INVPCID instruction.
+ * @param Type The type of the invalidation.
+ * @param Descriptor The INVPCID descriptor.
+ * @remark CPUID.(EAX=07H,ECX=0):EBX.INVPCID[bit 10] must be 1 before calling
+ *         this function.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformInvalidateProcessContext(
+    _Mo_In_ MO_PLATFORM_X64_INVPCID_TYPE Type,
+    _Mo_In_ PMO_PLATFORM_X64_INVPCID_DESCRIPTOR Descriptor);
+
+/**
+ * @brief Writes back all modified cache lines to the main memory and
+ *        invalidates the internal caches.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteBackInvalidateCache();
+
+/**
+ * @brief Serializes all load and store operations issued before it, which
+ *        includes the memory-mapped I/O writes.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformMemoryFence();
+
 /**
  * @brief Loads the Interrupt Descriptor Table (IDT) with the specified
  *        descriptor.
@@ -831,6 +1027,24 @@ MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteCr3(
 MO_EXTERN_C MO_VOID MOAPI MoPlatformLoadInterruptDescriptorTable(
     _Mo_In_ PMO_PLATFORM_X64_PSEUDO_DESCRIPTOR Descriptor);
 
+/**
+ * @brief Stores the Interrupt Descriptor Table Register (IDTR) to the specified
+ *        descriptor.
+ * @param Descriptor A pointer to the pseudo-descriptor that receives the base
+ *                   address and limit of the IDT.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformStoreInterruptDescriptorTable(
+    _Mo_Out_ PMO_PLATFORM_X64_PSEUDO_DESCRIPTOR Descriptor);
+
+/**
+ * @brief Reads a 64-bit value at the specified offset relative to the base of
+ *        the GS segment.
+ * @param Offset The offset in bytes relative to the base of the GS segment.
+ * @return The 64-bit value at the specified offset.
+ */
+MO_EXTERN_C MO_UINT64 MOAPI MoPlatformReadGsQword(
+    _Mo_In_ MO_UINT32 Offset);
+
 /**
  * @brief Reads an 8-bit value from the specified I/O port.
  * @param Port The I/O port to read from.
@@ -894,6 +1108,21 @@ MO_EXTERN_C MO_VOID MOAPI MoPlatformDisableInterrupts();
  */
 MO_EXTERN_C MO_VOID MOAPI MoPlatformEnableInterrupts();
 
+// MoPlatformSaveAndDisableInterrupts and MoPlatformRestoreInterrupts are
+// declared in Mobility.Platform.Interface.h. The x64 implementations in the
+// assembly parts use the RFLAGS value as the interrupt state.
+
+/**
+ * @brief Enables interrupts and halts the current processor until the next
+ *        interrupt arrives.
+ * @remarks Implemented in the assembly parts. Because STI delays recognizing
+ *          the interrupts by one instruction, an interrupt which becomes
+ *          pending after the caller disabled interrupts to check for work
+ *          always wakes up the processor, which is required by the idle loops
+ *          without a periodic timer tick.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoPlatformEnableInterruptsAndHalt();
+
 /**
  * @brief Loads the Global Descriptor Table (GDT) with the specified descriptor.
  * @param Descriptor A pointer to the pseudo-descriptor that contains the base
@@ -1012,6 +1241,130 @@ MO_EXTERN_C PMO_PLATFORM_X64_INTERRUPT_HANDLER* MoPlatformInterruptHandlerTable;
  */
 MO_EXTERN_C MO_UINT64 MoPlatformInterruptDescriptorTableHandlers[256];
 
+/**
+ * @brief The first vector which is not reserved for the architecture-defined
+ *        exceptions and interrupts, so the vectors from this one are used by
+ *        the hardware interrupts and the inter-processor interrupts.
+ */
+#define MO_PLATFORM_X64_INTERRUPT_FIRST_EXTERNAL_VECTOR 32
+
+/*
+ * The tiers of the interrupt entry points for x64 architecture.
+ */
+
+/**
+ * @brief The full interrupt entry point, which captures the complete processor
+ *        state into MO_PLATFORM_X64_INTERRUPT_CONTEXT and calls the handler
+ *        from MoPlatformInterruptHandlerTable. It should be used for the
+ *        exceptions and the debugger vectors.
+ * @remark Both tiers swap to the GS base of the processor block if the
+ *         interrupt arrives in the user mode. The full tier also swaps it for
+ *         a fault of the IRETQ returning to the user mode, whose handler must
+ *         change the return context instead of retrying the same IRETQ.
+ */
+#define MO_PLATFORM_X64_INTERRUPT_ENTRY_FULL 0
+/**
+ * @brief The lightweight interrupt entry point, which only saves the volatile
+ *        registers of the x64 calling convention into
+ *        MO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_CONTEXT and calls the handler
+ *        from MoPlatformLightweightInterruptHandlerTable. It should be used for
+ *        the hardware interrupts and the inter-processor interrupts.
+ */
+#define MO_PLATFORM_X64_INTERRUPT_ENTRY_LIGHTWEIGHT 1
+
+/**
+ * @brief The lightweight interrupt context for x64 architecture, which is the
+ *        stack frame built by the lightweight interrupt entry point.
+ * @remark The non-volatile registers are preserved by the handler itself per
+ *         the x64 calling convention, so only the volatile general-purpose
+ *         registers, XMM0-XMM5 and MXCSR are saved. CR0.TS is cleared while
+ *         the handler runs, so the handler can use the SSE registers without
+ *         raising #NM. The x87 and MMX registers are not saved, so the
+ *         lightweight interrupt handlers must not use them.
+ */
+typedef struct _MO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_CONTEXT
+{
+    MO_UINT8 Xmm0[16];
+    MO_UINT8 Xmm1[16];
+    MO_UINT8 Xmm2[16];
+    MO_UINT8 Xmm3[16];
+    MO_UINT8 Xmm4[16];
+    MO_UINT8 Xmm5[16];
+    MO_UINT32 MxCsr;
+    MO_UINT32 Reserved0;
+    MO_UINT64 Cr0;
+    MO_UINT64 Reserved1;
+    MO_UINT64 R11;
+    MO_UINT64 R10;
+    MO_UINT64 R9;
+    MO_UINT64 R8;
+    MO_UINT64 Rdx;
+    MO_UINT64 Rcx;
+    MO_UINT64 Rax;
+    MO_UINT64 Rbp;
+    MO_UINT64 Vector;
+    MO_UINT64 ExceptionData;
+    MO_UINT64 Rip;
+    MO_UINT64 Cs;
+    MO_UINT64 Rflags;
+    MO_UINT64 Rsp;
+    MO_UINT64 Ss;
+} MO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_CONTEXT,
+*PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_CONTEXT;
+MO_C_STATIC_ASSERT(
+    sizeof(MO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_CONTEXT) == 240);
+
+/**
+ * @brief The prototype for x64 lightweight interrupt handler.
+ * @param InterruptType The type of the interrupt.
+ * @param InterruptContext The lightweight context of the interrupt.
+ */
+typedef MO_VOID(MOAPI* PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER)(
+    _Mo_In_ MO_PLATFORM_X64_INTERRUPT_TYPE InterruptType,
+    _Mo_In_ PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_CONTEXT InterruptContext);
+
+/**
+ * @brief The lightweight interrupt handler table for x64 architecture.
+ * @remark The length of the pointed interrupt handler table must be 256
+ *         entries.
+ */
+MO_EXTERN_C PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER*
+MoPlatformLightweightInterruptHandlerTable;
+
+/**
+ * @brief The lightweight interrupt descriptor table handlers for x64
+ *        architecture, which have the same layout as
+ *        MoPlatformInterruptDescriptorTableHandlers.
+ */
+MO_EXTERN_C MO_UINT64 MoPlatformInterruptDescriptorTableLightweightHandlers[256];
+
+/**
+ * @brief Gets the default interrupt entry tier for the specific vector.
+ * @param Vector The interrupt vector.
+ * @return MO_PLATFORM_X64_INTERRUPT_ENTRY_FULL for the architecture-defined
+ *         exceptions and interrupts, and
+ *         MO_PLATFORM_X64_INTERRUPT_ENTRY_LIGHTWEIGHT for the others.
+ */
+MO_EXTERN_C MO_UINT32 MOAPI MoPlatformGetDefaultInterruptEntryTier(
+    _Mo_In_ MO_UINT8 Vector);
+
+/**
+ * @brief Points the Interrupt Descriptor Table (IDT) gate of the specific
+ *        vector to the entry point of the specific tier.
+ * @param InterruptDescriptorTable The Interrupt Descriptor Table (IDT) with 256
+ *                                 gates.
+ * @param Vector The interrupt vector.
+ * @param Tier The interrupt entry tier (MO_PLATFORM_X64_INTERRUPT_ENTRY_*).
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks Only the offset of the gate is changed, so the selector, the type
+ *          and the other fields should be set before.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformSetInterruptEntry(
+    _Mo_InOut_ PMO_PLATFORM_X64_IDT_GATE_DESCRIPTOR InterruptDescriptorTable,
+    _Mo_In_ MO_UINT8 Vector,
+    _Mo_In_ MO_UINT32 Tier);
+
 /**
  * @brief Set the Base value for the specific 64-Bit Segment Descriptor.
  * @param Descriptor The pointer to a 64-Bit Segment Descriptor.
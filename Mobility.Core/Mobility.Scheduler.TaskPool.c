@@ -0,0 +1,392 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Scheduler.TaskPool.c
+ * PURPOSE:    Implementation for Mobility Scheduler work-stealing task pool
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Scheduler.TaskPool.h"
+
+#include "Mobility.Runtime.Core.h"
+
+typedef struct _MO_TASK_POOL_PARALLEL_FOR_CHUNK
+{
+    MO_TASK Task;
+    MO_UINTN Begin;
+    MO_UINTN End;
+    PMO_TASK_POOL_RANGE_ROUTINE Routine;
+    MO_POINTER Context;
+    MO_UINT32 volatile* RemainingCount;
+} MO_TASK_POOL_PARALLEL_FOR_CHUNK, *PMO_TASK_POOL_PARALLEL_FOR_CHUNK;
+
+MO_FORCEINLINE MO_UINT64 MoTaskPoolNextRandom(
+    _Mo_InOut_ PMO_TASK_POOL_WORKER Worker)
+{
+    // xorshift64, which is good enough for selecting the victims.
+    MO_UINT64 State = Worker->RandomState;
+    State ^= State << 13;
+    State ^= State >> 7;
+    State ^= State << 17;
+    Worker->RandomState = State;
+    return State;
+}
+
+MO_FORCEINLINE MO_BOOL MoTaskPoolPush(
+    _Mo_InOut_ PMO_TASK_POOL_WORKER Worker,
+    _Mo_In_ PMO_TASK Task)
+{
+    MO_UINT64 Bottom = MoAtomicLoad64(
+        &Worker->Bottom,
+        MO_ATOMIC_ORDER_RELAXED);
+    MO_UINT64 Top = MoAtomicLoad64(&Worker->Top, MO_ATOMIC_ORDER_ACQUIRE);
+    if ((MO_INT64)(Bottom - Top) > (MO_INT64)Worker->Mask)
+    {
+        return MO_FALSE;
+    }
+
+    MoAtomicStorePointer(
+        &Worker->Slots[Bottom & Worker->Mask],
+        Task,
+        MO_ATOMIC_ORDER_RELAXED);
+    MoAtomicStore64(&Worker->Bottom, Bottom + 1, MO_ATOMIC_ORDER_RELEASE);
+    return MO_TRUE;
+}
+
+MO_FORCEINLINE PMO_TASK MoTaskPoolPop(
+    _Mo_InOut_ PMO_TASK_POOL_WORKER Worker)
+{
+    MO_UINT64 Bottom = MoAtomicLoad64(
+        &Worker->Bottom,
+        MO_ATOMIC_ORDER_RELAXED) - 1;
+
+    // The sequentially consistent exchange orders the reservation of the
+    // bottom slot before reading the top, which the thieves rely on.
+    MoAtomicExchange64(&Worker->Bottom, Bottom, MO_ATOMIC_ORDER_SEQUENTIAL);
+    MO_UINT64 Top = MoAtomicLoad64(&Worker->Top, MO_ATOMIC_ORDER_SEQUENTIAL);
+
+    if ((MO_INT64)(Bottom - Top) < 0)
+    {
+        MoAtomicStore64(
+            &Worker->Bottom,
+            Bottom + 1,
+            MO_ATOMIC_ORDER_RELAXED);
+        return nullptr;
+    }
+
+    PMO_TASK Task = (PMO_TASK)MoAtomicLoadPointer(
+        &Worker->Slots[Bottom & Worker->Mask],
+        MO_ATOMIC_ORDER_RELAXED);
+    if (Bottom == Top)
+    {
+        // The last task may be stolen at the same time, so race with the
+        // thieves for it by advancing the top.
+        if (!MoAtomicCompareExchange64(
+            &Worker->Top,
+            &Top,
+            Top + 1,
+            MO_ATOMIC_ORDER_SEQUENTIAL))
+        {
+            Task = nullptr;
+        }
+        MoAtomicStore64(
+            &Worker->Bottom,
+            Bottom + 1,
+            MO_ATOMIC_ORDER_RELAXED);
+    }
+
+    return Task;
+}
+
+MO_FORCEINLINE PMO_TASK MoTaskPoolSteal(
+    _Mo_InOut_ PMO_TASK_POOL_WORKER Victim)
+{
+    MO_UINT64 Top = MoAtomicLoad64(&Victim->Top, MO_ATOMIC_ORDER_SEQUENTIAL);
+    MO_UINT64 Bottom = MoAtomicLoad64(
+        &Victim->Bottom,
+        MO_ATOMIC_ORDER_SEQUENTIAL);
+    if ((MO_INT64)(Bottom - Top) <= 0)
+    {
+        return nullptr;
+    }
+
+    PMO_TASK Task = (PMO_TASK)MoAtomicLoadPointer(
+        &Victim->Slots[Top & Victim->Mask],
+        MO_ATOMIC_ORDER_RELAXED);
+    if (!MoAtomicCompareExchange64(
+        &Victim->Top,
+        &Top,
+        Top + 1,
+        MO_ATOMIC_ORDER_SEQUENTIAL))
+    {
+        // Lost the race with the owner or another thief.
+        return nullptr;
+    }
+
+    return Task;
+}
+
+MO_FORCEINLINE PMO_TASK MoTaskPoolFindTask(
+    _Mo_InOut_ PMO_TASK_POOL_WORKER Worker)
+{
+    PMO_TASK Task = MoTaskPoolPop(Worker);
+    if (Task)
+    {
+        return Task;
+    }
+
+    PMO_TASK_POOL Pool = Worker->Pool;
+    if (Pool->WorkerCount < 2)
+    {
+        return nullptr;
+    }
+
+    // Start from a random victim to spread the thieves over the workers.
+    MO_UINT32 Start = (MO_UINT32)(
+        MoTaskPoolNextRandom(Worker) % Pool->WorkerCount);
+    for (MO_UINT32 Offset = 0; Offset < Pool->WorkerCount; ++Offset)
+    {
+        MO_UINT32 Index = (Start + Offset) % Pool->WorkerCount;
+        if (Index == Worker->Index)
+        {
+            continue;
+        }
+        Task = MoTaskPoolSteal(&Pool->Workers[Index]);
+        if (Task)
+        {
+            return Task;
+        }
+    }
+
+    return nullptr;
+}
+
+static MO_VOID MoTaskPoolExecute(
+    _Mo_In_ PMO_TASK_POOL_WORKER Worker,
+    _Mo_In_ PMO_TASK Task)
+{
+    // Read the continuation first, because the task may be freed by its
+    // routine or by the continuation.
+    PMO_TASK Continuation = Task->Continuation;
+
+    Task->Routine(Worker, Task);
+
+    if (Continuation && 1 == MoAtomicFetchAdd32(
+        &Continuation->PendingCount,
+        (MO_UINT32)-1,
+        MO_ATOMIC_ORDER_ACQUIRE_RELEASE))
+    {
+        MoTaskPoolSpawn(Worker, Continuation);
+    }
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoTaskPoolInitialize(
+    _Mo_Out_ PMO_TASK_POOL Pool,
+    _Mo_Out_ PMO_TASK_POOL_WORKER Workers,
+    _Mo_In_ MO_UINT32 WorkerCount,
+    _Mo_Out_ PMO_POINTER Slots,
+    _Mo_In_ MO_UINT32 DequeCapacity,
+    _Mo_In_ PMO_TASK_POOL_IDLE_ROUTINE IdleRoutine,
+    _Mo_In_Opt_ MO_POINTER IdleContext)
+{
+    if (!Pool || !Workers || !WorkerCount || !Slots || !IdleRoutine)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (!DequeCapacity || (DequeCapacity & (DequeCapacity - 1)))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MoRuntimeMemoryFillByte(Pool, 0, sizeof(MO_TASK_POOL));
+    Pool->Workers = Workers;
+    Pool->WorkerCount = WorkerCount;
+    Pool->IdleRoutine = IdleRoutine;
+    Pool->IdleContext = IdleContext;
+
+    for (MO_UINT32 Index = 0; Index < WorkerCount; ++Index)
+    {
+        PMO_TASK_POOL_WORKER Worker = &Workers[Index];
+        MoRuntimeMemoryFillByte(Worker, 0, sizeof(MO_TASK_POOL_WORKER));
+        Worker->Slots = (MO_POINTER volatile*)
+            &Slots[(MO_UINTN)Index * DequeCapacity];
+        Worker->Pool = Pool;
+        // The xorshift state must not be zero.
+        Worker->RandomState = 0x9E3779B97F4A7C15ULL * (Index + 1);
+        Worker->Mask = DequeCapacity - 1;
+        Worker->Index = Index;
+    }
+
+    MoAtomicStore32(&Pool->Shutdown, MO_FALSE, MO_ATOMIC_ORDER_RELEASE);
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C PMO_TASK_POOL_WORKER MOAPI MoTaskPoolGetWorker(
+    _Mo_In_ PMO_TASK_POOL Pool,
+    _Mo_In_ MO_UINT32 Index)
+{
+    if (!Pool || Index >= Pool->WorkerCount)
+    {
+        return nullptr;
+    }
+    return &Pool->Workers[Index];
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoTaskInitialize(
+    _Mo_Out_ PMO_TASK Task,
+    _Mo_In_ PMO_TASK_ROUTINE Routine,
+    _Mo_In_Opt_ MO_POINTER Context,
+    _Mo_In_Opt_ PMO_TASK Continuation)
+{
+    Task->Routine = Routine;
+    Task->Context = Context;
+    Task->Continuation = Continuation;
+    Task->PendingCount = 0;
+    Task->Reserved = 0;
+
+    if (Continuation)
+    {
+        MoAtomicFetchAdd32(
+            &Continuation->PendingCount,
+            1,
+            MO_ATOMIC_ORDER_RELAXED);
+    }
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoTaskPoolSpawn(
+    _Mo_In_ PMO_TASK_POOL_WORKER Worker,
+    _Mo_In_ PMO_TASK Task)
+{
+    if (!MoTaskPoolPush(Worker, Task))
+    {
+        MoTaskPoolExecute(Worker, Task);
+    }
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoTaskPoolWorkUntilZero(
+    _Mo_In_ PMO_TASK_POOL_WORKER Worker,
+    _Mo_In_ MO_UINT32 volatile* Counter)
+{
+    while (MoAtomicLoad32(Counter, MO_ATOMIC_ORDER_ACQUIRE))
+    {
+        PMO_TASK Task = MoTaskPoolFindTask(Worker);
+        if (Task)
+        {
+            MoTaskPoolExecute(Worker, Task);
+        }
+        else
+        {
+            Worker->Pool->IdleRoutine(Worker->Pool->IdleContext);
+        }
+    }
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoTaskPoolWorkerRun(
+    _Mo_In_ PMO_TASK_POOL_WORKER Worker)
+{
+    PMO_TASK_POOL Pool = Worker->Pool;
+    while (!MoAtomicLoad32(&Pool->Shutdown, MO_ATOMIC_ORDER_ACQUIRE))
+    {
+        PMO_TASK Task = MoTaskPoolFindTask(Worker);
+        if (Task)
+        {
+            MoTaskPoolExecute(Worker, Task);
+        }
+        else
+        {
+            Pool->IdleRoutine(Pool->IdleContext);
+        }
+    }
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoTaskPoolShutdown(
+    _Mo_In_ PMO_TASK_POOL Pool)
+{
+    MoAtomicStore32(&Pool->Shutdown, MO_TRUE, MO_ATOMIC_ORDER_RELEASE);
+}
+
+static MO_VOID MOAPI MoTaskPoolParallelForChunkRoutine(
+    _Mo_In_ PMO_TASK_POOL_WORKER Worker,
+    _Mo_In_ PMO_TASK Task)
+{
+    MO_UNREFERENCED_PARAMETER(Worker);
+
+    PMO_TASK_POOL_PARALLEL_FOR_CHUNK Chunk =
+        (PMO_TASK_POOL_PARALLEL_FOR_CHUNK)Task->Context;
+    Chunk->Routine(Chunk->Begin, Chunk->End, Chunk->Context);
+    MoAtomicFetchAdd32(
+        Chunk->RemainingCount,
+        (MO_UINT32)-1,
+        MO_ATOMIC_ORDER_RELEASE);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoTaskPoolParallelFor(
+    _Mo_In_ PMO_TASK_POOL_WORKER Worker,
+    _Mo_In_ MO_UINTN Begin,
+    _Mo_In_ MO_UINTN End,
+    _Mo_In_ MO_UINTN GrainSize,
+    _Mo_In_ PMO_TASK_POOL_RANGE_ROUTINE Routine,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    if (!Worker || !GrainSize || !Routine || Begin > End)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MO_UINTN IterationCount = End - Begin;
+    if (!IterationCount)
+    {
+        return MO_RESULT_SUCCESS_OK;
+    }
+
+    MO_UINTN ChunkCount = IterationCount / GrainSize +
+        (IterationCount % GrainSize ? 1 : 0);
+    if (ChunkCount > MO_TASK_POOL_PARALLEL_FOR_MAXIMUM_CHUNKS)
+    {
+        ChunkCount = MO_TASK_POOL_PARALLEL_FOR_MAXIMUM_CHUNKS;
+    }
+    MO_UINTN ChunkSize = IterationCount / ChunkCount +
+        (IterationCount % ChunkCount ? 1 : 0);
+
+    MO_TASK_POOL_PARALLEL_FOR_CHUNK Chunks[
+        MO_TASK_POOL_PARALLEL_FOR_MAXIMUM_CHUNKS];
+    MO_UINT32 volatile RemainingCount = 0;
+
+    MO_UINTN UsedCount = 0;
+    for (MO_UINTN Current = Begin; Current < End; ++UsedCount)
+    {
+        PMO_TASK_POOL_PARALLEL_FOR_CHUNK Chunk = &Chunks[UsedCount];
+        Chunk->Begin = Current;
+        Chunk->End = End - Current > ChunkSize ? Current + ChunkSize : End;
+        Current = Chunk->End;
+        Chunk->Routine = Routine;
+        Chunk->Context = Context;
+        Chunk->RemainingCount = &RemainingCount;
+        MoTaskInitialize(
+            &Chunk->Task,
+            MoTaskPoolParallelForChunkRoutine,
+            Chunk,
+            nullptr);
+    }
+    MoAtomicStore32(
+        &RemainingCount,
+        (MO_UINT32)UsedCount,
+        MO_ATOMIC_ORDER_RELAXED);
+
+    // Spawn the later chunks for the thieves, which steal the oldest ones
+    // first, and keep the first chunk for the caller.
+    for (MO_UINTN Index = UsedCount - 1; Index > 0; --Index)
+    {
+        MoTaskPoolSpawn(Worker, &Chunks[Index].Task);
+    }
+    MoTaskPoolExecute(Worker, &Chunks[0].Task);
+
+    // The chunks live on this stack, so all of them must complete before
+    // returning.
+    MoTaskPoolWorkUntilZero(Worker, &RemainingCount);
+
+    return MO_RESULT_SUCCESS_OK;
+}
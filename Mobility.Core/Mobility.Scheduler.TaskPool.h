@@ -0,0 +1,286 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Scheduler.TaskPool.h
+ * PURPOSE:    Definition for Mobility Scheduler work-stealing task pool
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_SCHEDULER_TASKPOOL
+#define MOBILITY_SCHEDULER_TASKPOOL
+
+#include "Mobility.Synchronization.Atomic.h"
+
+/**
+ * @brief The maximum number of the tasks created by a parallel-for call, which
+ *        bounds the stack usage of the caller.
+ */
+#define MO_TASK_POOL_PARALLEL_FOR_MAXIMUM_CHUNKS 64
+
+typedef struct _MO_TASK MO_TASK, *PMO_TASK;
+typedef struct _MO_TASK_POOL MO_TASK_POOL, *PMO_TASK_POOL;
+typedef struct _MO_TASK_POOL_WORKER MO_TASK_POOL_WORKER, *PMO_TASK_POOL_WORKER;
+
+/**
+ * @brief The routine of a task.
+ * @param Worker The worker which executes the task, which should be used for
+ *               spawning the child tasks.
+ * @param Task The task being executed.
+ */
+typedef MO_VOID(MOAPI* PMO_TASK_ROUTINE)(
+    _Mo_In_ PMO_TASK_POOL_WORKER Worker,
+    _Mo_In_ PMO_TASK Task);
+
+/**
+ * @brief The routine which processes a range of the parallel-for iterations.
+ * @param Begin The first iteration in the range.
+ * @param End The iteration after the last one in the range.
+ * @param Context The user-defined context passed to the parallel-for call.
+ */
+typedef MO_VOID(MOAPI* PMO_TASK_POOL_RANGE_ROUTINE)(
+    _Mo_In_ MO_UINTN Begin,
+    _Mo_In_ MO_UINTN End,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief The routine called by a worker which finds no task to execute.
+ * @param Context The platform-defined context of the task pool.
+ * @remarks The platform decides how to wait, such as pausing the processor on
+ *          Mobility or yielding the thread on a hosted operating system.
+ */
+typedef MO_VOID(MOAPI* PMO_TASK_POOL_IDLE_ROUTINE)(
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief The task, which is owned by the caller and must stay valid until it
+ *        is executed and its continuation is notified.
+ */
+struct _MO_TASK
+{
+    /**
+     * @brief The routine which executes the task.
+     */
+    PMO_TASK_ROUTINE Routine;
+    /**
+     * @brief The user-defined context of the task.
+     */
+    MO_POINTER Context;
+    /**
+     * @brief The task which is spawned after this task and all other
+     *        predecessors of it complete.
+     */
+    PMO_TASK Continuation;
+    /**
+     * @brief The number of the predecessors which have not completed yet.
+     */
+    MO_UINT32 volatile PendingCount;
+    /**
+     * @brief Reserved bits. Set to 0.
+     */
+    MO_UINT32 Reserved;
+};
+
+/**
+ * @brief The worker of the task pool, which owns a Chase-Lev work-stealing
+ *        deque of the tasks.
+ * @remarks The owner pushes and pops at the bottom, and the other workers
+ *          steal from the top, so the top and the bottom are in the separate
+ *          cache lines.
+ */
+struct MO_SYNCHRONIZATION_CACHE_LINE_ALIGNED _MO_TASK_POOL_WORKER
+{
+    /**
+     * @brief The position of the oldest task, which is written by the
+     *        thieves.
+     */
+    MO_UINT64 volatile Top;
+    /**
+     * @brief Pads the top to its own cache line.
+     */
+    MO_UINT8 Reserved0[MO_SYNCHRONIZATION_CACHE_LINE_SIZE - 8];
+    /**
+     * @brief The position after the newest task, which is written by the
+     *        owner only.
+     */
+    MO_UINT64 volatile Bottom;
+    /**
+     * @brief The circular array of the PMO_TASK pointers in the deque.
+     */
+    MO_POINTER volatile* Slots;
+    /**
+     * @brief The task pool which owns the worker.
+     */
+    PMO_TASK_POOL Pool;
+    /**
+     * @brief The state of the pseudo-random generator for choosing the
+     *        victims.
+     */
+    MO_UINT64 RandomState;
+    /**
+     * @brief The capacity of the deque minus one.
+     */
+    MO_UINT32 Mask;
+    /**
+     * @brief The index of the worker in the task pool.
+     */
+    MO_UINT32 Index;
+    /**
+     * @brief Pads the owner fields to their own cache line.
+     */
+    MO_UINT8 Reserved1[MO_SYNCHRONIZATION_CACHE_LINE_SIZE - 40];
+};
+
+MO_C_STATIC_ASSERT(
+    sizeof(MO_TASK_POOL_WORKER) == 2 * MO_SYNCHRONIZATION_CACHE_LINE_SIZE);
+
+/**
+ * @brief The work-stealing task pool.
+ */
+struct _MO_TASK_POOL
+{
+    /**
+     * @brief The workers of the task pool.
+     */
+    PMO_TASK_POOL_WORKER Workers;
+    /**
+     * @brief The number of the workers.
+     */
+    MO_UINT32 WorkerCount;
+    /**
+     * @brief Set when the workers should stop after the current task.
+     */
+    MO_UINT32 volatile Shutdown;
+    /**
+     * @brief The routine called by a worker which finds no task to execute.
+     */
+    PMO_TASK_POOL_IDLE_ROUTINE IdleRoutine;
+    /**
+     * @brief The platform-defined context passed to the idle routine.
+     */
+    MO_POINTER IdleContext;
+};
+
+/**
+ * @brief Initializes the work-stealing task pool.
+ * @param Pool The task pool to initialize.
+ * @param Workers The array of the workers, which must have WorkerCount items
+ *                and must stay valid while the pool is used.
+ * @param WorkerCount The number of the workers, which is usually the number of
+ *                    the processors or the threads running the workers.
+ * @param Slots The buffer of the deque slots for all workers, which must have
+ *              WorkerCount * DequeCapacity pointers and must stay valid while
+ *              the pool is used.
+ * @param DequeCapacity The maximum number of the pending tasks of each worker,
+ *                      which must be a power of two.
+ * @param IdleRoutine The routine called by a worker which finds no task.
+ * @param IdleContext The platform-defined context passed to the idle routine.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The task pool does not create the processors or the threads, so it
+ *          runs on both Mobility SMP and the hosted threads. The platform
+ *          runs MoTaskPoolWorkerRun for each worker except the one used by
+ *          the submitting thread.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoTaskPoolInitialize(
+    _Mo_Out_ PMO_TASK_POOL Pool,
+    _Mo_Out_ PMO_TASK_POOL_WORKER Workers,
+    _Mo_In_ MO_UINT32 WorkerCount,
+    _Mo_Out_ PMO_POINTER Slots,
+    _Mo_In_ MO_UINT32 DequeCapacity,
+    _Mo_In_ PMO_TASK_POOL_IDLE_ROUTINE IdleRoutine,
+    _Mo_In_Opt_ MO_POINTER IdleContext);
+
+/**
+ * @brief Gets the worker of the task pool by the index.
+ * @param Pool The task pool.
+ * @param Index The index of the worker.
+ * @return The worker, or nullptr if the index is out of bounds.
+ */
+MO_EXTERN_C PMO_TASK_POOL_WORKER MOAPI MoTaskPoolGetWorker(
+    _Mo_In_ PMO_TASK_POOL Pool,
+    _Mo_In_ MO_UINT32 Index);
+
+/**
+ * @brief Initializes the task.
+ * @param Task The task to initialize.
+ * @param Routine The routine of the task.
+ * @param Context The user-defined context of the task.
+ * @param Continuation The task which is spawned after all its predecessors
+ *                     complete, and this task becomes one of them. This
+ *                     parameter can be nullptr if no continuation is needed.
+ * @remarks All predecessors of a continuation must be initialized before any
+ *          of them is spawned, or the continuation may be spawned too early.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoTaskInitialize(
+    _Mo_Out_ PMO_TASK Task,
+    _Mo_In_ PMO_TASK_ROUTINE Routine,
+    _Mo_In_Opt_ MO_POINTER Context,
+    _Mo_In_Opt_ PMO_TASK Continuation);
+
+/**
+ * @brief Spawns the task on the deque of the specified worker.
+ * @param Worker The worker which calls this function.
+ * @param Task The task to spawn.
+ * @remarks The task is executed immediately by the caller if the deque of the
+ *          worker is full.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoTaskPoolSpawn(
+    _Mo_In_ PMO_TASK_POOL_WORKER Worker,
+    _Mo_In_ PMO_TASK Task);
+
+/**
+ * @brief Executes the tasks of the pool until the counter becomes zero.
+ * @param Worker The worker which calls this function.
+ * @param Counter The counter to wait for, which is decremented by the tasks.
+ * @remarks The caller helps with the other tasks instead of blocking, so the
+ *          nested waits do not deadlock the pool.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoTaskPoolWorkUntilZero(
+    _Mo_In_ PMO_TASK_POOL_WORKER Worker,
+    _Mo_In_ MO_UINT32 volatile* Counter);
+
+/**
+ * @brief Runs the worker loop until the task pool is shut down.
+ * @param Worker The worker to run, which must be run by only one processor or
+ *               thread at the same time.
+ * @remarks The worker executes the tasks from its own deque first, and steals
+ *          from the randomly selected workers if its own deque is empty.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoTaskPoolWorkerRun(
+    _Mo_In_ PMO_TASK_POOL_WORKER Worker);
+
+/**
+ * @brief Requests all worker loops of the task pool to exit.
+ * @param Pool The task pool.
+ * @remarks The worker loops exit after their current tasks, and the pending
+ *          tasks are not executed.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoTaskPoolShutdown(
+    _Mo_In_ PMO_TASK_POOL Pool);
+
+/**
+ * @brief Splits the iterations into the tasks and processes them in parallel,
+ *        and returns after all iterations are processed.
+ * @param Worker The worker which calls this function.
+ * @param Begin The first iteration.
+ * @param End The iteration after the last one.
+ * @param GrainSize The minimum number of the iterations in each task, which
+ *                  must not be zero.
+ * @param Routine The routine which processes each range.
+ * @param Context The user-defined context passed to the routine.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks At most MO_TASK_POOL_PARALLEL_FOR_MAXIMUM_CHUNKS tasks are created,
+ *          and they are allocated on the stack of the caller.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoTaskPoolParallelFor(
+    _Mo_In_ PMO_TASK_POOL_WORKER Worker,
+    _Mo_In_ MO_UINTN Begin,
+    _Mo_In_ MO_UINTN End,
+    _Mo_In_ MO_UINTN GrainSize,
+    _Mo_In_ PMO_TASK_POOL_RANGE_ROUTINE Routine,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+#endif // !MOBILITY_SCHEDULER_TASKPOOL
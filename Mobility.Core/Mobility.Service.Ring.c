@@ -0,0 +1,366 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Service.Ring.c
+ * PURPOSE:    Implementation for Mobility System Service Submission and
+ *             Completion Rings
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Service.Ring.h"
+
+#include "Mobility.Runtime.Core.h"
+
+MO_FORCEINLINE MO_BOOL MoServiceRingIsPowerOfTwo(
+    _Mo_In_ MO_UINT32 Value)
+{
+    return Value && !(Value & (Value - 1));
+}
+
+static MO_RESULT MoServiceRingGetLayout(
+    _Mo_Out_ PMO_UINT32 CompletionOffset,
+    _Mo_Out_ PMO_UINTN RegionSize,
+    _Mo_In_ MO_UINT32 SubmissionEntryCount,
+    _Mo_In_ MO_UINT32 CompletionEntryCount)
+{
+    if (!MoServiceRingIsPowerOfTwo(SubmissionEntryCount) ||
+        !MoServiceRingIsPowerOfTwo(CompletionEntryCount))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MO_UINT64 Offset = sizeof(MO_SERVICE_RING_HEADER);
+    Offset += (MO_UINT64)SubmissionEntryCount *
+        sizeof(MO_SERVICE_RING_SUBMISSION);
+    MO_UINT64 Size = Offset + (MO_UINT64)CompletionEntryCount *
+        sizeof(MO_SERVICE_RING_COMPLETION);
+    if (Size > 0xFFFFFFFFULL)
+    {
+        return MO_RESULT_ERROR_OUT_OF_BOUNDS;
+    }
+
+    *CompletionOffset = (MO_UINT32)Offset;
+    *RegionSize = (MO_UINTN)Size;
+    return MO_RESULT_SUCCESS_OK;
+}
+
+static MO_VOID MoServiceRingInitializeView(
+    _Mo_Out_ PMO_SERVICE_RING Ring,
+    _Mo_In_ PMO_SERVICE_RING_HEADER Header,
+    _Mo_In_ MO_UINT32 SubmissionEntryCount,
+    _Mo_In_ MO_UINT32 CompletionEntryCount,
+    _Mo_In_ MO_UINT32 CompletionOffset)
+{
+    PMO_UINT8 Base = (PMO_UINT8)Header;
+    Ring->Header = Header;
+    Ring->Submissions = (PMO_SERVICE_RING_SUBMISSION)(
+        Base + sizeof(MO_SERVICE_RING_HEADER));
+    Ring->Completions = (PMO_SERVICE_RING_COMPLETION)(
+        Base + CompletionOffset);
+    Ring->SubmissionMask = SubmissionEntryCount - 1;
+    Ring->CompletionMask = CompletionEntryCount - 1;
+    Ring->PendingSubmissionTail = 0;
+    Ring->Reserved = 0;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoServiceRingQueryRegionSize(
+    _Mo_Out_ PMO_UINTN RegionSize,
+    _Mo_In_ MO_UINT32 SubmissionEntryCount,
+    _Mo_In_ MO_UINT32 CompletionEntryCount)
+{
+    if (!RegionSize)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MO_UINT32 CompletionOffset = 0;
+    return MoServiceRingGetLayout(
+        &CompletionOffset,
+        RegionSize,
+        SubmissionEntryCount,
+        CompletionEntryCount);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoServiceRingCreate(
+    _Mo_Out_ PMO_SERVICE_RING Ring,
+    _Mo_Out_ MO_POINTER Region,
+    _Mo_In_ MO_UINTN RegionSize,
+    _Mo_In_ MO_UINT32 SubmissionEntryCount,
+    _Mo_In_ MO_UINT32 CompletionEntryCount)
+{
+    if (!Ring ||
+        !Region ||
+        ((MO_UINTN)Region & (MO_SYNCHRONIZATION_CACHE_LINE_SIZE - 1)))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MO_UINT32 CompletionOffset = 0;
+    MO_UINTN RequiredSize = 0;
+    MO_RESULT Result = MoServiceRingGetLayout(
+        &CompletionOffset,
+        &RequiredSize,
+        SubmissionEntryCount,
+        CompletionEntryCount);
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+    if (RegionSize < RequiredSize)
+    {
+        return MO_RESULT_ERROR_OUT_OF_BOUNDS;
+    }
+
+    MoRuntimeMemoryFillByte(Region, 0, RequiredSize);
+
+    PMO_SERVICE_RING_HEADER Header = (PMO_SERVICE_RING_HEADER)Region;
+    Header->SubmissionEntryCount = SubmissionEntryCount;
+    Header->CompletionEntryCount = CompletionEntryCount;
+    Header->SubmissionOffset = sizeof(MO_SERVICE_RING_HEADER);
+    Header->CompletionOffset = CompletionOffset;
+
+    // The signature is published last, so the session never attaches to the
+    // region which is being initialized.
+    MoAtomicStore32(
+        &Header->Signature,
+        MO_SERVICE_RING_SIGNATURE,
+        MO_ATOMIC_ORDER_RELEASE);
+
+    MoServiceRingInitializeView(
+        Ring,
+        Header,
+        SubmissionEntryCount,
+        CompletionEntryCount,
+        CompletionOffset);
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoServiceRingAttach(
+    _Mo_Out_ PMO_SERVICE_RING Ring,
+    _Mo_In_ MO_POINTER Region,
+    _Mo_In_ MO_UINTN RegionSize)
+{
+    if (!Ring || !Region || RegionSize < sizeof(MO_SERVICE_RING_HEADER))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    PMO_SERVICE_RING_HEADER Header = (PMO_SERVICE_RING_HEADER)Region;
+    if (MO_SERVICE_RING_SIGNATURE != MoAtomicLoad32(
+        &Header->Signature,
+        MO_ATOMIC_ORDER_ACQUIRE))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    // Validate the layout again instead of trusting the header.
+    MO_UINT32 CompletionOffset = 0;
+    MO_UINTN RequiredSize = 0;
+    if (MO_RESULT_SUCCESS_OK != MoServiceRingGetLayout(
+        &CompletionOffset,
+        &RequiredSize,
+        Header->SubmissionEntryCount,
+        Header->CompletionEntryCount) ||
+        RegionSize < RequiredSize ||
+        Header->SubmissionOffset != sizeof(MO_SERVICE_RING_HEADER) ||
+        Header->CompletionOffset != CompletionOffset)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MoServiceRingInitializeView(
+        Ring,
+        Header,
+        Header->SubmissionEntryCount,
+        Header->CompletionEntryCount,
+        CompletionOffset);
+    Ring->PendingSubmissionTail = MoAtomicLoad32(
+        &Header->SubmissionTail,
+        MO_ATOMIC_ORDER_RELAXED);
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C PMO_SERVICE_RING_SUBMISSION MOAPI MoServiceRingGetSubmission(
+    _Mo_InOut_ PMO_SERVICE_RING Ring)
+{
+    MO_UINT32 Head = MoAtomicLoad32(
+        &Ring->Header->SubmissionHead,
+        MO_ATOMIC_ORDER_ACQUIRE);
+    if (Ring->PendingSubmissionTail - Head > Ring->SubmissionMask)
+    {
+        return nullptr;
+    }
+
+    PMO_SERVICE_RING_SUBMISSION Submission =
+        &Ring->Submissions[Ring->PendingSubmissionTail & Ring->SubmissionMask];
+    ++Ring->PendingSubmissionTail;
+    return Submission;
+}
+
+MO_EXTERN_C MO_BOOL MOAPI MoServiceRingSubmit(
+    _Mo_InOut_ PMO_SERVICE_RING Ring)
+{
+    // Pairs with MoServiceRingEnterIdle, which stores the flag before loading
+    // the submission tail.
+    MoAtomicStore32(
+        &Ring->Header->SubmissionTail,
+        Ring->PendingSubmissionTail,
+        MO_ATOMIC_ORDER_SEQUENTIAL);
+    return (MoAtomicLoad32(
+        &Ring->Header->Flags,
+        MO_ATOMIC_ORDER_SEQUENTIAL) & MO_SERVICE_RING_FLAG_NEED_WAKEUP)
+        ? MO_TRUE
+        : MO_FALSE;
+}
+
+MO_EXTERN_C MO_UINT32 MOAPI MoServiceRingReapCompletions(
+    _Mo_InOut_ PMO_SERVICE_RING Ring,
+    _Mo_Out_ PMO_SERVICE_RING_COMPLETION Completions,
+    _Mo_In_ MO_UINT32 MaximumCount)
+{
+    PMO_SERVICE_RING_HEADER Header = Ring->Header;
+    MO_UINT32 Head = MoAtomicLoad32(
+        &Header->CompletionHead,
+        MO_ATOMIC_ORDER_RELAXED);
+    MO_UINT32 Tail = MoAtomicLoad32(
+        &Header->CompletionTail,
+        MO_ATOMIC_ORDER_ACQUIRE);
+
+    MO_UINT32 Count = Tail - Head;
+    if (Count > MaximumCount)
+    {
+        Count = MaximumCount;
+    }
+    for (MO_UINT32 Index = 0; Index < Count; ++Index)
+    {
+        PMO_SERVICE_RING_COMPLETION Completion =
+            &Ring->Completions[(Head + Index) & Ring->CompletionMask];
+        Completions[Index].UserData = Completion->UserData;
+        Completions[Index].Result = Completion->Result;
+    }
+    if (Count)
+    {
+        MoAtomicStore32(
+            &Header->CompletionHead,
+            Head + Count,
+            MO_ATOMIC_ORDER_RELEASE);
+    }
+
+    return Count;
+}
+
+MO_EXTERN_C MO_UINT32 MOAPI MoServiceRingProcess(
+    _Mo_InOut_ PMO_SERVICE_RING Ring,
+    _Mo_In_ PMO_SERVICE_RING_HANDLER* Handlers,
+    _Mo_In_ MO_UINT32 HandlerCount,
+    _Mo_In_Opt_ MO_POINTER Context,
+    _Mo_In_ MO_UINT32 MaximumCount)
+{
+    PMO_SERVICE_RING_HEADER Header = Ring->Header;
+    MO_UINT32 SubmissionHead = MoAtomicLoad32(
+        &Header->SubmissionHead,
+        MO_ATOMIC_ORDER_RELAXED);
+    MO_UINT32 SubmissionTail = MoAtomicLoad32(
+        &Header->SubmissionTail,
+        MO_ATOMIC_ORDER_ACQUIRE);
+    MO_UINT32 CompletionHead = MoAtomicLoad32(
+        &Header->CompletionHead,
+        MO_ATOMIC_ORDER_ACQUIRE);
+    MO_UINT32 CompletionTail = MoAtomicLoad32(
+        &Header->CompletionTail,
+        MO_ATOMIC_ORDER_RELAXED);
+
+    // The indexes written by the session are only used for the counts, which
+    // are clamped to the sizes of the queues.
+    MO_UINT32 Pending = SubmissionTail - SubmissionHead;
+    if (Pending > Ring->SubmissionMask + 1)
+    {
+        Pending = 0;
+    }
+    MO_UINT32 Used = CompletionTail - CompletionHead;
+    MO_UINT32 Free = 0;
+    if (Used <= Ring->CompletionMask + 1)
+    {
+        Free = Ring->CompletionMask + 1 - Used;
+    }
+
+    MO_UINT32 Count = Pending;
+    if (Count > Free)
+    {
+        Count = Free;
+    }
+    if (Count > MaximumCount)
+    {
+        Count = MaximumCount;
+    }
+
+    for (MO_UINT32 Index = 0; Index < Count; ++Index)
+    {
+        PMO_SERVICE_RING_SUBMISSION Shared =
+            &Ring->Submissions[(SubmissionHead + Index) & Ring->SubmissionMask];
+        MO_SERVICE_RING_SUBMISSION Submission;
+        Submission.UserData = Shared->UserData;
+        Submission.Operation = Shared->Operation;
+        Submission.Flags = Shared->Flags;
+        for (MO_UINT32 Argument = 0;
+            Argument < MO_SERVICE_RING_ARGUMENT_COUNT;
+            ++Argument)
+        {
+            Submission.Arguments[Argument] = Shared->Arguments[Argument];
+        }
+        Submission.Reserved = 0;
+
+        MO_UINT64 Result = MO_SERVICE_RING_INVALID_OPERATION;
+        if (Submission.Operation < HandlerCount &&
+            Handlers[Submission.Operation])
+        {
+            Result = Handlers[Submission.Operation](&Submission, Context);
+        }
+
+        PMO_SERVICE_RING_COMPLETION Completion =
+            &Ring->Completions[(CompletionTail + Index) & Ring->CompletionMask];
+        Completion->UserData = Submission.UserData;
+        Completion->Result = Result;
+    }
+
+    if (Count)
+    {
+        MoAtomicStore32(
+            &Header->SubmissionHead,
+            SubmissionHead + Count,
+            MO_ATOMIC_ORDER_RELEASE);
+        MoAtomicStore32(
+            &Header->CompletionTail,
+            CompletionTail + Count,
+            MO_ATOMIC_ORDER_RELEASE);
+    }
+
+    return Count;
+}
+
+MO_EXTERN_C MO_BOOL MOAPI MoServiceRingEnterIdle(
+    _Mo_InOut_ PMO_SERVICE_RING Ring)
+{
+    PMO_SERVICE_RING_HEADER Header = Ring->Header;
+    MoAtomicStore32(
+        &Header->Flags,
+        MO_SERVICE_RING_FLAG_NEED_WAKEUP,
+        MO_ATOMIC_ORDER_SEQUENTIAL);
+    if (MoAtomicLoad32(&Header->SubmissionTail, MO_ATOMIC_ORDER_SEQUENTIAL) !=
+        MoAtomicLoad32(&Header->SubmissionHead, MO_ATOMIC_ORDER_RELAXED))
+    {
+        MoServiceRingLeaveIdle(Ring);
+        return MO_FALSE;
+    }
+    return MO_TRUE;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoServiceRingLeaveIdle(
+    _Mo_InOut_ PMO_SERVICE_RING Ring)
+{
+    MoAtomicStore32(&Ring->Header->Flags, 0, MO_ATOMIC_ORDER_RELAXED);
+}
@@ -0,0 +1,344 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Service.Ring.h
+ * PURPOSE:    Definition for Mobility System Service Submission and Completion
+ *             Rings
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_SERVICE_RING
+#define MOBILITY_SERVICE_RING
+
+#include "Mobility.Synchronization.Atomic.h"
+
+/**
+ * @brief The signature of the shared region, which is "MoSR".
+ */
+#define MO_SERVICE_RING_SIGNATURE 0x52536F4D
+
+/**
+ * @brief Set in the flags of the shared region by the kernel if the polling
+ *        kernel is idle, so the session needs to enter the kernel after
+ *        submitting the requests.
+ */
+#define MO_SERVICE_RING_FLAG_NEED_WAKEUP 0x1
+
+/**
+ * @brief The system call number which wakes up the idle polling kernel after
+ *        MoServiceRingSubmit returns MO_TRUE.
+ * @remarks The kernel puts its wakeup handler at this index of the dispatch
+ *          table passed to MoPlatformSystemCallInitialize. The handler calls
+ *          MoServiceRingLeaveIdle and then MoServiceRingProcess for the ring
+ *          of the calling session, and returns the number of the handled
+ *          requests.
+ */
+#define MO_SERVICE_RING_SYSTEM_CALL_WAKEUP 0
+
+/**
+ * @brief The number of the arguments of a service request.
+ */
+#define MO_SERVICE_RING_ARGUMENT_COUNT 5
+
+/**
+ * @brief The result of the service request whose operation has no handler.
+ */
+#define MO_SERVICE_RING_INVALID_OPERATION 0xFFFFFFFFFFFFFFFFULL
+
+/**
+ * @brief The service request posted by the session.
+ */
+typedef struct _MO_SERVICE_RING_SUBMISSION
+{
+    /**
+     * @brief The value returned in the completion unchanged, for matching the
+     *        request.
+     */
+    MO_UINT64 UserData;
+    /**
+     * @brief The index of the handler in the table passed to
+     *        MoServiceRingProcess.
+     */
+    MO_UINT32 Operation;
+    /**
+     * @brief The flags passed to the handler, which are defined by the
+     *        operation.
+     */
+    MO_UINT32 Flags;
+    /**
+     * @brief The arguments passed to the handler.
+     */
+    MO_UINT64 Arguments[MO_SERVICE_RING_ARGUMENT_COUNT];
+    /**
+     * @brief Reserved bits. Set to 0.
+     */
+    MO_UINT64 Reserved;
+} MO_SERVICE_RING_SUBMISSION, *PMO_SERVICE_RING_SUBMISSION;
+
+MO_C_STATIC_ASSERT(
+    sizeof(MO_SERVICE_RING_SUBMISSION) == MO_SYNCHRONIZATION_CACHE_LINE_SIZE);
+
+/**
+ * @brief The completion of the service request posted by the kernel.
+ */
+typedef struct _MO_SERVICE_RING_COMPLETION
+{
+    /**
+     * @brief The user data of the completed request.
+     */
+    MO_UINT64 UserData;
+    /**
+     * @brief The result returned by the handler, or
+     *        MO_SERVICE_RING_INVALID_OPERATION if the operation has no handler.
+     */
+    MO_UINT64 Result;
+} MO_SERVICE_RING_COMPLETION, *PMO_SERVICE_RING_COMPLETION;
+
+/**
+ * @brief The header at the start of the shared region, which is followed by
+ *        the submission entries and the completion entries. The entries are
+ *        located with the offsets, so the region can be mapped at different
+ *        addresses in the session and the kernel.
+ */
+typedef struct MO_SYNCHRONIZATION_CACHE_LINE_ALIGNED _MO_SERVICE_RING_HEADER
+{
+    /**
+     * @brief MO_SERVICE_RING_SIGNATURE. The members in the first cache line are
+     *        read-only after the initialization.
+     */
+    MO_UINT32 Signature;
+    /**
+     * @brief The number of the submission entries, which is a power of 2.
+     */
+    MO_UINT32 SubmissionEntryCount;
+    /**
+     * @brief The number of the completion entries, which is a power of 2.
+     */
+    MO_UINT32 CompletionEntryCount;
+    /**
+     * @brief The offset in bytes of the submission entries from the header.
+     */
+    MO_UINT32 SubmissionOffset;
+    /**
+     * @brief The offset in bytes of the completion entries from the header.
+     */
+    MO_UINT32 CompletionOffset;
+    /**
+     * @brief Pads the read-only members to their own cache line.
+     */
+    MO_UINT8 Reserved0[MO_SYNCHRONIZATION_CACHE_LINE_SIZE - 20];
+    /**
+     * @brief The index after the last submitted request. Written by the session
+     *        only.
+     */
+    MO_UINT32 volatile SubmissionTail;
+    /**
+     * @brief The index of the first completion not consumed yet. Written by the
+     *        session only.
+     */
+    MO_UINT32 volatile CompletionHead;
+    /**
+     * @brief Pads the members written by the session to their own cache line.
+     */
+    MO_UINT8 Reserved1[MO_SYNCHRONIZATION_CACHE_LINE_SIZE - 8];
+    /**
+     * @brief The index of the first request not processed yet. Written by the
+     *        kernel only.
+     */
+    MO_UINT32 volatile SubmissionHead;
+    /**
+     * @brief The index after the last posted completion. Written by the kernel
+     *        only.
+     */
+    MO_UINT32 volatile CompletionTail;
+    /**
+     * @brief The MO_SERVICE_RING_FLAG_* flags. Written by the kernel only.
+     */
+    MO_UINT32 volatile Flags;
+    /**
+     * @brief Pads the members written by the kernel to their own cache line.
+     */
+    MO_UINT8 Reserved2[MO_SYNCHRONIZATION_CACHE_LINE_SIZE - 12];
+} MO_SERVICE_RING_HEADER, *PMO_SERVICE_RING_HEADER;
+
+MO_C_STATIC_ASSERT(
+    sizeof(MO_SERVICE_RING_HEADER) == 3 * MO_SYNCHRONIZATION_CACHE_LINE_SIZE);
+
+/**
+ * @brief The view of the shared region, which is private to the session or
+ *        the kernel.
+ */
+typedef struct _MO_SERVICE_RING
+{
+    /**
+     * @brief The header of the shared region.
+     */
+    PMO_SERVICE_RING_HEADER Header;
+    /**
+     * @brief The submission entries in the shared region.
+     */
+    PMO_SERVICE_RING_SUBMISSION Submissions;
+    /**
+     * @brief The completion entries in the shared region.
+     */
+    PMO_SERVICE_RING_COMPLETION Completions;
+    /**
+     * @brief The number of the submission entries minus 1.
+     */
+    MO_UINT32 SubmissionMask;
+    /**
+     * @brief The number of the completion entries minus 1.
+     */
+    MO_UINT32 CompletionMask;
+    /**
+     * @brief The submission tail including the entries which are not submitted
+     *        yet, only used by the session.
+     */
+    MO_UINT32 PendingSubmissionTail;
+    /**
+     * @brief Reserved bits. Set to 0.
+     */
+    MO_UINT32 Reserved;
+} MO_SERVICE_RING, *PMO_SERVICE_RING;
+
+/**
+ * @brief The handler of a service operation, called by MoServiceRingProcess.
+ * @param Submission The copy of the service request, so the session cannot
+ *                   change it while it is handled.
+ * @param Context The user-defined context passed to MoServiceRingProcess.
+ * @return The result posted in the completion.
+ */
+typedef MO_UINT64(MOAPI* PMO_SERVICE_RING_HANDLER)(
+    _Mo_In_ PMO_SERVICE_RING_SUBMISSION Submission,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief Queries the size of the shared region.
+ * @param RegionSize The size in bytes of the shared region.
+ * @param SubmissionEntryCount The number of the submission entries, which must
+ *                             be a power of two.
+ * @param CompletionEntryCount The number of the completion entries, which must
+ *                             be a power of two.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The completion entries should be at least as many as the
+ *          submission entries, otherwise a full completion queue stops the
+ *          kernel from processing more requests.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoServiceRingQueryRegionSize(
+    _Mo_Out_ PMO_UINTN RegionSize,
+    _Mo_In_ MO_UINT32 SubmissionEntryCount,
+    _Mo_In_ MO_UINT32 CompletionEntryCount);
+
+/**
+ * @brief Initializes the shared region and the view of the kernel.
+ * @param Ring The view of the kernel.
+ * @param Region The shared region, which must be aligned to the cache line.
+ * @param RegionSize The size in bytes of the shared region, which must not be
+ *                   less than the size from MoServiceRingQueryRegionSize.
+ * @param SubmissionEntryCount The number of the submission entries, which must
+ *                             be a power of two.
+ * @param CompletionEntryCount The number of the completion entries, which must
+ *                             be a power of two.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoServiceRingCreate(
+    _Mo_Out_ PMO_SERVICE_RING Ring,
+    _Mo_Out_ MO_POINTER Region,
+    _Mo_In_ MO_UINTN RegionSize,
+    _Mo_In_ MO_UINT32 SubmissionEntryCount,
+    _Mo_In_ MO_UINT32 CompletionEntryCount);
+
+/**
+ * @brief Initializes the view of the session for the shared region created by
+ *        MoServiceRingCreate.
+ * @param Ring The view of the session.
+ * @param Region The shared region mapped in the session.
+ * @param RegionSize The size in bytes of the mapped shared region.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoServiceRingAttach(
+    _Mo_Out_ PMO_SERVICE_RING Ring,
+    _Mo_In_ MO_POINTER Region,
+    _Mo_In_ MO_UINTN RegionSize);
+
+/**
+ * @brief Acquires the next free submission entry, which is filled by the
+ *        session and posted by MoServiceRingSubmit.
+ * @param Ring The view of the session.
+ * @return The submission entry, or nullptr if the submission queue is full.
+ */
+MO_EXTERN_C PMO_SERVICE_RING_SUBMISSION MOAPI MoServiceRingGetSubmission(
+    _Mo_InOut_ PMO_SERVICE_RING Ring);
+
+/**
+ * @brief Posts all submission entries acquired by MoServiceRingGetSubmission
+ *        to the kernel at once.
+ * @param Ring The view of the session.
+ * @return MO_TRUE if the polling kernel is idle and the session needs to enter
+ *         the kernel with the MO_SERVICE_RING_SYSTEM_CALL_WAKEUP system call,
+ *         MO_FALSE otherwise.
+ */
+MO_EXTERN_C MO_BOOL MOAPI MoServiceRingSubmit(
+    _Mo_InOut_ PMO_SERVICE_RING Ring);
+
+/**
+ * @brief Consumes the posted completions.
+ * @param Ring The view of the session.
+ * @param Completions The buffer which receives the completions.
+ * @param MaximumCount The maximum number of the completions to consume.
+ * @return The number of the consumed completions.
+ */
+MO_EXTERN_C MO_UINT32 MOAPI MoServiceRingReapCompletions(
+    _Mo_InOut_ PMO_SERVICE_RING Ring,
+    _Mo_Out_ PMO_SERVICE_RING_COMPLETION Completions,
+    _Mo_In_ MO_UINT32 MaximumCount);
+
+/**
+ * @brief Handles the posted service requests in a batch, and posts their
+ *        completions.
+ * @param Ring The view of the kernel.
+ * @param Handlers The handler table indexed by the operation. The entries can
+ *                 be nullptr for the unused operations.
+ * @param HandlerCount The number of the entries of the handler table.
+ * @param Context The user-defined context passed to the handlers.
+ * @param MaximumCount The maximum number of the requests to handle.
+ * @return The number of the handled requests.
+ * @remarks The indexes are published once per batch. The function stops
+ *          early if the completion queue is full, and the remaining requests
+ *          are handled in the next call. The indexes written by the session
+ *          are not trusted, so a corrupted region only stops the progress.
+ */
+MO_EXTERN_C MO_UINT32 MOAPI MoServiceRingProcess(
+    _Mo_InOut_ PMO_SERVICE_RING Ring,
+    _Mo_In_ PMO_SERVICE_RING_HANDLER* Handlers,
+    _Mo_In_ MO_UINT32 HandlerCount,
+    _Mo_In_Opt_ MO_POINTER Context,
+    _Mo_In_ MO_UINT32 MaximumCount);
+
+/**
+ * @brief Marks the polling kernel as idle, so the session enters the kernel
+ *        after submitting the requests.
+ * @param Ring The view of the kernel.
+ * @return MO_TRUE if the kernel can stop polling, MO_FALSE if the requests
+ *         were posted meanwhile, in which case the kernel is not marked as
+ *         idle and should keep processing.
+ * @remarks The flag and the submission tail are accessed with the sequential
+ *          order on both sides, so no wakeup is lost.
+ */
+MO_EXTERN_C MO_BOOL MOAPI MoServiceRingEnterIdle(
+    _Mo_InOut_ PMO_SERVICE_RING Ring);
+
+/**
+ * @brief Marks the polling kernel as polling again, so the session does not
+ *        need to enter the kernel after submitting the requests.
+ * @param Ring The view of the kernel.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoServiceRingLeaveIdle(
+    _Mo_InOut_ PMO_SERVICE_RING Ring);
+
+#endif // !MOBILITY_SERVICE_RING
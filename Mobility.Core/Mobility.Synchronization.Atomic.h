@@ -0,0 +1,472 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Synchronization.Atomic.h
+ * PURPOSE:    Definition for Mobility Synchronization atomic operations
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_SYNCHRONIZATION_ATOMIC
+#define MOBILITY_SYNCHRONIZATION_ATOMIC
+
+#include <Mile.Mobility.Portable.Types.h>
+
+#include <Mile.Mobility.Utilities.MemoryAccess.h>
+
+/**
+ * @brief The size in bytes of a cache line, used for padding the shared
+ *        variables to avoid false sharing between the processors.
+ */
+#define MO_SYNCHRONIZATION_CACHE_LINE_SIZE 64
+
+/**
+ * @brief The alignment of the shared variables which need a cache line.
+ */
+#define MO_SYNCHRONIZATION_CACHE_LINE_ALIGNED \
+    MO_DECLSPEC_ALIGN(MO_SYNCHRONIZATION_CACHE_LINE_SIZE)
+
+/**
+ * @brief The memory order of the atomic operations, which has the same
+ *        meaning and the same value as the C11 memory order.
+ */
+typedef enum _MO_ATOMIC_ORDER
+{
+    MO_ATOMIC_ORDER_RELAXED = 0,
+    MO_ATOMIC_ORDER_ACQUIRE = 2,
+    MO_ATOMIC_ORDER_RELEASE = 3,
+    MO_ATOMIC_ORDER_ACQUIRE_RELEASE = 4,
+    MO_ATOMIC_ORDER_SEQUENTIAL = 5,
+} MO_ATOMIC_ORDER, *PMO_ATOMIC_ORDER;
+
+#ifdef _MSC_VER
+
+#ifndef MOBILITY_SYNCHRONIZATION_ATOMIC_PRIVATE
+#define MOBILITY_SYNCHRONIZATION_ATOMIC_PRIVATE
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+long _InterlockedExchange(long volatile*, long);
+long _InterlockedCompareExchange(long volatile*, long, long);
+long _InterlockedExchangeAdd(long volatile*, long);
+long _InterlockedOr(long volatile*, long);
+long _InterlockedAnd(long volatile*, long);
+
+__int64 _InterlockedExchange64(__int64 volatile*, __int64);
+__int64 _InterlockedCompareExchange64(__int64 volatile*, __int64, __int64);
+__int64 _InterlockedExchangeAdd64(__int64 volatile*, __int64);
+
+#if defined(_M_ARM64)
+void __dmb(unsigned int);
+#endif // _M_ARM64
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // !MOBILITY_SYNCHRONIZATION_ATOMIC_PRIVATE
+
+/**
+ * @brief Orders the memory accesses for the plain loads and stores. The x64
+ *        processors never reorder a load with an older load or a store with an
+ *        older store, so only the compiler needs to be restricted.
+ */
+#if defined(_M_ARM64)
+#define MoAtomicInternalFence() __dmb(0xB)
+#else
+#define MoAtomicInternalFence() MoMileCompilerBarrier()
+#endif // _M_ARM64
+
+#endif // _MSC_VER
+
+/**
+ * @brief Loads a 32-bit value atomically.
+ * @param Target The pointer to the 32-bit value.
+ * @param Order The memory order, which must be MO_ATOMIC_ORDER_RELAXED,
+ *              MO_ATOMIC_ORDER_ACQUIRE or MO_ATOMIC_ORDER_SEQUENTIAL.
+ * @return The loaded value.
+ */
+MO_FORCEINLINE MO_UINT32 MoAtomicLoad32(
+    _Mo_In_ MO_UINT32 volatile* Target,
+    _Mo_In_ MO_ATOMIC_ORDER Order)
+{
+#ifdef _MSC_VER
+    MO_UINT32 Value = *Target;
+    if (MO_ATOMIC_ORDER_RELAXED != Order)
+    {
+        MoAtomicInternalFence();
+    }
+    return Value;
+#else
+    return __atomic_load_n(Target, (int)Order);
+#endif // _MSC_VER
+}
+
+/**
+ * @brief Stores a 32-bit value atomically.
+ * @param Target The pointer to the 32-bit value.
+ * @param Value The value to be stored.
+ * @param Order The memory order, which must be MO_ATOMIC_ORDER_RELAXED,
+ *              MO_ATOMIC_ORDER_RELEASE or MO_ATOMIC_ORDER_SEQUENTIAL.
+ */
+MO_FORCEINLINE MO_VOID MoAtomicStore32(
+    _Mo_In_ MO_UINT32 volatile* Target,
+    _Mo_In_ MO_UINT32 Value,
+    _Mo_In_ MO_ATOMIC_ORDER Order)
+{
+#ifdef _MSC_VER
+    if (MO_ATOMIC_ORDER_SEQUENTIAL == Order)
+    {
+        _InterlockedExchange((long volatile*)Target, (long)Value);
+        return;
+    }
+    if (MO_ATOMIC_ORDER_RELAXED != Order)
+    {
+        MoAtomicInternalFence();
+    }
+    *Target = Value;
+#else
+    __atomic_store_n(Target, Value, (int)Order);
+#endif // _MSC_VER
+}
+
+/**
+ * @brief Replaces a 32-bit value atomically.
+ * @param Target The pointer to the 32-bit value.
+ * @param Value The value to be stored.
+ * @param Order The memory order.
+ * @return The previous value.
+ */
+MO_FORCEINLINE MO_UINT32 MoAtomicExchange32(
+    _Mo_In_ MO_UINT32 volatile* Target,
+    _Mo_In_ MO_UINT32 Value,
+    _Mo_In_ MO_ATOMIC_ORDER Order)
+{
+#ifdef _MSC_VER
+    MO_UNREFERENCED_PARAMETER(Order);
+    return (MO_UINT32)_InterlockedExchange(
+        (long volatile*)Target,
+        (long)Value);
+#else
+    return __atomic_exchange_n(Target, Value, (int)Order);
+#endif // _MSC_VER
+}
+
+/**
+ * @brief Replaces a 32-bit value atomically if it equals the expected value.
+ * @param Target The pointer to the 32-bit value.
+ * @param Expected The pointer to the expected value, which receives the
+ *                 current value if the comparison fails.
+ * @param Desired The value to be stored if the comparison succeeds.
+ * @param Order The memory order if the comparison succeeds. The memory order
+ *              if the comparison fails is always MO_ATOMIC_ORDER_RELAXED.
+ * @return MO_TRUE if the value is replaced, MO_FALSE otherwise.
+ */
+MO_FORCEINLINE MO_BOOL MoAtomicCompareExchange32(
+    _Mo_In_ MO_UINT32 volatile* Target,
+    _Mo_InOut_ PMO_UINT32 Expected,
+    _Mo_In_ MO_UINT32 Desired,
+    _Mo_In_ MO_ATOMIC_ORDER Order)
+{
+#ifdef _MSC_VER
+    MO_UNREFERENCED_PARAMETER(Order);
+    MO_UINT32 Current = (MO_UINT32)_InterlockedCompareExchange(
+        (long volatile*)Target,
+        (long)Desired,
+        (long)*Expected);
+    if (Current == *Expected)
+    {
+        return MO_TRUE;
+    }
+    *Expected = Current;
+    return MO_FALSE;
+#else
+    return __atomic_compare_exchange_n(
+        Target,
+        Expected,
+        Desired,
+        0,
+        (int)Order,
+        __ATOMIC_RELAXED) ? MO_TRUE : MO_FALSE;
+#endif // _MSC_VER
+}
+
+/**
+ * @brief Adds to a 32-bit value atomically.
+ * @param Target The pointer to the 32-bit value.
+ * @param Value The value to be added, which wraps around on overflow.
+ * @param Order The memory order.
+ * @return The previous value.
+ */
+MO_FORCEINLINE MO_UINT32 MoAtomicFetchAdd32(
+    _Mo_In_ MO_UINT32 volatile* Target,
+    _Mo_In_ MO_UINT32 Value,
+    _Mo_In_ MO_ATOMIC_ORDER Order)
+{
+#ifdef _MSC_VER
+    MO_UNREFERENCED_PARAMETER(Order);
+    return (MO_UINT32)_InterlockedExchangeAdd(
+        (long volatile*)Target,
+        (long)Value);
+#else
+    return __atomic_fetch_add(Target, Value, (int)Order);
+#endif // _MSC_VER
+}
+
+/**
+ * @brief Performs the bitwise OR to a 32-bit value atomically.
+ * @param Target The pointer to the 32-bit value.
+ * @param Value The bits to be set.
+ * @param Order The memory order.
+ * @return The previous value.
+ */
+MO_FORCEINLINE MO_UINT32 MoAtomicFetchOr32(
+    _Mo_In_ MO_UINT32 volatile* Target,
+    _Mo_In_ MO_UINT32 Value,
+    _Mo_In_ MO_ATOMIC_ORDER Order)
+{
+#ifdef _MSC_VER
+    MO_UNREFERENCED_PARAMETER(Order);
+    return (MO_UINT32)_InterlockedOr((long volatile*)Target, (long)Value);
+#else
+    return __atomic_fetch_or(Target, Value, (int)Order);
+#endif // _MSC_VER
+}
+
+/**
+ * @brief Performs the bitwise AND to a 32-bit value atomically.
+ * @param Target The pointer to the 32-bit value.
+ * @param Value The bits to be kept.
+ * @param Order The memory order.
+ * @return The previous value.
+ */
+MO_FORCEINLINE MO_UINT32 MoAtomicFetchAnd32(
+    _Mo_In_ MO_UINT32 volatile* Target,
+    _Mo_In_ MO_UINT32 Value,
+    _Mo_In_ MO_ATOMIC_ORDER Order)
+{
+#ifdef _MSC_VER
+    MO_UNREFERENCED_PARAMETER(Order);
+    return (MO_UINT32)_InterlockedAnd((long volatile*)Target, (long)Value);
+#else
+    return __atomic_fetch_and(Target, Value, (int)Order);
+#endif // _MSC_VER
+}
+
+/**
+ * @brief Loads a 64-bit value atomically.
+ * @param Target The pointer to the 64-bit value, which must be 8-byte aligned.
+ * @param Order The memory order, which must be MO_ATOMIC_ORDER_RELAXED,
+ *              MO_ATOMIC_ORDER_ACQUIRE or MO_ATOMIC_ORDER_SEQUENTIAL.
+ * @return The loaded value.
+ */
+MO_FORCEINLINE MO_UINT64 MoAtomicLoad64(
+    _Mo_In_ MO_UINT64 volatile* Target,
+    _Mo_In_ MO_ATOMIC_ORDER Order)
+{
+#ifdef _MSC_VER
+    MO_UINT64 Value = *Target;
+    if (MO_ATOMIC_ORDER_RELAXED != Order)
+    {
+        MoAtomicInternalFence();
+    }
+    return Value;
+#else
+    return __atomic_load_n(Target, (int)Order);
+#endif // _MSC_VER
+}
+
+/**
+ * @brief Stores a 64-bit value atomically.
+ * @param Target The pointer to the 64-bit value, which must be 8-byte aligned.
+ * @param Value The value to be stored.
+ * @param Order The memory order, which must be MO_ATOMIC_ORDER_RELAXED,
+ *              MO_ATOMIC_ORDER_RELEASE or MO_ATOMIC_ORDER_SEQUENTIAL.
+ */
+MO_FORCEINLINE MO_VOID MoAtomicStore64(
+    _Mo_In_ MO_UINT64 volatile* Target,
+    _Mo_In_ MO_UINT64 Value,
+    _Mo_In_ MO_ATOMIC_ORDER Order)
+{
+#ifdef _MSC_VER
+    if (MO_ATOMIC_ORDER_SEQUENTIAL == Order)
+    {
+        _InterlockedExchange64((__int64 volatile*)Target, (__int64)Value);
+        return;
+    }
+    if (MO_ATOMIC_ORDER_RELAXED != Order)
+    {
+        MoAtomicInternalFence();
+    }
+    *Target = Value;
+#else
+    __atomic_store_n(Target, Value, (int)Order);
+#endif // _MSC_VER
+}
+
+/**
+ * @brief Replaces a 64-bit value atomically.
+ * @param Target The pointer to the 64-bit value, which must be 8-byte aligned.
+ * @param Value The value to be stored.
+ * @param Order The memory order.
+ * @return The previous value.
+ */
+MO_FORCEINLINE MO_UINT64 MoAtomicExchange64(
+    _Mo_In_ MO_UINT64 volatile* Target,
+    _Mo_In_ MO_UINT64 Value,
+    _Mo_In_ MO_ATOMIC_ORDER Order)
+{
+#ifdef _MSC_VER
+    MO_UNREFERENCED_PARAMETER(Order);
+    return (MO_UINT64)_InterlockedExchange64(
+        (__int64 volatile*)Target,
+        (__int64)Value);
+#else
+    return __atomic_exchange_n(Target, Value, (int)Order);
+#endif // _MSC_VER
+}
+
+/**
+ * @brief Replaces a 64-bit value atomically if it equals the expected value.
+ * @param Target The pointer to the 64-bit value, which must be 8-byte aligned.
+ * @param Expected The pointer to the expected value, which receives the
+ *                 current value if the comparison fails.
+ * @param Desired The value to be stored if the comparison succeeds.
+ * @param Order The memory order if the comparison succeeds. The memory order
+ *              if the comparison fails is always MO_ATOMIC_ORDER_RELAXED.
+ * @return MO_TRUE if the value is replaced, MO_FALSE otherwise.
+ */
+MO_FORCEINLINE MO_BOOL MoAtomicCompareExchange64(
+    _Mo_In_ MO_UINT64 volatile* Target,
+    _Mo_InOut_ PMO_UINT64 Expected,
+    _Mo_In_ MO_UINT64 Desired,
+    _Mo_In_ MO_ATOMIC_ORDER Order)
+{
+#ifdef _MSC_VER
+    MO_UNREFERENCED_PARAMETER(Order);
+    MO_UINT64 Current = (MO_UINT64)_InterlockedCompareExchange64(
+        (__int64 volatile*)Target,
+        (__int64)Desired,
+        (__int64)*Expected);
+    if (Current == *Expected)
+    {
+        return MO_TRUE;
+    }
+    *Expected = Current;
+    return MO_FALSE;
+#else
+    return __atomic_compare_exchange_n(
+        Target,
+        Expected,
+        Desired,
+        0,
+        (int)Order,
+        __ATOMIC_RELAXED) ? MO_TRUE : MO_FALSE;
+#endif // _MSC_VER
+}
+
+/**
+ * @brief Adds to a 64-bit value atomically.
+ * @param Target The pointer to the 64-bit value, which must be 8-byte aligned.
+ * @param Value The value to be added, which wraps around on overflow.
+ * @param Order The memory order.
+ * @return The previous value.
+ */
+MO_FORCEINLINE MO_UINT64 MoAtomicFetchAdd64(
+    _Mo_In_ MO_UINT64 volatile* Target,
+    _Mo_In_ MO_UINT64 Value,
+    _Mo_In_ MO_ATOMIC_ORDER Order)
+{
+#ifdef _MSC_VER
+    MO_UNREFERENCED_PARAMETER(Order);
+    return (MO_UINT64)_InterlockedExchangeAdd64(
+        (__int64 volatile*)Target,
+        (__int64)Value);
+#else
+    return __atomic_fetch_add(Target, Value, (int)Order);
+#endif // _MSC_VER
+}
+
+/**
+ * @brief Loads a pointer atomically.
+ * @param Target The pointer to the pointer.
+ * @param Order The memory order, which must be MO_ATOMIC_ORDER_RELAXED,
+ *              MO_ATOMIC_ORDER_ACQUIRE or MO_ATOMIC_ORDER_SEQUENTIAL.
+ * @return The loaded pointer.
+ * @remarks The pointer variants only support the 64-bit platforms, which are
+ *          all platforms supported by Mobility.
+ */
+MO_FORCEINLINE MO_POINTER MoAtomicLoadPointer(
+    _Mo_In_ MO_POINTER volatile* Target,
+    _Mo_In_ MO_ATOMIC_ORDER Order)
+{
+    return (MO_POINTER)(MO_UINTN)MoAtomicLoad64(
+        (MO_UINT64 volatile*)Target,
+        Order);
+}
+
+/**
+ * @brief Stores a pointer atomically.
+ * @param Target The pointer to the pointer.
+ * @param Value The pointer to be stored.
+ * @param Order The memory order, which must be MO_ATOMIC_ORDER_RELAXED,
+ *              MO_ATOMIC_ORDER_RELEASE or MO_ATOMIC_ORDER_SEQUENTIAL.
+ */
+MO_FORCEINLINE MO_VOID MoAtomicStorePointer(
+    _Mo_In_ MO_POINTER volatile* Target,
+    _Mo_In_Opt_ MO_POINTER Value,
+    _Mo_In_ MO_ATOMIC_ORDER Order)
+{
+    MoAtomicStore64(
+        (MO_UINT64 volatile*)Target,
+        (MO_UINT64)(MO_UINTN)Value,
+        Order);
+}
+
+/**
+ * @brief Replaces a pointer atomically.
+ * @param Target The pointer to the pointer.
+ * @param Value The pointer to be stored.
+ * @param Order The memory order.
+ * @return The previous pointer.
+ */
+MO_FORCEINLINE MO_POINTER MoAtomicExchangePointer(
+    _Mo_In_ MO_POINTER volatile* Target,
+    _Mo_In_Opt_ MO_POINTER Value,
+    _Mo_In_ MO_ATOMIC_ORDER Order)
+{
+    return (MO_POINTER)(MO_UINTN)MoAtomicExchange64(
+        (MO_UINT64 volatile*)Target,
+        (MO_UINT64)(MO_UINTN)Value,
+        Order);
+}
+
+/**
+ * @brief Replaces a pointer atomically if it equals the expected pointer.
+ * @param Target The pointer to the pointer.
+ * @param Expected The pointer to the expected pointer, which receives the
+ *                 current pointer if the comparison fails.
+ * @param Desired The pointer to be stored if the comparison succeeds.
+ * @param Order The memory order if the comparison succeeds. The memory order
+ *              if the comparison fails is always MO_ATOMIC_ORDER_RELAXED.
+ * @return MO_TRUE if the pointer is replaced, MO_FALSE otherwise.
+ */
+MO_FORCEINLINE MO_BOOL MoAtomicCompareExchangePointer(
+    _Mo_In_ MO_POINTER volatile* Target,
+    _Mo_InOut_ PMO_POINTER Expected,
+    _Mo_In_Opt_ MO_POINTER Desired,
+    _Mo_In_ MO_ATOMIC_ORDER Order)
+{
+    return MoAtomicCompareExchange64(
+        (MO_UINT64 volatile*)Target,
+        (PMO_UINT64)Expected,
+        (MO_UINT64)(MO_UINTN)Desired,
+        Order);
+}
+
+MO_C_STATIC_ASSERT(sizeof(MO_POINTER) == sizeof(MO_UINT64));
+
+#endif // !MOBILITY_SYNCHRONIZATION_ATOMIC
@@ -0,0 +1,331 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Synchronization.RingQueue.c
+ * PURPOSE:    Implementation for Mobility Synchronization lock-free ring queues
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Synchronization.RingQueue.h"
+
+#include "Mobility.Runtime.Core.h"
+
+MO_FORCEINLINE MO_BOOL MoRingQueueValidateCapacity(
+    _Mo_In_ MO_UINT32 Capacity)
+{
+    return Capacity &&
+        !(Capacity & (Capacity - 1)) &&
+        Capacity <= MO_RING_QUEUE_MAXIMUM_CAPACITY;
+}
+
+MO_FORCEINLINE MO_VOID MoRingQueueCopyIn(
+    _Mo_In_ PMO_UINT8 Buffer,
+    _Mo_In_ MO_UINT32 Mask,
+    _Mo_In_ MO_UINT32 ElementSize,
+    _Mo_In_ MO_UINT32 Position,
+    _Mo_In_ MO_CONSTANT_POINTER Elements,
+    _Mo_In_ MO_UINT32 Count)
+{
+    MO_UINT32 Index = Position & Mask;
+    MO_UINT32 FirstCount = Mask + 1 - Index;
+    if (FirstCount > Count)
+    {
+        FirstCount = Count;
+    }
+    MoRuntimeMemoryMove(
+        Buffer + ((MO_UINTN)Index * ElementSize),
+        (MO_POINTER)Elements,
+        (MO_UINTN)FirstCount * ElementSize);
+    if (Count > FirstCount)
+    {
+        MoRuntimeMemoryMove(
+            Buffer,
+            (PMO_UINT8)Elements + ((MO_UINTN)FirstCount * ElementSize),
+            (MO_UINTN)(Count - FirstCount) * ElementSize);
+    }
+}
+
+MO_FORCEINLINE MO_VOID MoRingQueueCopyOut(
+    _Mo_In_ PMO_UINT8 Buffer,
+    _Mo_In_ MO_UINT32 Mask,
+    _Mo_In_ MO_UINT32 ElementSize,
+    _Mo_In_ MO_UINT32 Position,
+    _Mo_Out_ MO_POINTER Elements,
+    _Mo_In_ MO_UINT32 Count)
+{
+    MO_UINT32 Index = Position & Mask;
+    MO_UINT32 FirstCount = Mask + 1 - Index;
+    if (FirstCount > Count)
+    {
+        FirstCount = Count;
+    }
+    MoRuntimeMemoryMove(
+        Elements,
+        Buffer + ((MO_UINTN)Index * ElementSize),
+        (MO_UINTN)FirstCount * ElementSize);
+    if (Count > FirstCount)
+    {
+        MoRuntimeMemoryMove(
+            (PMO_UINT8)Elements + ((MO_UINTN)FirstCount * ElementSize),
+            Buffer,
+            (MO_UINTN)(Count - FirstCount) * ElementSize);
+    }
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoSpscRingQueueInitialize(
+    _Mo_Out_ PMO_SPSC_RING_QUEUE Queue,
+    _Mo_In_ MO_POINTER Buffer,
+    _Mo_In_ MO_UINT32 Capacity,
+    _Mo_In_ MO_UINT32 ElementSize)
+{
+    if (!Queue || !Buffer || !ElementSize)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (!MoRingQueueValidateCapacity(Capacity))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MoRuntimeMemoryFillByte(Queue, 0, sizeof(MO_SPSC_RING_QUEUE));
+    Queue->Buffer = (PMO_UINT8)Buffer;
+    Queue->Mask = Capacity - 1;
+    Queue->ElementSize = ElementSize;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_UINT32 MOAPI MoSpscRingQueueEnqueue(
+    _Mo_InOut_ PMO_SPSC_RING_QUEUE Queue,
+    _Mo_In_ MO_CONSTANT_POINTER Elements,
+    _Mo_In_ MO_UINT32 Count)
+{
+    MO_UINT32 Capacity = Queue->Mask + 1;
+    MO_UINT32 Tail = MoAtomicLoad32(&Queue->Tail, MO_ATOMIC_ORDER_RELAXED);
+
+    // Only read the consumer position if the cached one is not enough.
+    MO_UINT32 FreeCount = Capacity - (Tail - Queue->CachedHead);
+    if (FreeCount < Count)
+    {
+        Queue->CachedHead = MoAtomicLoad32(
+            &Queue->Head,
+            MO_ATOMIC_ORDER_ACQUIRE);
+        FreeCount = Capacity - (Tail - Queue->CachedHead);
+    }
+    if (Count > FreeCount)
+    {
+        Count = FreeCount;
+    }
+    if (!Count)
+    {
+        return 0;
+    }
+
+    MoRingQueueCopyIn(
+        Queue->Buffer,
+        Queue->Mask,
+        Queue->ElementSize,
+        Tail,
+        Elements,
+        Count);
+    MoAtomicStore32(&Queue->Tail, Tail + Count, MO_ATOMIC_ORDER_RELEASE);
+
+    return Count;
+}
+
+MO_EXTERN_C MO_UINT32 MOAPI MoSpscRingQueueDequeue(
+    _Mo_InOut_ PMO_SPSC_RING_QUEUE Queue,
+    _Mo_Out_ MO_POINTER Elements,
+    _Mo_In_ MO_UINT32 Count)
+{
+    MO_UINT32 Head = MoAtomicLoad32(&Queue->Head, MO_ATOMIC_ORDER_RELAXED);
+
+    // Only read the producer position if the cached one is not enough.
+    MO_UINT32 UsedCount = Queue->CachedTail - Head;
+    if (UsedCount < Count)
+    {
+        Queue->CachedTail = MoAtomicLoad32(
+            &Queue->Tail,
+            MO_ATOMIC_ORDER_ACQUIRE);
+        UsedCount = Queue->CachedTail - Head;
+    }
+    if (Count > UsedCount)
+    {
+        Count = UsedCount;
+    }
+    if (!Count)
+    {
+        return 0;
+    }
+
+    MoRingQueueCopyOut(
+        Queue->Buffer,
+        Queue->Mask,
+        Queue->ElementSize,
+        Head,
+        Elements,
+        Count);
+    MoAtomicStore32(&Queue->Head, Head + Count, MO_ATOMIC_ORDER_RELEASE);
+
+    return Count;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoMpscRingQueueInitialize(
+    _Mo_Out_ PMO_MPSC_RING_QUEUE Queue,
+    _Mo_In_ MO_POINTER Buffer,
+    _Mo_In_ MO_UINT32 Capacity,
+    _Mo_In_ MO_UINT32 ElementSize)
+{
+    if (!Queue || !Buffer || !ElementSize)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (!MoRingQueueValidateCapacity(Capacity))
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if ((MO_UINTN)Buffer & 7)
+    {
+        return MO_RESULT_ERROR_INVALID_POINTER;
+    }
+
+    MoRuntimeMemoryFillByte(Queue, 0, sizeof(MO_MPSC_RING_QUEUE));
+    Queue->Sequences = (PMO_UINT32)Buffer;
+    Queue->Elements = (PMO_UINT8)Buffer + MO_MPSC_RING_QUEUE_BUFFER_SIZE(
+        Capacity,
+        0);
+    Queue->Mask = Capacity - 1;
+    Queue->ElementSize = ElementSize;
+
+    // The slot is free for the producer at position P if its sequence number
+    // is P, and is published for the consumer if its sequence number is P + 1.
+    for (MO_UINT32 Index = 0; Index < Capacity; ++Index)
+    {
+        MoAtomicStore32(
+            &Queue->Sequences[Index],
+            Index,
+            MO_ATOMIC_ORDER_RELAXED);
+    }
+    MoAtomicStore32(&Queue->EnqueuePosition, 0, MO_ATOMIC_ORDER_RELEASE);
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_UINT32 MOAPI MoMpscRingQueueEnqueue(
+    _Mo_InOut_ PMO_MPSC_RING_QUEUE Queue,
+    _Mo_In_ MO_CONSTANT_POINTER Elements,
+    _Mo_In_ MO_UINT32 Count)
+{
+    if (!Count)
+    {
+        return 0;
+    }
+
+    MO_UINT32 Position = MoAtomicLoad32(
+        &Queue->EnqueuePosition,
+        MO_ATOMIC_ORDER_RELAXED);
+    for (;;)
+    {
+        MO_UINT32 FirstSequence = MoAtomicLoad32(
+            &Queue->Sequences[Position & Queue->Mask],
+            MO_ATOMIC_ORDER_ACQUIRE);
+        MO_INT32 Difference = (MO_INT32)(FirstSequence - Position);
+        if (Difference < 0)
+        {
+            // The consumer has not freed the slot of the last round yet.
+            return 0;
+        }
+        if (Difference > 0)
+        {
+            // Another producer has claimed the slot.
+            Position = MoAtomicLoad32(
+                &Queue->EnqueuePosition,
+                MO_ATOMIC_ORDER_RELAXED);
+            continue;
+        }
+
+        // Only the free slots can be claimed, and they cannot be changed by
+        // others before the claim because the consumer only touches the
+        // published slots.
+        MO_UINT32 FreeCount = 1;
+        while (FreeCount < Count)
+        {
+            MO_UINT32 Sequence = MoAtomicLoad32(
+                &Queue->Sequences[(Position + FreeCount) & Queue->Mask],
+                MO_ATOMIC_ORDER_ACQUIRE);
+            if (Sequence != Position + FreeCount)
+            {
+                break;
+            }
+            ++FreeCount;
+        }
+
+        if (MoAtomicCompareExchange32(
+            &Queue->EnqueuePosition,
+            &Position,
+            Position + FreeCount,
+            MO_ATOMIC_ORDER_RELAXED))
+        {
+            Count = FreeCount;
+            break;
+        }
+    }
+
+    for (MO_UINT32 Offset = 0; Offset < Count; ++Offset)
+    {
+        MO_UINT32 Index = (Position + Offset) & Queue->Mask;
+        MoRuntimeMemoryMove(
+            Queue->Elements + ((MO_UINTN)Index * Queue->ElementSize),
+            (PMO_UINT8)Elements + ((MO_UINTN)Offset * Queue->ElementSize),
+            Queue->ElementSize);
+        MoAtomicStore32(
+            &Queue->Sequences[Index],
+            Position + Offset + 1,
+            MO_ATOMIC_ORDER_RELEASE);
+    }
+
+    return Count;
+}
+
+MO_EXTERN_C MO_UINT32 MOAPI MoMpscRingQueueDequeue(
+    _Mo_InOut_ PMO_MPSC_RING_QUEUE Queue,
+    _Mo_Out_ MO_POINTER Elements,
+    _Mo_In_ MO_UINT32 Count)
+{
+    MO_UINT32 Position = MoAtomicLoad32(
+        &Queue->DequeuePosition,
+        MO_ATOMIC_ORDER_RELAXED);
+
+    MO_UINT32 Offset = 0;
+    for (; Offset < Count; ++Offset)
+    {
+        MO_UINT32 Index = (Position + Offset) & Queue->Mask;
+        MO_UINT32 Sequence = MoAtomicLoad32(
+            &Queue->Sequences[Index],
+            MO_ATOMIC_ORDER_ACQUIRE);
+        if (Sequence != Position + Offset + 1)
+        {
+            break;
+        }
+
+        MoRuntimeMemoryMove(
+            (PMO_UINT8)Elements + ((MO_UINTN)Offset * Queue->ElementSize),
+            Queue->Elements + ((MO_UINTN)Index * Queue->ElementSize),
+            Queue->ElementSize);
+
+        // Free the slot for the producers of the next round.
+        MoAtomicStore32(
+            &Queue->Sequences[Index],
+            Position + Offset + Queue->Mask + 1,
+            MO_ATOMIC_ORDER_RELEASE);
+    }
+
+    MoAtomicStore32(
+        &Queue->DequeuePosition,
+        Position + Offset,
+        MO_ATOMIC_ORDER_RELAXED);
+
+    return Offset;
+}
@@ -0,0 +1,263 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Synchronization.RingQueue.h
+ * PURPOSE:    Definition for Mobility Synchronization lock-free ring queues
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_SYNCHRONIZATION_RINGQUEUE
+#define MOBILITY_SYNCHRONIZATION_RINGQUEUE
+
+#include "Mobility.Synchronization.Atomic.h"
+
+/**
+ * @brief The maximum capacity of the ring queues, which keeps the distance
+ *        between the free-running 32-bit positions comparable.
+ */
+#define MO_RING_QUEUE_MAXIMUM_CAPACITY 0x40000000
+
+/**
+ * @brief The size in bytes of the buffer needed by the single-producer
+ *        single-consumer ring queue.
+ */
+#define MO_SPSC_RING_QUEUE_BUFFER_SIZE(Capacity, ElementSize) \
+    ((MO_UINTN)(Capacity) * (MO_UINTN)(ElementSize))
+
+/**
+ * @brief The size in bytes of the buffer needed by the multiple-producer
+ *        single-consumer ring queue, which has a 32-bit sequence number for
+ *        each slot followed by the 8-byte aligned elements.
+ */
+#define MO_MPSC_RING_QUEUE_BUFFER_SIZE(Capacity, ElementSize) \
+    (((((MO_UINTN)(Capacity) * sizeof(MO_UINT32)) + 7) & ~(MO_UINTN)7) + \
+    ((MO_UINTN)(Capacity) * (MO_UINTN)(ElementSize)))
+
+/**
+ * @brief The lock-free single-producer single-consumer ring queue.
+ * @remarks The producer and the consumer positions are in the separate cache
+ *          lines, and each side caches the position of the other side, so the
+ *          shared cache lines are only touched when the cached position says
+ *          the queue looks full or empty.
+ */
+typedef struct MO_SYNCHRONIZATION_CACHE_LINE_ALIGNED _MO_SPSC_RING_QUEUE
+{
+    /**
+     * @brief The element storage, which is read-only after the
+     *        initialization.
+     */
+    PMO_UINT8 Buffer;
+    /**
+     * @brief The capacity minus one, which is read-only after the
+     *        initialization.
+     */
+    MO_UINT32 Mask;
+    /**
+     * @brief The size in bytes of each element, which is read-only after the
+     *        initialization.
+     */
+    MO_UINT32 ElementSize;
+    /**
+     * @brief Pads the read-only fields to their own cache line.
+     */
+    MO_UINT8 Reserved0[MO_SYNCHRONIZATION_CACHE_LINE_SIZE - 16];
+    /**
+     * @brief The position of the next element to enqueue, which is written by
+     *        the producer only.
+     */
+    MO_UINT32 volatile Tail;
+    /**
+     * @brief The last head observed by the producer, which is written by the
+     *        producer only.
+     */
+    MO_UINT32 CachedHead;
+    /**
+     * @brief Pads the producer fields to their own cache line.
+     */
+    MO_UINT8 Reserved1[MO_SYNCHRONIZATION_CACHE_LINE_SIZE - 8];
+    /**
+     * @brief The position of the next element to dequeue, which is written by
+     *        the consumer only.
+     */
+    MO_UINT32 volatile Head;
+    /**
+     * @brief The last tail observed by the consumer, which is written by the
+     *        consumer only.
+     */
+    MO_UINT32 CachedTail;
+    /**
+     * @brief Pads the consumer fields to their own cache line.
+     */
+    MO_UINT8 Reserved2[MO_SYNCHRONIZATION_CACHE_LINE_SIZE - 8];
+} MO_SPSC_RING_QUEUE, *PMO_SPSC_RING_QUEUE;
+
+MO_C_STATIC_ASSERT(
+    sizeof(MO_SPSC_RING_QUEUE) == 3 * MO_SYNCHRONIZATION_CACHE_LINE_SIZE);
+
+/**
+ * @brief The lock-free multiple-producer single-consumer ring queue, which is
+ *        the bounded queue designed by Dmitry Vyukov with the sequence number
+ *        for each slot.
+ * @remarks A producer claims the slots by advancing the enqueue position, then
+ *          publishes each slot by updating its sequence number, so the
+ *          consumer never sees a slot before its element is written.
+ */
+typedef struct MO_SYNCHRONIZATION_CACHE_LINE_ALIGNED _MO_MPSC_RING_QUEUE
+{
+    /**
+     * @brief The sequence number of each slot, which tells whether the slot
+     *        is free or published. The pointer is read-only after the
+     *        initialization.
+     */
+    PMO_UINT32 Sequences;
+    /**
+     * @brief The element storage, which is read-only after the
+     *        initialization.
+     */
+    PMO_UINT8 Elements;
+    /**
+     * @brief The capacity minus one, which is read-only after the
+     *        initialization.
+     */
+    MO_UINT32 Mask;
+    /**
+     * @brief The size in bytes of each element, which is read-only after the
+     *        initialization.
+     */
+    MO_UINT32 ElementSize;
+    /**
+     * @brief Pads the read-only fields to their own cache line.
+     */
+    MO_UINT8 Reserved0[MO_SYNCHRONIZATION_CACHE_LINE_SIZE - 24];
+    /**
+     * @brief The position of the next slot to claim, which is written by the
+     *        producers.
+     */
+    MO_UINT32 volatile EnqueuePosition;
+    /**
+     * @brief Pads the producer field to its own cache line.
+     */
+    MO_UINT8 Reserved1[MO_SYNCHRONIZATION_CACHE_LINE_SIZE - 4];
+    /**
+     * @brief The position of the next slot to dequeue, which is written by the
+     *        consumer only.
+     */
+    MO_UINT32 volatile DequeuePosition;
+    /**
+     * @brief Pads the consumer field to its own cache line.
+     */
+    MO_UINT8 Reserved2[MO_SYNCHRONIZATION_CACHE_LINE_SIZE - 4];
+} MO_MPSC_RING_QUEUE, *PMO_MPSC_RING_QUEUE;
+
+MO_C_STATIC_ASSERT(
+    sizeof(MO_MPSC_RING_QUEUE) == 3 * MO_SYNCHRONIZATION_CACHE_LINE_SIZE);
+
+/**
+ * @brief Initializes the single-producer single-consumer ring queue.
+ * @param Queue The ring queue to initialize.
+ * @param Buffer The buffer for the elements, which must have at least
+ *               MO_SPSC_RING_QUEUE_BUFFER_SIZE(Capacity, ElementSize) bytes
+ *               and must stay valid while the queue is used.
+ * @param Capacity The maximum number of the elements, which must be a power of
+ *                 two and not greater than MO_RING_QUEUE_MAXIMUM_CAPACITY.
+ * @param ElementSize The size in bytes of each element, which must not be
+ *                    zero.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoSpscRingQueueInitialize(
+    _Mo_Out_ PMO_SPSC_RING_QUEUE Queue,
+    _Mo_In_ MO_POINTER Buffer,
+    _Mo_In_ MO_UINT32 Capacity,
+    _Mo_In_ MO_UINT32 ElementSize);
+
+/**
+ * @brief Enqueues the elements to the single-producer single-consumer ring
+ *        queue.
+ * @param Queue The ring queue.
+ * @param Elements The elements to enqueue, which are copied into the queue.
+ * @param Count The number of the elements to enqueue.
+ * @return The number of the elements enqueued, which is less than Count if the
+ *         queue becomes full.
+ * @remarks Only one producer may call this function at the same time. It does
+ *          not wait and does not need interrupts disabled, so it can be called
+ *          from an interrupt handler which is the only producer.
+ */
+MO_EXTERN_C MO_UINT32 MOAPI MoSpscRingQueueEnqueue(
+    _Mo_InOut_ PMO_SPSC_RING_QUEUE Queue,
+    _Mo_In_ MO_CONSTANT_POINTER Elements,
+    _Mo_In_ MO_UINT32 Count);
+
+/**
+ * @brief Dequeues the elements from the single-producer single-consumer ring
+ *        queue.
+ * @param Queue The ring queue.
+ * @param Elements The buffer to receive the dequeued elements.
+ * @param Count The maximum number of the elements to dequeue.
+ * @return The number of the elements dequeued, which is zero if the queue is
+ *         empty.
+ * @remarks Only one consumer may call this function at the same time.
+ */
+MO_EXTERN_C MO_UINT32 MOAPI MoSpscRingQueueDequeue(
+    _Mo_InOut_ PMO_SPSC_RING_QUEUE Queue,
+    _Mo_Out_ MO_POINTER Elements,
+    _Mo_In_ MO_UINT32 Count);
+
+/**
+ * @brief Initializes the multiple-producer single-consumer ring queue.
+ * @param Queue The ring queue to initialize.
+ * @param Buffer The buffer for the sequence numbers and the elements, which
+ *               must be 8-byte aligned, must have at least
+ *               MO_MPSC_RING_QUEUE_BUFFER_SIZE(Capacity, ElementSize) bytes
+ *               and must stay valid while the queue is used.
+ * @param Capacity The maximum number of the elements, which must be a power of
+ *                 two and not greater than MO_RING_QUEUE_MAXIMUM_CAPACITY.
+ * @param ElementSize The size in bytes of each element, which must not be
+ *                    zero.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoMpscRingQueueInitialize(
+    _Mo_Out_ PMO_MPSC_RING_QUEUE Queue,
+    _Mo_In_ MO_POINTER Buffer,
+    _Mo_In_ MO_UINT32 Capacity,
+    _Mo_In_ MO_UINT32 ElementSize);
+
+/**
+ * @brief Enqueues the elements to the multiple-producer single-consumer ring
+ *        queue.
+ * @param Queue The ring queue.
+ * @param Elements The elements to enqueue, which are copied into the queue.
+ * @param Count The number of the elements to enqueue.
+ * @return The number of the elements enqueued, which is less than Count if the
+ *         queue becomes full.
+ * @remarks The enqueued elements are contiguous in the queue, because all
+ *          slots are claimed by one atomic operation. It does not wait and
+ *          does not need interrupts disabled, so it can be called from the
+ *          interrupt handlers even if they interrupt another producer.
+ */
+MO_EXTERN_C MO_UINT32 MOAPI MoMpscRingQueueEnqueue(
+    _Mo_InOut_ PMO_MPSC_RING_QUEUE Queue,
+    _Mo_In_ MO_CONSTANT_POINTER Elements,
+    _Mo_In_ MO_UINT32 Count);
+
+/**
+ * @brief Dequeues the elements from the multiple-producer single-consumer ring
+ *        queue.
+ * @param Queue The ring queue.
+ * @param Elements The buffer to receive the dequeued elements.
+ * @param Count The maximum number of the elements to dequeue.
+ * @return The number of the elements dequeued, which is zero if the queue is
+ *         empty.
+ * @remarks Only one consumer may call this function at the same time. The
+ *          dequeue stops at the first slot claimed but not yet published by a
+ *          producer, and the following elements are returned by a later call.
+ */
+MO_EXTERN_C MO_UINT32 MOAPI MoMpscRingQueueDequeue(
+    _Mo_InOut_ PMO_MPSC_RING_QUEUE Queue,
+    _Mo_Out_ MO_POINTER Elements,
+    _Mo_In_ MO_UINT32 Count);
+
+#endif // !MOBILITY_SYNCHRONIZATION_RINGQUEUE
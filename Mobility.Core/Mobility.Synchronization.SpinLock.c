@@ -0,0 +1,366 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Synchronization.SpinLock.c
+ * PURPOSE:    Implementation for Mobility Synchronization spin locks
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Synchronization.SpinLock.h"
+
+#include "Mobility.Platform.Interface.h"
+
+MO_FORCEINLINE MO_VOID MoSpinLockBackoff(
+    _Mo_InOut_ PMO_UINT32 Backoff)
+{
+    for (MO_UINT32 Index = 0; Index < *Backoff; ++Index)
+    {
+        MoPlatformPause();
+    }
+    if (*Backoff < MO_SPIN_LOCK_MAXIMUM_BACKOFF)
+    {
+        *Backoff <<= 1;
+    }
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoSpinLockInitialize(
+    _Mo_Out_ PMO_SPIN_LOCK Lock)
+{
+    MoAtomicStore32(&Lock->Value, 0, MO_ATOMIC_ORDER_RELAXED);
+}
+
+MO_EXTERN_C MO_BOOL MOAPI MoSpinLockTryAcquire(
+    _Mo_InOut_ PMO_SPIN_LOCK Lock)
+{
+    // Test before the atomic exchange to keep the cache line shared while the
+    // lock is owned by others.
+    if (MoAtomicLoad32(&Lock->Value, MO_ATOMIC_ORDER_RELAXED))
+    {
+        return MO_FALSE;
+    }
+    return MoAtomicExchange32(&Lock->Value, 1, MO_ATOMIC_ORDER_ACQUIRE)
+        ? MO_FALSE
+        : MO_TRUE;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoSpinLockAcquire(
+    _Mo_InOut_ PMO_SPIN_LOCK Lock)
+{
+    MO_UINT32 Backoff = MO_SPIN_LOCK_MINIMUM_BACKOFF;
+    while (!MoSpinLockTryAcquire(Lock))
+    {
+        MoSpinLockBackoff(&Backoff);
+    }
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoSpinLockRelease(
+    _Mo_InOut_ PMO_SPIN_LOCK Lock)
+{
+    MoAtomicStore32(&Lock->Value, 0, MO_ATOMIC_ORDER_RELEASE);
+}
+
+MO_EXTERN_C MO_UINTN MOAPI MoSpinLockAcquireDisableInterrupts(
+    _Mo_InOut_ PMO_SPIN_LOCK Lock)
+{
+    MO_UINTN InterruptState = MoPlatformSaveAndDisableInterrupts();
+    MoSpinLockAcquire(Lock);
+    return InterruptState;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoSpinLockReleaseRestoreInterrupts(
+    _Mo_InOut_ PMO_SPIN_LOCK Lock,
+    _Mo_In_ MO_UINTN InterruptState)
+{
+    MoSpinLockRelease(Lock);
+    MoPlatformRestoreInterrupts(InterruptState);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoTicketLockInitialize(
+    _Mo_Out_ PMO_TICKET_LOCK Lock)
+{
+    MoAtomicStore32(&Lock->NextTicket, 0, MO_ATOMIC_ORDER_RELAXED);
+    MoAtomicStore32(&Lock->OwnerTicket, 0, MO_ATOMIC_ORDER_RELAXED);
+}
+
+MO_EXTERN_C MO_BOOL MOAPI MoTicketLockTryAcquire(
+    _Mo_InOut_ PMO_TICKET_LOCK Lock)
+{
+    // The lock is free only if no ticket is taken after the owner ticket, so
+    // take the next ticket only in that case.
+    MO_UINT32 OwnerTicket = MoAtomicLoad32(
+        &Lock->OwnerTicket,
+        MO_ATOMIC_ORDER_ACQUIRE);
+    MO_UINT32 NextTicket = OwnerTicket;
+    return MoAtomicCompareExchange32(
+        &Lock->NextTicket,
+        &NextTicket,
+        OwnerTicket + 1,
+        MO_ATOMIC_ORDER_ACQUIRE);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoTicketLockAcquire(
+    _Mo_InOut_ PMO_TICKET_LOCK Lock)
+{
+    MO_UINT32 Ticket = MoAtomicFetchAdd32(
+        &Lock->NextTicket,
+        1,
+        MO_ATOMIC_ORDER_RELAXED);
+    for (;;)
+    {
+        MO_UINT32 OwnerTicket = MoAtomicLoad32(
+            &Lock->OwnerTicket,
+            MO_ATOMIC_ORDER_ACQUIRE);
+        if (Ticket == OwnerTicket)
+        {
+            break;
+        }
+
+        MO_UINT32 Backoff = (Ticket - OwnerTicket) *
+            MO_TICKET_LOCK_BACKOFF_PER_WAITER;
+        if (Backoff > MO_SPIN_LOCK_MAXIMUM_BACKOFF)
+        {
+            Backoff = MO_SPIN_LOCK_MAXIMUM_BACKOFF;
+        }
+        for (MO_UINT32 Index = 0; Index < Backoff; ++Index)
+        {
+            MoPlatformPause();
+        }
+    }
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoTicketLockRelease(
+    _Mo_InOut_ PMO_TICKET_LOCK Lock)
+{
+    // Only the owner writes the owner ticket, so no atomic addition is needed.
+    MO_UINT32 OwnerTicket = MoAtomicLoad32(
+        &Lock->OwnerTicket,
+        MO_ATOMIC_ORDER_RELAXED);
+    MoAtomicStore32(
+        &Lock->OwnerTicket,
+        OwnerTicket + 1,
+        MO_ATOMIC_ORDER_RELEASE);
+}
+
+MO_EXTERN_C MO_UINTN MOAPI MoTicketLockAcquireDisableInterrupts(
+    _Mo_InOut_ PMO_TICKET_LOCK Lock)
+{
+    MO_UINTN InterruptState = MoPlatformSaveAndDisableInterrupts();
+    MoTicketLockAcquire(Lock);
+    return InterruptState;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoTicketLockReleaseRestoreInterrupts(
+    _Mo_InOut_ PMO_TICKET_LOCK Lock,
+    _Mo_In_ MO_UINTN InterruptState)
+{
+    MoTicketLockRelease(Lock);
+    MoPlatformRestoreInterrupts(InterruptState);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoMcsLockInitialize(
+    _Mo_Out_ PMO_MCS_LOCK Lock)
+{
+    MoAtomicStorePointer(
+        (MO_POINTER volatile*)&Lock->Tail,
+        nullptr,
+        MO_ATOMIC_ORDER_RELAXED);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoMcsLockAcquire(
+    _Mo_InOut_ PMO_MCS_LOCK Lock,
+    _Mo_Out_ PMO_MCS_LOCK_NODE Node)
+{
+    MoAtomicStorePointer(
+        (MO_POINTER volatile*)&Node->Next,
+        nullptr,
+        MO_ATOMIC_ORDER_RELAXED);
+    MoAtomicStore32(&Node->Locked, 1, MO_ATOMIC_ORDER_RELAXED);
+
+    PMO_MCS_LOCK_NODE Previous = (PMO_MCS_LOCK_NODE)MoAtomicExchangePointer(
+        (MO_POINTER volatile*)&Lock->Tail,
+        Node,
+        MO_ATOMIC_ORDER_ACQUIRE_RELEASE);
+    if (!Previous)
+    {
+        return;
+    }
+
+    // Link after the previous waiter, then spin on the own node until the
+    // previous waiter hands the lock over.
+    MoAtomicStorePointer(
+        (MO_POINTER volatile*)&Previous->Next,
+        Node,
+        MO_ATOMIC_ORDER_RELEASE);
+    while (MoAtomicLoad32(&Node->Locked, MO_ATOMIC_ORDER_ACQUIRE))
+    {
+        MoPlatformPause();
+    }
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoMcsLockRelease(
+    _Mo_InOut_ PMO_MCS_LOCK Lock,
+    _Mo_InOut_ PMO_MCS_LOCK_NODE Node)
+{
+    PMO_MCS_LOCK_NODE Next = (PMO_MCS_LOCK_NODE)MoAtomicLoadPointer(
+        (MO_POINTER volatile*)&Node->Next,
+        MO_ATOMIC_ORDER_ACQUIRE);
+    if (!Next)
+    {
+        MO_POINTER Expected = Node;
+        if (MoAtomicCompareExchangePointer(
+            (MO_POINTER volatile*)&Lock->Tail,
+            &Expected,
+            nullptr,
+            MO_ATOMIC_ORDER_RELEASE))
+        {
+            return;
+        }
+
+        // A new waiter has swapped the tail but has not linked itself yet.
+        do
+        {
+            MoPlatformPause();
+            Next = (PMO_MCS_LOCK_NODE)MoAtomicLoadPointer(
+                (MO_POINTER volatile*)&Node->Next,
+                MO_ATOMIC_ORDER_ACQUIRE);
+        } while (!Next);
+    }
+
+    MoAtomicStore32(&Next->Locked, 0, MO_ATOMIC_ORDER_RELEASE);
+}
+
+MO_EXTERN_C MO_UINTN MOAPI MoMcsLockAcquireDisableInterrupts(
+    _Mo_InOut_ PMO_MCS_LOCK Lock,
+    _Mo_Out_ PMO_MCS_LOCK_NODE Node)
+{
+    MO_UINTN InterruptState = MoPlatformSaveAndDisableInterrupts();
+    MoMcsLockAcquire(Lock, Node);
+    return InterruptState;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoMcsLockReleaseRestoreInterrupts(
+    _Mo_InOut_ PMO_MCS_LOCK Lock,
+    _Mo_InOut_ PMO_MCS_LOCK_NODE Node,
+    _Mo_In_ MO_UINTN InterruptState)
+{
+    MoMcsLockRelease(Lock, Node);
+    MoPlatformRestoreInterrupts(InterruptState);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoReadWriteLockInitialize(
+    _Mo_Out_ PMO_READ_WRITE_LOCK Lock)
+{
+    MoAtomicStore32(&Lock->State, 0, MO_ATOMIC_ORDER_RELAXED);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoReadWriteLockAcquireShared(
+    _Mo_InOut_ PMO_READ_WRITE_LOCK Lock)
+{
+    MO_UINT32 Backoff = MO_SPIN_LOCK_MINIMUM_BACKOFF;
+    for (;;)
+    {
+        MO_UINT32 State = MoAtomicLoad32(
+            &Lock->State,
+            MO_ATOMIC_ORDER_RELAXED);
+        if (!(State & (
+            MO_READ_WRITE_LOCK_WRITER | MO_READ_WRITE_LOCK_WRITER_PENDING)))
+        {
+            if (MoAtomicCompareExchange32(
+                &Lock->State,
+                &State,
+                State + 1,
+                MO_ATOMIC_ORDER_ACQUIRE))
+            {
+                break;
+            }
+        }
+        MoSpinLockBackoff(&Backoff);
+    }
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoReadWriteLockReleaseShared(
+    _Mo_InOut_ PMO_READ_WRITE_LOCK Lock)
+{
+    MoAtomicFetchAdd32(
+        &Lock->State,
+        (MO_UINT32)-1,
+        MO_ATOMIC_ORDER_RELEASE);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoReadWriteLockAcquireExclusive(
+    _Mo_InOut_ PMO_READ_WRITE_LOCK Lock)
+{
+    MO_UINT32 Backoff = MO_SPIN_LOCK_MINIMUM_BACKOFF;
+    for (;;)
+    {
+        MO_UINT32 State = MoAtomicLoad32(
+            &Lock->State,
+            MO_ATOMIC_ORDER_RELAXED);
+        if (!(State & (
+            MO_READ_WRITE_LOCK_WRITER | MO_READ_WRITE_LOCK_READER_MASK)))
+        {
+            // Taking the lock also clears the pending bit. Other waiting
+            // writers set it again in their next attempt.
+            if (MoAtomicCompareExchange32(
+                &Lock->State,
+                &State,
+                MO_READ_WRITE_LOCK_WRITER,
+                MO_ATOMIC_ORDER_ACQUIRE))
+            {
+                break;
+            }
+        }
+        else if (!(State & MO_READ_WRITE_LOCK_WRITER_PENDING))
+        {
+            MoAtomicFetchOr32(
+                &Lock->State,
+                MO_READ_WRITE_LOCK_WRITER_PENDING,
+                MO_ATOMIC_ORDER_RELAXED);
+        }
+        MoSpinLockBackoff(&Backoff);
+    }
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoReadWriteLockReleaseExclusive(
+    _Mo_InOut_ PMO_READ_WRITE_LOCK Lock)
+{
+    // Keep the pending bit which may be set by other waiting writers.
+    MoAtomicFetchAnd32(
+        &Lock->State,
+        ~(MO_UINT32)MO_READ_WRITE_LOCK_WRITER,
+        MO_ATOMIC_ORDER_RELEASE);
+}
+
+MO_EXTERN_C MO_UINTN MOAPI MoReadWriteLockAcquireSharedDisableInterrupts(
+    _Mo_InOut_ PMO_READ_WRITE_LOCK Lock)
+{
+    MO_UINTN InterruptState = MoPlatformSaveAndDisableInterrupts();
+    MoReadWriteLockAcquireShared(Lock);
+    return InterruptState;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoReadWriteLockReleaseSharedRestoreInterrupts(
+    _Mo_InOut_ PMO_READ_WRITE_LOCK Lock,
+    _Mo_In_ MO_UINTN InterruptState)
+{
+    MoReadWriteLockReleaseShared(Lock);
+    MoPlatformRestoreInterrupts(InterruptState);
+}
+
+MO_EXTERN_C MO_UINTN MOAPI MoReadWriteLockAcquireExclusiveDisableInterrupts(
+    _Mo_InOut_ PMO_READ_WRITE_LOCK Lock)
+{
+    MO_UINTN InterruptState = MoPlatformSaveAndDisableInterrupts();
+    MoReadWriteLockAcquireExclusive(Lock);
+    return InterruptState;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoReadWriteLockReleaseExclusiveRestoreInterrupts(
+    _Mo_InOut_ PMO_READ_WRITE_LOCK Lock,
+    _Mo_In_ MO_UINTN InterruptState)
+{
+    MoReadWriteLockReleaseExclusive(Lock);
+    MoPlatformRestoreInterrupts(InterruptState);
+}
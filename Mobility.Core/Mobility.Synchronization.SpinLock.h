@@ -0,0 +1,327 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Synchronization.SpinLock.h
+ * PURPOSE:    Definition for Mobility Synchronization spin locks
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_SYNCHRONIZATION_SPINLOCK
+#define MOBILITY_SYNCHRONIZATION_SPINLOCK
+
+#include "Mobility.Synchronization.Atomic.h"
+
+/**
+ * @brief The number of the pause hints for the first backoff of the spin
+ *        locks, which is doubled after each failed attempt.
+ */
+#define MO_SPIN_LOCK_MINIMUM_BACKOFF 1
+
+/**
+ * @brief The maximum number of the pause hints for each backoff of the spin
+ *        locks, which bounds the latency of noticing a released lock.
+ */
+#define MO_SPIN_LOCK_MAXIMUM_BACKOFF 1024
+
+/**
+ * @brief The number of the pause hints for each waiter ahead in the ticket
+ *        lock queue.
+ */
+#define MO_TICKET_LOCK_BACKOFF_PER_WAITER 32
+
+/**
+ * @brief The writer bit of the reader-writer spin lock state.
+ */
+#define MO_READ_WRITE_LOCK_WRITER 0x80000000
+
+/**
+ * @brief The pending writer bit of the reader-writer spin lock state, which
+ *        blocks the new readers until a waiting writer gets the lock.
+ */
+#define MO_READ_WRITE_LOCK_WRITER_PENDING 0x40000000
+
+/**
+ * @brief The mask of the reader count in the reader-writer spin lock state.
+ */
+#define MO_READ_WRITE_LOCK_READER_MASK 0x3FFFFFFF
+
+/**
+ * @brief The test-and-test-and-set spin lock with the exponential backoff.
+ */
+typedef struct _MO_SPIN_LOCK
+{
+    MO_UINT32 volatile Value;
+} MO_SPIN_LOCK, *PMO_SPIN_LOCK;
+
+/**
+ * @brief The ticket spin lock, which grants the lock in the FIFO order.
+ */
+typedef struct _MO_TICKET_LOCK
+{
+    MO_UINT32 volatile NextTicket;
+    MO_UINT32 volatile OwnerTicket;
+} MO_TICKET_LOCK, *PMO_TICKET_LOCK;
+
+/**
+ * @brief The queue node of the MCS lock, which is owned by a waiter from the
+ *        acquisition to the release.
+ * @remarks Each waiter spins on its own node only, so the nodes are aligned to
+ *          the cache line to avoid the cross-processor cache line traffic.
+ */
+typedef struct MO_SYNCHRONIZATION_CACHE_LINE_ALIGNED _MO_MCS_LOCK_NODE
+{
+    struct _MO_MCS_LOCK_NODE* volatile Next;
+    MO_UINT32 volatile Locked;
+} MO_MCS_LOCK_NODE, *PMO_MCS_LOCK_NODE;
+
+/**
+ * @brief The MCS queue spin lock, which grants the lock in the FIFO order and
+ *        lets each waiter spin on its own queue node.
+ */
+typedef struct _MO_MCS_LOCK
+{
+    PMO_MCS_LOCK_NODE volatile Tail;
+} MO_MCS_LOCK, *PMO_MCS_LOCK;
+
+/**
+ * @brief The reader-writer spin lock, which prefers the writers.
+ */
+typedef struct _MO_READ_WRITE_LOCK
+{
+    MO_UINT32 volatile State;
+} MO_READ_WRITE_LOCK, *PMO_READ_WRITE_LOCK;
+
+/**
+ * @brief Initializes the spin lock to the released state.
+ * @param Lock The spin lock to initialize.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoSpinLockInitialize(
+    _Mo_Out_ PMO_SPIN_LOCK Lock);
+
+/**
+ * @brief Tries to acquire the spin lock without waiting.
+ * @param Lock The spin lock to acquire.
+ * @return MO_TRUE if the lock is acquired, MO_FALSE otherwise.
+ */
+MO_EXTERN_C MO_BOOL MOAPI MoSpinLockTryAcquire(
+    _Mo_InOut_ PMO_SPIN_LOCK Lock);
+
+/**
+ * @brief Acquires the spin lock.
+ * @param Lock The spin lock to acquire.
+ * @remarks The waiters only read the lock until it looks released, and pause
+ *          for an exponentially growing time after each failed attempt, so the
+ *          contended lock does not saturate the cache coherence traffic.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoSpinLockAcquire(
+    _Mo_InOut_ PMO_SPIN_LOCK Lock);
+
+/**
+ * @brief Releases the spin lock.
+ * @param Lock The spin lock to release.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoSpinLockRelease(
+    _Mo_InOut_ PMO_SPIN_LOCK Lock);
+
+/**
+ * @brief Disables interrupts and acquires the spin lock.
+ * @param Lock The spin lock to acquire.
+ * @return The interrupt state, which should be passed to
+ *         MoSpinLockReleaseRestoreInterrupts.
+ * @remarks Use this variant if the lock is also acquired by the interrupt
+ *          handlers, or the handler will deadlock on the interrupted owner.
+ */
+MO_EXTERN_C MO_UINTN MOAPI MoSpinLockAcquireDisableInterrupts(
+    _Mo_InOut_ PMO_SPIN_LOCK Lock);
+
+/**
+ * @brief Releases the spin lock and restores the interrupt state.
+ * @param Lock The spin lock to release.
+ * @param InterruptState The interrupt state returned by
+ *                       MoSpinLockAcquireDisableInterrupts.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoSpinLockReleaseRestoreInterrupts(
+    _Mo_InOut_ PMO_SPIN_LOCK Lock,
+    _Mo_In_ MO_UINTN InterruptState);
+
+/**
+ * @brief Initializes the ticket lock to the released state.
+ * @param Lock The ticket lock to initialize.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoTicketLockInitialize(
+    _Mo_Out_ PMO_TICKET_LOCK Lock);
+
+/**
+ * @brief Tries to acquire the ticket lock without waiting.
+ * @param Lock The ticket lock to acquire.
+ * @return MO_TRUE if the lock is acquired, MO_FALSE otherwise.
+ */
+MO_EXTERN_C MO_BOOL MOAPI MoTicketLockTryAcquire(
+    _Mo_InOut_ PMO_TICKET_LOCK Lock);
+
+/**
+ * @brief Acquires the ticket lock.
+ * @param Lock The ticket lock to acquire.
+ * @remarks The waiters pause in proportion to the number of the waiters ahead
+ *          of them, because the owner ticket only advances by one per release.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoTicketLockAcquire(
+    _Mo_InOut_ PMO_TICKET_LOCK Lock);
+
+/**
+ * @brief Releases the ticket lock.
+ * @param Lock The ticket lock to release.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoTicketLockRelease(
+    _Mo_InOut_ PMO_TICKET_LOCK Lock);
+
+/**
+ * @brief Disables interrupts and acquires the ticket lock.
+ * @param Lock The ticket lock to acquire.
+ * @return The interrupt state, which should be passed to
+ *         MoTicketLockReleaseRestoreInterrupts.
+ */
+MO_EXTERN_C MO_UINTN MOAPI MoTicketLockAcquireDisableInterrupts(
+    _Mo_InOut_ PMO_TICKET_LOCK Lock);
+
+/**
+ * @brief Releases the ticket lock and restores the interrupt state.
+ * @param Lock The ticket lock to release.
+ * @param InterruptState The interrupt state returned by
+ *                       MoTicketLockAcquireDisableInterrupts.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoTicketLockReleaseRestoreInterrupts(
+    _Mo_InOut_ PMO_TICKET_LOCK Lock,
+    _Mo_In_ MO_UINTN InterruptState);
+
+/**
+ * @brief Initializes the MCS lock to the released state.
+ * @param Lock The MCS lock to initialize.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoMcsLockInitialize(
+    _Mo_Out_ PMO_MCS_LOCK Lock);
+
+/**
+ * @brief Acquires the MCS lock.
+ * @param Lock The MCS lock to acquire.
+ * @param Node The queue node of the caller, which must stay valid and must not
+ *             be used by others until the paired MoMcsLockRelease returns.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoMcsLockAcquire(
+    _Mo_InOut_ PMO_MCS_LOCK Lock,
+    _Mo_Out_ PMO_MCS_LOCK_NODE Node);
+
+/**
+ * @brief Releases the MCS lock and hands it to the next waiter if any.
+ * @param Lock The MCS lock to release.
+ * @param Node The queue node passed to the paired MoMcsLockAcquire.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoMcsLockRelease(
+    _Mo_InOut_ PMO_MCS_LOCK Lock,
+    _Mo_InOut_ PMO_MCS_LOCK_NODE Node);
+
+/**
+ * @brief Disables interrupts and acquires the MCS lock.
+ * @param Lock The MCS lock to acquire.
+ * @param Node The queue node of the caller.
+ * @return The interrupt state, which should be passed to
+ *         MoMcsLockReleaseRestoreInterrupts.
+ */
+MO_EXTERN_C MO_UINTN MOAPI MoMcsLockAcquireDisableInterrupts(
+    _Mo_InOut_ PMO_MCS_LOCK Lock,
+    _Mo_Out_ PMO_MCS_LOCK_NODE Node);
+
+/**
+ * @brief Releases the MCS lock and restores the interrupt state.
+ * @param Lock The MCS lock to release.
+ * @param Node The queue node passed to the paired acquisition.
+ * @param InterruptState The interrupt state returned by
+ *                       MoMcsLockAcquireDisableInterrupts.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoMcsLockReleaseRestoreInterrupts(
+    _Mo_InOut_ PMO_MCS_LOCK Lock,
+    _Mo_InOut_ PMO_MCS_LOCK_NODE Node,
+    _Mo_In_ MO_UINTN InterruptState);
+
+/**
+ * @brief Initializes the reader-writer spin lock to the released state.
+ * @param Lock The reader-writer spin lock to initialize.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoReadWriteLockInitialize(
+    _Mo_Out_ PMO_READ_WRITE_LOCK Lock);
+
+/**
+ * @brief Acquires the reader-writer spin lock for the shared access.
+ * @param Lock The reader-writer spin lock to acquire.
+ * @remarks The new readers wait while a writer owns or waits for the lock, so
+ *          the writers are not starved by a continuous stream of readers.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoReadWriteLockAcquireShared(
+    _Mo_InOut_ PMO_READ_WRITE_LOCK Lock);
+
+/**
+ * @brief Releases the shared access of the reader-writer spin lock.
+ * @param Lock The reader-writer spin lock to release.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoReadWriteLockReleaseShared(
+    _Mo_InOut_ PMO_READ_WRITE_LOCK Lock);
+
+/**
+ * @brief Acquires the reader-writer spin lock for the exclusive access.
+ * @param Lock The reader-writer spin lock to acquire.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoReadWriteLockAcquireExclusive(
+    _Mo_InOut_ PMO_READ_WRITE_LOCK Lock);
+
+/**
+ * @brief Releases the exclusive access of the reader-writer spin lock.
+ * @param Lock The reader-writer spin lock to release.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoReadWriteLockReleaseExclusive(
+    _Mo_InOut_ PMO_READ_WRITE_LOCK Lock);
+
+/**
+ * @brief Disables interrupts and acquires the reader-writer spin lock for the
+ *        shared access.
+ * @param Lock The reader-writer spin lock to acquire.
+ * @return The interrupt state, which should be passed to
+ *         MoReadWriteLockReleaseSharedRestoreInterrupts.
+ */
+MO_EXTERN_C MO_UINTN MOAPI MoReadWriteLockAcquireSharedDisableInterrupts(
+    _Mo_InOut_ PMO_READ_WRITE_LOCK Lock);
+
+/**
+ * @brief Releases the shared access of the reader-writer spin lock and
+ *        restores the interrupt state.
+ * @param Lock The reader-writer spin lock to release.
+ * @param InterruptState The interrupt state returned by
+ *                       MoReadWriteLockAcquireSharedDisableInterrupts.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoReadWriteLockReleaseSharedRestoreInterrupts(
+    _Mo_InOut_ PMO_READ_WRITE_LOCK Lock,
+    _Mo_In_ MO_UINTN InterruptState);
+
+/**
+ * @brief Disables interrupts and acquires the reader-writer spin lock for the
+ *        exclusive access.
+ * @param Lock The reader-writer spin lock to acquire.
+ * @return The interrupt state, which should be passed to
+ *         MoReadWriteLockReleaseExclusiveRestoreInterrupts.
+ */
+MO_EXTERN_C MO_UINTN MOAPI MoReadWriteLockAcquireExclusiveDisableInterrupts(
+    _Mo_InOut_ PMO_READ_WRITE_LOCK Lock);
+
+/**
+ * @brief Releases the exclusive access of the reader-writer spin lock and
+ *        restores the interrupt state.
+ * @param Lock The reader-writer spin lock to release.
+ * @param InterruptState The interrupt state returned by
+ *                       MoReadWriteLockAcquireExclusiveDisableInterrupts.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoReadWriteLockReleaseExclusiveRestoreInterrupts(
+    _Mo_InOut_ PMO_READ_WRITE_LOCK Lock,
+    _Mo_In_ MO_UINTN InterruptState);
+
+#endif // !MOBILITY_SYNCHRONIZATION_SPINLOCK
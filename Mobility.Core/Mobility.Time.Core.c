@@ -0,0 +1,473 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Time.Core.c
+ * PURPOSE:    Implementation for Mobility Time Core
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Time.Core.h"
+
+#include "Mobility.Synchronization.Atomic.h"
+
+/**
+ * @brief The number of the measurements used by the frequency calibration.
+ */
+#define MO_TIME_CALIBRATION_ATTEMPTS 5
+
+/**
+ * @brief The maximum number of the reads for waiting the reference clock
+ *        source to advance during the frequency calibration.
+ */
+#define MO_TIME_CALIBRATION_MAXIMUM_SPINS 0x1000000
+
+/**
+ * @brief The global state of the monotonic time.
+ * @remarks The members after the sequence are protected by the sequence lock,
+ *          so the readers never write the shared state.
+ */
+typedef struct _MO_TIME_CORE_STATE
+{
+    /**
+     * @brief The sequence of the updates, which is odd while an update is in
+     *        progress. The readers retry if the sequence is odd or changed
+     *        while reading.
+     */
+    MO_UINT32 volatile Sequence;
+    /**
+     * @brief The registered clock sources sorted by the rating descending.
+     */
+    PMO_TIME_CLOCK_SOURCE ClockSources;
+    /**
+     * @brief The current clock source.
+     */
+    PMO_TIME_CLOCK_SOURCE Current;
+    /**
+     * @brief The counter value of the current clock source which has been
+     *        accumulated.
+     */
+    MO_UINT64 LastCycles;
+    /**
+     * @brief The accumulated monotonic time in nanoseconds.
+     */
+    MO_UINT64 Nanoseconds;
+    /**
+     * @brief The accumulated fraction of nanoseconds shifted left by the shift
+     *        of the current clock source, so no precision is lost across the
+     *        accumulations.
+     */
+    MO_UINT64 Fraction;
+} MO_TIME_CORE_STATE, *PMO_TIME_CORE_STATE;
+
+static MO_TIME_CORE_STATE MoTimeCoreState;
+
+/**
+ * @brief Calculates (Value * Numerator) / Denominator without the overflow of
+ *        the intermediate product, as long as Denominator * Numerator fits in
+ *        64 bits.
+ */
+MO_FORCEINLINE MO_UINT64 MoTimeMultiplyDivide(
+    _Mo_In_ MO_UINT64 Value,
+    _Mo_In_ MO_UINT64 Numerator,
+    _Mo_In_ MO_UINT64 Denominator)
+{
+    MO_UINT64 Quotient = Value / Denominator;
+    MO_UINT64 Remainder = Value % Denominator;
+    return Quotient * Numerator + (Remainder * Numerator) / Denominator;
+}
+
+/**
+ * @brief Tries to start an update of the state by making the sequence odd.
+ * @return MO_TRUE if the update is started, MO_FALSE if another update is in
+ *         progress.
+ */
+MO_FORCEINLINE MO_BOOL MoTimeTryBeginUpdate(
+    _Mo_In_ PMO_TIME_CORE_STATE State)
+{
+    MO_UINT32 Sequence = MoAtomicLoad32(
+        &State->Sequence,
+        MO_ATOMIC_ORDER_RELAXED);
+    if (Sequence & 1)
+    {
+        return MO_FALSE;
+    }
+    return MoAtomicCompareExchange32(
+        &State->Sequence,
+        &Sequence,
+        Sequence + 1,
+        MO_ATOMIC_ORDER_ACQUIRE);
+}
+
+/**
+ * @brief Ends the update of the state by making the sequence even, which
+ *        publishes the updated members to the readers.
+ */
+MO_FORCEINLINE MO_VOID MoTimeEndUpdate(
+    _Mo_In_ PMO_TIME_CORE_STATE State)
+{
+    MoAtomicStore32(
+        &State->Sequence,
+        State->Sequence + 1,
+        MO_ATOMIC_ORDER_RELEASE);
+}
+
+/**
+ * @brief Converts the cycles elapsed since the last accumulation to
+ *        nanoseconds, including the accumulated fraction, so the readers get
+ *        the same result as the next accumulation.
+ * @param Fraction The accumulated fraction, which receives the new fraction.
+ */
+MO_FORCEINLINE MO_UINT64 MoTimeConvertElapsedCycles(
+    _Mo_In_ PMO_TIME_CLOCK_SOURCE Source,
+    _Mo_In_ MO_UINT64 Cycles,
+    _Mo_InOut_ PMO_UINT64 Fraction)
+{
+    if (Cycles > Source->MaximumCycles)
+    {
+        return MoTimeConvertCyclesToNanoseconds(Source, Cycles);
+    }
+
+    MO_UINT64 FractionMask = (1ULL << Source->Shift) - 1;
+    MO_UINT64 Scaled = Cycles * Source->Multiplier;
+    MO_UINT64 Nanoseconds = Scaled >> Source->Shift;
+    *Fraction += Scaled & FractionMask;
+    Nanoseconds += *Fraction >> Source->Shift;
+    *Fraction &= FractionMask;
+    return Nanoseconds;
+}
+
+/**
+ * @brief Accumulates the elapsed cycles of the current clock source since the
+ *        last accumulation to the monotonic time. The caller must own the
+ *        update of the state.
+ */
+MO_FORCEINLINE MO_VOID MoTimeAccumulate(
+    _Mo_In_ PMO_TIME_CORE_STATE State)
+{
+    PMO_TIME_CLOCK_SOURCE Source = State->Current;
+
+    MO_UINT64 Now = Source->Read(Source->Context);
+    MO_UINT64 Cycles = (Now - State->LastCycles) & Source->Mask;
+    MO_UINT64 Fraction = State->Fraction;
+    MO_UINT64 Nanoseconds = State->Nanoseconds + MoTimeConvertElapsedCycles(
+        Source,
+        Cycles,
+        &Fraction);
+
+    MoAtomicStore64(&State->LastCycles, Now, MO_ATOMIC_ORDER_RELAXED);
+    MoAtomicStore64(&State->Nanoseconds, Nanoseconds, MO_ATOMIC_ORDER_RELAXED);
+    MoAtomicStore64(&State->Fraction, Fraction, MO_ATOMIC_ORDER_RELAXED);
+}
+
+/**
+ * @brief Selects the clock source as the current clock source, and the
+ *        monotonic time continues from the value accumulated before. The
+ *        caller must own the update of the state.
+ */
+MO_FORCEINLINE MO_VOID MoTimeSelectClockSource(
+    _Mo_In_ PMO_TIME_CORE_STATE State,
+    _Mo_In_ PMO_TIME_CLOCK_SOURCE Source)
+{
+    if (State->Current)
+    {
+        MoTimeAccumulate(State);
+    }
+    MoAtomicStorePointer(
+        (MO_POINTER volatile*)&State->Current,
+        Source,
+        MO_ATOMIC_ORDER_RELAXED);
+    MoAtomicStore64(
+        &State->LastCycles,
+        Source->Read(Source->Context),
+        MO_ATOMIC_ORDER_RELAXED);
+    MoAtomicStore64(&State->Fraction, 0u, MO_ATOMIC_ORDER_RELAXED);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoTimeCalculateMultiplierShift(
+    _Mo_Out_ PMO_UINT64 Multiplier,
+    _Mo_Out_ PMO_UINT32 Shift,
+    _Mo_In_ MO_UINT64 Frequency,
+    _Mo_In_ MO_UINT32 MaximumSeconds)
+{
+    if (!Multiplier || !Shift || !Frequency || !MaximumSeconds)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    *Multiplier = 0u;
+    *Shift = 0u;
+
+    if (Frequency > MO_UINT64_MAX / MaximumSeconds)
+    {
+        return MO_RESULT_ERROR_OUT_OF_BOUNDS;
+    }
+
+    // The cycles of the maximum interval take some bits of the product, and
+    // the multiplier can only take the remaining bits.
+    MO_UINT32 AvailableBits = 64;
+    for (MO_UINT64 Cycles = Frequency * MaximumSeconds; Cycles; Cycles >>= 1)
+    {
+        --AvailableBits;
+    }
+
+    // Prefer the largest shift for the best precision. The shift is limited to
+    // 32 bits, so the nanoseconds per second shifted left never overflow.
+    for (MO_UINT32 Candidate = 32; Candidate > 0; --Candidate)
+    {
+        MO_UINT64 Value = MO_TIME_NANOSECONDS_PER_SECOND << Candidate;
+        Value = (Value + (Frequency >> 1)) / Frequency;
+        if (Value && !(Value >> AvailableBits))
+        {
+            *Multiplier = Value;
+            *Shift = Candidate;
+            return MO_RESULT_SUCCESS_OK;
+        }
+    }
+
+    return MO_RESULT_ERROR_OUT_OF_BOUNDS;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoTimeInitializeClockSource(
+    _Mo_InOut_ PMO_TIME_CLOCK_SOURCE Source)
+{
+    if (!Source || !Source->Read || !Source->Frequency || !Source->Mask)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MO_RESULT Result = MoTimeCalculateMultiplierShift(
+        &Source->Multiplier,
+        &Source->Shift,
+        Source->Frequency,
+        MO_TIME_CLOCK_SOURCE_MAXIMUM_SECONDS);
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+    Source->MaximumCycles = MO_UINT64_MAX / Source->Multiplier;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_UINT64 MOAPI MoTimeConvertCyclesToNanoseconds(
+    _Mo_In_ PMO_TIME_CLOCK_SOURCE Source,
+    _Mo_In_ MO_UINT64 Cycles)
+{
+    if (Cycles <= Source->MaximumCycles)
+    {
+        return (Cycles * Source->Multiplier) >> Source->Shift;
+    }
+
+    // The remainder is less than the cycles of one second, which is always
+    // less than the maximum cycles.
+    MO_UINT64 Seconds = Cycles / Source->Frequency;
+    MO_UINT64 Remainder = Cycles % Source->Frequency;
+    return Seconds * MO_TIME_NANOSECONDS_PER_SECOND +
+        ((Remainder * Source->Multiplier) >> Source->Shift);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoTimeRegisterClockSource(
+    _Mo_InOut_ PMO_TIME_CLOCK_SOURCE Source)
+{
+    PMO_TIME_CORE_STATE State = &MoTimeCoreState;
+
+    if (!Source)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    while (!MoTimeTryBeginUpdate(State))
+    {
+        // Wait for the update on another processor.
+    }
+
+    MO_RESULT Result = MO_RESULT_SUCCESS_OK;
+    for (PMO_TIME_CLOCK_SOURCE Current = State->ClockSources;
+        Current;
+        Current = Current->Next)
+    {
+        if (Current == Source)
+        {
+            Result = MO_RESULT_ERROR_INVALID_PARAMETER;
+            break;
+        }
+    }
+    if (MO_RESULT_SUCCESS_OK == Result)
+    {
+        Result = MoTimeInitializeClockSource(Source);
+    }
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        MoTimeEndUpdate(State);
+        return Result;
+    }
+
+    // Keep the list sorted by the rating descending, and the clock sources with
+    // the same rating are kept in the registration order.
+    PMO_TIME_CLOCK_SOURCE* Link = &State->ClockSources;
+    while (*Link && (*Link)->Rating >= Source->Rating)
+    {
+        Link = &(*Link)->Next;
+    }
+    Source->Next = *Link;
+    *Link = Source;
+
+    if (!State->Current || Source->Rating > State->Current->Rating)
+    {
+        MoTimeSelectClockSource(State, Source);
+    }
+
+    MoTimeEndUpdate(State);
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C PMO_TIME_CLOCK_SOURCE MOAPI MoTimeGetCurrentClockSource()
+{
+    return (PMO_TIME_CLOCK_SOURCE)MoAtomicLoadPointer(
+        (MO_POINTER volatile*)&MoTimeCoreState.Current,
+        MO_ATOMIC_ORDER_ACQUIRE);
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoTimeUpdate()
+{
+    PMO_TIME_CORE_STATE State = &MoTimeCoreState;
+
+    if (!MoTimeTryBeginUpdate(State))
+    {
+        // Another processor is accumulating the same elapsed time.
+        return;
+    }
+    if (State->Current)
+    {
+        MoTimeAccumulate(State);
+    }
+    MoTimeEndUpdate(State);
+}
+
+MO_EXTERN_C MO_UINT64 MOAPI MoTimeGetMonotonicNanoseconds()
+{
+    PMO_TIME_CORE_STATE State = &MoTimeCoreState;
+
+    for (;;)
+    {
+        MO_UINT32 Sequence = MoAtomicLoad32(
+            &State->Sequence,
+            MO_ATOMIC_ORDER_ACQUIRE);
+        if (Sequence & 1)
+        {
+            // An update is in progress.
+            continue;
+        }
+
+        // All members are loaded with the acquire order, so none of them can
+        // be reordered after the sequence is loaded again.
+        PMO_TIME_CLOCK_SOURCE Source = (PMO_TIME_CLOCK_SOURCE)
+            MoAtomicLoadPointer(
+                (MO_POINTER volatile*)&State->Current,
+                MO_ATOMIC_ORDER_ACQUIRE);
+        MO_UINT64 LastCycles = MoAtomicLoad64(
+            &State->LastCycles,
+            MO_ATOMIC_ORDER_ACQUIRE);
+        MO_UINT64 Nanoseconds = MoAtomicLoad64(
+            &State->Nanoseconds,
+            MO_ATOMIC_ORDER_ACQUIRE);
+        MO_UINT64 Fraction = MoAtomicLoad64(
+            &State->Fraction,
+            MO_ATOMIC_ORDER_ACQUIRE);
+        if (!Source)
+        {
+            return 0u;
+        }
+
+        MO_UINT64 Now = Source->Read(Source->Context);
+        Nanoseconds += MoTimeConvertElapsedCycles(
+            Source,
+            (Now - LastCycles) & Source->Mask,
+            &Fraction);
+
+        if (Sequence == MoAtomicLoad32(
+            &State->Sequence,
+            MO_ATOMIC_ORDER_ACQUIRE))
+        {
+            return Nanoseconds;
+        }
+    }
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoTimeCalibrateFrequency(
+    _Mo_Out_ PMO_UINT64 Frequency,
+    _Mo_In_ PMO_TIME_CLOCK_SOURCE Target,
+    _Mo_In_ PMO_TIME_CLOCK_SOURCE Reference,
+    _Mo_In_ MO_UINT64 Nanoseconds)
+{
+    if (!Frequency || !Target || !Reference || !Nanoseconds)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    *Frequency = 0u;
+    if (!Target->Read || !Target->Mask)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+    if (!Reference->Read || !Reference->Frequency || !Reference->Mask)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    // The reference counter must not wrap around more than once during each
+    // measurement.
+    MO_UINT64 ReferenceCycles = MoTimeMultiplyDivide(
+        Nanoseconds,
+        Reference->Frequency,
+        MO_TIME_NANOSECONDS_PER_SECOND);
+    if (!ReferenceCycles || ReferenceCycles > (Reference->Mask >> 1))
+    {
+        return MO_RESULT_ERROR_OUT_OF_BOUNDS;
+    }
+
+    MO_UINT64 Results[MO_TIME_CALIBRATION_ATTEMPTS];
+    for (MO_UINTN i = 0; i < MO_TIME_CALIBRATION_ATTEMPTS; ++i)
+    {
+        // Start at the edge of the reference counter, so the quantization error
+        // of the slow reference counters is minimized.
+        MO_UINT64 Previous = Reference->Read(Reference->Context);
+        MO_UINT64 ReferenceStart = Previous;
+        MO_UINTN Spins = 0u;
+        while (ReferenceStart == Previous)
+        {
+            if (++Spins > MO_TIME_CALIBRATION_MAXIMUM_SPINS)
+            {
+                return MO_RESULT_ERROR_UNEXPECTED;
+            }
+            ReferenceStart = Reference->Read(Reference->Context);
+        }
+        MO_UINT64 TargetStart = Target->Read(Target->Context);
+
+        MO_UINT64 ReferenceElapsed = 0u;
+        do
+        {
+            ReferenceElapsed = (Reference->Read(Reference->Context)
+                - ReferenceStart) & Reference->Mask;
+        } while (ReferenceElapsed < ReferenceCycles);
+
+        MO_UINT64 TargetElapsed =
+            (Target->Read(Target->Context) - TargetStart) & Target->Mask;
+
+        // Insert the result in the ascending order.
+        MO_UINT64 Current = MoTimeMultiplyDivide(
+            TargetElapsed,
+            Reference->Frequency,
+            ReferenceElapsed);
+        MO_UINTN Position = i;
+        while (Position && Results[Position - 1] > Current)
+        {
+            Results[Position] = Results[Position - 1];
+            --Position;
+        }
+        Results[Position] = Current;
+    }
+
+    *Frequency = Results[MO_TIME_CALIBRATION_ATTEMPTS / 2];
+    return *Frequency ? MO_RESULT_SUCCESS_OK : MO_RESULT_ERROR_UNEXPECTED;
+}
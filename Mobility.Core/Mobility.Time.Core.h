@@ -0,0 +1,227 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Time.Core.h
+ * PURPOSE:    Definition for Mobility Time Core
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_TIME_CORE
+#define MOBILITY_TIME_CORE
+
+#include <Mile.Mobility.Portable.Types.h>
+
+/**
+ * @brief The number of nanoseconds per second.
+ */
+#define MO_TIME_NANOSECONDS_PER_SECOND 1000000000ULL
+
+/**
+ * @brief The maximum interval in seconds between two reads of a clock source
+ *        which can be converted with the multiply-shift conversion. The longer
+ *        intervals are still converted correctly, but with the slower division.
+ */
+#define MO_TIME_CLOCK_SOURCE_MAXIMUM_SECONDS 600
+
+/*
+ * The ratings of the clock sources. The clock source with the highest rating is
+ * selected as the current clock source.
+ */
+
+/**
+ * @brief The rating of the invariant Time Stamp Counter (TSC), which is the
+ *        cheapest to read and runs at a constant rate.
+ */
+#define MO_TIME_CLOCK_SOURCE_RATING_TIME_STAMP_COUNTER 400
+/**
+ * @brief The rating of the Hyper-V reference TSC page, which needs a few memory
+ *        reads besides reading the Time Stamp Counter (TSC).
+ */
+#define MO_TIME_CLOCK_SOURCE_RATING_HYPERV_REFERENCE_PAGE 350
+/**
+ * @brief The rating of the High Precision Event Timer (HPET), which needs an
+ *        uncached MMIO read.
+ */
+#define MO_TIME_CLOCK_SOURCE_RATING_HIGH_PRECISION_EVENT_TIMER 250
+/**
+ * @brief The rating of the ACPI Power Management Timer, which needs a slow I/O
+ *        port read and has only 24 or 32 bits.
+ */
+#define MO_TIME_CLOCK_SOURCE_RATING_POWER_MANAGEMENT_TIMER 200
+
+/**
+ * @brief The prototype for reading the counter of a clock source.
+ * @param Context The user-defined context of the clock source.
+ * @return The current value of the counter.
+ */
+typedef MO_UINT64(MOAPI* PMO_TIME_CLOCK_SOURCE_READ_ROUTINE)(
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief The free-running counter which can be used for measuring the time.
+ * @remark The Name, Read, Context, Frequency, Mask and Rating members are
+ *         filled by the owner of the clock source, and the other members are
+ *         filled by MoTimeInitializeClockSource or MoTimeRegisterClockSource.
+ *         The clock source must remain valid after it is registered.
+ */
+typedef struct _MO_TIME_CLOCK_SOURCE
+{
+    /**
+     * @brief The next registered clock source with the lower or the same
+     *        rating.
+     */
+    struct _MO_TIME_CLOCK_SOURCE* Next;
+    /**
+     * @brief The name of the clock source.
+     */
+    MO_CONSTANT_STRING Name;
+    /**
+     * @brief The routine for reading the counter.
+     */
+    PMO_TIME_CLOCK_SOURCE_READ_ROUTINE Read;
+    /**
+     * @brief The user-defined context passed to the read routine.
+     */
+    MO_POINTER Context;
+    /**
+     * @brief The frequency of the counter in Hz.
+     */
+    MO_UINT64 Frequency;
+    /**
+     * @brief The mask of the valid bits of the counter, e.g. 0xFFFFFF for the
+     *        24-bit counters. The counter wraps around to zero after the mask.
+     */
+    MO_UINT64 Mask;
+    /**
+     * @brief The rating of the clock source (MO_TIME_CLOCK_SOURCE_RATING_*).
+     */
+    MO_UINT32 Rating;
+    /**
+     * @brief The shift of the multiply-shift conversion.
+     */
+    MO_UINT32 Shift;
+    /**
+     * @brief The multiplier of the multiply-shift conversion, so the elapsed
+     *        nanoseconds are (Cycles * Multiplier) >> Shift.
+     */
+    MO_UINT64 Multiplier;
+    /**
+     * @brief The maximum elapsed cycles which can be converted with the
+     *        multiply-shift conversion without the overflow.
+     */
+    MO_UINT64 MaximumCycles;
+} MO_TIME_CLOCK_SOURCE, *PMO_TIME_CLOCK_SOURCE;
+
+/**
+ * @brief Calculates the multiplier and the shift which convert the cycles of
+ *        the specified frequency to nanoseconds with the multiply-shift
+ *        conversion.
+ * @param Multiplier The pointer to receive the multiplier.
+ * @param Shift The pointer to receive the shift.
+ * @param Frequency The frequency in Hz. It must not be zero.
+ * @param MaximumSeconds The maximum interval in seconds which should be
+ *                       converted without the overflow. The larger interval
+ *                       results in the less precise conversion.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoTimeCalculateMultiplierShift(
+    _Mo_Out_ PMO_UINT64 Multiplier,
+    _Mo_Out_ PMO_UINT32 Shift,
+    _Mo_In_ MO_UINT64 Frequency,
+    _Mo_In_ MO_UINT32 MaximumSeconds);
+
+/**
+ * @brief Initializes the conversion members of a clock source from its
+ *        frequency, so the clock source can be used for the conversion without
+ *        being registered.
+ * @param Source The clock source whose Read, Frequency and Mask members are
+ *               filled.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoTimeInitializeClockSource(
+    _Mo_InOut_ PMO_TIME_CLOCK_SOURCE Source);
+
+/**
+ * @brief Converts the elapsed cycles of a clock source to nanoseconds.
+ * @param Source The initialized clock source.
+ * @param Cycles The elapsed cycles.
+ * @return The elapsed nanoseconds.
+ * @remark The multiply-shift conversion is used if the cycles are not more than
+ *         the MaximumCycles member, and the division is used otherwise.
+ */
+MO_EXTERN_C MO_UINT64 MOAPI MoTimeConvertCyclesToNanoseconds(
+    _Mo_In_ PMO_TIME_CLOCK_SOURCE Source,
+    _Mo_In_ MO_UINT64 Cycles);
+
+/**
+ * @brief Registers a clock source, and selects it as the current clock source
+ *        if its rating is higher than the current one.
+ * @param Source The clock source to be registered.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The monotonic time continues from the value read with the previous
+ *          clock source when the current clock source is switched.
+ *          If the clock source is already registered, the function returns
+ *          MO_RESULT_ERROR_INVALID_PARAMETER.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoTimeRegisterClockSource(
+    _Mo_InOut_ PMO_TIME_CLOCK_SOURCE Source);
+
+/**
+ * @brief Acquires the current clock source.
+ * @return The current clock source, or nullptr if no clock source is
+ *         registered.
+ */
+MO_EXTERN_C PMO_TIME_CLOCK_SOURCE MOAPI MoTimeGetCurrentClockSource();
+
+/**
+ * @brief Accumulates the elapsed cycles of the current clock source to the
+ *        monotonic time.
+ * @remark This function should be called periodically, such as from the timer
+ *         interrupt, at least once per wrap-around period of the current clock
+ *         source, like 4.6 seconds for the 24-bit ACPI Power Management Timer.
+ *         If another processor is updating the monotonic time at the same
+ *         time, the function returns without waiting.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoTimeUpdate();
+
+/**
+ * @brief Acquires the monotonic time in nanoseconds since the first clock
+ *        source is registered.
+ * @return The monotonic time in nanoseconds, or zero if no clock source is
+ *         registered.
+ * @remark The function only reads the shared state protected by a sequence
+ *         lock, so it can be called on all processors at the same time without
+ *         bouncing the cache line of the state. The result is only correct if
+ *         MoTimeUpdate is called at least once per wrap-around period of the
+ *         current clock source.
+ */
+MO_EXTERN_C MO_UINT64 MOAPI MoTimeGetMonotonicNanoseconds();
+
+/**
+ * @brief Measures the frequency of a clock source against a reference clock
+ *        source with the known frequency.
+ * @param Frequency The pointer to receive the measured frequency in Hz.
+ * @param Target The clock source to be measured, whose Read and Mask members
+ *               are filled.
+ * @param Reference The initialized reference clock source.
+ * @param Nanoseconds The duration in nanoseconds of each measurement.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The measurement is repeated several times and the median is used, so
+ *          the occasional interruption by the hypervisor or the SMM does not
+ *          skew the result.
+ *          If the reference clock source does not advance, the function
+ *          returns MO_RESULT_ERROR_UNEXPECTED.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoTimeCalibrateFrequency(
+    _Mo_Out_ PMO_UINT64 Frequency,
+    _Mo_In_ PMO_TIME_CLOCK_SOURCE Target,
+    _Mo_In_ PMO_TIME_CLOCK_SOURCE Reference,
+    _Mo_In_ MO_UINT64 Nanoseconds);
+
+#endif // !MOBILITY_TIME_CORE
@@ -0,0 +1,324 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Time.TimerWheel.c
+ * PURPOSE:    Implementation for Mobility Time hierarchical timer wheel
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#include "Mobility.Time.TimerWheel.h"
+
+#include "Mobility.Runtime.Core.h"
+
+#define MO_TIMER_WHEEL_SLOT_MASK (MO_TIMER_WHEEL_SLOT_COUNT - 1)
+
+/**
+ * @brief The slot index of the timers which have expired and whose routines
+ *        have not been called yet.
+ */
+#define MO_TIMER_WHEEL_EXPIRED_SLOT_INDEX 0xFFFFFFFF
+
+MO_FORCEINLINE MO_UINT32 MoTimerWheelFindLowestSetBit(
+    _Mo_In_ MO_UINT64 Value)
+{
+    // The de Bruijn sequence maps the isolated lowest set bit to a unique
+    // index, which avoids depending on the compiler intrinsics.
+    static const MO_UINT8 Table[64] =
+    {
+        0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+        62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+        63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+        46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6,
+    };
+    return Table[((Value & (0 - Value)) * 0x03F79D71B4CB0A89ULL) >> 58];
+}
+
+MO_FORCEINLINE MO_UINT32 MoTimerWheelGetLevelShift(
+    _Mo_In_ MO_UINT32 Level)
+{
+    return Level * MO_TIMER_WHEEL_SLOT_BITS;
+}
+
+static MO_VOID MoTimerWheelLinkTimer(
+    _Mo_InOut_ PMO_TIMER_WHEEL Wheel,
+    _Mo_InOut_ PMO_TIMER Timer)
+{
+    MO_UINT64 Delta = 0;
+    if (Timer->ExpireTick > Wheel->CurrentTick)
+    {
+        Delta = Timer->ExpireTick - Wheel->CurrentTick;
+    }
+
+    // The timers beyond the range are placed at the end of the range, and
+    // placed again when the slot is reached.
+    MO_UINT64 PlacementTick = Wheel->CurrentTick + Delta;
+    if (Delta >= MO_TIMER_WHEEL_RANGE_TICKS)
+    {
+        Delta = MO_TIMER_WHEEL_RANGE_TICKS - 1;
+        PlacementTick = Wheel->CurrentTick + Delta;
+    }
+
+    MO_UINT32 Level = 0;
+    while (Level < MO_TIMER_WHEEL_LEVEL_COUNT - 1 &&
+        Delta >= (1ULL << MoTimerWheelGetLevelShift(Level + 1)))
+    {
+        ++Level;
+    }
+
+    MO_UINT32 Slot = (MO_UINT32)(
+        PlacementTick >> MoTimerWheelGetLevelShift(Level)) &
+        MO_TIMER_WHEEL_SLOT_MASK;
+
+    PMO_TIMER* Head = &Wheel->Slots[Level][Slot];
+    Timer->Next = *Head;
+    if (Timer->Next)
+    {
+        Timer->Next->PreviousNext = &Timer->Next;
+    }
+    Timer->PreviousNext = Head;
+    *Head = Timer;
+    Timer->SlotIndex = (Level << MO_TIMER_WHEEL_SLOT_BITS) | Slot;
+    Wheel->OccupiedSlots[Level] |= 1ULL << Slot;
+}
+
+static MO_VOID MoTimerWheelUnlinkTimer(
+    _Mo_InOut_ PMO_TIMER_WHEEL Wheel,
+    _Mo_InOut_ PMO_TIMER Timer)
+{
+    *Timer->PreviousNext = Timer->Next;
+    if (Timer->Next)
+    {
+        Timer->Next->PreviousNext = Timer->PreviousNext;
+    }
+
+    if (MO_TIMER_WHEEL_EXPIRED_SLOT_INDEX != Timer->SlotIndex)
+    {
+        MO_UINT32 Level = Timer->SlotIndex >> MO_TIMER_WHEEL_SLOT_BITS;
+        MO_UINT32 Slot = Timer->SlotIndex & MO_TIMER_WHEEL_SLOT_MASK;
+        if (!Wheel->Slots[Level][Slot])
+        {
+            Wheel->OccupiedSlots[Level] &= ~(1ULL << Slot);
+        }
+    }
+
+    Timer->Next = nullptr;
+    Timer->PreviousNext = nullptr;
+}
+
+/**
+ * @brief Detaches all timers in the slot, and clears the occupied bit.
+ */
+static PMO_TIMER MoTimerWheelDetachSlot(
+    _Mo_InOut_ PMO_TIMER_WHEEL Wheel,
+    _Mo_In_ MO_UINT32 Level,
+    _Mo_In_ MO_UINT32 Slot)
+{
+    PMO_TIMER List = Wheel->Slots[Level][Slot];
+    Wheel->Slots[Level][Slot] = nullptr;
+    Wheel->OccupiedSlots[Level] &= ~(1ULL << Slot);
+    return List;
+}
+
+/**
+ * @brief Finds the next tick which has the timers to expire or to move to the
+ *        lower level.
+ */
+static MO_UINT64 MoTimerWheelFindNextEventTick(
+    _Mo_In_ PMO_TIMER_WHEEL Wheel)
+{
+    MO_UINT64 Result = MO_TIMER_WHEEL_NO_DEADLINE;
+
+    for (MO_UINT32 Level = 0; Level < MO_TIMER_WHEEL_LEVEL_COUNT; ++Level)
+    {
+        MO_UINT64 Occupied = Wheel->OccupiedSlots[Level];
+        if (!Occupied)
+        {
+            continue;
+        }
+
+        // The slots of this level are only visited at the multiples of the
+        // level granularity, and each slot is visited once per rotation.
+        MO_UINT32 Shift = MoTimerWheelGetLevelShift(Level);
+        MO_UINT64 Granularity = 1ULL << Shift;
+        MO_UINT64 BaseTick =
+            (Wheel->CurrentTick + Granularity - 1) & ~(Granularity - 1);
+        MO_UINT32 BaseSlot =
+            (MO_UINT32)(BaseTick >> Shift) & MO_TIMER_WHEEL_SLOT_MASK;
+
+        MO_UINT64 Rotated = (Occupied >> BaseSlot);
+        if (BaseSlot)
+        {
+            Rotated |= Occupied << (MO_TIMER_WHEEL_SLOT_COUNT - BaseSlot);
+        }
+        MO_UINT64 Candidate = BaseTick +
+            ((MO_UINT64)MoTimerWheelFindLowestSetBit(Rotated) << Shift);
+        if (Candidate < Result)
+        {
+            Result = Candidate;
+        }
+    }
+
+    return Result;
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoTimerWheelInitialize(
+    _Mo_Out_ PMO_TIMER_WHEEL Wheel,
+    _Mo_In_ MO_UINT32 TickShift,
+    _Mo_In_ MO_UINT64 CurrentNanoseconds)
+{
+    if (!Wheel || TickShift >= 32)
+    {
+        return MO_RESULT_ERROR_INVALID_PARAMETER;
+    }
+
+    MoRuntimeMemoryFillByte(Wheel, 0, sizeof(MO_TIMER_WHEEL));
+    Wheel->TickShift = TickShift;
+    Wheel->CurrentTick = CurrentNanoseconds >> TickShift;
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoTimerInitialize(
+    _Mo_Out_ PMO_TIMER Timer,
+    _Mo_In_ PMO_TIMER_ROUTINE Routine,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    MoRuntimeMemoryFillByte(Timer, 0, sizeof(MO_TIMER));
+    Timer->Routine = Routine;
+    Timer->Context = Context;
+}
+
+MO_EXTERN_C MO_BOOL MOAPI MoTimerIsPending(
+    _Mo_In_ PMO_TIMER Timer)
+{
+    return Timer->PreviousNext ? MO_TRUE : MO_FALSE;
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoTimerWheelInsert(
+    _Mo_InOut_ PMO_TIMER_WHEEL Wheel,
+    _Mo_InOut_ PMO_TIMER Timer,
+    _Mo_In_ MO_UINT64 DeadlineNanoseconds)
+{
+    if (Timer->PreviousNext)
+    {
+        MoTimerWheelUnlinkTimer(Wheel, Timer);
+        --Wheel->PendingCount;
+    }
+
+    // Round up, so the timer never expires before the deadline.
+    MO_UINT64 TickMask = (1ULL << Wheel->TickShift) - 1;
+    MO_UINT64 ExpireTick = DeadlineNanoseconds >> Wheel->TickShift;
+    if (DeadlineNanoseconds & TickMask)
+    {
+        ++ExpireTick;
+    }
+
+    Timer->ExpireTick = ExpireTick;
+    MoTimerWheelLinkTimer(Wheel, Timer);
+    ++Wheel->PendingCount;
+}
+
+MO_EXTERN_C MO_BOOL MOAPI MoTimerWheelCancel(
+    _Mo_InOut_ PMO_TIMER_WHEEL Wheel,
+    _Mo_InOut_ PMO_TIMER Timer)
+{
+    if (!Timer->PreviousNext)
+    {
+        return MO_FALSE;
+    }
+
+    MoTimerWheelUnlinkTimer(Wheel, Timer);
+    --Wheel->PendingCount;
+
+    return MO_TRUE;
+}
+
+MO_EXTERN_C MO_UINT32 MOAPI MoTimerWheelAdvance(
+    _Mo_InOut_ PMO_TIMER_WHEEL Wheel,
+    _Mo_In_ MO_UINT64 CurrentNanoseconds)
+{
+    MO_UINT64 TargetTick = CurrentNanoseconds >> Wheel->TickShift;
+
+    PMO_TIMER* ExpiredTail = &Wheel->ExpiredList;
+    MO_UINT32 ExpiredCount = 0;
+
+    for (;;)
+    {
+        MO_UINT64 EventTick = MoTimerWheelFindNextEventTick(Wheel);
+        if (EventTick > TargetTick)
+        {
+            break;
+        }
+        Wheel->CurrentTick = EventTick;
+
+        // Move the timers in the reached slots of the higher levels to the
+        // lower levels, from the lowest level upwards. They are placed from
+        // the current tick, so they never land in the slots already passed.
+        for (MO_UINT32 Level = 1; Level < MO_TIMER_WHEEL_LEVEL_COUNT; ++Level)
+        {
+            MO_UINT32 Shift = MoTimerWheelGetLevelShift(Level);
+            if (EventTick & ((1ULL << Shift) - 1))
+            {
+                break;
+            }
+
+            MO_UINT32 Slot =
+                (MO_UINT32)(EventTick >> Shift) & MO_TIMER_WHEEL_SLOT_MASK;
+            PMO_TIMER Current = MoTimerWheelDetachSlot(Wheel, Level, Slot);
+            while (Current)
+            {
+                PMO_TIMER Next = Current->Next;
+                MoTimerWheelLinkTimer(Wheel, Current);
+                Current = Next;
+            }
+        }
+
+        MO_UINT32 Slot = (MO_UINT32)EventTick & MO_TIMER_WHEEL_SLOT_MASK;
+        PMO_TIMER Current = MoTimerWheelDetachSlot(Wheel, 0, Slot);
+        while (Current)
+        {
+            PMO_TIMER Next = Current->Next;
+            Current->Next = nullptr;
+            Current->PreviousNext = ExpiredTail;
+            Current->SlotIndex = MO_TIMER_WHEEL_EXPIRED_SLOT_INDEX;
+            *ExpiredTail = Current;
+            ExpiredTail = &Current->Next;
+            ++ExpiredCount;
+            Current = Next;
+        }
+
+        Wheel->CurrentTick = EventTick + 1;
+    }
+
+    if (Wheel->CurrentTick <= TargetTick)
+    {
+        Wheel->CurrentTick = TargetTick + 1;
+    }
+
+    // Each timer is removed from the expired list before its routine is
+    // called, so the routine can insert it again, and can also cancel the
+    // other expired timers whose routines have not been called yet.
+    while (Wheel->ExpiredList)
+    {
+        PMO_TIMER Timer = Wheel->ExpiredList;
+        MoTimerWheelUnlinkTimer(Wheel, Timer);
+        --Wheel->PendingCount;
+        Timer->Routine(Timer, Timer->Context);
+    }
+
+    return ExpiredCount;
+}
+
+MO_EXTERN_C MO_UINT64 MOAPI MoTimerWheelQueryNextDeadline(
+    _Mo_In_ PMO_TIMER_WHEEL Wheel)
+{
+    MO_UINT64 EventTick = MoTimerWheelFindNextEventTick(Wheel);
+    if (MO_TIMER_WHEEL_NO_DEADLINE == EventTick)
+    {
+        return MO_TIMER_WHEEL_NO_DEADLINE;
+    }
+
+    return EventTick << Wheel->TickShift;
+}
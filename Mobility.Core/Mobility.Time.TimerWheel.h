@@ -0,0 +1,237 @@
+﻿/*
+ * PROJECT:    Mobility
+ * FILE:       Mobility.Time.TimerWheel.h
+ * PURPOSE:    Definition for Mobility Time hierarchical timer wheel
+ *
+ * LICENSE:    The MIT License
+ *
+ * MAINTAINER: MouriNaruto (Kenji.Mouri@outlook.com)
+ */
+
+#ifndef MOBILITY_TIME_TIMERWHEEL
+#define MOBILITY_TIME_TIMERWHEEL
+
+#include <Mile.Mobility.Portable.Types.h>
+
+/**
+ * @brief The number of the bits of the slot index in each level.
+ */
+#define MO_TIMER_WHEEL_SLOT_BITS 6
+
+/**
+ * @brief The number of the slots in each level.
+ */
+#define MO_TIMER_WHEEL_SLOT_COUNT (1 << MO_TIMER_WHEEL_SLOT_BITS)
+
+/**
+ * @brief The number of the levels. Each level covers the ticks which are
+ *        MO_TIMER_WHEEL_SLOT_COUNT times as many as the lower level.
+ */
+#define MO_TIMER_WHEEL_LEVEL_COUNT 4
+
+/**
+ * @brief The number of the ticks covered by all levels. The timers which
+ *        expire later are kept in the last slot and moved again when the slot
+ *        is reached.
+ */
+#define MO_TIMER_WHEEL_RANGE_TICKS \
+    (1ULL << (MO_TIMER_WHEEL_SLOT_BITS * MO_TIMER_WHEEL_LEVEL_COUNT))
+
+/**
+ * @brief The default shift of the tick length, which makes a tick 2^20
+ *        nanoseconds (about 1 millisecond), so all levels cover about 4.9
+ *        hours.
+ */
+#define MO_TIMER_WHEEL_DEFAULT_TICK_SHIFT 20
+
+/**
+ * @brief The deadline returned by MoTimerWheelQueryNextDeadline if no timer is
+ *        pending.
+ */
+#define MO_TIMER_WHEEL_NO_DEADLINE 0xFFFFFFFFFFFFFFFFULL
+
+typedef struct _MO_TIMER MO_TIMER, *PMO_TIMER;
+
+/**
+ * @brief The routine called when the timer expires.
+ * @param Timer The expired timer, which can be inserted again by the routine.
+ * @param Context The user-defined context of the timer.
+ */
+typedef MO_VOID(MOAPI* PMO_TIMER_ROUTINE)(
+    _Mo_In_ PMO_TIMER Timer,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief The timer, which is owned by the caller and must stay valid while it
+ *        is pending.
+ */
+struct _MO_TIMER
+{
+    /**
+     * @brief The next timer in the same slot or in the expired batch.
+     */
+    PMO_TIMER Next;
+    /**
+     * @brief The pointer to the member which points to this timer, so the timer
+     *        can be removed without walking the slot. It is nullptr if the
+     *        timer is not pending.
+     */
+    PMO_TIMER* PreviousNext;
+    /**
+     * @brief The tick when the timer expires.
+     */
+    MO_UINT64 ExpireTick;
+    /**
+     * @brief The routine called when the timer expires.
+     */
+    PMO_TIMER_ROUTINE Routine;
+    /**
+     * @brief The user-defined context passed to the routine.
+     */
+    MO_POINTER Context;
+    /**
+     * @brief The index of the slot in all levels, used for maintaining the
+     *        bitmap of the occupied slots, or 0xFFFFFFFF if the timer has
+     *        expired.
+     */
+    MO_UINT32 SlotIndex;
+    /**
+     * @brief Reserved bits. Set to 0.
+     */
+    MO_UINT32 Reserved;
+};
+
+/**
+ * @brief The hierarchical timer wheel.
+ * @remarks The timer wheel is not protected by any lock, so it should be used
+ *          by only one processor, or be protected by the caller.
+ */
+typedef struct _MO_TIMER_WHEEL
+{
+    /**
+     * @brief The singly-linked lists of the pending timers in each slot of each
+     *        level.
+     */
+    PMO_TIMER Slots[MO_TIMER_WHEEL_LEVEL_COUNT][MO_TIMER_WHEEL_SLOT_COUNT];
+    /**
+     * @brief The bit N is set if the slot N of the level is not empty.
+     */
+    MO_UINT64 OccupiedSlots[MO_TIMER_WHEEL_LEVEL_COUNT];
+    /**
+     * @brief The expired timers whose routines have not been called yet.
+     */
+    PMO_TIMER ExpiredList;
+    /**
+     * @brief The next tick which has not been processed.
+     */
+    MO_UINT64 CurrentTick;
+    /**
+     * @brief The number of the pending timers, including the expired timers
+     *        whose routines have not been called yet.
+     */
+    MO_UINT64 PendingCount;
+    /**
+     * @brief The shift of the tick length, so a tick is 2^TickShift
+     *        nanoseconds.
+     */
+    MO_UINT32 TickShift;
+    /**
+     * @brief Reserved bits. Set to 0.
+     */
+    MO_UINT32 Reserved;
+} MO_TIMER_WHEEL, *PMO_TIMER_WHEEL;
+
+/**
+ * @brief Initializes the hierarchical timer wheel.
+ * @param Wheel The timer wheel to initialize.
+ * @param TickShift The shift of the tick length, so a tick is 2^TickShift
+ *                  nanoseconds. It must be less than 32, and the timers expire
+ *                  with the precision of one tick.
+ * @param CurrentNanoseconds The current time in nanoseconds, which is usually
+ *                           the result of MoTimeGetMonotonicNanoseconds.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ */
+MO_EXTERN_C MO_RESULT MOAPI MoTimerWheelInitialize(
+    _Mo_Out_ PMO_TIMER_WHEEL Wheel,
+    _Mo_In_ MO_UINT32 TickShift,
+    _Mo_In_ MO_UINT64 CurrentNanoseconds);
+
+/**
+ * @brief Initializes the timer, which is not pending after initialized.
+ * @param Timer The timer to initialize.
+ * @param Routine The routine called when the timer expires.
+ * @param Context The user-defined context passed to the routine.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoTimerInitialize(
+    _Mo_Out_ PMO_TIMER Timer,
+    _Mo_In_ PMO_TIMER_ROUTINE Routine,
+    _Mo_In_Opt_ MO_POINTER Context);
+
+/**
+ * @brief Checks whether the timer is pending in a timer wheel.
+ * @param Timer The initialized timer.
+ * @return MO_TRUE if the timer is pending, MO_FALSE otherwise.
+ */
+MO_EXTERN_C MO_BOOL MOAPI MoTimerIsPending(
+    _Mo_In_ PMO_TIMER Timer);
+
+/**
+ * @brief Inserts the timer into the timer wheel, or moves the timer if it is
+ *        already pending.
+ * @param Wheel The timer wheel.
+ * @param Timer The initialized timer.
+ * @param DeadlineNanoseconds The time in nanoseconds when the timer expires,
+ *                            in the same time base as the timer wheel.
+ * @remarks The operation takes constant time. The deadline is rounded up to
+ *          the tick, so the timer never expires early, and the timer whose
+ *          deadline has passed expires in the next advance.
+ */
+MO_EXTERN_C MO_VOID MOAPI MoTimerWheelInsert(
+    _Mo_InOut_ PMO_TIMER_WHEEL Wheel,
+    _Mo_InOut_ PMO_TIMER Timer,
+    _Mo_In_ MO_UINT64 DeadlineNanoseconds);
+
+/**
+ * @brief Cancels the pending timer.
+ * @param Wheel The timer wheel which the timer is inserted into.
+ * @param Timer The timer to cancel.
+ * @return MO_TRUE if the timer was pending, MO_FALSE otherwise.
+ * @remarks The operation takes constant time.
+ */
+MO_EXTERN_C MO_BOOL MOAPI MoTimerWheelCancel(
+    _Mo_InOut_ PMO_TIMER_WHEEL Wheel,
+    _Mo_InOut_ PMO_TIMER Timer);
+
+/**
+ * @brief Advances the timer wheel to the current time, and calls the routines
+ *        of all expired timers.
+ * @param Wheel The timer wheel.
+ * @param CurrentNanoseconds The current time in nanoseconds, which is usually
+ *                           the result of MoTimeGetMonotonicNanoseconds.
+ * @return The number of the expired timers.
+ * @remarks The empty slots are skipped with the bitmaps, so advancing after a
+ *          long idle period is cheap. All expired timers are collected before
+ *          any routine is called, so the routines can insert or cancel any
+ *          timer, and the timers inserted by the routines expire in the next
+ *          advance at the earliest. The routines must not advance the timer
+ *          wheel.
+ */
+MO_EXTERN_C MO_UINT32 MOAPI MoTimerWheelAdvance(
+    _Mo_InOut_ PMO_TIMER_WHEEL Wheel,
+    _Mo_In_ MO_UINT64 CurrentNanoseconds);
+
+/**
+ * @brief Queries the time when the timer wheel needs to be advanced next.
+ * @param Wheel The timer wheel.
+ * @return The time in nanoseconds, or MO_TIMER_WHEEL_NO_DEADLINE if no timer
+ *         is pending.
+ * @remarks The result is not later than the earliest deadline, and can be
+ *          earlier if the timers in the higher levels need to be moved to the
+ *          lower levels first. The idle loop can arm the one-shot timer with
+ *          this deadline instead of using the periodic tick.
+ */
+MO_EXTERN_C MO_UINT64 MOAPI MoTimerWheelQueryNextDeadline(
+    _Mo_In_ PMO_TIMER_WHEEL Wheel);
+
+#endif // !MOBILITY_TIME_TIMERWHEEL
@@ -316,9 +316,84 @@ namespace
     }
 }
 
+/**
+ * @brief Defines the ACPI patch rule which fills the legacy FADT I/O port block
+ *        address from the extended one if the legacy one is missing.
+ * @param Block The name of the legacy FADT I/O port block address field.
+ */
+#define MO_HVGCS_FADT_SYSTEM_IO_BLOCK_RULE(Block) \
+    { \
+        "FADT " #Block, \
+        EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE_SIGNATURE, \
+        MO_UEFI_ACPI_PATCH_SCOPE_TABLE, \
+        0u, \
+        MO_UEFI_ACPI_PATCH_PREDICATE_EQUAL, \
+        sizeof(UINT8), \
+        OFFSET_OF( \
+            EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE, \
+            X##Block.AddressSpaceId), \
+        MO_UEFI_ACPI_PATCH_OPERATION_COPY, \
+        sizeof(UINT32), \
+        OFFSET_OF(EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE, Block), \
+        EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE_REVISION, \
+        MO_UEFI_ACPI_PATCH_FLAG_ONLY_IF_ZERO, \
+        { 0 }, \
+        EFI_ACPI_2_0_SYSTEM_IO, \
+        OFFSET_OF(EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE, X##Block.Address) \
+    }
+
 namespace
 {
     MO_UINT8 g_DevicePathBuffer[4096];
+
+    MO_UEFI_ACPI_PATCH_RULE g_HyperVAcpiPatchRules[] =
+    {
+        {
+            "MADT PC-AT Compatibility flags bit",
+            EFI_ACPI_2_0_MULTIPLE_SAPIC_DESCRIPTION_TABLE_SIGNATURE,
+            MO_UEFI_ACPI_PATCH_SCOPE_TABLE,
+            0u,
+            MO_UEFI_ACPI_PATCH_PREDICATE_ALWAYS,
+            0u,
+            0u,
+            MO_UEFI_ACPI_PATCH_OPERATION_OR,
+            sizeof(UINT32),
+            OFFSET_OF(
+                EFI_ACPI_2_0_MULTIPLE_APIC_DESCRIPTION_TABLE_HEADER,
+                Flags),
+            EFI_ACPI_2_0_MULTIPLE_APIC_DESCRIPTION_TABLE_REVISION,
+            0u,
+            { 0 },
+            0u,
+            EFI_ACPI_2_0_PCAT_COMPAT
+        },
+        MO_HVGCS_FADT_SYSTEM_IO_BLOCK_RULE(Pm1aEvtBlk),
+        MO_HVGCS_FADT_SYSTEM_IO_BLOCK_RULE(Pm1bEvtBlk),
+        MO_HVGCS_FADT_SYSTEM_IO_BLOCK_RULE(Pm1aCntBlk),
+        MO_HVGCS_FADT_SYSTEM_IO_BLOCK_RULE(Pm1bCntBlk),
+        MO_HVGCS_FADT_SYSTEM_IO_BLOCK_RULE(Pm2CntBlk),
+        MO_HVGCS_FADT_SYSTEM_IO_BLOCK_RULE(PmTmrBlk),
+        MO_HVGCS_FADT_SYSTEM_IO_BLOCK_RULE(Gpe0Blk),
+        MO_HVGCS_FADT_SYSTEM_IO_BLOCK_RULE(Gpe1Blk),
+        {
+            // Disable the memory ranges above 2 TiB.
+            "SRAT",
+            EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_SIGNATURE,
+            EFI_ACPI_3_0_MEMORY_AFFINITY,
+            sizeof(EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_HEADER),
+            MO_UEFI_ACPI_PATCH_PREDICATE_GREATER_OR_EQUAL,
+            sizeof(UINT64),
+            OFFSET_OF(EFI_ACPI_3_0_MEMORY_AFFINITY_STRUCTURE, AddressBaseLow),
+            MO_UEFI_ACPI_PATCH_OPERATION_SET,
+            sizeof(UINT32),
+            OFFSET_OF(EFI_ACPI_3_0_MEMORY_AFFINITY_STRUCTURE, Flags),
+            EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_REVISION,
+            0u,
+            { 0 },
+            0x20000000000ULL,
+            0u
+        },
+    };
 }
 
 /**
@@ -378,6 +453,20 @@ EFI_STATUS EFIAPI UefiMain(
     {
         ExtendedSystemDescriptionTable = 0u;
     }
+    // Validate each ACPI description table once and serve the following
+    // queries from the index.
+    MO_UEFI_ACPI_TABLE_INDEX AcpiTableIndex;
+    if (ExtendedSystemDescriptionTable)
+    {
+        MO_RESULT Result = ::MoUefiAcpiTableIndexInitialize(
+            &AcpiTableIndex,
+            ExtendedSystemDescriptionTable);
+        if (MO_RESULT_SUCCESS_OK != Result &&
+            MO_RESULT_SUCCESS_FALSE != Result)
+        {
+            ExtendedSystemDescriptionTable = 0u;
+        }
+    }
     if (MO_RESULT_SUCCESS_OK == ::MoHyperVCheckAvailability() &&
         ExtendedSystemDescriptionTable)
     {
@@ -386,191 +475,34 @@ EFI_STATUS EFIAPI UefiMain(
             "Hyper-V Generation 2 Virtual Machine detected, "
             "starting to patch ACPI description tables...\r\n");
 
-        MO_UINT64 MultipleApicDescriptionTable = 0u;
-        if (MO_RESULT_SUCCESS_OK == ::MoUefiAcpiQueryDescriptionTable(
-            &MultipleApicDescriptionTable,
-            EFI_ACPI_2_0_MULTIPLE_SAPIC_DESCRIPTION_TABLE_SIGNATURE,
-            EFI_ACPI_2_0_MULTIPLE_APIC_DESCRIPTION_TABLE_REVISION,
-            ExtendedSystemDescriptionTable))
+        const MO_UINTN RuleCount =
+            sizeof(g_HyperVAcpiPatchRules) / sizeof(*g_HyperVAcpiPatchRules);
+        MO_UINT64 AppliedRules = 0u;
+        if (MO_RESULT_SUCCESS_OK != ::MoUefiAcpiTableIndexApplyPatches(
+            &AppliedRules,
+            &AcpiTableIndex,
+            g_HyperVAcpiPatchRules,
+            RuleCount))
         {
-            using TableType = EFI_ACPI_2_0_MULTIPLE_APIC_DESCRIPTION_TABLE_HEADER;
-            TableType* MadtHeader = reinterpret_cast<TableType*>(
-                MultipleApicDescriptionTable);
-            MadtHeader->Flags |= EFI_ACPI_2_0_PCAT_COMPAT;
-            MadtHeader->Header.Checksum = 0;
-            ::MoRuntimeCalculateChecksumByte(
-                &MadtHeader->Header.Checksum,
-                MadtHeader,
-                MadtHeader->Header.Length);
-
             ::MoUefiConsoleWriteAsciiString(
                 SystemTable->ConOut,
-                "ACPI MADT PC-AT Compatibility flags bit is applied.\r\n");
+                "Failed to apply all ACPI workarounds.\r\n");
         }
-
-        MO_UINT64 FixedAcpiDescriptionTable = 0u;
-        if (MO_RESULT_SUCCESS_OK == ::MoUefiAcpiQueryDescriptionTable(
-            &FixedAcpiDescriptionTable,
-            EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE_SIGNATURE,
-            EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE_REVISION,
-            ExtendedSystemDescriptionTable))
+        for (MO_UINTN i = 0; i < RuleCount; ++i)
         {
-            using TableType = EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE;
-            TableType* Fadt = reinterpret_cast<TableType*>(
-                FixedAcpiDescriptionTable);
-            if (EFI_ACPI_2_0_SYSTEM_IO == Fadt->XPm1aEvtBlk.AddressSpaceId)
-            {
-                if (!Fadt->Pm1aEvtBlk)
-                {
-                    Fadt->Pm1aEvtBlk = static_cast<UINT32>(
-                        Fadt->XPm1aEvtBlk.Address);
-
-                    ::MoUefiConsoleWriteAsciiString(
-                        SystemTable->ConOut,
-                        "ACPI FADT Pm1aEvtBlk workaround is applied.\r\n");
-                }
-            }
-
-            if (EFI_ACPI_2_0_SYSTEM_IO == Fadt->XPm1bEvtBlk.AddressSpaceId)
+            if (!(AppliedRules & (1ULL << i)))
             {
-                if (!Fadt->Pm1bEvtBlk)
-                {
-                    Fadt->Pm1bEvtBlk = static_cast<UINT32>(
-                        Fadt->XPm1bEvtBlk.Address);
-
-                    ::MoUefiConsoleWriteAsciiString(
-                        SystemTable->ConOut,
-                        "ACPI FADT Pm1bEvtBlk workaround is applied.\r\n");
-                }
+                continue;
             }
-
-            if (EFI_ACPI_2_0_SYSTEM_IO == Fadt->XPm1aCntBlk.AddressSpaceId)
-            {
-                if (!Fadt->Pm1aCntBlk)
-                {
-                    Fadt->Pm1aCntBlk = static_cast<UINT32>(
-                        Fadt->XPm1aCntBlk.Address);
-
-                    ::MoUefiConsoleWriteAsciiString(
-                        SystemTable->ConOut,
-                        "ACPI FADT Pm1aCntBlk workaround is applied.\r\n");
-                }
-            }
-
-            if (EFI_ACPI_2_0_SYSTEM_IO == Fadt->XPm1bCntBlk.AddressSpaceId)
-            {
-                if (!Fadt->Pm1bCntBlk)
-                {
-                    Fadt->Pm1bCntBlk = static_cast<UINT32>(
-                        Fadt->XPm1bCntBlk.Address);
-
-                    ::MoUefiConsoleWriteAsciiString(
-                        SystemTable->ConOut,
-                        "ACPI FADT Pm1bCntBlk workaround is applied.\r\n");
-                }
-            }
-
-            if (EFI_ACPI_2_0_SYSTEM_IO == Fadt->XPm2CntBlk.AddressSpaceId)
-            {
-                if (!Fadt->Pm2CntBlk)
-                {
-                    Fadt->Pm2CntBlk = static_cast<UINT32>(
-                        Fadt->XPm2CntBlk.Address);
-
-                    ::MoUefiConsoleWriteAsciiString(
-                        SystemTable->ConOut,
-                        "ACPI FADT Pm2CntBlk workaround is applied.\r\n");
-                }
-            }
-
-            if (EFI_ACPI_2_0_SYSTEM_IO == Fadt->XPmTmrBlk.AddressSpaceId)
-            {
-                if (!Fadt->PmTmrBlk)
-                {
-                    Fadt->PmTmrBlk = static_cast<UINT32>(
-                        Fadt->XPmTmrBlk.Address);
-
-                    ::MoUefiConsoleWriteAsciiString(
-                        SystemTable->ConOut,
-                        "ACPI FADT PmTmrBlk workaround is applied.\r\n");
-                }
-            }
-
-            if (EFI_ACPI_2_0_SYSTEM_IO == Fadt->XGpe0Blk.AddressSpaceId)
-            {
-                if (!Fadt->Gpe0Blk)
-                {
-                    Fadt->Gpe0Blk = static_cast<UINT32>(
-                        Fadt->XGpe0Blk.Address);
-
-                    ::MoUefiConsoleWriteAsciiString(
-                        SystemTable->ConOut,
-                        "ACPI FADT Gpe0Blk workaround is applied.\r\n");
-                }
-            }
-
-            if (EFI_ACPI_2_0_SYSTEM_IO == Fadt->XGpe1Blk.AddressSpaceId)
-            {
-                if (!Fadt->Gpe1Blk)
-                {
-                    Fadt->Gpe1Blk = static_cast<UINT32>(
-                        Fadt->XGpe1Blk.Address);
-
-                    ::MoUefiConsoleWriteAsciiString(
-                        SystemTable->ConOut,
-                        "ACPI FADT Gpe1Blk workaround is applied.\r\n");
-                }
-            }
-
-            Fadt->Header.Checksum = 0;
-            ::MoRuntimeCalculateChecksumByte(
-                &Fadt->Header.Checksum,
-                Fadt,
-                Fadt->Header.Length);
-        }
-
-        MO_UINT64 SystemResourceAffinityTable = 0u;
-        if (MO_RESULT_SUCCESS_OK == ::MoUefiAcpiQueryDescriptionTable(
-            &SystemResourceAffinityTable,
-            EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_SIGNATURE,
-            EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_REVISION,
-            ExtendedSystemDescriptionTable))
-        {
-            using TableType = EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_HEADER;
-            TableType* SratHeader = reinterpret_cast<TableType*>(
-                SystemResourceAffinityTable);
-            PMO_UINT8 CurrentSratItemEntry = reinterpret_cast<PMO_UINT8>(
-                &SratHeader[1]);
-            MO_UINT32 ProcessedSize =
-                sizeof(EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_HEADER);
-            while (ProcessedSize < SratHeader->Header.Length)
-            {
-                EFI_ACPI_3_0_MEMORY_AFFINITY_STRUCTURE* CandidateItem =
-                    reinterpret_cast<EFI_ACPI_3_0_MEMORY_AFFINITY_STRUCTURE*>(
-                        CurrentSratItemEntry);
-                if (EFI_ACPI_3_0_MEMORY_AFFINITY == CandidateItem->Type)
-                {
-                    MO_UINT64 AddressBase = CandidateItem->AddressBaseHigh;
-                    AddressBase <<= 32;
-                    AddressBase |= CandidateItem->AddressBaseLow;
-                    if (AddressBase >= 0x20000000000ULL)
-                    {
-                        CandidateItem->Flags = 0;
-                    }
-                }
-                ProcessedSize += CandidateItem->Length;
-                CurrentSratItemEntry += CandidateItem->Length;
-            }
-
-            SratHeader->Header.Checksum = 0;
-            ::MoRuntimeCalculateChecksumByte(
-                &SratHeader->Header.Checksum,
-                SratHeader,
-                SratHeader->Header.Length);
-
             ::MoUefiConsoleWriteAsciiString(
                 SystemTable->ConOut,
-                "ACPI SRAT workaround is applied.\r\n");
+                "ACPI ");
+            ::MoUefiConsoleWriteAsciiString(
+                SystemTable->ConOut,
+                g_HyperVAcpiPatchRules[i].Name);
+            ::MoUefiConsoleWriteAsciiString(
+                SystemTable->ConOut,
+                " workaround is applied.\r\n");
         }
 
         ::MoUefiConsoleWriteAsciiString(
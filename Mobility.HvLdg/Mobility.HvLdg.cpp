@@ -16,11 +16,22 @@
 #include <Mobility.Runtime.Core.h>
 #include "Mobility.Console.Core.h"
 #include <Mobility.Platform.x64.h>
+#include <Mobility.Platform.x64.Apic.h>
+#include <Mobility.Platform.x64.PageTable.h>
+#include <Mobility.Platform.x64.DemandZero.h>
+#include <Mobility.Platform.x64.Fpu.h>
+#include <Mobility.Platform.x64.Fiber.h>
+#include <Mobility.Platform.x64.Smp.h>
+#include <Mobility.Platform.x64.SystemCall.h>
+#include <Mobility.Platform.x64.InterruptStatistics.h>
+#include <Mobility.Platform.x64.Time.h>
 #include <Mobility.Platform.Interface.h>
 #include <Mobility.Memory.SmallHeap.h>
+#include <Mobility.Synchronization.Atomic.h>
 
 #include <Mobility.Uefi.Core.h>
 #include <Mobility.Uefi.Acpi.h>
+#include <Mobility.Uefi.Mp.h>
 
 #include <IndustryStandard/Acpi30.h>
 
@@ -30,170 +41,2179 @@
     MILE_PROJECT_VERSION_UTF8_STRING " (Build " \
     MILE_PROJECT_MACRO_TO_UTF8_STRING(MILE_PROJECT_VERSION_BUILD) ")"
 
+#ifndef MO_PLATFORM_X64_PAGE_ALIGNED
+#define MO_PLATFORM_X64_PAGE_ALIGNED \
+    MO_DECLSPEC_ALIGN(MO_PLATFORM_X64_PAGE_SIZE)
+#endif // !MO_PLATFORM_X64_PAGE_ALIGNED
+
+#define MO_PLATFORM_X64_CONSOLE_WIDTH 128
+#define MO_PLATFORM_X64_CONSOLE_HEIGHT 40
+
+#define MO_PLATFORM_X64_CONSOLE_SIZE \
+    (MO_PLATFORM_X64_CONSOLE_WIDTH * MO_PLATFORM_X64_CONSOLE_HEIGHT)
+
+#define MO_PLATFORM_X64_FRAME_POOL_PAGES 256
+
+#define MO_PLATFORM_X64_SESSION_REGION_BASE 0xFFFF800000000000ULL
+#define MO_PLATFORM_X64_SESSION_REGION_SIZE 0x4000000ULL
+
+/**
+ * @brief Set to 1 to run the demo which takes over the local APIC timer from
+ *        the firmware, arms it once and halts until it fires. The firmware
+ *        configuration of the local APIC is restored afterwards.
+ */
+#ifndef MOBILITY_HVLDG_LOCAL_APIC_TIMER_DEMO
+#define MOBILITY_HVLDG_LOCAL_APIC_TIMER_DEMO 0
+#endif // !MOBILITY_HVLDG_LOCAL_APIC_TIMER_DEMO
+
+/**
+ * @brief The interval in nanoseconds armed by the local APIC timer demo.
+ */
+#define MO_PLATFORM_X64_LOCAL_APIC_TIMER_DEMO_INTERVAL 1000000ULL
+
+/**
+ * @brief Set to 1 to run the demo which switches among the fibers on the stacks
+ *        with the guard pages, and catches the stack overflow of one of them
+ *        from the page-fault handler.
+ */
+#ifndef MOBILITY_HVLDG_FIBER_DEMO
+#define MOBILITY_HVLDG_FIBER_DEMO 0
+#endif // !MOBILITY_HVLDG_FIBER_DEMO
+
+/**
+ * @brief The fiber stacks of the fiber demo are mapped right after the session
+ *        region, so their guard pages are not backed by the demand-zero
+ *        handler.
+ */
+#define MO_PLATFORM_X64_FIBER_DEMO_REGION_BASE \
+    (MO_PLATFORM_X64_SESSION_REGION_BASE + MO_PLATFORM_X64_SESSION_REGION_SIZE)
+
+/**
+ * @brief The number of the 4 KiB pages of each fiber stack of the fiber demo.
+ */
+#define MO_PLATFORM_X64_FIBER_DEMO_STACK_PAGES 4
+
+/**
+ * @brief The number of the times the first fiber of the fiber demo yields
+ *        before it finishes.
+ */
+#define MO_PLATFORM_X64_FIBER_DEMO_YIELDS 3
+
+/**
+ * @brief Set to 1 to run the demo which starts the first application processor
+ *        described by the MADT with MoPlatformSmpStartProcessor, and returns
+ *        it to the wait-for-SIPI state with an INIT IPI afterwards.
+ */
+#ifndef MOBILITY_HVLDG_PROCESSOR_START_DEMO
+#define MOBILITY_HVLDG_PROCESSOR_START_DEMO 0
+#endif // !MOBILITY_HVLDG_PROCESSOR_START_DEMO
+
+/**
+ * @brief The number of the 4 KiB pages of each stack of the application
+ *        processor started by the processor start demo.
+ */
+#define MO_PLATFORM_X64_PROCESSOR_START_DEMO_STACK_PAGES 4
+
+/**
+ * @brief Set to 1 to run the demo which enters the user mode on the application
+ *        processor started by the processor start demo, and issues two system
+ *        calls. The first one returns with SYSRET, and the second one is at the
+ *        end of the lower half, so it returns with IRETQ to a non-canonical
+ *        address and faults.
+ * @remarks The boot processor still uses the firmware GDT, which has no user
+ *          segments, so the demo needs MOBILITY_HVLDG_PROCESSOR_START_DEMO.
+ */
+#ifndef MOBILITY_HVLDG_SYSTEM_CALL_DEMO
+#define MOBILITY_HVLDG_SYSTEM_CALL_DEMO 0
+#endif // !MOBILITY_HVLDG_SYSTEM_CALL_DEMO
+
+#if MOBILITY_HVLDG_SYSTEM_CALL_DEMO
+#if !MOBILITY_HVLDG_PROCESSOR_START_DEMO
+#error "The system call demo needs MOBILITY_HVLDG_PROCESSOR_START_DEMO."
+#endif // !MOBILITY_HVLDG_PROCESSOR_START_DEMO
+#endif // MOBILITY_HVLDG_SYSTEM_CALL_DEMO
+
+/**
+ * @brief The user-mode code page of the system call demo, which is the last
+ *        page of the lower half.
+ */
+#define MO_PLATFORM_X64_SYSTEM_CALL_DEMO_CODE_PAGE 0x00007FFFFFFFF000ULL
+
+/**
+ * @brief The user-mode stack page of the system call demo, which is right
+ *        below the code page.
+ */
+#define MO_PLATFORM_X64_SYSTEM_CALL_DEMO_STACK_PAGE 0x00007FFFFFFFE000ULL
+
+/**
+ * @brief The argument of the first system call of the system call demo. Each
+ *        call returns its argument plus one, and the second call takes the
+ *        result of the first one.
+ */
+#define MO_PLATFORM_X64_SYSTEM_CALL_DEMO_ARGUMENT 0x4D6F6200u
+
+/**
+ * @brief The platform-specific context for x64 architecture.
+ */
+typedef struct MO_PLATFORM_X64_PAGE_ALIGNED _MO_PLATFORM_X64_PLATFORM_CONTEXT
+{
+    // Area 1 (64 KiB)
+
+    MO_MEMORY_SMALL_HEAP InternalHeap;
+
+    // Area 2 (64 KiB)
+
+    // Due to the x86 page table design, we can use PML4 Entry (PML4E) page as
+    // the protection page for protecting the platform context from the
+    // corrupted internal heap.
+    MO_PLATFORM_X64_PAGE_DIRECTORY_ENTRY PageMapLevel4Entry[512];
+
+    MO_PLATFORM_X64_PAGE_DIRECTORY_ENTRY PageDirectoryPointerEntry[512];
+
+    MO_PLATFORM_X64_PAGE_TABLE_ENTRY PageTableEntry[512 * 4];
+
+    HV_MESSAGE_PAGE InterruptMessagePage;
+
+    HV_SYNIC_EVENT_FLAGS_PAGE InterruptEventFlagsPage;
+
+    HV_REFERENCE_TSC_PAGE ReferenceTscPage;
+
+    MO_UINT8 FpuStateArea[MO_PLATFORM_X64_PAGE_SIZE];
+
+    PMO_PLATFORM_X64_LIGHTWEIGHT_INTERRUPT_HANDLER LightweightHandlers[256];
+    PMO_PLATFORM_X64_INTERRUPT_HANDLER MoPlatformInterruptHandlers[256];
+
+    MO_PLATFORM_X64_IDT_GATE_DESCRIPTOR InterruptDescriptorTable[256];
+
+    MO_PLATFORM_X64_GDT_DESCRIPTORS GlobalDescriptorTable;
+    MO_PLATFORM_X64_TASK_STATE_SEGMENT TaskStateSegment;
+    MO_DISPLAY_BGRA32_FRAMEBUFFER DisplayFrameBuffer;
+    bool HypercallInitialized;
+    MO_UINT8 Reserved1_0[7];
+    MO_UINT8 Reserved1_1[40];
+    MO_CONSOLE_SCREEN_BUFFER ConsoleScreenBuffer;
+    MO_UINT8 Reserved1_2[512];
+    MO_UINT8 Reserved2[1024];
+    MO_WIDE_CHAR ConsoleCharacterBuffer[MO_PLATFORM_X64_CONSOLE_SIZE];
+
+    // According to the Hyper-V hypercall page are readable and executable
+    // but not writable by the guest from Hypervisor Top Level Functional
+    // Specification 6.0b, we can use Hyper-V hypercall page here as the
+    // protection page for protecting the platform context from corrupting
+    // via the kernel stack overflow.
+    MO_UINT8 HypercallPage[MO_PLATFORM_X64_PAGE_SIZE];
+
+    // Area 3 (64 KiB)
+
+    MO_UINT8 KernelStack[MO_PLATFORM_X64_PAGE_SIZE * 16];
+} MO_PLATFORM_X64_PLATFORM_CONTEXT, *PMO_PLATFORM_X64_PLATFORM_CONTEXT;
+
+namespace
+{
+    MO_PLATFORM_X64_PLATFORM_CONTEXT g_PlatformContext;
+    MO_UINTN g_PageTablePoolAllocatedPages = 0u;
+    MO_UINT64 g_FirmwareCr3 = 0u;
+    MO_UINT64 g_FirmwareAttributeTable = 0u;
+    bool g_PageTablesInitialized = false;
+    MO_PLATFORM_X64_PSEUDO_DESCRIPTOR g_FirmwareInterruptDescriptorTable;
+    MO_PLATFORM_X64_IDT_GATE_DESCRIPTOR g_FirmwarePageFaultGate;
+    MO_PLATFORM_X64_IDT_GATE_DESCRIPTOR g_FirmwareDeviceNotAvailableGate;
+    bool g_InterruptDescriptorTableInitialized = false;
+    MO_UINT64 g_FirmwareCr0 = 0u;
+    MO_UINT64 g_FirmwareCr4 = 0u;
+    MO_UINT64 g_FirmwareXcr0 = 0u;
+    bool g_LazyFpuInitialized = false;
+    MO_UINT64 g_FramePoolAddress = 0u;
+    MO_UINTN g_FramePoolAllocatedPages = 0u;
+    MO_PLATFORM_X64_PAGE_TABLE_BUILDER g_PageTableBuilder;
+    MO_PLATFORM_X64_DEMAND_ZERO_MANAGER g_DemandZeroManager;
+    bool g_DemandZeroInitialized = false;
+    MO_PLATFORM_X64_FPU_MANAGER g_FpuManager;
+    MO_PLATFORM_X64_FPU_CONTEXT g_BootFpuContext;
+    MO_PLATFORM_X64_FPU_CONTEXT g_DemoFpuContext;
+#if MO_PLATFORM_X64_INTERRUPT_STATISTICS
+    MO_PLATFORM_X64_PROCESSOR_INTERRUPT_STATISTICS g_InterruptStatistics;
+#endif // MO_PLATFORM_X64_INTERRUPT_STATISTICS
+    MO_TIME_CLOCK_SOURCE g_HyperVReferenceClockSource;
+    MO_TIME_CLOCK_SOURCE g_PowerManagementTimerClockSource;
+    MO_TIME_CLOCK_SOURCE g_HighPrecisionEventTimerClockSource;
+    MO_UINT64 g_HighPrecisionEventTimerConfiguration = 0u;
+    bool g_HighPrecisionEventTimerInitialized = false;
+    MO_TIME_CLOCK_SOURCE g_TimeStampCounterClockSource;
+    MO_PLATFORM_X64_PROCESSOR_BLOCK g_BootProcessorBlock;
+    MO_UINT64 g_FirmwareGsBase = 0u;
+    bool g_BootProcessorBlockAttached = false;
+    MO_PLATFORM_X64_LOCAL_APIC g_LocalApic;
+#if MOBILITY_HVLDG_FIBER_DEMO
+    MO_PLATFORM_X64_FIBER g_FiberDemoMainFiber;
+    MO_PLATFORM_X64_FIBER g_FiberDemoFibers[2];
+    PMO_PLATFORM_X64_INTERRUPT_HANDLER g_FiberDemoPreviousPageFaultHandler;
+    MO_UINT64 g_FiberDemoFaultAddress = 0u;
+    MO_UINT32 g_FiberDemoSteps = 0u;
+#endif // MOBILITY_HVLDG_FIBER_DEMO
+#if MOBILITY_HVLDG_PROCESSOR_START_DEMO
+    MO_PLATFORM_X64_PROCESSOR_BLOCK g_ApplicationProcessorBlock;
+#endif // MOBILITY_HVLDG_PROCESSOR_START_DEMO
+#if MOBILITY_HVLDG_SYSTEM_CALL_DEMO
+    MO_PLATFORM_X64_IDT_GATE_DESCRIPTOR
+        g_SystemCallDemoInterruptDescriptorTable[256];
+    PMO_PLATFORM_X64_SYSTEM_CALL_HANDLER g_SystemCallDemoHandlers[1];
+    PMO_PLATFORM_X64_INTERRUPT_HANDLER g_SystemCallDemoPreviousHandler;
+    MO_UINT64 g_SystemCallDemoEntry = 0u;
+    MO_UINT32 g_SystemCallDemoCalls = 0u;
+    MO_UINT64 g_SystemCallDemoReturnAddress = 0u;
+    MO_UINT64 g_SystemCallDemoResult = 0u;
+    MO_UINT64 g_SystemCallDemoFaultCodeSegment = 0u;
+    MO_UINT32 volatile g_SystemCallDemoFinished = 0u;
+#endif // MOBILITY_HVLDG_SYSTEM_CALL_DEMO
+    const char g_LogoString[] =
+        "Mobility Hyper-V Lightweight Debugger for Guests"
+        " " MOBILITY_MINUAP_VERSION_UTF8_STRING "\r\n"
+        "(c) Kenji Mouri. All rights reserved.\r\n"
+        "\r\n";
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformHeapAllocate(
+    _Mo_Out_ PMO_POINTER Block,
+    _Mo_In_ MO_UINTN Size)
+{
+    // Additional check to ensure Size fits in MO_UINT16.
+    if (Size > MO_UINT16_MAX)
+    {
+        return MO_RESULT_ERROR_OUT_OF_MEMORY;
+    }
+
+    return ::MoMemorySmallHeapAllocate(
+        Block,
+        &g_PlatformContext.InternalHeap,
+        static_cast<MO_UINT16>(Size));
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformHeapFree(
+    _Mo_In_ MO_POINTER Block)
+{
+    return ::MoMemorySmallHeapFree(&g_PlatformContext.InternalHeap, Block);
+}
+
+MO_EXTERN_C MO_RESULT MOAPI MoPlatformHeapReallocate(
+    _Mo_Out_ PMO_POINTER UpdatedBlock,
+    _Mo_In_Opt_ MO_POINTER Block,
+    _Mo_In_ MO_UINTN NewSize)
+{
+    // Additional check to ensure NewSize fits in MO_UINT16.
+    if (NewSize > MO_UINT16_MAX)
+    {
+        return MO_RESULT_ERROR_OUT_OF_MEMORY;
+    }
+
+    return ::MoMemorySmallHeapReallocate(
+        UpdatedBlock,
+        &g_PlatformContext.InternalHeap,
+        Block,
+        static_cast<MO_UINT16>(NewSize));
+}
+
+MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteAsciiString(
+    _Mo_In_ MO_CONSTANT_STRING String)
+{
+    ::MoConsoleCoreWriteString(
+        &g_PlatformContext.ConsoleScreenBuffer,
+        String,
+        static_cast<MO_UINT32>(::MoRuntimeStringLength(String)));
+    ::MoConsoleCoreRefreshScreen(
+        &g_PlatformContext.DisplayFrameBuffer,
+        &g_PlatformContext.ConsoleScreenBuffer);
+}
+
+void MoPlatformWriteUnsignedInteger(
+    _Mo_In_ MO_UINT64 Value)
+{
+    // 21 characters: 20 decimal digits + '\0'
+    MO_CHAR NumberBuffer[21];
+
+    if (MO_RESULT_SUCCESS_OK ==
+        ::MoRuntimeConvertUnsignedIntegerToDecimalString(
+            NumberBuffer,
+            nullptr,
+            sizeof(NumberBuffer),
+            Value))
+    {
+        ::MoPlatformWriteAsciiString(NumberBuffer);
+    }
+    else
+    {
+        ::MoPlatformWriteAsciiString("<Conversion Error>");
+    }
+}
+
+MO_RESULT MOAPI MoPlatformAllocateFramePoolPage(
+    _Mo_Out_ PMO_UINT64 PhysicalAddress,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    MO_UNREFERENCED_PARAMETER(Context);
+
+    // The frame pool is allocated from the UEFI firmware in advance, because
+    // the boot services cannot be called from the page-fault handler.
+    if (!g_FramePoolAddress ||
+        g_FramePoolAllocatedPages >= MO_PLATFORM_X64_FRAME_POOL_PAGES)
+    {
+        return MO_RESULT_ERROR_OUT_OF_MEMORY;
+    }
+
+    *PhysicalAddress = g_FramePoolAddress +
+        (g_FramePoolAllocatedPages++ * MO_PLATFORM_X64_PAGE_SIZE);
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_RESULT MOAPI MoPlatformAllocatePageTablePage(
+    _Mo_Out_ PMO_UINT64 PhysicalAddress,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    // The paging structures area in the platform context is used as the pool,
+    // and the UEFI firmware identity maps all memory.
+    MO_POINTER PoolPages[] =
+    {
+        g_PlatformContext.PageMapLevel4Entry,
+        g_PlatformContext.PageDirectoryPointerEntry,
+        &g_PlatformContext.PageTableEntry[512 * 0],
+        &g_PlatformContext.PageTableEntry[512 * 1],
+        &g_PlatformContext.PageTableEntry[512 * 2],
+        &g_PlatformContext.PageTableEntry[512 * 3],
+    };
+    if (g_PageTablePoolAllocatedPages >= sizeof(PoolPages) / sizeof(*PoolPages))
+    {
+        return ::MoPlatformAllocateFramePoolPage(PhysicalAddress, Context);
+    }
+
+    *PhysicalAddress = reinterpret_cast<MO_UINT64>(
+        PoolPages[g_PageTablePoolAllocatedPages++]);
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_RESULT MoPlatformTranslateFirmwareCacheType(
+    _Mo_Out_ PMO_UINT8 CacheType,
+    _Mo_In_ MO_UINT8 FirmwareCacheType)
+{
+    // The firmware may program the IA32_PAT differently, so look up the
+    // Mobility PAT entry with the same memory type instead of reusing the index.
+    MO_UINT8 MemoryType = static_cast<MO_UINT8>(
+        (g_FirmwareAttributeTable >> (FirmwareCacheType * 8)) & 0x7);
+    for (MO_UINT8 Index = 0;
+        Index <= MO_PLATFORM_X64_PAGE_CACHE_MAXIMUM;
+        ++Index)
+    {
+        if (MemoryType == static_cast<MO_UINT8>(
+            (MO_PLATFORM_X64_PAT_VALUE >> (Index * 8)) & 0x7))
+        {
+            *CacheType = Index;
+            return MO_RESULT_SUCCESS_OK;
+        }
+    }
+
+    return MO_RESULT_ERROR_NOT_IMPLEMENTED;
+}
+
+MO_RESULT MoPlatformCloneFirmwarePageTable(
+    _Mo_In_ PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder,
+    _Mo_In_ MO_UINT64 TableAddress,
+    _Mo_In_ MO_UINT32 Shift,
+    _Mo_In_ MO_UINT64 BaseAddress,
+    _Mo_In_ MO_UINT32 InheritedAttributes)
+{
+    PMO_PLATFORM_X64_PAGE_TABLE_ENTRY Table =
+        reinterpret_cast<PMO_PLATFORM_X64_PAGE_TABLE_ENTRY>(TableAddress);
+    for (MO_UINT64 Index = 0;
+        Index < MO_PLATFORM_X64_PAGE_TABLE_ENTRY_COUNT;
+        ++Index)
+    {
+        MO_PLATFORM_X64_PAGE_TABLE_ENTRY Entry = Table[Index];
+        if (!Entry.P)
+        {
+            continue;
+        }
+
+        MO_UINT64 VirtualAddress = BaseAddress | (Index << Shift);
+        if (39 == Shift && (VirtualAddress & (1ULL << 47)))
+        {
+            // Sign extend the upper half of the canonical address space.
+            VirtualAddress |= 0xFFFF000000000000ULL;
+        }
+
+        // The access rights are the combination of all levels, which means
+        // a page is writable only if it is writable at all levels, and a page
+        // is not executable if it is not executable at any level.
+        MO_UINT32 Attributes = InheritedAttributes;
+        if (!Entry.RW)
+        {
+            Attributes &= ~MO_PLATFORM_X64_PAGE_ATTRIBUTE_WRITABLE;
+        }
+        if (!Entry.US)
+        {
+            Attributes &= ~MO_PLATFORM_X64_PAGE_ATTRIBUTE_USER;
+        }
+        if (Entry.XD)
+        {
+            Attributes |= MO_PLATFORM_X64_PAGE_ATTRIBUTE_NO_EXECUTE;
+        }
+
+        if (12 != Shift && (39 == Shift || !Entry.PS_2M))
+        {
+            MO_PLATFORM_X64_PAGE_DIRECTORY_ENTRY DirectoryEntry;
+            DirectoryEntry.RawData = Entry.RawData;
+            MO_RESULT Result = ::MoPlatformCloneFirmwarePageTable(
+                Builder,
+                static_cast<MO_UINT64>(DirectoryEntry.PageTableAddress) << 12,
+                Shift - 9,
+                VirtualAddress,
+                Attributes);
+            if (MO_RESULT_SUCCESS_OK != Result)
+            {
+                return Result;
+            }
+            continue;
+        }
+
+        MO_UINT64 PageSize = 1ULL << Shift;
+        MO_UINT64 PhysicalAddress = 0u;
+        MO_UINT8 FirmwareCacheType = static_cast<MO_UINT8>(
+            (Entry.PCD << 1) | Entry.PWT);
+        if (MO_PLATFORM_X64_PAGE_SIZE_1G == PageSize)
+        {
+            PhysicalAddress =
+                static_cast<MO_UINT64>(Entry.PageFrameNumber_1G) << 30;
+            FirmwareCacheType |= static_cast<MO_UINT8>(Entry.PAT_1G << 2);
+        }
+        else if (MO_PLATFORM_X64_PAGE_SIZE_2M == PageSize)
+        {
+            PhysicalAddress =
+                static_cast<MO_UINT64>(Entry.PageFrameNumber_2M) << 21;
+            FirmwareCacheType |= static_cast<MO_UINT8>(Entry.PAT_2M << 2);
+        }
+        else
+        {
+            PhysicalAddress =
+                static_cast<MO_UINT64>(Entry.PageFrameNumber_4K) << 12;
+            FirmwareCacheType |= static_cast<MO_UINT8>(Entry.PAT_4K << 2);
+        }
+        if (Entry.G)
+        {
+            Attributes |= MO_PLATFORM_X64_PAGE_ATTRIBUTE_GLOBAL;
+        }
+
+        MO_UINT8 CacheType = 0u;
+        MO_RESULT Result = ::MoPlatformTranslateFirmwareCacheType(
+            &CacheType,
+            FirmwareCacheType);
+        if (MO_RESULT_SUCCESS_OK != Result)
+        {
+            return Result;
+        }
+
+        // Map every firmware page with the same size, because the firmware
+        // already splits the large pages where the MTRR memory types change,
+        // and a large page spanning more than one MTRR memory type is
+        // undefined.
+        Result = ::MoPlatformPageTableMapRange(
+            Builder,
+            VirtualAddress,
+            PhysicalAddress,
+            PageSize,
+            Attributes,
+            CacheType);
+        if (MO_RESULT_SUCCESS_OK != Result)
+        {
+            return Result;
+        }
+    }
+
+    return MO_RESULT_SUCCESS_OK;
+}
+
+MO_RESULT MoPlatformInitializePageTables()
+{
+    // CPUID.01H:EDX.PAT[bit 16] is required for the write-combining mapping.
+    MO_PLATFORM_X64_CPUID_RESULT CpuidResult;
+    ::MoPlatformReadCpuid(&CpuidResult, 0x00000001);
+    if (!(CpuidResult.Edx & (1u << 16)))
+    {
+        return MO_RESULT_ERROR_NOT_IMPLEMENTED;
+    }
+
+    // The firmware page tables are cloned entry by entry, so 5-level paging is
+    // not supported.
+    if (::MoPlatformReadCr4() & MO_PLATFORM_X64_CR4_LA57)
+    {
+        return MO_RESULT_ERROR_NOT_IMPLEMENTED;
+    }
+
+    // Only use the 1 GiB pages where the firmware uses them, which requires
+    // the CPUID.80000001H:EDX.Page1GB[bit 26].
+    MO_BOOL Allow1GiBPages = MO_FALSE;
+    ::MoPlatformReadCpuid(&CpuidResult, 0x80000000);
+    if (CpuidResult.Eax >= 0x80000001)
+    {
+        ::MoPlatformReadCpuid(&CpuidResult, 0x80000001);
+        Allow1GiBPages = (CpuidResult.Edx & (1u << 26)) ? MO_TRUE : MO_FALSE;
+    }
+
+    // The firmware still owns the paging and the memory types before exiting
+    // the boot services, so both are restored by MoPlatformRestorePageTables.
+    g_FirmwareCr3 = ::MoPlatformReadCr3();
+    g_FirmwareAttributeTable = ::MoPlatformReadMsr(
+        MO_PLATFORM_X64_MSR_IA32_PAT);
+
+    PMO_PLATFORM_X64_PAGE_TABLE_BUILDER Builder = &g_PageTableBuilder;
+    g_PageTablePoolAllocatedPages = 0u;
+    MO_RESULT Result = ::MoPlatformPageTableInitialize(
+        Builder,
+        ::MoPlatformAllocatePageTablePage,
+        nullptr,
+        nullptr,
+        Allow1GiBPages);
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+
+    // Keep the page sizes, the access rights and the memory types of the
+    // firmware mappings, so the memory protection of the firmware is still
+    // enforced and the MTRR boundaries are still respected.
+    Result = ::MoPlatformCloneFirmwarePageTable(
+        Builder,
+        g_FirmwareCr3 & 0x000FFFFFFFFFF000ULL,
+        39,
+        0u,
+        MO_PLATFORM_X64_PAGE_ATTRIBUTE_WRITABLE |
+        MO_PLATFORM_X64_PAGE_ATTRIBUTE_USER);
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+
+    // The firmware usually leaves the frame buffer as uncacheable, which makes
+    // every pixel write a separate bus transaction.
+    MO_UINT64 FrameBufferStart = reinterpret_cast<MO_UINT64>(
+        g_PlatformContext.DisplayFrameBuffer.FrameBufferBase);
+    MO_UINT64 FrameBufferEnd = FrameBufferStart +
+        MO_DISPLAY_BGRA32_FRAMEBUFFER_GET_SIZE_IN_BYTES(
+            &g_PlatformContext.DisplayFrameBuffer);
+    FrameBufferStart &= ~(MO_PLATFORM_X64_PAGE_SIZE_4K - 1);
+    FrameBufferEnd += MO_PLATFORM_X64_PAGE_SIZE_4K - 1;
+    FrameBufferEnd &= ~(MO_PLATFORM_X64_PAGE_SIZE_4K - 1);
+
+    MO_UINT64 FrameBufferPhysicalAddress = 0u;
+    MO_UINT32 FrameBufferAttributes = 0u;
+    Result = ::MoPlatformPageTableQuery(
+        &FrameBufferPhysicalAddress,
+        nullptr,
+        &FrameBufferAttributes,
+        nullptr,
+        Builder,
+        FrameBufferStart);
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+
+    // The write-combining memory type overrides the uncacheable MTRR memory
+    // type, and mapping the frame buffer only splits the large pages.
+    Result = ::MoPlatformPageTableIdentityMapRange(
+        Builder,
+        FrameBufferStart,
+        FrameBufferEnd - FrameBufferStart,
+        FrameBufferAttributes,
+        MO_PLATFORM_X64_PAGE_CACHE_WRITE_COMBINING);
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+
+    // Switch to the new page tables before reprogramming the IA32_PAT, so the
+    // firmware mappings are never accessed with the Mobility memory types.
+    ::MoPlatformDisableInterrupts();
+    ::MoPlatformWriteCr3(Builder->PageMapLevel4Address);
+    Result = ::MoPlatformPageTableInitializeAttributeTable();
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        ::MoPlatformWriteCr3(g_FirmwareCr3);
+    }
+    ::MoPlatformEnableInterrupts();
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+
+    g_PageTablesInitialized = true;
+    return MO_RESULT_SUCCESS_OK;
+}
+
+void MoPlatformRestorePageTables()
+{
+    if (!g_PageTablesInitialized)
+    {
+        return;
+    }
+
+    // Restore the IA32_PAT while the Mobility page tables are still used, and
+    // drop the cache lines and the translations created with the Mobility
+    // memory types when switching back to the firmware page tables.
+    ::MoPlatformDisableInterrupts();
+    ::MoPlatformWriteMsr(
+        MO_PLATFORM_X64_MSR_IA32_PAT,
+        g_FirmwareAttributeTable);
+    ::MoPlatformWriteBackInvalidateCache();
+    ::MoPlatformWriteCr3(g_FirmwareCr3);
+    ::MoPlatformEnableInterrupts();
+
+    g_PageTablesInitialized = false;
+}
+
+MO_RESULT MoPlatformInitializeInterruptDescriptorTable()
+{
+    // Inherit the firmware interrupt gates, and only route the page faults and
+    // the device-not-available exceptions to the Mobility interrupt handlers
+    // because the firmware still owns the timer and the other interrupts before
+    // exiting the boot services.
+    MO_PLATFORM_X64_PSEUDO_DESCRIPTOR Descriptor;
+    ::MoPlatformStoreInterruptDescriptorTable(&Descriptor);
+    g_FirmwareInterruptDescriptorTable = Descriptor;
+    MO_UINTN FirmwareSize = static_cast<MO_UINTN>(Descriptor.Limit) + 1;
+    if (FirmwareSize > sizeof(g_PlatformContext.InterruptDescriptorTable))
+    {
+        FirmwareSize = sizeof(g_PlatformContext.InterruptDescriptorTable);
+    }
+    if (FirmwareSize <= sizeof(MO_PLATFORM_X64_IDT_GATE_DESCRIPTOR) *
+        MO_PLATFORM_X64_INTERRUPT_PAGE_FAULT)
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+    if (MO_RESULT_SUCCESS_OK != ::MoRuntimeMemoryMove(
+        g_PlatformContext.InterruptDescriptorTable,
+        reinterpret_cast<MO_POINTER>(Descriptor.Base),
+        FirmwareSize))
+    {
+        return MO_RESULT_ERROR_UNEXPECTED;
+    }
+
+    g_FirmwarePageFaultGate =
+        g_PlatformContext.InterruptDescriptorTable[
+            MO_PLATFORM_X64_INTERRUPT_PAGE_FAULT];
+    g_FirmwareDeviceNotAvailableGate =
+        g_PlatformContext.InterruptDescriptorTable[
+            MO_PLATFORM_X64_INTERRUPT_DEVICE_NOT_AVAILABLE];
+
+    ::MoPlatformInterruptHandlerTable =
+        g_PlatformContext.MoPlatformInterruptHandlers;
+    ::MoPlatformLightweightInterruptHandlerTable =
+        g_PlatformContext.LightweightHandlers;
+    ::MoPlatformSetInterruptEntry(
+        g_PlatformContext.InterruptDescriptorTable,
+        MO_PLATFORM_X64_INTERRUPT_PAGE_FAULT,
+        ::MoPlatformGetDefaultInterruptEntryTier(
+            MO_PLATFORM_X64_INTERRUPT_PAGE_FAULT));
+    ::MoPlatformSetInterruptEntry(
+        g_PlatformContext.InterruptDescriptorTable,
+        MO_PLATFORM_X64_INTERRUPT_DEVICE_NOT_AVAILABLE,
+        MO_PLATFORM_X64_INTERRUPT_ENTRY_FULL);
+
+#if MO_PLATFORM_X64_INTERRUPT_STATISTICS
+    // Only the boot processor takes the interrupts routed to Mobility before
+    // exiting the boot services.
+    ::MoPlatformInterruptStatisticsInitialize(&g_InterruptStatistics, 1);
+#endif // MO_PLATFORM_X64_INTERRUPT_STATISTICS
+
+    Descriptor.Limit = static_cast<MO_UINT16>(
+        sizeof(g_PlatformContext.InterruptDescriptorTable) - 1);
+    Descriptor.Base = reinterpret_cast<MO_UINT64>(
+        g_PlatformContext.InterruptDescriptorTable);
+    ::MoPlatformDisableInterrupts();
+    ::MoPlatformLoadInterruptDescriptorTable(&Descriptor);
+    ::MoPlatformEnableInterrupts();
+
+    g_InterruptDescriptorTableInitialized = true;
+    return MO_RESULT_SUCCESS_OK;
+}
+
+void MoPlatformRestoreInterruptDescriptorTable()
+{
+    if (!g_InterruptDescriptorTableInitialized)
+    {
+        return;
+    }
+
+    // The firmware gates are copied to the Mobility IDT without changes, so
+    // only the routed vectors are taken back from Mobility.
+    ::MoPlatformDisableInterrupts();
+    ::MoPlatformLoadInterruptDescriptorTable(
+        &g_FirmwareInterruptDescriptorTable);
+    ::MoPlatformEnableInterrupts();
+
+    g_InterruptDescriptorTableInitialized = false;
+}
+
+/**
+ * @brief Passes the page faults not owned by Mobility to the firmware.
+ * @param InterruptType The type of the interrupt.
+ * @param InterruptContext The context of the interrupt.
+ * @remarks The firmware page-fault gate is put back to the Mobility IDT, so
+ *          the faulting instruction is restarted and raises the same page fault
+ *          to the firmware handler, which reports it as the firmware does
+ *          without Mobility.
+ */
+MO_VOID MOAPI MoPlatformFirmwarePageFaultHandler(
+    _Mo_In_ MO_PLATFORM_X64_INTERRUPT_TYPE InterruptType,
+    _Mo_In_ PMO_PLATFORM_X64_INTERRUPT_CONTEXT InterruptContext)
+{
+    MO_UNREFERENCED_PARAMETER(InterruptType);
+    MO_UNREFERENCED_PARAMETER(InterruptContext);
+
+    g_PlatformContext.InterruptDescriptorTable[
+        MO_PLATFORM_X64_INTERRUPT_PAGE_FAULT] = g_FirmwarePageFaultGate;
+}
+
+MO_RESULT MoPlatformInitializeDemandZeroMemory()
+{
+    MO_RESULT Result = ::MoPlatformDemandZeroInitialize(
+        &g_DemandZeroManager,
+        &g_PageTableBuilder,
+        ::MoPlatformAllocateFramePoolPage,
+        nullptr);
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+
+    Result = ::MoPlatformInitializeInterruptDescriptorTable();
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+
+    // The demand-zero handler passes the page faults it does not resolve to
+    // the previously installed handler, which returns them to the firmware.
+    g_PlatformContext.MoPlatformInterruptHandlers[
+        MO_PLATFORM_X64_INTERRUPT_PAGE_FAULT] =
+            ::MoPlatformFirmwarePageFaultHandler;
+    Result = ::MoPlatformDemandZeroInstallHandler(
+        &g_DemandZeroManager,
+        g_PlatformContext.MoPlatformInterruptHandlers);
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+
+    g_DemandZeroInitialized = true;
+    return MO_RESULT_SUCCESS_OK;
+}
+
+void MoPlatformRestoreDemandZeroMemory()
+{
+    if (!g_DemandZeroInitialized)
+    {
+        return;
+    }
+
+    // The committed pages are only mapped in the Mobility page tables, so no
+    // page fault is left for the firmware after the page tables are restored.
+    ::MoPlatformDemandZeroUninstallHandler(
+        &g_DemandZeroManager,
+        g_PlatformContext.MoPlatformInterruptHandlers);
+
+    ::MoPlatformDisableInterrupts();
+    g_PlatformContext.MoPlatformInterruptHandlers[
+        MO_PLATFORM_X64_INTERRUPT_PAGE_FAULT] = nullptr;
+    g_PlatformContext.InterruptDescriptorTable[
+        MO_PLATFORM_X64_INTERRUPT_PAGE_FAULT] = g_FirmwarePageFaultGate;
+    ::MoPlatformEnableInterrupts();
+
+    g_DemandZeroInitialized = false;
+}
+
+/**
+ * @brief Measures the average time of repainting the full screen, which fills
+ *        the whole frame buffer and redraws the console screen buffer.
+ * @return The average time in 100 nanosecond units.
+ */
+MO_UINT64 MoPlatformMeasureScreenRepaintTime()
+{
+    const MO_UINT32 Iterations = 16;
+
+    PMO_DISPLAY_BGRA32_FRAMEBUFFER DisplayFrameBuffer =
+        &g_PlatformContext.DisplayFrameBuffer;
+    MO_UINT32 BackgroundColor = ::MoConsoleCoreGetBackgroundColor(
+        &g_PlatformContext.ConsoleScreenBuffer);
+
+    MO_UINT64 StartTime = ::MoHyperVGetPartitionReferenceCounter();
+    for (MO_UINT32 i = 0; i < Iterations; ++i)
+    {
+        for (MO_UINT32 y = 0; y < DisplayFrameBuffer->VerticalResolution; ++y)
+        {
+            volatile MO_UINT32* Row =
+                MO_DISPLAY_BGRA32_FRAMEBUFFER_GET_PIXEL_ADDRESS(
+                    DisplayFrameBuffer,
+                    0,
+                    y);
+            for (MO_UINT32 x = 0;
+                x < DisplayFrameBuffer->HorizontalResolution;
+                ++x)
+            {
+                Row[x] = BackgroundColor;
+            }
+        }
+        ::MoConsoleCoreRefreshScreen(
+            DisplayFrameBuffer,
+            &g_PlatformContext.ConsoleScreenBuffer);
+    }
+    MO_UINT64 EndTime = ::MoHyperVGetPartitionReferenceCounter();
+
+    return (EndTime - StartTime) / Iterations;
+}
+
+void MoPlatformDemandZeroSessionDemo()
+{
+    if (MO_RESULT_SUCCESS_OK != ::MoPlatformInitializeDemandZeroMemory() ||
+        MO_RESULT_SUCCESS_OK != ::MoPlatformDemandZeroReserveRange(
+            &g_DemandZeroManager,
+            MO_PLATFORM_X64_SESSION_REGION_BASE,
+            MO_PLATFORM_X64_SESSION_REGION_SIZE,
+            MO_PLATFORM_X64_PAGE_ATTRIBUTE_WRITABLE,
+            MO_PLATFORM_X64_PAGE_CACHE_WRITE_BACK))
+    {
+        ::MoPlatformWriteAsciiString(
+            "Unable to reserve the demand-zero session region.\r\n");
+        return;
+    }
+
+    // Only touch the first, the middle and the last pages of the session
+    // region, so only 3 frames should be committed.
+    volatile MO_UINT64* Session = reinterpret_cast<volatile MO_UINT64*>(
+        MO_PLATFORM_X64_SESSION_REGION_BASE);
+    MO_UINTN TouchedOffsets[] =
+    {
+        0u,
+        MO_PLATFORM_X64_SESSION_REGION_SIZE / 2,
+        MO_PLATFORM_X64_SESSION_REGION_SIZE - MO_PLATFORM_X64_PAGE_SIZE,
+    };
+    bool AllZeroed = true;
+    MO_UINTN TouchedCount = sizeof(TouchedOffsets) / sizeof(*TouchedOffsets);
+    for (MO_UINTN i = 0; i < TouchedCount; ++i)
+    {
+        volatile MO_UINT64* Current = Session + (
+            TouchedOffsets[i] / sizeof(MO_UINT64));
+        if (0u != *Current)
+        {
+            AllZeroed = false;
+        }
+        *Current = i + 1;
+    }
+
+    ::MoPlatformWriteAsciiString(
+        AllZeroed
+        ? "Demand-zero session region: "
+        : "Demand-zero session region (not zeroed): ");
+    ::MoPlatformWriteUnsignedInteger(
+        g_DemandZeroManager.Regions[0].CommittedPages);
+    ::MoPlatformWriteAsciiString(" of ");
+    ::MoPlatformWriteUnsignedInteger(
+        MO_PLATFORM_X64_SESSION_REGION_SIZE / MO_PLATFORM_X64_PAGE_SIZE);
+    ::MoPlatformWriteAsciiString(" pages committed.\r\n");
+}
+
+MO_RESULT MoPlatformInitializeLazyFpu()
+{
+    // The device-not-available exceptions must be routed to the Mobility
+    // interrupt handlers before CR0.TS is set by any context switch.
+    if (::MoPlatformInterruptHandlerTable !=
+        g_PlatformContext.MoPlatformInterruptHandlers)
+    {
+        return MO_RESULT_ERROR_NO_INTERFACE;
+    }
+
+    // The firmware still owns the FPU configuration before exiting the boot
+    // services, so it is restored by MoPlatformRestoreLazyFpu. XCR0 can only
+    // be read if CR4.OSXSAVE is set.
+    g_FirmwareCr0 = ::MoPlatformReadCr0();
+    g_FirmwareCr4 = ::MoPlatformReadCr4();
+    if (g_FirmwareCr4 & MO_PLATFORM_X64_CR4_OSXSAVE)
+    {
+        g_FirmwareXcr0 = ::MoPlatformReadExtendedControlRegister(
+            MO_PLATFORM_X64_XCR_XFEATURE_ENABLED_MASK);
+    }
+
+    g_BootFpuContext.StateArea = g_PlatformContext.FpuStateArea;
+    g_BootFpuContext.StateAreaSize = sizeof(g_PlatformContext.FpuStateArea);
+    g_LazyFpuInitialized = true;
+    MO_RESULT Result = ::MoPlatformFpuInitialize(
+        &g_FpuManager,
+        &g_BootFpuContext);
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+
+    return ::MoPlatformFpuInstallHandler(
+        &g_FpuManager,
+        g_PlatformContext.MoPlatformInterruptHandlers);
+}
+
+void MoPlatformRestoreLazyFpu()
+{
+    if (!g_LazyFpuInitialized)
+    {
+        return;
+    }
+
+    // Make the boot context the owner again, so the firmware gets back the
+    // registers it had before, and no pending switch is left for the #NM
+    // handler being removed.
+    if (g_FpuManager.Current)
+    {
+        ::MoPlatformFpuSwitchContext(&g_FpuManager, &g_BootFpuContext);
+        if (g_FpuManager.Owner != &g_BootFpuContext)
+        {
+            ::MoPlatformFpuResolveDeviceNotAvailable(&g_FpuManager);
+        }
+    }
+    ::MoPlatformFpuUninstallHandler(
+        &g_FpuManager,
+        g_PlatformContext.MoPlatformInterruptHandlers);
+
+    ::MoPlatformDisableInterrupts();
+    g_PlatformContext.InterruptDescriptorTable[
+        MO_PLATFORM_X64_INTERRUPT_DEVICE_NOT_AVAILABLE] =
+            g_FirmwareDeviceNotAvailableGate;
+    if (g_FirmwareCr4 & MO_PLATFORM_X64_CR4_OSXSAVE)
+    {
+        ::MoPlatformWriteExtendedControlRegister(
+            MO_PLATFORM_X64_XCR_XFEATURE_ENABLED_MASK,
+            g_FirmwareXcr0);
+    }
+    ::MoPlatformWriteCr4(g_FirmwareCr4);
+    ::MoPlatformWriteCr0(g_FirmwareCr0);
+    ::MoPlatformEnableInterrupts();
+
+    g_LazyFpuInitialized = false;
+}
+
+void MoPlatformLazyFpuDemo()
+{
+    MO_UINT64 DemoStateArea = 0u;
+    if (MO_RESULT_SUCCESS_OK != ::MoPlatformInitializeLazyFpu() ||
+        MO_RESULT_SUCCESS_OK != ::MoPlatformAllocateFramePoolPage(
+            &DemoStateArea,
+            nullptr) ||
+        MO_RESULT_SUCCESS_OK != ::MoPlatformFpuInitializeContext(
+            &g_FpuManager,
+            &g_DemoFpuContext,
+            reinterpret_cast<MO_POINTER>(DemoStateArea),
+            MO_PLATFORM_X64_PAGE_SIZE))
+    {
+        ::MoPlatformWriteAsciiString(
+            "Unable to initialize the lazy FPU state switching.\r\n");
+        return;
+    }
+
+    // Switching contexts only sets CR0.TS, and the state is switched on the
+    // first floating-point instruction of each context. Switching back to the
+    // boot context and using the FPU again leaves the boot context as the
+    // owner with CR0.TS cleared before calling into the firmware.
+    volatile double Value = 1.5;
+    ::MoPlatformFpuSwitchContext(&g_FpuManager, &g_DemoFpuContext);
+    Value = Value * 2.0;
+    ::MoPlatformFpuSwitchContext(&g_FpuManager, &g_BootFpuContext);
+    Value = Value * 2.0;
+
+    MO_CONSTANT_STRING SaveMethods[] =
+    {
+        "FXSAVE",
+        "XSAVE",
+        "XSAVEOPT",
+    };
+
+    ::MoPlatformWriteAsciiString("Lazy FPU state switching: ");
+    ::MoPlatformWriteAsciiString(SaveMethods[g_FpuManager.SaveMethod]);
+    ::MoPlatformWriteAsciiString(", ");
+    ::MoPlatformWriteUnsignedInteger(g_FpuManager.StateSize);
+    ::MoPlatformWriteAsciiString(" bytes per context, ");
+    ::MoPlatformWriteUnsignedInteger(g_FpuManager.StateSwitches);
+    ::MoPlatformWriteAsciiString(" state switches.\r\n");
+}
+
+#if MOBILITY_HVLDG_FIBER_DEMO
+MO_VOID MOAPI MoPlatformFiberDemoPageFaultHandler(
+    _Mo_In_ MO_PLATFORM_X64_INTERRUPT_TYPE InterruptType,
+    _Mo_In_ PMO_PLATFORM_X64_INTERRUPT_CONTEXT InterruptContext)
+{
+    for (MO_UINTN i = 0; i < sizeof(g_FiberDemoFibers) /
+        sizeof(*g_FiberDemoFibers); ++i)
+    {
+        if (MO_RESULT_SUCCESS_OK == ::MoPlatformFiberHandleGuardPageFault(
+            &g_FiberDemoFibers[i],
+            InterruptContext))
+        {
+            g_FiberDemoFaultAddress = InterruptContext->Cr2;
+            return;
+        }
+    }
+
+    g_FiberDemoPreviousPageFaultHandler(InterruptType, InterruptContext);
+}
+
+MO_VOID MOAPI MoPlatformFiberDemoCountRoutine(
+    _Mo_In_ PMO_PLATFORM_X64_FIBER Fiber,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    MO_UNREFERENCED_PARAMETER(Context);
+
+    for (MO_UINT32 i = 0; i < MO_PLATFORM_X64_FIBER_DEMO_YIELDS; ++i)
+    {
+        ++g_FiberDemoSteps;
+        ::MoPlatformFiberYield(Fiber);
+    }
+    ++g_FiberDemoSteps;
+}
+
+MO_VOID MOAPI MoPlatformFiberDemoOverflowRoutine(
+    _Mo_In_ PMO_PLATFORM_X64_FIBER Fiber,
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    MO_UNREFERENCED_PARAMETER(Context);
+
+    // Touch the guard page while most of the stack is still free, because the
+    // firmware page-fault gate has no IST stack, and a fault with an exhausted
+    // stack would escalate to a double fault.
+    volatile MO_UINT64* Guard = reinterpret_cast<volatile MO_UINT64*>(
+        Fiber->StackBase - sizeof(MO_UINT64));
+    *Guard = 0u;
+
+    // The page-fault handler never resumes here.
+    ++g_FiberDemoSteps;
+}
+
+void MoPlatformFiberDemo()
+{
+    if (!g_PageTablesInitialized || !g_DemandZeroInitialized)
+    {
+        ::MoPlatformWriteAsciiString(
+            "Unable to run the fiber demo.\r\n");
+        return;
+    }
+
+    const MO_UINTN FiberCount =
+        sizeof(g_FiberDemoFibers) / sizeof(*g_FiberDemoFibers);
+    const MO_UINT64 StackSize =
+        MO_PLATFORM_X64_FIBER_DEMO_STACK_PAGES * MO_PLATFORM_X64_PAGE_SIZE;
+    PMO_PLATFORM_X64_FIBER_START_ROUTINE StartRoutines[] =
+    {
+        ::MoPlatformFiberDemoCountRoutine,
+        ::MoPlatformFiberDemoOverflowRoutine,
+    };
+    MO_RESULT Result = ::MoPlatformFiberInitializeCurrent(
+        &g_FiberDemoMainFiber);
+    for (MO_UINTN i = 0; MO_RESULT_SUCCESS_OK == Result && i < FiberCount; ++i)
+    {
+        // The frame pool hands out the pages in order, so the stack pages are
+        // physically contiguous unless the pool runs out.
+        MO_UINT64 PhysicalAddress = 0u;
+        for (MO_UINTN j = 0;
+            MO_RESULT_SUCCESS_OK == Result &&
+            j < MO_PLATFORM_X64_FIBER_DEMO_STACK_PAGES;
+            ++j)
+        {
+            MO_UINT64 PageAddress = 0u;
+            Result = ::MoPlatformAllocateFramePoolPage(&PageAddress, nullptr);
+            if (!j)
+            {
+                PhysicalAddress = PageAddress;
+            }
+        }
+
+        // Each stack is preceded by its unmapped guard page.
+        MO_UINT64 StackBase = 0u;
+        if (MO_RESULT_SUCCESS_OK == Result)
+        {
+            Result = ::MoPlatformFiberMapStack(
+                &StackBase,
+                &g_PageTableBuilder,
+                MO_PLATFORM_X64_FIBER_DEMO_REGION_BASE +
+                i * (StackSize + MO_PLATFORM_X64_FIBER_GUARD_PAGE_SIZE),
+                PhysicalAddress,
+                StackSize);
+        }
+        if (MO_RESULT_SUCCESS_OK == Result)
+        {
+            Result = ::MoPlatformFiberCreate(
+                &g_FiberDemoFibers[i],
+                StackBase,
+                StackSize,
+                StartRoutines[i],
+                nullptr);
+        }
+    }
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        ::MoPlatformWriteAsciiString(
+            "Unable to create the fibers.\r\n");
+        return;
+    }
+
+    // The firmware interrupt handlers may need more stack than the fibers
+    // have, so only the page faults are taken while the fibers run.
+    MO_UINTN InterruptState = ::MoPlatformSaveAndDisableInterrupts();
+    PMO_PLATFORM_X64_INTERRUPT_HANDLER* PageFaultEntry =
+        &g_PlatformContext.MoPlatformInterruptHandlers[
+            MO_PLATFORM_X64_INTERRUPT_PAGE_FAULT];
+    g_FiberDemoPreviousPageFaultHandler = *PageFaultEntry;
+    *PageFaultEntry = ::MoPlatformFiberDemoPageFaultHandler;
+
+    // Switch to the first fiber once by hand and let the join resume the
+    // rest of its yields.
+    g_FiberDemoSteps = 0u;
+    g_FiberDemoFaultAddress = 0u;
+    MO_RESULT SwitchResult = ::MoPlatformFiberSwitch(
+        &g_FiberDemoMainFiber,
+        &g_FiberDemoFibers[0]);
+    MO_UINT32 StepsAfterSwitch = g_FiberDemoSteps;
+    MO_RESULT JoinResult = ::MoPlatformFiberJoin(
+        &g_FiberDemoMainFiber,
+        &g_FiberDemoFibers[0]);
+    MO_RESULT OverflowResult = ::MoPlatformFiberJoin(
+        &g_FiberDemoMainFiber,
+        &g_FiberDemoFibers[1]);
+
+    *PageFaultEntry = g_FiberDemoPreviousPageFaultHandler;
+    ::MoPlatformRestoreInterrupts(InterruptState);
+
+    if (MO_RESULT_SUCCESS_OK != SwitchResult ||
+        1u != StepsAfterSwitch ||
+        MO_RESULT_SUCCESS_OK != JoinResult ||
+        MO_PLATFORM_X64_FIBER_DEMO_YIELDS + 1u != g_FiberDemoSteps)
+    {
+        ::MoPlatformWriteAsciiString(
+            "Fibers: switch, yield and join failed.\r\n");
+        return;
+    }
+    ::MoPlatformWriteAsciiString("Fibers: ");
+    ::MoPlatformWriteUnsignedInteger(g_FiberDemoSteps);
+    ::MoPlatformWriteAsciiString(" steps run until joined, ");
+
+    if (MO_RESULT_ERROR_UNEXPECTED != OverflowResult ||
+        MO_PLATFORM_X64_FIBER_STATE_OVERFLOWED != g_FiberDemoFibers[1].State)
+    {
+        ::MoPlatformWriteAsciiString("stack overflow not detected.\r\n");
+        return;
+    }
+    ::MoPlatformWriteAsciiString("stack overflow detected at guard page ");
+    // 19 characters: "0x" + 16 hex digits + '\0'
+    MO_CHAR AddressBuffer[19];
+    if (MO_RESULT_SUCCESS_OK == ::MoRuntimeConvertUnsignedIntegerToHexString(
+        AddressBuffer,
+        nullptr,
+        sizeof(AddressBuffer),
+        static_cast<MO_UINTN>(g_FiberDemoFaultAddress),
+        sizeof(g_FiberDemoFaultAddress) * 8u,
+        MO_TRUE,
+        MO_TRUE))
+    {
+        ::MoPlatformWriteAsciiString(AddressBuffer);
+    }
+    ::MoPlatformWriteAsciiString(".\r\n");
+}
+#endif // MOBILITY_HVLDG_FIBER_DEMO
+
+void MoPlatformWriteInterruptStatistics()
+{
+    MO_PLATFORM_X64_INTERRUPT_VECTOR_STATISTICS Statistics;
+    MO_RESULT Result = ::MoPlatformInterruptStatisticsQuery(
+        &Statistics,
+        0,
+        MO_PLATFORM_X64_INTERRUPT_STATISTICS_ALL_PROCESSORS);
+    if (MO_RESULT_ERROR_NOT_IMPLEMENTED == Result)
+    {
+        ::MoPlatformWriteAsciiString(
+            "Interrupt statistics are disabled at compile time.\r\n");
+        return;
+    }
+
+    // 5 characters: "0x" + 2 hexadecimal digits + '\0'
+    MO_CHAR VectorBuffer[5];
+
+    for (MO_PLATFORM_X64_INTERRUPT_TYPE Vector = 0;
+        Vector < MO_PLATFORM_X64_INTERRUPT_STATISTICS_VECTOR_COUNT;
+        ++Vector)
+    {
+        if (MO_RESULT_SUCCESS_OK != ::MoPlatformInterruptStatisticsQuery(
+            &Statistics,
+            Vector,
+            MO_PLATFORM_X64_INTERRUPT_STATISTICS_ALL_PROCESSORS) ||
+            !Statistics.Count)
+        {
+            continue;
+        }
+
+        ::MoPlatformWriteAsciiString("Interrupt ");
+        if (MO_RESULT_SUCCESS_OK ==
+            ::MoRuntimeConvertUnsignedIntegerToHexString(
+                VectorBuffer,
+                nullptr,
+                sizeof(VectorBuffer),
+                static_cast<MO_UINTN>(Vector),
+                8u,
+                MO_TRUE,
+                MO_TRUE))
+        {
+            ::MoPlatformWriteAsciiString(VectorBuffer);
+        }
+        else
+        {
+            ::MoPlatformWriteAsciiString("<Conversion Error>");
+        }
+        ::MoPlatformWriteAsciiString(": ");
+        ::MoPlatformWriteUnsignedInteger(Statistics.Count);
+        ::MoPlatformWriteAsciiString(" times, average ");
+        ::MoPlatformWriteUnsignedInteger(
+            Statistics.TotalCycles / Statistics.Count);
+        ::MoPlatformWriteAsciiString(" cycles, maximum ");
+        ::MoPlatformWriteUnsignedInteger(Statistics.MaximumCycles);
+        ::MoPlatformWriteAsciiString(" cycles.\r\n");
+
+        // Only list the non-empty buckets as "2^N: Count".
+        ::MoPlatformWriteAsciiString("   ");
+        for (MO_UINT32 Bucket = 0;
+            Bucket < MO_PLATFORM_X64_INTERRUPT_STATISTICS_BUCKET_COUNT;
+            ++Bucket)
+        {
+            if (!Statistics.Histogram[Bucket])
+            {
+                continue;
+            }
+            ::MoPlatformWriteAsciiString(" 2^");
+            ::MoPlatformWriteUnsignedInteger(Bucket);
+            ::MoPlatformWriteAsciiString(": ");
+            ::MoPlatformWriteUnsignedInteger(Statistics.Histogram[Bucket]);
+        }
+        ::MoPlatformWriteAsciiString("\r\n");
+    }
+}
+
+void MoPlatformWriteScreenRepaintTime(
+    _Mo_In_ MO_CONSTANT_STRING Description,
+    _Mo_In_ MO_UINT64 RepaintTime)
+{
+    ::MoPlatformWriteAsciiString(Description);
+    ::MoPlatformWriteUnsignedInteger(RepaintTime / 10);
+    ::MoPlatformWriteAsciiString(" us per full-screen repaint.\r\n");
+}
+
+void MoPlatformWriteLocalApicFeatures()
+{
+    // The firmware still owns the local APIC and its timer before exiting the
+    // boot services, so only report the features here.
+    MO_BOOL X2ApicSupported = MO_FALSE;
+    MO_BOOL TscDeadlineSupported = MO_FALSE;
+    if (MO_RESULT_SUCCESS_OK != ::MoPlatformLocalApicQueryFeatures(
+        &X2ApicSupported,
+        &TscDeadlineSupported))
+    {
+        ::MoPlatformWriteAsciiString(
+            "No local APIC is available.\r\n");
+        return;
+    }
+
+    ::MoPlatformWriteAsciiString("Local APIC: ");
+    ::MoPlatformWriteAsciiString(X2ApicSupported ? "x2APIC" : "xAPIC");
+    ::MoPlatformWriteAsciiString(
+        TscDeadlineSupported
+        ? ", TSC-deadline timer.\r\n"
+        : ", one-shot timer.\r\n");
+}
+
 /**
- * @brief The segment types for the GDT entries.
+ * @brief Points the GS base of the boot processor to its processor block, so
+ *        the per-processor data can be used before exiting the boot services.
+ * @return If the function succeeds, it returns MO_RESULT_SUCCESS_OK. Otherwise,
+ *         it returns an MO_RESULT error code.
+ * @remarks The GDT and the TSS of the block are not loaded, because they are
+ *          still owned by the firmware, and the firmware does not use the GS
+ *          base. The firmware GS base is restored by
+ *          MoPlatformDetachBootProcessorBlock.
  */
-typedef enum _MO_PLATFORM_X64_SEGMENT_TYPE
+MO_RESULT MoPlatformAttachBootProcessorBlock()
+{
+    if (g_BootProcessorBlockAttached)
+    {
+        return MO_RESULT_SUCCESS_OK;
+    }
+
+    // CPUID.01H:EBX[31:24] is the initial APIC ID of the current processor.
+    MO_PLATFORM_X64_CPUID_RESULT CpuidResult;
+    ::MoPlatformReadCpuid(&CpuidResult, 1);
+    MO_UINT64 KernelStackTop = reinterpret_cast<MO_UINT64>(
+        g_PlatformContext.KernelStack) + sizeof(g_PlatformContext.KernelStack);
+    MO_RESULT Result = ::MoPlatformProcessorBlockInitialize(
+        &g_BootProcessorBlock,
+        0u,
+        CpuidResult.Ebx >> 24,
+        KernelStackTop,
+        KernelStackTop);
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return Result;
+    }
+
+    MO_UINTN InterruptState = ::MoPlatformSaveAndDisableInterrupts();
+    g_FirmwareGsBase = ::MoPlatformReadMsr(MO_PLATFORM_X64_MSR_GS_BASE);
+    ::MoPlatformWriteMsr(
+        MO_PLATFORM_X64_MSR_GS_BASE,
+        reinterpret_cast<MO_UINT64>(&g_BootProcessorBlock));
+    ::MoPlatformRestoreInterrupts(InterruptState);
+
+    g_BootProcessorBlockAttached = true;
+    return MO_RESULT_SUCCESS_OK;
+}
+
+void MoPlatformDetachBootProcessorBlock()
+{
+    if (!g_BootProcessorBlockAttached)
+    {
+        return;
+    }
+
+    MO_UINTN InterruptState = ::MoPlatformSaveAndDisableInterrupts();
+    ::MoPlatformWriteMsr(MO_PLATFORM_X64_MSR_GS_BASE, g_FirmwareGsBase);
+    ::MoPlatformRestoreInterrupts(InterruptState);
+
+    g_BootProcessorBlockAttached = false;
+}
+
+#if MOBILITY_HVLDG_LOCAL_APIC_TIMER_DEMO
+MO_VOID MOAPI MoPlatformLocalApicTimerDemoRoutine(
+    _Mo_In_Opt_ MO_POINTER Context)
+{
+    *reinterpret_cast<volatile MO_UINT64*>(Context) =
+        ::MoPlatformReadTimeStampCounter();
+}
+
+void MoPlatformLocalApicTimerDemo()
+{
+    // The demo routes the timer interrupt through the Mobility IDT, and
+    // reports the latency with the calibrated TSC.
+    MO_UINT64 TscFrequency = g_TimeStampCounterClockSource.Frequency;
+    PMO_TIME_CLOCK_SOURCE Reference = ::MoTimeGetCurrentClockSource();
+    MO_BOOL TscDeadlineSupported = MO_FALSE;
+    if (!g_InterruptDescriptorTableInitialized ||
+        !TscFrequency ||
+        !Reference ||
+        MO_RESULT_SUCCESS_OK != ::MoPlatformLocalApicQueryFeatures(
+            nullptr,
+            &TscDeadlineSupported))
+    {
+        ::MoPlatformWriteAsciiString(
+            "Unable to run the local APIC timer demo.\r\n");
+        return;
+    }
+
+    // Keep the mode used by the firmware, because leaving the x2APIC mode
+    // needs disabling the local APIC.
+    MO_UINT64 ApicBase = ::MoPlatformReadMsr(MO_PLATFORM_X64_MSR_APIC_BASE);
+    if (!(ApicBase & MO_PLATFORM_X64_APIC_BASE_GLOBAL_ENABLE))
+    {
+        ::MoPlatformWriteAsciiString(
+            "The local APIC is disabled by the firmware.\r\n");
+        return;
+    }
+    MO_UINT32 Mode = (ApicBase & MO_PLATFORM_X64_APIC_BASE_X2APIC_ENABLE)
+        ? MO_PLATFORM_X64_APIC_MODE_X2APIC
+        : MO_PLATFORM_X64_APIC_MODE_XAPIC;
+
+    if (MO_RESULT_SUCCESS_OK != ::MoPlatformAttachBootProcessorBlock())
+    {
+        ::MoPlatformWriteAsciiString(
+            "Unable to attach the boot processor block.\r\n");
+        return;
+    }
+
+    ::MoPlatformDisableInterrupts();
+
+    // Save the firmware configuration with a descriptor in the same mode,
+    // which does not change the local APIC.
+    MO_PLATFORM_X64_LOCAL_APIC Firmware;
+    ::MoRuntimeMemoryFillByte(&Firmware, 0, sizeof(Firmware));
+    Firmware.Mode = Mode;
+    Firmware.BaseAddress = ApicBase & MO_PLATFORM_X64_APIC_BASE_ADDRESS_MASK;
+    MO_UINT32 TaskPriority = ::MoPlatformLocalApicReadRegister(
+        &Firmware,
+        MO_PLATFORM_X64_APIC_TASK_PRIORITY);
+    MO_UINT32 SpuriousInterruptVector = ::MoPlatformLocalApicReadRegister(
+        &Firmware,
+        MO_PLATFORM_X64_APIC_SPURIOUS_INTERRUPT_VECTOR);
+    MO_UINT32 TimerVectorEntry = ::MoPlatformLocalApicReadRegister(
+        &Firmware,
+        MO_PLATFORM_X64_APIC_LVT_TIMER);
+    MO_UINT32 DivideConfiguration = ::MoPlatformLocalApicReadRegister(
+        &Firmware,
+        MO_PLATFORM_X64_APIC_TIMER_DIVIDE_CONFIGURATION);
+    MO_UINT32 InitialCount = ::MoPlatformLocalApicReadRegister(
+        &Firmware,
+        MO_PLATFORM_X64_APIC_TIMER_INITIAL_COUNT);
+    MO_UINT64 Deadline = TscDeadlineSupported
+        ? ::MoPlatformReadMsr(MO_PLATFORM_X64_MSR_TSC_DEADLINE)
+        : 0u;
+    const MO_UINT8 TimerVector = MO_PLATFORM_X64_APIC_DEFAULT_TIMER_VECTOR;
+    const MO_UINT8 SpuriousVector =
+        MO_PLATFORM_X64_APIC_DEFAULT_SPURIOUS_VECTOR;
+    MO_PLATFORM_X64_IDT_GATE_DESCRIPTOR TimerGate =
+        g_PlatformContext.InterruptDescriptorTable[TimerVector];
+    MO_PLATFORM_X64_IDT_GATE_DESCRIPTOR SpuriousGate =
+        g_PlatformContext.InterruptDescriptorTable[SpuriousVector];
+
+    volatile MO_UINT64 FiredTimeStamp = 0u;
+    MO_UINT64 ArmedTimeStamp = 0u;
+    MO_RESULT Result = ::MoPlatformLocalApicInitialize(
+        &g_LocalApic,
+        Mode,
+        TimerVector,
+        SpuriousVector,
+        TscFrequency);
+    if (MO_RESULT_SUCCESS_OK == Result)
+    {
+        // Calibrating does nothing in the TSC-deadline mode.
+        Result = ::MoPlatformLocalApicCalibrateTimer(
+            &g_LocalApic,
+            Reference,
+            10000000u);
+    }
+    if (MO_RESULT_SUCCESS_OK == Result)
+    {
+        Result = ::MoPlatformLocalApicInstallHandlers(
+            &g_LocalApic,
+            g_PlatformContext.InterruptDescriptorTable,
+            g_PlatformContext.LightweightHandlers,
+            ::MoPlatformLocalApicTimerDemoRoutine,
+            const_cast<MO_UINT64*>(&FiredTimeStamp));
+    }
+    if (MO_RESULT_SUCCESS_OK == Result)
+    {
+        ArmedTimeStamp = ::MoPlatformReadTimeStampCounter();
+        Result = ::MoPlatformLocalApicArmTimer(
+            &g_LocalApic,
+            MO_PLATFORM_X64_LOCAL_APIC_TIMER_DEMO_INTERVAL);
+        while (MO_RESULT_SUCCESS_OK == Result && !FiredTimeStamp)
+        {
+            // The firmware interrupts may also wake up the processor.
+            ::MoPlatformEnableInterruptsAndHalt();
+            ::MoPlatformDisableInterrupts();
+        }
+        ::MoPlatformLocalApicUninstallHandlers(&g_LocalApic);
+    }
+
+    // Return the local APIC to the firmware with its timer masked until the
+    // counting configuration is restored.
+    ::MoPlatformLocalApicWriteRegister(
+        &Firmware,
+        MO_PLATFORM_X64_APIC_LVT_TIMER,
+        TimerVectorEntry | MO_PLATFORM_X64_APIC_LVT_MASKED);
+    ::MoPlatformLocalApicWriteRegister(
+        &Firmware,
+        MO_PLATFORM_X64_APIC_TIMER_DIVIDE_CONFIGURATION,
+        DivideConfiguration);
+    ::MoPlatformLocalApicWriteRegister(
+        &Firmware,
+        MO_PLATFORM_X64_APIC_LVT_TIMER,
+        TimerVectorEntry);
+    if (MO_PLATFORM_X64_APIC_TIMER_MODE_TSC_DEADLINE ==
+        (TimerVectorEntry & MO_PLATFORM_X64_APIC_TIMER_MODE_TSC_DEADLINE))
+    {
+        ::MoPlatformMemoryFence();
+        ::MoPlatformWriteMsr(MO_PLATFORM_X64_MSR_TSC_DEADLINE, Deadline);
+    }
+    else
+    {
+        ::MoPlatformLocalApicWriteRegister(
+            &Firmware,
+            MO_PLATFORM_X64_APIC_TIMER_INITIAL_COUNT,
+            InitialCount);
+    }
+    ::MoPlatformLocalApicWriteRegister(
+        &Firmware,
+        MO_PLATFORM_X64_APIC_SPURIOUS_INTERRUPT_VECTOR,
+        SpuriousInterruptVector);
+    ::MoPlatformLocalApicWriteRegister(
+        &Firmware,
+        MO_PLATFORM_X64_APIC_TASK_PRIORITY,
+        TaskPriority);
+    g_PlatformContext.InterruptDescriptorTable[TimerVector] = TimerGate;
+    g_PlatformContext.InterruptDescriptorTable[SpuriousVector] = SpuriousGate;
+    g_PlatformContext.LightweightHandlers[TimerVector] = nullptr;
+    g_PlatformContext.LightweightHandlers[SpuriousVector] = nullptr;
+
+    ::MoPlatformEnableInterrupts();
+    ::MoPlatformDetachBootProcessorBlock();
+
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        ::MoPlatformWriteAsciiString(
+            "Unable to arm the local APIC timer.\r\n");
+        return;
+    }
+
+    ::MoPlatformWriteAsciiString("Local APIC timer: ");
+    ::MoPlatformWriteAsciiString(
+        (MO_PLATFORM_X64_APIC_TIMER_TSC_DEADLINE == g_LocalApic.TimerMode)
+        ? "TSC-deadline"
+        : "one-shot");
+    ::MoPlatformWriteAsciiString(" timer armed for ");
+    ::MoPlatformWriteUnsignedInteger(
+        MO_PLATFORM_X64_LOCAL_APIC_TIMER_DEMO_INTERVAL / 1000);
+    ::MoPlatformWriteAsciiString(" us, fired after ");
+    ::MoPlatformWriteUnsignedInteger(
+        (FiredTimeStamp - ArmedTimeStamp) * 1000000u / TscFrequency);
+    ::MoPlatformWriteAsciiString(" us.\r\n");
+}
+#endif // MOBILITY_HVLDG_LOCAL_APIC_TIMER_DEMO
+
+#if MOBILITY_HVLDG_PROCESSOR_START_DEMO
+#if MOBILITY_HVLDG_SYSTEM_CALL_DEMO
+MO_UINT64 MOAPI MoPlatformSystemCallDemoHandler(
+    _Mo_InOut_ PMO_PLATFORM_X64_SYSTEM_CALL_FRAME Frame)
 {
-    MO_PLATFORM_X64_SEGMENT_NULL = 0x00,
-    MO_PLATFORM_X64_SEGMENT_KERNEL_CODE = 0x08,
-    MO_PLATFORM_X64_SEGMENT_KERNEL_DATA = 0x10,
-    MO_PLATFORM_X64_SEGMENT_USER_CODE = 0x18,
-    MO_PLATFORM_X64_SEGMENT_USER_DATA = 0x20,
-    MO_PLATFORM_X64_SEGMENT_TSS = 0x28,
-} MO_PLATFORM_X64_SEGMENT_TYPE, *PMO_PLATFORM_X64_SEGMENT_TYPE;
+    ++g_SystemCallDemoCalls;
+    g_SystemCallDemoReturnAddress = Frame->Rip;
+    return Frame->Arguments[0] + 1u;
+}
+
+MO_VOID MOAPI MoPlatformSystemCallDemoGeneralProtectionHandler(
+    _Mo_In_ MO_PLATFORM_X64_INTERRUPT_TYPE InterruptType,
+    _Mo_In_ PMO_PLATFORM_X64_INTERRUPT_CONTEXT InterruptContext)
+{
+    MO_UNREFERENCED_PARAMETER(InterruptType);
+
+    // The expected fault is raised in the kernel mode by the IRETQ which
+    // returns to the non-canonical address, and the result of the second
+    // system call is still in RAX. Any other fault is reported as well,
+    // because the user-mode code cannot continue after it.
+    g_SystemCallDemoResult = InterruptContext->Rax;
+    g_SystemCallDemoFaultCodeSegment = InterruptContext->Cs;
+    ::MoAtomicStore32(
+        &g_SystemCallDemoFinished,
+        1u,
+        MO_ATOMIC_ORDER_RELEASE);
+
+    // Returning to the same IRETQ would fault again, and the processor start
+    // demo returns the processor to the wait-for-SIPI state with an INIT IPI,
+    // so halt here with the interrupts disabled.
+    for (;;)
+    {
+        ::MoPlatformHalt();
+    }
+}
 
 /**
- * @brief The GDT descriptors for x64 architecture.
+ * @brief Maps the user-mode code and stack of the system call demo, and routes
+ *        the general-protection faults of the application processor to the
+ *        demo.
+ * @param Block The processor block of the application processor, which is
+ *              initialized but not started.
+ * @remarks The application processor only runs the demo after it starts if
+ *          g_SystemCallDemoEntry is not zero.
  */
-typedef struct _MO_PLATFORM_X64_GDT_DESCRIPTORS
+void MoPlatformSystemCallDemoPrepare(
+    _Mo_InOut_ PMO_PLATFORM_X64_PROCESSOR_BLOCK Block)
 {
-    MO_PLATFORM_X64_SEGMENT_DESCRIPTOR Null;
-    MO_PLATFORM_X64_SEGMENT_DESCRIPTOR KernelCode;
-    MO_PLATFORM_X64_SEGMENT_DESCRIPTOR KernelData;
-    MO_PLATFORM_X64_SEGMENT_DESCRIPTOR UserCode;
-    MO_PLATFORM_X64_SEGMENT_DESCRIPTOR UserData;
-    MO_PLATFORM_X64_SYSTEM_SEGMENT_DESCRIPTOR Tss;
-} MO_PLATFORM_X64_GDT_DESCRIPTORS, *PMO_PLATFORM_X64_GDT_DESCRIPTORS;
+    g_SystemCallDemoEntry = 0u;
+    if (!g_PageTablesInitialized || !g_InterruptDescriptorTableInitialized)
+    {
+        return;
+    }
 
-#ifndef MO_PLATFORM_X64_PAGE_SIZE
-#define MO_PLATFORM_X64_PAGE_SIZE 0x1000
-#endif // !MO_PLATFORM_X64_PAGE_SIZE
+    // The first SYSCALL is followed by more code, so it returns with SYSRET.
+    // The second one takes the result of the first one, and is the last
+    // instruction of the lower half.
+    MO_UINT8 Code[] =
+    {
+        // mov eax, 0
+        0xB8, 0x00, 0x00, 0x00, 0x00,
+        // mov edi, MO_PLATFORM_X64_SYSTEM_CALL_DEMO_ARGUMENT
+        0xBF,
+        static_cast<MO_UINT8>(MO_PLATFORM_X64_SYSTEM_CALL_DEMO_ARGUMENT),
+        static_cast<MO_UINT8>(MO_PLATFORM_X64_SYSTEM_CALL_DEMO_ARGUMENT >> 8),
+        static_cast<MO_UINT8>(MO_PLATFORM_X64_SYSTEM_CALL_DEMO_ARGUMENT >> 16),
+        static_cast<MO_UINT8>(MO_PLATFORM_X64_SYSTEM_CALL_DEMO_ARGUMENT >> 24),
+        // syscall
+        0x0F, 0x05,
+        // mov edi, eax
+        0x89, 0xC7,
+        // xor eax, eax
+        0x31, 0xC0,
+        // syscall
+        0x0F, 0x05,
+    };
 
-#ifndef MO_PLATFORM_X64_PAGE_ALIGNED
-#define MO_PLATFORM_X64_PAGE_ALIGNED \
-    MO_DECLSPEC_ALIGN(MO_PLATFORM_X64_PAGE_SIZE)
-#endif // !MO_PLATFORM_X64_PAGE_ALIGNED
+    // The pages are written through the identity mapping of the frame pool
+    // before they are mapped to the user mode.
+    MO_UINT64 CodePhysicalAddress = 0u;
+    MO_UINT64 StackPhysicalAddress = 0u;
+    MO_RESULT Result = ::MoPlatformAllocateFramePoolPage(
+        &CodePhysicalAddress,
+        nullptr);
+    if (MO_RESULT_SUCCESS_OK == Result)
+    {
+        Result = ::MoPlatformAllocateFramePoolPage(
+            &StackPhysicalAddress,
+            nullptr);
+    }
+    if (MO_RESULT_SUCCESS_OK == Result)
+    {
+        Result = ::MoRuntimeMemoryMove(
+            reinterpret_cast<MO_POINTER>(
+                CodePhysicalAddress + MO_PLATFORM_X64_PAGE_SIZE - sizeof(Code)),
+            Code,
+            sizeof(Code));
+    }
+    if (MO_RESULT_SUCCESS_OK == Result)
+    {
+        Result = ::MoPlatformPageTableMapRange(
+            &g_PageTableBuilder,
+            MO_PLATFORM_X64_SYSTEM_CALL_DEMO_CODE_PAGE,
+            CodePhysicalAddress,
+            MO_PLATFORM_X64_PAGE_SIZE,
+            MO_PLATFORM_X64_PAGE_ATTRIBUTE_USER,
+            MO_PLATFORM_X64_PAGE_CACHE_WRITE_BACK);
+    }
+    if (MO_RESULT_SUCCESS_OK == Result)
+    {
+        Result = ::MoPlatformPageTableMapRange(
+            &g_PageTableBuilder,
+            MO_PLATFORM_X64_SYSTEM_CALL_DEMO_STACK_PAGE,
+            StackPhysicalAddress,
+            MO_PLATFORM_X64_PAGE_SIZE,
+            MO_PLATFORM_X64_PAGE_ATTRIBUTE_WRITABLE |
+            MO_PLATFORM_X64_PAGE_ATTRIBUTE_USER,
+            MO_PLATFORM_X64_PAGE_CACHE_WRITE_BACK);
+    }
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        return;
+    }
 
-#define MO_PLATFORM_X64_CONSOLE_WIDTH 128
-#define MO_PLATFORM_X64_CONSOLE_HEIGHT 40
+    // The gates copied from the firmware use the firmware code selector, so
+    // the application processor loads its own copy of the IDT, whose
+    // general-protection gate uses the selector of its GDT. The gate of the
+    // boot processor is not changed, so only the application processor calls
+    // the demo handler.
+    ::MoRuntimeMemoryMove(
+        g_SystemCallDemoInterruptDescriptorTable,
+        g_PlatformContext.InterruptDescriptorTable,
+        sizeof(g_SystemCallDemoInterruptDescriptorTable));
+    PMO_PLATFORM_X64_IDT_GATE_DESCRIPTOR Gate =
+        &g_SystemCallDemoInterruptDescriptorTable[
+            MO_PLATFORM_X64_INTERRUPT_GENERAL_PROTECTION];
+    ::MoPlatformSetInterruptEntry(
+        g_SystemCallDemoInterruptDescriptorTable,
+        MO_PLATFORM_X64_INTERRUPT_GENERAL_PROTECTION,
+        MO_PLATFORM_X64_INTERRUPT_ENTRY_FULL);
+    Gate->Selector = MO_PLATFORM_X64_SEGMENT_KERNEL_CODE;
+    Gate->IST = 0;
+    Block->InterruptDescriptorTable.Limit = static_cast<MO_UINT16>(
+        sizeof(g_SystemCallDemoInterruptDescriptorTable) - 1);
+    Block->InterruptDescriptorTable.Base = reinterpret_cast<MO_UINT64>(
+        g_SystemCallDemoInterruptDescriptorTable);
 
-#define MO_PLATFORM_X64_CONSOLE_SIZE \
-    (MO_PLATFORM_X64_CONSOLE_WIDTH * MO_PLATFORM_X64_CONSOLE_HEIGHT)
+    PMO_PLATFORM_X64_INTERRUPT_HANDLER* GeneralProtectionEntry =
+        &g_PlatformContext.MoPlatformInterruptHandlers[
+            MO_PLATFORM_X64_INTERRUPT_GENERAL_PROTECTION];
+    g_SystemCallDemoPreviousHandler = *GeneralProtectionEntry;
+    *GeneralProtectionEntry =
+        ::MoPlatformSystemCallDemoGeneralProtectionHandler;
+
+    g_SystemCallDemoHandlers[0] = ::MoPlatformSystemCallDemoHandler;
+    g_SystemCallDemoCalls = 0u;
+    g_SystemCallDemoReturnAddress = 0u;
+    g_SystemCallDemoResult = 0u;
+    g_SystemCallDemoFaultCodeSegment = 0u;
+    g_SystemCallDemoFinished = 0u;
+    g_SystemCallDemoEntry = MO_PLATFORM_X64_SYSTEM_CALL_DEMO_CODE_PAGE +
+        MO_PLATFORM_X64_PAGE_SIZE - sizeof(Code);
+}
 
 /**
- * @brief The platform-specific context for x64 architecture.
+ * @brief Enters the user-mode code of the system call demo on the application
+ *        processor, and never returns unless SYSCALL cannot be enabled.
  */
-typedef struct MO_PLATFORM_X64_PAGE_ALIGNED _MO_PLATFORM_X64_PLATFORM_CONTEXT
+void MoPlatformSystemCallDemoEnterUserMode()
 {
-    // Area 1 (64 KiB)
+    if (MO_RESULT_SUCCESS_OK != ::MoPlatformSystemCallInitialize(
+        g_SystemCallDemoHandlers,
+        sizeof(g_SystemCallDemoHandlers) / sizeof(*g_SystemCallDemoHandlers)))
+    {
+        ::MoAtomicStore32(
+            &g_SystemCallDemoFinished,
+            1u,
+            MO_ATOMIC_ORDER_RELEASE);
+        return;
+    }
 
-    MO_MEMORY_SMALL_HEAP InternalHeap;
+    // The frames on the kernel stack are abandoned, because the SYSCALL entry
+    // starts again from the top of the kernel stack.
+    ::MoPlatformDisableInterrupts();
+    ::MoPlatformEnterUserMode(
+        g_SystemCallDemoEntry,
+        MO_PLATFORM_X64_SYSTEM_CALL_DEMO_STACK_PAGE + MO_PLATFORM_X64_PAGE_SIZE,
+        0u);
+}
 
-    // Area 2 (64 KiB)
+/**
+ * @brief Restores the general-protection fault handler after the application
+ *        processor of the system call demo is returned to the wait-for-SIPI
+ *        state.
+ */
+void MoPlatformSystemCallDemoRestore()
+{
+    if (!g_SystemCallDemoEntry)
+    {
+        return;
+    }
 
-    // Due to the x86 page table design, we can use PML4 Entry (PML4E) page as
-    // the protection page for protecting the platform context from the
-    // corrupted internal heap.
-    MO_PLATFORM_X64_PAGE_DIRECTORY_ENTRY PageMapLevel4Entry[512];
+    g_PlatformContext.MoPlatformInterruptHandlers[
+        MO_PLATFORM_X64_INTERRUPT_GENERAL_PROTECTION] =
+            g_SystemCallDemoPreviousHandler;
+}
 
-    MO_PLATFORM_X64_PAGE_DIRECTORY_ENTRY PageDirectoryPointerEntry[512];
+void MoPlatformWriteSystemCallDemoResult()
+{
+    if (!g_SystemCallDemoEntry)
+    {
+        ::MoPlatformWriteAsciiString(
+            "Unable to run the system call demo.\r\n");
+        return;
+    }
 
-    MO_PLATFORM_X64_PAGE_TABLE_ENTRY PageTableEntry[512 * 4];
+    // SYSCALL saves the address of the next instruction, which is the first
+    // non-canonical address after the second system call.
+    const MO_UINT64 ExpectedReturnAddress =
+        MO_PLATFORM_X64_SYSTEM_CALL_DEMO_CODE_PAGE + MO_PLATFORM_X64_PAGE_SIZE;
+    const MO_UINT64 ExpectedResult =
+        MO_PLATFORM_X64_SYSTEM_CALL_DEMO_ARGUMENT + 2u;
+    if (!::MoAtomicLoad32(&g_SystemCallDemoFinished, MO_ATOMIC_ORDER_ACQUIRE) ||
+        2u != g_SystemCallDemoCalls ||
+        ExpectedReturnAddress != g_SystemCallDemoReturnAddress ||
+        (g_SystemCallDemoFaultCodeSegment & 3u) ||
+        ExpectedResult != g_SystemCallDemoResult)
+    {
+        ::MoPlatformWriteAsciiString(
+            "System calls: SYSRET or IRETQ return failed.\r\n");
+        return;
+    }
+    ::MoPlatformWriteAsciiString("System calls: ");
+    ::MoPlatformWriteUnsignedInteger(g_SystemCallDemoCalls);
+    ::MoPlatformWriteAsciiString(
+        " calls returned with SYSRET and with IRETQ to a non-canonical"
+        " address.\r\n");
+}
+#endif // MOBILITY_HVLDG_SYSTEM_CALL_DEMO
 
-    HV_MESSAGE_PAGE InterruptMessagePage;
+MO_VOID MOAPI MoPlatformProcessorStartDemoRoutine(
+    _Mo_In_ PMO_PLATFORM_X64_PROCESSOR_BLOCK Block)
+{
+    // Read the index through the GS base instead of the parameter, so the
+    // report also checks that the processor block is loaded.
+    ::MoAtomicStore32(
+        reinterpret_cast<volatile MO_UINT32*>(Block->Context),
+        ::MoPlatformGetCurrentProcessorBlock()->ProcessorIndex,
+        MO_ATOMIC_ORDER_RELEASE);
 
-    HV_SYNIC_EVENT_FLAGS_PAGE InterruptEventFlagsPage;
+#if MOBILITY_HVLDG_SYSTEM_CALL_DEMO
+    if (g_SystemCallDemoEntry)
+    {
+        ::MoPlatformSystemCallDemoEnterUserMode();
+    }
+#endif // MOBILITY_HVLDG_SYSTEM_CALL_DEMO
+}
 
-    MO_UINT8 Reserved0_0[MO_PLATFORM_X64_PAGE_SIZE * 2];
+void MoPlatformProcessorStartDemo(
+    _Mo_In_ EFI_BOOT_SERVICES* BootServices,
+    _Mo_In_ PMO_UEFI_ACPI_PROCESSOR_ITEM Processors,
+    _Mo_In_ MO_UINTN ProcessorCount)
+{
+    MO_UINT64 ApicBase = ::MoPlatformReadMsr(MO_PLATFORM_X64_MSR_APIC_BASE);
+    if (!::MoTimeGetCurrentClockSource() ||
+        !(ApicBase & MO_PLATFORM_X64_APIC_BASE_GLOBAL_ENABLE))
+    {
+        ::MoPlatformWriteAsciiString(
+            "Unable to run the processor start demo.\r\n");
+        return;
+    }
 
-    MO_UINT8 Reserved0_1[2048];
-    PMO_PLATFORM_X64_INTERRUPT_HANDLER MoPlatformInterruptHandlers[256];
+    // Only the interrupt command register is used, so a descriptor in the
+    // firmware mode is enough and the local APIC is not changed.
+    MO_PLATFORM_X64_LOCAL_APIC Apic;
+    ::MoRuntimeMemoryFillByte(&Apic, 0, sizeof(Apic));
+    Apic.Mode = (ApicBase & MO_PLATFORM_X64_APIC_BASE_X2APIC_ENABLE)
+        ? MO_PLATFORM_X64_APIC_MODE_X2APIC
+        : MO_PLATFORM_X64_APIC_MODE_XAPIC;
+    Apic.BaseAddress = ApicBase & MO_PLATFORM_X64_APIC_BASE_ADDRESS_MASK;
 
-    MO_PLATFORM_X64_IDT_GATE_DESCRIPTOR InterruptDescriptorTable[256];
+    MO_UINT32 BootApicId = ::MoPlatformLocalApicGetId(&Apic);
+    MO_UINTN Target = 0u;
+    while (Target < ProcessorCount && BootApicId == Processors[Target].ApicId)
+    {
+        ++Target;
+    }
+    if (Target >= ProcessorCount)
+    {
+        ::MoPlatformWriteAsciiString(
+            "No application processors to start.\r\n");
+        return;
+    }
 
-    MO_PLATFORM_X64_GDT_DESCRIPTORS GlobalDescriptorTable;
-    MO_PLATFORM_X64_TASK_STATE_SEGMENT TaskStateSegment;
-    MO_DISPLAY_BGRA32_FRAMEBUFFER DisplayFrameBuffer;
-    bool HypercallInitialized;
-    MO_UINT8 Reserved1_0[7];
-    MO_UINT8 Reserved1_1[40];
-    MO_CONSOLE_SCREEN_BUFFER ConsoleScreenBuffer;
-    MO_UINT8 Reserved1_2[512];
-    MO_UINT8 Reserved2[1024];
-    MO_WIDE_CHAR ConsoleCharacterBuffer[MO_PLATFORM_X64_CONSOLE_SIZE];
+    // The trampoline must be in the first 1 MiB, and the stacks are identity
+    // mapped by both the firmware and the Mobility page tables.
+    EFI_PHYSICAL_ADDRESS TrampolineBase =
+        MO_PLATFORM_X64_SMP_TRAMPOLINE_MAXIMUM_ADDRESS - 1;
+    if (EFI_SUCCESS != BootServices->AllocatePages(
+        AllocateMaxAddress,
+        EfiLoaderData,
+        MO_PLATFORM_X64_SMP_TRAMPOLINE_PAGES,
+        &TrampolineBase))
+    {
+        ::MoPlatformWriteAsciiString(
+            "Unable to allocate the trampoline below 1 MiB.\r\n");
+        return;
+    }
+    EFI_PHYSICAL_ADDRESS StackBase = 0u;
+    if (EFI_SUCCESS != BootServices->AllocatePages(
+        AllocateAnyPages,
+        EfiLoaderData,
+        MO_PLATFORM_X64_PROCESSOR_START_DEMO_STACK_PAGES * 2,
+        &StackBase))
+    {
+        BootServices->FreePages(
+            TrampolineBase,
+            MO_PLATFORM_X64_SMP_TRAMPOLINE_PAGES);
+        ::MoPlatformWriteAsciiString(
+            "Unable to allocate the application processor stacks.\r\n");
+        return;
+    }
+    MO_UINT64 KernelStackTop = StackBase +
+        MO_PLATFORM_X64_PROCESSOR_START_DEMO_STACK_PAGES *
+        MO_PLATFORM_X64_PAGE_SIZE;
+    MO_UINT64 InterruptStackTop = KernelStackTop +
+        MO_PLATFORM_X64_PROCESSOR_START_DEMO_STACK_PAGES *
+        MO_PLATFORM_X64_PAGE_SIZE;
 
-    // According to the Hyper-V hypercall page are readable and executable
-    // but not writable by the guest from Hypervisor Top Level Functional
-    // Specification 6.0b, we can use Hyper-V hypercall page here as the
-    // protection page for protecting the platform context from corrupting
-    // via the kernel stack overflow.
-    MO_UINT8 HypercallPage[MO_PLATFORM_X64_PAGE_SIZE];
+    // The bootstrap processor is zero by convention, so the reported index
+    // starts as zero until the application processor overwrites it.
+    const MO_UINT32 ProcessorIndex = 1u;
+    volatile MO_UINT32 ReportedIndex = 0u;
+    bool StartRequested = false;
+    MO_RESULT Result = ::MoPlatformSmpPrepareTrampoline(TrampolineBase);
+    if (MO_RESULT_SUCCESS_OK == Result)
+    {
+        Result = ::MoPlatformProcessorBlockInitialize(
+            &g_ApplicationProcessorBlock,
+            ProcessorIndex,
+            Processors[Target].ApicId,
+            KernelStackTop,
+            InterruptStackTop);
+    }
+#if MOBILITY_HVLDG_SYSTEM_CALL_DEMO
+    if (MO_RESULT_SUCCESS_OK == Result)
+    {
+        ::MoPlatformSystemCallDemoPrepare(&g_ApplicationProcessorBlock);
+    }
+#endif // MOBILITY_HVLDG_SYSTEM_CALL_DEMO
+    if (MO_RESULT_SUCCESS_OK == Result)
+    {
+        StartRequested = true;
+        Result = ::MoPlatformSmpStartProcessor(
+            &Apic,
+            TrampolineBase,
+            &g_ApplicationProcessorBlock,
+            ::MoPlatformProcessorStartDemoRoutine,
+            const_cast<MO_UINT32*>(&ReportedIndex));
+    }
+    if (MO_RESULT_SUCCESS_OK == Result)
+    {
+        // The routine is called after the processor reports that it has
+        // started, so wait for the report with the same timeout.
+        ::MoTimeUpdate();
+        MO_UINT64 Deadline = ::MoTimeGetMonotonicNanoseconds() +
+            MO_PLATFORM_X64_SMP_STARTUP_TIMEOUT;
+        while (ProcessorIndex != ::MoAtomicLoad32(
+            &ReportedIndex,
+            MO_ATOMIC_ORDER_ACQUIRE))
+        {
+            ::MoTimeUpdate();
+            if (::MoTimeGetMonotonicNanoseconds() >= Deadline)
+            {
+                Result = MO_RESULT_ERROR_NO_INTERFACE;
+                break;
+            }
+            ::MoPlatformPause();
+        }
 
-    // Area 3 (64 KiB)
+#if MOBILITY_HVLDG_SYSTEM_CALL_DEMO
+        // The processor enters the user mode after the report, so wait for the
+        // system calls with the same timeout before it is returned.
+        ::MoTimeUpdate();
+        Deadline = ::MoTimeGetMonotonicNanoseconds() +
+            MO_PLATFORM_X64_SMP_STARTUP_TIMEOUT;
+        while (MO_RESULT_SUCCESS_OK == Result &&
+            g_SystemCallDemoEntry &&
+            !::MoAtomicLoad32(
+                &g_SystemCallDemoFinished,
+                MO_ATOMIC_ORDER_ACQUIRE))
+        {
+            ::MoTimeUpdate();
+            if (::MoTimeGetMonotonicNanoseconds() >= Deadline)
+            {
+                break;
+            }
+            ::MoPlatformPause();
+        }
+#endif // MOBILITY_HVLDG_SYSTEM_CALL_DEMO
+    }
 
-    MO_UINT8 KernelStack[MO_PLATFORM_X64_PAGE_SIZE * 16];
-} MO_PLATFORM_X64_PLATFORM_CONTEXT, *PMO_PLATFORM_X64_PLATFORM_CONTEXT;
+    // Return the processor to the wait-for-SIPI state, so the firmware can
+    // start it again, and its stacks and the trampoline are no longer used.
+    // The INIT IPI is also sent if the processor has not reported, because it
+    // may still be running the trampoline.
+    if (StartRequested && MO_RESULT_SUCCESS_OK !=
+        ::MoPlatformLocalApicSendInterProcessorInterrupt(
+            &Apic,
+            Processors[Target].ApicId,
+            MO_PLATFORM_X64_APIC_COMMAND_INIT))
+    {
+        // The processor may still use the memory, so leak it.
+        ::MoPlatformWriteAsciiString(
+            "Unable to return the application processor.\r\n");
+        return;
+    }
+    if (StartRequested)
+    {
+        // Give the INIT IPI the same delay as the startup sequence before the
+        // memory is returned to the firmware.
+        ::MoTimeUpdate();
+        MO_UINT64 Deadline = ::MoTimeGetMonotonicNanoseconds() +
+            MO_PLATFORM_X64_SMP_INIT_DELAY;
+        while (::MoTimeGetMonotonicNanoseconds() < Deadline)
+        {
+            ::MoPlatformPause();
+            ::MoTimeUpdate();
+        }
+    }
+#if MOBILITY_HVLDG_SYSTEM_CALL_DEMO
+    ::MoPlatformSystemCallDemoRestore();
+#endif // MOBILITY_HVLDG_SYSTEM_CALL_DEMO
+    BootServices->FreePages(
+        StackBase,
+        MO_PLATFORM_X64_PROCESSOR_START_DEMO_STACK_PAGES * 2);
+    BootServices->FreePages(
+        TrampolineBase,
+        MO_PLATFORM_X64_SMP_TRAMPOLINE_PAGES);
 
-namespace
-{
-    MO_PLATFORM_X64_PLATFORM_CONTEXT g_PlatformContext;
-    const char g_LogoString[] =
-        "Mobility Hyper-V Lightweight Debugger for Guests"
-        " " MOBILITY_MINUAP_VERSION_UTF8_STRING "\r\n"
-        "(c) Kenji Mouri. All rights reserved.\r\n"
-        "\r\n";
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        ::MoPlatformWriteAsciiString(
+            "Unable to start the application processor.\r\n");
+        return;
+    }
+
+    ::MoPlatformWriteAsciiString("Application processor ");
+    ::MoPlatformWriteUnsignedInteger(Processors[Target].ApicId);
+    ::MoPlatformWriteAsciiString(" started with processor index ");
+    ::MoPlatformWriteUnsignedInteger(ReportedIndex);
+    ::MoPlatformWriteAsciiString(".\r\n");
+
+#if MOBILITY_HVLDG_SYSTEM_CALL_DEMO
+    ::MoPlatformWriteSystemCallDemoResult();
+#endif // MOBILITY_HVLDG_SYSTEM_CALL_DEMO
 }
+#endif // MOBILITY_HVLDG_PROCESSOR_START_DEMO
 
-MO_EXTERN_C MO_RESULT MOAPI MoPlatformHeapAllocate(
-    _Mo_Out_ PMO_POINTER Block,
-    _Mo_In_ MO_UINTN Size)
+void MoPlatformWriteProcessors(
+    _Mo_In_ EFI_BOOT_SERVICES* BootServices,
+    _Mo_In_ PMO_UEFI_ACPI_TABLE_INDEX AcpiTableIndex)
 {
-    // Additional check to ensure Size fits in MO_UINT16.
-    if (Size > MO_UINT16_MAX)
+    // The firmware still owns the application processors before exiting the
+    // boot services, so only report the processors described by the MADT
+    // unless the processor start demo is enabled.
+    MO_UINTN ProcessorCount = 0u;
+    MO_UINTN RequiredCount = 0u;
+    MO_RESULT Result = ::MoUefiAcpiCollectProcessors(
+        nullptr,
+        &RequiredCount,
+        &ProcessorCount,
+        0u,
+        AcpiTableIndex);
+    if (MO_RESULT_ERROR_OUT_OF_MEMORY != Result)
     {
-        return MO_RESULT_ERROR_OUT_OF_MEMORY;
+        ::MoPlatformWriteAsciiString(
+            "No processors found from ACPI MADT.\r\n");
+        return;
     }
 
-    return ::MoMemorySmallHeapAllocate(
-        Block,
-        &g_PlatformContext.InternalHeap,
-        static_cast<MO_UINT16>(Size));
+    // Size the buffer from the required count, so all processors are listed
+    // without a fixed limit.
+    PMO_UEFI_ACPI_PROCESSOR_ITEM Processors = nullptr;
+    if (EFI_SUCCESS != BootServices->AllocatePool(
+        EfiLoaderData,
+        RequiredCount * sizeof(MO_UEFI_ACPI_PROCESSOR_ITEM),
+        reinterpret_cast<VOID**>(&Processors)))
+    {
+        ::MoPlatformWriteAsciiString(
+            "Unable to allocate the processor list.\r\n");
+        return;
+    }
+    Result = ::MoUefiAcpiCollectProcessors(
+        Processors,
+        nullptr,
+        &ProcessorCount,
+        RequiredCount,
+        AcpiTableIndex);
+    if (MO_RESULT_SUCCESS_OK != Result)
+    {
+        BootServices->FreePool(Processors);
+        ::MoPlatformWriteAsciiString(
+            "No processors found from ACPI MADT.\r\n");
+        return;
+    }
+
+    ::MoPlatformWriteAsciiString("Processors: ");
+    ::MoPlatformWriteUnsignedInteger(ProcessorCount);
+    ::MoPlatformWriteAsciiString(", APIC IDs:");
+    for (MO_UINTN i = 0; i < ProcessorCount; ++i)
+    {
+        ::MoPlatformWriteAsciiString(" ");
+        ::MoPlatformWriteUnsignedInteger(Processors[i].ApicId);
+    }
+    ::MoPlatformWriteAsciiString(".\r\n");
+
+#if MOBILITY_HVLDG_PROCESSOR_START_DEMO
+    ::MoPlatformProcessorStartDemo(BootServices, Processors, ProcessorCount);
+#endif // MOBILITY_HVLDG_PROCESSOR_START_DEMO
+
+    BootServices->FreePool(Processors);
 }
 
-MO_EXTERN_C MO_RESULT MOAPI MoPlatformHeapFree(
-    _Mo_In_ MO_POINTER Block)
+void MoPlatformInitializeClockSources(
+    _Mo_In_ PMO_UEFI_ACPI_TABLE_INDEX AcpiTableIndex)
 {
-    return ::MoMemorySmallHeapFree(&g_PlatformContext.InternalHeap, Block);
+    MO_UINT16 PowerManagementTimerPort = 0u;
+    MO_BOOL PowerManagementTimerExtended = MO_FALSE;
+    if (MO_RESULT_SUCCESS_OK == ::MoUefiAcpiQueryPowerManagementTimer(
+        &PowerManagementTimerPort,
+        &PowerManagementTimerExtended,
+        AcpiTableIndex) &&
+        MO_RESULT_SUCCESS_OK ==
+        ::MoPlatformInitializePowerManagementTimerClockSource(
+            &g_PowerManagementTimerClockSource,
+            PowerManagementTimerPort,
+            PowerManagementTimerExtended))
+    {
+        ::MoTimeRegisterClockSource(&g_PowerManagementTimerClockSource);
+    }
+
+    if (MO_RESULT_SUCCESS_OK == ::MoHyperVInitializeReferenceClockSource(
+        &g_HyperVReferenceClockSource))
+    {
+        ::MoTimeRegisterClockSource(&g_HyperVReferenceClockSource);
+    }
+
+    MO_UINT64 HighPrecisionEventTimerBase = 0u;
+    if (MO_RESULT_SUCCESS_OK == ::MoUefiAcpiQueryHighPrecisionEventTimer(
+        &HighPrecisionEventTimerBase,
+        AcpiTableIndex) &&
+        MO_RESULT_SUCCESS_OK ==
+        ::MoPlatformInitializeHighPrecisionEventTimerClockSource(
+            &g_HighPrecisionEventTimerClockSource,
+            &g_HighPrecisionEventTimerConfiguration,
+            HighPrecisionEventTimerBase))
+    {
+        g_HighPrecisionEventTimerInitialized = true;
+        ::MoTimeRegisterClockSource(&g_HighPrecisionEventTimerClockSource);
+    }
+
+    if (MO_RESULT_SUCCESS_OK ==
+        ::MoPlatformInitializeTimeStampCounterClockSource(
+            &g_TimeStampCounterClockSource,
+            0u))
+    {
+        // Calibrate the TSC against the best reference for 50 milliseconds,
+        // and only trust the nominal frequency if there is no reference.
+        PMO_TIME_CLOCK_SOURCE Reference = ::MoTimeGetCurrentClockSource();
+        if (!Reference ||
+            MO_RESULT_SUCCESS_OK != ::MoTimeCalibrateFrequency(
+                &g_TimeStampCounterClockSource.Frequency,
+                &g_TimeStampCounterClockSource,
+                Reference,
+                50000000u))
+        {
+            ::MoPlatformQueryTimeStampCounterFrequency(
+                &g_TimeStampCounterClockSource.Frequency);
+        }
+        if (g_TimeStampCounterClockSource.Frequency)
+        {
+            ::MoTimeRegisterClockSource(&g_TimeStampCounterClockSource);
+        }
+    }
+
+    PMO_TIME_CLOCK_SOURCE Current = ::MoTimeGetCurrentClockSource();
+    if (!Current)
+    {
+        ::MoPlatformWriteAsciiString(
+            "No clock source is available.\r\n");
+        return;
+    }
+
+    ::MoPlatformWriteAsciiString("Clock source: ");
+    ::MoPlatformWriteAsciiString(Current->Name);
+    ::MoPlatformWriteAsciiString(", ");
+    ::MoPlatformWriteUnsignedInteger(Current->Frequency);
+    ::MoPlatformWriteAsciiString(" Hz.\r\n");
 }
 
-MO_EXTERN_C MO_RESULT MOAPI MoPlatformHeapReallocate(
-    _Mo_Out_ PMO_POINTER UpdatedBlock,
-    _Mo_In_Opt_ MO_POINTER Block,
-    _Mo_In_ MO_UINTN NewSize)
+void MoPlatformRestoreClockSources()
 {
-    // Additional check to ensure NewSize fits in MO_UINT16.
-    if (NewSize > MO_UINT16_MAX)
+    if (!g_HighPrecisionEventTimerInitialized)
     {
-        return MO_RESULT_ERROR_OUT_OF_MEMORY;
+        return;
     }
 
-    return ::MoMemorySmallHeapReallocate(
-        UpdatedBlock,
-        &g_PlatformContext.InternalHeap,
-        Block,
-        static_cast<MO_UINT16>(NewSize));
+    // The HPET is owned by the firmware, so halt the main counter again if
+    // the firmware left it halted.
+    ::MoPlatformDeinitializeHighPrecisionEventTimerClockSource(
+        &g_HighPrecisionEventTimerClockSource,
+        g_HighPrecisionEventTimerConfiguration);
+    g_HighPrecisionEventTimerInitialized = false;
 }
 
-MO_EXTERN_C MO_VOID MOAPI MoPlatformWriteAsciiString(
-    _Mo_In_ MO_CONSTANT_STRING String)
+MO_VOID MOAPI MoPlatformZeroPlatformContextPages(
+    _Mo_In_ MO_UINTN Begin,
+    _Mo_In_ MO_UINTN End,
+    _Mo_In_Opt_ MO_POINTER Context)
 {
-    ::MoConsoleCoreWriteString(
-        &g_PlatformContext.ConsoleScreenBuffer,
-        String,
-        static_cast<MO_UINT32>(::MoRuntimeStringLength(String)));
-    ::MoConsoleCoreRefreshScreen(
-        &g_PlatformContext.DisplayFrameBuffer,
-        &g_PlatformContext.ConsoleScreenBuffer);
+    MO_UNREFERENCED_PARAMETER(Context);
+
+    ::MoRuntimeMemoryFillByte(
+        reinterpret_cast<PMO_UINT8>(&g_PlatformContext) +
+        (Begin * MO_PLATFORM_X64_PAGE_SIZE),
+        0,
+        (End - Begin) * MO_PLATFORM_X64_PAGE_SIZE);
 }
 
 MO_EXTERN_C MO_RESULT MOAPI MoPlatformInitialize(
     _Mo_In_ EFI_BOOT_SERVICES* BootServices)
 {
-    if (MO_RESULT_SUCCESS_OK != ::MoRuntimeMemoryFillByte(
-        &g_PlatformContext,
-        0,
-        sizeof(MO_PLATFORM_X64_PLATFORM_CONTEXT)))
+    // The platform context is page aligned and sized, so it can be zeroed by
+    // all processors in page granularity before exiting the boot services.
+    if (MO_RESULT_SUCCESS_OK != ::MoUefiMpDispatchWork(
+        nullptr,
+        BootServices,
+        sizeof(MO_PLATFORM_X64_PLATFORM_CONTEXT) / MO_PLATFORM_X64_PAGE_SIZE,
+        4,
+        ::MoPlatformZeroPlatformContextPages,
+        nullptr))
     {
         // This function should not fail here.
         return MO_RESULT_ERROR_UNEXPECTED;
@@ -206,6 +2226,19 @@ MO_EXTERN_C MO_RESULT MOAPI MoPlatformInitialize(
         return MO_RESULT_ERROR_UNEXPECTED;
     }
 
+    {
+        EFI_PHYSICAL_ADDRESS FramePoolAddress = 0u;
+        if (EFI_SUCCESS == BootServices->AllocatePages(
+            AllocateAnyPages,
+            EfiLoaderData,
+            MO_PLATFORM_X64_FRAME_POOL_PAGES,
+            &FramePoolAddress))
+        {
+            g_FramePoolAddress = FramePoolAddress;
+            g_FramePoolAllocatedPages = 0u;
+        }
+    }
+
     // PageMapLevel4Entry
     // PageDirectoryPointerEntry
     // PageTableEntry
@@ -250,6 +2283,45 @@ void SimpleDemo(
     }
     ::MoPlatformWriteAsciiString(g_LogoString);
 
+    if (MO_RESULT_SUCCESS_OK == ::MoHyperVCheckAvailability())
+    {
+        // Read the partition reference time from the reference TSC page, so
+        // the time measurements do not exit to the hypervisor.
+        if (!::MoHyperVSetReferenceTscPage(reinterpret_cast<MO_UINT64>(
+            &g_PlatformContext.ReferenceTscPage)))
+        {
+            ::MoPlatformWriteAsciiString(
+                "Unable to enable the Hyper-V reference TSC page.\r\n");
+        }
+
+        MO_UINT64 RepaintTime = ::MoPlatformMeasureScreenRepaintTime();
+        if (MO_RESULT_SUCCESS_OK == ::MoPlatformInitializePageTables())
+        {
+            ::MoPlatformWriteScreenRepaintTime(
+                "Firmware frame buffer mapping: ",
+                RepaintTime);
+            RepaintTime = ::MoPlatformMeasureScreenRepaintTime();
+            ::MoPlatformWriteScreenRepaintTime(
+                "Write-combining frame buffer mapping: ",
+                RepaintTime);
+
+            ::MoPlatformDemandZeroSessionDemo();
+            ::MoPlatformLazyFpuDemo();
+#if MOBILITY_HVLDG_FIBER_DEMO
+            ::MoPlatformFiberDemo();
+#endif // MOBILITY_HVLDG_FIBER_DEMO
+            ::MoPlatformWriteInterruptStatistics();
+        }
+        else
+        {
+            ::MoPlatformWriteAsciiString(
+                "Unable to map the frame buffer as write-combining.\r\n");
+            ::MoPlatformWriteScreenRepaintTime(
+                "Firmware frame buffer mapping: ",
+                RepaintTime);
+        }
+    }
+
     MO_UINT64 ExtendedSystemDescriptionTable = 0u;
     if (MO_RESULT_SUCCESS_OK != ::MoUefiAcpiQueryExtendedSystemDescriptionTable(
         &ExtendedSystemDescriptionTable,
@@ -262,12 +2334,32 @@ void SimpleDemo(
     ::MoPlatformWriteAsciiString(
         "ACPI XSDT is located successfully.\r\n");
 
+    MO_UEFI_ACPI_TABLE_INDEX AcpiTableIndex;
+    MO_RESULT IndexResult = ::MoUefiAcpiTableIndexInitialize(
+        &AcpiTableIndex,
+        ExtendedSystemDescriptionTable);
+    if (MO_RESULT_SUCCESS_OK != IndexResult &&
+        MO_RESULT_SUCCESS_FALSE != IndexResult)
+    {
+        ::MoPlatformWriteAsciiString(
+            "Unable to index ACPI description tables.\r\n");
+        return;
+    }
+
+    ::MoPlatformInitializeClockSources(&AcpiTableIndex);
+    ::MoPlatformWriteLocalApicFeatures();
+#if MOBILITY_HVLDG_LOCAL_APIC_TIMER_DEMO
+    ::MoPlatformLocalApicTimerDemo();
+#endif // MOBILITY_HVLDG_LOCAL_APIC_TIMER_DEMO
+    ::MoPlatformWriteProcessors(SystemTable->BootServices, &AcpiTableIndex);
+
     MO_UINT64 SystemResourceAffinityTable = 0u;
-    if (MO_RESULT_SUCCESS_OK != ::MoUefiAcpiQueryDescriptionTable(
+    if (MO_RESULT_SUCCESS_OK != ::MoUefiAcpiTableIndexQuery(
         &SystemResourceAffinityTable,
+        &AcpiTableIndex,
         EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_SIGNATURE,
         EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_REVISION,
-        ExtendedSystemDescriptionTable))
+        0))
     {
         ::MoPlatformWriteAsciiString(
             "Unable to locate ACPI SRAT.\r\n");
@@ -276,11 +2368,13 @@ void SimpleDemo(
     ::MoPlatformWriteAsciiString(
         "ACPI SRAT is located successfully.\r\n");
 
-    PMO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM MemoryHoleRanges = nullptr;
+    MO_UEFI_ACPI_SIMPLE_MEMORY_RANGE_ITEM MemoryHoleRanges[64];
     MO_UINTN MemoryHolesCount = 0u;
-    if (MO_RESULT_SUCCESS_OK != ::MoUefiAcpiQueryMemoryHoles(
-        &MemoryHoleRanges,
+    if (MO_RESULT_SUCCESS_OK != ::MoUefiAcpiCollectMemoryHoles(
+        MemoryHoleRanges,
+        nullptr,
         &MemoryHolesCount,
+        sizeof(MemoryHoleRanges) / sizeof(*MemoryHoleRanges),
         SystemResourceAffinityTable))
     {
         ::MoPlatformWriteAsciiString(
@@ -355,6 +2449,31 @@ EFI_STATUS EFIAPI UefiMain(
 
     ::SimpleDemo(SystemTable);
 
+    // Return the HPET, the FPU configuration, the interrupts, the paging and
+    // the memory types to the firmware before calling the boot services again.
+    ::MoPlatformRestoreClockSources();
+    ::MoPlatformRestoreLazyFpu();
+    ::MoPlatformRestoreDemandZeroMemory();
+    ::MoPlatformRestoreInterruptDescriptorTable();
+    ::MoPlatformRestorePageTables();
+
+    // The frame pool backs the Mobility page tables and the demand-zero pages,
+    // so it can only be freed after the firmware page tables are restored.
+    if (g_FramePoolAddress)
+    {
+        SystemTable->BootServices->FreePages(
+            g_FramePoolAddress,
+            MO_PLATFORM_X64_FRAME_POOL_PAGES);
+        g_FramePoolAddress = 0u;
+    }
+
+    // The reference TSC page overlays the memory of this image, so disable it
+    // before the memory is returned to the firmware.
+    if (MO_RESULT_SUCCESS_OK == ::MoHyperVCheckAvailability())
+    {
+        ::MoHyperVSetReferenceTscPage(0u);
+    }
+
     ::MoUefiConsoleWriteAsciiString(
         SystemTable->ConOut,
         "Hello World!\r\n");